@@ -45,6 +45,7 @@
 // #define BSP_USING_QDEC1
 // #define BSP_USING_QDEC2
 #define BSP_USING_USB
+// #define BSP_USING_CAM0
 /* ----------------------*/
 
 /* PERIPHERAL With DMA LIST */
@@ -217,6 +218,20 @@
 #endif
 #endif
 
+#if defined(BSP_USING_CAM0)
+#ifndef CAM0_CONFIG
+#define CAM0_CONFIG                              \
+    {                                            \
+        .id = 0,                                 \
+        .software_mode = CAM_AUTO_MODE,          \
+        .frame_mode = CAM_FRAME_INTERLEAVE_MODE, \
+        .yuv_format = CAM_YUV_FORMAT_YUV422,     \
+        .hsp = CAM_HSPOLARITY_HIGH,              \
+        .vsp = CAM_VSPOLARITY_HIGH,              \
+    }
+#endif
+#endif
+
 #if defined(BSP_USING_DMA0_CH0)
 #ifndef DMA0_CH0_CONFIG
 #define DMA0_CH0_CONFIG                            \
@@ -25,17 +25,31 @@
 
 // <<< Use Configuration Wizard in Context Menu >>>
 
+/* with BSP_USING_CAM0 the spare pins carry the dvp camera: pclk, hsync, vsync and d0-d7 */
+
 // <q> GPIO0 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_UART0_RTS//GPIO_FUN_UART1_RTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio0 function
+#ifdef BSP_USING_CAM0
+#define CONFIG_GPIO0_FUNC GPIO_FUN_CAM
+#else
 #define CONFIG_GPIO0_FUNC GPIO_FUN_UNUSED
+#endif
 
 // <q> GPIO1 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_UART0_CTS//GPIO_FUN_UART1_CTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio1 function
+#ifdef BSP_USING_CAM0
+#define CONFIG_GPIO1_FUNC GPIO_FUN_CAM
+#else
 #define CONFIG_GPIO1_FUNC GPIO_FUN_UNUSED
+#endif
 
 // <q> GPIO2 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_UART0_TX//GPIO_FUN_UART1_TX//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio2 function
+#ifdef BSP_USING_CAM0
+#define CONFIG_GPIO2_FUNC GPIO_FUN_CAM
+#else
 #define CONFIG_GPIO2_FUNC GPIO_FUN_UNUSED
+#endif
 
 // <q> GPIO7 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_USB//GPIO_FUN_UART0_RX//GPIO_FUN_UART1_RX//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio7 function
@@ -47,7 +61,11 @@
 
 // <q> GPIO9 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_USB//GPIO_FUN_UART0_RTS//GPIO_FUN_UART1_RTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio9 function
+#ifdef BSP_USING_CAM0
+#define CONFIG_GPIO9_FUNC GPIO_FUN_CAM
+#else
 #define CONFIG_GPIO9_FUNC GPIO_FUN_UNUSED
+#endif
 
 // <q> GPIO14 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_USB//GPIO_FUN_UART0_RTS//GPIO_FUN_UART1_RTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio14 function
@@ -59,7 +77,11 @@
 
 // <q> GPIO17 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_USB//GPIO_FUN_UART0_RTS//GPIO_FUN_UART1_RTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio17 function
+#ifdef BSP_USING_CAM0
+#define CONFIG_GPIO17_FUNC GPIO_FUN_CAM
+#else
 #define CONFIG_GPIO17_FUNC GPIO_FUN_UNUSED
+#endif
 
 // <q> GPIO19 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_ADC//GPIO_FUN_UART0_RTS//GPIO_FUN_UART1_RTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio19 function
@@ -75,26 +97,50 @@
 
 // <q> GPIO23 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_USB//GPIO_FUN_UART0_RTS//GPIO_FUN_UART1_RTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio23 function
+#ifdef BSP_USING_CAM0
+#define CONFIG_GPIO23_FUNC GPIO_FUN_CAM
+#else
 #define CONFIG_GPIO23_FUNC GPIO_FUN_UNUSED
+#endif
 
 // <q> GPIO24 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_USB//GPIO_FUN_UART0_RTS//GPIO_FUN_UART1_RTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio24 function
+#ifdef BSP_USING_CAM0
+#define CONFIG_GPIO24_FUNC GPIO_FUN_CAM
+#else
 #define CONFIG_GPIO24_FUNC GPIO_FUN_UNUSED
+#endif
 
 // <q> GPIO25 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_USB//GPIO_FUN_UART0_RTS//GPIO_FUN_UART1_RTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio25 function
+#ifdef BSP_USING_CAM0
+#define CONFIG_GPIO25_FUNC GPIO_FUN_CAM
+#else
 #define CONFIG_GPIO25_FUNC GPIO_FUN_UNUSED
+#endif
 
 // <q> GPIO26 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_USB//GPIO_FUN_UART0_RTS//GPIO_FUN_UART1_RTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio26 function
+#ifdef BSP_USING_CAM0
+#define CONFIG_GPIO26_FUNC GPIO_FUN_CAM
+#else
 #define CONFIG_GPIO26_FUNC GPIO_FUN_UNUSED
+#endif
 
 // <q> GPIO27 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_USB//GPIO_FUN_UART0_RTS//GPIO_FUN_UART1_RTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio27 function
+#ifdef BSP_USING_CAM0
+#define CONFIG_GPIO27_FUNC GPIO_FUN_CAM
+#else
 #define CONFIG_GPIO27_FUNC GPIO_FUN_UNUSED
+#endif
 
 // <q> GPIO28 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_USB//GPIO_FUN_UART0_RTS//GPIO_FUN_UART1_RTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio28 function
+#ifdef BSP_USING_CAM0
+#define CONFIG_GPIO28_FUNC GPIO_FUN_CAM
+#else
 #define CONFIG_GPIO28_FUNC GPIO_FUN_UNUSED
+#endif
 
 #endif
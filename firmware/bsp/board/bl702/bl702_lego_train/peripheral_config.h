@@ -25,8 +25,8 @@
 #define _PERIPHERAL_CONFIG_H_
 
 /* PERIPHERAL USING LIST */
-// #define BSP_USING_ADC0
-// #define BSP_USING_DAC0
+#define BSP_USING_ADC0
+#define BSP_USING_DAC0
 #define BSP_USING_UART0
 // #define BSP_USING_UART1
 // #define BSP_USING_SPI0
@@ -41,7 +41,7 @@
 #define BSP_USING_TIMER1
 #define BSP_USING_WDT
 // #define BSP_USING_KEYSCAN
-// #define BSP_USING_QDEC0
+#define BSP_USING_QDEC0
 // #define BSP_USING_QDEC1
 // #define BSP_USING_QDEC2
 // #define BSP_USING_USB
@@ -61,15 +61,15 @@
 /* PERIPHERAL CONFIG */
 #if defined(BSP_USING_ADC0)
 #ifndef ADC0_CONFIG
-#define ADC0_CONFIG                                        \
-    {                                                      \
-        .clk_div = ADC_CLOCK_DIV_32,                       \
-        .vref = ADC_VREF_2V,                              \
-        .continuous_conv_mode = DISABLE,                   \
-        .differential_mode = DISABLE,                      \
-        .data_width = ADC_DATA_WIDTH_16B_WITH_256_AVERAGE, \
-        .fifo_threshold = ADC_FIFO_THRESHOLD_1BYTE,        \
-        .gain = ADC_GAIN_1                                 \
+#define ADC0_CONFIG                                 \
+    {                                               \
+        .clk_div = ADC_CLOCK_DIV_32,                \
+        .vref = ADC_VREF_2V,                        \
+        .continuous_conv_mode = ENABLE,             \
+        .differential_mode = DISABLE,               \
+        .data_width = ADC_DATA_WIDTH_12B,           \
+        .fifo_threshold = ADC_FIFO_THRESHOLD_1BYTE, \
+        .gain = ADC_GAIN_1                          \
     }
 #endif
 #endif
@@ -284,15 +284,15 @@
         .id = 0,                                    \
         .ch = 3,                                    \
         .direction = DMA_MEMORY_TO_PERIPH,          \
-        .transfer_mode = DMA_LLI_ONCE_MODE,         \
+        .transfer_mode = DMA_LLI_PINGPONG_MODE,     \
         .src_req = DMA_REQUEST_NONE,                \
-        .dst_req = DMA_REQUEST_SPI0_TX,             \
+        .dst_req = DMA_REQUEST_DAC0,                \
         .src_addr_inc = DMA_ADDR_INCREMENT_ENABLE,  \
         .dst_addr_inc = DMA_ADDR_INCREMENT_DISABLE, \
         .src_burst_size = DMA_BURST_1BYTE,          \
         .dst_burst_size = DMA_BURST_1BYTE,          \
-        .src_width = DMA_TRANSFER_WIDTH_8BIT,       \
-        .dst_width = DMA_TRANSFER_WIDTH_8BIT,       \
+        .src_width = DMA_TRANSFER_WIDTH_32BIT,      \
+        .dst_width = DMA_TRANSFER_WIDTH_32BIT,      \
     }
 #endif
 #endif
@@ -304,15 +304,15 @@
         .id = 0,                                    \
         .ch = 4,                                    \
         .direction = DMA_PERIPH_TO_MEMORY,          \
-        .transfer_mode = DMA_LLI_ONCE_MODE,         \
-        .src_req = DMA_REQUEST_SPI0_RX,             \
+        .transfer_mode = DMA_LLI_PINGPONG_MODE,     \
+        .src_req = DMA_REQUEST_ADC0,                \
         .dst_req = DMA_REQUEST_NONE,                \
         .src_addr_inc = DMA_ADDR_INCREMENT_DISABLE, \
         .dst_addr_inc = DMA_ADDR_INCREMENT_ENABLE,  \
         .src_burst_size = DMA_BURST_1BYTE,          \
         .dst_burst_size = DMA_BURST_1BYTE,          \
-        .src_width = DMA_TRANSFER_WIDTH_8BIT,       \
-        .dst_width = DMA_TRANSFER_WIDTH_8BIT,       \
+        .src_width = DMA_TRANSFER_WIDTH_32BIT,      \
+        .dst_width = DMA_TRANSFER_WIDTH_32BIT,      \
     }
 #endif
 #endif
@@ -445,11 +445,11 @@
     {                                              \
         .id = 0,                                   \
         .acc_mode = QDEC_ACC_CONTINUE_ACCUMULATE,  \
-        .sample_mode = QDEC_SAMPLE_SINGLE_MOD,     \
-        .sample_period = QDEC_SAMPLE_PERIOD_256US, \
+        .sample_mode = QDEC_SAMPLE_CONTINUE_MOD,   \
+        .sample_period = QDEC_SAMPLE_PERIOD_64US,  \
         .report_mode = QDEC_REPORT_TIME_MOD,       \
-        .report_period = 2000,                     \
-        .led_en = ENABLE,                          \
+        .report_period = 78,                       \
+        .led_en = DISABLE,                         \
         .led_swap = DISABLE,                       \
         .led_period = 7,                           \
         .deglitch_en = DISABLE,                    \
@@ -25,6 +25,8 @@
 
 // <<< Use Configuration Wizard in Context Menu >>>
 
+/* with BSP_USING_USB GPIO7 and GPIO8 carry USB D+ and D-, for the robot_bootloader drive */
+
 // <q> GPIO0 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_UART0_RTS//GPIO_FUN_UART1_RTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio0 function
 #define CONFIG_GPIO0_FUNC GPIO_FUN_UNUSED
@@ -39,19 +41,27 @@
 
 // <q> GPIO3 <3> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_UART0_TX//GPIO_FUN_UART1_TX//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio3 function
-#define CONFIG_GPIO3_FUNC GPIO_FUN_UNUSED
+#define CONFIG_GPIO3_FUNC GPIO_FUN_PWM
 
 // <q> GPIO4 <4> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_UART0_TX//GPIO_FUN_UART1_TX//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio4 function
-#define CONFIG_GPIO4_FUNC GPIO_FUN_UNUSED
+#define CONFIG_GPIO4_FUNC GPIO_FUN_PWM
 
 // <q> GPIO7 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_USB//GPIO_FUN_UART0_RX//GPIO_FUN_UART1_RX//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio7 function
+#ifdef BSP_USING_USB
+#define CONFIG_GPIO7_FUNC GPIO_FUN_USB
+#else
 #define CONFIG_GPIO7_FUNC GPIO_FUN_UNUSED
+#endif
 
 // <q> GPIO8 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_USB//GPIO_FUN_UART0_RTS//GPIO_FUN_UART1_RTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio8 function
+#ifdef BSP_USING_USB
+#define CONFIG_GPIO8_FUNC GPIO_FUN_USB
+#else
 #define CONFIG_GPIO8_FUNC GPIO_FUN_UNUSED
+#endif
 
 // <q> GPIO9 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_USB//GPIO_FUN_UART0_RTS//GPIO_FUN_UART1_RTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio9 function
@@ -67,15 +77,19 @@
 
 // <q> GPIO17 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_USB//GPIO_FUN_UART0_RTS//GPIO_FUN_UART1_RTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio17 function
-#define CONFIG_GPIO17_FUNC GPIO_FUN_UNUSED
+#define CONFIG_GPIO17_FUNC GPIO_FUN_DAC
 
 // <q> GPIO18 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_USB//GPIO_FUN_UART0_RTS//GPIO_FUN_UART1_RTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio18 function
-#define CONFIG_GPIO18_FUNC GPIO_FUN_UNUSED
+#define CONFIG_GPIO18_FUNC GPIO_FUN_QDEC
 
 // <q> GPIO19 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_USB//GPIO_FUN_UART0_RTS//GPIO_FUN_UART1_RTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio19 function
-#define CONFIG_GPIO19_FUNC GPIO_FUN_UNUSED
+#define CONFIG_GPIO19_FUNC GPIO_FUN_QDEC
+
+// <q> GPIO20 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_ADC//GPIO_FUN_UART0_RTS//GPIO_FUN_UART1_RTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC_LED]
+// <i> config gpio20 function
+#define CONFIG_GPIO20_FUNC GPIO_FUN_ADC
 
 // <q> GPIO23 <2> [GPIO_FUN_UNUSED//GPIO_FUN_I2S//GPIO_FUN_SPI//GPIO_FUN_I2C//GPIO_FUN_PWM//GPIO_FUN_CAM//GPIO_FUN_USB//GPIO_FUN_UART0_RTS//GPIO_FUN_UART1_RTS//GPIO_FUN_ETHER_MAC//GPIO_FUN_QDEC]
 // <i> config gpio23 function
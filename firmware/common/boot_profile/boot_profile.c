@@ -0,0 +1,112 @@
+/**
+ * @file boot_profile.c
+ * @brief
+ *
+ * Copyright (c) 2021 Bouffalolab team
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "string.h"
+#include "hal_mtimer.h"
+#include "boot_profile.h"
+
+#define boot_profile ((volatile boot_profile_t *)BOOT_PROFILE_ADDR)
+
+static int boot_profile_valid(void)
+{
+    return boot_profile->magic == BOOT_PROFILE_MAGIC && boot_profile->version == BOOT_PROFILE_VERSION &&
+           boot_profile->num_marks <= BOOT_PROFILE_MAX_MARKS;
+}
+
+/* boot2 entry: a new record, the unconfirmed boot count carries over */
+void boot_profile_start(void)
+{
+    if (!boot_profile_valid()) {
+        memset((void *)boot_profile, 0, sizeof(boot_profile_t));
+        boot_profile->magic = BOOT_PROFILE_MAGIC;
+        boot_profile->version = BOOT_PROFILE_VERSION;
+    }
+
+    boot_profile->boot_count++;
+    boot_profile->num_marks = 0;
+    boot_profile->flags = 0;
+    boot_profile_mark(BOOT_PHASE_BOOT2_START);
+}
+
+/* only the first time a phase is reached counts */
+void boot_profile_mark(uint8_t phase)
+{
+    uint32_t now = (uint32_t)mtimer_get_time_us();
+    uint8_t i, n;
+
+    if (!boot_profile_valid()) {
+        return;
+    }
+
+    n = boot_profile->num_marks;
+
+    for (i = 0; i < n; i++) {
+        if (boot_profile->marks[i].phase == phase) {
+            return;
+        }
+    }
+
+    if (n < BOOT_PROFILE_MAX_MARKS) {
+        boot_profile->marks[n].time_us = now;
+        boot_profile->marks[n].phase = phase;
+        boot_profile->num_marks = n + 1;
+    }
+}
+
+void boot_profile_set_flags(uint8_t flags)
+{
+    if (boot_profile_valid()) {
+        boot_profile->flags |= flags;
+    }
+}
+
+uint8_t boot_profile_get_unconfirmed(void)
+{
+    return boot_profile_valid() ? boot_profile->unconfirmed : 0;
+}
+
+/* boot2, right before the jump: the app has to confirm this boot */
+void boot_profile_handoff(void)
+{
+    if (boot_profile_valid() && boot_profile->unconfirmed < 0xff) {
+        boot_profile->unconfirmed++;
+    }
+
+    boot_profile_mark(BOOT_PHASE_JUMP);
+}
+
+/* app, once it is up far enough to take an update */
+void boot_profile_confirm(void)
+{
+    if (boot_profile_valid()) {
+        boot_profile->unconfirmed = 0;
+    }
+
+    boot_profile_mark(BOOT_PHASE_APP_READY);
+}
+
+/* NULL after a power cycle into an app not started by boot2 */
+const boot_profile_t *boot_profile_get(void)
+{
+    return boot_profile_valid() ? (const boot_profile_t *)boot_profile : NULL;
+}
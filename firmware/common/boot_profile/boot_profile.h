@@ -0,0 +1,88 @@
+/**
+ * @file boot_profile.h
+ * @brief
+ *
+ * Copyright (c) 2021 Bouffalolab team
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#ifndef __BOOT_PROFILE_H__
+#define __BOOT_PROFILE_H__
+
+#include "stdint.h"
+
+/*
+ * Boot phase timestamps, kept in the last 256 bytes of HBN RAM so they survive
+ * the jump from boot2 into the app and any reset short of a power cycle. Apps
+ * keep their hbn_memory below this. Times are mtime in us since reset; the
+ * step from boot2's pre-jump clock setup into the app's platform init runs at
+ * the pre-jump mtimer rate and is not exact.
+ */
+#define BOOT_PROFILE_ADDR      0x40010F00
+#define BOOT_PROFILE_MAGIC     0x50544F42 /* "BOTP" */
+#define BOOT_PROFILE_VERSION   1
+#define BOOT_PROFILE_MAX_MARKS 24
+
+enum {
+    BOOT_PHASE_BOOT2_START = 0x01, /* boot2 main, after the ROM */
+    BOOT_PHASE_LOADER_INIT,        /* BLE and UART loader interfaces up */
+    BOOT_PHASE_FLASH_INIT,
+    BOOT_PHASE_PT_READY,           /* efuse config read, partition table dumped */
+    BOOT_PHASE_HANDSHAKE_END,      /* loader window closed */
+    BOOT_PHASE_IMG_CHECKED,        /* boot header parsed, image hashed */
+    BOOT_PHASE_JUMP,
+    BOOT_PHASE_APP_MAIN = 0x10,    /* app main, platform init done */
+    BOOT_PHASE_APP_TASKS,          /* scheduler running, app task entered */
+    BOOT_PHASE_APP_READY,          /* app initialised, boot confirmed */
+    BOOT_PHASE_APP_ADV,            /* advertising */
+    BOOT_PHASE_APP_CONNECTED,
+    BOOT_PHASE_APP_FIRST_MOVE,     /* first non-zero motor output */
+};
+
+/* why this boot took the path it did */
+#define BOOT_PROFILE_FLAG_FAST_BOOT   0x01 /* no loader init, no handshake window */
+#define BOOT_PROFILE_FLAG_REQ_APP     0x02 /* the app asked for the loader */
+#define BOOT_PROFILE_FLAG_REQ_GPIO    0x04 /* loader strap held */
+#define BOOT_PROFILE_FLAG_REQ_UNCONF  0x08 /* too many boots the app did not confirm */
+#define BOOT_PROFILE_FLAG_LOADER_RAN  0x10 /* a host connected to the loader */
+
+typedef struct __attribute__((packed)) {
+    uint32_t time_us;
+    uint8_t phase;
+    uint8_t reserved[3];
+} boot_profile_mark_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t num_marks;
+    uint8_t flags;
+    uint8_t unconfirmed; /* boots handed to the app since it last confirmed one */
+    uint32_t boot_count; /* since power on */
+    boot_profile_mark_t marks[BOOT_PROFILE_MAX_MARKS];
+} boot_profile_t;
+
+void boot_profile_start(void);
+void boot_profile_mark(uint8_t phase);
+void boot_profile_set_flags(uint8_t flags);
+uint8_t boot_profile_get_unconfirmed(void);
+void boot_profile_handoff(void);
+void boot_profile_confirm(void);
+const boot_profile_t *boot_profile_get(void);
+
+#endif
@@ -0,0 +1,270 @@
+/**
+ * @file dlog.c
+ * @brief
+ *
+ * Copyright (c) 2021 Bouffalolab team
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "string.h"
+#include "stdio.h"
+#include "hal_mtimer.h"
+#include "dlog.h"
+
+#define DLOG_RING_MASK (DLOG_RING_WORDS - 1)
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+/* header, timestamp in us, format address */
+#define DLOG_HDR_WORDS 3
+
+/* record header: marker, argument count, module, level */
+#define DLOG_HDR_MARK           0xD0000000
+#define DLOG_HDR_MARK_MASK      0xF0000000
+#define DLOG_HDR(level, module, nargs) \
+    (DLOG_HDR_MARK | ((uint32_t)(nargs) << 8) | ((uint32_t)(module) << 4) | (level))
+#define DLOG_HDR_NARGS(hdr)  (((hdr) >> 8) & 0x0f)
+#define DLOG_HDR_MODULE(hdr) (((hdr) >> 4) & 0x0f)
+#define DLOG_HDR_LEVEL(hdr)  ((hdr) & 0x03)
+
+#if (DLOG_RING_WORDS & DLOG_RING_MASK) || (DLOG_RING_WORDS < 2 * (DLOG_HDR_WORDS + DLOG_ARGS_MAX))
+#error "DLOG_RING_WORDS must be a power of two that holds two full records"
+#endif
+
+__attribute__((weak)) const char *const dlog_modules[DLOG_MODULE_MAX] = { "app" };
+uint8_t dlog_levels[DLOG_MODULE_MAX] = { [0 ... DLOG_MODULE_MAX - 1] = DLOG_LEVEL_INF };
+
+static uint32_t dlog_ring[DLOG_RING_WORDS];
+/* writers reserve with a compare and swap on head, the one reader frees by moving tail */
+static uint32_t dlog_head;
+static uint32_t dlog_tail;
+static dlog_out_t dlog_out;
+static dlog_notify_t dlog_notify;
+static bool dlog_binary;
+static dlog_stats_t dlog_stats;
+static uint32_t dlog_dropped_reported;
+
+void dlog_init(dlog_out_t out, dlog_notify_t notify)
+{
+    dlog_out = out;
+    dlog_notify = notify;
+}
+
+void dlog_set_binary(bool binary)
+{
+    dlog_binary = binary;
+}
+
+void dlog_set_level(uint8_t module, uint8_t level)
+{
+    if (module < DLOG_MODULE_MAX) {
+        dlog_levels[module] = level;
+    }
+}
+
+void dlog_write(uint8_t level, uint8_t module, const char *fmt, const uint32_t *args, uint8_t nargs)
+{
+    uint32_t words = DLOG_HDR_WORDS + nargs;
+    uint32_t head, used, i;
+
+    do {
+        head = __atomic_load_n(&dlog_head, __ATOMIC_RELAXED);
+        used = head - __atomic_load_n(&dlog_tail, __ATOMIC_ACQUIRE);
+
+        if (used + words > DLOG_RING_WORDS) {
+            dlog_stats.dropped++;
+            dlog_stats.module_dropped[module]++;
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&dlog_head, &head, head + words, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    dlog_ring[(head + 1) & DLOG_RING_MASK] = (uint32_t)mtimer_get_time_us();
+    dlog_ring[(head + 2) & DLOG_RING_MASK] = (uint32_t)(uintptr_t)fmt;
+    for (i = 0; i < nargs; i++) {
+        dlog_ring[(head + DLOG_HDR_WORDS + i) & DLOG_RING_MASK] = args[i];
+    }
+    /* the header goes last, the reader stops at a slot without one */
+    __atomic_store_n(&dlog_ring[head & DLOG_RING_MASK], DLOG_HDR(level, module, nargs), __ATOMIC_RELEASE);
+
+    dlog_stats.written++;
+    if (used + words > dlog_stats.high_water) {
+        dlog_stats.high_water = used + words;
+    }
+
+    if (used == 0 && dlog_notify) {
+        dlog_notify();
+    }
+}
+
+static void dlog_render_hex(const uint32_t *rec, uint32_t words)
+{
+    static const char hex[] = "0123456789abcdef";
+    char line[5 + (DLOG_HDR_WORDS + DLOG_ARGS_MAX) * 8 + 3] = "DLOG:";
+    uint32_t len = 5;
+    uint32_t i, b, byte;
+
+    for (i = 0; i < words; i++) {
+        /* little endian, like the words sit in memory */
+        for (b = 0; b < 4; b++) {
+            byte = (rec[i] >> (b * 8)) & 0xff;
+            line[len++] = hex[byte >> 4];
+            line[len++] = hex[byte & 0x0f];
+        }
+    }
+    line[len++] = '\r';
+    line[len++] = '\n';
+    dlog_out(line, len);
+}
+
+static void dlog_render_text(const uint32_t *rec)
+{
+    static const char levels[] = "DIWE";
+    uint32_t hdr = rec[0];
+    uint32_t nargs = DLOG_HDR_NARGS(hdr);
+    const char *module = dlog_modules[DLOG_HDR_MODULE(hdr)];
+    uintptr_t a[DLOG_ARGS_MAX] = { 0 };
+    char line[DLOG_LINE_MAX];
+    int len;
+    uint32_t i;
+
+    for (i = 0; i < nargs; i++) {
+        a[i] = rec[DLOG_HDR_WORDS + i];
+    }
+
+    /* room for the line end, longer lines are cut */
+    len = snprintf(line, sizeof(line) - 2, "%lu.%06lu %c/%s: ", (unsigned long)(rec[1] / 1000000), (unsigned long)(rec[1] % 1000000),
+                   levels[DLOG_HDR_LEVEL(hdr)], module ? module : "?");
+    len = MIN(len, (int)sizeof(line) - 3);
+    /* every argument is one word, extra ones are ignored by the format */
+    len += snprintf(line + len, sizeof(line) - 2 - len, (const char *)(uintptr_t)rec[2],
+                    a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+    len = MIN(len, (int)sizeof(line) - 3);
+    line[len++] = '\r';
+    line[len++] = '\n';
+    dlog_out(line, len);
+}
+
+static void dlog_report_dropped(void)
+{
+    uint32_t dropped = dlog_stats.dropped;
+    uint32_t rec[DLOG_HDR_WORDS + 1];
+    char line[48];
+    int len;
+
+    if (dropped == dlog_dropped_reported) {
+        return;
+    }
+
+    if (dlog_binary) {
+        /* a record without format, its argument is the count */
+        rec[0] = DLOG_HDR(DLOG_LEVEL_WRN, 0, 1);
+        rec[1] = (uint32_t)mtimer_get_time_us();
+        rec[2] = 0;
+        rec[3] = dropped - dlog_dropped_reported;
+        dlog_render_hex(rec, DLOG_HDR_WORDS + 1);
+    } else {
+        len = snprintf(line, sizeof(line), "dlog: %lu dropped\r\n", (unsigned long)(dropped - dlog_dropped_reported));
+        dlog_out(line, len);
+    }
+
+    dlog_dropped_reported = dropped;
+}
+
+uint32_t dlog_process(uint32_t max)
+{
+    uint32_t rec[DLOG_HDR_WORDS + DLOG_ARGS_MAX];
+    uint32_t n = 0;
+    uint32_t tail, hdr, words, i;
+
+    while (n < max) {
+        tail = dlog_tail;
+        if (tail == __atomic_load_n(&dlog_head, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+
+        hdr = __atomic_load_n(&dlog_ring[tail & DLOG_RING_MASK], __ATOMIC_ACQUIRE);
+        if ((hdr & DLOG_HDR_MARK_MASK) != DLOG_HDR_MARK) {
+            /* reserved but still being written */
+            break;
+        }
+
+        words = DLOG_HDR_WORDS + DLOG_HDR_NARGS(hdr);
+        for (i = 0; i < words; i++) {
+            rec[i] = dlog_ring[(tail + i) & DLOG_RING_MASK];
+            dlog_ring[(tail + i) & DLOG_RING_MASK] = 0;
+        }
+        __atomic_store_n(&dlog_tail, tail + words, __ATOMIC_RELEASE);
+
+        if (dlog_out) {
+            if (dlog_binary) {
+                dlog_render_hex(rec, words);
+            } else {
+                dlog_render_text(rec);
+            }
+        }
+        n++;
+    }
+
+    if (dlog_out) {
+        dlog_report_dropped();
+    }
+
+    return n;
+}
+
+void dlog_flush(void)
+{
+    while (dlog_process(UINT32_MAX)) {
+    }
+}
+
+void dlog_get_stats(dlog_stats_t *stats)
+{
+    *stats = dlog_stats;
+}
+
+uint32_t dlog_bench_ns(void)
+{
+    /* as many records as fit, so the run never takes the drop path */
+    const uint32_t batch = DLOG_RING_WORDS / (DLOG_HDR_WORDS + 2);
+    const uint32_t loops = (1000 + batch - 1) / batch;
+    dlog_stats_t saved;
+    uint64_t start, total_us = 0;
+    uint32_t i, j;
+
+    dlog_flush();
+    saved = dlog_stats;
+
+    for (i = 0; i < loops; i++) {
+        start = mtimer_get_time_us();
+        for (j = 0; j < batch; j++) {
+            const uint32_t args[] = { j, i };
+            dlog_write(DLOG_LEVEL_INF, 0, "bench %u %u", args, 2);
+        }
+        total_us += mtimer_get_time_us() - start;
+
+        memset(dlog_ring, 0, sizeof(dlog_ring));
+        dlog_tail = dlog_head;
+    }
+
+    dlog_stats = saved;
+
+    return (uint32_t)(total_us * 1000 / (batch * loops));
+}
@@ -0,0 +1,121 @@
+/**
+ * @file dlog.h
+ * @brief
+ *
+ * Copyright (c) 2021 Bouffalolab team
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#ifndef __DLOG_H__
+#define __DLOG_H__
+
+#include "stdint.h"
+#include "stdbool.h"
+
+/*
+ * Deferred logging. A call stores the format string address, a timestamp and its
+ * arguments as raw words in a ring; nothing is formatted on the caller. dlog_process()
+ * renders the records later from a low priority task, as text or as "DLOG:<hex>"
+ * lines that tools/dlog/dlog_decode.py turns into text with the strings of the ELF.
+ *
+ * Arguments are stored as 32 bit words: integers, chars and pointers. %s only works
+ * for strings that outlive the record (literals, static names), %f and %lld do not.
+ */
+#define DLOG_LEVEL_DBG 0
+#define DLOG_LEVEL_INF 1
+#define DLOG_LEVEL_WRN 2
+#define DLOG_LEVEL_ERR 3
+#define DLOG_LEVEL_OFF 4
+
+/* ring size in words, a power of two; a record is 3 words plus one per argument */
+#ifndef DLOG_RING_WORDS
+#define DLOG_RING_WORDS 256
+#endif
+
+#define DLOG_MODULE_MAX 16
+#define DLOG_ARGS_MAX   8
+/* longest rendered line */
+#define DLOG_LINE_MAX   128
+
+/* a source file sets DLOG_MODULE before it includes dlog.h */
+#ifndef DLOG_MODULE
+#define DLOG_MODULE 0
+#endif
+
+typedef struct {
+    uint32_t written;
+    uint32_t dropped;
+    /* most words the ring held at once */
+    uint16_t high_water;
+    uint16_t module_dropped[DLOG_MODULE_MAX];
+} dlog_stats_t;
+
+/* receives rendered text or DLOG: lines, from dlog_process() */
+typedef void (*dlog_out_t)(const char *text, uint32_t len);
+/* called when a record lands in an empty ring, may run in an interrupt */
+typedef void (*dlog_notify_t)(void);
+
+/* module names by DLOG_MODULE, an application replaces this weak default */
+extern const char *const dlog_modules[DLOG_MODULE_MAX];
+/* lowest level that is recorded, per module */
+extern uint8_t dlog_levels[DLOG_MODULE_MAX];
+
+#define DLOG_CAT_(a, b) a##b
+#define DLOG_CAT(a, b)  DLOG_CAT_(a, b)
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+#define DLOG_NARGS(...) DLOG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+
+#define DLOG_ARG(x) ((uint32_t)(uintptr_t)(x))
+#define DLOG_MAP_0()
+#define DLOG_MAP_1(a)                      DLOG_ARG(a)
+#define DLOG_MAP_2(a, b)                   DLOG_ARG(a), DLOG_ARG(b)
+#define DLOG_MAP_3(a, b, c)                DLOG_MAP_2(a, b), DLOG_ARG(c)
+#define DLOG_MAP_4(a, b, c, d)             DLOG_MAP_3(a, b, c), DLOG_ARG(d)
+#define DLOG_MAP_5(a, b, c, d, e)          DLOG_MAP_4(a, b, c, d), DLOG_ARG(e)
+#define DLOG_MAP_6(a, b, c, d, e, f)       DLOG_MAP_5(a, b, c, d, e), DLOG_ARG(f)
+#define DLOG_MAP_7(a, b, c, d, e, f, g)    DLOG_MAP_6(a, b, c, d, e, f), DLOG_ARG(g)
+#define DLOG_MAP_8(a, b, c, d, e, f, g, h) DLOG_MAP_7(a, b, c, d, e, f, g), DLOG_ARG(h)
+#define DLOG_MAP(...)                      DLOG_CAT(DLOG_MAP_, DLOG_NARGS(__VA_ARGS__))(__VA_ARGS__)
+
+#define DLOG(level, fmt, ...)                                                                  \
+    do {                                                                                       \
+        if ((level) >= dlog_levels[DLOG_MODULE]) {                                             \
+            const uint32_t dlog_args_[] = { 0, DLOG_MAP(__VA_ARGS__) };                        \
+            dlog_write((level), DLOG_MODULE, (fmt), &dlog_args_[1], DLOG_NARGS(__VA_ARGS__)); \
+        }                                                                                      \
+    } while (0)
+
+#define DLOG_D(fmt, ...) DLOG(DLOG_LEVEL_DBG, fmt, ##__VA_ARGS__)
+#define DLOG_I(fmt, ...) DLOG(DLOG_LEVEL_INF, fmt, ##__VA_ARGS__)
+#define DLOG_W(fmt, ...) DLOG(DLOG_LEVEL_WRN, fmt, ##__VA_ARGS__)
+#define DLOG_E(fmt, ...) DLOG(DLOG_LEVEL_ERR, fmt, ##__VA_ARGS__)
+
+void dlog_init(dlog_out_t out, dlog_notify_t notify);
+/* DLOG:<hex> lines for the host decoder instead of text */
+void dlog_set_binary(bool binary);
+void dlog_set_level(uint8_t module, uint8_t level);
+void dlog_write(uint8_t level, uint8_t module, const char *fmt, const uint32_t *args, uint8_t nargs);
+/* render at most max records, returns how many it did */
+uint32_t dlog_process(uint32_t max);
+/* render everything, for fault handlers */
+void dlog_flush(void);
+void dlog_get_stats(dlog_stats_t *stats);
+/* time 1000 calls of a two argument DLOG_I, the records are discarded */
+uint32_t dlog_bench_ns(void);
+
+#endif
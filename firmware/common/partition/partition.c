@@ -451,12 +451,14 @@ pt_table_error_type pt_table_get_iap_para(pt_table_iap_param_type *para)
         if (pt_stuff[0].pt_table.age >= pt_stuff[1].pt_table.age) {
             active_index = pt_stuff[0].pt_entries[0].active_index;
             para->iap_write_addr = para->iap_start_addr = pt_stuff[0].pt_entries[0].start_address[!(active_index & 0x01)];
+            para->iap_max_len = pt_stuff[0].pt_entries[0].max_len[!(active_index & 0x01)];
             para->inactive_index = !(active_index & 0x01);
             para->inactive_table_index = 1;
 
         } else {
             active_index = pt_stuff[1].pt_entries[0].active_index;
             para->iap_write_addr = para->iap_start_addr = pt_stuff[1].pt_entries[0].start_address[!(active_index & 0x01)];
+            para->iap_max_len = pt_stuff[1].pt_entries[0].max_len[!(active_index & 0x01)];
             para->inactive_index = !(active_index & 0x01);
             para->inactive_table_index = 0;
         }
@@ -464,11 +466,13 @@ pt_table_error_type pt_table_get_iap_para(pt_table_iap_param_type *para)
     } else if (pt_valid[1] == 1) {
         active_index = pt_stuff[1].pt_entries[0].active_index;
         para->iap_write_addr = para->iap_start_addr = pt_stuff[1].pt_entries[0].start_address[!(active_index & 0x01)];
+        para->iap_max_len = pt_stuff[1].pt_entries[0].max_len[!(active_index & 0x01)];
         para->inactive_index = !(active_index & 0x01);
         para->inactive_table_index = 0;
     } else if (pt_valid[0] == 1) {
         active_index = pt_stuff[0].pt_entries[0].active_index;
         para->iap_write_addr = para->iap_start_addr = pt_stuff[0].pt_entries[0].start_address[!(active_index & 0x01)];
+        para->iap_max_len = pt_stuff[0].pt_entries[0].max_len[!(active_index & 0x01)];
         para->inactive_index = !(active_index & 0x01);
         para->inactive_table_index = 1;
     } else {
@@ -128,6 +128,7 @@ typedef struct
     uint32_t iap_start_addr;
     uint32_t iap_write_addr;
     uint32_t iap_img_len;
+    uint32_t iap_max_len;
     uint8_t inactive_index;
     uint8_t inactive_table_index;
 } pt_table_iap_param_type;
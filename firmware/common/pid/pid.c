@@ -66,3 +66,35 @@ float increment_pid_cal(pid_alg_t *pid, float next_val)
 
     return pid->out_val;
 }
+
+// closed loop pid, error is taken against a measured feedback value
+float feedback_pid_cal(pid_alg_t *pid, float set_val, float feedback_val)
+{
+    float out;
+
+    pid->set_val = set_val;
+    pid->i_error = pid->set_val - feedback_val;
+    pid->sum_error += pid->i_error;
+
+    /* anti-windup: keep the integral term inside the output range */
+    if (pid->ki != 0.0f) {
+        if (pid->ki * pid->sum_error > pid->max_val) {
+            pid->sum_error = pid->max_val / pid->ki;
+        } else if (pid->ki * pid->sum_error < pid->min_val) {
+            pid->sum_error = pid->min_val / pid->ki;
+        }
+    }
+
+    out = pid->kp * pid->i_error + pid->ki * pid->sum_error + pid->kd * (pid->i_error - pid->last_error);
+    pid->last_error = pid->i_error;
+
+    if (out > pid->max_val) {
+        out = pid->max_val;
+    } else if (out < pid->min_val) {
+        out = pid->min_val;
+    }
+
+    pid->out_val = out;
+
+    return pid->out_val;
+}
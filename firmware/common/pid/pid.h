@@ -46,5 +46,6 @@ typedef struct pid_alg {
 void pid_init(pid_alg_t *pid);
 float standard_pid_cal(pid_alg_t *pid, float next_val);
 float increment_pid_cal(pid_alg_t *pid, float next_val);
+float feedback_pid_cal(pid_alg_t *pid, float set_val, float feedback_val);
 
 #endif
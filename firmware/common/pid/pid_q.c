@@ -0,0 +1,206 @@
+/**
+ * @file pid_q.c
+ * @brief
+ *
+ * Copyright (c) 2021 Bouffalolab team
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "pid_q.h"
+
+void pid_q_init(pid_q_alg_t *pid)
+{
+    pid->set_val = 0;
+    pid->out_val = 0;
+
+    pid->last_error = 0;
+    pid->prev_error = 0;
+
+    /* kp 3 like pid_init(), the limits are the whole Q31 range */
+    pid->shift = 2;
+    pid->kp = PID_Q_GAIN(3.0, 2);
+    pid->ki = 0;
+    pid->kd = 0;
+    pid->d_alpha = 0;
+
+    pid->i_error = 0;
+    pid->i_term = 0;
+    pid->d_term = 0;
+
+    pid->max_val = Q31_MAX;
+    pid->min_val = Q31_MIN;
+}
+
+/* out + alpha * (in - out); the difference may reach 2^32, alpha < 1 brings it back in range */
+static q31_t pid_q_smooth(q31_t out, q31_t in, q31_t alpha)
+{
+    return q31_sat(out + ((((int64_t)in - out) * alpha + (1 << 30)) >> 31));
+}
+
+static q31_t pid_q_derivative(pid_q_alg_t *pid, q31_t diff)
+{
+    q31_t d = q31_mul_shift(pid->kd, diff, pid->shift);
+
+    if (pid->d_alpha == 0) {
+        pid->d_term = d;
+    } else {
+        pid->d_term = pid_q_smooth(pid->d_term, d, pid->d_alpha);
+    }
+
+    return pid->d_term;
+}
+
+static q31_t pid_q_sum(q31_t p, q31_t i, q31_t d)
+{
+    return q31_sat((int64_t)p + i + d);
+}
+
+// standard pid
+q31_t standard_pid_q_cal(pid_q_alg_t *pid, q31_t next_val)
+{
+    q31_t p, d;
+
+    pid->set_val = next_val;
+    pid->i_error = q31_sub(pid->set_val, pid->out_val);
+    pid->i_term = q31_add(pid->i_term, q31_mul_shift(pid->ki, pid->i_error, pid->shift));
+    p = q31_mul_shift(pid->kp, pid->i_error, pid->shift);
+    d = pid_q_derivative(pid, q31_sub(pid->i_error, pid->last_error));
+    pid->out_val = pid_q_sum(p, pid->i_term, d);
+    pid->last_error = pid->i_error;
+
+    return pid->out_val;
+}
+
+// increment pid
+q31_t increment_pid_q_cal(pid_q_alg_t *pid, q31_t next_val)
+{
+    q31_t p, i, d;
+
+    pid->set_val = next_val;
+    pid->i_error = q31_sub(pid->set_val, pid->out_val);
+    p = q31_mul_shift(pid->kp, q31_sub(pid->i_error, pid->prev_error), pid->shift);
+    i = q31_mul_shift(pid->ki, pid->i_error, pid->shift);
+    d = pid_q_derivative(pid, q31_sat((int64_t)pid->i_error - 2 * (int64_t)pid->prev_error + pid->last_error));
+    pid->out_val = q31_sat((int64_t)pid->out_val + p + i + d);
+    pid->last_error = pid->prev_error;
+    pid->prev_error = pid->i_error;
+
+    return pid->out_val;
+}
+
+// closed loop pid, error is taken against a measured feedback value
+q31_t feedback_pid_q_cal(pid_q_alg_t *pid, q31_t set_val, q31_t feedback_val)
+{
+    q31_t p, d, out;
+
+    pid->set_val = set_val;
+    pid->i_error = q31_sub(pid->set_val, feedback_val);
+    pid->i_term = q31_add(pid->i_term, q31_mul_shift(pid->ki, pid->i_error, pid->shift));
+
+    /* anti-windup: keep the integral term inside the output range */
+    if (pid->i_term > pid->max_val) {
+        pid->i_term = pid->max_val;
+    } else if (pid->i_term < pid->min_val) {
+        pid->i_term = pid->min_val;
+    }
+
+    p = q31_mul_shift(pid->kp, pid->i_error, pid->shift);
+    d = pid_q_derivative(pid, q31_sub(pid->i_error, pid->last_error));
+    out = pid_q_sum(p, pid->i_term, d);
+    pid->last_error = pid->i_error;
+
+    if (out > pid->max_val) {
+        out = pid->max_val;
+    } else if (out < pid->min_val) {
+        out = pid->min_val;
+    }
+
+    pid->out_val = out;
+
+    return pid->out_val;
+}
+
+void lpf_q31_init(lpf_q31_t *lpf, q31_t alpha, q31_t out)
+{
+    lpf->alpha = alpha;
+    lpf->out = out;
+}
+
+// first order low pass, out += alpha * (in - out)
+q31_t lpf_q31(lpf_q31_t *lpf, q31_t in)
+{
+    lpf->out = pid_q_smooth(lpf->out, in, lpf->alpha);
+
+    return lpf->out;
+}
+
+void lpf_q15_init(lpf_q15_t *lpf, q15_t alpha, q15_t out)
+{
+    lpf->alpha = alpha;
+    lpf->acc = (q31_t)out * 65536;
+}
+
+q15_t lpf_q15(lpf_q15_t *lpf, q15_t in)
+{
+    lpf->acc = pid_q_smooth(lpf->acc, (q31_t)in * 65536, (q31_t)lpf->alpha * 65536);
+
+    return q15_sat((int32_t)(((int64_t)lpf->acc + (1 << 15)) >> 16));
+}
+
+void slew_q31_init(slew_q31_t *slew, q31_t rate, q31_t out)
+{
+    slew->rate = rate;
+    slew->out = out;
+}
+
+// steps towards target by at most rate per call
+q31_t slew_q31(slew_q31_t *slew, q31_t target)
+{
+    int64_t step = (int64_t)target - slew->out;
+
+    if (step > slew->rate) {
+        step = slew->rate;
+    } else if (step < -(int64_t)slew->rate) {
+        step = -(int64_t)slew->rate;
+    }
+
+    slew->out = (q31_t)(slew->out + step);
+
+    return slew->out;
+}
+
+void slew_q15_init(slew_q15_t *slew, q15_t rate, q15_t out)
+{
+    slew->rate = rate;
+    slew->out = out;
+}
+
+q15_t slew_q15(slew_q15_t *slew, q15_t target)
+{
+    int32_t step = (int32_t)target - slew->out;
+
+    if (step > slew->rate) {
+        step = slew->rate;
+    } else if (step < -slew->rate) {
+        step = -slew->rate;
+    }
+
+    slew->out = (q15_t)(slew->out + step);
+
+    return slew->out;
+}
@@ -0,0 +1,173 @@
+/**
+ * @file pid_q.h
+ * @brief
+ *
+ * Copyright (c) 2021 Bouffalolab team
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#ifndef __PID_Q_H__
+#define __PID_Q_H__
+
+#include "stdint.h"
+
+/*
+ * Fixed point counterparts of pid.h plus the small filters a control loop needs,
+ * free of float so they are safe in interrupts that do not save the fpu state.
+ * Signals are Q31 (or Q15) fractions of a full scale the caller picks, e.g. ticks/s
+ * over 4096. Everything saturates instead of wrapping. tools/pid/pid_bench.c checks
+ * the results against the float code on the host.
+ */
+typedef int16_t q15_t;
+typedef int32_t q31_t;
+
+#define Q15_MAX INT16_MAX
+#define Q15_MIN INT16_MIN
+#define Q31_MAX INT32_MAX
+#define Q31_MIN INT32_MIN
+
+/* constants from float, folded by the compiler; 1.0 and beyond saturate */
+#define Q15(x) ((q15_t)((x) >= 1.0 ? Q15_MAX : ((x) <= -1.0 ? Q15_MIN : (x)*32768.0 + ((x) < 0 ? -0.5 : 0.5))))
+#define Q31(x) ((q31_t)((x) >= 1.0 ? Q31_MAX : ((x) <= -1.0 ? Q31_MIN : (x)*2147483648.0 + ((x) < 0 ? -0.5 : 0.5))))
+
+/* a gain k stored for pid_q_alg_t.shift, |k| < 2^shift */
+#define PID_Q_GAIN(k, shift) Q31((k) / (double)(1UL << (shift)))
+/* low pass coefficient for a cutoff at fc with updates at fs */
+#define LPF_Q_ALPHA(fc, fs) (6.2831853 * (fc) / (6.2831853 * (fc) + (fs)))
+
+static inline q15_t q15_sat(int32_t v)
+{
+    return (v > Q15_MAX) ? Q15_MAX : ((v < Q15_MIN) ? Q15_MIN : (q15_t)v);
+}
+
+static inline q31_t q31_sat(int64_t v)
+{
+    return (v > Q31_MAX) ? Q31_MAX : ((v < Q31_MIN) ? Q31_MIN : (q31_t)v);
+}
+
+static inline q15_t q15_add(q15_t a, q15_t b)
+{
+    return q15_sat((int32_t)a + b);
+}
+
+static inline q15_t q15_sub(q15_t a, q15_t b)
+{
+    return q15_sat((int32_t)a - b);
+}
+
+/* rounded, -1 * -1 saturates */
+static inline q15_t q15_mul(q15_t a, q15_t b)
+{
+    return q15_sat(((int32_t)a * b + (1 << 14)) >> 15);
+}
+
+static inline q31_t q31_add(q31_t a, q31_t b)
+{
+    return q31_sat((int64_t)a + b);
+}
+
+static inline q31_t q31_sub(q31_t a, q31_t b)
+{
+    return q31_sat((int64_t)a - b);
+}
+
+static inline q31_t q31_mul(q31_t a, q31_t b)
+{
+    return q31_sat(((int64_t)a * b + (1 << 30)) >> 31);
+}
+
+/* a * b * 2^shift, shift up to 30 */
+static inline q31_t q31_mul_shift(q31_t a, q31_t b, uint8_t shift)
+{
+    return q31_sat(((int64_t)a * b + (1LL << (30 - shift))) >> (31 - shift));
+}
+
+/* an integer against a full scale of 2^bits, and back rounded */
+static inline q31_t q31_from_int(int32_t v, uint8_t bits)
+{
+    return q31_sat((int64_t)v * (1LL << (31 - bits)));
+}
+
+static inline int32_t q31_to_int(q31_t q, uint8_t bits)
+{
+    return (int32_t)(((int64_t)q + (1LL << (30 - bits))) >> (31 - bits));
+}
+
+typedef struct pid_q_alg {
+    q31_t set_val;
+    q31_t out_val;
+
+    /* each gain is kp * 2^shift etc, see PID_Q_GAIN() */
+    q31_t kp;
+    q31_t ki;
+    q31_t kd;
+    uint8_t shift;
+    /* low pass on the derivative term, LPF_Q_ALPHA() as Q31; 0 leaves it unfiltered */
+    q31_t d_alpha;
+
+    q31_t i_error;
+    q31_t last_error;
+    q31_t prev_error;
+    /*
+     * ki * sum_error of the float code, accumulated as a term so the anti-windup
+     * clamp needs no division; a changed ki applies to new errors only
+     */
+    q31_t i_term;
+    q31_t d_term;
+
+    q31_t max_val;
+    q31_t min_val;
+} pid_q_alg_t;
+
+typedef struct {
+    q31_t alpha;
+    q31_t out;
+} lpf_q31_t;
+
+typedef struct {
+    q15_t alpha;
+    /* Q31 so that a small alpha still settles on the input */
+    q31_t acc;
+} lpf_q15_t;
+
+typedef struct {
+    q31_t rate; /* most change per call */
+    q31_t out;
+} slew_q31_t;
+
+typedef struct {
+    q15_t rate;
+    q15_t out;
+} slew_q15_t;
+
+void pid_q_init(pid_q_alg_t *pid);
+q31_t standard_pid_q_cal(pid_q_alg_t *pid, q31_t next_val);
+q31_t increment_pid_q_cal(pid_q_alg_t *pid, q31_t next_val);
+q31_t feedback_pid_q_cal(pid_q_alg_t *pid, q31_t set_val, q31_t feedback_val);
+
+void lpf_q31_init(lpf_q31_t *lpf, q31_t alpha, q31_t out);
+q31_t lpf_q31(lpf_q31_t *lpf, q31_t in);
+void lpf_q15_init(lpf_q15_t *lpf, q15_t alpha, q15_t out);
+q15_t lpf_q15(lpf_q15_t *lpf, q15_t in);
+
+void slew_q31_init(slew_q31_t *slew, q31_t rate, q31_t out);
+q31_t slew_q31(slew_q31_t *slew, q31_t target);
+void slew_q15_init(slew_q15_t *slew, q15_t rate, q15_t out);
+q15_t slew_q15(slew_q15_t *slew, q15_t target);
+
+#endif
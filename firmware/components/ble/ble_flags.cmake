@@ -191,6 +191,17 @@ if(NOT DEFINED CFG_BLE_PDS)
 set(CFG_BLE_PDS 0)
 endif()
 
+# P-256 for LE Secure Connections on the PKA, tinycrypt stays as the fallback;
+# opt in per app, the PKA holds the security engine for the whole multiplication
+if(NOT DEFINED CONFIG_BT_HCI_ECC_HW)
+set(CONFIG_BT_HCI_ECC_HW 0)
+endif()
+
+# host AES-128 (bt_encrypt_le, RPA resolution, SMP) on the security engine
+if(NOT DEFINED CONFIG_BT_HOST_AES_HW)
+set(CONFIG_BT_HOST_AES_HW 1)
+endif()
+
 if(CONFIG_BT_OAD_SERVER)
 set(CONFIG_BT_OAD_SERVER 1)
 endif()
@@ -325,6 +336,14 @@ if(CFG_BLE_PDS)
 list(APPEND CFLAGS -DCFG_BLE_PDS)
 endif()
 
+if(CONFIG_BT_HCI_ECC_HW AND "${CHIP}" STREQUAL "bl702" AND NOT CONFIG_HW_SEC_ENG_DISABLE)
+list(APPEND CFLAGS -DCONFIG_BT_HCI_ECC_HW)
+endif()
+
+if(CONFIG_BT_HOST_AES_HW AND "${CHIP}" STREQUAL "bl702" AND NOT CONFIG_HW_SEC_ENG_DISABLE)
+list(APPEND CFLAGS -DCONFIG_BT_HOST_AES_HW)
+endif()
+
 list(APPEND CFLAGS -DCONFIG_BT_L2CAP_DYNAMIC_CHANNEL)
 list(APPEND CFLAGS -DCONFIG_BT_GATT_CLIENT)
 list(APPEND CFLAGS -DCONFIG_BT_CONN)
@@ -16,6 +16,13 @@
 #if defined(CONFIG_HOGP_SERVER)
 #include "hog.h"
 #endif
+#if defined(CONFIG_BT_TINYCRYPT_ECC)
+#include "hci_ecc.h"
+#endif
+#if defined(CONFIG_BT_SMP)
+#include "rpa.h"
+#include "../include/bluetooth/crypto.h"
+#endif
 
 #define PASSKEY_MAX   0xF423F
 #define NAME_LEN      30
@@ -77,6 +84,10 @@ static void blecli_auth_cancel(char *pcWriteBuffer, int xWriteBufferLen, int arg
 static void blecli_auth_passkey_confirm(char *pcWriteBuffer, int xWriteBufferLen, int argc, char **argv);
 static void blecli_auth_pairing_confirm(char *pcWriteBuffer, int xWriteBufferLen, int argc, char **argv);
 static void blecli_auth_passkey(char *pcWriteBuffer, int xWriteBufferLen, int argc, char **argv);
+static void blecli_aes_bench(char *pcWriteBuffer, int xWriteBufferLen, int argc, char **argv);
+#if defined(CONFIG_BT_TINYCRYPT_ECC)
+static void blecli_ecc_backend(char *pcWriteBuffer, int xWriteBufferLen, int argc, char **argv);
+#endif
 #endif
 static void blecli_exchange_mtu(char *pcWriteBuffer, int xWriteBufferLen, int argc, char **argv);
 static void blecli_discover(char *pcWriteBuffer, int xWriteBufferLen, int argc, char **argv);
@@ -176,6 +187,12 @@ const struct cli_command btStackCmdSet[] STATIC_CLI_CMD_ATTRIBUTE = {
 
     {"ble_auth_passkey", "\r\nble_auth_passkey:[Input passkey]\r\n[Passkey, 00000000-000F423F]", blecli_auth_passkey},
 
+    {"ble_aes_bench", "\r\nble_aes_bench:[Measure AES and RPA resolution throughput]\r\n[Loops, default 1024]\r\n", blecli_aes_bench},
+
+#if defined(CONFIG_BT_TINYCRYPT_ECC)
+    {"ble_ecc_backend", "\r\nble_ecc_backend:[Select the P-256 backend for pairing]\r\n[Backend, 0:TinyCrypt, 1:PKA]\r\n", blecli_ecc_backend},
+#endif
+
 #endif //CONFIG_BT_SMP
 
 #if defined(CONFIG_BT_GATT_CLIENT)
@@ -275,6 +292,10 @@ const struct cli_command btStackCmdSet[] STATIC_CLI_CMD_ATTRIBUTE = {
     { "ble_auth_passkey_confirm", "", blecli_auth_passkey_confirm },
     { "ble_auth_pairing_confirm", "", blecli_auth_pairing_confirm },
     { "ble_auth_passkey", "", blecli_auth_passkey },
+    { "ble_aes_bench", "", blecli_aes_bench },
+#if defined(CONFIG_BT_TINYCRYPT_ECC)
+    { "ble_ecc_backend", "", blecli_ecc_backend },
+#endif
 #endif //CONFIG_BT_SMP
 #if defined(CONFIG_BT_GATT_CLIENT)
     { "ble_exchange_mtu", "", blecli_exchange_mtu },
@@ -962,6 +983,9 @@ static void blecli_conn_update(char *pcWriteBuffer, int xWriteBufferLen, int arg
 #endif //#if defined(CONFIG_BT_CONN)
 
 #if defined(CONFIG_BT_SMP)
+/* set when ble_security starts pairing, reported on completion */
+static u32_t security_start_ms;
+
 static void blecli_security(char *pcWriteBuffer, int xWriteBufferLen, int argc, char **argv)
 {
     int err;
@@ -975,6 +999,7 @@ static void blecli_security(char *pcWriteBuffer, int xWriteBufferLen, int argc,
     if (argc == 2)
         get_uint8_from_string(&argv[1], &sec_level);
 
+    security_start_ms = k_uptime_get_32();
     err = bt_conn_set_security(default_conn, sec_level);
 
     if (err) {
@@ -1036,6 +1061,20 @@ static void auth_pairing_complete(struct bt_conn *conn, bool bonded)
     bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
 
     vOutputString("%s with %s\r\n", bonded ? "Bonded" : "Paired", addr);
+
+    if (security_start_ms) {
+        vOutputString("Pairing took %d ms\r\n", k_uptime_get_32() - security_start_ms);
+        security_start_ms = 0;
+    }
+
+#if defined(CONFIG_BT_TINYCRYPT_ECC)
+    struct bt_hci_ecc_stats stats;
+
+    bt_hci_ecc_get_stats(&stats);
+    vOutputString("P-256 public key %d us (cpu %d us), DHKey %d us (cpu %d us), hw %d/%d, sw %d/%d, fallbacks %d\r\n",
+                  stats.pub_key_us, stats.pub_key_cpu_us, stats.dhkey_us, stats.dhkey_cpu_us,
+                  stats.pub_key_hw, stats.dhkey_hw, stats.pub_key_sw, stats.dhkey_sw, stats.hw_fallbacks);
+#endif
 }
 
 static void auth_pairing_failed(struct bt_conn *conn, enum bt_security_err reason)
@@ -1130,6 +1169,89 @@ static void blecli_auth_passkey(char *pcWriteBuffer, int xWriteBufferLen, int ar
     bt_conn_auth_passkey_entry(default_conn, passkey);
 }
 
+/*
+ * AES throughput and how many advertising reports per second the scanner
+ * can resolve, one report at a time and in BT_RPA_BATCH_MAX bursts. Every
+ * RPA is checked against CONFIG_BT_MAX_PAIRED IRKs and none match, the worst
+ * case for a scan with a full bond table.
+ */
+static void blecli_aes_bench(char *pcWriteBuffer, int xWriteBufferLen, int argc, char **argv)
+{
+    static u8_t irk[CONFIG_BT_MAX_PAIRED][16];
+    static bt_addr_t rpa[BT_RPA_BATCH_MAX];
+    struct bt_crypto_stats stats;
+    u8_t block[16] = { 0 };
+    u32_t loops = 1024;
+    u32_t matched;
+    u32_t start_ms;
+    u32_t single_ms;
+    u32_t batch_ms;
+    u32_t i;
+    int k;
+
+    if (argc == 2) {
+        loops = atoi(argv[1]);
+    }
+
+    loops = MAX(loops / BT_RPA_BATCH_MAX, 1U) * BT_RPA_BATCH_MAX;
+
+    bt_rand(irk, sizeof(irk));
+    bt_rand(rpa, sizeof(rpa));
+    for (i = 0; i < BT_RPA_BATCH_MAX; i++) {
+        BT_ADDR_SET_RPA(&rpa[i]);
+    }
+
+    start_ms = k_uptime_get_32();
+    for (i = 0; i < loops; i++) {
+        bt_encrypt_le(irk[i % CONFIG_BT_MAX_PAIRED], block, block);
+    }
+    single_ms = MAX(k_uptime_get_32() - start_ms, 1U);
+
+    start_ms = k_uptime_get_32();
+    for (i = 0; i < loops / BT_RPA_BATCH_MAX; i++) {
+        for (k = 0; k < CONFIG_BT_MAX_PAIRED; k++) {
+            bt_rpa_irk_matches_batch(irk[k], rpa, BT_RPA_BATCH_MAX, &matched);
+        }
+    }
+    batch_ms = MAX(k_uptime_get_32() - start_ms, 1U);
+
+    vOutputString("AES single: %d blocks in %d ms, %d ops/s\r\n",
+                  loops, single_ms, loops * 1000 / single_ms);
+    vOutputString("AES batch: %d blocks in %d ms, %d ops/s\r\n",
+                  loops * CONFIG_BT_MAX_PAIRED, batch_ms,
+                  (u32_t)((u64_t)loops * CONFIG_BT_MAX_PAIRED * 1000 / batch_ms));
+    vOutputString("Scan with %d IRKs: %d adv/s single, %d adv/s batched\r\n",
+                  CONFIG_BT_MAX_PAIRED, loops * 1000 / single_ms / CONFIG_BT_MAX_PAIRED,
+                  loops * 1000 / batch_ms);
+
+    bt_crypto_get_stats(&stats);
+    vOutputString("hw %d, sw %d, fallbacks %d, sw key loads %d\r\n",
+                  stats.hw_blocks, stats.sw_blocks, stats.hw_fallbacks, stats.key_loads);
+}
+
+#if defined(CONFIG_BT_TINYCRYPT_ECC)
+/* pair once with each backend and compare the times printed on completion */
+static void blecli_ecc_backend(char *pcWriteBuffer, int xWriteBufferLen, int argc, char **argv)
+{
+    u8_t backend = 0;
+    int err;
+
+    if (argc != 2) {
+        vOutputString("Number of Parameters is not correct\r\n");
+        return;
+    }
+
+    get_uint8_from_string(&argv[1], &backend);
+
+    err = bt_hci_ecc_set_backend(backend);
+    if (err) {
+        vOutputString("Failed to select the backend (err %d)\r\n", err);
+    } else {
+        vOutputString("P-256 on %s\r\n", backend == BT_HCI_ECC_BACKEND_HW ? "PKA" : "TinyCrypt");
+    }
+}
+#endif
+
 #endif //#if defined(CONFIG_BT_SMP)
 
 #if defined(CONFIG_BT_GATT_CLIENT)
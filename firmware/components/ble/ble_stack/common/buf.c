@@ -89,6 +89,10 @@ extern struct net_buf_pool hf_pool;
 extern struct net_buf_pool dummy_pool;
 #endif
 
+#if defined(CONFIG_BT_L2CAP_DYNAMIC_CHANNEL) && (CONFIG_BT_L2CAP_COC_BUF_COUNT > 0)
+extern struct net_buf_pool l2cap_coc_pool;
+#endif
+
 #if defined(CONFIG_AUTO_PTS)
 extern struct net_buf_pool server_pool;
 extern struct net_buf_pool data_pool;
@@ -127,6 +131,9 @@ struct net_buf_pool *_net_buf_pool_list[] = {
     &hf_pool,
     &dummy_pool,
 #endif
+#if defined(CONFIG_BT_L2CAP_DYNAMIC_CHANNEL) && (CONFIG_BT_L2CAP_COC_BUF_COUNT > 0)
+    &l2cap_coc_pool,
+#endif
 #if defined(CONFIG_AUTO_PTS)
     &server_pool,
     &data_pool,
@@ -87,12 +87,24 @@ extern "C" {
 
 #endif /*BFLB_BLE*/
 
+#if defined(CONFIG_BT_DEBUG_MONITOR)
+/* keeps the HCI capture of what led up to the assert */
+extern void bt_monitor_assert(void);
+#define BT_ASSERT_MONITOR() bt_monitor_assert()
+#else
+#define BT_ASSERT_MONITOR()
+#endif
+
 #if defined(CONFIG_BT_ASSERT)
 #if defined(BFLB_BLE)
 extern void user_vAssertCalled(void);
-#define BT_ASSERT(cond) \
-    if ((cond) == 0)    \
-    user_vAssertCalled()
+#define BT_ASSERT(cond)               \
+    do {                              \
+        if ((cond) == 0) {            \
+            BT_ASSERT_MONITOR();      \
+            user_vAssertCalled();     \
+        }                             \
+    } while (0)
 #else
 #define BT_ASSERT(cond)                   \
     if (!(cond)) {                        \
@@ -24,6 +24,7 @@
 #include <utils.h>
 #include <cmac_mode.h>
 #include <../include/bluetooth/crypto.h>
+#include "rpa.h"
 
 #define BT_DBG_ENABLED  IS_ENABLED(CONFIG_BT_DEBUG_RPA)
 #define LOG_MODULE_NAME bt_rpa
@@ -74,6 +75,44 @@ bool bt_rpa_irk_matches(const u8_t irk[16], const bt_addr_t *addr)
 
     return !memcmp(addr->val, hash, 3);
 }
+
+/*
+ * Check a burst of RPAs against one IRK. All the ah() inputs go through a
+ * single bt_encrypt_le_blocks() call, so the key is loaded once per burst
+ * instead of once per address. Bit i of matched is set if addrs[i] resolves.
+ */
+int bt_rpa_irk_matches_batch(const u8_t irk[16], const bt_addr_t *addrs,
+                             u8_t count, u32_t *matched)
+{
+    u8_t res[BT_RPA_BATCH_MAX][16];
+    int err;
+    u8_t i;
+
+    if (count > BT_RPA_BATCH_MAX) {
+        return -EINVAL;
+    }
+
+    *matched = 0U;
+
+    /* r' = padding || r */
+    (void)memset(res, 0, count * 16);
+    for (i = 0; i < count; i++) {
+        memcpy(res[i], addrs[i].val + 3, 3);
+    }
+
+    err = bt_encrypt_le_blocks(irk, res[0], res[0], count);
+    if (err) {
+        return err;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (!memcmp(addrs[i].val, res[i], 3)) {
+            *matched |= BIT(i);
+        }
+    }
+
+    return 0;
+}
 #endif
 
 #if defined(CONFIG_BT_PRIVACY) || defined(CONFIG_BT_CTLR_PRIVACY)
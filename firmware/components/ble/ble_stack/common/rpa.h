@@ -12,5 +12,10 @@
 #include "bluetooth.h"
 #include "hci_host.h"
 
+/* most addresses bt_rpa_irk_matches_batch() checks in one call */
+#define BT_RPA_BATCH_MAX 16
+
 bool bt_rpa_irk_matches(const u8_t irk[16], const bt_addr_t *addr);
+int bt_rpa_irk_matches_batch(const u8_t irk[16], const bt_addr_t *addrs,
+                             u8_t count, u32_t *matched);
 int bt_rpa_create(const u8_t irk[16], bt_addr_t *rpa);
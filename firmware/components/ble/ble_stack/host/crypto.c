@@ -19,6 +19,7 @@
 #include <hmac_prng.h>
 #include <aes.h>
 #include <utils.h>
+#include <../include/bluetooth/crypto.h>
 
 #define BT_DBG_ENABLED  IS_ENABLED(CONFIG_BT_DEBUG_HCI_CORE)
 #define LOG_MODULE_NAME bt_crypto
@@ -26,6 +27,28 @@
 
 #include "hci_core.h"
 
+#if defined(CONFIG_BT_HOST_AES_HW)
+#include "hal_sec_aes.h"
+
+/* blocks handed to the engine per request, longer runs are split */
+#define AES_HW_BATCH_BLOCKS 16
+
+static sec_aes_handle_t aes_hw_handle = {
+    .aes_type = SEC_AES_ECB,
+    .key_type = SEC_AES_KEY_128,
+};
+/* the engine reads and writes memory directly, keep both sides word aligned */
+static u8_t aes_hw_in[AES_HW_BATCH_BLOCKS * 16] __aligned(4);
+static u8_t aes_hw_out[AES_HW_BATCH_BLOCKS * 16] __aligned(4);
+#endif
+
+/* SMP and RPA resolution tend to reuse the last key, keep its schedule */
+static struct tc_aes_key_sched_struct aes_sw_sched;
+static u8_t aes_sw_key[16];
+static bool aes_sw_key_valid;
+
+static struct bt_crypto_stats crypto_stats;
+
 static struct tc_hmac_prng_struct prng;
 
 static int prng_reseed(struct tc_hmac_prng_struct *h)
@@ -117,25 +140,121 @@ int bt_rand(void *buf, size_t len)
 #endif
 }
 
+#if defined(CONFIG_BT_HOST_AES_HW)
+/*
+ * The key registers are rewritten on every request: the mbedTLS port and
+ * boot2 decryption drive the same engine between two of ours, so a loaded key
+ * cannot be trusted to still be there. Loading it is a handful of register
+ * writes. The engine lock also covers the bounce buffers.
+ */
+static int aes_hw_encrypt(const u8_t key[16], const u8_t *in, u8_t *out,
+                          size_t blocks)
+{
+    static const u8_t iv[16];
+    size_t len;
+    int err = 0;
+
+    sec_eng_lock();
+
+    sec_aes_setkey(&aes_hw_handle, key, 16, iv, SEC_AES_DIR_ENCRYPT);
+
+    while (blocks) {
+        len = MIN(blocks, AES_HW_BATCH_BLOCKS) * 16;
+
+        memcpy(aes_hw_in, in, len);
+        if (sec_aes_encrypt(&aes_hw_handle, aes_hw_in, len, 0, aes_hw_out)) {
+            err = -EIO;
+            break;
+        }
+        memcpy(out, aes_hw_out, len);
+
+        in += len;
+        out += len;
+        blocks -= len / 16;
+    }
+
+    sec_eng_unlock();
+
+    return err;
+}
+#endif
+
+static int aes_sw_encrypt(const u8_t key[16], const u8_t *in, u8_t *out,
+                          size_t blocks)
+{
+    struct tc_aes_key_sched_struct s;
+    unsigned int lock;
+    bool cached;
+
+    lock = irq_lock();
+    cached = aes_sw_key_valid && !memcmp(aes_sw_key, key, 16);
+    if (cached) {
+        memcpy(&s, &aes_sw_sched, sizeof(s));
+    }
+    irq_unlock(lock);
+
+    if (!cached) {
+        if (tc_aes128_set_encrypt_key(&s, key) == TC_CRYPTO_FAIL) {
+            return -EINVAL;
+        }
+
+        lock = irq_lock();
+        memcpy(aes_sw_key, key, 16);
+        memcpy(&aes_sw_sched, &s, sizeof(s));
+        aes_sw_key_valid = true;
+        crypto_stats.key_loads++;
+        irq_unlock(lock);
+    }
+
+    for (; blocks; blocks--, in += 16, out += 16) {
+        if (tc_aes_encrypt(out, in, &s) == TC_CRYPTO_FAIL) {
+            return -EINVAL;
+        }
+    }
+
+    return 0;
+}
+
+/* big endian key and blocks, in and out may overlap exactly */
+static int aes_encrypt(const u8_t key[16], const u8_t *in, u8_t *out,
+                       size_t blocks)
+{
+    int err;
+
+#if defined(CONFIG_BT_HOST_AES_HW)
+    if (!aes_hw_encrypt(key, in, out, blocks)) {
+        crypto_stats.hw_blocks += blocks;
+        return 0;
+    }
+
+    BT_WARN("AES engine failed, using TinyCrypt");
+    crypto_stats.hw_fallbacks++;
+#endif
+
+    err = aes_sw_encrypt(key, in, out, blocks);
+    if (!err) {
+        crypto_stats.sw_blocks += blocks;
+    }
+
+    return err;
+}
+
 int bt_encrypt_le(const u8_t key[16], const u8_t plaintext[16],
                   u8_t enc_data[16])
 {
-    struct tc_aes_key_sched_struct s;
+    u8_t tmp_key[16];
     u8_t tmp[16];
+    int err;
 
     BT_DBG("key %s", bt_hex(key, 16));
     BT_DBG("plaintext %s", bt_hex(plaintext, 16));
 
-    sys_memcpy_swap(tmp, key, 16);
-
-    if (tc_aes128_set_encrypt_key(&s, tmp) == TC_CRYPTO_FAIL) {
-        return -EINVAL;
-    }
-
+    sys_memcpy_swap(tmp_key, key, 16);
     sys_memcpy_swap(tmp, plaintext, 16);
 
-    if (tc_aes_encrypt(enc_data, tmp, &s) == TC_CRYPTO_FAIL) {
-        return -EINVAL;
+    err = aes_encrypt(tmp_key, tmp, enc_data, 1);
+    if (err) {
+        return err;
     }
 
     sys_mem_swap(enc_data, 16);
@@ -145,23 +264,54 @@ int bt_encrypt_le(const u8_t key[16], const u8_t plaintext[16],
     return 0;
 }
 
+int bt_encrypt_le_blocks(const u8_t key[16], const u8_t *plaintext,
+                         u8_t *enc_data, size_t blocks)
+{
+    u8_t tmp_key[16];
+    size_t i;
+    int err;
+
+    sys_memcpy_swap(tmp_key, key, 16);
+
+    for (i = 0; i < blocks; i++) {
+        if (enc_data == plaintext) {
+            sys_mem_swap(&enc_data[i * 16], 16);
+        } else {
+            sys_memcpy_swap(&enc_data[i * 16], &plaintext[i * 16], 16);
+        }
+    }
+
+    err = aes_encrypt(tmp_key, enc_data, enc_data, blocks);
+    if (err) {
+        return err;
+    }
+
+    for (i = 0; i < blocks; i++) {
+        sys_mem_swap(&enc_data[i * 16], 16);
+    }
+
+    return 0;
+}
+
 int bt_encrypt_be(const u8_t key[16], const u8_t plaintext[16],
                   u8_t enc_data[16])
 {
-    struct tc_aes_key_sched_struct s;
+    int err;
 
     BT_DBG("key %s", bt_hex(key, 16));
     BT_DBG("plaintext %s", bt_hex(plaintext, 16));
 
-    if (tc_aes128_set_encrypt_key(&s, key) == TC_CRYPTO_FAIL) {
-        return -EINVAL;
-    }
-
-    if (tc_aes_encrypt(enc_data, plaintext, &s) == TC_CRYPTO_FAIL) {
-        return -EINVAL;
+    err = aes_encrypt(key, plaintext, enc_data, 1);
+    if (err) {
+        return err;
     }
 
     BT_DBG("enc_data %s", bt_hex(enc_data, 16));
 
     return 0;
 }
+
+void bt_crypto_get_stats(struct bt_crypto_stats *stats)
+{
+    memcpy(stats, &crypto_stats, sizeof(*stats));
+}
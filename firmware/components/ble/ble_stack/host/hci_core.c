@@ -3981,14 +3981,57 @@ void bt_data_parse(struct net_buf_simple *ad,
     }
 }
 
+#if defined(CONFIG_BT_SMP)
+/*
+ * Resolve the RPAs of all the reports in one event up front, a busy scan
+ * delivers several per event and each IRK then costs one key load for the
+ * whole burst. Returns how many leading reports keys[] covers.
+ */
+static u8_t le_adv_resolve_batch(struct net_buf *buf, u8_t num_reports,
+                                 struct bt_keys **keys)
+{
+    struct bt_hci_evt_le_advertising_info *info;
+    bt_addr_le_t addrs[BT_RPA_BATCH_MAX];
+    struct net_buf_simple_state state;
+    u8_t count = 0U;
+
+    net_buf_simple_save(&buf->b, &state);
+
+    while (count < num_reports && count < BT_RPA_BATCH_MAX) {
+        if (buf->len < sizeof(*info)) {
+            break;
+        }
+
+        info = net_buf_pull_mem(buf, sizeof(*info));
+        if (buf->len < info->length + sizeof(s8_t)) {
+            break;
+        }
+
+        bt_addr_le_copy(&addrs[count++], &info->addr);
+        net_buf_pull(buf, info->length + sizeof(s8_t));
+    }
+
+    net_buf_simple_restore(&buf->b, &state);
+
+    bt_keys_find_irk_batch(bt_dev.adv_id, addrs, count, keys);
+
+    return count;
+}
+#endif /* CONFIG_BT_SMP */
+
 static void le_adv_report(struct net_buf *buf)
 {
     u8_t num_reports = net_buf_pull_u8(buf);
     struct bt_hci_evt_le_advertising_info *info;
+    u8_t report;
+#if defined(CONFIG_BT_SMP)
+    struct bt_keys *keys[BT_RPA_BATCH_MAX];
+    u8_t batched = le_adv_resolve_batch(buf, num_reports, keys);
+#endif
 
     BT_DBG("Adv number of reports %u", num_reports);
 
-    while (num_reports--) {
+    for (report = 0U; report < num_reports; report++) {
         bt_addr_le_t id_addr;
         s8_t rssi;
 
@@ -4008,6 +4051,11 @@ static void le_adv_report(struct net_buf *buf)
             info->addr.type == BT_ADDR_LE_RANDOM_ID) {
             bt_addr_le_copy(&id_addr, &info->addr);
             id_addr.type -= BT_ADDR_LE_PUBLIC_ID;
+#if defined(CONFIG_BT_SMP)
+        } else if (report < batched) {
+            bt_addr_le_copy(&id_addr,
+                            keys[report] ? &keys[report]->addr : &info->addr);
+#endif
         } else {
             bt_addr_le_copy(&id_addr,
                             bt_lookup_id_addr(bt_dev.adv_id,
@@ -5718,6 +5766,9 @@ void bt_delete_queue(struct k_fifo *queue_to_del)
 #if defined(BFLB_DYNAMIC_ALLOC_MEM) && (CONFIG_BT_CONN)
 extern struct net_buf_pool acl_tx_pool;
 extern struct net_buf_pool prep_pool;
+#if defined(CONFIG_BT_L2CAP_DYNAMIC_CHANNEL) && (CONFIG_BT_L2CAP_COC_BUF_COUNT > 0)
+extern struct net_buf_pool l2cap_coc_pool;
+#endif
 #if defined(CONFIG_BT_BREDR)
 extern struct net_buf_pool br_sig_pool;
 extern struct net_buf_pool sdp_pool;
@@ -5771,6 +5822,9 @@ int bt_disable_action(void)
 #if (CONFIG_BT_L2CAP_TX_FRAG_COUNT > 0)
     net_buf_deinit(&frag_pool);
 #endif
+#if defined(CONFIG_BT_L2CAP_DYNAMIC_CHANNEL) && (CONFIG_BT_L2CAP_COC_BUF_COUNT > 0)
+    net_buf_deinit(&l2cap_coc_pool);
+#endif
 #if defined(CONFIG_BT_BREDR)
     net_buf_deinit(&br_sig_pool);
     net_buf_deinit(&sdp_pool);
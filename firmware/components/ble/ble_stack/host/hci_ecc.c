@@ -9,6 +9,7 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <errno.h>
 #include <zephyr.h>
 #include <atomic.h>
 #include <misc/stack.h>
@@ -28,6 +29,15 @@
 #include "log.h"
 
 #include "hci_ecc.h"
+#if defined(CONFIG_BT_HCI_ECC_HW)
+#include "hal_sec_ecdsa.h"
+#endif
+#if defined(BL_MCU_SDK)
+#include "bflb_platform.h"
+#define ecc_time_us() ((u32_t)bflb_platform_get_time_us())
+#else
+#define ecc_time_us() (k_uptime_get_32() * 1000U)
+#endif
 #ifdef CONFIG_BT_HCI_RAW
 #include <bluetooth/hci_raw.h>
 #include "hci_raw_internal.h"
@@ -69,14 +79,174 @@ static ATOMIC_DEFINE(flags, NUM_FLAGS);
 
 static K_SEM_DEFINE(cmd_sem, 0, 1);
 
+/* word aligned, the PKA reads and writes its operands as words */
 static struct {
     u8_t private_key[32];
+    /* own or peer key; apart from the result so a fallback still has it */
+    u8_t pk[64];
+    u8_t dhkey[32];
+} __aligned(4) ecc;
+
+static struct bt_hci_ecc_stats ecc_stats;
+
+#if defined(CONFIG_BT_HCI_ECC_HW)
+static u8_t ecc_backend = BT_HCI_ECC_BACKEND_HW;
+#else
+static u8_t ecc_backend = BT_HCI_ECC_BACKEND_SW;
+#endif
+
+#if defined(CONFIG_BT_HCI_ECC_HW)
+/*
+ * Scalar bits per PKA step. The ecc thread runs above the host RX thread, so
+ * it sleeps a tick between steps and the host keeps running while the PKA
+ * works through the multiplication.
+ */
+#define ECC_HW_STEP_BITS 32
+
+/*
+ * P-256 on the security engine PKA, operands are big-endian like tinycrypt's.
+ * The PKA keeps the point between steps, the engine stays locked throughout.
+ * Adds the time spent in the steps to cpu_us.
+ */
+static int ecc_hw_scalar_point(const u8_t *peer_pk, u8_t *x, u8_t *y, u32_t *cpu_us)
+{
+    sec_ecdh_handle_t ecdh_handle;
+    u32_t start_us;
+    int left;
+
+    sec_eng_lock();
+
+    start_us = ecc_time_us();
+    sec_ecdh_init(&ecdh_handle, ECP_SECP256R1);
+    left = sec_ecdh_scalar_point_start(&ecdh_handle, peer_pk ? (uint32_t *)peer_pk : NULL,
+                                       peer_pk ? (uint32_t *)&peer_pk[32] : NULL,
+                                       (uint32_t *)ecc.private_key);
+    if (!left) {
+        left = sec_ecdh_scalar_point_step(&ecdh_handle, ECC_HW_STEP_BITS);
+    }
+
+    while (left > 0) {
+        *cpu_us += ecc_time_us() - start_us;
+        k_sleep(1);
+        start_us = ecc_time_us();
+        left = sec_ecdh_scalar_point_step(&ecdh_handle, ECC_HW_STEP_BITS);
+    }
+
+    if (!left) {
+        left = sec_ecdh_scalar_point_finish(&ecdh_handle, (uint32_t *)x, (uint32_t *)y);
+    }
+
+    sec_ecdh_deinit(&ecdh_handle);
+    *cpu_us += ecc_time_us() - start_us;
+
+    sec_eng_unlock();
+
+    return left;
+}
+
+static int ecc_hw_make_key(u32_t *cpu_us)
+{
+    sec_ecdsa_handle_t key_handle;
+    int err;
+
+    key_handle.ecpId = ECP_SECP256R1;
+
+    /* private key from the TRNG, below the curve order */
+    sec_eng_trng_enable();
+    err = sec_ecdsa_get_private_key(&key_handle, (uint32_t *)ecc.private_key);
+    if (err) {
+        return err;
+    }
+
+    return ecc_hw_scalar_point(NULL, ecc.pk, &ecc.pk[32], cpu_us);
+}
 
-    union {
-        u8_t pk[64];
-        u8_t dhkey[32];
-    };
-} ecc;
+static int ecc_hw_shared_secret(u32_t *cpu_us)
+{
+    u32_t dhkey_y[8];
+
+    return ecc_hw_scalar_point(ecc.pk, ecc.dhkey, (u8_t *)dhkey_y, cpu_us);
+}
+#endif
+
+static int ecc_make_key(void)
+{
+    u32_t start_us = ecc_time_us();
+    u32_t cpu_us = 0;
+    u32_t sw_us;
+    int rc;
+
+#if defined(CONFIG_BT_HCI_ECC_HW)
+    if (ecc_backend == BT_HCI_ECC_BACKEND_HW) {
+        if (!ecc_hw_make_key(&cpu_us)) {
+            ecc_stats.pub_key_hw++;
+            ecc_stats.pub_key_us = ecc_time_us() - start_us;
+            ecc_stats.pub_key_cpu_us = cpu_us;
+            return TC_CRYPTO_SUCCESS;
+        }
+
+        BT_WARN("PKA key generation failed, using tinycrypt");
+        ecc_stats.hw_fallbacks++;
+    }
+#endif
+
+    sw_us = ecc_time_us();
+    rc = uECC_make_key(ecc.pk, ecc.private_key, &curve_secp256r1);
+    ecc_stats.pub_key_sw++;
+    ecc_stats.pub_key_us = ecc_time_us() - start_us;
+    /* tinycrypt computes all along, plus what a failed PKA attempt took */
+    ecc_stats.pub_key_cpu_us = cpu_us + ecc_time_us() - sw_us;
+    return rc;
+}
+
+static int ecc_shared_secret(void)
+{
+    u32_t start_us = ecc_time_us();
+    u32_t cpu_us = 0;
+    u32_t sw_us;
+    int rc;
+
+#if defined(CONFIG_BT_HCI_ECC_HW)
+    if (ecc_backend == BT_HCI_ECC_BACKEND_HW) {
+        if (!ecc_hw_shared_secret(&cpu_us)) {
+            ecc_stats.dhkey_hw++;
+            ecc_stats.dhkey_us = ecc_time_us() - start_us;
+            ecc_stats.dhkey_cpu_us = cpu_us;
+            return TC_CRYPTO_SUCCESS;
+        }
+
+        BT_WARN("PKA DHKey failed, using tinycrypt");
+        ecc_stats.hw_fallbacks++;
+    }
+#endif
+
+    sw_us = ecc_time_us();
+    rc = uECC_shared_secret(ecc.pk, ecc.private_key, ecc.dhkey, &curve_secp256r1);
+    ecc_stats.dhkey_sw++;
+    ecc_stats.dhkey_us = ecc_time_us() - start_us;
+    ecc_stats.dhkey_cpu_us = cpu_us + ecc_time_us() - sw_us;
+    return rc;
+}
+
+void bt_hci_ecc_get_stats(struct bt_hci_ecc_stats *stats)
+{
+    *stats = ecc_stats;
+}
+
+int bt_hci_ecc_set_backend(u8_t backend)
+{
+    if (backend == BT_HCI_ECC_BACKEND_HW) {
+#if !defined(CONFIG_BT_HCI_ECC_HW)
+        return -ENOTSUP;
+#endif
+    } else if (backend != BT_HCI_ECC_BACKEND_SW) {
+        return -EINVAL;
+    }
+
+    /* taken up by the next command, one in progress finishes where it is */
+    ecc_backend = backend;
+    return 0;
+}
 
 static void send_cmd_status(u16_t opcode, u8_t status)
 {
@@ -107,7 +277,7 @@ static u8_t generate_keys(void)
     do {
         int rc;
 
-        rc = uECC_make_key(ecc.pk, ecc.private_key, &curve_secp256r1);
+        rc = ecc_make_key();
         if (rc == TC_CRYPTO_FAIL) {
             BT_ERR("Failed to create ECC public/private pair");
             return BT_HCI_ERR_UNSPECIFIED;
@@ -170,13 +340,13 @@ static void emulate_le_generate_dhkey(void)
     struct net_buf *buf;
     int ret;
 
+    /* the PKA does not check the peer key is on the curve, tinycrypt always does */
     ret = uECC_valid_public_key(ecc.pk, &curve_secp256r1);
     if (ret < 0) {
         BT_ERR("public key is not valid (ret %d)", ret);
         ret = TC_CRYPTO_FAIL;
     } else {
-        ret = uECC_shared_secret(ecc.pk, ecc.private_key, ecc.dhkey,
-                                 &curve_secp256r1);
+        ret = ecc_shared_secret();
     }
 
     buf = bt_buf_get_rx(BT_BUF_EVT, K_FOREVER);
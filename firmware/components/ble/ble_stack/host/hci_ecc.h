@@ -6,5 +6,27 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+enum {
+    BT_HCI_ECC_BACKEND_SW,
+    BT_HCI_ECC_BACKEND_HW,
+};
+
+/* last P-256 operation times and which backend served them */
+struct bt_hci_ecc_stats {
+    u32_t pub_key_us;
+    u32_t dhkey_us;
+    /* of those, the time the CPU spent on them */
+    u32_t pub_key_cpu_us;
+    u32_t dhkey_cpu_us;
+    u32_t pub_key_hw;
+    u32_t pub_key_sw;
+    u32_t dhkey_hw;
+    u32_t dhkey_sw;
+    u32_t hw_fallbacks;
+};
+
 void bt_hci_ecc_init(void);
+void bt_hci_ecc_get_stats(struct bt_hci_ecc_stats *stats);
+/* BT_HCI_ECC_BACKEND_HW only with CONFIG_BT_HCI_ECC_HW, where it is the default */
+int bt_hci_ecc_set_backend(u8_t backend);
 int bt_hci_ecc_send(struct net_buf *buf);
@@ -213,6 +213,80 @@ struct bt_keys *bt_keys_find_irk(u8_t id, const bt_addr_le_t *addr)
     return NULL;
 }
 
+/*
+ * bt_keys_find_irk() for up to BT_RPA_BATCH_MAX addresses, e.g. all the
+ * reports of one advertising event. Each IRK is checked against every
+ * still unresolved RPA in one go. keys[i] is set for each resolved
+ * addrs[i] and NULL otherwise, the number resolved is returned.
+ */
+u8_t bt_keys_find_irk_batch(u8_t id, const bt_addr_le_t *addrs, u8_t count,
+                            struct bt_keys **keys)
+{
+    bt_addr_t rpa[BT_RPA_BATCH_MAX];
+    u8_t idx[BT_RPA_BATCH_MAX];
+    u32_t pending = 0U;
+    u32_t matched;
+    u8_t resolved = 0U;
+    u8_t num;
+    int i, j;
+
+    count = MIN(count, BT_RPA_BATCH_MAX);
+
+    for (j = 0; j < count; j++) {
+        keys[j] = NULL;
+
+        if (!bt_addr_le_is_rpa(&addrs[j])) {
+            continue;
+        }
+
+        for (i = 0; i < ARRAY_SIZE(key_pool); i++) {
+            if ((key_pool[i].keys & BT_KEYS_IRK) && key_pool[i].id == id &&
+                !bt_addr_cmp(&addrs[j].a, &key_pool[i].irk.rpa)) {
+                keys[j] = &key_pool[i];
+                resolved++;
+                break;
+            }
+        }
+
+        if (!keys[j]) {
+            pending |= BIT(j);
+        }
+    }
+
+    for (i = 0; i < ARRAY_SIZE(key_pool) && pending; i++) {
+        if (!(key_pool[i].keys & BT_KEYS_IRK) || key_pool[i].id != id) {
+            continue;
+        }
+
+        for (j = 0, num = 0; j < count; j++) {
+            if (pending & BIT(j)) {
+                bt_addr_copy(&rpa[num], &addrs[j].a);
+                idx[num++] = j;
+            }
+        }
+
+        if (bt_rpa_irk_matches_batch(key_pool[i].irk.val, rpa, num, &matched)) {
+            break;
+        }
+
+        for (j = 0; j < num; j++) {
+            if (!(matched & BIT(j))) {
+                continue;
+            }
+
+            BT_DBG("RPA %s matches %s", bt_addr_str(&rpa[j]),
+                   bt_addr_le_str(&key_pool[i].addr));
+
+            bt_addr_copy(&key_pool[i].irk.rpa, &rpa[j]);
+            keys[idx[j]] = &key_pool[i];
+            pending &= ~BIT(idx[j]);
+            resolved++;
+        }
+    }
+
+    return resolved;
+}
+
 struct bt_keys *bt_keys_find_addr(u8_t id, const bt_addr_le_t *addr)
 {
     int i;
@@ -69,6 +69,20 @@ static sys_slist_t le_channels;
 
 static sys_slist_t servers;
 
+#if CONFIG_BT_L2CAP_COC_BUF_COUNT > 0
+/* One MPS per buffer, so every received segment fits one fragment and an SDU
+ * up to the MPS goes out without a copy.
+ */
+#define L2CAP_COC_BUF_SIZE BT_L2CAP_BUF_SIZE(L2CAP_MAX_LE_MPS)
+
+#if !defined(BFLB_DYNAMIC_ALLOC_MEM)
+NET_BUF_POOL_FIXED_DEFINE(l2cap_coc_pool, CONFIG_BT_L2CAP_COC_BUF_COUNT,
+                          L2CAP_COC_BUF_SIZE, NULL);
+#else
+struct net_buf_pool l2cap_coc_pool;
+#endif
+#endif /* CONFIG_BT_L2CAP_COC_BUF_COUNT > 0 */
+
 #endif /* CONFIG_BT_L2CAP_DYNAMIC_CHANNEL */
 
 /* L2CAP signalling channel specific context */
@@ -286,6 +300,13 @@ static void l2cap_rx_process(struct k_work *work)
     struct bt_l2cap_le_chan *ch = CHAN_RX(work);
     struct net_buf *buf;
 
+#ifdef BFLB_BLE_PATCH_FREE_ALLOCATED_BUFFER_IN_OS
+    /* Work still pending when the channel was destroyed */
+    if (!ch->rx_queue._queue.hdl) {
+        return;
+    }
+#endif
+
     while ((buf = net_buf_get(&ch->rx_queue, K_NO_WAIT))) {
         BT_DBG("ch %p buf %p", ch, buf);
         l2cap_chan_le_recv(ch, buf);
@@ -808,6 +829,27 @@ static void l2cap_chan_destroy(struct bt_l2cap_chan *chan)
         ch->_sdu = NULL;
         ch->_sdu_len = 0U;
     }
+
+#ifdef BFLB_BLE_PATCH_FREE_ALLOCATED_BUFFER_IN_OS
+    /* Created again by every channel setup */
+    if (ch->rx.credits.sem.hdl) {
+        k_sem_delete(&ch->rx.credits);
+    }
+
+    if (ch->tx.credits.sem.hdl) {
+        k_sem_delete(&ch->tx.credits);
+    }
+
+    if (ch->tx_queue._queue.hdl) {
+        k_queue_free(&ch->tx_queue._queue);
+        ch->tx_queue._queue.hdl = NULL;
+    }
+
+    if (ch->rx_queue._queue.hdl) {
+        k_queue_free(&ch->rx_queue._queue);
+        ch->rx_queue._queue.hdl = NULL;
+    }
+#endif
 }
 
 static u16_t le_err_to_result(int err)
@@ -1572,6 +1614,22 @@ int bt_l2cap_chan_recv_complete(struct bt_l2cap_chan *chan, struct net_buf *buf)
     return 0;
 }
 
+#if CONFIG_BT_L2CAP_COC_BUF_COUNT > 0
+struct net_buf *bt_l2cap_chan_buf_alloc(s32_t timeout)
+{
+    struct net_buf *buf;
+
+    buf = net_buf_alloc(&l2cap_coc_pool, timeout);
+    if (!buf) {
+        return NULL;
+    }
+
+    net_buf_reserve(buf, BT_L2CAP_CHAN_SEND_RESERVE);
+
+    return buf;
+}
+#endif
+
 static struct net_buf *l2cap_alloc_frag(s32_t timeout, void *user_data)
 {
     struct bt_l2cap_le_chan *chan = user_data;
@@ -1840,6 +1898,11 @@ void bt_l2cap_init(void)
     };
 
     bt_l2cap_le_fixed_chan_register(&chan);
+#endif
+#if defined(CONFIG_BT_L2CAP_DYNAMIC_CHANNEL) && (CONFIG_BT_L2CAP_COC_BUF_COUNT > 0)
+#if defined(BFLB_DYNAMIC_ALLOC_MEM)
+    net_buf_init(&l2cap_coc_pool, CONFIG_BT_L2CAP_COC_BUF_COUNT, L2CAP_COC_BUF_SIZE, NULL);
+#endif
 #endif
     if (IS_ENABLED(CONFIG_BT_BREDR)) {
         bt_l2cap_br_init();
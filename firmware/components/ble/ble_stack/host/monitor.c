@@ -1,5 +1,5 @@
 /** @file
- *  @brief Custom logging over UART
+ *  @brief HCI capture ring, dumped as a btsnoop file
  */
 
 /*
@@ -10,19 +10,352 @@
 #if defined(CONFIG_BT_DEBUG_MONITOR)
 
 #include <zephyr.h>
-#include <buf.h>
-#include "monitor.h"
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <misc/util.h>
+#include <misc/byteorder.h>
+#include <bluetooth.h>
+#include <hci_host.h>
+#include <hci_driver.h>
 #include "log.h"
+#include "monitor.h"
+#if defined(BL_MCU_SDK)
+#include "bflb_platform.h"
+#include "hal_flash.h"
+#define monitor_time_us()   ((u32_t)bflb_platform_get_time_us())
+#define monitor_time_us64() bflb_platform_get_time_us()
+#else
+#define monitor_time_us()   (k_uptime_get_32() * 1000U)
+#define monitor_time_us64() ((u64_t)k_uptime_get() * 1000U)
+#endif
+
+#define BTSNOOP_VERSION          1
+#define BTSNOOP_DATALINK_MONITOR 2001
+/* btsnoop counts us from year 0, captures start at 2000-01-01 plus the uptime */
+#define BTSNOOP_EPOCH_2000 0x00E03AB44A676000ULL
+
+struct monitor_slot {
+    /* sequence number + 1 once the slot is complete, the dump skips any other slot */
+    u32_t commit;
+    u32_t ts_us;
+    u16_t orig_len;
+    u8_t opcode;
+    u8_t incl_len;
+    u8_t data[CONFIG_BT_MONITOR_SNAPLEN];
+};
+
+struct btsnoop_record_hdr {
+    u8_t orig_len[4];
+    u8_t incl_len[4];
+    u8_t flags[4];
+    u8_t drops[4];
+    u8_t ts_hi[4];
+    u8_t ts_lo[4];
+} __packed;
+
+static struct monitor_slot monitor_ring[CONFIG_BT_MONITOR_SLOTS];
+/* sequence number of the next packet, taken with one amoadd so writers never lock */
+static u32_t monitor_head;
+static volatile u8_t monitor_frozen;
+static u8_t monitor_filter = BT_MONITOR_FILTER_ALL;
+static u8_t monitor_triggers = BT_MONITOR_FREEZE_ASSERT;
+static u8_t monitor_disconnect_reason;
+static u32_t monitor_truncated;
+static u32_t monitor_filtered;
+static struct bt_monitor_new_index monitor_index;
+
+static void monitor_capture(u8_t opcode, const u8_t *buf, size_t len, u8_t incl_len)
+{
+    struct monitor_slot *slot;
+    u32_t seq;
+
+    seq = __atomic_fetch_add(&monitor_head, 1, __ATOMIC_RELAXED);
+    slot = &monitor_ring[seq % CONFIG_BT_MONITOR_SLOTS];
+
+    slot->commit = 0;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->ts_us = monitor_time_us();
+    slot->orig_len = len;
+    slot->opcode = opcode;
+    slot->incl_len = incl_len;
+    memcpy(slot->data, buf, incl_len);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->commit = seq + 1;
+}
 
 void bt_monitor_send(uint16_t opcode, const void *data, size_t len)
 {
     const uint8_t *buf = data;
+    u8_t incl_len;
+    u8_t mask;
+
+    if (monitor_frozen) {
+        return;
+    }
+
+    switch (opcode) {
+        case BT_MONITOR_COMMAND_PKT:
+            mask = BT_MONITOR_FILTER_CMD;
+            break;
+        case BT_MONITOR_EVENT_PKT:
+            mask = BT_MONITOR_FILTER_EVT;
+            break;
+        case BT_MONITOR_ACL_TX_PKT:
+        case BT_MONITOR_ACL_RX_PKT:
+            mask = BT_MONITOR_FILTER_ACL;
+            break;
+        default:
+            return;
+    }
 
-    BT_WARN("[Hci]:pkt_type:[0x%x],pkt_data:[%s]\r\n", opcode, bt_hex(buf, len));
+    if (monitor_filter & mask) {
+        incl_len = MIN(len, CONFIG_BT_MONITOR_SNAPLEN);
+        if (mask == BT_MONITOR_FILTER_ACL && (monitor_filter & BT_MONITOR_FILTER_ACL_HDR)) {
+            incl_len = MIN(incl_len, BT_MONITOR_ACL_HDR_LEN);
+        }
+        if (incl_len < len) {
+            monitor_truncated++;
+        }
+        monitor_capture(opcode, buf, len, incl_len);
+    } else {
+        monitor_filtered++;
+    }
+
+    /* event code, length, status, handle, reason */
+    if (mask == BT_MONITOR_FILTER_EVT && len >= 6 && buf[0] == BT_HCI_EVT_DISCONN_COMPLETE) {
+        monitor_disconnect_reason = buf[5];
+        if (monitor_triggers & BT_MONITOR_FREEZE_DISCONNECT) {
+            bt_monitor_freeze(BT_MONITOR_FREEZE_DISCONNECT);
+        }
+    }
 }
 
 void bt_monitor_new_index(uint8_t type, uint8_t bus, bt_addr_t *addr,
                           const char *name)
 {
+    monitor_index.type = type;
+    monitor_index.bus = bus;
+    memcpy(monitor_index.bdaddr, addr->val, sizeof(monitor_index.bdaddr));
+    strncpy(monitor_index.name, name, sizeof(monitor_index.name) - 1);
+    monitor_index.name[sizeof(monitor_index.name) - 1] = '\0';
+}
+
+void bt_monitor_set_filter(u8_t filter)
+{
+    monitor_filter = filter;
+}
+
+void bt_monitor_set_freeze(u8_t triggers)
+{
+    monitor_triggers = triggers;
+}
+
+void bt_monitor_freeze(u8_t reason)
+{
+    /* the first reason stays */
+    if (!monitor_frozen) {
+        monitor_frozen = reason;
+    }
+}
+
+void bt_monitor_assert(void)
+{
+    if (monitor_triggers & BT_MONITOR_FREEZE_ASSERT) {
+        bt_monitor_freeze(BT_MONITOR_FREEZE_ASSERT);
+    }
+}
+
+u8_t bt_monitor_frozen(void)
+{
+    return monitor_frozen;
+}
+
+void bt_monitor_resume(void)
+{
+    memset(monitor_ring, 0, sizeof(monitor_ring));
+    monitor_head = 0;
+    monitor_truncated = 0;
+    monitor_filtered = 0;
+    monitor_disconnect_reason = 0;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    monitor_frozen = 0;
+}
+
+void bt_monitor_get_stats(struct bt_monitor_stats *stats)
+{
+    u32_t head = monitor_head;
+
+    stats->captured = head;
+    stats->overwritten = head > CONFIG_BT_MONITOR_SLOTS ? head - CONFIG_BT_MONITOR_SLOTS : 0;
+    stats->truncated = monitor_truncated;
+    stats->filtered = monitor_filtered;
+    stats->frozen = monitor_frozen;
+    stats->disconnect_reason = monitor_disconnect_reason;
+}
+
+static int monitor_put_record(bt_monitor_out_t out, void *ctx, u16_t opcode, u64_t ts,
+                              const void *data, u16_t incl_len, u16_t orig_len)
+{
+    struct btsnoop_record_hdr hdr;
+    int err;
+
+    sys_put_be32(orig_len, hdr.orig_len);
+    sys_put_be32(incl_len, hdr.incl_len);
+    /* controller index 0 in the upper half */
+    sys_put_be32(opcode, hdr.flags);
+    sys_put_be32(0, hdr.drops);
+    sys_put_be32(ts >> 32, hdr.ts_hi);
+    sys_put_be32(ts, hdr.ts_lo);
+
+    err = out(ctx, &hdr, sizeof(hdr));
+    if (!err && incl_len) {
+        err = out(ctx, data, incl_len);
+    }
+
+    return err;
+}
+
+static u64_t monitor_slot_ts(struct monitor_slot *slot, u64_t now)
+{
+    /* 32 bit stamps are fine as long as the ring spans less than 71 minutes */
+    return BTSNOOP_EPOCH_2000 + now - (u32_t)((u32_t)now - slot->ts_us);
+}
+
+int bt_monitor_dump(bt_monitor_out_t out, void *ctx)
+{
+    static const char * const reasons[] = { "manually", "on disconnect", "on assert" };
+    struct monitor_slot *slot;
+    u8_t file_hdr[16] = { 'b', 't', 's', 'n', 'o', 'o', 'p', 0 };
+    char note[112];
+    u32_t head, first, seq, incomplete = 0;
+    u64_t now;
+    int reason, err;
+
+    /* a writer still in flight leaves its slot incomplete, it is skipped */
+    bt_monitor_freeze(BT_MONITOR_FREEZE_MANUAL);
+
+    head = monitor_head;
+    first = head > CONFIG_BT_MONITOR_SLOTS ? head - CONFIG_BT_MONITOR_SLOTS : 0;
+    now = monitor_time_us64();
+
+    sys_put_be32(BTSNOOP_VERSION, &file_hdr[8]);
+    sys_put_be32(BTSNOOP_DATALINK_MONITOR, &file_hdr[12]);
+    err = out(ctx, file_hdr, sizeof(file_hdr));
+    if (err) {
+        return err;
+    }
+
+    /* names the controller, stamped with the oldest packet */
+    slot = &monitor_ring[first % CONFIG_BT_MONITOR_SLOTS];
+    err = monitor_put_record(out, ctx, BT_MONITOR_NEW_INDEX,
+                             slot->commit == first + 1 ? monitor_slot_ts(slot, now) : BTSNOOP_EPOCH_2000 + now,
+                             &monitor_index, sizeof(monitor_index), sizeof(monitor_index));
+
+    for (seq = first; seq != head && !err; seq++) {
+        slot = &monitor_ring[seq % CONFIG_BT_MONITOR_SLOTS];
+        if (slot->commit != seq + 1) {
+            incomplete++;
+            continue;
+        }
+
+        err = monitor_put_record(out, ctx, slot->opcode, monitor_slot_ts(slot, now),
+                                 slot->data, slot->incl_len, slot->orig_len);
+    }
+
+    if (err) {
+        return err;
+    }
+
+    reason = __builtin_ctz(monitor_frozen);
+    snprintf(note, sizeof(note), "capture frozen %s, disconnect reason 0x%02x, %u packets, %u overwritten, %u incomplete, %u truncated",
+             reasons[reason < (int)ARRAY_SIZE(reasons) ? reason : 0], monitor_disconnect_reason,
+             (unsigned int)head, (unsigned int)first, (unsigned int)incomplete, (unsigned int)monitor_truncated);
+
+    return monitor_put_record(out, ctx, BT_MONITOR_SYSTEM_NOTE, BTSNOOP_EPOCH_2000 + now,
+                              note, strlen(note) + 1, strlen(note) + 1);
+}
+
+#if defined(BL_MCU_SDK)
+struct monitor_flash_out {
+    u32_t addr;
+    u32_t end;
+    u32_t len;
+    flash_write_buf_t wbuf;
+};
+
+/* records are short, one page program per 256 bytes of them. Static, the dump runs on asserts with little stack left */
+static u8_t monitor_flash_window[256] __aligned(4);
+
+static int monitor_flash_write(void *ctx, const void *data, size_t len)
+{
+    struct monitor_flash_out *flash = ctx;
+
+    if (flash->addr + flash->len + len > flash->end) {
+        return -ENOSPC;
+    }
+
+    if (flash_write_buffered(&flash->wbuf, flash->addr + flash->len, (uint8_t *)data, len) != SUCCESS) {
+        return -EIO;
+    }
+
+    flash->len += len;
+    return 0;
+}
+
+int bt_monitor_dump_flash(u32_t addr, u32_t size)
+{
+    struct monitor_flash_out flash = {
+        .addr = addr + sizeof(struct bt_monitor_flash_hdr),
+        .end = addr + size,
+    };
+    struct bt_monitor_flash_hdr hdr;
+    int err;
+
+    flash_write_buf_init(&flash.wbuf, monitor_flash_window, sizeof(monitor_flash_window));
+
+    if (flash_erase(addr, size) != SUCCESS) {
+        return -EIO;
+    }
+
+    err = bt_monitor_dump(monitor_flash_write, &flash);
+    if (flash_write_flush(&flash.wbuf) != SUCCESS && !err) {
+        err = -EIO;
+    }
+    if (err) {
+        return err;
+    }
+
+    /* the header goes last, a dump cut short leaves the region blank */
+    hdr.magic = BT_MONITOR_FLASH_MAGIC;
+    hdr.len = flash.len;
+    if (flash_write(addr, (uint8_t *)&hdr, sizeof(hdr)) != SUCCESS) {
+        return -EIO;
+    }
+
+    return 0;
+}
+#endif
+
+u32_t bt_monitor_bench_ns(void)
+{
+    /* LE-U ACL header and an ATT notification of 23 bytes */
+    u8_t pkt[4 + 27] = { 0x00, 0x20, 27, 0x00, 23, 0x00, 0x04, 0x00, 0x1b };
+    u64_t start;
+    u32_t us;
+    int i;
+
+    bt_monitor_resume();
+
+    start = monitor_time_us64();
+    for (i = 0; i < 1000; i++) {
+        bt_monitor_send(BT_MONITOR_ACL_RX_PKT, pkt, sizeof(pkt));
+    }
+    us = monitor_time_us64() - start;
+
+    bt_monitor_resume();
+
+    /* us for 1000 packets reads as ns per packet */
+    return us;
 }
 #endif
@@ -89,11 +89,66 @@ static inline u8_t bt_monitor_opcode(struct net_buf *buf)
     }
 }
 
+/* packets bt_monitor_set_filter() lets into the capture ring */
+#define BT_MONITOR_FILTER_CMD     BIT(0)
+#define BT_MONITOR_FILTER_EVT     BIT(1)
+#define BT_MONITOR_FILTER_ACL     BIT(2)
+/* ACL packets keep only the HCI and L2CAP headers and the first payload byte */
+#define BT_MONITOR_FILTER_ACL_HDR BIT(3)
+#define BT_MONITOR_FILTER_ALL     (BT_MONITOR_FILTER_CMD | BT_MONITOR_FILTER_EVT | BT_MONITOR_FILTER_ACL)
+
+#define BT_MONITOR_ACL_HDR_LEN 9
+
+/* triggers of bt_monitor_set_freeze(), also the reason bt_monitor_frozen() reports */
+#define BT_MONITOR_FREEZE_MANUAL     BIT(0)
+#define BT_MONITOR_FREEZE_DISCONNECT BIT(1)
+#define BT_MONITOR_FREEZE_ASSERT     BIT(2)
+
+/* header of a capture written by bt_monitor_dump_flash(), the btsnoop file follows */
+#define BT_MONITOR_FLASH_MAGIC 0x504E5342
+
+struct bt_monitor_flash_hdr {
+    u32_t magic;
+    u32_t len;
+} __packed;
+
+struct bt_monitor_stats {
+    u32_t captured;
+    u32_t overwritten;
+    u32_t truncated;
+    u32_t filtered;
+    u8_t frozen;
+    u8_t disconnect_reason;
+};
+
+/* receives the btsnoop file in pieces, a non zero return ends the dump */
+typedef int (*bt_monitor_out_t)(void *ctx, const void *data, size_t len);
+
 void bt_monitor_send(u16_t opcode, const void *data, size_t len);
 
 void bt_monitor_new_index(u8_t type, u8_t bus, bt_addr_t *addr,
                           const char *name);
 
+void bt_monitor_set_filter(u8_t filter);
+void bt_monitor_set_freeze(u8_t triggers);
+/* stop capturing, the ring keeps the packets up to now */
+void bt_monitor_freeze(u8_t reason);
+/* called by BT_ASSERT, freezes if BT_MONITOR_FREEZE_ASSERT is set */
+void bt_monitor_assert(void);
+/* reason of the freeze, 0 while capturing */
+u8_t bt_monitor_frozen(void);
+/* empty the ring and capture again */
+void bt_monitor_resume(void);
+void bt_monitor_get_stats(struct bt_monitor_stats *stats);
+/* write the frozen ring as a btsnoop file (datalink 2001, Linux monitor) */
+int bt_monitor_dump(bt_monitor_out_t out, void *ctx);
+#if defined(BL_MCU_SDK)
+/* erase the region and store the dump behind a bt_monitor_flash_hdr */
+int bt_monitor_dump_flash(u32_t addr, u32_t size);
+#endif
+/* time the capture of a 27 byte ACL packet, the ring is emptied afterwards */
+u32_t bt_monitor_bench_ns(void);
+
 #else /* !CONFIG_BT_DEBUG_MONITOR */
 
 #define bt_monitor_send(opcode, data, len)
@@ -15,9 +15,11 @@
 static struct multi_adv_instant g_multi_adv_list[MAX_MULTI_ADV_INSTANT];
 static struct multi_adv_scheduler g_multi_adv_scheduler;
 static struct k_delayed_work g_multi_adv_timer;
+static uint32_t g_multi_adv_budget_ua;
 
 void multi_adv_schedule_timeslot(struct multi_adv_scheduler *adv_scheduler);
 int multi_adv_schedule_timer_stop(void);
+void multi_adv_new_schedule(void);
 
 int multi_adv_get_instant_num(void)
 {
@@ -236,25 +238,58 @@ int multi_adv_start_adv_instant(struct multi_adv_instant *adv_instant)
     return ret;
 }
 
-void multi_adv_schedule_timer_handle(void)
+/* uA * ms of one event on the three primary channels, most events end with a stop */
+uint32_t multi_adv_event_charge(struct multi_adv_instant *adv_instant)
 {
-    struct multi_adv_scheduler *adv_scheduler = &g_multi_adv_scheduler;
+    /* preamble, access address, header, AdvA and CRC around the data at 1 Mbit/s */
+    uint32_t tx_us = (1 + 4 + 2 + 6 + adv_instant->ad_len + 3) * 8 + MULTI_ADV_RAMP_US;
+    uint32_t rx_us = 0;
 
-    multi_adv_schedule_timer_stop();
-    if (adv_scheduler->schedule_state == SCHEDULE_STOP)
-        return;
+    if ((adv_instant->param.options & BT_LE_ADV_OPT_CONNECTABLE) || adv_instant->sd_len) {
+        rx_us = MULTI_ADV_RX_WINDOW_US;
+    }
 
-    adv_scheduler->slot_clock = adv_scheduler->next_slot_clock;
-    adv_scheduler->slot_offset = adv_scheduler->next_slot_offset;
+    return (3 * (tx_us * MULTI_ADV_TX_UA + rx_us * MULTI_ADV_RX_UA) +
+            (MULTI_ADV_SWITCH_US + MULTI_ADV_STOP_US) * MULTI_ADV_CPU_UA) / 1000;
+}
 
-    multi_adv_schedule_timeslot(adv_scheduler);
-    return;
+uint32_t multi_adv_plan_current(int inst_num, uint16_t inst_interval[], uint32_t inst_charge[])
+{
+    int i;
+    uint32_t ua = 0;
+
+    for (i = 0; i < inst_num; i++) {
+        ua += inst_charge[i] / (inst_interval[i] * TIME_PRIOD_MS);
+    }
+    return ua;
 }
 
-void multi_adv_schedule_timer_callback(struct k_work *timer)
+/* stretch the set that costs most, as far as its interval_max allows, until the plan fits the budget */
+void multi_adv_fit_budget(int inst_num, uint16_t inst_interval[], uint16_t max_interval[], uint32_t inst_charge[])
 {
-    multi_adv_schedule_timer_handle();
-    return;
+    int i, worst;
+    uint16_t step;
+
+    while (g_multi_adv_budget_ua && (multi_adv_plan_current(inst_num, inst_interval, inst_charge) > g_multi_adv_budget_ua)) {
+        worst = -1;
+        for (i = 0; i < inst_num; i++) {
+            if (inst_interval[i] >= max_interval[i])
+                continue;
+            if ((worst < 0) || (inst_charge[i] / inst_interval[i] > inst_charge[worst] / inst_interval[worst]))
+                worst = i;
+        }
+
+        if (worst < 0) {
+            BT_WARN("multi adv: %u uA at interval_max, budget %u uA\r\n",
+                    multi_adv_plan_current(inst_num, inst_interval, inst_charge), g_multi_adv_budget_ua);
+            return;
+        }
+
+        step = inst_interval[worst] / 8;
+        if (step == 0)
+            step = 1;
+        inst_interval[worst] = MIN(inst_interval[worst] + step, max_interval[worst]);
+    }
 }
 
 int multi_adv_schedule_timer_start(int timeout)
@@ -279,86 +314,110 @@ int multi_adv_schedule_timer_stop(void)
     return 0;
 }
 
-void multi_adv_schedule_timeslot(struct multi_adv_scheduler *adv_scheduler)
+/* slots are timed from the start of the plan, a late callback does not shift the ones after it */
+void multi_adv_schedule_timer_at(struct multi_adv_scheduler *adv_scheduler, uint32_t slot)
 {
-    int i, inst_num;
-    int inst_clk, inst_off, match, insts = 0, next_slot, min_next_slot;
+    int32_t delay = (int32_t)(adv_scheduler->start_ms + slot * TIME_PRIOD_MS - k_uptime_get_32());
+
+    multi_adv_schedule_timer_start((delay > 0) ? delay : 0);
+}
+
+uint32_t multi_adv_next_slot(struct multi_adv_scheduler *adv_scheduler, uint32_t slot)
+{
+    int i;
+    uint32_t next_slot, min_next_slot = UINT32_MAX;
     struct multi_adv_instant *adv_instant;
-    uint16_t inst_interval[MAX_MULTI_ADV_INSTANT];
-    uint16_t inst_offset[MAX_MULTI_ADV_INSTANT];
-    uint8_t inst_order[MAX_MULTI_ADV_INSTANT];
-    uint8_t match_order[MAX_MULTI_ADV_INSTANT];
 
-    inst_num = 0;
-    for (i = 0; i < MAX_MULTI_ADV_INSTANT; i++) {
-        adv_instant = multi_adv_find_instant_by_order(i);
-        if (adv_instant) {
-            inst_interval[inst_num] = adv_instant->instant_interval;
-            inst_offset[inst_num] = adv_instant->instant_offset;
-            inst_order[inst_num] = i;
-            inst_num++;
+    for (i = 0; i < adv_scheduler->plan_num; i++) {
+        adv_instant = multi_adv_find_instant_by_order(adv_scheduler->plan_order[i]);
+        if (!adv_instant)
+            continue;
+
+        if (slot < adv_instant->instant_offset) {
+            next_slot = adv_instant->instant_offset;
+        } else {
+            next_slot = ((slot - adv_instant->instant_offset) / adv_instant->instant_interval + 1) * adv_instant->instant_interval + adv_instant->instant_offset;
         }
+        if (next_slot < min_next_slot)
+            min_next_slot = next_slot;
     }
+    return min_next_slot;
+}
 
-    inst_clk = adv_scheduler->slot_clock;
-    inst_off = adv_scheduler->slot_offset;
-    match = 0;
-    for (i = 0; i < inst_num; i++) {
-        if ((inst_clk % inst_interval[i]) == inst_offset[i]) {
-            match_order[match] = i;
-            match++;
-        }
+void multi_adv_schedule_timer_handle(void)
+{
+    struct multi_adv_scheduler *adv_scheduler = &g_multi_adv_scheduler;
+
+    adv_scheduler->schedule_timer_active = 0;
+
+    if (adv_scheduler->schedule_state == SCHEDULE_READY) {
+        multi_adv_new_schedule();
+        return;
     }
 
-    //    BT_DBG("multi_adv_schedule_timeslot, num = %d, match = %d", inst_num, match);
-    if (match) {
-        int offset_per_instant, diff;
-        offset_per_instant = TIME_PRIOD_MS / match;
-        diff = inst_off - (inst_off + offset_per_instant / 2) / offset_per_instant * offset_per_instant; //TODO may be error
+    if (adv_scheduler->schedule_state != SCHEDULE_START)
+        return;
 
-        /* means this is the time to start */
-        if (diff <= 2) {
-            insts = (inst_off + offset_per_instant / 2) / offset_per_instant;
+    if (adv_scheduler->on_air) {
+        /* end of the slot and nothing due in the next one, let the radio rest */
+        adv_scheduler->on_air = 0;
+        bt_le_adv_stop();
+        multi_adv_schedule_timer_at(adv_scheduler, adv_scheduler->next_slot_clock);
+        return;
+    }
 
-            /* start instant */
-            adv_instant = multi_adv_find_instant_by_order(inst_order[match_order[insts]]);
-            if (adv_instant)
-                multi_adv_start_adv_instant(adv_instant);
-        }
+    adv_scheduler->slot_clock = adv_scheduler->next_slot_clock;
+    multi_adv_schedule_timeslot(adv_scheduler);
+}
 
-        /* next instant in the same slot */
-        if (match - insts > 1) {
-            adv_scheduler->next_slot_offset = adv_scheduler->slot_offset + offset_per_instant;
-            adv_scheduler->next_slot_clock = adv_scheduler->slot_clock;
+void multi_adv_schedule_timer_callback(struct k_work *timer)
+{
+    multi_adv_schedule_timer_handle();
+    return;
+}
 
-            if ((adv_scheduler->next_slot_offset >= (TIME_PRIOD_MS - 2)) && (adv_scheduler->slot_offset <= (TIME_PRIOD_MS + 2))) {
-                adv_scheduler->next_slot_clock++;
-                adv_scheduler->next_slot_offset = 0;
-            }
-            multi_adv_schedule_timer_start(offset_per_instant);
-            return;
+/* runs once per planned event, the timer is armed for the next one */
+void multi_adv_schedule_timeslot(struct multi_adv_scheduler *adv_scheduler)
+{
+    int i, started = 0;
+    uint32_t slot = adv_scheduler->slot_clock;
+    struct multi_adv_instant *adv_instant;
+
+    for (i = 0; i < adv_scheduler->plan_num; i++) {
+        adv_instant = multi_adv_find_instant_by_order(adv_scheduler->plan_order[i]);
+        if (adv_instant && ((slot % adv_instant->instant_interval) == adv_instant->instant_offset)) {
+            adv_scheduler->pending |= BIT(i);
         }
     }
 
-    /* next instant not in the same slot */
-    min_next_slot = 0x7fffffff;
-    for (i = 0; i < inst_num; i++) {
-        if (inst_clk - inst_offset[i] < 0) {
-            match = 0;
-        } else {
-            match = (inst_clk - inst_offset[i]) / inst_interval[i] + 1;
-        }
-        next_slot = match * inst_interval[i] + inst_offset[i];
-        if (next_slot < min_next_slot) {
-            min_next_slot = next_slot;
+    /* the shortest interval goes first, the others slip a slot */
+    for (i = 0; i < adv_scheduler->plan_num; i++) {
+        if (!(adv_scheduler->pending & BIT(i)))
+            continue;
+
+        if (started) {
+            adv_scheduler->slips++;
+            continue;
         }
+
+        adv_scheduler->pending &= ~BIT(i);
+        adv_instant = multi_adv_find_instant_by_order(adv_scheduler->plan_order[i]);
+        if (adv_instant && !multi_adv_start_adv_instant(adv_instant))
+            started = 1;
     }
-    adv_scheduler->next_slot_offset = 0;
-    adv_scheduler->next_slot_clock = min_next_slot;
 
-    next_slot = (adv_scheduler->next_slot_clock - adv_scheduler->slot_clock) * TIME_PRIOD_MS + (adv_scheduler->next_slot_offset - adv_scheduler->slot_offset);
-    multi_adv_schedule_timer_start(next_slot);
-    return;
+    if (adv_scheduler->pending) {
+        adv_scheduler->next_slot_clock = slot + 1;
+    } else {
+        adv_scheduler->next_slot_clock = multi_adv_next_slot(adv_scheduler, slot);
+    }
+
+    if (started && (adv_scheduler->next_slot_clock != slot + 1)) {
+        adv_scheduler->on_air = 1;
+        multi_adv_schedule_timer_at(adv_scheduler, slot + 1);
+    } else {
+        multi_adv_schedule_timer_at(adv_scheduler, adv_scheduler->next_slot_clock);
+    }
 }
 
 void multi_adv_schedule_stop(void)
@@ -367,6 +426,7 @@ void multi_adv_schedule_stop(void)
 
     multi_adv_schedule_timer_stop();
     adv_scheduler->schedule_state = SCHEDULE_STOP;
+    adv_scheduler->on_air = 0;
 }
 
 void multi_adv_schedule_start(void)
@@ -380,11 +440,21 @@ void multi_adv_schedule_start(void)
 
     /* reinit scheduler */
     adv_scheduler->slot_clock = 0;
-    adv_scheduler->slot_offset = 0;
+    adv_scheduler->pending = 0;
+    adv_scheduler->start_ms = k_uptime_get_32();
     adv_scheduler->schedule_state = SCHEDULE_START;
     multi_adv_schedule_timeslot(adv_scheduler);
 }
 
+/* plans are built in the work queue, the same context that runs them */
+void multi_adv_request_schedule(void)
+{
+    struct multi_adv_scheduler *adv_scheduler = &g_multi_adv_scheduler;
+
+    adv_scheduler->schedule_state = SCHEDULE_READY;
+    multi_adv_schedule_timer_start(0);
+}
+
 void multi_adv_new_schedule(void)
 {
     int i;
@@ -392,12 +462,15 @@ void multi_adv_new_schedule(void)
     struct multi_adv_scheduler *adv_scheduler = &g_multi_adv_scheduler;
     uint16_t inst_offset[MAX_MULTI_ADV_INSTANT];
     uint16_t inst_interval[MAX_MULTI_ADV_INSTANT];
+    uint16_t max_interval[MAX_MULTI_ADV_INSTANT];
+    uint32_t inst_charge[MAX_MULTI_ADV_INSTANT];
     uint8_t inst_order[MAX_MULTI_ADV_INSTANT];
     int inst_num = 0;
 
-    if (adv_scheduler->schedule_state == SCHEDULE_START) {
-        multi_adv_schedule_stop();
-    }
+    multi_adv_schedule_stop();
+    adv_scheduler->plan_num = 0;
+    adv_scheduler->current_ua = 0;
+
     /* get all instant and calculate ticks and */
     high_duty_instant = 0;
     for (i = 0; i < MAX_MULTI_ADV_INSTANT; i++) {
@@ -410,14 +483,16 @@ void multi_adv_new_schedule(void)
             }
 
             inst_interval[inst_num] = change_to_tick(adv_instant->param.interval_min, adv_instant->param.interval_max);
+            max_interval[inst_num] = MAX(adv_instant->param.interval_max / SLOT_PER_PERIOD, inst_interval[inst_num]);
+            inst_charge[inst_num] = adv_instant->event_charge;
             inst_order[inst_num] = i;
             inst_num++;
         }
     }
 
     if (high_duty_instant) {
-        //BT_WARN("High Duty Cycle Instants, id = %d, interval = %d\n", adv_instant->instant_id, adv_instant->param.interval_min);
-        multi_adv_start_adv_instant(adv_instant);
+        //BT_WARN("High Duty Cycle Instants, id = %d, interval = %d\n", high_duty_instant->instant_id, high_duty_instant->param.interval_min);
+        multi_adv_start_adv_instant(high_duty_instant);
         return;
     }
 
@@ -430,10 +505,15 @@ void multi_adv_new_schedule(void)
         adv_instant = multi_adv_find_instant_by_order(inst_order[0]);
         if (!adv_instant)
             return;
+        /* the controller keeps the interval of a lone set by itself */
+        adv_scheduler->current_ua = multi_adv_plan_current(1, inst_interval, inst_charge);
         multi_adv_start_adv_instant(adv_instant);
         return;
     }
 
+    multi_adv_fit_budget(inst_num, inst_interval, max_interval, inst_charge);
+    adv_scheduler->current_ua = multi_adv_plan_current(inst_num, inst_interval, inst_charge);
+
     /* reorder by inst_interval */
     multi_adv_reorder(inst_num, inst_interval, inst_order);
 
@@ -448,9 +528,11 @@ void multi_adv_new_schedule(void)
         }
         adv_instant->instant_interval = inst_interval[i];
         adv_instant->instant_offset = inst_offset[i];
+        adv_scheduler->plan_order[i] = inst_order[i];
 
         //BT_WARN("adv_instant id = %d, interval = %d, offset = %d\n", adv_instant->instant_id, adv_instant->instant_interval, adv_instant->instant_offset);
     }
+    adv_scheduler->plan_num = inst_num;
 
     multi_adv_schedule_start();
 }
@@ -481,8 +563,9 @@ int bt_le_multi_adv_start(const struct bt_le_adv_param *param,
 
     adv_instant->ad_len = multi_adv_set_ad_data(adv_instant->ad, ad, ad_len);
     adv_instant->sd_len = multi_adv_set_ad_data(adv_instant->sd, sd, sd_len);
+    adv_instant->event_charge = multi_adv_event_charge(adv_instant);
 
-    multi_adv_new_schedule();
+    multi_adv_request_schedule();
 
     *instant_id = adv_instant->instant_id;
     return 0;
@@ -495,11 +578,48 @@ int bt_le_multi_adv_stop(int instant_id)
 
     //BT_WARN("%s id[%d]\n", __func__, instant_id);
     multi_adv_delete_instant_by_id(instant_id);
-    multi_adv_new_schedule();
+    multi_adv_request_schedule();
 
     return 0;
 }
 
+int bt_le_multi_adv_update(int instant_id,
+                           const struct bt_data *ad, size_t ad_len,
+                           const struct bt_data *sd, size_t sd_len)
+{
+    struct multi_adv_instant *adv_instant = multi_adv_find_instant_by_id(instant_id);
+
+    if (adv_instant == 0)
+        return -1;
+
+    /* the plan keeps its intervals, the estimate follows on the next one */
+    adv_instant->ad_len = multi_adv_set_ad_data(adv_instant->ad, ad, ad_len);
+    adv_instant->sd_len = multi_adv_set_ad_data(adv_instant->sd, sd, sd_len);
+    adv_instant->event_charge = multi_adv_event_charge(adv_instant);
+
+    return 0;
+}
+
+int bt_le_multi_adv_set_budget(uint32_t budget_ua)
+{
+    g_multi_adv_budget_ua = budget_ua;
+
+    if (multi_adv_get_instant_num())
+        multi_adv_request_schedule();
+
+    return 0;
+}
+
+uint32_t bt_le_multi_adv_get_current_ua(void)
+{
+    return g_multi_adv_scheduler.current_ua;
+}
+
+uint32_t bt_le_multi_adv_get_slips(void)
+{
+    return g_multi_adv_scheduler.slips;
+}
+
 bool bt_le_multi_adv_id_is_vaild(int instant_id)
 {
     int i;
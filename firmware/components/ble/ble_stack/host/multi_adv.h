@@ -8,13 +8,28 @@
 #define MAX_MULTI_ADV_INSTANT 4
 #define MAX_AD_DATA_LEN       31
 
-#define TIME_PRIOD_MS   (10 * (MAX_MULTI_ADV_INSTANT - 2))
+/* the plan runs on a grid of slots, one set is on air for at most one slot */
+#define TIME_PRIOD_MS   10
 #define SLOT_PER_PERIOD (TIME_PRIOD_MS * 8 / 5)
 
+/* offsets are chosen over at most this many slots of the common period */
 #define MAX_MIN_MULTI (30000 / TIME_PRIOD_MS)
 
 #define HIGH_DUTY_CYCLE_INTERVAL (20 * 8 / 5)
 
+/* cost of one advertising event for the power budget, BL702 at 0 dBm;
+ * estimates, calibrate against a current measurement of the board */
+#define MULTI_ADV_TX_UA        9000
+#define MULTI_ADV_RX_UA        8000
+#define MULTI_ADV_CPU_UA       4000
+/* radio ramp up per packet */
+#define MULTI_ADV_RAMP_US      150
+/* T_IFS and a scan or connect request, listened for after a scannable or connectable packet */
+#define MULTI_ADV_RX_WINDOW_US 230
+/* wake up and the HCI commands of one set switch, and of the stop after it */
+#define MULTI_ADV_SWITCH_US    1000
+#define MULTI_ADV_STOP_US      300
+
 struct multi_adv_instant {
     uint8_t inuse_flag;
 
@@ -29,14 +44,12 @@ struct multi_adv_instant {
     bt_addr_t own_addr;
     uint8_t own_addr_valid;
 
-    /* for schedule */
+    /* for schedule, in slots */
     int instant_id;
     int instant_interval;
     int instant_offset;
-    uint32_t clock;
-    uint32_t clock_instant_offset;
-    uint32_t clock_instant_total;
-    uint32_t next_wakeup_time;
+    /* uA * ms of one event */
+    uint32_t event_charge;
 };
 
 typedef enum {
@@ -49,10 +62,19 @@ typedef enum {
 struct multi_adv_scheduler {
     SCHEDULE_STATE schedule_state;
     uint8_t schedule_timer_active;
+    /* a set advertises until the end of slot_clock */
+    uint8_t on_air;
+    /* sets of the plan, shortest interval first */
+    uint8_t plan_num;
+    uint8_t plan_order[MAX_MULTI_ADV_INSTANT];
+    /* plan entries that were due in a taken slot */
+    uint8_t pending;
     uint32_t slot_clock;
-    uint16_t slot_offset;
-    uint16_t next_slot_offset;
     uint32_t next_slot_clock;
+    /* k_uptime_get_32() at slot 0 */
+    uint32_t start_ms;
+    uint32_t current_ua;
+    uint32_t slips;
 };
 
 int bt_le_multi_adv_thread_init(void);
@@ -60,6 +82,17 @@ int bt_le_multi_adv_start(const struct bt_le_adv_param *param,
                           const struct bt_data *ad, size_t ad_len,
                           const struct bt_data *sd, size_t sd_len, int *instant_id);
 int bt_le_multi_adv_stop(int instant_id);
+/* new data for a set, sent from its next event on */
+int bt_le_multi_adv_update(int instant_id,
+                           const struct bt_data *ad, size_t ad_len,
+                           const struct bt_data *sd, size_t sd_len);
+/* average current the sets may spend on advertising, intervals stretch up
+ * to their interval_max to stay below it; 0 runs every set at interval_min */
+int bt_le_multi_adv_set_budget(uint32_t budget_ua);
+/* estimated average current of the running plan */
+uint32_t bt_le_multi_adv_get_current_ua(void);
+/* events that slipped a slot because another set had it */
+uint32_t bt_le_multi_adv_get_slips(void);
 
 bool bt_le_multi_adv_id_is_vaild(int instant_id);
 
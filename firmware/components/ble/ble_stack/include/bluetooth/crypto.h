@@ -67,6 +67,36 @@ int bt_encrypt_le(const u8_t key[16], const u8_t plaintext[16],
 int bt_encrypt_be(const u8_t key[16], const u8_t plaintext[16],
                   u8_t enc_data[16]);
 
+/** @brief AES encrypt a run of little-endian blocks with one key.
+ *
+ *  Same as calling bt_encrypt_le() for every block, but the key is only
+ *  loaded once and the blocks go through the AES engine in one request.
+ *  plaintext and enc_data may be the same buffer.
+ *
+ *  @param key 128 bit LS byte first key for the encryption of the plaintext
+ *  @param plaintext blocks * 128 bit LS byte first plaintext data blocks
+ *  @param enc_data blocks * 128 bit LS byte first encrypted data blocks
+ *  @param blocks Number of 16 byte blocks
+ *
+ *  @return Zero on success or error code otherwise.
+ */
+int bt_encrypt_le_blocks(const u8_t key[16], const u8_t *plaintext,
+                         u8_t *enc_data, size_t blocks);
+
+/** AES usage counters since boot. */
+struct bt_crypto_stats {
+    u32_t hw_blocks;    /* encrypted on the security engine */
+    u32_t sw_blocks;    /* encrypted with TinyCrypt */
+    u32_t hw_fallbacks; /* engine errors handled by TinyCrypt */
+    u32_t key_loads;    /* TinyCrypt key schedules built, cache misses */
+};
+
+/** @brief Read the AES usage counters.
+ *
+ *  @param stats Filled with the counters since boot
+ */
+void bt_crypto_get_stats(struct bt_crypto_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -386,6 +386,20 @@ int bt_l2cap_chan_send(struct bt_l2cap_chan *chan, struct net_buf *buf);
 int bt_l2cap_chan_recv_complete(struct bt_l2cap_chan *chan,
                                 struct net_buf *buf);
 
+/** @brief Get a buffer for L2CAP channel data
+ *
+ *  Take a buffer of one LE MPS from the pool of CONFIG_BT_L2CAP_COC_BUF_COUNT
+ *  buffers shared by all credit based channels. Outgoing data gets the
+ *  BT_L2CAP_CHAN_SEND_RESERVE headroom, so an SDU that fits the peer's MPS is
+ *  sent without a copy. The same buffers may be returned from the alloc_buf
+ *  callback to reassemble incoming SDUs.
+ *
+ *  @param timeout Time to wait for a free buffer, K_NO_WAIT or K_FOREVER.
+ *
+ *  @return Buffer or NULL when none was free in time.
+ */
+struct net_buf *bt_l2cap_chan_buf_alloc(s32_t timeout);
+
 #ifdef __cplusplus
 }
 #endif
@@ -54,6 +54,41 @@ int bl_rand()
     val >>= 1; //leave signe bit alone
     return val;
 }
+
+#if !defined(CONFIG_HW_SEC_ENG_DISABLE)
+/*
+ * The host AES, the mbedTLS port and boot2 decryption program the same
+ * security engine, each as a sequence of key load and requests. Recursive,
+ * mbedTLS calls back into its AES from CCM. Before the scheduler runs there
+ * is nobody to share the engine with.
+ */
+static StaticSemaphore_t sec_eng_mutex_buf;
+static SemaphoreHandle_t sec_eng_mutex;
+
+void sec_eng_lock(void)
+{
+    if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    if (sec_eng_mutex == NULL) {
+        sec_eng_mutex = xSemaphoreCreateRecursiveMutexStatic(&sec_eng_mutex_buf);
+    }
+    taskEXIT_CRITICAL();
+
+    xSemaphoreTakeRecursive(sec_eng_mutex, portMAX_DELAY);
+}
+
+void sec_eng_unlock(void)
+{
+    if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) {
+        return;
+    }
+
+    xSemaphoreGiveRecursive(sec_eng_mutex);
+}
+#endif
 #endif
 
 void k_queue_init(struct k_queue *queue, int size)
@@ -331,6 +331,28 @@
 #undef CONFIG_BT_TINYCRYPT_ECC
 #define CONFIG_BT_TINYCRYPT_ECC 1
 #endif
+
+/**
+* CONFIG_BT_HCI_ECC_HW: run the emulated ECDH HCI commands on the security
+* engine PKA instead of TinyCrypt. TinyCrypt is still used to validate the
+* peer public key and takes over if the PKA reports an error. Off unless the
+* app sets it; bt_hci_ecc_set_backend() picks either backend at run time.
+*/
+#ifdef CONFIG_BT_HCI_ECC_HW
+#undef CONFIG_BT_HCI_ECC_HW
+#define CONFIG_BT_HCI_ECC_HW 1
+#endif
+
+/**
+* CONFIG_BT_HOST_AES_HW: run the host AES-128 (bt_encrypt_le/be, RPA
+* resolution, SMP) on the security engine. TinyCrypt takes over if the
+* engine reports an error. The engine is shared with the mbedTLS port and
+* boot2 decryption through sec_eng_lock(), which the BLE port implements.
+*/
+#ifdef CONFIG_BT_HOST_AES_HW
+#undef CONFIG_BT_HOST_AES_HW
+#define CONFIG_BT_HOST_AES_HW 1
+#endif
 /**
 *  CONFIG_BLUETOOTH_MAX_CONN:Maximum number of connections
 *  range 1 to 128
@@ -523,6 +545,32 @@
 #define CONFIG_BT_L2CAP_TX_FRAG_COUNT 0
 #endif
 
+/**
+* CONFIG_BT_L2CAP_COC_BUF_COUNT: buffers of one LE MPS each, shared by the application's
+* credit based channels for SDUs in both directions, 0 leaves the pool out
+* range 0 to 32
+*/
+#ifndef CONFIG_BT_L2CAP_COC_BUF_COUNT
+#define CONFIG_BT_L2CAP_COC_BUF_COUNT 0
+#endif
+
+/**
+* CONFIG_BT_MONITOR_SLOTS: HCI packets kept by the capture ring of CONFIG_BT_DEBUG_MONITOR,
+* the oldest is overwritten first
+* range 8 to 1024
+*/
+#ifndef CONFIG_BT_MONITOR_SLOTS
+#define CONFIG_BT_MONITOR_SLOTS 64
+#endif
+
+/**
+* CONFIG_BT_MONITOR_SNAPLEN: bytes kept of each captured packet, the rest is cut off
+* range 9 to 255
+*/
+#ifndef CONFIG_BT_MONITOR_SNAPLEN
+#define CONFIG_BT_MONITOR_SNAPLEN 48
+#endif
+
 #ifndef CONFIG_BT_DEVICE_NAME_DYNAMIC
 #define CONFIG_BT_DEVICE_NAME_DYNAMIC 1
 #endif
@@ -44,7 +44,9 @@
 #define configCLINT_BASE_ADDRESS                CLINT_CTRL_ADDR
 #define configUSE_PREEMPTION                    1
 #define configUSE_IDLE_HOOK                     0
+#ifndef configUSE_TICK_HOOK
 #define configUSE_TICK_HOOK                     0
+#endif
 #define configCPU_CLOCK_HZ                      (1000000UL)
 #define configTICK_RATE_HZ                      ((TickType_t)1000)
 #define configMAX_PRIORITIES                    (7)
@@ -61,7 +63,9 @@
 #define configUSE_MALLOC_FAILED_HOOK            1
 #define configUSE_APPLICATION_TASK_TAG          0
 #define configUSE_COUNTING_SEMAPHORES           1
+#ifndef configGENERATE_RUN_TIME_STATS
 #define configGENERATE_RUN_TIME_STATS           0
+#endif
 #define configUSE_PORT_OPTIMISED_TASK_SELECTION 1
 #define configUSE_STATS_FORMATTING_FUNCTIONS    2
 #ifdef LOW_POWER
@@ -112,5 +116,13 @@ void vApplicationSleep(uint32_t xExpectedIdleTime);
 #define portSUPPRESS_TICKS_AND_SLEEP(xExpectedIdleTime) vApplicationSleep(xExpectedIdleTime)
 #endif
 
+#if (configGENERATE_RUN_TIME_STATS != 0)
+/* the CLINT mtime runs at 1MHz, its low word is a free running microsecond counter */
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE() (*(volatile uint32_t *)(configCLINT_BASE_ADDRESS + 0xBFF8))
+void vApplicationTaskSwitchedIn(uint32_t ulTaskNumber);
+#define traceTASK_SWITCHED_IN() vApplicationTaskSwitchedIn(pxCurrentTCB->uxTCBNumber)
+#endif
+
 #define portUSING_MPU_WRAPPERS 0
 #endif /* FREERTOS_CONFIG_H */
@@ -0,0 +1,16 @@
+#ifndef __AES_ALT_H__
+#define __AES_ALT_H__
+
+#include <stdint.h>
+
+/*
+ * AES on the security engine. Only the key is kept here, every call loads
+ * key and IV again, so contexts can be interleaved with each other and with
+ * the other engine users (BLE host, boot2 decryption).
+ */
+typedef struct mbedtls_aes_context {
+    uint32_t key[8];
+    uint32_t keybits;
+} mbedtls_aes_context;
+
+#endif
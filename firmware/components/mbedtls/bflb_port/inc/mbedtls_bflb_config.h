@@ -9,6 +9,30 @@
 #define MBEDTLS_CIPHER_C
 #define MBEDTLS_SHA256_C
 
+#define MBEDTLS_BIGNUM_C
+#define MBEDTLS_ECP_C
+/* callers always pass f_rng, no need for a DRBG just for point blinding */
+#define MBEDTLS_ECP_NO_INTERNAL_RNG
+#define MBEDTLS_ECP_DP_SECP256R1_ENABLED
+#define MBEDTLS_ECP_DP_SECP256K1_ENABLED
+#define MBEDTLS_ECDH_C
+#define MBEDTLS_ECDSA_C
+#define MBEDTLS_ASN1_PARSE_C
+#define MBEDTLS_ASN1_WRITE_C
+
+/* security engine implementations in bflb_port/src */
+#if defined(MBEDTLS_USE_BFLB_AES)
+#define MBEDTLS_AES_ALT
+#endif
+#if defined(MBEDTLS_USE_BFLB_SHA)
+#define MBEDTLS_SHA256_ALT
+#endif
+#if defined(MBEDTLS_USE_BFLB_PKA)
+#define MBEDTLS_ECDH_GEN_PUBLIC_ALT
+#define MBEDTLS_ECDH_COMPUTE_SHARED_ALT
+#define MBEDTLS_ECDSA_VERIFY_ALT
+#endif
+
 #define MBEDTLS_CIPHER_MODE_CBC
 #define MBEDTLS_CIPHER_MODE_CTR
 
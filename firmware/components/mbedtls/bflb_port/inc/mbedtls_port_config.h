@@ -15,6 +15,11 @@
 #define MBEDTLS_PLATFORM_SNPRINTF_ALT
 //#define MBEDTLS_PLATFORM_STD_SNPRINTF    snprintf
 #define MBEDTLS_PLATFORM_MEMORY
+/* bignum allocates, the libc heap is backed by mmheap */
+#include <limits.h>
+#include <stdlib.h>
+#define MBEDTLS_PLATFORM_CALLOC_MACRO calloc
+#define MBEDTLS_PLATFORM_FREE_MACRO   free
 //#if defined(bflb_platform_calloc) && defined(bflb_platform_free)
 //#define MBEDTLS_PLATFORM_CALLOC_MACRO    bflb_platform_calloc
 //#define MBEDTLS_PLATFORM_FREE_MACRO      bflb_platform_free
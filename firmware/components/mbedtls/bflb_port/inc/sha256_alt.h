@@ -0,0 +1,22 @@
+#ifndef __SHA256_ALT_H__
+#define __SHA256_ALT_H__
+
+#include <stdint.h>
+#include "bl702_sec_eng.h"
+
+/*
+ * SHA-256 on the security engine in link mode. The engine reads the running
+ * hash from link_cfg and writes it back there, so the whole hash state lives
+ * in the context and any number of contexts can be in flight. The pointers
+ * in link_ctx are refreshed on every call, which keeps plain struct copies
+ * (mbedtls_sha256_clone) valid.
+ */
+typedef struct mbedtls_sha256_context {
+    SEC_Eng_SHA_Link_Config_Type link_cfg;
+    SEC_Eng_SHA256_Link_Ctx link_ctx;
+    uint32_t buf[16];
+    uint32_t padding[16];
+    int is224;
+} mbedtls_sha256_context;
+
+#endif
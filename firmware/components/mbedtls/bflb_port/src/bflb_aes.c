@@ -1,7 +1,18 @@
 #include "mbedtls/aes.h"
 #include "mbedtls/platform.h"
 #include "mbedtls/platform_util.h"
+#include "mbedtls/error.h"
 #include "mbedtls_port_config.h"
+#include "hal_common.h"
+
+#if defined(MBEDTLS_AES_C) && defined(MBEDTLS_AES_ALT)
+
+/* bytes per engine run, bounds how long other engine users wait */
+#define BFLB_AES_CHUNK 256
+
+/* the engine moves words, unaligned buffers are copied through here */
+static uint32_t aes_bounce_in[BFLB_AES_CHUNK / 4];
+static uint32_t aes_bounce_out[BFLB_AES_CHUNK / 4];
 
 static SEC_ENG_AES_Key_Type get_key_type(uint32_t keybits)
 {
@@ -17,10 +28,48 @@ static SEC_ENG_AES_Key_Type get_key_type(uint32_t keybits)
     }
 }
 
+/*
+ * One engine run of at most BFLB_AES_CHUNK bytes. Key and IV are loaded
+ * every time under the engine lock, so whoever used the engine last does
+ * not matter. The lock also covers the bounce buffers.
+ */
+static int aes_engine_run(const mbedtls_aes_context *ctx, SEC_ENG_AES_Type type, SEC_ENG_AES_EnDec_Type dir,
+                          const uint8_t iv[16], const uint8_t *input, uint8_t *output, size_t len)
+{
+    SEC_Eng_AES_Ctx aesCtx;
+    const uint8_t *in = input;
+    uint8_t *out = output;
+    BL_Err_Type err;
+
+    sec_eng_lock();
+
+    if ((uintptr_t)input & 3) {
+        arch_memcpy(aes_bounce_in, input, len);
+        in = (const uint8_t *)aes_bounce_in;
+    }
+
+    if ((uintptr_t)output & 3) {
+        out = (uint8_t *)aes_bounce_out;
+    }
+
+    Sec_Eng_AES_Enable_BE(SEC_ENG_AES_ID0);
+    Sec_Eng_AES_Init(&aesCtx, SEC_ENG_AES_ID0, type, get_key_type(ctx->keybits), dir);
+    Sec_Eng_AES_Set_Key_IV_BE(SEC_ENG_AES_ID0, SEC_ENG_AES_KEY_SW, (const uint8_t *)ctx->key, iv);
+    err = Sec_Eng_AES_Crypt(&aesCtx, SEC_ENG_AES_ID0, in, len, out);
+    Sec_Eng_AES_Finish(SEC_ENG_AES_ID0);
+
+    if (out != output) {
+        arch_memcpy(output, out, len);
+    }
+
+    sec_eng_unlock();
+
+    return (err == SUCCESS) ? 0 : MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+}
+
 void mbedtls_aes_init(mbedtls_aes_context *ctx)
 {
     CHECK_PARAM(ctx != NULL);
-    Sec_Eng_AES_Enable_BE(SEC_ENG_AES_ID0);
     arch_memset(ctx, 0, sizeof(mbedtls_aes_context));
 }
 
@@ -30,77 +79,165 @@ void mbedtls_aes_free(mbedtls_aes_context *ctx)
         return;
     }
 
-    arch_memset(ctx, 0, sizeof(mbedtls_aes_context));
+    mbedtls_platform_zeroize(ctx, sizeof(mbedtls_aes_context));
 }
 
 int mbedtls_aes_setkey_enc(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits)
 {
-    ctx->nr = 0;
-    ctx->rk = (uint32_t *)key;
-    ctx->buf[0] = keybits;
+    if (keybits != 128 && keybits != 192 && keybits != 256) {
+        return (MBEDTLS_ERR_AES_INVALID_KEY_LENGTH);
+    }
+
+    /* the engine derives the decryption schedule itself */
+    arch_memset(ctx->key, 0, sizeof(ctx->key));
+    arch_memcpy(ctx->key, key, keybits / 8);
+    ctx->keybits = keybits;
 
     return (0);
 }
 
 int mbedtls_aes_setkey_dec(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits)
 {
-    ctx->nr = 0;
-    ctx->rk = (uint32_t *)key;
-    ctx->buf[0] = keybits;
-
-    return (0);
+    return mbedtls_aes_setkey_enc(ctx, key, keybits);
 }
 
-int mbedtls_aes_crypt_cbc(mbedtls_aes_context *ctx, int mode, size_t length, unsigned char iv[16], const unsigned char *input, unsigned char *output)
+int mbedtls_internal_aes_encrypt(mbedtls_aes_context *ctx, const unsigned char input[16], unsigned char output[16])
 {
-    SEC_Eng_AES_Ctx aesCtx;
+    const uint8_t iv[16] = { 0 };
 
-    if (!ctx->nr) {
-        Sec_Eng_AES_Init(&aesCtx, SEC_ENG_AES_ID0, SEC_ENG_AES_CBC, get_key_type(ctx->buf[0]), (SEC_ENG_AES_EnDec_Type)(~mode & 1));
-        Sec_Eng_AES_Set_Key_IV_BE(SEC_ENG_AES_ID0, SEC_ENG_AES_KEY_SW, (uint8_t *)ctx->rk, iv);
-    }
+    return aes_engine_run(ctx, SEC_ENG_AES_ECB, SEC_ENG_AES_ENCRYPTION, iv, input, output, 16);
+}
 
-    aesCtx.aesFeed = ctx->nr;
-    aesCtx.mode = SEC_ENG_AES_CBC;
-    Sec_Eng_AES_Crypt(&aesCtx, SEC_ENG_AES_ID0, input, length, output);
-    ctx->nr = 1;
+int mbedtls_internal_aes_decrypt(mbedtls_aes_context *ctx, const unsigned char input[16], unsigned char output[16])
+{
+    const uint8_t iv[16] = { 0 };
 
-    return (0);
+    return aes_engine_run(ctx, SEC_ENG_AES_ECB, SEC_ENG_AES_DECRYPTION, iv, input, output, 16);
 }
 
 int mbedtls_aes_crypt_ecb(mbedtls_aes_context *ctx, int mode, const unsigned char input[16], unsigned char output[16])
 {
-    SEC_Eng_AES_Ctx aesCtx;
-    const uint8_t iv[16] = { 0 };
+    if (mode == MBEDTLS_AES_ENCRYPT) {
+        return mbedtls_internal_aes_encrypt(ctx, input, output);
+    }
+
+    return mbedtls_internal_aes_decrypt(ctx, input, output);
+}
+
+#if defined(MBEDTLS_CIPHER_MODE_CBC)
+int mbedtls_aes_crypt_cbc(mbedtls_aes_context *ctx, int mode, size_t length, unsigned char iv[16], const unsigned char *input, unsigned char *output)
+{
+    uint8_t next_iv[16];
+    size_t len;
+    int ret;
 
-    if (!ctx->nr) {
-        Sec_Eng_AES_Init(&aesCtx, SEC_ENG_AES_ID0, SEC_ENG_AES_ECB, get_key_type(ctx->buf[0]), (SEC_ENG_AES_EnDec_Type)(~mode & 1));
-        Sec_Eng_AES_Set_Key_IV_BE(SEC_ENG_AES_ID0, SEC_ENG_AES_KEY_SW, (uint8_t *)ctx->rk, iv);
+    if (length % 16) {
+        return (MBEDTLS_ERR_AES_INVALID_INPUT_LENGTH);
     }
 
-    aesCtx.aesFeed = ctx->nr;
-    aesCtx.mode = SEC_ENG_AES_ECB;
-    Sec_Eng_AES_Crypt(&aesCtx, SEC_ENG_AES_ID0, input, 16, output);
-    ctx->nr = 1;
+    while (length > 0) {
+        len = (length > BFLB_AES_CHUNK) ? BFLB_AES_CHUNK : length;
+
+        /* the chaining value is the last ciphertext block, grab it before an in place decrypt */
+        if (mode == MBEDTLS_AES_DECRYPT) {
+            arch_memcpy(next_iv, input + len - 16, 16);
+        }
+
+        ret = aes_engine_run(ctx, SEC_ENG_AES_CBC, (mode == MBEDTLS_AES_ENCRYPT) ? SEC_ENG_AES_ENCRYPTION : SEC_ENG_AES_DECRYPTION,
+                             iv, input, output, len);
+
+        if (ret != 0) {
+            return (ret);
+        }
+
+        arch_memcpy(iv, (mode == MBEDTLS_AES_ENCRYPT) ? output + len - 16 : next_iv, 16);
+        input += len;
+        output += len;
+        length -= len;
+    }
 
     return (0);
 }
+#endif /* MBEDTLS_CIPHER_MODE_CBC */
+
+#if defined(MBEDTLS_CIPHER_MODE_CTR)
+/* big endian 128 bit counter, as mbedtls counts */
+static void aes_ctr_add(unsigned char nonce_counter[16], uint32_t blocks)
+{
+    uint32_t carry = blocks;
+    int i;
+
+    for (i = 15; i >= 0 && carry; i--) {
+        carry += nonce_counter[i];
+        nonce_counter[i] = carry & 0xff;
+        carry >>= 8;
+    }
+}
 
 int mbedtls_aes_crypt_ctr(mbedtls_aes_context *ctx, size_t length, size_t *nc_off, unsigned char nonce_counter[16],
                           unsigned char stream_block[16], const unsigned char *input, unsigned char *output)
 {
-    SEC_Eng_AES_Ctx aesCtx;
+    const uint8_t zero[16] = { 0 };
+    size_t n = *nc_off;
+    uint32_t low, blocks;
+    size_t len;
+    int ret;
+
+    if (n > 0x0F) {
+        return (MBEDTLS_ERR_AES_BAD_INPUT_DATA);
+    }
+
+    /* finish the keystream block left over from the previous call */
+    while (n != 0 && length > 0) {
+        *output++ = *input++ ^ stream_block[n];
+        n = (n + 1) & 0x0F;
+        length--;
+    }
+
+    /* whole blocks; the engine counts in the low word only, so never run across its wrap */
+    while (length >= 16) {
+        low = ((uint32_t)nonce_counter[12] << 24) | ((uint32_t)nonce_counter[13] << 16) |
+              ((uint32_t)nonce_counter[14] << 8) | nonce_counter[15];
+        blocks = ((length > BFLB_AES_CHUNK) ? BFLB_AES_CHUNK : length) / 16;
+
+        if (low + blocks < low && low + blocks != 0) {
+            blocks = 0 - low;
+        }
 
-    if (!ctx->nr) {
-        // *(uint32_t *)(nonce_counter + 12) += *nc_off;
-        Sec_Eng_AES_Init(&aesCtx, SEC_ENG_AES_ID0, SEC_ENG_AES_CTR, get_key_type(ctx->buf[0]), SEC_ENG_AES_ENCRYPTION);
-        Sec_Eng_AES_Set_Key_IV_BE(SEC_ENG_AES_ID0, SEC_ENG_AES_KEY_SW, (uint8_t *)ctx->rk, nonce_counter);
+        len = blocks * 16;
+        ret = aes_engine_run(ctx, SEC_ENG_AES_CTR, SEC_ENG_AES_ENCRYPTION, nonce_counter, input, output, len);
+
+        if (ret != 0) {
+            return (ret);
+        }
+
+        aes_ctr_add(nonce_counter, blocks);
+        input += len;
+        output += len;
+        length -= len;
+    }
+
+    /* partial tail: keep the rest of its keystream for the next call */
+    if (length > 0) {
+        ret = aes_engine_run(ctx, SEC_ENG_AES_CTR, SEC_ENG_AES_ENCRYPTION, nonce_counter, zero, stream_block, 16);
+
+        if (ret != 0) {
+            return (ret);
+        }
+
+        aes_ctr_add(nonce_counter, 1);
+
+        while (length > 0) {
+            *output++ = *input++ ^ stream_block[n];
+            n++;
+            length--;
+        }
     }
 
-    aesCtx.aesFeed = ctx->nr;
-    aesCtx.mode = SEC_ENG_AES_CTR;
-    Sec_Eng_AES_Crypt(&aesCtx, SEC_ENG_AES_ID0, input, length, output);
-    ctx->nr = 1;
+    *nc_off = n;
 
     return (0);
 }
+#endif /* MBEDTLS_CIPHER_MODE_CTR */
+
+#endif /* MBEDTLS_AES_C && MBEDTLS_AES_ALT */
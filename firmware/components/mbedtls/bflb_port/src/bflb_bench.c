@@ -0,0 +1,221 @@
+#include "common.h"
+#include "mbedtls/aes.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/ecdh.h"
+#include "mbedtls/ecdsa.h"
+#include "mbedtls/error.h"
+#include "mbedtls/platform.h"
+#include "mbedtls_port_config.h"
+#include "mbedtls_bflb_bench.h"
+
+#define BENCH_BUF_LEN    4096
+#define BENCH_BULK_LOOPS 64
+#define BENCH_ECP_LOOPS  4
+
+/* NIST SP 800-38A F.1.1, F.2.1, F.5.1 first blocks */
+static const uint8_t kat_aes_key[16] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+static const uint8_t kat_aes_pt[16] = {
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a
+};
+static const uint8_t kat_aes_ecb[16] = {
+    0x3a, 0xd7, 0x7b, 0xb4, 0x0d, 0x7a, 0x36, 0x60, 0xa8, 0x9e, 0xca, 0xf3, 0x24, 0x66, 0xef, 0x97
+};
+static const uint8_t kat_aes_cbc[16] = {
+    0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46, 0xce, 0xe9, 0x8e, 0x9b, 0x12, 0xe9, 0x19, 0x7d
+};
+static const uint8_t kat_aes_ctr[16] = {
+    0x87, 0x4d, 0x61, 0x91, 0xb6, 0x20, 0xe3, 0x26, 0x1b, 0xef, 0x68, 0x64, 0x99, 0x0d, 0xb6, 0xce
+};
+/* FIPS 180-2 "abc" */
+static const uint8_t kat_sha256_abc[32] = {
+    0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+    0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+};
+/* RFC 5903 8.1, P-256 initiator */
+static const char kat_ecp_d[] = "C88F01F510D9AC3F70A292DAA2316DE544E9AAB8AFE84049C62A9C57862D1433";
+static const char kat_ecp_qx[] = "DAD0B65394221CF9B051E1FECA5787D098DFE637FC90B9EF945D0C3772581180";
+static const char kat_ecp_qy[] = "5271A0461CDB8252D61F1C456FA3E59AB1F45B33ACCF5F58389E0577B8990BB3";
+
+static uint8_t bench_buf[BENCH_BUF_LEN] __attribute__((aligned(4)));
+
+static int bench_rng(void *p_rng, unsigned char *output, size_t len)
+{
+    (void)p_rng;
+    return (Sec_Eng_Trng_Get_Random(output, len) == SUCCESS) ? 0 : MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+}
+
+static void bench_report(const char *name, uint32_t ops, uint32_t bytes, uint64_t start_us)
+{
+    uint32_t us = (uint32_t)(bflb_platform_get_time_us() - start_us);
+
+    if (us == 0) {
+        us = 1;
+    }
+
+    if (bytes) {
+        mbedtls_printf("%-16s %8u KB/s\r\n", name, (unsigned int)((uint64_t)bytes * 1000000 / 1024 / us));
+    } else {
+        mbedtls_printf("%-16s %8u.%02u ops/s\r\n", name, (unsigned int)((uint64_t)ops * 1000000 / us),
+                       (unsigned int)((uint64_t)ops * 100000000 / us % 100));
+    }
+}
+
+static int bench_aes(void)
+{
+    mbedtls_aes_context aes;
+    uint8_t iv[16], stream[16], out[16];
+    size_t off = 0;
+    uint64_t start;
+    int fail = 0;
+    int i;
+
+    mbedtls_aes_init(&aes);
+    mbedtls_aes_setkey_enc(&aes, kat_aes_key, 128);
+
+    mbedtls_aes_crypt_ecb(&aes, MBEDTLS_AES_ENCRYPT, kat_aes_pt, out);
+    fail |= memcmp(out, kat_aes_ecb, 16);
+
+    for (i = 0; i < 16; i++) {
+        iv[i] = i;
+    }
+    mbedtls_aes_crypt_cbc(&aes, MBEDTLS_AES_ENCRYPT, 16, iv, kat_aes_pt, out);
+    fail |= memcmp(out, kat_aes_cbc, 16);
+
+    for (i = 0; i < 16; i++) {
+        iv[i] = 0xf0 + i;
+    }
+    mbedtls_aes_crypt_ctr(&aes, 16, &off, iv, stream, kat_aes_pt, out);
+    fail |= memcmp(out, kat_aes_ctr, 16);
+
+    mbedtls_printf("AES KAT %s\r\n", fail ? "FAIL" : "ok");
+
+    start = bflb_platform_get_time_us();
+    for (i = 0; i < BENCH_BULK_LOOPS * 16; i++) {
+        mbedtls_aes_crypt_ecb(&aes, MBEDTLS_AES_ENCRYPT, bench_buf, bench_buf);
+    }
+    bench_report("AES-128-ECB 16B", BENCH_BULK_LOOPS * 16, 0, start);
+
+    start = bflb_platform_get_time_us();
+    for (i = 0; i < BENCH_BULK_LOOPS; i++) {
+        mbedtls_aes_crypt_cbc(&aes, MBEDTLS_AES_ENCRYPT, BENCH_BUF_LEN, iv, bench_buf, bench_buf);
+    }
+    bench_report("AES-128-CBC", 0, BENCH_BULK_LOOPS * BENCH_BUF_LEN, start);
+
+    start = bflb_platform_get_time_us();
+    for (i = 0; i < BENCH_BULK_LOOPS; i++) {
+        mbedtls_aes_crypt_ctr(&aes, BENCH_BUF_LEN, &off, iv, stream, bench_buf, bench_buf);
+    }
+    bench_report("AES-128-CTR", 0, BENCH_BULK_LOOPS * BENCH_BUF_LEN, start);
+
+    mbedtls_aes_free(&aes);
+    return fail;
+}
+
+static int bench_sha256(void)
+{
+    uint8_t out[32];
+    uint64_t start;
+    int fail;
+    int i;
+
+    mbedtls_sha256_ret((const unsigned char *)"abc", 3, out, 0);
+    fail = memcmp(out, kat_sha256_abc, 32);
+    mbedtls_printf("SHA-256 KAT %s\r\n", fail ? "FAIL" : "ok");
+
+    start = bflb_platform_get_time_us();
+    for (i = 0; i < BENCH_BULK_LOOPS; i++) {
+        mbedtls_sha256_ret(bench_buf, BENCH_BUF_LEN, out, 0);
+    }
+    bench_report("SHA-256", 0, BENCH_BULK_LOOPS * BENCH_BUF_LEN, start);
+
+    return fail;
+}
+
+static int bench_ecp(void)
+{
+    mbedtls_ecp_group grp;
+    mbedtls_ecp_point Q;
+    mbedtls_mpi d, z, r, s, x, y;
+    uint8_t hash[32];
+    uint64_t start;
+    int fail = 1;
+    int i;
+
+    mbedtls_ecp_group_init(&grp);
+    mbedtls_ecp_point_init(&Q);
+    mbedtls_mpi_init(&d);
+    mbedtls_mpi_init(&z);
+    mbedtls_mpi_init(&r);
+    mbedtls_mpi_init(&s);
+    mbedtls_mpi_init(&x);
+    mbedtls_mpi_init(&y);
+
+    Sec_Eng_Trng_Enable();
+
+    if (mbedtls_ecp_group_load(&grp, MBEDTLS_ECP_DP_SECP256R1) != 0 ||
+        mbedtls_mpi_read_string(&d, 16, kat_ecp_d) != 0 ||
+        mbedtls_mpi_read_string(&x, 16, kat_ecp_qx) != 0 ||
+        mbedtls_mpi_read_string(&y, 16, kat_ecp_qy) != 0) {
+        goto exit;
+    }
+
+    /* d * G through the shared secret path, Q = G */
+    if (mbedtls_ecdh_compute_shared(&grp, &z, &grp.G, &d, bench_rng, NULL) == 0) {
+        fail = mbedtls_mpi_cmp_mpi(&z, &x) != 0;
+    }
+    mbedtls_printf("ECDH P-256 KAT %s\r\n", fail ? "FAIL" : "ok");
+
+    start = bflb_platform_get_time_us();
+    for (i = 0; i < BENCH_ECP_LOOPS; i++) {
+        mbedtls_ecdh_gen_public(&grp, &d, &Q, bench_rng, NULL);
+    }
+    bench_report("ECDH P-256 gen", BENCH_ECP_LOOPS, 0, start);
+
+    start = bflb_platform_get_time_us();
+    for (i = 0; i < BENCH_ECP_LOOPS; i++) {
+        mbedtls_ecdh_compute_shared(&grp, &z, &Q, &d, bench_rng, NULL);
+    }
+    bench_report("ECDH P-256 shared", BENCH_ECP_LOOPS, 0, start);
+
+    /* software signature over the bench buffer hash, verified by the PKA */
+    mbedtls_sha256_ret(bench_buf, sizeof(hash), hash, 0);
+    if (mbedtls_ecdsa_sign(&grp, &r, &s, &d, hash, sizeof(hash), bench_rng, NULL) != 0) {
+        fail = 1;
+        goto exit;
+    }
+
+    start = bflb_platform_get_time_us();
+    for (i = 0; i < BENCH_ECP_LOOPS; i++) {
+        fail |= mbedtls_ecdsa_verify(&grp, hash, sizeof(hash), &Q, &r, &s) != 0;
+    }
+    bench_report("ECDSA P-256 verify", BENCH_ECP_LOOPS, 0, start);
+
+    /* a tampered hash must be rejected */
+    hash[0] ^= 1;
+    fail |= mbedtls_ecdsa_verify(&grp, hash, sizeof(hash), &Q, &r, &s) == 0;
+    mbedtls_printf("ECDSA P-256 check %s\r\n", fail ? "FAIL" : "ok");
+
+exit:
+    mbedtls_ecp_group_free(&grp);
+    mbedtls_ecp_point_free(&Q);
+    mbedtls_mpi_free(&d);
+    mbedtls_mpi_free(&z);
+    mbedtls_mpi_free(&r);
+    mbedtls_mpi_free(&s);
+    mbedtls_mpi_free(&x);
+    mbedtls_mpi_free(&y);
+    return fail;
+}
+
+int mbedtls_bflb_benchmark(void)
+{
+    int fail = 0;
+
+    fail |= bench_aes();
+    fail |= bench_sha256();
+    fail |= bench_ecp();
+
+    return fail;
+}
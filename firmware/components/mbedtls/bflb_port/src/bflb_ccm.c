@@ -20,7 +20,7 @@ mbedtls_aes_context aes_ctx = { 0 };
 void mbedtls_ccm_init(mbedtls_ccm_context *ctx)
 {
     CHECK_PARAM(ctx != NULL);
-    Sec_Eng_AES_Enable_BE(SEC_ENG_AES_ID0);
+    /* the AES runs set up the engine themselves, under the engine lock */
     arch_memset(ctx, 0, sizeof(mbedtls_ccm_context));
 }
 
@@ -65,6 +65,8 @@ static int get_cbc_mac_input(mbedtls_ccm_context *ctx, size_t length,
     size_t len_left;
     unsigned char b[16];
     const unsigned char *src;
+
+    (void)ctx;
     cbc_adata_round = 0;
     cbc_pt_round = 0;
 
@@ -247,7 +249,7 @@ static int get_ctr_dec_input(size_t length, const unsigned char *input, const un
     src = input;
 
     // Copy tag in first block to calucate T
-    arch_memcpy(b_input, tag, 16);
+    arch_memcpy(b_input, tag, tag_len);
 
     ctr_ct_round = 1;
 
@@ -302,7 +304,6 @@ int mbedtls_ccm_encrypt_and_tag(mbedtls_ccm_context *ctx, size_t length, const u
 
     arch_memset(b_output, 0, sizeof(b_output));
 
-    aes_ctx.nr = 0;
     mbedtls_aes_crypt_cbc(ctx->cipher_ctx.cipher_ctx, ctx->cipher_ctx.operation, cbc_length, cbc_iv, b_input, b_output);
 
     get_ctr_iv(ctr_iv, iv, iv_len);
@@ -312,9 +313,6 @@ int mbedtls_ccm_encrypt_and_tag(mbedtls_ccm_context *ctx, size_t length, const u
     ctr_length = 16 * ctr_pt_round;
     arch_memset(b_output, 0, sizeof(b_output));
 
-    /*reset this value for init ctr and set new IV*/
-    aes_ctx.nr = 0;
-
     mbedtls_aes_crypt_ctr(ctx->cipher_ctx.cipher_ctx, ctr_length, &nc_off, ctr_iv, stream_block, b_input, b_output);
 
     /*first output block is tag info*/
@@ -347,8 +345,6 @@ int mbedtls_ccm_auth_decrypt(mbedtls_ccm_context *ctx, size_t length, const unsi
 
     ctr_length = 16 * ctr_ct_round;
 
-    /*reset this value for init ctr and set new IV*/
-    aes_ctx.nr = 0;
     mbedtls_aes_crypt_ctr(ctx->cipher_ctx.cipher_ctx, ctr_length, &nc_off, ctr_iv, stream_block, b_input, b_output);
 
     /* Copy CBC-MAC here */
@@ -369,7 +365,6 @@ int mbedtls_ccm_auth_decrypt(mbedtls_ccm_context *ctx, size_t length, const unsi
 
     arch_memset(b_output, 0, sizeof(b_output));
 
-    aes_ctx.nr = 0;
     mbedtls_aes_crypt_cbc(ctx->cipher_ctx.cipher_ctx, ctx->cipher_ctx.operation, cbc_length, cbc_iv, b_input, b_output);
 
     /* Check CBC-MAC */
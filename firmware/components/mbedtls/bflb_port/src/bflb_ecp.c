@@ -0,0 +1,260 @@
+#include "common.h"
+#include "mbedtls/ecp.h"
+#include "mbedtls/ecdh.h"
+#include "mbedtls/ecdsa.h"
+#include "mbedtls/platform.h"
+#include "mbedtls/platform_util.h"
+#include "mbedtls/error.h"
+#include "mbedtls_port_config.h"
+#include "hal_sec_ecdsa.h"
+
+/*
+ * Point multiplication for the 256 bit curves the PKA knows, with mbedtls'
+ * own ecp code as the fallback for every other curve and for PKA errors.
+ * PKA operands are big endian words, mbedtls_mpi_write_binary's layout.
+ * The PKA keeps intermediate points in its registers, so every operation
+ * holds the engine lock from init to deinit; BLE pairing waits for it in
+ * the HCI ECC thread and the other way round.
+ */
+#if defined(MBEDTLS_ECP_C) && (defined(MBEDTLS_ECDH_C) || defined(MBEDTLS_ECDSA_C))
+
+#define BFLB_ECP_WORDS 8
+
+static int pka_curve(const mbedtls_ecp_group *grp, sec_ecp_type *id)
+{
+    switch (grp->id) {
+        case MBEDTLS_ECP_DP_SECP256R1:
+            *id = ECP_SECP256R1;
+            return (1);
+
+        case MBEDTLS_ECP_DP_SECP256K1:
+            *id = ECP_SECP256K1;
+            return (1);
+
+        default:
+            return (0);
+    }
+}
+
+/* R = m * P, or m * G when P is NULL */
+static int pka_mul(const mbedtls_ecp_group *grp, sec_ecp_type id, mbedtls_ecp_point *R,
+                   const mbedtls_mpi *m, const mbedtls_ecp_point *P)
+{
+    uint32_t k[BFLB_ECP_WORDS];
+    uint32_t px[BFLB_ECP_WORDS], py[BFLB_ECP_WORDS];
+    uint32_t rx[BFLB_ECP_WORDS], ry[BFLB_ECP_WORDS];
+    sec_ecdh_handle_t handle;
+    int ret;
+
+    /* the curve is picked by id */
+    (void)grp;
+
+    MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(m, (unsigned char *)k, sizeof(k)));
+
+    sec_eng_lock();
+    sec_ecdh_init(&handle, id);
+
+    if (P == NULL) {
+        ret = sec_ecdh_get_public_key(&handle, k, rx, ry);
+    } else {
+        MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&P->X, (unsigned char *)px, sizeof(px)));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&P->Y, (unsigned char *)py, sizeof(py)));
+        ret = sec_ecdh_get_encrypt_key(&handle, px, py, k, rx, ry);
+    }
+
+    sec_ecdh_deinit(&handle);
+    sec_eng_unlock();
+
+    if (ret != 0) {
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        goto cleanup;
+    }
+
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&R->X, (unsigned char *)rx, sizeof(rx)));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&R->Y, (unsigned char *)ry, sizeof(ry)));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_lset(&R->Z, 1));
+
+    /* the point at infinity comes back as (0, 0) */
+    if (mbedtls_mpi_cmp_int(&R->X, 0) == 0 && mbedtls_mpi_cmp_int(&R->Y, 0) == 0) {
+        MBEDTLS_MPI_CHK(mbedtls_mpi_lset(&R->Z, 0));
+    }
+
+cleanup:
+    mbedtls_platform_zeroize(k, sizeof(k));
+    return (ret);
+}
+
+#if defined(MBEDTLS_ECDH_C)
+#if defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT)
+int mbedtls_ecdh_gen_public(mbedtls_ecp_group *grp, mbedtls_mpi *d, mbedtls_ecp_point *Q,
+                            int (*f_rng)(void *, unsigned char *, size_t),
+                            void *p_rng)
+{
+    int ret;
+    sec_ecp_type id;
+
+    MBEDTLS_MPI_CHK(mbedtls_ecp_gen_privkey(grp, d, f_rng, p_rng));
+
+    if (pka_curve(grp, &id) && pka_mul(grp, id, Q, d, NULL) == 0) {
+        return (0);
+    }
+
+    MBEDTLS_MPI_CHK(mbedtls_ecp_mul(grp, Q, d, &grp->G, f_rng, p_rng));
+
+cleanup:
+    return (ret);
+}
+#endif /* MBEDTLS_ECDH_GEN_PUBLIC_ALT */
+
+#if defined(MBEDTLS_ECDH_COMPUTE_SHARED_ALT)
+int mbedtls_ecdh_compute_shared(mbedtls_ecp_group *grp, mbedtls_mpi *z,
+                                const mbedtls_ecp_point *Q, const mbedtls_mpi *d,
+                                int (*f_rng)(void *, unsigned char *, size_t),
+                                void *p_rng)
+{
+    int ret;
+    sec_ecp_type id;
+    mbedtls_ecp_point P;
+
+    mbedtls_ecp_point_init(&P);
+
+    /* the PKA takes any point, mbedtls_ecp_mul checks these itself */
+    MBEDTLS_MPI_CHK(mbedtls_ecp_check_privkey(grp, d));
+    MBEDTLS_MPI_CHK(mbedtls_ecp_check_pubkey(grp, Q));
+
+    if (!pka_curve(grp, &id) || pka_mul(grp, id, &P, d, Q) != 0) {
+        MBEDTLS_MPI_CHK(mbedtls_ecp_mul(grp, &P, d, Q, f_rng, p_rng));
+    }
+
+    if (mbedtls_ecp_is_zero(&P)) {
+        ret = MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+        goto cleanup;
+    }
+
+    MBEDTLS_MPI_CHK(mbedtls_mpi_copy(z, &P.X));
+
+cleanup:
+    mbedtls_ecp_point_free(&P);
+    return (ret);
+}
+#endif /* MBEDTLS_ECDH_COMPUTE_SHARED_ALT */
+#endif /* MBEDTLS_ECDH_C */
+
+#if defined(MBEDTLS_ECDSA_C) && defined(MBEDTLS_ECDSA_VERIFY_ALT)
+/* SEC1 4.1.3 step 5: the hash, truncated to the bit length of n */
+static int ecdsa_derive_mpi(const mbedtls_ecp_group *grp, mbedtls_mpi *x, const unsigned char *buf, size_t blen)
+{
+    int ret;
+    size_t n_size = (grp->nbits + 7) / 8;
+    size_t use_size = blen > n_size ? n_size : blen;
+
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(x, buf, use_size));
+
+    if (use_size * 8 > grp->nbits) {
+        MBEDTLS_MPI_CHK(mbedtls_mpi_shift_r(x, use_size * 8 - grp->nbits));
+    }
+
+    if (mbedtls_mpi_cmp_mpi(x, &grp->N) >= 0) {
+        MBEDTLS_MPI_CHK(mbedtls_mpi_sub_mpi(x, x, &grp->N));
+    }
+
+cleanup:
+    return (ret);
+}
+
+static int ecdsa_verify_sw(mbedtls_ecp_group *grp, const mbedtls_mpi *e, const mbedtls_ecp_point *Q,
+                           const mbedtls_mpi *r, const mbedtls_mpi *s)
+{
+    int ret;
+    mbedtls_mpi s_inv, u1, u2;
+    mbedtls_ecp_point R;
+
+    mbedtls_ecp_point_init(&R);
+    mbedtls_mpi_init(&s_inv);
+    mbedtls_mpi_init(&u1);
+    mbedtls_mpi_init(&u2);
+
+    MBEDTLS_MPI_CHK(mbedtls_mpi_inv_mod(&s_inv, s, &grp->N));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mul_mpi(&u1, e, &s_inv));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(&u1, &u1, &grp->N));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mul_mpi(&u2, r, &s_inv));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(&u2, &u2, &grp->N));
+
+    MBEDTLS_MPI_CHK(mbedtls_ecp_muladd(grp, &R, &u1, &grp->G, &u2, Q));
+
+    if (mbedtls_ecp_is_zero(&R)) {
+        ret = MBEDTLS_ERR_ECP_VERIFY_FAILED;
+        goto cleanup;
+    }
+
+    MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(&R.X, &R.X, &grp->N));
+
+    if (mbedtls_mpi_cmp_mpi(&R.X, r) != 0) {
+        ret = MBEDTLS_ERR_ECP_VERIFY_FAILED;
+    }
+
+cleanup:
+    mbedtls_ecp_point_free(&R);
+    mbedtls_mpi_free(&s_inv);
+    mbedtls_mpi_free(&u1);
+    mbedtls_mpi_free(&u2);
+    return (ret);
+}
+
+/*
+ * The PKA cannot tell a bad signature from a failed operation, so a
+ * rejection is confirmed in software. Valid signatures, the common case,
+ * only take the PKA path.
+ */
+int mbedtls_ecdsa_verify(mbedtls_ecp_group *grp, const unsigned char *buf, size_t blen,
+                         const mbedtls_ecp_point *Q, const mbedtls_mpi *r, const mbedtls_mpi *s)
+{
+    int ret;
+    sec_ecp_type id;
+    sec_ecdsa_handle_t handle;
+    uint32_t hash[BFLB_ECP_WORDS], qx[BFLB_ECP_WORDS], qy[BFLB_ECP_WORDS];
+    uint32_t rw[BFLB_ECP_WORDS], sw[BFLB_ECP_WORDS];
+    mbedtls_mpi e;
+
+    mbedtls_mpi_init(&e);
+
+    /* range checks the PKA path relies on, as ecdsa.c does them */
+    if (mbedtls_mpi_cmp_int(r, 1) < 0 || mbedtls_mpi_cmp_mpi(r, &grp->N) >= 0 ||
+        mbedtls_mpi_cmp_int(s, 1) < 0 || mbedtls_mpi_cmp_mpi(s, &grp->N) >= 0) {
+        ret = MBEDTLS_ERR_ECP_VERIFY_FAILED;
+        goto cleanup;
+    }
+
+    /* the PKA takes any point */
+    MBEDTLS_MPI_CHK(mbedtls_ecp_check_pubkey(grp, Q));
+    MBEDTLS_MPI_CHK(ecdsa_derive_mpi(grp, &e, buf, blen));
+
+    if (pka_curve(grp, &id)) {
+        MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&e, (unsigned char *)hash, sizeof(hash)));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&Q->X, (unsigned char *)qx, sizeof(qx)));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&Q->Y, (unsigned char *)qy, sizeof(qy)));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(r, (unsigned char *)rw, sizeof(rw)));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(s, (unsigned char *)sw, sizeof(sw)));
+
+        sec_eng_lock();
+        sec_ecdsa_init(&handle, id);
+        handle.publicKeyx = qx;
+        handle.publicKeyy = qy;
+        ret = sec_ecdsa_verify(&handle, hash, BFLB_ECP_WORDS, rw, sw);
+        sec_ecdsa_deinit(&handle);
+        sec_eng_unlock();
+
+        if (ret == 0) {
+            goto cleanup;
+        }
+    }
+
+    ret = ecdsa_verify_sw(grp, &e, Q, r, s);
+
+cleanup:
+    mbedtls_mpi_free(&e);
+    return (ret);
+}
+#endif /* MBEDTLS_ECDSA_C && MBEDTLS_ECDSA_VERIFY_ALT */
+
+#endif /* MBEDTLS_ECP_C && (MBEDTLS_ECDH_C || MBEDTLS_ECDSA_C) */
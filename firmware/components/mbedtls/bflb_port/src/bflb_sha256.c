@@ -0,0 +1,125 @@
+#include "common.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/platform.h"
+#include "mbedtls/platform_util.h"
+#include "mbedtls/error.h"
+#include "mbedtls_port_config.h"
+#include "hal_common.h"
+
+#if defined(MBEDTLS_SHA256_C) && defined(MBEDTLS_SHA256_ALT)
+
+/* bytes fed per engine run, bounds how long other engine users wait */
+#define BFLB_SHA256_CHUNK 1024
+
+/* unaligned input goes through here, the engine fetches words; under the engine lock */
+static uint32_t sha_bounce[256 / 4];
+
+static void sha256_bind(mbedtls_sha256_context *ctx)
+{
+    ctx->link_ctx.shaBuf = ctx->buf;
+    ctx->link_ctx.shaPadding = ctx->padding;
+    ctx->link_ctx.linkAddr = (uint32_t)(uintptr_t)&ctx->link_cfg;
+}
+
+/* with the engine lock held */
+static int sha256_engine_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+{
+    BL_Err_Type err;
+
+    sha256_bind(ctx);
+    Sec_Eng_SHA_Enable_Link(SEC_ENG_SHA_ID0);
+    err = Sec_Eng_SHA256_Link_Update(&ctx->link_ctx, SEC_ENG_SHA_ID0, input, ilen);
+    Sec_Eng_SHA_Disable_Link(SEC_ENG_SHA_ID0);
+
+    return (err == SUCCESS) ? 0 : MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+}
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx)
+{
+    arch_memset(ctx, 0, sizeof(mbedtls_sha256_context));
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+
+    mbedtls_platform_zeroize(ctx, sizeof(mbedtls_sha256_context));
+}
+
+void mbedtls_sha256_clone(mbedtls_sha256_context *dst, const mbedtls_sha256_context *src)
+{
+    *dst = *src;
+}
+
+int mbedtls_sha256_starts_ret(mbedtls_sha256_context *ctx, int is224)
+{
+    Sec_Eng_SHA256_Link_Init(&ctx->link_ctx, SEC_ENG_SHA_ID0, (uint32_t)(uintptr_t)&ctx->link_cfg, ctx->buf, ctx->padding);
+
+    arch_memset(&ctx->link_cfg, 0, sizeof(ctx->link_cfg));
+    ctx->link_cfg.shaMode = is224 ? SEC_ENG_SHA224 : SEC_ENG_SHA256;
+    ctx->is224 = is224;
+
+    return (0);
+}
+
+/*
+ * The engine fetches whole words straight from the input, so only aligned
+ * input with an empty block buffer is fed directly. Topping up a partial
+ * block and unaligned input go through the bounce buffer.
+ */
+int mbedtls_sha256_update_ret(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+{
+    size_t left;
+    size_t len;
+    int ret;
+
+    while (ilen > 0) {
+        left = ctx->link_ctx.total[0] & 0x3F;
+
+        sec_eng_lock();
+
+        if (left == 0 && ((uintptr_t)input & 3) == 0) {
+            len = (ilen > BFLB_SHA256_CHUNK) ? BFLB_SHA256_CHUNK : ilen;
+            ret = sha256_engine_update(ctx, input, len);
+        } else {
+            len = left ? (64 - left) : sizeof(sha_bounce);
+            len = (ilen > len) ? len : ilen;
+            arch_memcpy(sha_bounce, input, len);
+            ret = sha256_engine_update(ctx, (const unsigned char *)sha_bounce, len);
+        }
+
+        sec_eng_unlock();
+
+        if (ret != 0) {
+            return (ret);
+        }
+
+        input += len;
+        ilen -= len;
+    }
+
+    return (0);
+}
+
+int mbedtls_sha256_finish_ret(mbedtls_sha256_context *ctx, unsigned char *output)
+{
+    BL_Err_Type err;
+
+    sec_eng_lock();
+    sha256_bind(ctx);
+    Sec_Eng_SHA_Enable_Link(SEC_ENG_SHA_ID0);
+    err = Sec_Eng_SHA256_Link_Finish(&ctx->link_ctx, SEC_ENG_SHA_ID0, output);
+    Sec_Eng_SHA_Disable_Link(SEC_ENG_SHA_ID0);
+    sec_eng_unlock();
+
+    return (err == SUCCESS) ? 0 : MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+}
+
+int mbedtls_internal_sha256_process(mbedtls_sha256_context *ctx, const unsigned char data[64])
+{
+    return mbedtls_sha256_update_ret(ctx, data, 64);
+}
+
+#endif /* MBEDTLS_SHA256_C && MBEDTLS_SHA256_ALT */
@@ -83,8 +83,15 @@ struct usbd_msc_cfg_private {
     uint32_t scsi_blk_len;
     uint8_t *block_buffer;
 
+    /* block the storage answered USBD_MSC_PENDING for, see usbd_msc_sector_done() */
+    uint8_t pending;
+    uint16_t pending_len;
 } usbd_msc_cfg;
 
+#define MSC_PENDING_NONE  0
+#define MSC_PENDING_READ  1
+#define MSC_PENDING_WRITE 2
+
 /*memory OK (after a usbd_msc_memory_verify)*/
 static bool memOK;
 
@@ -103,11 +110,16 @@ static void usbd_msc_reset(void)
 
     usbd_msc_get_cap(0, &usbd_msc_cfg.scsi_blk_nbr, &usbd_msc_cfg.scsi_blk_size);
 
-    if (usbd_msc_cfg.block_buffer) {
-        free(usbd_msc_cfg.block_buffer);
+    /* the block size never changes, a pending block keeps pointing at this buffer */
+    if (!usbd_msc_cfg.block_buffer) {
+        usbd_msc_cfg.block_buffer = malloc(usbd_msc_cfg.scsi_blk_size * sizeof(uint8_t));
     }
-    usbd_msc_cfg.block_buffer = malloc(usbd_msc_cfg.scsi_blk_size * sizeof(uint8_t));
     memset(usbd_msc_cfg.block_buffer, 0, usbd_msc_cfg.scsi_blk_size * sizeof(uint8_t));
+
+    if (usbd_msc_cfg.pending == MSC_PENDING_WRITE) {
+        usbd_ep_read(mass_ep_data[MSD_OUT_EP_IDX].ep_addr, NULL, 0, NULL);
+    }
+    usbd_msc_cfg.pending = MSC_PENDING_NONE;
 }
 
 /**
@@ -230,22 +242,12 @@ static void SCSI_SenseCode(uint8_t sKey, uint8_t ASC)
     usbd_msc_cfg.ASC = ASC;
 }
 
-static bool SCSI_processRead(void)
+static void SCSI_sendReadData(void)
 {
     uint32_t transfer_len;
 
-    USBD_LOG_DBG("read addr:%d\r\n", usbd_msc_cfg.scsi_blk_addr);
-
     transfer_len = MIN(usbd_msc_cfg.scsi_blk_len, MASS_STORAGE_BULK_EP_MPS);
 
-    /* we read an entire block */
-    if (!(usbd_msc_cfg.scsi_blk_addr % usbd_msc_cfg.scsi_blk_size)) {
-        if (usbd_msc_sector_read((usbd_msc_cfg.scsi_blk_addr / usbd_msc_cfg.scsi_blk_size), usbd_msc_cfg.block_buffer, usbd_msc_cfg.scsi_blk_size) != 0) {
-            SCSI_SenseCode(SCSI_SENSE_HARDWARE_ERROR, SCSI_ASC_UNRECOVERED_READ_ERROR);
-            return false;
-        }
-    }
-
     usbd_ep_write(mass_ep_data[MSD_IN_EP_IDX].ep_addr,
                   &usbd_msc_cfg.block_buffer[usbd_msc_cfg.scsi_blk_addr % usbd_msc_cfg.scsi_blk_size], transfer_len, NULL);
 
@@ -256,12 +258,48 @@ static bool SCSI_processRead(void)
     if (usbd_msc_cfg.scsi_blk_len == 0) {
         usbd_msc_cfg.stage = MSC_SEND_CSW;
     }
+}
 
+static bool SCSI_processRead(void)
+{
+    int ret;
+
+    USBD_LOG_DBG("read addr:%d\r\n", usbd_msc_cfg.scsi_blk_addr);
+
+    /* we read an entire block */
+    if (!(usbd_msc_cfg.scsi_blk_addr % usbd_msc_cfg.scsi_blk_size)) {
+        ret = usbd_msc_sector_read((usbd_msc_cfg.scsi_blk_addr / usbd_msc_cfg.scsi_blk_size), usbd_msc_cfg.block_buffer, usbd_msc_cfg.scsi_blk_size);
+
+        if (ret == USBD_MSC_PENDING) {
+            usbd_msc_cfg.pending = MSC_PENDING_READ;
+            return true;
+        }
+
+        if (ret != 0) {
+            SCSI_SenseCode(SCSI_SENSE_HARDWARE_ERROR, SCSI_ASC_UNRECOVERED_READ_ERROR);
+            return false;
+        }
+    }
+
+    SCSI_sendReadData();
     return true;
 }
 
+static void SCSI_advanceWrite(uint16_t len)
+{
+    usbd_msc_cfg.scsi_blk_addr += len;
+    usbd_msc_cfg.scsi_blk_len -= len;
+    usbd_msc_cfg.csw.dDataResidue -= len;
+
+    if (usbd_msc_cfg.scsi_blk_len == 0) {
+        sendCSW(CSW_STATUS_CMD_PASSED);
+    }
+}
+
 static bool SCSI_processWrite(uint8_t *buf, uint16_t len)
 {
+    int ret;
+
     USBD_LOG_DBG("write addr:%d\r\n", usbd_msc_cfg.scsi_blk_addr);
 
     /* we fill an array in RAM of 1 block before writing it in memory */
@@ -271,20 +309,21 @@ static bool SCSI_processWrite(uint8_t *buf, uint16_t len)
 
     /* if the array is filled, write it in memory */
     if ((usbd_msc_cfg.scsi_blk_addr % usbd_msc_cfg.scsi_blk_size) + len >= usbd_msc_cfg.scsi_blk_size) {
-        if (usbd_msc_sector_write((usbd_msc_cfg.scsi_blk_addr / usbd_msc_cfg.scsi_blk_size), usbd_msc_cfg.block_buffer, usbd_msc_cfg.scsi_blk_size) != 0) {
+        ret = usbd_msc_sector_write((usbd_msc_cfg.scsi_blk_addr / usbd_msc_cfg.scsi_blk_size), usbd_msc_cfg.block_buffer, usbd_msc_cfg.scsi_blk_size);
+
+        if (ret == USBD_MSC_PENDING) {
+            usbd_msc_cfg.pending = MSC_PENDING_WRITE;
+            usbd_msc_cfg.pending_len = len;
+            return true;
+        }
+
+        if (ret != 0) {
             SCSI_SenseCode(SCSI_SENSE_HARDWARE_ERROR, SCSI_ASC_WRITE_FAULT);
             return false;
         }
     }
 
-    usbd_msc_cfg.scsi_blk_addr += len;
-    usbd_msc_cfg.scsi_blk_len -= len;
-    usbd_msc_cfg.csw.dDataResidue -= len;
-
-    if (usbd_msc_cfg.scsi_blk_len == 0) {
-        sendCSW(CSW_STATUS_CMD_PASSED);
-    }
-
+    SCSI_advanceWrite(len);
     return true;
 }
 
@@ -921,6 +960,11 @@ static void mass_storage_bulk_out(uint8_t ep)
             break;
     }
 
+    /*the host waits until the storage has taken the block*/
+    if (usbd_msc_cfg.pending == MSC_PENDING_WRITE) {
+        return;
+    }
+
     /*set ep ack to recv next data*/
     usbd_ep_read(ep, NULL, 0, NULL);
 }
@@ -987,6 +1031,36 @@ static usbd_interface_t msc_intf = {
     .notify_handler = msc_storage_notify_handler,
 };
 
+/*
+ * Finish the block the storage answered USBD_MSC_PENDING for, with the usb
+ * interrupt masked. A read goes out to the host now, a write releases the
+ * bulk out endpoint, which NAKs until then.
+ */
+void usbd_msc_sector_done(int result)
+{
+    uint8_t pending = usbd_msc_cfg.pending;
+
+    usbd_msc_cfg.pending = MSC_PENDING_NONE;
+
+    if (pending == MSC_PENDING_READ) {
+        if (result != 0) {
+            SCSI_SenseCode(SCSI_SENSE_HARDWARE_ERROR, SCSI_ASC_UNRECOVERED_READ_ERROR);
+            sendCSW(CSW_STATUS_CMD_FAILED);
+        } else {
+            SCSI_sendReadData();
+        }
+    } else if (pending == MSC_PENDING_WRITE) {
+        if (result != 0) {
+            SCSI_SenseCode(SCSI_SENSE_HARDWARE_ERROR, SCSI_ASC_WRITE_FAULT);
+            sendCSW(CSW_STATUS_CMD_FAILED);
+        } else {
+            SCSI_advanceWrite(usbd_msc_cfg.pending_len);
+        }
+
+        usbd_ep_read(mass_ep_data[MSD_OUT_EP_IDX].ep_addr, NULL, 0, NULL);
+    }
+}
+
 void usbd_msc_class_init(uint8_t out_ep, uint8_t in_ep)
 {
     msc_class.name = "usbd_msc";
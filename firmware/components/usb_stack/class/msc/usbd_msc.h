@@ -97,10 +97,14 @@ extern "C" {
 #endif
 // clang-format on
 
+/* returned by usbd_msc_sector_read/write for a block finished later through usbd_msc_sector_done() */
+#define USBD_MSC_PENDING 1
+
 void usbd_msc_class_init(uint8_t out_ep, uint8_t in_ep);
 void usbd_msc_get_cap(uint8_t lun, uint32_t *block_num, uint16_t *block_size);
 int usbd_msc_sector_read(uint32_t sector, uint8_t *buffer, uint32_t length);
 int usbd_msc_sector_write(uint32_t sector, uint8_t *buffer, uint32_t length);
+void usbd_msc_sector_done(int result);
 
 #ifdef __cplusplus
 }
@@ -162,6 +162,7 @@ typedef struct adc_device {
     adc_data_width_t data_width;
     adc_fifo_threshold_t fifo_threshold;
     adc_pga_gain_t gain;
+    void *rx_dma;
 } adc_device_t;
 
 #define ADC_DEV(dev) ((adc_device_t *)dev)
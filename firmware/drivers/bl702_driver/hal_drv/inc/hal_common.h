@@ -39,6 +39,10 @@ void hal_enter_usb_iap(void);
 void hal_jump2app(uint32_t flash_offset);
 int hal_get_trng_seed(void);
 
+/* serialise the security engine (AES, SHA, PKA) between its users, no-ops without an RTOS */
+void sec_eng_lock(void);
+void sec_eng_unlock(void);
+
 #ifdef __cplusplus
 }
 #endif
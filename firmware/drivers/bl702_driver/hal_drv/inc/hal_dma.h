@@ -71,8 +71,9 @@ enum dma_index_type {
 #define dma_channel_update(dev, list) device_control(dev, DEVICE_CTRL_DMA_CHANNEL_UPDATE, list)
 #define dma_channel_check_busy(dev)   device_control(dev, DEVICE_CTRL_DMA_CHANNEL_GET_STATUS, NULL)
 
-#define DMA_LLI_ONCE_MODE  0
-#define DMA_LLI_CYCLE_MODE 1
+#define DMA_LLI_ONCE_MODE     0
+#define DMA_LLI_CYCLE_MODE    1
+#define DMA_LLI_PINGPONG_MODE 2 /* cycle over two halves, interrupt at the end of each */
 
 #define DMA_ADDR_INCREMENT_DISABLE 0 /*!< Addr increment mode disable */
 #define DMA_ADDR_INCREMENT_ENABLE  1 /*!< Addr increment mode enable  */
@@ -34,16 +34,49 @@ extern "C"{
 #define FLASH_NOT_DETECT  0x10
 #define BL_FLASH_XIP_BASE BL702_FLASH_XIP_BASE
 
+#define FLASH_SECTOR_SIZE 4096
+
+/* sectors below this address are tracked as erased until written, flash_erase_skip_blank() always erases the rest */
+#ifndef FLASH_ERASE_TRACK_SIZE
+#define FLASH_ERASE_TRACK_SIZE (2 * 1024 * 1024)
+#endif
+
+typedef struct {
+    uint32_t write_calls;     /* flash_write() and flash_write_buffered() */
+    uint32_t program_calls;   /* programs handed to the flash driver */
+    uint32_t page_programs;   /* page program commands those took */
+    uint32_t write_bytes;
+    uint32_t erase_sectors;
+    uint32_t erase_skipped;   /* sectors already erased */
+} flash_stats_t;
+
+#define FLASH_WRITE_BUF_EMPTY 0xffffffff
+
+/* flash_write_buffered() state of one writer, see flash_write_buf_init() */
+typedef struct {
+    uint8_t *buf;
+    uint32_t size;
+    uint32_t base;            /* flash address of the window, FLASH_WRITE_BUF_EMPTY when nothing is pending */
+    uint32_t lo;              /* [lo, hi) of the window is pending */
+    uint32_t hi;
+} flash_write_buf_t;
+
 uint32_t flash_get_jedecid(void);
 BL_Err_Type flash_init(void);
 BL_Err_Type flash_read_jedec_id(uint8_t *data);
 BL_Err_Type flash_read_via_xip(uint32_t addr, uint8_t *data, uint32_t len);
 BL_Err_Type flash_read(uint32_t addr, uint8_t *data, uint32_t len);
 BL_Err_Type flash_write(uint32_t addr, uint8_t *data, uint32_t len);
+void flash_write_buf_init(flash_write_buf_t *wbuf, uint8_t *buf, uint32_t size);
+BL_Err_Type flash_write_buffered(flash_write_buf_t *wbuf, uint32_t addr, uint8_t *data, uint32_t len);
+BL_Err_Type flash_write_flush(flash_write_buf_t *wbuf);
 BL_Err_Type flash_erase(uint32_t startaddr, uint32_t len);
+BL_Err_Type flash_erase_skip_blank(uint32_t startaddr, uint32_t len);
 BL_Err_Type flash_set_cache(uint8_t cont_read, uint8_t cache_enable, uint8_t cache_way_disable, uint32_t flash_offset);
 BL_Err_Type flash_get_cfg(uint8_t **cfg_addr, uint32_t *len);
 BL_Err_Type flash_write_protect_set(SFlash_Protect_Kh25v40_Type protect);
+void flash_get_stats(flash_stats_t *stats);
+void flash_clear_stats(void);
 #ifdef __cplusplus
 }
 #endif
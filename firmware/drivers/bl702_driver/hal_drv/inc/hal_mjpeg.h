@@ -68,6 +68,7 @@ typedef struct mjpeg_device {
 void mjpeg_init(mjpeg_device_t *mjpeg_cfg);
 void mjpeg_start(void);
 void mjpeg_stop(void);
+void mjpeg_set_quality(uint8_t quality);
 uint8_t mjpeg_get_one_frame(uint8_t **pic, uint32_t *len, uint8_t *q);
 void mjpeg_drop_one_frame(void);
 
@@ -83,7 +83,36 @@ typedef struct pwm_device {
 
 #define PWM_DEV(dev) ((pwm_device_t *)dev)
 
+#define PWM_GROUP_MAX_CHANNELS 5
+
+/*
+ * A pwm group stages new thresholds for several channels and writes them
+ * together, from the pwm interrupt, right after the reference channel (the
+ * first one in the group) wraps its period. Only registers whose value
+ * actually changes are written.
+ */
+typedef struct pwm_group {
+    pwm_device_t *dev[PWM_GROUP_MAX_CHANNELS];
+    pwm_dutycycle_config_t staged[PWM_GROUP_MAX_CHANNELS];
+    uint8_t num;
+    volatile uint8_t staged_mask; /* channels with staged thresholds */
+    volatile uint8_t armed;       /* waiting for the period boundary */
+
+    /* statistics */
+    uint32_t commits;
+    uint32_t reg_writes;
+    uint32_t last_latency_us; /* commit request to register write */
+    uint32_t max_latency_us;
+    uint64_t commit_time_us;
+} pwm_group_t;
+
 int pwm_register(enum pwm_index_type index, const char *name);
+
+int pwm_group_init(pwm_group_t *group, struct device **dev, uint8_t num);
+void pwm_group_stage(pwm_group_t *group, uint8_t idx, uint16_t threshold_low, uint16_t threshold_high);
+void pwm_group_commit(pwm_group_t *group);
+void pwm_group_commit_now(pwm_group_t *group);
+bool pwm_group_is_pending(pwm_group_t *group);
 #ifdef __cplusplus
 }
 #endif
@@ -46,6 +46,10 @@ typedef struct
 typedef struct
 {
     sec_ecp_type ecpId;
+    /* a stepped scalar multiplication */
+    const uint8_t *scalar;
+    uint32_t bit;
+    uint32_t bits;
 } sec_ecdh_handle_t;
 
 int sec_ecdsa_init(sec_ecdsa_handle_t *handle, sec_ecp_type id);
@@ -59,6 +63,11 @@ int sec_ecdh_init(sec_ecdh_handle_t *handle, sec_ecp_type id);
 int sec_ecdh_deinit(sec_ecdh_handle_t *handle);
 int sec_ecdh_get_encrypt_key(sec_ecdh_handle_t *handle, const uint32_t *pkX, const uint32_t *pkY, const uint32_t *private_key, const uint32_t *pRx, const uint32_t *pRy);
 int sec_ecdh_get_public_key(sec_ecdh_handle_t *handle, const uint32_t *private_key, const uint32_t *pRx, const uint32_t *pRy);
+/* the same multiplication a few scalar bits per step, the PKA holds the point in between;
+ * step returns the bits left, 0 when finish can read the result, or -1 */
+int sec_ecdh_scalar_point_start(sec_ecdh_handle_t *handle, const uint32_t *pkX, const uint32_t *pkY, const uint32_t *private_key);
+int sec_ecdh_scalar_point_step(sec_ecdh_handle_t *handle, uint32_t bits);
+int sec_ecdh_scalar_point_finish(sec_ecdh_handle_t *handle, uint32_t *pRx, uint32_t *pRy);
 int sec_ecc_get_random_value(uint32_t *randomData, uint32_t *maxRef, uint32_t size);
 int sec_eng_trng_enable(void);
 void sec_eng_trng_disable(void);
@@ -178,6 +178,7 @@ enum usb_error_type {
     USB_DC_ADDR_ERR = 4,
     USB_DC_RB_SIZE_SMALL_ERR = 5,
     USB_DC_ZLP_ERR = 6,
+    USB_DC_EP_BUSY_ERR = 7,
 };
 /**
  * @brief USB Endpoint Configuration.
@@ -199,6 +200,27 @@ struct usb_dc_ep_cfg {
     uint8_t ep_type;
 };
 
+/**
+ * Called from the usb isr once a transfer has ended, with the endpoint
+ * address and the number of bytes moved.
+ */
+typedef void (*usb_dc_xfer_cb_t)(struct device *dev, uint8_t ep, uint32_t actual);
+
+/*
+ * Transfer in flight on one endpoint. The isr moves it between the buffer
+ * and the endpoint fifo a packet at a time, without the class code in between.
+ */
+typedef struct
+{
+    uint8_t *buf;
+    uint32_t len;
+    uint32_t actual;
+    usb_dc_xfer_cb_t done;
+    uint8_t busy;
+    uint8_t zlp; /* a zero length packet still has to end an IN transfer */
+    uint8_t nak; /* the ring buffer had no room, OUT ep is left nak'ing */
+} usb_dc_xfer_t;
+
 /*
  * USB endpoint  structure.
  */
@@ -207,6 +229,7 @@ typedef struct
     uint8_t ep_ena;
     uint32_t is_stalled;
     struct usb_dc_ep_cfg ep_cfg;
+    usb_dc_xfer_t xfer;
 } usb_dc_ep_state_t;
 
 typedef struct usb_dc_device {
@@ -230,6 +253,8 @@ int usb_dc_ep_write(struct device *dev, const uint8_t ep, const uint8_t *data, u
 int usb_dc_ep_read(struct device *dev, const uint8_t ep, uint8_t *data, uint32_t data_len, uint32_t *read_bytes);
 int usb_dc_receive_to_ringbuffer(struct device *dev, Ring_Buffer_Type *rb, uint8_t ep);
 int usb_dc_send_from_ringbuffer(struct device *dev, Ring_Buffer_Type *rb, uint8_t ep);
+int usb_dc_ep_xfer_start(struct device *dev, const uint8_t ep, uint8_t *buf, uint32_t len, usb_dc_xfer_cb_t done);
+int usb_dc_ep_xfer_abort(struct device *dev, const uint8_t ep);
 #ifdef __cplusplus
 }
 #endif
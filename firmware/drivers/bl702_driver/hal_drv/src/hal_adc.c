@@ -22,6 +22,7 @@
  */
 #include "hal_adc.h"
 #include "hal_clock.h"
+#include "hal_dma.h"
 #include "bl702_glb.h"
 #include "bl702_dma.h"
 #include "bl702_adc.h"
@@ -216,6 +217,10 @@ int adc_control(struct device *dev, int cmd, void *args)
         case DEVICE_CTRL_CONFIG:
             break;
 
+        case DEVICE_CTRL_ATTACH_RX_DMA:
+            adc_device->rx_dma = (struct device *)args;
+            break;
+
         case DEVICE_CTRL_ADC_CHANNEL_CONFIG:
             if (adc_channel_cfg->num == 1) {
                 ADC_Channel_Config(*adc_channel_cfg->pos_channel, *adc_channel_cfg->neg_channel, adc_device->continuous_conv_mode);
@@ -302,6 +307,20 @@ int adc_control(struct device *dev, int cmd, void *args)
 int adc_read(struct device *dev, uint32_t pos, void *buffer, uint32_t size)
 {
     uint32_t adc_fifo_val[32];
+    adc_device_t *adc_device = (adc_device_t *)dev;
+
+    if (dev->oflag & DEVICE_OFLAG_DMA_RX) {
+        /* raw fifo words land in buffer, parse them with ADC_Parse_Result */
+        struct device *dma_ch = (struct device *)adc_device->rx_dma;
+        int ret;
+
+        if (!dma_ch)
+            return -1;
+
+        ret = dma_reload(dma_ch, (uint32_t)DMA_ADDR_ADC_RDR, (uint32_t)buffer, size);
+        dma_channel_start(dma_ch);
+        return ret;
+    }
 
     if (dev->oflag & DEVICE_OFLAG_STREAM_RX) {
         if (size > 32)
@@ -101,4 +101,13 @@ int hal_get_trng_seed(void)
     BL_WR_REG(GLB_BASE, GLB_CGEN_CFG1, tmpVal);
 
     return seed[0];
+}
+
+/* a program with several tasks on the engine provides a mutex, see the BLE port */
+__WEAK void sec_eng_lock(void)
+{
+}
+
+__WEAK void sec_eng_unlock(void)
+{
 }
\ No newline at end of file
@@ -322,6 +322,36 @@ int dma_reload(struct device *dev, uint32_t src_addr, uint32_t dst_addr, uint32_
 
     dma_ctrl_cfg = (dma_control_data_t)(BL_RD_REG(dma_channel_base[dma_device->id][dma_device->ch], DMA_CONTROL));
 
+    if (dma_device->transfer_mode == DMA_LLI_PINGPONG_MODE) {
+        /* each half is one lli, so it must fit a single transfer */
+        if ((actual_transfer_len % 2) || (actual_transfer_len > (4095 * 2))) {
+            return -1;
+        }
+
+        dma_device->lli_cfg = (dma_lli_ctrl_t *)realloc(dma_device->lli_cfg, sizeof(dma_lli_ctrl_t) * 2);
+
+        if (!dma_device->lli_cfg) {
+            return -2;
+        }
+
+        dma_ctrl_cfg.bits.TransferSize = actual_transfer_len / 2;
+        dma_ctrl_cfg.bits.I = 1;
+
+        for (uint32_t i = 0; i < 2; i++) {
+            dma_device->lli_cfg[i].src_addr = src_addr + (dma_ctrl_cfg.bits.SI ? (i * transfer_size / 2) : 0);
+            dma_device->lli_cfg[i].dst_addr = dst_addr + (dma_ctrl_cfg.bits.DI ? (i * transfer_size / 2) : 0);
+            dma_device->lli_cfg[i].nextlli = (uint32_t)&dma_device->lli_cfg[!i];
+            dma_device->lli_cfg[i].cfg = dma_ctrl_cfg;
+        }
+
+        BL_WR_REG(dma_channel_base[dma_device->id][dma_device->ch], DMA_SRCADDR, dma_device->lli_cfg[0].src_addr);
+        BL_WR_REG(dma_channel_base[dma_device->id][dma_device->ch], DMA_DSTADDR, dma_device->lli_cfg[0].dst_addr);
+        BL_WR_REG(dma_channel_base[dma_device->id][dma_device->ch], DMA_LLI, dma_device->lli_cfg[0].nextlli);
+        BL_WR_REG(dma_channel_base[dma_device->id][dma_device->ch], DMA_CONTROL, dma_device->lli_cfg[0].cfg.WORD);
+
+        return 0;
+    }
+
     malloc_count = actual_transfer_len / 4095;
     remain_len = actual_transfer_len % 4095;
 
@@ -29,6 +29,16 @@
 
 static uint32_t g_jedec_id = 0;
 static SPI_Flash_Cfg_Type g_flash_cfg;
+static flash_stats_t g_flash_stats;
+
+/*
+ * Sectors known to be blank, set by an erase or a blank check, cleared by any
+ * program. Changed with interrupts off, next to the flash operation that changes
+ * the sector. Programs are counted so a blank check that raced with one is not
+ * remembered.
+ */
+static uint32_t g_flash_erased_map[FLASH_ERASE_TRACK_SIZE / FLASH_SECTOR_SIZE / 32];
+static uint32_t g_flash_program_seq;
 
 /**
  * @brief flash_get_jedecid
@@ -221,47 +231,314 @@ BL_Err_Type ATTR_TCM_SECTION flash_read(uint32_t addr, uint8_t *data, uint32_t l
     return ret;
 }
 
+static void flash_stats_add(uint32_t *counter, uint32_t n)
+{
+    cpu_global_irq_disable();
+    *counter += n;
+    cpu_global_irq_enable();
+}
+
+/* with interrupts off */
+static void flash_erased_map_set(uint32_t sector, uint8_t erased)
+{
+    if (sector >= FLASH_ERASE_TRACK_SIZE / FLASH_SECTOR_SIZE) {
+        return;
+    }
+
+    if (erased) {
+        g_flash_erased_map[sector / 32] |= (1U << (sector % 32));
+    } else {
+        g_flash_erased_map[sector / 32] &= ~(1U << (sector % 32));
+    }
+}
+
 /**
- * @brief flash write data
+ * @brief program through the flash driver, which splits at page boundaries
  *
  * @param addr
  * @param data
  * @param len
  * @return BL_Err_Type
  */
-BL_Err_Type ATTR_TCM_SECTION flash_write(uint32_t addr, uint8_t *data, uint32_t len)
+static BL_Err_Type ATTR_TCM_SECTION flash_program(uint32_t addr, uint8_t *data, uint32_t len)
 {
     BL_Err_Type ret = ERROR;
+    uint32_t page_size = g_flash_cfg.pageSize ? g_flash_cfg.pageSize : 256;
+    uint32_t sector;
+
+    if (len == 0) {
+        return SUCCESS;
+    }
 
     cpu_global_irq_disable();
+
+    for (sector = addr / FLASH_SECTOR_SIZE; sector <= (addr + len - 1) / FLASH_SECTOR_SIZE; sector++) {
+        flash_erased_map_set(sector, 0);
+    }
+
+    g_flash_program_seq++;
     XIP_SFlash_Opt_Enter();
     ret = XIP_SFlash_Write_Need_Lock(&g_flash_cfg, g_flash_cfg.ioMode & 0x0f, addr, data, len);
     XIP_SFlash_Opt_Exit();
+
+    g_flash_stats.program_calls++;
+    g_flash_stats.page_programs += (addr + len - 1) / page_size - addr / page_size + 1;
+    g_flash_stats.write_bytes += len;
     cpu_global_irq_enable();
 
     return ret;
 }
 
 /**
- * @brief flash erase
+ * @brief flash write data
  *
- * @param startaddr
- * @param endaddr
+ * @param addr
+ * @param data
+ * @param len
  * @return BL_Err_Type
  */
-BL_Err_Type ATTR_TCM_SECTION flash_erase(uint32_t startaddr, uint32_t len)
+BL_Err_Type ATTR_TCM_SECTION flash_write(uint32_t addr, uint8_t *data, uint32_t len)
+{
+    flash_stats_add(&g_flash_stats.write_calls, 1);
+
+    return flash_program(addr, data, len);
+}
+
+/**
+ * @brief set up a write combine window for flash_write_buffered()
+ *
+ * @param wbuf
+ * @param buf window owned by the caller, word aligned, a multiple of the page size, NULL writes straight through
+ * @param size
+ */
+void flash_write_buf_init(flash_write_buf_t *wbuf, uint8_t *buf, uint32_t size)
+{
+    wbuf->buf = buf;
+    wbuf->size = buf ? size : 0;
+    wbuf->base = FLASH_WRITE_BUF_EMPTY;
+    wbuf->lo = 0;
+    wbuf->hi = 0;
+}
+
+/**
+ * @brief flash write data through a write combine window
+ *
+ * Sequential writes of any size and alignment are collected into the
+ * aligned window of wbuf and programmed once it is full, so a stream of
+ * small chunks costs one program per page instead of one or two per chunk.
+ * Whole aligned windows go straight through. A write that does not continue
+ * the pending one flushes it first. The window is the caller's alone: call
+ * flash_write_flush() after the last write and before reading back or
+ * erasing what was written.
+ *
+ * @param wbuf
+ * @param addr
+ * @param data
+ * @param len
+ * @return BL_Err_Type
+ */
+BL_Err_Type ATTR_TCM_SECTION flash_write_buffered(flash_write_buf_t *wbuf, uint32_t addr, uint8_t *data, uint32_t len)
+{
+    BL_Err_Type ret = SUCCESS;
+    uint32_t base, offset, n;
+
+    if (wbuf->size == 0) {
+        return flash_write(addr, data, len);
+    }
+
+    flash_stats_add(&g_flash_stats.write_calls, 1);
+
+    while (len > 0 && ret == SUCCESS) {
+        offset = addr % wbuf->size;
+        base = addr - offset;
+        n = (len > wbuf->size - offset) ? (wbuf->size - offset) : len;
+
+        if (wbuf->base != FLASH_WRITE_BUF_EMPTY && (wbuf->base != base || wbuf->hi != offset)) {
+            ret = flash_write_flush(wbuf);
+            continue;
+        }
+
+        if (wbuf->base == FLASH_WRITE_BUF_EMPTY) {
+            if (offset == 0 && len >= wbuf->size) {
+                n = len - len % wbuf->size;
+                ret = flash_program(addr, data, n);
+                addr += n;
+                data += n;
+                len -= n;
+                continue;
+            }
+
+            wbuf->base = base;
+            wbuf->lo = offset;
+            wbuf->hi = offset;
+        }
+
+        arch_memcpy(wbuf->buf + offset, data, n);
+        wbuf->hi = offset + n;
+
+        if (wbuf->hi == wbuf->size) {
+            ret = flash_write_flush(wbuf);
+        }
+
+        addr += n;
+        data += n;
+        len -= n;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief program what flash_write_buffered() still holds in wbuf
+ *
+ * @param wbuf
+ * @return BL_Err_Type
+ */
+BL_Err_Type ATTR_TCM_SECTION flash_write_flush(flash_write_buf_t *wbuf)
+{
+    uint32_t base = wbuf->base;
+
+    if (base == FLASH_WRITE_BUF_EMPTY) {
+        return SUCCESS;
+    }
+
+    wbuf->base = FLASH_WRITE_BUF_EMPTY;
+
+    return flash_program(base + wbuf->lo, wbuf->buf + wbuf->lo, wbuf->hi - wbuf->lo);
+}
+
+/**
+ * @brief whether a sector reads all 0xff, remembered until it is programmed
+ *
+ * A blank check costs a fraction of an erase and usually stops at the
+ * first word of a sector in use.
+ *
+ * @param sector
+ * @return 1 when the erase can be skipped
+ */
+static uint8_t ATTR_TCM_SECTION flash_sector_is_erased(uint32_t sector)
+{
+    uint32_t buf[64];
+    uint32_t offset, i, seq;
+
+    if (sector >= FLASH_ERASE_TRACK_SIZE / FLASH_SECTOR_SIZE) {
+        return 0;
+    }
+
+    cpu_global_irq_disable();
+    seq = g_flash_program_seq;
+    i = g_flash_erased_map[sector / 32] & (1U << (sector % 32));
+    cpu_global_irq_enable();
+
+    if (i) {
+        return 1;
+    }
+
+    for (offset = 0; offset < FLASH_SECTOR_SIZE; offset += sizeof(buf)) {
+        if (flash_read(sector * FLASH_SECTOR_SIZE + offset, (uint8_t *)buf, sizeof(buf)) != SUCCESS) {
+            return 0;
+        }
+
+        for (i = 0; i < sizeof(buf) / 4; i++) {
+            if (buf[i] != 0xffffffff) {
+                return 0;
+            }
+        }
+    }
+
+    cpu_global_irq_disable();
+    if (seq == g_flash_program_seq) {
+        flash_erased_map_set(sector, 1);
+    }
+    cpu_global_irq_enable();
+
+    return 1;
+}
+
+/* the driver erases every sector [startaddr, startaddr + len) touches */
+static BL_Err_Type ATTR_TCM_SECTION flash_erase_range(uint32_t startaddr, uint32_t len)
 {
     BL_Err_Type ret = ERROR;
+    uint32_t sector;
 
     cpu_global_irq_disable();
     XIP_SFlash_Opt_Enter();
     ret = XIP_SFlash_Erase_Need_Lock(&g_flash_cfg, g_flash_cfg.ioMode & 0x0f, startaddr, startaddr + len - 1);
     XIP_SFlash_Opt_Exit();
+
+    g_flash_stats.erase_sectors += (startaddr + len - 1) / FLASH_SECTOR_SIZE - startaddr / FLASH_SECTOR_SIZE + 1;
+
+    if (ret == SUCCESS) {
+        for (sector = startaddr / FLASH_SECTOR_SIZE; sector <= (startaddr + len - 1) / FLASH_SECTOR_SIZE; sector++) {
+            flash_erased_map_set(sector, 1);
+        }
+    }
     cpu_global_irq_enable();
 
     return ret;
 }
 
+/**
+ * @brief flash erase
+ *
+ * @param startaddr
+ * @param endaddr
+ * @return BL_Err_Type
+ */
+BL_Err_Type ATTR_TCM_SECTION flash_erase(uint32_t startaddr, uint32_t len)
+{
+    if (len == 0) {
+        return SUCCESS;
+    }
+
+    return flash_erase_range(startaddr, len);
+}
+
+/**
+ * @brief flash erase, skipping sectors that are already blank
+ *
+ * For large regions that are often partly blank, such as an OTA slot. Each
+ * sector not known to be blank is read first, which costs more than it saves
+ * when the region is mostly in use.
+ *
+ * @param startaddr
+ * @param len
+ * @return BL_Err_Type
+ */
+BL_Err_Type ATTR_TCM_SECTION flash_erase_skip_blank(uint32_t startaddr, uint32_t len)
+{
+    BL_Err_Type ret = SUCCESS;
+    uint32_t sector, last, run = 0, skipped = 0;
+
+    if (len == 0) {
+        return SUCCESS;
+    }
+
+    last = (startaddr + len - 1) / FLASH_SECTOR_SIZE;
+
+    for (sector = startaddr / FLASH_SECTOR_SIZE; sector <= last && ret == SUCCESS; sector++) {
+        if (flash_sector_is_erased(sector)) {
+            skipped++;
+
+            /* one call for the whole run, the driver picks block erases where aligned */
+            if (run) {
+                ret = flash_erase_range((sector - run) * FLASH_SECTOR_SIZE, run * FLASH_SECTOR_SIZE);
+                run = 0;
+            }
+        } else {
+            run++;
+        }
+    }
+
+    if (run && ret == SUCCESS) {
+        ret = flash_erase_range((last + 1 - run) * FLASH_SECTOR_SIZE, run * FLASH_SECTOR_SIZE);
+    }
+
+    flash_stats_add(&g_flash_stats.erase_skipped, skipped);
+
+    return ret;
+}
+
 /**
  * @brief flash write protect set
  *
@@ -344,3 +621,26 @@ BL_Err_Type ATTR_TCM_SECTION flash_set_cache(uint8_t cont_read, uint8_t cache_en
 
     return SUCCESS;
 }
+
+/**
+ * @brief flash write and erase counters since boot or the last clear
+ *
+ * @param stats
+ */
+void flash_get_stats(flash_stats_t *stats)
+{
+    cpu_global_irq_disable();
+    *stats = g_flash_stats;
+    cpu_global_irq_enable();
+}
+
+/**
+ * @brief clear the flash counters
+ *
+ */
+void flash_clear_stats(void)
+{
+    cpu_global_irq_disable();
+    arch_memset(&g_flash_stats, 0, sizeof(g_flash_stats));
+    cpu_global_irq_enable();
+}
@@ -107,6 +107,16 @@ void mjpeg_stop(void)
     BL_WR_REG(MJPEG_BASE, MJPEG_CONTROL_1, tmpVal);
 }
 
+/* takes effect from the next frame, the frame info reports the q each frame was coded with */
+void mjpeg_set_quality(uint8_t quality)
+{
+    uint32_t tmpVal;
+
+    tmpVal = BL_RD_REG(MJPEG_BASE, MJPEG_CONTROL_1);
+    tmpVal = BL_SET_REG_BITS_VAL(tmpVal, MJPEG_REG_Q_MODE, quality);
+    BL_WR_REG(MJPEG_BASE, MJPEG_CONTROL_1, tmpVal);
+}
+
 uint8_t mjpeg_get_one_frame(uint8_t **pic, uint32_t *len, uint8_t *q)
 {
     MJPEG_Frame_Info info;
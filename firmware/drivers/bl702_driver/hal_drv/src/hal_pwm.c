@@ -22,6 +22,7 @@
  */
 #include "hal_pwm.h"
 #include "hal_clock.h"
+#include "hal_mtimer.h"
 #include "bl702_pwm.h"
 #include "bl702_glb.h"
 
@@ -44,6 +45,10 @@ static pwm_device_t pwmx_device[PWM_MAX_INDEX] = {
 };
 static void PWM_IRQ(void);
 
+static pwm_group_t *pwm_armed_group = NULL;
+
+#define PWM_CH_REG(ch) (PWM_BASE + PWM_CHANNEL_OFFSET + (ch) * 0x20)
+
 int pwm_open(struct device *dev, uint16_t oflag)
 {
     pwm_device_t *pwm_device = (pwm_device_t *)dev;
@@ -111,6 +116,8 @@ int pwm_control(struct device *dev, int cmd, void *args)
             BL_WR_REG(PWM_BASE + PWM_CHANNEL_OFFSET + (pwm_device->ch) * 0x20, PWM_PERIOD, (uint32_t)args);
             break;
         case DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG:
+            pwm_device->threshold_low = config->threshold_low;
+            pwm_device->threshold_high = config->threshold_high;
             BL_WR_REG(PWM_BASE + PWM_CHANNEL_OFFSET + (pwm_device->ch) * 0x20, PWM_THRE1, config->threshold_low);
             BL_WR_REG(PWM_BASE + PWM_CHANNEL_OFFSET + (pwm_device->ch) * 0x20, PWM_THRE2, config->threshold_high);
             break;
@@ -160,6 +167,166 @@ int pwm_register(enum pwm_index_type index, const char *name)
     return device_register(dev, name);
 }
 
+/* must be called with the pwm interrupt masked or from the pwm interrupt */
+static void pwm_group_apply(pwm_group_t *group)
+{
+    uint8_t mask = group->staged_mask;
+    uint64_t now;
+
+    for (uint8_t i = 0; i < group->num; i++) {
+        pwm_device_t *pwm_device = group->dev[i];
+
+        if (!(mask & (1 << i))) {
+            continue;
+        }
+
+        /* threshold_low is rarely touched, skip the write when it is unchanged */
+        if (pwm_device->threshold_low != group->staged[i].threshold_low) {
+            pwm_device->threshold_low = group->staged[i].threshold_low;
+            BL_WR_REG(PWM_CH_REG(pwm_device->ch), PWM_THRE1, pwm_device->threshold_low);
+            group->reg_writes++;
+        }
+
+        if (pwm_device->threshold_high != group->staged[i].threshold_high) {
+            pwm_device->threshold_high = group->staged[i].threshold_high;
+            BL_WR_REG(PWM_CH_REG(pwm_device->ch), PWM_THRE2, pwm_device->threshold_high);
+            group->reg_writes++;
+        }
+    }
+
+    group->staged_mask = 0;
+    group->armed = 0;
+    group->commits++;
+
+    now = mtimer_get_time_us();
+    group->last_latency_us = (uint32_t)(now - group->commit_time_us);
+    if (group->last_latency_us > group->max_latency_us) {
+        group->max_latency_us = group->last_latency_us;
+    }
+}
+
+/**
+ * @brief init a pwm group, all devices must already be opened
+ *
+ * @param group group to init
+ * @param dev pwm devices, dev[0] is the reference channel for the period boundary
+ * @param num number of devices
+ * @return int 0 on success
+ */
+int pwm_group_init(pwm_group_t *group, struct device **dev, uint8_t num)
+{
+    if ((num == 0) || (num > PWM_GROUP_MAX_CHANNELS)) {
+        return -DEVICE_EINVAL;
+    }
+
+    memset(group, 0, sizeof(pwm_group_t));
+
+    for (uint8_t i = 0; i < num; i++) {
+        if (dev[i] == NULL) {
+            return -DEVICE_EINVAL;
+        }
+
+        group->dev[i] = PWM_DEV(dev[i]);
+        group->staged[i].threshold_low = group->dev[i]->threshold_low;
+        group->staged[i].threshold_high = group->dev[i]->threshold_high;
+    }
+
+    group->num = num;
+    Interrupt_Handler_Register(PWM_IRQn, PWM_IRQ);
+
+    return 0;
+}
+
+/**
+ * @brief stage new thresholds for one channel of the group, nothing is written to hardware
+ *
+ * @param group pwm group
+ * @param idx index of the channel in the group
+ * @param threshold_low
+ * @param threshold_high
+ */
+void pwm_group_stage(pwm_group_t *group, uint8_t idx, uint16_t threshold_low, uint16_t threshold_high)
+{
+    if (idx >= group->num) {
+        return;
+    }
+
+    CPU_Interrupt_Disable(PWM_IRQn);
+    group->staged[idx].threshold_low = threshold_low;
+    group->staged[idx].threshold_high = threshold_high;
+    group->staged_mask |= (1 << idx);
+    CPU_Interrupt_Enable(PWM_IRQn);
+}
+
+/**
+ * @brief write all staged thresholds at the next period boundary of the reference channel
+ *
+ * Staging again before the boundary is reached simply replaces the values,
+ * so only the latest command reaches the hardware.
+ *
+ * @param group pwm group
+ */
+void pwm_group_commit(pwm_group_t *group)
+{
+    uint32_t ref = PWM_CH_REG(group->dev[0]->ch);
+    uint32_t tmpVal;
+
+    CPU_Interrupt_Disable(PWM_IRQn);
+
+    if ((group->staged_mask == 0) || group->armed) {
+        CPU_Interrupt_Enable(PWM_IRQn);
+        return;
+    }
+
+    group->commit_time_us = mtimer_get_time_us();
+
+    /* reference channel stopped, there is no period boundary to wait for */
+    if (BL_IS_REG_BIT_SET(BL_RD_REG(ref, PWM_CONFIG), PWM_STOP_EN)) {
+        pwm_group_apply(group);
+        CPU_Interrupt_Enable(PWM_IRQn);
+        return;
+    }
+
+    group->armed = 1;
+    pwm_armed_group = group;
+
+    /* interrupt after one more period of the reference channel */
+    tmpVal = BL_RD_REG(ref, PWM_INTERRUPT);
+    BL_WR_REG(ref, PWM_INTERRUPT, BL_SET_REG_BITS_VAL(tmpVal, PWM_INT_PERIOD_CNT, 1));
+    PWM_IntMask(group->dev[0]->ch, PWM_INT_PULSE_CNT, UNMASK);
+
+    CPU_Interrupt_Enable(PWM_IRQn);
+}
+
+/**
+ * @brief write all staged thresholds immediately, without waiting for the period boundary
+ *
+ * @param group pwm group
+ */
+void pwm_group_commit_now(pwm_group_t *group)
+{
+    CPU_Interrupt_Disable(PWM_IRQn);
+
+    if (group->armed) {
+        PWM_IntMask(group->dev[0]->ch, PWM_INT_PULSE_CNT, MASK);
+        pwm_armed_group = NULL;
+    } else {
+        group->commit_time_us = mtimer_get_time_us();
+    }
+
+    if (group->staged_mask) {
+        pwm_group_apply(group);
+    }
+
+    group->armed = 0;
+    CPU_Interrupt_Enable(PWM_IRQn);
+}
+
+bool pwm_group_is_pending(pwm_group_t *group)
+{
+    return (group->armed != 0);
+}
+
 static void pwm_isr(pwm_device_t *handle)
 {
     uint32_t i;
@@ -190,6 +357,15 @@ static void pwm_isr(pwm_device_t *handle)
             tmpVal &= (~(1 << (handle[i].ch + PWM_INT_CLEAR_POS)));
             BL_WR_REG(PWMx, PWM_INT_CONFIG, tmpVal);
 
+            if (pwm_armed_group && (pwm_armed_group->dev[0] == &handle[i])) {
+                pwm_group_t *group = pwm_armed_group;
+
+                pwm_armed_group = NULL;
+                PWM_IntMask(handle[i].ch, PWM_INT_PULSE_CNT, MASK);
+                pwm_group_apply(group);
+                continue;
+            }
+
             if (handle[i].parent.callback) {
                 handle[i].parent.callback(&handle[i].parent, NULL, 0, PWM_EVENT_COMPLETE);
             }
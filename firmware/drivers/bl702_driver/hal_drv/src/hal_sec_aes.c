@@ -75,6 +75,9 @@ int sec_aes_setkey(sec_aes_handle_t *handle, const uint8_t *key, uint8_t key_len
             break;
 
         case SEC_AES_ECB:
+            Sec_Eng_AES_Enable_BE(SEC_ENG_AES_ID0);
+            Sec_Eng_AES_Init(&aesCtx, SEC_ENG_AES_ID0, SEC_ENG_AES_ECB, type,
+                             SEC_AES_DIR_ENCRYPT == dir ? SEC_ENG_AES_ENCRYPTION : SEC_ENG_AES_DECRYPTION);
             break;
 
         default:
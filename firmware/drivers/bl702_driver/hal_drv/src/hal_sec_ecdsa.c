@@ -576,78 +576,70 @@ static void sec_ecdsa_dump_temp_result()
     bflb_platform_dump(pka_tmp, ECP_SECP256R1_SIZE);
 }
 #endif
-static int sec_ecdsa_verify_point_mul(uint8_t id, const uint32_t *m)
+/* bits [first, first + count) of the big-endian scalar p, least significant first */
+static int sec_ecc_point_mul_bits(uint8_t id, const uint8_t *p, uint32_t first, uint32_t count)
 {
-    uint32_t i, j, k;
-    uint32_t tmp;
-    uint32_t isOne = 0;
-    uint8_t *p = (uint8_t *)m;
+    uint32_t b;
     uint8_t pka_p1_eq_inf, pka_p2_eq_inf;
 
-    /* Remove zeros bytes*/
-    k = 0;
-
-    while (p[k] == 0 && k < 31) {
-        k++;
-    }
-
-    i = 31;
-
-    for (; i >= k; i--) {
-        tmp = p[i];
-        j = 0;
-
-        for (j = 0; j < 8; j++) {
-            isOne = tmp & (1 << j);
-
-            if (isOne) {
-                sec_ecdsa_point_add_inf_check(&pka_p1_eq_inf, &pka_p2_eq_inf);
+    for (b = first; b < first + count; b++) {
+        if (p[31 - b / 8] & (1 << (b % 8))) {
+            sec_ecdsa_point_add_inf_check(&pka_p1_eq_inf, &pka_p2_eq_inf);
 
-                if (pka_p1_eq_inf == 1 && pka_p2_eq_inf == 0) {
-                    //sum = X2
-                    sec_ecdsa_copy_x2_to_x1(id);
+            if (pka_p1_eq_inf == 1 && pka_p2_eq_inf == 0) {
+                //sum = X2
+                sec_ecdsa_copy_x2_to_x1(id);
 #ifdef ECDSA_DBG_DETAIL
-                    MSG("sum = X2\r\n");
-                    sec_ecdsa_dump_temp_result();
+                MSG("sum = X2\r\n");
+                sec_ecdsa_dump_temp_result();
 #endif
-                } else if (pka_p1_eq_inf == 0 && pka_p2_eq_inf == 1) {
-                    //sum = X1
-                    //MSG("sum = X1\r\n");
-                } else if (pka_p1_eq_inf == 0 && pka_p2_eq_inf == 0) {
-                    //sum = X1 + X2
-                    sec_ecdsa_point_add(id);
+            } else if (pka_p1_eq_inf == 0 && pka_p2_eq_inf == 1) {
+                //sum = X1
+                //MSG("sum = X1\r\n");
+            } else if (pka_p1_eq_inf == 0 && pka_p2_eq_inf == 0) {
+                //sum = X1 + X2
+                sec_ecdsa_point_add(id);
 #ifdef ECDSA_DBG_DETAIL
-                    MSG("sum = X1+X2\r\n");
-                    sec_ecdsa_dump_temp_result();
+                MSG("sum = X1+X2\r\n");
+                sec_ecdsa_dump_temp_result();
 #endif
-                } else {
-                    //MSG("Error! infinite point + infinite point\r\n");
-                    return -1;
-                }
+            } else {
+                //MSG("Error! infinite point + infinite point\r\n");
+                return -1;
             }
+        }
 
-            sec_ecdsa_point_double(id);
+        sec_ecdsa_point_double(id);
 #ifdef ECDSA_DBG_DETAIL
-            sec_ecdsa_dump_temp_result();
+        sec_ecdsa_dump_temp_result();
 #endif
-        }
-
-        if (i == 0) {
-            break;
-        }
     }
 
     return 0;
 }
 
-/*cal d*G if pkX(pky)==NULL
- * cal d(bG) if pkX(pky)!=NULL */
-static int32_t sec_ecdh_get_scalar_point(uint8_t id, const uint32_t *pkX, const uint32_t *pkY, const uint32_t *private_key, const uint32_t *pRx, const uint32_t *pRy)
+/* significant bits of the scalar, whole bytes and at least one */
+static uint32_t sec_ecc_scalar_bits(const uint32_t *m)
 {
-#ifdef ECDSA_DBG
-    uint32_t pk_z[8];
-#endif
+    const uint8_t *p = (const uint8_t *)m;
+    uint32_t k = 0;
+
+    /* Remove zeros bytes*/
+    while (p[k] == 0 && k < 31) {
+        k++;
+    }
 
+    return (32 - k) * 8;
+}
+
+static int sec_ecdsa_verify_point_mul(uint8_t id, const uint32_t *m)
+{
+    return sec_ecc_point_mul_bits(id, (const uint8_t *)m, 0, sec_ecc_scalar_bits(m));
+}
+
+/* load G, or the peer key pkX/pkY if given, and the start point for a multiplication by private_key */
+static int32_t sec_ecdh_scalar_point_setup(uint8_t id, const uint32_t *pkX, const uint32_t *pkY, const uint32_t *private_key)
+{
     if (id >= ECP_TYPE_MAX) {
         return ERROR;
     }
@@ -742,7 +734,16 @@ static int32_t sec_ecdh_get_scalar_point(uint8_t id, const uint32_t *pkX, const
     /* Clear temp register since it's used in point-mul*/
     Sec_Eng_PKA_CREG(ECP_SECP256R1_LT_REG_TYPE, 7, ECP_SECP256R1_SIZE / 4, 1);
 
-    sec_ecdsa_verify_point_mul(id, private_key);
+    return 0;
+}
+
+/* the product back from the Montgomery domain to affine coordinates */
+static void sec_ecdh_scalar_point_read(uint8_t id, const uint32_t *pRx, const uint32_t *pRy)
+{
+#ifdef ECDSA_DBG
+    uint32_t pk_z[8];
+#endif
+
     //get bar_u1_x
     Sec_Eng_PKA_Read_Data(ECP_SECP256R1_REG_TYPE, 2, (uint32_t *)pRx, ECP_SECP256R1_SIZE / 4);
 #ifdef ECDSA_DBG
@@ -853,6 +854,21 @@ static int32_t sec_ecdh_get_scalar_point(uint8_t id, const uint32_t *pkX, const
     MSG("R.y%n=\r\n");
     bflb_platform_dump(pRy, ECP_SECP256R1_SIZE);
 #endif
+}
+
+/*cal d*G if pkX(pky)==NULL
+ * cal d(bG) if pkX(pky)!=NULL */
+static int32_t sec_ecdh_get_scalar_point(uint8_t id, const uint32_t *pkX, const uint32_t *pkY, const uint32_t *private_key, const uint32_t *pRx, const uint32_t *pRy)
+{
+    if (sec_ecdh_scalar_point_setup(id, pkX, pkY, private_key) != 0) {
+        return -1;
+    }
+
+    if (sec_ecdsa_verify_point_mul(id, private_key) != 0) {
+        return -1;
+    }
+
+    sec_ecdh_scalar_point_read(id, pRx, pRy);
     return 0;
 }
 
@@ -1448,3 +1464,41 @@ int sec_ecdh_get_public_key(sec_ecdh_handle_t *handle, const uint32_t *private_k
 {
     return sec_ecdh_get_scalar_point(handle->ecpId, NULL, NULL, private_key, pRx, pRy);
 }
+
+int sec_ecdh_scalar_point_start(sec_ecdh_handle_t *handle, const uint32_t *pkX, const uint32_t *pkY, const uint32_t *private_key)
+{
+    if (sec_ecdh_scalar_point_setup(handle->ecpId, pkX, pkY, private_key) != 0) {
+        return -1;
+    }
+
+    handle->scalar = (const uint8_t *)private_key;
+    handle->bit = 0;
+    handle->bits = sec_ecc_scalar_bits(private_key);
+
+    return 0;
+}
+
+int sec_ecdh_scalar_point_step(sec_ecdh_handle_t *handle, uint32_t bits)
+{
+    if (bits > handle->bits - handle->bit) {
+        bits = handle->bits - handle->bit;
+    }
+
+    if (sec_ecc_point_mul_bits(handle->ecpId, handle->scalar, handle->bit, bits) != 0) {
+        return -1;
+    }
+
+    handle->bit += bits;
+
+    return handle->bits - handle->bit;
+}
+
+int sec_ecdh_scalar_point_finish(sec_ecdh_handle_t *handle, uint32_t *pRx, uint32_t *pRy)
+{
+    if (handle->bit < handle->bits) {
+        return -1;
+    }
+
+    sec_ecdh_scalar_point_read(handle->ecpId, pRx, pRy);
+    return 0;
+}
@@ -38,6 +38,12 @@
 #define USB_DC_LOG_ERR(a, ...) //bflb_platform_printf(a, ##__VA_ARGS__)
 #define USB_DC_LOG(a, ...)
 
+/* cpu access to the endpoint fifos, and the aliases the dma handshake uses */
+#define USB_DC_EP_TX_FIFO(ep_idx)     (USB_BASE + USB_EP0_TX_FIFO_WDATA_OFFSET + (ep_idx)*0x10)
+#define USB_DC_EP_RX_FIFO(ep_idx)     (USB_BASE + USB_EP0_RX_FIFO_RDATA_OFFSET + (ep_idx)*0x10)
+#define USB_DC_EP_TX_DMA_FIFO(ep_idx) (USB_BASE + 0x308 + (ep_idx)*0x10)
+#define USB_DC_EP_RX_DMA_FIFO(ep_idx) (USB_BASE + 0x30C + (ep_idx)*0x10)
+
 static usb_dc_device_t usb_fs_device;
 static void USB_FS_IRQ(void);
 
@@ -58,6 +64,72 @@ static dma_lli_ctrl_t usb_lli_list = {
     .cfg.bits.TransferSize = 0
 };
 
+/*
+ * The fifo data register takes one byte per access, so the cost is on the
+ * memory side: read the buffer a word at a time and unroll the stores.
+ */
+static void usb_fifo_write(void *fifo_addr, uint8_t *data, uint32_t length)
+{
+    volatile uint8_t *p = (volatile uint8_t *)fifo_addr;
+
+    if (!((uintptr_t)data & 3)) {
+        const uint32_t *q = (const uint32_t *)data;
+
+        for (; length >= 4; length -= 4) {
+            uint32_t word = *q++;
+
+            *p = (uint8_t)word;
+            *p = (uint8_t)(word >> 8);
+            *p = (uint8_t)(word >> 16);
+            *p = (uint8_t)(word >> 24);
+        }
+
+        data = (uint8_t *)q;
+    }
+
+    while (length--) {
+        *p = *data++;
+    }
+}
+
+static void usb_fifo_read(void *fifo_addr, uint8_t *data, uint32_t length)
+{
+    volatile uint8_t *p = (volatile uint8_t *)fifo_addr;
+
+    if (!((uintptr_t)data & 3)) {
+        uint32_t *q = (uint32_t *)data;
+
+        for (; length >= 4; length -= 4) {
+            uint32_t word = *p;
+
+            word |= (uint32_t)*p << 8;
+            word |= (uint32_t)*p << 16;
+            word |= (uint32_t)*p << 24;
+            *q++ = word;
+        }
+
+        data = (uint8_t *)q;
+    }
+
+    while (length--) {
+        *data++ = *p;
+    }
+}
+
+static void usb_dma_start(struct device *dma, uint32_t src, uint32_t dst, uint32_t size, uint8_t to_fifo)
+{
+    dma_channel_stop(dma);
+    usb_lli_list.src_addr = src;
+    usb_lli_list.dst_addr = dst;
+    usb_lli_list.cfg.bits.TransferSize = size;
+    usb_lli_list.cfg.bits.SI = to_fifo;
+    usb_lli_list.cfg.bits.DI = !to_fifo;
+    usb_lli_list.cfg.bits.SBSize = to_fifo ? DMA_BURST_16BYTE : DMA_BURST_1BYTE;
+    usb_lli_list.cfg.bits.DBSize = to_fifo ? DMA_BURST_1BYTE : DMA_BURST_16BYTE;
+    dma_channel_update(dma, (void *)((uint32_t)&usb_lli_list));
+    dma_channel_start(dma);
+}
+
 static void usb_set_power_up(void)
 {
     uint32_t tmpVal = 0;
@@ -400,18 +472,7 @@ int usb_write(struct device *dev, uint32_t pos, const void *buffer, uint32_t siz
     uint8_t ep_idx = USB_EP_GET_IDX(pos);
 
     if (usb_device->in_ep[ep_idx].ep_cfg.ep_type == USBD_EP_TYPE_ISOC) {
-        uint32_t usb_ep_addr = USB_BASE + 0x308 + ep_idx * 0x10;
-
-        dma_channel_stop(usb_device->tx_dma);
-        usb_lli_list.src_addr = (uint32_t)buffer;
-        usb_lli_list.dst_addr = usb_ep_addr;
-        usb_lli_list.cfg.bits.TransferSize = size;
-        usb_lli_list.cfg.bits.DI = 0;
-        usb_lli_list.cfg.bits.SI = 1;
-        usb_lli_list.cfg.bits.SBSize = DMA_BURST_16BYTE;
-        usb_lli_list.cfg.bits.DBSize = DMA_BURST_1BYTE;
-        dma_channel_update(usb_device->tx_dma, (void *)((uint32_t)&usb_lli_list));
-        dma_channel_start(usb_device->tx_dma);
+        usb_dma_start(usb_device->tx_dma, (uint32_t)buffer, USB_DC_EP_TX_DMA_FIFO(ep_idx), size, 1);
         return 0;
     } else {
     }
@@ -425,18 +486,7 @@ int usb_read(struct device *dev, uint32_t pos, void *buffer, uint32_t size)
     uint8_t ep_idx = USB_EP_GET_IDX(pos);
 
     if (usb_device->out_ep[ep_idx].ep_cfg.ep_type == USBD_EP_TYPE_ISOC) {
-        uint32_t usb_ep_addr = USB_BASE + 0x308 + ep_idx * 0x1c;
-
-        dma_channel_stop(usb_device->tx_dma);
-        usb_lli_list.src_addr = usb_ep_addr;
-        usb_lli_list.dst_addr = (uint32_t)buffer;
-        usb_lli_list.cfg.bits.TransferSize = size;
-        usb_lli_list.cfg.bits.DI = 1;
-        usb_lli_list.cfg.bits.SI = 0;
-        usb_lli_list.cfg.bits.SBSize = DMA_BURST_1BYTE;
-        usb_lli_list.cfg.bits.DBSize = DMA_BURST_16BYTE;
-        dma_channel_update(usb_device->rx_dma, (void *)((uint32_t)&usb_lli_list));
-        dma_channel_start(usb_device->rx_dma);
+        usb_dma_start(usb_device->rx_dma, USB_DC_EP_RX_DMA_FIFO(ep_idx), (uint32_t)buffer, size, 0);
         return 0;
     } else {
     }
@@ -573,6 +623,7 @@ int usb_dc_ep_open(struct device *dev, const struct usb_dc_ep_cfg *ep_cfg)
 
 int usb_dc_ep_close(const uint8_t ep)
 {
+    usb_dc_ep_xfer_abort(&usb_fs_device.parent, ep);
     return 0;
 }
 
@@ -838,7 +889,7 @@ int usb_dc_ep_write(struct device *dev, const uint8_t ep, const uint8_t *data, u
      * to access a FIFO, the application must complete the transaction
      * before accessing the register."
      */
-    ep_tx_fifo_addr = USB_BASE + USB_EP0_TX_FIFO_WDATA_OFFSET + ep_idx * 0x10;
+    ep_tx_fifo_addr = USB_DC_EP_TX_FIFO(ep_idx);
 
     if ((data_len == 1) && (ep_idx == 0)) {
         USB_Set_EPx_Xfer_Size(EP_ID0, 1);
@@ -846,7 +897,7 @@ int usb_dc_ep_write(struct device *dev, const uint8_t ep, const uint8_t *data, u
         USB_Set_EPx_Xfer_Size(EP_ID0, 64);
     }
 
-    memcopy_to_fifo((void *)ep_tx_fifo_addr, (uint8_t *)data, data_len);
+    usb_fifo_write((void *)ep_tx_fifo_addr, (uint8_t *)data, data_len);
     /* Clear NAK and enable ep */
     if (USB_EP_GET_IDX(ep) != 0)
         USB_Set_EPx_Rdy(USB_EP_GET_IDX(ep));
@@ -924,8 +975,8 @@ int usb_dc_ep_read(struct device *dev, const uint8_t ep, uint8_t *data, uint32_t
     read_count = MIN(read_count, data_len);
 
     /* Data in the FIFOs is always stored per 8-bit word*/
-    ep_rx_fifo_addr = (USB_BASE + USB_EP0_RX_FIFO_RDATA_OFFSET + ep_idx * 0x10);
-    fifocopy_to_mem((void *)ep_rx_fifo_addr, data, read_count);
+    ep_rx_fifo_addr = USB_DC_EP_RX_FIFO(ep_idx);
+    usb_fifo_read((void *)ep_rx_fifo_addr, data, read_count);
     USB_DC_LOG_DBG("Read EP%d, req %d, read %d bytes\r\n", ep, data_len, read_count);
 
     if (read_bytes) {
@@ -934,8 +985,162 @@ int usb_dc_ep_read(struct device *dev, const uint8_t ep, uint8_t *data, uint32_t
 
     return USB_DC_OK;
 }
+static void usb_dc_xfer_end(usb_dc_device_t *device, usb_dc_xfer_t *xfer, uint8_t ep)
+{
+    xfer->busy = 0U;
+    xfer->zlp = 0U;
+
+    if (xfer->done) {
+        xfer->done(&device->parent, ep, xfer->actual);
+    }
+}
+
+/*
+ * Next packet of an IN transfer, once the endpoint is free again. The
+ * transfer ends as soon as its last packet is in the fifo, the buffer can
+ * be reused from then on. The cpu moves it: one packet is at most 64 bytes,
+ * less than it takes to set up a dma channel and wait for it in the isr.
+ */
+static void usb_dc_xfer_in(usb_dc_device_t *device, uint8_t ep_idx)
+{
+    usb_dc_ep_state_t *ep_state = &device->in_ep[ep_idx];
+    usb_dc_xfer_t *xfer = &ep_state->xfer;
+    uint32_t len = MIN(xfer->len - xfer->actual, ep_state->ep_cfg.ep_mps);
+
+    if (len) {
+        usb_fifo_write((void *)USB_DC_EP_TX_FIFO(ep_idx), xfer->buf + xfer->actual, len);
+        xfer->actual += len;
+    } else {
+        xfer->zlp = 0U;
+    }
+
+    USB_Set_EPx_Rdy(ep_idx);
+
+    if ((xfer->actual == xfer->len) && !xfer->zlp) {
+        usb_dc_xfer_end(device, xfer, USB_SET_EP_IN(ep_idx));
+    }
+}
+
+/*
+ * Packet received on an OUT transfer. A short packet ends the transfer
+ * before the buffer is full, otherwise the endpoint is armed for the next one.
+ */
+static void usb_dc_xfer_out(usb_dc_device_t *device, uint8_t ep_idx)
+{
+    usb_dc_ep_state_t *ep_state = &device->out_ep[ep_idx];
+    usb_dc_xfer_t *xfer = &ep_state->xfer;
+    uint32_t count = USB_Get_EPx_RX_FIFO_CNT(ep_idx);
+    uint32_t len = MIN(count, xfer->len - xfer->actual);
+
+    if (len) {
+        usb_fifo_read((void *)USB_DC_EP_RX_FIFO(ep_idx), xfer->buf + xfer->actual, len);
+        xfer->actual += len;
+    }
+
+    if ((count < ep_state->ep_cfg.ep_mps) || (xfer->actual == xfer->len)) {
+        usb_dc_xfer_end(device, xfer, USB_SET_EP_OUT(ep_idx));
+        return;
+    }
+
+    USB_Set_EPx_Rdy(ep_idx);
+}
+
 /**
- * @brief
+ * @brief Queue a transfer on a bulk or interrupt endpoint
+ *
+ * The isr moves the whole buffer one packet at a time through the endpoint
+ * fifo and calls done once the transfer has ended. An IN
+ * transfer that is a multiple of the max packet size ends with a zero length
+ * packet. An OUT transfer ends on a short packet or a full buffer, so len
+ * should be a multiple of the max packet size. The endpoint interrupt must
+ * be enabled with DEVICE_CTRL_SET_INT.
+ *
+ * @param dev usb device
+ * @param ep endpoint address
+ * @param buf data to send or room to receive into, must stay valid until done
+ * @param len transfer length
+ * @param done completion callback, called from the usb isr, may be NULL
+ * @return 0 on success, negative errno code on fail.
+ */
+int usb_dc_ep_xfer_start(struct device *dev, const uint8_t ep, uint8_t *buf, uint32_t len, usb_dc_xfer_cb_t done)
+{
+    usb_dc_device_t *device = (usb_dc_device_t *)dev;
+    uint8_t ep_idx = USB_EP_GET_IDX(ep);
+    usb_dc_ep_state_t *ep_state;
+    usb_dc_xfer_t *xfer;
+
+    if (!ep_idx || !usb_ep_is_enabled(ep)) {
+        return -USB_DC_EP_EN_ERR;
+    }
+
+    if (!buf && len) {
+        return -USB_DC_ADDR_ERR;
+    }
+
+    ep_state = USB_EP_DIR_IS_IN(ep) ? &device->in_ep[ep_idx] : &device->out_ep[ep_idx];
+    xfer = &ep_state->xfer;
+
+    if (ep_state->ep_cfg.ep_type == USBD_EP_TYPE_ISOC) {
+        return -USB_DC_EP_EN_ERR;
+    }
+
+    if (xfer->busy) {
+        return -USB_DC_EP_BUSY_ERR;
+    }
+
+    cpu_global_irq_disable();
+
+    xfer->buf = buf;
+    xfer->len = len;
+    xfer->actual = 0;
+    xfer->done = done;
+    xfer->nak = 0U;
+    xfer->busy = 1U;
+
+    if (USB_EP_DIR_IS_IN(ep)) {
+        xfer->zlp = !(len % ep_state->ep_cfg.ep_mps);
+
+        /* a free endpoint raises no interrupt, so load the first packet here */
+        if (USB_Is_EPx_RDY_Free(ep_idx)) {
+            usb_dc_xfer_in(device, ep_idx);
+        }
+    } else {
+        xfer->zlp = 0U;
+        USB_Set_EPx_Rdy(ep_idx);
+    }
+
+    cpu_global_irq_enable();
+
+    return USB_DC_OK;
+}
+
+/**
+ * @brief Drop the transfer queued on an endpoint without calling done
+ *
+ * @param dev usb device
+ * @param ep endpoint address
+ * @return int
+ */
+int usb_dc_ep_xfer_abort(struct device *dev, const uint8_t ep)
+{
+    usb_dc_device_t *device = (usb_dc_device_t *)dev;
+    uint8_t ep_idx = USB_EP_GET_IDX(ep);
+    usb_dc_xfer_t *xfer = USB_EP_DIR_IS_IN(ep) ? &device->in_ep[ep_idx].xfer : &device->out_ep[ep_idx].xfer;
+
+    cpu_global_irq_disable();
+    xfer->busy = 0U;
+    xfer->zlp = 0U;
+    xfer->nak = 0U;
+    cpu_global_irq_enable();
+
+    return 0;
+}
+
+/**
+ * @brief Move one received packet into a ring buffer
+ *
+ * The endpoint is left nak'ing while the ring buffer has no room for another
+ * packet, and armed again by the first call after it has.
  *
  * @param dev
  * @param rb
@@ -945,8 +1150,8 @@ int usb_dc_ep_read(struct device *dev, const uint8_t ep, uint8_t *data, uint32_t
 int usb_dc_receive_to_ringbuffer(struct device *dev, Ring_Buffer_Type *rb, uint8_t ep)
 {
     uint8_t ep_idx;
-    uint8_t recv_len;
-    static bool overflow_flag = false;
+    uint32_t recv_len;
+    usb_dc_xfer_t *xfer;
 
     /* Check if OUT ep */
     if (USB_EP_GET_DIR(ep) != USB_EP_DIR_OUT) {
@@ -960,22 +1165,26 @@ int usb_dc_receive_to_ringbuffer(struct device *dev, Ring_Buffer_Type *rb, uint8
     }
 
     ep_idx = USB_EP_GET_IDX(ep);
+    xfer = &usb_fs_device.out_ep[ep_idx].xfer;
+
+    if (xfer->busy) {
+        return -USB_DC_EP_BUSY_ERR;
+    }
 
     recv_len = USB_Get_EPx_RX_FIFO_CNT(ep_idx);
 
     /*if rx fifo count equal 0,it means last is send nack and ringbuffer is smaller than 64,
     * so,if ringbuffer is larger than 64,set ack to recv next data.
     */
-    if (overflow_flag && (Ring_Buffer_Get_Empty_Length(rb) > 64) && (!recv_len)) {
-        overflow_flag = false;
+    if (xfer->nak && (Ring_Buffer_Get_Empty_Length(rb) > USB_FS_MAX_PACKET_SIZE) && (!recv_len)) {
+        xfer->nak = 0U;
         USB_Set_EPx_Rdy(ep_idx);
         return 0;
     } else {
-        uint32_t addr = USB_BASE + 0x11C + (ep_idx - 1) * 0x10;
-        Ring_Buffer_Write_Callback(rb, recv_len, fifocopy_to_mem, (void *)addr);
+        Ring_Buffer_Write_Callback(rb, recv_len, usb_fifo_read, (void *)USB_DC_EP_RX_FIFO(ep_idx));
 
-        if (Ring_Buffer_Get_Empty_Length(rb) < 64) {
-            overflow_flag = true;
+        if (Ring_Buffer_Get_Empty_Length(rb) < USB_FS_MAX_PACKET_SIZE) {
+            xfer->nak = 1U;
             return -USB_DC_RB_SIZE_SMALL_ERR;
         }
 
@@ -983,8 +1192,12 @@ int usb_dc_receive_to_ringbuffer(struct device *dev, Ring_Buffer_Type *rb, uint8
         return 0;
     }
 }
+
 /**
- * @brief
+ * @brief Send one packet out of a ring buffer
+ *
+ * A full packet that empties the ring buffer is followed by a zero length
+ * packet on the next call, so the host sees the end of the data.
  *
  * @param dev
  * @param rb
@@ -994,8 +1207,7 @@ int usb_dc_receive_to_ringbuffer(struct device *dev, Ring_Buffer_Type *rb, uint8
 int usb_dc_send_from_ringbuffer(struct device *dev, Ring_Buffer_Type *rb, uint8_t ep)
 {
     uint8_t ep_idx;
-    static bool zlp_flag = false;
-    static uint32_t send_total_len = 0;
+    usb_dc_xfer_t *xfer;
 
     ep_idx = USB_EP_GET_IDX(ep);
 
@@ -1009,15 +1221,18 @@ int usb_dc_send_from_ringbuffer(struct device *dev, Ring_Buffer_Type *rb, uint8_
         return -USB_DC_EP_EN_ERR;
     }
 
-    uint32_t addr = USB_BASE + 0x118 + (ep_idx - 1) * 0x10;
+    xfer = &usb_fs_device.in_ep[ep_idx].xfer;
 
-    if (zlp_flag == false) {
+    if (xfer->busy) {
+        return -USB_DC_EP_BUSY_ERR;
+    }
+
+    if (!xfer->zlp) {
         if ((USB_Get_EPx_TX_FIFO_CNT(ep_idx) == USB_FS_MAX_PACKET_SIZE) && Ring_Buffer_Get_Length(rb)) {
-            uint32_t actual_len = Ring_Buffer_Read_Callback(rb, USB_FS_MAX_PACKET_SIZE, memcopy_to_fifo, (void *)addr);
-            send_total_len += actual_len;
+            uint32_t actual_len = Ring_Buffer_Read_Callback(rb, USB_FS_MAX_PACKET_SIZE, usb_fifo_write, (void *)USB_DC_EP_TX_FIFO(ep_idx));
 
-            if (!Ring_Buffer_Get_Length(rb) && (!(send_total_len % 64))) {
-                zlp_flag = true;
+            if (!Ring_Buffer_Get_Length(rb) && (actual_len == USB_FS_MAX_PACKET_SIZE)) {
+                xfer->zlp = 1U;
             }
 
             USB_Set_EPx_Rdy(ep_idx);
@@ -1026,8 +1241,7 @@ int usb_dc_send_from_ringbuffer(struct device *dev, Ring_Buffer_Type *rb, uint8_
             return -USB_DC_RB_SIZE_SMALL_ERR;
         }
     } else {
-        zlp_flag = false;
-        send_total_len = 0;
+        xfer->zlp = 0U;
         USB_Set_EPx_Rdy(ep_idx);
         return -USB_DC_ZLP_ERR;
     }
@@ -1051,6 +1265,10 @@ void usb_dc_isr(usb_dc_device_t *device)
                 continue;
             }
             USB_Clr_IntStatus(epint);
+            if (device->out_ep[epnum].xfer.busy) {
+                usb_dc_xfer_out(device, epnum);
+                continue;
+            }
             device->parent.callback(&device->parent, (void *)((uint32_t)USB_SET_EP_OUT(epnum)), 0, USB_DC_EVENT_EP_OUT_NOTIFY);
         }
     }
@@ -1064,6 +1282,10 @@ void usb_dc_isr(usb_dc_device_t *device)
                 continue;
             }
             USB_Clr_IntStatus(epint);
+            if (device->in_ep[epnum].xfer.busy) {
+                usb_dc_xfer_in(device, epnum);
+                continue;
+            }
             device->parent.callback(&device->parent, (void *)((uint32_t)USB_SET_EP_IN(epnum)), 0, USB_DC_EVENT_EP_IN_NOTIFY);
         }
     }
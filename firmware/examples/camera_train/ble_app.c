@@ -0,0 +1,364 @@
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+#include "drv_device.h"
+#include "bflb_platform.h"
+#include "bl702_glb.h"
+#include "hal_common.h"
+
+#include "bluetooth.h"
+#include "conn.h"
+#include "gatt.h"
+#include "hci_core.h"
+#include "hci_driver.h"
+#include "ble_lib_api.h"
+#include "video_pipe.h"
+#include "video_rate.h"
+#include "ble_app.h"
+
+#define MAGIC_CODE  "BL702BOOT"
+
+/* notifications queued in the stack at once, one per controller tx buffer */
+#define BLE_APP_TX_CREDITS 2
+#define BLE_APP_TX_TIMEOUT 200
+
+/* single byte opcode followed by little endian payload */
+#define BLE_CMD_STREAM_START 0x01 /* start sending frames */
+#define BLE_CMD_STREAM_STOP  0x02
+#define BLE_CMD_GET_STATS    0x03 /* reply with BLE_MSG_STATS */
+#define BLE_CMD_TIME_SYNC    0x04 /* uint32 host token, reply with BLE_MSG_TIME */
+
+/* first byte of every notification */
+#define BLE_MSG_CHUNK        0x01 /* uint8 seq, uint16 index, jpeg bytes */
+#define BLE_MSG_CHUNK_LAST   0x03
+#define BLE_MSG_FRAME        0x10 /* ble_frame_msg_t, before the frame's chunks */
+#define BLE_MSG_TIME         0x20 /* uint32 host token, uint32 device us */
+#define BLE_MSG_STATS        0x21 /* video_pipe_stats_t, video_rate_stats_t */
+
+typedef struct {
+    uint8_t type;
+    uint16_t seq;
+    uint16_t chunks;
+    uint32_t len;
+    uint32_t capture_us;
+    uint8_t quality;
+    uint8_t fps;
+} __attribute__((packed)) ble_frame_msg_t;
+
+static struct bt_conn *ble_bl_conn = NULL;
+static SemaphoreHandle_t tx_sem;
+static SemaphoreHandle_t rx_sem;
+static struct bt_gatt_exchange_params exchg_mtu;
+static volatile bool is_streaming = false;
+static bool is_jump_bootloader = false;
+static bool is_stats_req = false;
+static bool is_time_req = false;
+static uint32_t time_token;
+
+static int ble_app_recv(struct bt_conn *conn,
+                        const struct bt_gatt_attr *attr, const void *buf,
+                        u16_t len, u16_t offset, u8_t flags)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    const uint8_t *cmd = buf;
+
+    /*If prepare write, it will return 0 */
+    if (flags == BT_GATT_WRITE_FLAG_PREPARE) {
+        return 0;
+    }
+
+    if ((len == 1) && (cmd[0] == BLE_CMD_STREAM_START)) {
+        is_streaming = true;
+        return len;
+    }
+
+    if ((len == 1) && (cmd[0] == BLE_CMD_STREAM_STOP)) {
+        is_streaming = false;
+        return len;
+    }
+
+    if ((len == 1) && (cmd[0] == BLE_CMD_GET_STATS)) {
+        is_stats_req = true;
+        xSemaphoreGiveFromISR(rx_sem, &xHigherPriorityTaskWoken);
+        return len;
+    }
+
+    if ((len == 5) && (cmd[0] == BLE_CMD_TIME_SYNC)) {
+        time_token = cmd[1] | (cmd[2] << 8) | (cmd[3] << 16) | ((uint32_t)cmd[4] << 24);
+        is_time_req = true;
+        xSemaphoreGiveFromISR(rx_sem, &xHigherPriorityTaskWoken);
+        return len;
+    }
+
+    if (len != sizeof(MAGIC_CODE) - 1) {
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+
+    if (strncmp(buf, MAGIC_CODE, sizeof(MAGIC_CODE) - 1)) {
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+
+    is_jump_bootloader = true;
+
+    xSemaphoreGiveFromISR(rx_sem, &xHigherPriorityTaskWoken);
+
+    return len;
+}
+
+static void ble_app_cfg_changed(const struct bt_gatt_attr *attr, u16_t value)
+{
+}
+
+static void ble_tx_mtu_size(struct bt_conn *conn, u8_t err,
+                            struct bt_gatt_exchange_params *params)
+{
+}
+
+static const struct bt_data ad[] = {
+    BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+    BT_DATA(BT_DATA_MANUFACTURER_DATA, "RV_702", 6),
+};
+
+static struct bt_gatt_attr blattrs[] = {
+    BT_GATT_PRIMARY_SERVICE(BT_UUID_DECLARE_16(0xFFF0)),
+
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(BT_UUID_128_ENCODE(0x00080001, 0x0745, 0x4650, 0x8d93, 0xdf59be2fc10a)),
+                           BT_GATT_CHRC_NOTIFY,
+                           BT_GATT_PERM_READ,
+                           NULL,
+                           NULL,
+                           NULL),
+
+    BT_GATT_CCC(ble_app_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(BT_UUID_128_ENCODE(0x00080002, 0x0745, 0x4650, 0x8d93, 0xdf59be2fc10a)),
+                           BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP,
+                           BT_GATT_PERM_WRITE,
+                           NULL,
+                           ble_app_recv,
+                           NULL)
+};
+
+static struct bt_gatt_service ble_bl_server = BT_GATT_SERVICE(blattrs);
+
+static void bl_connected(struct bt_conn *conn, uint8_t err)
+{
+    int tx_octets = 0x00fb;
+    int tx_time = 0x0848;
+    struct bt_le_conn_param param;
+
+    /* 7.5 ms, the shortest interval carries the most chunks */
+    param.interval_max = 0x06;
+    param.interval_min = 0x06;
+    param.latency = 0;
+    param.timeout = 400;
+
+    if (err) {
+    } else {
+        ble_bl_conn = conn;
+        bt_conn_le_param_update(conn, &param);
+
+        if (!bt_le_set_data_len(ble_bl_conn, tx_octets, tx_time)) {
+            exchg_mtu.func = ble_tx_mtu_size;
+            //exchange mtu size after connected.
+            bt_gatt_exchange_mtu(ble_bl_conn, &exchg_mtu);
+        }
+    }
+}
+
+static void bl_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+    struct bt_le_adv_param adv_param = {
+        .options = BT_LE_ADV_OPT_CONNECTABLE |
+                   BT_LE_ADV_OPT_USE_NAME,
+        .interval_min = BT_GAP_ADV_FAST_INT_MIN_2,
+        .interval_max = BT_GAP_ADV_FAST_INT_MAX_2
+    };
+
+    ble_bl_conn = NULL;
+    is_streaming = false;
+
+    bt_le_adv_stop();
+    bt_le_adv_start(&adv_param, ad, ARRAY_SIZE(ad), NULL, 0);
+}
+
+static struct bt_conn_cb conn_callbacks = {
+    .connected = bl_connected,
+    .disconnected = bl_disconnected,
+};
+
+void bt_enable_cb(int err)
+{
+    bt_addr_le_t adv_addr;
+    char str[100] = { 0 };
+    struct bt_le_adv_param adv_param = {
+        .options = BT_LE_ADV_OPT_CONNECTABLE |
+                   BT_LE_ADV_OPT_USE_NAME,
+        .interval_min = BT_GAP_ADV_FAST_INT_MIN_2,
+        .interval_max = BT_GAP_ADV_FAST_INT_MAX_2
+    };
+
+    if (!err) {
+        bt_get_local_public_address(&adv_addr);
+        sprintf(str, "camera_train_%02X%02X", adv_addr.a.val[0], adv_addr.a.val[1]);
+
+        bt_set_name(str);
+
+        bt_conn_cb_register(&conn_callbacks);
+        bt_gatt_service_register(&ble_bl_server);
+        bt_le_adv_start(&adv_param, ad, ARRAY_SIZE(ad), NULL, 0);
+    }
+}
+
+void ble_app_init(void)
+{
+    tx_sem = xSemaphoreCreateCounting(BLE_APP_TX_CREDITS, BLE_APP_TX_CREDITS);
+    rx_sem = xSemaphoreCreateBinary();
+
+    GLB_Set_EM_Sel(GLB_EM_8KB);
+    ble_controller_init(configMAX_PRIORITIES - 1);
+    // Initialize BLE Host stack
+    hci_driver_init();
+
+    bt_enable(bt_enable_cb);
+}
+
+static void notify_cb(struct bt_conn *conn, void *user_data)
+{
+    xSemaphoreGive(tx_sem);
+}
+
+/* the stack copies the data into its own buffer before this returns */
+static int ble_app_notify(const uint8_t *data, uint16_t len)
+{
+    struct bt_gatt_notify_params params;
+
+    if (!ble_bl_conn || (xSemaphoreTake(tx_sem, pdMS_TO_TICKS(BLE_APP_TX_TIMEOUT)) != pdTRUE)) {
+        return -1;
+    }
+
+    memset(&params, 0, sizeof(params));
+    params.uuid = blattrs[1].uuid;
+    params.attr = &blattrs[1];
+    params.data = data;
+    params.len = len;
+    params.func = notify_cb;
+
+    if (bt_gatt_notify_cb(ble_bl_conn, &params)) {
+        xSemaphoreGive(tx_sem);
+        return -1;
+    }
+
+    return 0;
+}
+
+bool ble_app_is_connected(void)
+{
+    return (ble_bl_conn != NULL);
+}
+
+bool ble_app_streaming(void)
+{
+    return ble_app_is_connected() && is_streaming;
+}
+
+/* one chunk fills a notification at the negotiated mtu */
+void ble_app_format(video_format_t *format)
+{
+    uint16_t mtu = ble_bl_conn ? bt_gatt_get_mtu(ble_bl_conn) : 23;
+    uint16_t payload = mtu - 3;
+
+    if (payload > VIDEO_PACKET_MAX) {
+        payload = VIDEO_PACKET_MAX;
+    }
+
+    format->width = BLE_VIDEO_WIDTH;
+    format->height = BLE_VIDEO_HEIGHT;
+    format->packet_head = BLE_VIDEO_HEADER;
+    format->packet_body = payload - BLE_VIDEO_HEADER;
+    format->grey = true;
+}
+
+/*
+ * A frame record first, then every chunk straight out of the encoder ring
+ * with its header written into the gap in front of it. A host that misses a
+ * chunk drops the frame and waits for the next record.
+ */
+int ble_app_send_frame(const video_frame_t *frame, uint8_t fps)
+{
+    ble_frame_msg_t msg;
+    uint16_t i;
+
+    msg.type = BLE_MSG_FRAME;
+    msg.seq = frame->seq;
+    msg.chunks = frame->packets;
+    msg.len = frame->len;
+    msg.capture_us = frame->capture_us;
+    msg.quality = frame->quality;
+    msg.fps = fps;
+
+    if (ble_app_notify((const uint8_t *)&msg, sizeof(msg)) < 0) {
+        return -1;
+    }
+
+    for (i = 0; i < frame->packets; i++) {
+        uint16_t len;
+        uint8_t *chunk = video_pipe_packet(frame, i, &len);
+
+        chunk[0] = (i == frame->packets - 1) ? BLE_MSG_CHUNK_LAST : BLE_MSG_CHUNK;
+        chunk[1] = frame->seq & 0xFF;
+        chunk[2] = i & 0xFF;
+        chunk[3] = i >> 8;
+
+        if (ble_app_notify(chunk, len) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int ble_app_process(uint32_t timeout_ms)
+{
+    if (xSemaphoreTake(rx_sem, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+        return 0;
+    }
+
+    if (is_time_req) {
+        uint8_t msg[9];
+        uint32_t now = (uint32_t)bflb_platform_get_time_us();
+
+        is_time_req = false;
+        msg[0] = BLE_MSG_TIME;
+        memcpy(&msg[1], &time_token, 4);
+        memcpy(&msg[5], &now, 4);
+        ble_app_notify(msg, sizeof(msg));
+    }
+
+    if (is_stats_req) {
+        uint8_t msg[1 + sizeof(video_pipe_stats_t) + sizeof(video_rate_stats_t)];
+        video_pipe_stats_t pipe;
+        video_rate_stats_t rate;
+
+        is_stats_req = false;
+        video_pipe_get_stats(&pipe);
+        video_rate_get_stats(&rate);
+        msg[0] = BLE_MSG_STATS;
+        memcpy(&msg[1], &pipe, sizeof(pipe));
+        memcpy(&msg[1 + sizeof(pipe)], &rate, sizeof(rate));
+        ble_app_notify(msg, sizeof(msg));
+    }
+
+    if (is_jump_bootloader) {
+        vTaskDelay(pdMS_TO_TICKS(500));
+
+        BL_WR_REG(HBN_BASE, HBN_RSV3, 0xAABBCCDD);
+        __disable_irq();
+        GLB_SW_POR_Reset();
+        while (1) {
+            /*empty dead loop*/
+        }
+    }
+
+    return 0;
+}
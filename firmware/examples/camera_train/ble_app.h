@@ -0,0 +1,19 @@
+#ifndef BLE_APP_H
+#define BLE_APP_H
+
+#include "video_pipe.h"
+
+/* the low resolution profile streamed when there is no usb host */
+#define BLE_VIDEO_WIDTH   160
+#define BLE_VIDEO_HEIGHT  120
+/* type, frame seq and chunk index in front of every chunk */
+#define BLE_VIDEO_HEADER  4
+
+void ble_app_init(void);
+bool ble_app_is_connected(void);
+bool ble_app_streaming(void);
+void ble_app_format(video_format_t *format);
+int ble_app_send_frame(const video_frame_t *frame, uint8_t fps);
+int ble_app_process(uint32_t timeout_ms);
+
+#endif
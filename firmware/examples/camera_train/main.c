@@ -0,0 +1,304 @@
+/**
+ * @file main.c
+ * @brief
+ *
+ * Copyright (c) 2021 Bouffalolab team
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+#include <string.h>
+#include "bflb_platform.h"
+#include "bl702_glb.h"
+#include "bl702_sec_eng.h"
+#include <FreeRTOS.h>
+#include "task.h"
+#include "ble_app.h"
+#include "video_pipe.h"
+#include "video_rate.h"
+#include "video_uvc.h"
+
+#define STREAM_NONE 0
+#define STREAM_USB  1
+#define STREAM_BLE  2
+
+#define STREAM_WAIT_MS     200
+#define STREAM_REPORT_MS   5000
+/* longest a frame may take on the link before it is given up */
+#define STREAM_SEND_TIMEOUT_MS 500
+
+static StackType_t main_stack[512];
+static StaticTask_t main_task_handle;
+static StackType_t stream_stack[512];
+static StaticTask_t stream_task_handle;
+
+/* usb carries the full picture, ble a grey thumbnail at a few frames per second */
+static const video_rate_cfg_t usb_rate = { .q_min = 10, .q_max = 75, .fps_min = 5, .fps_max = 30 };
+static const video_rate_cfg_t ble_rate = { .q_min = 5, .q_max = 50, .fps_min = 1, .fps_max = 10 };
+#define STREAM_USB_QUALITY 50
+#define STREAM_BLE_QUALITY 25
+#define STREAM_BLE_FPS     5
+
+extern uint8_t _heap_start;
+extern uint8_t _heap_size; // @suppress("Type cannot be resolved")
+static HeapRegion_t xHeapRegions[] = {
+    { &_heap_start, (unsigned int)&_heap_size },
+    { NULL, 0 }, /* Terminates the array. */
+    { NULL, 0 }  /* Terminates the array. */
+};
+
+void user_vAssertCalled(void) __attribute__((weak, alias("vAssertCalled")));
+void vAssertCalled(void)
+{
+    MSG("vAssertCalled\r\n");
+
+    while (1)
+        ;
+}
+
+void vApplicationTickHook(void)
+{
+    //MSG("vApplicationTickHook\r\n");
+}
+
+void vApplicationStackOverflowHook(TaskHandle_t xTask, char *pcTaskName)
+{
+    MSG("vApplicationStackOverflowHook\r\n");
+
+    if (pcTaskName) {
+        MSG("Stack name %s\r\n", pcTaskName);
+    }
+
+    while (1)
+        ;
+}
+
+void vApplicationMallocFailedHook(void)
+{
+    MSG("vApplicationMallocFailedHook\r\n");
+
+    while (1)
+        ;
+}
+void vApplicationGetIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer, StackType_t **ppxIdleTaskStackBuffer, uint32_t *pulIdleTaskStackSize)
+{
+    /* If the buffers to be provided to the Idle task are declared inside this
+    function then they must be declared static - otherwise they will be allocated on
+    the stack and so not exists after this function exits. */
+    static StaticTask_t xIdleTaskTCB;
+    static StackType_t uxIdleTaskStack[configMINIMAL_STACK_SIZE];
+
+    /* Pass out a pointer to the StaticTask_t structure in which the Idle task's
+    state will be stored. */
+    *ppxIdleTaskTCBBuffer = &xIdleTaskTCB;
+
+    /* Pass out the array that will be used as the Idle task's stack. */
+    *ppxIdleTaskStackBuffer = uxIdleTaskStack;
+
+    /* Pass out the size of the array pointed to by *ppxIdleTaskStackBuffer.
+    Note that, as the array is necessarily of type StackType_t,
+    configMINIMAL_STACK_SIZE is specified in words, not bytes. */
+    *pulIdleTaskStackSize = configMINIMAL_STACK_SIZE;
+}
+
+/* configSUPPORT_STATIC_ALLOCATION and configUSE_TIMERS are both set to 1, so the
+application must provide an implementation of vApplicationGetTimerTaskMemory()
+to provide the memory that is used by the Timer service task. */
+void vApplicationGetTimerTaskMemory(StaticTask_t **ppxTimerTaskTCBBuffer, StackType_t **ppxTimerTaskStackBuffer, uint32_t *pulTimerTaskStackSize)
+{
+    /* If the buffers to be provided to the Timer task are declared inside this
+    function then they must be declared static - otherwise they will be allocated on
+    the stack and so not exists after this function exits. */
+    static StaticTask_t xTimerTaskTCB;
+    static StackType_t uxTimerTaskStack[configTIMER_TASK_STACK_DEPTH];
+
+    /* Pass out a pointer to the StaticTask_t structure in which the Timer
+    task's state will be stored. */
+    *ppxTimerTaskTCBBuffer = &xTimerTaskTCB;
+
+    /* Pass out the array that will be used as the Timer task's stack. */
+    *ppxTimerTaskStackBuffer = uxTimerTaskStack;
+
+    /* Pass out the size of the array pointed to by *ppxTimerTaskStackBuffer.
+    Note that, as the array is necessarily of type StackType_t,
+    configTIMER_TASK_STACK_DEPTH is specified in words, not bytes. */
+    *pulTimerTaskStackSize = configTIMER_TASK_STACK_DEPTH;
+}
+
+/* a usb host that opened the stream wins over a ble viewer */
+static uint8_t stream_select(video_format_t *format)
+{
+    if (video_uvc_streaming()) {
+        video_uvc_format(format);
+        return STREAM_USB;
+    }
+
+    if (ble_app_streaming()) {
+        ble_app_format(format);
+        return STREAM_BLE;
+    }
+
+    memset(format, 0, sizeof(*format));
+    return STREAM_NONE;
+}
+
+static int stream_restart(uint8_t mode, video_format_t *format)
+{
+    video_pipe_stop();
+
+    if (mode == STREAM_USB) {
+        format->quality = STREAM_USB_QUALITY;
+        video_rate_init(&usb_rate, format->quality, usb_rate.fps_max);
+    } else if (mode == STREAM_BLE) {
+        format->quality = STREAM_BLE_QUALITY;
+        video_rate_init(&ble_rate, format->quality, STREAM_BLE_FPS);
+    } else {
+        return 0;
+    }
+
+    video_pipe_clear_stats();
+    return video_pipe_start(format);
+}
+
+static void stream_report(void)
+{
+    video_pipe_stats_t pipe;
+    video_rate_stats_t rate;
+
+    video_pipe_get_stats(&pipe);
+    video_rate_get_stats(&rate);
+    MSG("video: %u sent, %u skipped, %u overflows, q %u, %u fps, %u B/frame, %u B/s\r\n",
+        rate.sent, pipe.skipped, pipe.overflows, rate.quality, rate.fps, rate.frame_bytes, rate.throughput);
+}
+
+/*
+ * Capture and encoding run in hardware into the ring; this task only picks
+ * the newest frame when the rate controller says one is due, hands it to the
+ * transport in place and feeds the time it took back into the controller.
+ */
+static void stream_task(void *pvParameters)
+{
+    uint8_t mode = STREAM_NONE;
+    uint8_t want;
+    video_format_t format = { 0 };
+    video_format_t next;
+    video_frame_t frame;
+    video_rate_stats_t rate;
+    uint32_t start_us;
+    uint32_t report_ms = 0;
+    int ret;
+
+    if (video_pipe_init() < 0) {
+        MSG("video: no camera\r\n");
+        vTaskDelete(NULL);
+    }
+
+    while (1) {
+        want = stream_select(&next);
+
+        /* a new mtu changes the ble chunk size */
+        if ((want != mode) || (next.packet_body != format.packet_body)) {
+            mode = want;
+            format = next;
+
+            if (stream_restart(mode, &format) < 0) {
+                MSG("video: start failed\r\n");
+                mode = STREAM_NONE;
+                vTaskDelay(pdMS_TO_TICKS(1000));
+                continue;
+            }
+        }
+
+        if (mode == STREAM_NONE) {
+            vTaskDelay(pdMS_TO_TICKS(STREAM_WAIT_MS));
+            continue;
+        }
+
+        if (!video_pipe_wait(STREAM_WAIT_MS) || (video_pipe_get(&frame) < 0)) {
+            continue;
+        }
+
+        if (!video_rate_due((uint32_t)bflb_platform_get_time_us())) {
+            video_pipe_release();
+            continue;
+        }
+
+        video_rate_get_stats(&rate);
+        start_us = (uint32_t)bflb_platform_get_time_us();
+
+        if (mode == STREAM_USB) {
+            ret = video_uvc_send(&frame, STREAM_SEND_TIMEOUT_MS);
+        } else {
+            ret = ble_app_send_frame(&frame, rate.fps);
+        }
+
+        video_pipe_release();
+
+        if (ret < 0) {
+            continue;
+        }
+
+        video_rate_update(frame.len + frame.packets * format.packet_head, (uint32_t)bflb_platform_get_time_us() - start_us);
+
+        if (video_rate_quality() != rate.quality) {
+            video_pipe_set_quality(video_rate_quality());
+        }
+
+        if (xTaskGetTickCount() - report_ms >= pdMS_TO_TICKS(STREAM_REPORT_MS)) {
+            report_ms = xTaskGetTickCount();
+            stream_report();
+        }
+    }
+}
+
+static void main_task(void *pvParameters)
+{
+    ble_app_init();
+
+    if (video_uvc_init() < 0) {
+        MSG("video: usb init failed\r\n");
+    }
+
+    /* below the ble controller, above the host work in this task */
+    xTaskCreateStatic(stream_task, (char *)"stream", sizeof(stream_stack) / 4, NULL, configMAX_PRIORITIES - 2, stream_stack, &stream_task_handle);
+
+    while (1) {
+        ble_app_process(1000);
+    }
+}
+
+int main(void)
+{
+    uint32_t tmpVal = 0;
+
+    bflb_platform_init(0);
+
+    HBN_Set_XCLK_CLK_Sel(HBN_XCLK_CLK_XTAL);
+
+    //Set capcode
+    tmpVal = BL_RD_REG(AON_BASE, AON_XTAL_CFG);
+    tmpVal = BL_SET_REG_BITS_VAL(tmpVal, AON_XTAL_CAPCODE_IN_AON, 33);
+    tmpVal = BL_SET_REG_BITS_VAL(tmpVal, AON_XTAL_CAPCODE_OUT_AON, 33);
+    BL_WR_REG(AON_BASE, AON_XTAL_CFG, tmpVal);
+
+    Sec_Eng_Trng_Enable();
+
+    vPortDefineHeapRegions(xHeapRegions);
+
+    xTaskCreateStatic(main_task, (char *)"main", sizeof(main_stack) / 4, NULL, configMAX_PRIORITIES - 3, main_stack, &main_task_handle);
+
+    vTaskStartScheduler();
+}
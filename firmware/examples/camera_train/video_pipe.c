@@ -0,0 +1,538 @@
+#include <string.h>
+#include <FreeRTOS.h>
+#include "task.h"
+#include "semphr.h"
+#include "timers.h"
+#include "bflb_platform.h"
+#include "hal_cam.h"
+#include "hal_mjpeg.h"
+#include "bl702_mjpeg.h"
+#include "video_pipe.h"
+
+/* capture timestamps kept for frames still in the mjpeg ring */
+#define VIDEO_TS_FIFO   8
+/* running averages kept as x += (new - x) / 2^VIDEO_AVG_SHIFT */
+#define VIDEO_AVG_SHIFT 3
+
+#ifdef VIDEO_TEST_SOURCE
+/* stand-in frame rate, the camera's when it is not known */
+#ifndef VIDEO_TEST_FPS
+#define VIDEO_TEST_FPS  30
+#endif
+#define VIDEO_TEST_SLOTS 4
+#endif
+
+/* the cam and mjpeg masters write here, see .video_buffer in the linker script */
+static uint8_t video_cam_buf[VIDEO_MAX_WIDTH * 2 * VIDEO_CAM_LINES] __attribute__((section(".video_buffer"), aligned(16)));
+static uint8_t video_ring[VIDEO_JPEG_RING_SIZE] __attribute__((section(".video_buffer"), aligned(64)));
+/* a packet that straddles the ring end is put back together here */
+static uint8_t video_bounce[VIDEO_PACKET_MAX] __attribute__((aligned(16)));
+
+static SemaphoreHandle_t frame_sem;
+static video_format_t cur_format;
+static bool running;
+static bool holding;
+static uint16_t next_seq;
+
+static volatile uint32_t capture_ts[VIDEO_TS_FIFO];
+static volatile uint32_t captured;
+static volatile uint32_t overflows;
+static video_pipe_stats_t pipe_stats;
+
+static void video_frame_captured(void)
+{
+    capture_ts[captured % VIDEO_TS_FIFO] = (uint32_t)bflb_platform_get_time_us();
+    captured++;
+}
+
+#ifndef VIDEO_TEST_SOURCE
+
+static struct device *cam;
+
+/* the end of a camera frame; the mjpeg engine finishes it a few lines later */
+static void video_cam_callback(struct device *dev, void *args, uint32_t size, uint32_t state)
+{
+    if (state == CAM_EVENT_FRAME) {
+        video_frame_captured();
+    }
+}
+
+static void video_mjpeg_isr(void)
+{
+    BaseType_t woken = pdFALSE;
+    uint32_t tmpVal = BL_RD_REG(MJPEG_BASE, MJPEG_CONTROL_3);
+
+    if (BL_IS_REG_BIT_SET(tmpVal, MJPEG_STS_NORMAL_INT)) {
+        MJPEG_IntClr(MJPEG_INT_NORMAL);
+        xSemaphoreGiveFromISR(frame_sem, &woken);
+    }
+
+    if (BL_IS_REG_BIT_SET(tmpVal, MJPEG_STS_CAM_INT)) {
+        MJPEG_IntClr(MJPEG_INT_CAM_OVERWRITE);
+        overflows++;
+    }
+
+    if (BL_IS_REG_BIT_SET(tmpVal, MJPEG_STS_MEM_INT)) {
+        MJPEG_IntClr(MJPEG_INT_MEM_OVERWRITE);
+        overflows++;
+    }
+
+    if (BL_IS_REG_BIT_SET(tmpVal, MJPEG_STS_FRAME_INT)) {
+        MJPEG_IntClr(MJPEG_INT_FRAME_OVERWRITE);
+        overflows++;
+    }
+
+    portYIELD_FROM_ISR(woken);
+}
+
+__attribute__((weak)) int camera_sensor_init(uint16_t width, uint16_t height, bool grey)
+{
+    /* a sensor that powers up streaming in the wanted format needs nothing */
+    return 0;
+}
+
+static int source_init(void)
+{
+    cam_register(CAM0_INDEX, "camera");
+    cam = device_find("camera");
+
+    if (!cam) {
+        return -1;
+    }
+
+    device_set_callback(cam, video_cam_callback);
+    Interrupt_Handler_Register(MJPEG_IRQn, video_mjpeg_isr);
+    return 0;
+}
+
+static int source_start(const video_format_t *format)
+{
+    uint8_t bytes_per_pixel = format->grey ? 1 : 2;
+    mjpeg_device_t mjpeg_cfg = { 0 };
+
+    if (camera_sensor_init(format->width, format->height, format->grey) < 0) {
+        return -1;
+    }
+
+    CAM_DEV(cam)->software_mode = CAM_AUTO_MODE;
+    CAM_DEV(cam)->frame_mode = CAM_FRAME_INTERLEAVE_MODE;
+    CAM_DEV(cam)->yuv_format = format->grey ? CAM_YUV_FORMAT_YUV400_EVEN : CAM_YUV_FORMAT_YUV422;
+    CAM_DEV(cam)->cam_write_ram_addr = (uint32_t)video_cam_buf;
+    CAM_DEV(cam)->cam_write_ram_size = format->width * bytes_per_pixel * VIDEO_CAM_LINES;
+    CAM_DEV(cam)->cam_frame_size = format->width * format->height * bytes_per_pixel;
+    device_open(cam, DEVICE_OFLAG_INT_RX);
+    device_control(cam, DEVICE_CTRL_SET_INT, (void *)CAM_FRAME_IT);
+
+    mjpeg_cfg.quality = format->quality;
+    mjpeg_cfg.yuv_format = format->grey ? MJPEG_YUV_FORMAT_YUV400 : MJPEG_YUV_FORMAT_YUV422_INTERLEAVE;
+    mjpeg_cfg.write_buffer_addr = (uint32_t)video_ring;
+    mjpeg_cfg.write_buffer_size = sizeof(video_ring);
+    mjpeg_cfg.read_buffer_addr = (uint32_t)video_cam_buf;
+    /* in 8 line blocks */
+    mjpeg_cfg.read_buffer_size = VIDEO_CAM_LINES / 8;
+    mjpeg_cfg.resolution_x = format->width;
+    mjpeg_cfg.resolution_y = format->height;
+    mjpeg_cfg.packet_cut_mode = MJPEG_PACKET_ADD_DEFAULT | MJPEG_PACKET_ADD_FRAME_TAIL;
+    mjpeg_cfg.packet_head_length = format->packet_head;
+    mjpeg_cfg.packet_body_length = format->packet_body;
+    mjpeg_cfg.packet_tail_length = 0;
+    mjpeg_init(&mjpeg_cfg);
+
+    MJPEG_Set_Frame_Threshold(1);
+    MJPEG_IntClr(MJPEG_INT_ALL);
+    MJPEG_IntMask(MJPEG_INT_NORMAL, UNMASK);
+    MJPEG_IntMask(MJPEG_INT_CAM_OVERWRITE, UNMASK);
+    MJPEG_IntMask(MJPEG_INT_MEM_OVERWRITE, UNMASK);
+    MJPEG_IntMask(MJPEG_INT_FRAME_OVERWRITE, UNMASK);
+    CPU_Interrupt_Enable(MJPEG_IRQn);
+
+    mjpeg_start();
+    device_control(cam, DEVICE_CTRL_RESUME, NULL);
+    return 0;
+}
+
+static void source_stop(void)
+{
+    device_control(cam, DEVICE_CTRL_SUSPEND, NULL);
+    device_control(cam, DEVICE_CTRL_CLR_INT, (void *)CAM_FRAME_IT);
+    CPU_Interrupt_Disable(MJPEG_IRQn);
+    mjpeg_stop();
+    device_close(cam);
+}
+
+static uint8_t source_count(void)
+{
+    return MJPEG_Get_Frame_Count();
+}
+
+static void source_head(uint8_t **pic, uint32_t *len, uint8_t *q)
+{
+    mjpeg_get_one_frame(pic, len, q);
+}
+
+static void source_pop(void)
+{
+    mjpeg_drop_one_frame();
+}
+
+static void source_set_quality(uint8_t quality)
+{
+    mjpeg_set_quality(quality);
+}
+
+#else
+
+/*
+ * Stand-in for the camera and the mjpeg engine: a timer writes a valid, flat
+ * grey baseline jpeg with the same packet gaps into the same ring, sized the
+ * way quality moves real frames, so the transports and the rate control run
+ * unchanged on a board without a sensor.
+ */
+typedef struct {
+    uint32_t offset;
+    uint32_t len;
+    uint8_t q;
+} test_slot_t;
+
+static TimerHandle_t test_timer;
+static test_slot_t test_slots[VIDEO_TEST_SLOTS];
+static volatile uint8_t test_head;
+static volatile uint8_t test_count;
+static uint32_t test_wr;
+static uint32_t test_body_pos;
+static uint8_t test_quality;
+
+static void test_put(const uint8_t *src, uint8_t fill, uint32_t n)
+{
+    while (n--) {
+        if (test_body_pos == 0) {
+            test_wr = (test_wr + cur_format.packet_head) % sizeof(video_ring);
+        }
+
+        video_ring[test_wr] = src ? *src++ : fill;
+        test_wr = (test_wr + 1) % sizeof(video_ring);
+
+        if (++test_body_pos == cur_format.packet_body) {
+            test_body_pos = 0;
+        }
+    }
+}
+
+static void test_marker(uint8_t marker, uint16_t len)
+{
+    uint8_t hdr[4] = { 0xFF, marker, len >> 8, len & 0xFF };
+
+    test_put(hdr, 0, 4);
+}
+
+static uint32_t test_frame_len(uint8_t q)
+{
+    /* roughly what the engine makes of a busy scene, 1.25 bit per pixel at q50 */
+    return (uint32_t)cur_format.width * cur_format.height * q / 320;
+}
+
+static uint32_t test_span(uint32_t len)
+{
+    uint32_t packets = (len + cur_format.packet_body - 1) / cur_format.packet_body;
+
+    return len + packets * cur_format.packet_head;
+}
+
+static uint32_t test_used(void)
+{
+    const test_slot_t *oldest = &test_slots[test_head];
+
+    if (!test_count) {
+        return 0;
+    }
+
+    return (test_wr + sizeof(video_ring) - oldest->offset) % sizeof(video_ring);
+}
+
+static void test_frame(TimerHandle_t timer)
+{
+    static const uint8_t dqt[] = {
+        0x00,                                     /* DQT: 8 bit, table 0 */
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    };
+    /* one symbol each: DC category 0 and AC end of block, both coded as a single 0 bit */
+    static const uint8_t dht[] = {
+        0x00, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x00,
+        0x10, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x00,
+    };
+    static const uint8_t sos[] = { 1, 1, 0x00, 0, 63, 0 };
+    static const uint8_t soi[] = { 0xFF, 0xD8 };
+    static const uint8_t eoi[] = { 0xFF, 0xD9 };
+    uint8_t sof[9] = { 8, cur_format.height >> 8, cur_format.height & 0xFF,
+                       cur_format.width >> 8, cur_format.width & 0xFF, 1, 1, 0x11, 0 };
+    uint32_t blocks = ((cur_format.width + 7) / 8) * ((cur_format.height + 7) / 8);
+    uint32_t scan = (blocks * 2 + 7) / 8;
+    uint32_t base = 2 + 4 + 4 + sizeof(dqt) + 4 + sizeof(sof) + 4 + sizeof(dht) + 4 + sizeof(sos) + scan + 2;
+    uint32_t len = test_frame_len(test_quality);
+    uint32_t pad = (len > base) ? len - base : 0;
+    test_slot_t *slot;
+    uint8_t b;
+
+    if (!running) {
+        return;
+    }
+
+    if (pad > 0xFFF0) {
+        pad = 0xFFF0;
+    }
+    len = base + pad;
+
+    if ((test_count == VIDEO_TEST_SLOTS) || (test_used() + test_span(len) >= sizeof(video_ring))) {
+        /* what the engine's overwrite interrupt reports */
+        video_frame_captured();
+        overflows++;
+        return;
+    }
+
+    slot = &test_slots[(test_head + test_count) % VIDEO_TEST_SLOTS];
+    slot->offset = test_wr;
+    slot->len = len;
+    slot->q = test_quality;
+    test_body_pos = 0;
+
+    test_put(soi, 0, sizeof(soi));
+    /* the padding stands in for the image detail a real frame carries */
+    test_marker(0xFE, pad + 2);
+    test_put(NULL, ' ', pad);
+    test_marker(0xDB, sizeof(dqt) + 2);
+    test_put(dqt, 0, sizeof(dqt));
+    test_marker(0xC0, sizeof(sof) + 2);
+    test_put(sof, 0, sizeof(sof));
+    test_marker(0xC4, sizeof(dht) + 2);
+    test_put(dht, 0, sizeof(dht));
+    test_marker(0xDA, sizeof(sos) + 2);
+    test_put(sos, 0, sizeof(sos));
+    /* every block is a zero DC difference and an end of block, two 0 bits, padded with ones */
+    test_put(NULL, 0x00, scan - 1);
+    b = (blocks * 2) % 8 ? 0xFF >> ((blocks * 2) % 8) : 0x00;
+    test_put(&b, 0, 1);
+    test_put(eoi, 0, sizeof(eoi));
+
+    /* the next frame starts on a 64 byte line, as the engine's does */
+    test_wr = (test_wr + 63) & ~63;
+    test_wr %= sizeof(video_ring);
+
+    taskENTER_CRITICAL();
+    test_count++;
+    taskEXIT_CRITICAL();
+
+    video_frame_captured();
+    xSemaphoreGive(frame_sem);
+}
+
+__attribute__((weak)) int camera_sensor_init(uint16_t width, uint16_t height, bool grey)
+{
+    return 0;
+}
+
+static int source_init(void)
+{
+    test_timer = xTimerCreate("video_test", pdMS_TO_TICKS(1000 / VIDEO_TEST_FPS), pdTRUE, NULL, test_frame);
+
+    return test_timer ? 0 : -1;
+}
+
+static int source_start(const video_format_t *format)
+{
+    test_head = 0;
+    test_count = 0;
+    test_wr = 0;
+    test_quality = format->quality;
+    xTimerStart(test_timer, portMAX_DELAY);
+    return 0;
+}
+
+static void source_stop(void)
+{
+    xTimerStop(test_timer, portMAX_DELAY);
+}
+
+static uint8_t source_count(void)
+{
+    return test_count;
+}
+
+static void source_head(uint8_t **pic, uint32_t *len, uint8_t *q)
+{
+    const test_slot_t *slot = &test_slots[test_head];
+
+    *pic = &video_ring[slot->offset];
+    *len = slot->len;
+    *q = slot->q;
+}
+
+static void source_pop(void)
+{
+    taskENTER_CRITICAL();
+    test_head = (test_head + 1) % VIDEO_TEST_SLOTS;
+    test_count--;
+    taskEXIT_CRITICAL();
+}
+
+static void source_set_quality(uint8_t quality)
+{
+    test_quality = quality;
+}
+
+#endif
+
+int video_pipe_init(void)
+{
+    frame_sem = xSemaphoreCreateBinary();
+
+    if (!frame_sem) {
+        return -1;
+    }
+
+    return source_init();
+}
+
+int video_pipe_start(const video_format_t *format)
+{
+    if ((format->width > VIDEO_MAX_WIDTH) || (format->height > VIDEO_MAX_HEIGHT) ||
+        !format->packet_body || (format->packet_head + format->packet_body > VIDEO_PACKET_MAX)) {
+        return -1;
+    }
+
+    video_pipe_stop();
+
+    cur_format = *format;
+    holding = false;
+    captured = 0;
+    xSemaphoreTake(frame_sem, 0);
+
+    if (source_start(format) < 0) {
+        return -1;
+    }
+
+    running = true;
+    return 0;
+}
+
+void video_pipe_stop(void)
+{
+    if (!running) {
+        return;
+    }
+
+    running = false;
+    source_stop();
+}
+
+void video_pipe_set_quality(uint8_t quality)
+{
+    cur_format.quality = quality;
+    source_set_quality(quality);
+}
+
+bool video_pipe_wait(uint32_t timeout_ms)
+{
+    if (running && source_count()) {
+        return true;
+    }
+
+    xSemaphoreTake(frame_sem, pdMS_TO_TICKS(timeout_ms));
+
+    return running && source_count();
+}
+
+/*
+ * Hands out the newest finished frame in place. Anything older still in the
+ * ring is dropped first: a late picture is worth less than a fresh one.
+ */
+int video_pipe_get(video_frame_t *frame)
+{
+    uint8_t valid;
+    uint8_t *pic;
+    uint32_t len;
+    uint8_t q;
+
+    if (!running || holding) {
+        return -1;
+    }
+
+    valid = source_count();
+    if (!valid) {
+        return -1;
+    }
+
+    while (valid > 1) {
+        source_pop();
+        pipe_stats.skipped++;
+        valid--;
+    }
+
+    source_head(&pic, &len, &q);
+
+    frame->data = pic;
+    frame->len = len;
+    frame->quality = q;
+    frame->packets = (len + cur_format.packet_body - 1) / cur_format.packet_body;
+    frame->seq = next_seq++;
+    /* the newest frame in the ring belongs to the newest capture */
+    frame->capture_us = capture_ts[(captured - 1) % VIDEO_TS_FIFO];
+
+    pipe_stats.encoded++;
+    pipe_stats.bytes_avg += (int32_t)(len - pipe_stats.bytes_avg) >> VIDEO_AVG_SHIFT;
+    holding = true;
+    return 0;
+}
+
+/* packet index of frame, with its head gap in front; valid until the release */
+uint8_t *video_pipe_packet(const video_frame_t *frame, uint16_t index, uint16_t *len)
+{
+    uint32_t span = cur_format.packet_head + cur_format.packet_body;
+    uint32_t offset = ((frame->data - video_ring) + index * span) % sizeof(video_ring);
+    uint32_t body = frame->len - index * cur_format.packet_body;
+    uint32_t first;
+
+    if (body > cur_format.packet_body) {
+        body = cur_format.packet_body;
+    }
+
+    *len = cur_format.packet_head + body;
+
+    if (offset + *len <= sizeof(video_ring)) {
+        return &video_ring[offset];
+    }
+
+    first = sizeof(video_ring) - offset;
+    memcpy(video_bounce, &video_ring[offset], first);
+    memcpy(&video_bounce[first], video_ring, *len - first);
+    pipe_stats.wrapped++;
+    return video_bounce;
+}
+
+void video_pipe_release(void)
+{
+    if (!holding) {
+        return;
+    }
+
+    holding = false;
+
+    if (running && source_count()) {
+        source_pop();
+    }
+}
+
+void video_pipe_get_stats(video_pipe_stats_t *stats)
+{
+    *stats = pipe_stats;
+    stats->captured = captured;
+    stats->overflows = overflows;
+}
+
+void video_pipe_clear_stats(void)
+{
+    memset(&pipe_stats, 0, sizeof(pipe_stats));
+    overflows = 0;
+}
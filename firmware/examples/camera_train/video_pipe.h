@@ -0,0 +1,62 @@
+#ifndef VIDEO_PIPE_H
+#define VIDEO_PIPE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* camera lines the mjpeg engine reads from, a multiple of 8 */
+#define VIDEO_CAM_LINES      16
+#define VIDEO_MAX_WIDTH      320
+#define VIDEO_MAX_HEIGHT     240
+/* compressed frames queue here until every packet of the oldest one is sent */
+#define VIDEO_JPEG_RING_SIZE (12 * 1024)
+/* largest transport packet, gap included */
+#define VIDEO_PACKET_MAX     512
+
+/*
+ * What the encoder produces. The engine leaves packet_head bytes in front of
+ * every packet_body bytes of jpeg data, so a transport writes its own framing
+ * into the gap and sends straight out of the ring.
+ */
+typedef struct {
+    uint16_t width;
+    uint16_t height;
+    uint16_t packet_head;
+    uint16_t packet_body;
+    uint8_t quality;  /* 1-75 */
+    bool grey;        /* YUV400 instead of YUV422 */
+} video_format_t;
+
+typedef struct {
+    uint8_t *data;       /* first packet, in the ring */
+    uint32_t len;        /* jpeg bytes, gaps excluded */
+    uint32_t capture_us; /* end of exposure readout */
+    uint16_t seq;
+    uint16_t packets;
+    uint8_t quality;
+} video_frame_t;
+
+typedef struct {
+    uint32_t captured;     /* frames out of the camera */
+    uint32_t encoded;      /* frames taken from the mjpeg ring */
+    uint32_t skipped;      /* older frames dropped for a newer one */
+    uint32_t overflows;    /* camera or ring overrun, frame lost in the engine */
+    uint32_t wrapped;      /* packets bounced because they straddle the ring end */
+    uint32_t bytes_avg;    /* encoded frame size, running average */
+} video_pipe_stats_t;
+
+int video_pipe_init(void);
+int video_pipe_start(const video_format_t *format);
+void video_pipe_stop(void);
+void video_pipe_set_quality(uint8_t quality);
+bool video_pipe_wait(uint32_t timeout_ms);
+int video_pipe_get(video_frame_t *frame);
+uint8_t *video_pipe_packet(const video_frame_t *frame, uint16_t index, uint16_t *len);
+void video_pipe_release(void);
+void video_pipe_get_stats(video_pipe_stats_t *stats);
+void video_pipe_clear_stats(void);
+
+/* sensor register setup over SCCB, board specific */
+int camera_sensor_init(uint16_t width, uint16_t height, bool grey);
+
+#endif
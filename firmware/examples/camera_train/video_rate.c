@@ -0,0 +1,118 @@
+#include "video_rate.h"
+
+/* running averages kept as x += (new - x) / 2^VIDEO_RATE_AVG_SHIFT */
+#define VIDEO_RATE_AVG_SHIFT 2
+/* share of the frame period a frame may spend on the link */
+#define VIDEO_RATE_HEADROOM  85
+/* below this share of the budget there is room to step up */
+#define VIDEO_RATE_SPARE     60
+/* frames to wait after a step before judging its effect */
+#define VIDEO_RATE_HOLD_DOWN 4
+#define VIDEO_RATE_HOLD_UP   8
+
+static video_rate_cfg_t rate_cfg;
+static video_rate_stats_t rate_stats;
+static uint32_t next_due_us;
+static uint8_t hold;
+
+static void video_rate_budget(void)
+{
+    rate_stats.budget = (uint64_t)rate_stats.throughput * VIDEO_RATE_HEADROOM / 100 / rate_stats.fps;
+}
+
+void video_rate_init(const video_rate_cfg_t *cfg, uint8_t quality, uint8_t fps)
+{
+    rate_cfg = *cfg;
+
+    rate_stats = (video_rate_stats_t){ 0 };
+    rate_stats.quality = quality;
+    rate_stats.fps = fps;
+    next_due_us = 0;
+    hold = 0;
+}
+
+/* paces the stream to the current frame rate, the camera runs faster */
+bool video_rate_due(uint32_t now_us)
+{
+    uint32_t period_us = 1000000 / rate_stats.fps;
+
+    if (next_due_us && ((int32_t)(now_us - next_due_us) < 0)) {
+        rate_stats.paced++;
+        return false;
+    }
+
+    /* keep the schedule, but don't try to catch up after a stall */
+    if (!next_due_us || ((int32_t)(now_us - next_due_us) > (int32_t)period_us)) {
+        next_due_us = now_us;
+    }
+
+    next_due_us += period_us;
+    return true;
+}
+
+void video_rate_update(uint32_t bytes, uint32_t send_us)
+{
+    uint32_t rate;
+    uint8_t step;
+
+    rate_stats.sent++;
+
+    if (!send_us) {
+        send_us = 1;
+    }
+
+    rate = (uint64_t)bytes * 1000000 / send_us;
+
+    if (!rate_stats.throughput) {
+        rate_stats.throughput = rate;
+        rate_stats.frame_bytes = bytes;
+    } else {
+        rate_stats.throughput += (int32_t)(rate - rate_stats.throughput) >> VIDEO_RATE_AVG_SHIFT;
+        rate_stats.frame_bytes += (int32_t)(bytes - rate_stats.frame_bytes) >> VIDEO_RATE_AVG_SHIFT;
+    }
+
+    video_rate_budget();
+
+    if (hold) {
+        hold--;
+        return;
+    }
+
+    step = rate_stats.quality / 8 ? rate_stats.quality / 8 : 1;
+
+    if (rate_stats.frame_bytes > rate_stats.budget) {
+        if (rate_stats.quality > rate_cfg.q_min) {
+            rate_stats.quality = (rate_stats.quality - rate_cfg.q_min > step) ? rate_stats.quality - step : rate_cfg.q_min;
+        } else if (rate_stats.fps > rate_cfg.fps_min) {
+            rate_stats.fps = (rate_stats.fps * 3 / 4 > rate_cfg.fps_min) ? rate_stats.fps * 3 / 4 : rate_cfg.fps_min;
+        } else {
+            return;
+        }
+
+        rate_stats.steps_down++;
+        hold = VIDEO_RATE_HOLD_DOWN;
+    } else if (rate_stats.frame_bytes < (uint64_t)rate_stats.budget * VIDEO_RATE_SPARE / 100) {
+        if (rate_stats.fps < rate_cfg.fps_max) {
+            rate_stats.fps++;
+        } else if (rate_stats.quality < rate_cfg.q_max) {
+            rate_stats.quality = (rate_cfg.q_max - rate_stats.quality > step) ? rate_stats.quality + step : rate_cfg.q_max;
+        } else {
+            return;
+        }
+
+        rate_stats.steps_up++;
+        hold = VIDEO_RATE_HOLD_UP;
+    }
+
+    video_rate_budget();
+}
+
+uint8_t video_rate_quality(void)
+{
+    return rate_stats.quality;
+}
+
+void video_rate_get_stats(video_rate_stats_t *stats)
+{
+    *stats = rate_stats;
+}
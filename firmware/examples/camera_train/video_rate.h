@@ -0,0 +1,38 @@
+#ifndef VIDEO_RATE_H
+#define VIDEO_RATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Fits the stream to what the link actually carried lately: the measured
+ * throughput sets a per-frame byte budget, quality gives way first and the
+ * frame rate only once quality is at its floor. Recovery goes the other way
+ * round, so the picture stays fluid before it gets sharp again.
+ */
+typedef struct {
+    uint8_t q_min;
+    uint8_t q_max;
+    uint8_t fps_min;
+    uint8_t fps_max;
+} video_rate_cfg_t;
+
+typedef struct {
+    uint8_t quality;         /* current encoder quality */
+    uint8_t fps;             /* current frame rate target */
+    uint32_t throughput;     /* link bytes/s, running average */
+    uint32_t frame_bytes;    /* encoded frame size, running average */
+    uint32_t budget;         /* bytes one frame may take at the current rate */
+    uint32_t sent;           /* frames handed to the link */
+    uint32_t paced;          /* frames dropped to hold the frame rate */
+    uint32_t steps_down;
+    uint32_t steps_up;
+} video_rate_stats_t;
+
+void video_rate_init(const video_rate_cfg_t *cfg, uint8_t quality, uint8_t fps);
+bool video_rate_due(uint32_t now_us);
+void video_rate_update(uint32_t bytes, uint32_t send_us);
+uint8_t video_rate_quality(void);
+void video_rate_get_stats(video_rate_stats_t *stats);
+
+#endif
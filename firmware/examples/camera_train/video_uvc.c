@@ -0,0 +1,220 @@
+#include <FreeRTOS.h>
+#include "semphr.h"
+#include "hal_usb.h"
+#include "hal_dma.h"
+#include "bl702_usb.h"
+#include "usbd_core.h"
+#include "usbd_video.h"
+#include "video_uvc.h"
+
+#define VIDEO_UVC_FPS_MAX  30
+#define VIDEO_UVC_INTERVAL(fps) (10000000 / (fps))
+#define VIDEO_UVC_MAX_FRAME (VIDEO_JPEG_RING_SIZE / 2)
+
+#define VIDEO_UVC_HEADER_FID 0x01
+#define VIDEO_UVC_HEADER_EOF 0x02
+#define VIDEO_UVC_HEADER_EOH 0x80
+
+/* video control + video streaming class specific lengths */
+#define VIDEO_VC_TOTAL  (13 + 18 + 9)
+#define VIDEO_VS_TOTAL  (14 + 11 + 38 + 6)
+#define VIDEO_UVC_TOTAL (9 + 8 + 9 + VIDEO_VC_TOTAL + 9 + VIDEO_VS_TOTAL + 9 + 7)
+
+extern struct device *usb_dc_init(void);
+
+static const uint8_t video_descriptor[] = {
+    USB_DEVICE_DESCRIPTOR_INIT(USB_2_0, 0xEF, 0x02, 0x01, 0xFFFF, 0xFFFF, 0x0001, 0x01),
+    USB_CONFIG_DESCRIPTOR_INIT(VIDEO_UVC_TOTAL, 0x02, 0x01, USB_CONFIG_BUS_POWERED, 100),
+    USB_IAD_INIT(0x00, 0x02, 0x0E, VIDEO_SC_VIDEO_INTERFACE_COLLECTION, 0x00),
+    USB_INTERFACE_DESCRIPTOR_INIT(0x00, 0x00, 0x00, 0x0E, VIDEO_SC_VIDEOCONTROL, 0x00, 0x00),
+    /* VC header, UVC 1.0, one streaming interface */
+    0x0D, VIDEO_CS_INTERFACE_DESCRIPTOR_TYPE, VIDEO_VC_HEADER_DESCRIPTOR_SUBTYPE,
+    WBVAL(0x0100), WBVAL(VIDEO_VC_TOTAL), DBVAL(48000000), 0x01, 0x01,
+    /* camera terminal, no controls */
+    0x12, VIDEO_CS_INTERFACE_DESCRIPTOR_TYPE, VIDEO_VC_INPUT_TERMINAL_DESCRIPTOR_SUBTYPE,
+    0x01, WBVAL(0x0201), 0x00, 0x00, WBVAL(0), WBVAL(0), WBVAL(0), 0x03, 0x00, 0x00, 0x00,
+    /* usb streaming output terminal fed by the camera */
+    0x09, VIDEO_CS_INTERFACE_DESCRIPTOR_TYPE, VIDEO_VC_OUTPUT_TERMINAL_DESCRIPTOR_SUBTYPE,
+    0x02, WBVAL(0x0101), 0x00, 0x01, 0x00,
+    USB_INTERFACE_DESCRIPTOR_INIT(0x01, 0x00, 0x00, 0x0E, VIDEO_SC_VIDEOSTREAMING, 0x00, 0x00),
+    /* VS input header, one format */
+    0x0E, VIDEO_CS_INTERFACE_DESCRIPTOR_TYPE, VIDEO_VS_INPUT_HEADER_DESCRIPTOR_SUBTYPE,
+    0x01, WBVAL(VIDEO_VS_TOTAL), VIDEO_UVC_EP, 0x00, 0x02, 0x00, 0x00, 0x00, 0x01, 0x00,
+    /* mjpeg format */
+    0x0B, VIDEO_CS_INTERFACE_DESCRIPTOR_TYPE, VIDEO_VS_FORMAT_MJPEG_DESCRIPTOR_SUBTYPE,
+    0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00,
+    /* 320x240 at 30, 15 and 10 fps */
+    0x26, VIDEO_CS_INTERFACE_DESCRIPTOR_TYPE, VIDEO_VS_FRAME_MJPEG_DESCRIPTOR_SUBTYPE,
+    0x01, 0x00, WBVAL(VIDEO_UVC_WIDTH), WBVAL(VIDEO_UVC_HEIGHT),
+    DBVAL(VIDEO_UVC_MAX_FRAME * 8 * 10), DBVAL(VIDEO_UVC_MAX_FRAME * 8 * VIDEO_UVC_FPS_MAX),
+    DBVAL(VIDEO_UVC_MAX_FRAME), DBVAL(VIDEO_UVC_INTERVAL(VIDEO_UVC_FPS_MAX)), 0x03,
+    DBVAL(VIDEO_UVC_INTERVAL(30)), DBVAL(VIDEO_UVC_INTERVAL(15)), DBVAL(VIDEO_UVC_INTERVAL(10)),
+    /* color matching, bt.709 / sRGB */
+    0x06, VIDEO_CS_INTERFACE_DESCRIPTOR_TYPE, VIDEO_VS_COLORFORMAT_DESCRIPTOR_SUBTYPE, 0x01, 0x01, 0x04,
+    USB_INTERFACE_DESCRIPTOR_INIT(0x01, 0x01, 0x01, 0x0E, VIDEO_SC_VIDEOSTREAMING, 0x00, 0x00),
+    USB_ENDPOINT_DESCRIPTOR_INIT(VIDEO_UVC_EP, 0x05, VIDEO_UVC_PACKET, 0x01),
+
+    USB_LANGID_INIT(0x0409),
+    0x18, USB_DESCRIPTOR_TYPE_STRING,
+    'B', 0x00, 'o', 0x00, 'u', 0x00, 'f', 0x00, 'f', 0x00, 'a', 0x00, 'l', 0x00, 'o', 0x00, 'l', 0x00,
+    'a', 0x00, 'b', 0x00,
+    0x1A, USB_DESCRIPTOR_TYPE_STRING,
+    'T', 0x00, 'r', 0x00, 'a', 0x00, 'i', 0x00, 'n', 0x00, ' ', 0x00, 'C', 0x00, 'a', 0x00, 'm', 0x00,
+    'e', 0x00, 'r', 0x00, 'a', 0x00,
+    0x0A, USB_DESCRIPTOR_TYPE_STRING,
+    '0', 0x00, '7', 0x00, '0', 0x00, '2', 0x00,
+    0x00
+};
+
+/* the host reads and writes these through the class requests in usbd_video.c */
+struct video_probe_and_commit_controls probe = {
+    .hintUnion.bmHint = 0x01,
+    .bFormatIndex = 0x01,
+    .bFrameIndex = 0x01,
+    .dwFrameInterval = VIDEO_UVC_INTERVAL(VIDEO_UVC_FPS_MAX),
+    .dwMaxVideoFrameSize = VIDEO_UVC_MAX_FRAME,
+    .dwMaxPayloadTransferSize = VIDEO_UVC_PACKET,
+};
+struct video_probe_and_commit_controls commit = {
+    .hintUnion.bmHint = 0x01,
+    .bFormatIndex = 0x01,
+    .bFrameIndex = 0x01,
+    .dwFrameInterval = VIDEO_UVC_INTERVAL(VIDEO_UVC_FPS_MAX),
+    .dwMaxVideoFrameSize = VIDEO_UVC_MAX_FRAME,
+    .dwMaxPayloadTransferSize = VIDEO_UVC_PACKET,
+};
+
+static usbd_class_t video_class;
+static usbd_interface_t video_control_intf;
+static usbd_interface_t video_stream_intf;
+
+static struct device *usb;
+static struct device *usb_dma;
+static SemaphoreHandle_t tx_done_sem;
+static const video_frame_t *volatile tx_frame;
+static volatile uint16_t tx_index;
+static volatile bool streaming;
+static uint16_t last_sof = 0xFFFF;
+static uint8_t fid;
+
+void usbd_video_set_interface_callback(uint8_t value)
+{
+    streaming = value ? true : false;
+
+    if (!streaming && tx_frame) {
+        tx_frame = NULL;
+        xSemaphoreGiveFromISR(tx_done_sem, NULL);
+    }
+}
+
+/* one packet out of the ring per bus frame, the dma feeds the endpoint fifo */
+void usbd_video_sof_callback(void)
+{
+    const video_frame_t *frame = tx_frame;
+    uint16_t sof = USB_Get_Frame_Num();
+    uint8_t *packet;
+    uint16_t len;
+    BaseType_t woken = pdFALSE;
+
+    /* the core notifies every interface of the class, send once per frame */
+    if (sof == last_sof) {
+        return;
+    }
+    last_sof = sof;
+
+    if (!frame || dma_channel_check_busy(usb_dma)) {
+        return;
+    }
+
+    /* the last packet has left the ring once its dma is idle */
+    if (tx_index == frame->packets) {
+        fid ^= VIDEO_UVC_HEADER_FID;
+        tx_frame = NULL;
+        xSemaphoreGiveFromISR(tx_done_sem, &woken);
+        portYIELD_FROM_ISR(woken);
+        return;
+    }
+
+    packet = video_pipe_packet(frame, tx_index, &len);
+    packet[0] = VIDEO_UVC_HEADER;
+    packet[1] = VIDEO_UVC_HEADER_EOH | fid;
+
+    if (++tx_index == frame->packets) {
+        packet[1] |= VIDEO_UVC_HEADER_EOF;
+    }
+
+    device_write(usb, VIDEO_UVC_EP, packet, len);
+}
+
+int video_uvc_init(void)
+{
+    tx_done_sem = xSemaphoreCreateBinary();
+
+    if (!tx_done_sem) {
+        return -1;
+    }
+
+    usbd_desc_register(video_descriptor);
+    usbd_video_add_interface(&video_class, &video_control_intf);
+    usbd_video_add_interface(&video_class, &video_stream_intf);
+
+    usb = usb_dc_init();
+
+    if (!usb) {
+        return -1;
+    }
+
+    dma_register(DMA0_CH4_INDEX, "uvc_dma");
+    usb_dma = device_find("uvc_dma");
+
+    if (!usb_dma) {
+        return -1;
+    }
+
+    DMA_DEV(usb_dma)->direction = DMA_MEMORY_TO_PERIPH;
+    DMA_DEV(usb_dma)->dst_req = DMA_REQUEST_USB_EP1;
+    DMA_DEV(usb_dma)->src_addr_inc = DMA_ADDR_INCREMENT_ENABLE;
+    DMA_DEV(usb_dma)->dst_addr_inc = DMA_ADDR_INCREMENT_DISABLE;
+    device_open(usb_dma, 0);
+
+    device_control(usb, DEVICE_CTRL_ATTACH_TX_DMA, usb_dma);
+    device_control(usb, DEVICE_CTRL_USB_DC_SET_TX_DMA, (void *)VIDEO_UVC_EP);
+    device_control(usb, DEVICE_CTRL_SET_INT, (void *)(1 << USB_INT_SOF));
+
+    return 0;
+}
+
+bool video_uvc_streaming(void)
+{
+    return streaming && usb_device_is_configured();
+}
+
+void video_uvc_format(video_format_t *format)
+{
+    format->width = VIDEO_UVC_WIDTH;
+    format->height = VIDEO_UVC_HEIGHT;
+    format->packet_head = VIDEO_UVC_HEADER;
+    format->packet_body = VIDEO_UVC_PACKET - VIDEO_UVC_HEADER;
+    format->grey = false;
+}
+
+/* hands the frame to the sof interrupt and waits for its last packet */
+int video_uvc_send(const video_frame_t *frame, uint32_t timeout_ms)
+{
+    if (!video_uvc_streaming()) {
+        return -1;
+    }
+
+    xSemaphoreTake(tx_done_sem, 0);
+    tx_index = 0;
+    tx_frame = frame;
+
+    if (xSemaphoreTake(tx_done_sem, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+        /* the ring slot goes back after this, don't let the dma read on */
+        tx_frame = NULL;
+        dma_channel_stop(usb_dma);
+        return -1;
+    }
+
+    return (tx_index == frame->packets) ? 0 : -1;
+}
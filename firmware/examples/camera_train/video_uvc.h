@@ -0,0 +1,20 @@
+#ifndef VIDEO_UVC_H
+#define VIDEO_UVC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "video_pipe.h"
+
+#define VIDEO_UVC_EP      0x81
+/* one isochronous packet per 1 ms frame, the payload header sits in the encoder's gap */
+#define VIDEO_UVC_PACKET  512
+#define VIDEO_UVC_HEADER  2
+#define VIDEO_UVC_WIDTH   320
+#define VIDEO_UVC_HEIGHT  240
+
+int video_uvc_init(void);
+bool video_uvc_streaming(void);
+void video_uvc_format(video_format_t *format);
+int video_uvc_send(const video_frame_t *frame, uint32_t timeout_ms);
+
+#endif
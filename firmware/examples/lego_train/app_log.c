@@ -0,0 +1,84 @@
+#include <FreeRTOS.h>
+#include "task.h"
+#include "bflb_platform.h"
+#include "drv_device.h"
+#include "dlog.h"
+#include "app_log.h"
+#include "watchdog.h"
+
+/* records rendered per pass, the task yields to the others in between */
+#define APP_LOG_BATCH 8
+/* the lowest priority task, longer than anything above it should keep the cpu */
+#define APP_LOG_WDG_MS 2000
+
+static StackType_t app_log_stack[256];
+static StaticTask_t app_log_task_handle;
+static TaskHandle_t app_log_task;
+static int app_log_wdg = -1;
+static struct device *app_log_uart;
+
+const char *const dlog_modules[DLOG_MODULE_MAX] = {
+    [APP_LOG_MAIN] = "main",
+    [APP_LOG_BLE] = "ble",
+    [APP_LOG_POWER] = "power",
+    [APP_LOG_SPEED] = "speed",
+    [APP_LOG_SOUND] = "sound",
+};
+
+static void app_log_out(const char *text, uint32_t len)
+{
+    device_write(app_log_uart, 0, (uint8_t *)text, len);
+}
+
+static void app_log_notify(void)
+{
+    BaseType_t woken = pdFALSE;
+
+    if (!app_log_task) {
+        return;
+    }
+
+    if (xPortIsInsideInterrupt()) {
+        vTaskNotifyGiveFromISR(app_log_task, &woken);
+        portYIELD_FROM_ISR(woken);
+    } else {
+        xTaskNotifyGive(app_log_task);
+    }
+}
+
+static void app_log_task_entry(void *pvParameters)
+{
+    while (1) {
+        watchdog_block(app_log_wdg);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        watchdog_checkin(app_log_wdg);
+
+        while (dlog_process(APP_LOG_BATCH)) {
+            watchdog_checkin(app_log_wdg);
+            taskYIELD();
+        }
+    }
+}
+
+void app_log_init(void)
+{
+    uint8_t i;
+
+    app_log_uart = device_find("debug_log");
+
+    /* with the debug uart off nothing would read the ring, skip the records */
+    if (bflb_platform_print_get() || !app_log_uart) {
+        for (i = 0; i < DLOG_MODULE_MAX; i++) {
+            dlog_set_level(i, DLOG_LEVEL_OFF);
+        }
+        return;
+    }
+
+    dlog_init(app_log_out, app_log_notify);
+    app_log_wdg = watchdog_register("log", APP_LOG_WDG_MS);
+    /* lowest priority above idle, the uart is written when nothing else runs */
+    app_log_task = xTaskCreateStatic(app_log_task_entry, (char *)"log", sizeof(app_log_stack) / 4, NULL,
+                                     1, app_log_stack, &app_log_task_handle);
+
+    MSG("dlog: %u ns per record\r\n", (unsigned int)dlog_bench_ns());
+}
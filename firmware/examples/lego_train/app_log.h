@@ -0,0 +1,13 @@
+#ifndef APP_LOG_H
+#define APP_LOG_H
+
+/* DLOG_MODULE of each source file, names in app_log.c */
+#define APP_LOG_MAIN  0
+#define APP_LOG_BLE   1
+#define APP_LOG_POWER 2
+#define APP_LOG_SPEED 3
+#define APP_LOG_SOUND 4
+
+void app_log_init(void);
+
+#endif
@@ -0,0 +1,198 @@
+#include <math.h>
+#include <string.h>
+#include "autotune.h"
+
+/* periods of the measured cycles may spread this fraction of their mean, as 1/n */
+#define AUTOTUNE_PERIOD_SPREAD 4
+
+static int32_t autotune_clamp(int32_t v, int32_t min, int32_t max)
+{
+    return (v < min) ? min : ((v > max) ? max : v);
+}
+
+static void autotune_finish(autotune_t *at, autotune_state_t state)
+{
+    at->state = state;
+    at->out = 0;
+}
+
+static void autotune_restart_measure(autotune_t *at)
+{
+    at->measured = 0;
+    at->period_sum = 0;
+    at->period_min = UINT32_MAX;
+    at->period_max = 0;
+    at->amplitude_sum = 0;
+}
+
+/* at a switch to high, closes the cycle that began at the last one */
+static void autotune_cycle(autotune_t *at)
+{
+    uint32_t period = at->step - at->cycle_start;
+    int32_t mean;
+
+    if (at->cycle_start != UINT32_MAX) {
+        at->cycle++;
+
+        /* the mean output of the cycle, where the relay is balanced */
+        mean = at->bias + at->cfg.relay * (int32_t)(2 * at->high_steps - period) / (int32_t)period;
+        at->bias = autotune_clamp(mean, -at->cfg.max_out + at->cfg.relay, at->cfg.max_out - at->cfg.relay);
+
+        if (at->cycle > at->cfg.settle_cycles) {
+            at->measured++;
+            at->period_sum += period;
+            at->period_min = (period < at->period_min) ? period : at->period_min;
+            at->period_max = (period > at->period_max) ? period : at->period_max;
+            at->amplitude_sum += (uint32_t)(at->pv_max - at->pv_min) / 2;
+
+            if (at->measured >= at->cfg.cycles) {
+                if ((at->period_max - at->period_min) * AUTOTUNE_PERIOD_SPREAD * at->measured <= at->period_sum) {
+                    autotune_finish(at, AUTOTUNE_DONE);
+                    return;
+                }
+                /* not steady yet, measure again */
+                autotune_restart_measure(at);
+            }
+        }
+    }
+
+    at->cycle_start = at->step;
+    at->high_steps = 0;
+    at->pv_max = INT32_MIN;
+    at->pv_min = INT32_MAX;
+}
+
+void autotune_start(autotune_t *at, const autotune_cfg_t *cfg)
+{
+    memset(at, 0, sizeof(*at));
+    at->cfg = *cfg;
+    at->bias = autotune_clamp(cfg->bias, -cfg->max_out + cfg->relay, cfg->max_out - cfg->relay);
+    at->high = true;
+    at->cycle_start = UINT32_MAX;
+    at->pv_max = INT32_MIN;
+    at->pv_min = INT32_MAX;
+    autotune_restart_measure(at);
+    at->out = at->bias + cfg->relay;
+    at->state = AUTOTUNE_RUNNING;
+}
+
+int32_t autotune_step(autotune_t *at, int32_t pv)
+{
+    int32_t error;
+
+    if (at->state != AUTOTUNE_RUNNING) {
+        return 0;
+    }
+
+    at->step++;
+    error = pv - at->cfg.setpoint;
+
+    if ((error > at->cfg.max_deviation) || (error < -at->cfg.max_deviation)) {
+        autotune_finish(at, AUTOTUNE_OUT_OF_RANGE);
+        return 0;
+    }
+
+    /* a stalled wheel or a lost encoder or line reads the same value on and on */
+    at->unchanged = (pv == at->last_pv) ? (at->unchanged + 1) : 0;
+    at->last_pv = pv;
+    if (at->unchanged >= at->cfg.no_signal_steps) {
+        autotune_finish(at, AUTOTUNE_NO_SIGNAL);
+        return 0;
+    }
+
+    if (at->step >= at->cfg.timeout_steps) {
+        autotune_finish(at, AUTOTUNE_TIMEOUT);
+        return 0;
+    }
+
+    at->pv_max = (pv > at->pv_max) ? pv : at->pv_max;
+    at->pv_min = (pv < at->pv_min) ? pv : at->pv_min;
+
+    if (at->high && (error > at->cfg.hysteresis)) {
+        at->high = false;
+    } else if (!at->high && (error < -at->cfg.hysteresis)) {
+        at->high = true;
+        autotune_cycle(at);
+        if (at->state != AUTOTUNE_RUNNING) {
+            return 0;
+        }
+    }
+
+    at->high_steps += at->high;
+    at->out = autotune_clamp(at->high ? (at->bias + at->cfg.relay) : (at->bias - at->cfg.relay), -at->cfg.max_out,
+                             at->cfg.max_out);
+
+    return at->out;
+}
+
+void autotune_abort(autotune_t *at)
+{
+    if (at->state == AUTOTUNE_RUNNING) {
+        autotune_finish(at, AUTOTUNE_ABORTED);
+    }
+}
+
+int autotune_result(const autotune_t *at, float *ku, float *tu)
+{
+    float a = (float)at->amplitude_sum / at->measured;
+    float h = (float)at->cfg.hysteresis;
+
+    if (at->state != AUTOTUNE_DONE) {
+        return -1;
+    }
+
+    /* a describing function of the relay with hysteresis; a quantized pv may not clear it */
+    a = (a > h) ? sqrtf(a * a - h * h) : a;
+    *ku = 4.0f * at->cfg.relay / (3.14159265f * a);
+    *tu = (float)at->period_sum / at->measured;
+
+    return 0;
+}
+
+void autotune_gains(float ku, float tu, autotune_rule_t rule, autotune_gains_t *gains)
+{
+    /* ki = kp / Ti and kd = kp * Td, with Ti and Td in steps */
+    switch (rule) {
+        case AUTOTUNE_RULE_ZN_PID:
+            gains->kp = 0.6f * ku;
+            gains->ki = gains->kp / (0.5f * tu);
+            gains->kd = gains->kp * 0.125f * tu;
+            break;
+
+        case AUTOTUNE_RULE_ZN_PI:
+            gains->kp = 0.45f * ku;
+            gains->ki = gains->kp / (tu / 1.2f);
+            gains->kd = 0;
+            break;
+
+        case AUTOTUNE_RULE_TL_PI:
+        default:
+            gains->kp = ku / 3.2f;
+            gains->ki = gains->kp / (2.2f * tu);
+            gains->kd = 0;
+            break;
+    }
+}
+
+static q31_t autotune_q_gain(float k, uint8_t shift)
+{
+    float q = k / (float)(1UL << shift) * 2147483648.0f;
+
+    return (q >= 2147483647.0f) ? Q31_MAX : ((q <= -2147483648.0f) ? Q31_MIN : (q31_t)lrintf(q));
+}
+
+void autotune_to_pid_q(const autotune_gains_t *gains, uint8_t in_bits, uint8_t out_bits, pid_q_alg_t *pid)
+{
+    float scale = ldexpf(1.0f, in_bits - out_bits);
+    float most = fmaxf(fabsf(gains->kp), fmaxf(fabsf(gains->ki), fabsf(gains->kd))) * scale;
+    uint8_t shift = 0;
+
+    while ((shift < 30) && (most >= (float)(1UL << shift))) {
+        shift++;
+    }
+
+    pid->shift = shift;
+    pid->kp = autotune_q_gain(gains->kp * scale, shift);
+    pid->ki = autotune_q_gain(gains->ki * scale, shift);
+    pid->kd = autotune_q_gain(gains->kd * scale, shift);
+}
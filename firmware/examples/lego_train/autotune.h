@@ -0,0 +1,91 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "pid_q.h"
+
+/*
+ * Relay feedback experiment (Astrom and Hagglund) for a loop that runs at a fixed
+ * step. A relay drives the plant in place of the pid: bias + relay while the process
+ * value is below the setpoint, bias - relay above it, with some hysteresis. The plant
+ * settles into a limit cycle. Its amplitude a and period Tu give the ultimate gain
+ * Ku = 4 * relay / (pi * sqrt(a^2 - hysteresis^2)), and the gains follow from Ku and Tu.
+ * The bias moves to the mean output of each cycle, so the cycle stays centred on the
+ * setpoint of a plant with an offset, like the dead band of a motor.
+ *
+ * Free of hal calls so that tools/autotune/autotune_sim.c runs the same code. The plant
+ * gain must be positive: a caller whose output lowers its process value negates it.
+ */
+
+typedef enum {
+    AUTOTUNE_IDLE,
+    AUTOTUNE_RUNNING,
+    AUTOTUNE_DONE,
+    AUTOTUNE_TIMEOUT,      /* no steady limit cycle in time */
+    AUTOTUNE_NO_SIGNAL,    /* the process value stopped changing while driven */
+    AUTOTUNE_OUT_OF_RANGE, /* the process value left the band around the setpoint */
+    AUTOTUNE_ABORTED,
+} autotune_state_t;
+
+typedef enum {
+    AUTOTUNE_RULE_ZN_PID, /* Ziegler-Nichols, quarter amplitude decay */
+    AUTOTUNE_RULE_ZN_PI,
+    AUTOTUNE_RULE_TL_PI,  /* Tyreus-Luyben, slower and with less overshoot */
+} autotune_rule_t;
+
+typedef struct {
+    int32_t setpoint;
+    int32_t bias;             /* output before the first cycle completes */
+    int32_t relay;            /* output swing either side of the bias */
+    int32_t hysteresis;       /* error band in which the relay holds */
+    int32_t max_out;          /* |output| bound, the bias is kept relay inside it */
+    int32_t max_deviation;    /* |pv - setpoint| that ends the run */
+    uint32_t timeout_steps;
+    uint32_t no_signal_steps; /* steps of an unchanged pv that end the run */
+    uint8_t settle_cycles;    /* cycles left out while the bias settles */
+    uint8_t cycles;           /* cycles averaged after that */
+} autotune_cfg_t;
+
+typedef struct {
+    autotune_cfg_t cfg;
+    autotune_state_t state;
+    bool high;
+    int32_t bias;
+    int32_t out;
+    int32_t last_pv;
+    int32_t pv_max;
+    int32_t pv_min;
+    uint32_t step;
+    uint32_t unchanged;
+    uint32_t cycle_start; /* step of the last switch to high */
+    uint32_t high_steps;  /* of the cycle in progress */
+    uint8_t cycle;        /* completed cycles */
+    uint8_t measured;     /* of those, averaged so far */
+    uint32_t period_sum;  /* steps */
+    uint32_t period_min;
+    uint32_t period_max;
+    uint32_t amplitude_sum; /* half the peak to peak pv */
+} autotune_t;
+
+/* per step gains of a pid that adds kp * e + ki * sum(e) + kd * (e - last_e) */
+typedef struct {
+    float kp;
+    float ki;
+    float kd;
+} autotune_gains_t;
+
+void autotune_start(autotune_t *at, const autotune_cfg_t *cfg);
+/* feeds the process value of this step, returns the output to apply until the next one */
+int32_t autotune_step(autotune_t *at, int32_t pv);
+void autotune_abort(autotune_t *at);
+/* ultimate gain (output per pv unit) and period (steps) of a finished run, -1 before */
+int autotune_result(const autotune_t *at, float *ku, float *tu);
+void autotune_gains(float ku, float tu, autotune_rule_t rule, autotune_gains_t *gains);
+/*
+ * loads gains into a pid_q_alg_t whose pv and output are Q31 fractions of full scales
+ * 2^in_bits and 2^out_bits, with the smallest shift that holds them
+ */
+void autotune_to_pid_q(const autotune_gains_t *gains, uint8_t in_bits, uint8_t out_bits, pid_q_alg_t *pid);
+
+#endif
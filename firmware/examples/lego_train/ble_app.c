@@ -1,3 +1,5 @@
+#include <stddef.h>
+#include <errno.h>
 #include <FreeRTOS.h>
 #include <task.h>
 #include <semphr.h>
@@ -9,54 +11,364 @@
 #include "bluetooth.h"
 #include "conn.h"
 #include "gatt.h"
+#include "l2cap.h"
 #include "hci_core.h"
+#include "multi_adv.h"
+#include "monitor.h"
 #include "hci_driver.h"
 #include "ble_lib_api.h"
 #include "bl702_sec_eng.h"
 #include "ring_buffer.h"
 #include "gatt.h"
 #include "motor.h"
+#include "speed_ctrl.h"
+#include "watchdog.h"
+#include "power_sense.h"
+#include "sound.h"
+#include "task_profile.h"
+#include "low_power.h"
+#include "boot_profile.h"
+#include "odometry.h"
+#include "ble_app.h"
+#include "app_log.h"
+#define DLOG_MODULE APP_LOG_BLE
+#include "dlog.h"
 
 #define TO_BLE_INTERVAL(x)  ((x) * 0.625)
 #define WAIT_TIMEOUT        (24 * 3600000)
-#define ADV_1S_DURATION     (30)
+/* a reply, a snoop dump or the bootloader jump, from the semaphore to the next wait */
+#define BLE_APP_WDG_MS      3000
+
+/* advertising current of the connectable set and the beacon together, the
+ * beacon interval stretches towards 150 ms to stay below it */
+#define BLE_ADV_BUDGET_UA    150
+#define BLE_BEACON_UPDATE_MS 500
+/* the speed loop compensates below this */
+#define BLE_BEACON_VBAT_LOW_MV 3300
+
+#define BLE_BEACON_FLAG_CUTOFF    0x01 /* motor cut off for overcurrent or stall */
+#define BLE_BEACON_FLAG_VBAT_LOW  0x02
+#define BLE_BEACON_FLAG_CONNECTED 0x80
+
+#if defined(CONFIG_BT_DEBUG_MONITOR)
+/* HCI capture after an assert, in the second half of the media partition of
+ * partition_cfg_1M_boot2_ble.toml; the sound bank takes the first */
+#define BLE_SNOOP_FLASH_ADDR  0xFD000
+#define BLE_SNOOP_FLASH_SIZE  0x2000
+#define BLE_SNOOP_LINE_BYTES  32
+#endif
+
+/* manufacturer data of the non-connectable status beacon */
+typedef struct __attribute__((packed)) {
+    uint16_t company;   /* 0xFFFF, none assigned */
+    uint8_t tag[2];     /* "RV" */
+    int16_t velocity;   /* ticks/s */
+    uint16_t vbat_mv;
+    uint8_t flags;      /* BLE_BEACON_FLAG_* */
+    uint8_t seq;        /* counts updates */
+} ble_beacon_t;
 
 static struct bt_conn *ble_bl_conn = NULL;
 static SemaphoreHandle_t tx_sem;
 static SemaphoreHandle_t rx_sem;
 static struct bt_gatt_exchange_params exchg_mtu;
 static bool is_jump_bootloader = false;
-static uint32_t adv_duration = 0;
-static bool is_adv_2s = false;
+static int adv_conn_id = 0;
+static int adv_beacon_id = 0;
+static char adv_name[32];
+static ble_beacon_t beacon = { .company = 0xFFFF, .tag = { 'R', 'V' } };
+static TickType_t beacon_next;
+static bool is_speed_stats_req = false;
+static bool is_power_stats_req = false;
+static bool is_task_profile_req = false;
+static bool is_sleep_stats_req = false;
+static bool is_boot_profile_req = false;
+static bool is_sound_stats_req = false;
+static bool is_gains_req = false;
+static bool is_clear_gains_req = false;
+static bool is_watchdog_req = false;
+static int ble_wdg = -1;
+static uint8_t task_profile_buf[TASK_PROFILE_SNAPSHOT_MAX];
+static struct bt_l2cap_le_chan coc_chan;
+static bool is_coc_connected = false;
+/* SDUs handed to the channel and not sent yet */
+static atomic_t coc_tx_pending;
+static uint16_t telemetry_period_ms = 0;
+static bool is_telemetry_restart = false;
+static TickType_t telemetry_next;
+static uint16_t telemetry_seq;
+static uint8_t telemetry_batch_max;
 
 #define MAGIC_CODE  "BL702BOOT"
 
-static int ble_app_recv(struct bt_conn *conn,
-              const struct bt_gatt_attr *attr, const void *buf,
-              u16_t len, u16_t offset, u8_t flags)
+/* single byte opcode followed by little endian payload */
+#define BLE_CMD_SET_SPEED           0x01 /* int16 target speed, wheel ticks/s */
+#define BLE_CMD_GET_SPEED_STATS     0x02 /* reply with speed_ctrl_stats_t */
+#define BLE_CMD_GET_POWER_STATS     0x03 /* reply with power_sense_stats_t */
+#define BLE_CMD_SET_ADC_CLK_DIV     0x04 /* uint8 adc_clk_div_t, clears the power stats */
+#define BLE_CMD_GET_TASK_PROFILE    0x05 /* reply with a task_profile snapshot */
+#define BLE_CMD_GET_SLEEP_STATS     0x06 /* reply with low_power_stats_t, then clear them */
+#define BLE_CMD_GET_BOOT_PROFILE    0x07 /* reply with boot_profile_t up to its last mark */
+#define BLE_CMD_SET_TELEMETRY       0x08 /* uint16 sample period in ms, l2cap channel only, 0 stops it */
+#define BLE_CMD_PLAY_SOUND          0x09 /* uint8 clip, SOUND_HORN or SOUND_BELL */
+#define BLE_CMD_GET_SOUND_STATS     0x0a /* reply with sound_stats_t */
+#define BLE_CMD_AUTOTUNE            0x0b /* int16 speed, uint8 relay duty; speed 0 drops the tuned gains */
+#define BLE_CMD_GET_GAINS           0x0c /* reply with speed_ctrl_tune_t */
+#define BLE_CMD_GET_WATCHDOG        0x0d /* reply with watchdog_record_t of the last reset */
+
+/* channel SDUs from the train: a reply tagged with its opcode, or a telemetry batch */
+#define BLE_MSG_TELEMETRY           0x80
+
+#define TELEMETRY_BATCH_MAX         10
+
+typedef struct __attribute__((packed)) {
+    uint32_t time_ms;    /* tick count */
+    int32_t target;      /* ticks/s */
+    int32_t velocity;    /* ticks/s */
+    int32_t ticks;       /* odometry */
+    uint16_t vbat_mv;
+    uint16_t current_ma;
+} ble_telemetry_record_t;
+
+/* records pile up here while the host withholds credits, later ones are dropped */
+static struct __attribute__((packed)) {
+    uint8_t count;
+    uint16_t seq; /* of the first record, a gap to the previous batch counts the drops */
+    ble_telemetry_record_t records[TELEMETRY_BATCH_MAX];
+} telemetry_batch;
+
+static int ble_app_command(const void *buf, uint16_t len)
 {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
-    /*If prepare write, it will return 0 */
-    if (flags == BT_GATT_WRITE_FLAG_PREPARE) {
+    if ((len == 3) && (((const uint8_t *)buf)[0] == BLE_CMD_SET_SPEED)) {
+        /* a new command is the acknowledgement of a stall or overcurrent cutoff */
+        power_sense_rearm();
+        speed_ctrl_set_target((int16_t)(((const uint8_t *)buf)[1] | (((const uint8_t *)buf)[2] << 8)));
+        sound_wake();
+        return 0;
+    }
+
+    if ((len == 4) && (((const uint8_t *)buf)[0] == BLE_CMD_AUTOTUNE)) {
+        int16_t speed = (int16_t)(((const uint8_t *)buf)[1] | (((const uint8_t *)buf)[2] << 8));
+
+        /* dropping the gains erases flash, which waits for the process task */
+        if (speed == 0) {
+            is_clear_gains_req = true;
+            xSemaphoreGiveFromISR( rx_sem, &xHigherPriorityTaskWoken );
+            return 0;
+        }
+
+        power_sense_rearm();
+        if (speed_ctrl_autotune(speed, ((const uint8_t *)buf)[3]) < 0) {
+            return -1;
+        }
+        sound_wake();
+        return 0;
+    }
+
+    if ((len == 1) && (((const uint8_t *)buf)[0] == BLE_CMD_GET_WATCHDOG)) {
+        is_watchdog_req = true;
+        xSemaphoreGiveFromISR( rx_sem, &xHigherPriorityTaskWoken );
+        return 0;
+    }
+
+    if ((len == 1) && (((const uint8_t *)buf)[0] == BLE_CMD_GET_GAINS)) {
+        is_gains_req = true;
+        xSemaphoreGiveFromISR( rx_sem, &xHigherPriorityTaskWoken );
+        return 0;
+    }
+
+    if ((len == 3) && (((const uint8_t *)buf)[0] == BLE_CMD_SET_TELEMETRY)) {
+        /* a record has to fit the host's mtu */
+        if (!is_coc_connected || !telemetry_batch_max) {
+            return -1;
+        }
+        telemetry_period_ms = ((const uint8_t *)buf)[1] | (((const uint8_t *)buf)[2] << 8);
+        is_telemetry_restart = true;
+        xSemaphoreGiveFromISR( rx_sem, &xHigherPriorityTaskWoken );
+        return 0;
+    }
+
+    if ((len == 1) && (((const uint8_t *)buf)[0] == BLE_CMD_GET_SPEED_STATS)) {
+        is_speed_stats_req = true;
+        xSemaphoreGiveFromISR( rx_sem, &xHigherPriorityTaskWoken );
+        return 0;
+    }
+
+    if ((len == 1) && (((const uint8_t *)buf)[0] == BLE_CMD_GET_POWER_STATS)) {
+        is_power_stats_req = true;
+        xSemaphoreGiveFromISR( rx_sem, &xHigherPriorityTaskWoken );
+        return 0;
+    }
+
+    if ((len == 1) && (((const uint8_t *)buf)[0] == BLE_CMD_GET_TASK_PROFILE)) {
+        is_task_profile_req = true;
+        xSemaphoreGiveFromISR( rx_sem, &xHigherPriorityTaskWoken );
+        return 0;
+    }
+
+    if ((len == 1) && (((const uint8_t *)buf)[0] == BLE_CMD_GET_SLEEP_STATS)) {
+        is_sleep_stats_req = true;
+        xSemaphoreGiveFromISR( rx_sem, &xHigherPriorityTaskWoken );
+        return 0;
+    }
+
+    if ((len == 1) && (((const uint8_t *)buf)[0] == BLE_CMD_GET_BOOT_PROFILE)) {
+        is_boot_profile_req = true;
+        xSemaphoreGiveFromISR( rx_sem, &xHigherPriorityTaskWoken );
+        return 0;
+    }
+
+    if ((len == 1) && (((const uint8_t *)buf)[0] == BLE_CMD_GET_SOUND_STATS)) {
+        is_sound_stats_req = true;
+        xSemaphoreGiveFromISR( rx_sem, &xHigherPriorityTaskWoken );
+        return 0;
+    }
+
+    if ((len == 2) && (((const uint8_t *)buf)[0] == BLE_CMD_PLAY_SOUND)) {
+        if (sound_play(((const uint8_t *)buf)[1]) < 0) {
+            return -1;
+        }
+        return 0;
+    }
+
+    if ((len == 2) && (((const uint8_t *)buf)[0] == BLE_CMD_SET_ADC_CLK_DIV)) {
+        if (power_sense_set_clk_div(((const uint8_t *)buf)[1]) < 0) {
+            return -1;
+        }
         return 0;
     }
 
     if (len != sizeof(MAGIC_CODE) - 1) {
-        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+        return -1;
     }
 
     if (strncmp(buf, MAGIC_CODE, sizeof(MAGIC_CODE) - 1)) {
-        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+        return -1;
     }
 
     is_jump_bootloader = true;
 
     xSemaphoreGiveFromISR( rx_sem, &xHigherPriorityTaskWoken );
 
+    return 0;
+}
+
+static int ble_app_recv(struct bt_conn *conn,
+              const struct bt_gatt_attr *attr, const void *buf,
+              u16_t len, u16_t offset, u8_t flags)
+{
+    /*If prepare write, it will return 0 */
+    if (flags == BT_GATT_WRITE_FLAG_PREPARE) {
+        return 0;
+    }
+
+    if (ble_app_command(buf, len) < 0) {
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+
     return len;
 }
 
+static struct net_buf *ble_coc_alloc_frag(s32_t timeout, void *user_data)
+{
+    return bt_l2cap_chan_buf_alloc(timeout);
+}
+
+/* commands fit one segment, so the stack hands over every SDU as it comes */
+static int ble_coc_recv(struct bt_l2cap_chan *chan, struct net_buf *buf)
+{
+    /* a bad command is ignored, not a reason to close the channel */
+    ble_app_command(buf->data, buf->len);
+
+    return 0;
+}
+
+static void ble_coc_sent(struct bt_l2cap_chan *chan)
+{
+    atomic_dec(&coc_tx_pending);
+}
+
+static void ble_coc_connected(struct bt_l2cap_chan *chan)
+{
+    uint16_t mtu = MIN(coc_chan.tx.mtu, sizeof(telemetry_batch) + 1);
+
+    telemetry_batch_max = (mtu - 1 - offsetof(typeof(telemetry_batch), records)) / sizeof(ble_telemetry_record_t);
+    atomic_set(&coc_tx_pending, 0);
+    is_coc_connected = true;
+}
+
+static void ble_coc_disconnected(struct bt_l2cap_chan *chan)
+{
+    is_coc_connected = false;
+    telemetry_period_ms = 0;
+}
+
+static struct bt_l2cap_chan_ops coc_ops = {
+    .recv = ble_coc_recv,
+    .sent = ble_coc_sent,
+    .connected = ble_coc_connected,
+    .disconnected = ble_coc_disconnected,
+};
+
+static int ble_coc_accept(struct bt_conn *conn, struct bt_l2cap_chan **chan)
+{
+    if (coc_chan.chan.conn) {
+        return -ENOMEM;
+    }
+
+    memset(&coc_chan, 0, sizeof(coc_chan));
+    coc_chan.chan.ops = &coc_ops;
+    coc_chan.rx.mtu = BLE_APP_L2CAP_RX_MTU;
+    *chan = &coc_chan.chan;
+
+    return 0;
+}
+
+static struct bt_l2cap_server coc_server = {
+    .psm = BLE_APP_L2CAP_PSM,
+    .sec_level = BT_SECURITY_L1,
+    .accept = ble_coc_accept,
+};
+
+/* one SDU of type and payload, segmented by the stack to the host's MPS */
+static int ble_coc_send(uint8_t type, const void *data, uint16_t len)
+{
+    struct net_buf *buf;
+    int ret;
+
+    if (!is_coc_connected || (len + 1 > coc_chan.tx.mtu)) {
+        return -EMSGSIZE;
+    }
+
+    buf = bt_l2cap_chan_buf_alloc(K_NO_WAIT);
+    if (!buf) {
+        return -ENOMEM;
+    }
+
+    net_buf_add_u8(buf, type);
+
+    if (net_buf_append_bytes(buf, len, data, K_NO_WAIT, ble_coc_alloc_frag, NULL) != len) {
+        net_buf_unref(buf);
+        return -ENOMEM;
+    }
+
+    /* queued in the stack while the host has no credits left, that returns the bytes sent so far */
+    atomic_inc(&coc_tx_pending);
+    ret = bt_l2cap_chan_send(&coc_chan.chan, buf);
+    if (ret < 0) {
+        atomic_dec(&coc_tx_pending);
+        /* not queued, so still ours, unless the channel reset under it and the stack dropped it */
+        if (ret != -ECONNRESET) {
+            net_buf_unref(buf);
+        }
+        return ret;
+    }
+
+    return 0;
+}
+
 static void ble_app_cfg_changed(const struct bt_gatt_attr *attr, u16_t vblfue)
 {
 
@@ -74,6 +386,16 @@ static const struct bt_data ad[] = {
     BT_DATA(BT_DATA_MANUFACTURER_DATA, "RV_702", 6),
     
 };
+
+/* multi_adv sends data as given, the name goes in the scan response by hand */
+static struct bt_data adv_sd[] = {
+    BT_DATA(BT_DATA_NAME_COMPLETE, adv_name, 0),
+};
+
+static const struct bt_data beacon_ad[] = {
+    BT_DATA_BYTES(BT_DATA_FLAGS, BT_LE_AD_NO_BREDR),
+    BT_DATA(BT_DATA_MANUFACTURER_DATA, &beacon, sizeof(beacon)),
+};
 static struct bt_gatt_attr blattrs[]= {
     BT_GATT_PRIMARY_SERVICE(BT_UUID_DECLARE_16(0xFFF0)),
 
@@ -96,6 +418,55 @@ static struct bt_gatt_attr blattrs[]= {
 
 static struct bt_gatt_service ble_bl_server = BT_GATT_SERVICE(blattrs);
 
+/* the slow connectable set is only planned while nobody is connected */
+static void ble_adv_conn_start(void)
+{
+    struct bt_le_adv_param adv_param = {
+        .options = BT_LE_ADV_OPT_CONNECTABLE,
+        .interval_min = BT_GAP_ADV_SLOW_INT_MIN,
+        .interval_max = BT_GAP_ADV_SLOW_INT_MAX
+    };
+
+    if (!adv_conn_id && bt_le_multi_adv_start(&adv_param, ad, ARRAY_SIZE(ad), adv_sd, ARRAY_SIZE(adv_sd), &adv_conn_id)) {
+        adv_conn_id = 0;
+    }
+}
+
+static void ble_beacon_fill(void)
+{
+    speed_ctrl_stats_t speed;
+
+    speed_ctrl_get_stats(&speed);
+
+    beacon.velocity = (int16_t)MAX(MIN(speed.velocity, INT16_MAX), INT16_MIN);
+    beacon.vbat_mv = power_sense_get_vbat_mv();
+    beacon.flags = 0;
+    if (power_sense_is_tripped()) {
+        beacon.flags |= BLE_BEACON_FLAG_CUTOFF;
+    }
+    if (beacon.vbat_mv && (beacon.vbat_mv < BLE_BEACON_VBAT_LOW_MV)) {
+        beacon.flags |= BLE_BEACON_FLAG_VBAT_LOW;
+    }
+    if (ble_bl_conn) {
+        beacon.flags |= BLE_BEACON_FLAG_CONNECTED;
+    }
+    beacon.seq++;
+}
+
+static void ble_beacon_start(void)
+{
+    struct bt_le_adv_param adv_param = {
+        .options = 0,
+        .interval_min = BT_GAP_ADV_FAST_INT_MIN_2,
+        .interval_max = BT_GAP_ADV_FAST_INT_MAX_2
+    };
+
+    ble_beacon_fill();
+    if (bt_le_multi_adv_start(&adv_param, beacon_ad, ARRAY_SIZE(beacon_ad), NULL, 0, &adv_beacon_id)) {
+        adv_beacon_id = 0;
+    }
+}
+
 static void bl_connected(struct bt_conn *conn, uint8_t err)
 {
     int tx_octets = 0x00fb;
@@ -108,13 +479,18 @@ static void bl_connected(struct bt_conn *conn, uint8_t err)
     param.timeout=400;
 
 	if (err) {
-
+        DLOG_W("connect failed, err 0x%02x", err);
 	} else {
-        is_adv_2s = false;
-        adv_duration = 0;
+        /* the controller stopped the set, keep it out of the plan until the link drops */
+        if (adv_conn_id) {
+            bt_le_multi_adv_stop(adv_conn_id);
+            adv_conn_id = 0;
+        }
 
         ble_bl_conn = conn;
+        DLOG_I("connected");
         bt_conn_le_param_update(conn, &param);
+        boot_profile_mark(BOOT_PHASE_APP_CONNECTED);
 
         if (!bt_le_set_data_len(ble_bl_conn, tx_octets, tx_time)) {
             exchg_mtu.func = ble_tx_mtu_size;
@@ -126,17 +502,11 @@ static void bl_connected(struct bt_conn *conn, uint8_t err)
 
 static void bl_disconnected(struct bt_conn *conn, uint8_t reason)
 {
+    DLOG_I("disconnected, reason 0x%02x", reason);
     ble_bl_conn = NULL;
+    speed_ctrl_set_target(0);
 
-    struct bt_le_adv_param adv_param = {
-        .options = BT_LE_ADV_OPT_CONNECTABLE |
-                    BT_LE_ADV_OPT_USE_NAME,
-        .interval_min = BT_GAP_ADV_SLOW_INT_MIN,
-        .interval_max = BT_GAP_ADV_SLOW_INT_MAX
-    };
-
-    bt_le_adv_stop();
-    bt_le_adv_start(&adv_param, ad, ARRAY_SIZE(ad), NULL, 0);
+    ble_adv_conn_start();
 }
 
 static struct bt_conn_cb conn_callbacks = {
@@ -144,26 +514,87 @@ static struct bt_conn_cb conn_callbacks = {
 	.disconnected = bl_disconnected,
 };
 
+#if defined(CONFIG_BT_DEBUG_MONITOR)
+struct ble_snoop_line {
+    uint8_t len;
+    char hex[BLE_SNOOP_LINE_BYTES * 2 + 1];
+};
+
+static void ble_snoop_flush(struct ble_snoop_line *line)
+{
+    if (line->len) {
+        line->hex[line->len * 2] = '\0';
+        MSG("SNOOP:%s\r\n", line->hex);
+        line->len = 0;
+    }
+}
+
+static int ble_snoop_uart_out(void *ctx, const void *data, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    struct ble_snoop_line *line = ctx;
+    const uint8_t *p = data;
+
+    while (len--) {
+        line->hex[line->len * 2] = hex[*p >> 4];
+        line->hex[line->len * 2 + 1] = hex[*p & 0x0f];
+        p++;
+
+        if (++line->len == BLE_SNOOP_LINE_BYTES) {
+            ble_snoop_flush(line);
+        }
+    }
+
+    return 0;
+}
+
+/* "SNOOP:<hex>" lines share the debug uart with MSG() logs, see tools/btsnoop/snoop_dump.py */
+static void ble_snoop_dump_uart(void)
+{
+    struct ble_snoop_line line = { 0 };
+
+    /* MSG() prints nothing with the debug uart off, skip the dump like app_log_init() does */
+    if (bflb_platform_print_get()) {
+        return;
+    }
+
+    bt_monitor_dump(ble_snoop_uart_out, &line);
+    ble_snoop_flush(&line);
+}
+
+void ble_app_snoop_assert(void)
+{
+    static bool dumped = false;
+
+    if (dumped) {
+        return;
+    }
+    dumped = true;
+
+    bt_monitor_freeze(BT_MONITOR_FREEZE_ASSERT);
+    bt_monitor_dump_flash(BLE_SNOOP_FLASH_ADDR, BLE_SNOOP_FLASH_SIZE);
+    ble_snoop_dump_uart();
+}
+#endif
+
 void bt_enable_cb(int err)
 {
     bt_addr_le_t adv_addr;
-    char str[100] = {0};
-    struct bt_le_adv_param adv_param = {
-        .options = BT_LE_ADV_OPT_CONNECTABLE | 
-                    BT_LE_ADV_OPT_USE_NAME,
-        .interval_min = BT_GAP_ADV_SLOW_INT_MIN,
-        .interval_max = BT_GAP_ADV_SLOW_INT_MAX
-    };
     
     if (!err) {
         bt_get_local_public_address(&adv_addr);
-        sprintf(str, "lego_train_%02X%02X", adv_addr.a.val[0], adv_addr.a.val[1]);
+        sprintf(adv_name, "lego_train_%02X%02X", adv_addr.a.val[0], adv_addr.a.val[1]);
+        adv_sd[0].data_len = strlen(adv_name);
         
-        bt_set_name(str);
+        bt_set_name(adv_name);
 
         bt_conn_cb_register(&conn_callbacks);
         bt_gatt_service_register(&ble_bl_server);
-        bt_le_adv_start(&adv_param, ad, ARRAY_SIZE(ad), NULL, 0);
+        bt_l2cap_server_register(&coc_server);
+        bt_le_multi_adv_set_budget(BLE_ADV_BUDGET_UA);
+        ble_adv_conn_start();
+        ble_beacon_start();
+        boot_profile_mark(BOOT_PHASE_APP_ADV);
     }
 }
 
@@ -171,12 +602,21 @@ void ble_app_init(void)
 {
     tx_sem = xSemaphoreCreateBinary();
     rx_sem = xSemaphoreCreateBinary();
+    /* ble_app_process() runs in the main task */
+    ble_wdg = watchdog_register("main", BLE_APP_WDG_MS);
 
     GLB_Set_EM_Sel(GLB_EM_8KB);
     ble_controller_init(configMAX_PRIORITIES - 1);
     // Initialize BLE Host stack
     hci_driver_init();
 
+#if defined(CONFIG_BT_DEBUG_MONITOR)
+    /* events and commands whole, ACL cut to the headers; kept for the last disconnect */
+    bt_monitor_set_filter(BT_MONITOR_FILTER_ALL | BT_MONITOR_FILTER_ACL_HDR);
+    bt_monitor_set_freeze(BT_MONITOR_FREEZE_DISCONNECT | BT_MONITOR_FREEZE_ASSERT);
+    DLOG_I("snoop: %u ns per captured packet", bt_monitor_bench_ns());
+#endif
+
     bt_enable(bt_enable_cb);
 }
 
@@ -225,9 +665,158 @@ bool ble_app_is_connected(void)
     return (ble_bl_conn != NULL);
 }
 
+/* on the channel when the host opened one, else as notifications like before */
+static void ble_app_reply(uint8_t opcode, uint8_t *data, uint16_t len)
+{
+    if (is_coc_connected) {
+        ble_coc_send(opcode, data, len);
+    } else if (ble_app_is_connected()) {
+        ble_app_send(data, len);
+    }
+}
+
+static void ble_telemetry_sample(void)
+{
+    ble_telemetry_record_t *rec;
+    speed_ctrl_stats_t speed;
+    power_sense_stats_t power;
+
+    if (telemetry_batch.count < telemetry_batch_max) {
+        if (!telemetry_batch.count) {
+            telemetry_batch.seq = telemetry_seq;
+        }
+
+        speed_ctrl_get_stats(&speed);
+        power_sense_get_stats(&power);
+
+        rec = &telemetry_batch.records[telemetry_batch.count++];
+        rec->time_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+        rec->target = speed.target;
+        rec->velocity = speed.velocity;
+        rec->ticks = odometry_get_ticks();
+        rec->vbat_mv = power.vbat_mv;
+        rec->current_ma = power.current_ma;
+    }
+
+    telemetry_seq++;
+
+    /* the last batch still waits for credits, keep collecting */
+    if (atomic_get(&coc_tx_pending)) {
+        return;
+    }
+
+    if (!ble_coc_send(BLE_MSG_TELEMETRY, &telemetry_batch,
+                      offsetof(typeof(telemetry_batch), records) + telemetry_batch.count * sizeof(ble_telemetry_record_t))) {
+        telemetry_batch.count = 0;
+    }
+}
+
 int ble_app_process(void)
 {
-    if (xSemaphoreTake( rx_sem, pdMS_TO_TICKS(WAIT_TIMEOUT)) == pdTRUE) {
+    TickType_t wait = pdMS_TO_TICKS(WAIT_TIMEOUT);
+    TickType_t now = xTaskGetTickCount();
+    BaseType_t taken;
+
+    if (telemetry_period_ms && !is_telemetry_restart) {
+        wait = ((int32_t)(telemetry_next - now) > 0) ? (telemetry_next - now) : 0;
+    }
+
+    if (adv_beacon_id) {
+        wait = MIN(wait, ((int32_t)(beacon_next - now) > 0) ? (beacon_next - now) : 0);
+    }
+
+    /* without telemetry or a beacon no command may come for a day */
+    watchdog_block(ble_wdg);
+    taken = xSemaphoreTake( rx_sem, wait);
+    watchdog_checkin(ble_wdg);
+
+    if (taken == pdTRUE) {
+        if (is_speed_stats_req) {
+            speed_ctrl_stats_t stats;
+
+            is_speed_stats_req = false;
+            speed_ctrl_get_stats(&stats);
+
+            ble_app_reply(BLE_CMD_GET_SPEED_STATS, (uint8_t *)&stats, sizeof(stats));
+        }
+
+        if (is_power_stats_req) {
+            power_sense_stats_t stats;
+
+            is_power_stats_req = false;
+            power_sense_get_stats(&stats);
+
+            ble_app_reply(BLE_CMD_GET_POWER_STATS, (uint8_t *)&stats, sizeof(stats));
+        }
+
+        if (is_task_profile_req) {
+            uint16_t len;
+
+            is_task_profile_req = false;
+            len = task_profile_snapshot(task_profile_buf, sizeof(task_profile_buf));
+
+            if (len) {
+                ble_app_reply(BLE_CMD_GET_TASK_PROFILE, task_profile_buf, len);
+            }
+        }
+
+        if (is_sleep_stats_req) {
+            low_power_stats_t stats;
+
+            is_sleep_stats_req = false;
+            low_power_get_stats(&stats);
+            low_power_clear_stats();
+
+            ble_app_reply(BLE_CMD_GET_SLEEP_STATS, (uint8_t *)&stats, sizeof(stats));
+        }
+
+        if (is_boot_profile_req) {
+            const boot_profile_t *profile = boot_profile_get();
+
+            is_boot_profile_req = false;
+
+            if (profile) {
+                ble_app_reply(BLE_CMD_GET_BOOT_PROFILE, (uint8_t *)profile, offsetof(boot_profile_t, marks) + profile->num_marks * sizeof(boot_profile_mark_t));
+            }
+        }
+
+        if (is_sound_stats_req) {
+            sound_stats_t stats;
+
+            is_sound_stats_req = false;
+            sound_get_stats(&stats);
+
+            ble_app_reply(BLE_CMD_GET_SOUND_STATS, (uint8_t *)&stats, sizeof(stats));
+        }
+
+        if (is_clear_gains_req) {
+            int err;
+
+            is_clear_gains_req = false;
+            err = speed_ctrl_clear_gains();
+            if (err) {
+                DLOG_W("gains not cleared (%d)", err);
+            }
+        }
+
+        if (is_gains_req) {
+            speed_ctrl_tune_t tune;
+
+            is_gains_req = false;
+            speed_ctrl_get_tune(&tune);
+
+            ble_app_reply(BLE_CMD_GET_GAINS, (uint8_t *)&tune, sizeof(tune));
+        }
+
+        if (is_watchdog_req) {
+            watchdog_record_t record;
+
+            is_watchdog_req = false;
+            watchdog_get_reset(&record);
+
+            ble_app_reply(BLE_CMD_GET_WATCHDOG, (uint8_t *)&record, sizeof(record));
+        }
+
         if (is_jump_bootloader) {
             vTaskDelay(pdMS_TO_TICKS(500));
 
@@ -238,23 +827,37 @@ int ble_app_process(void)
                 /*empty dead loop*/
             }
         }
-    } else {
-        if (is_adv_2s == false) {
-            adv_duration++;
-            if (adv_duration >= ADV_1S_DURATION) {
-                struct bt_le_adv_param adv_param = {
-                    .options = BT_LE_ADV_OPT_CONNECTABLE |
-                               BT_LE_ADV_OPT_USE_NAME,
-                    .interval_min = BT_GAP_ADV_SLOW_INT_MIN * 2,
-                    .interval_max = BT_GAP_ADV_SLOW_INT_MAX * 2
-                };
-                adv_duration = 0;
-                is_adv_2s = true;
-
-                bt_le_adv_stop();
-                bt_le_adv_start(&adv_param, ad, ARRAY_SIZE(ad), NULL, 0);
-            }
+    }
+
+    if (adv_beacon_id && ((int32_t)(xTaskGetTickCount() - beacon_next) >= 0)) {
+        beacon_next = xTaskGetTickCount() + pdMS_TO_TICKS(BLE_BEACON_UPDATE_MS);
+        ble_beacon_fill();
+        bt_le_multi_adv_update(adv_beacon_id, beacon_ad, ARRAY_SIZE(beacon_ad), NULL, 0);
+    }
+
+#if defined(CONFIG_BT_DEBUG_MONITOR)
+    /* the beacon update wakes this loop at least every 500 ms */
+    if (bt_monitor_frozen() == BT_MONITOR_FREEZE_DISCONNECT) {
+        ble_snoop_dump_uart();
+        bt_monitor_resume();
+    }
+#endif
+
+    if (is_telemetry_restart) {
+        is_telemetry_restart = false;
+        telemetry_batch.count = 0;
+        telemetry_next = xTaskGetTickCount();
+    }
+
+    if (telemetry_period_ms && ((int32_t)(xTaskGetTickCount() - telemetry_next) >= 0)) {
+        telemetry_next += pdMS_TO_TICKS(telemetry_period_ms);
+
+        /* after a long stall start over instead of sampling in a burst */
+        if ((int32_t)(xTaskGetTickCount() - telemetry_next) > 0) {
+            telemetry_next = xTaskGetTickCount() + pdMS_TO_TICKS(telemetry_period_ms);
         }
+
+        ble_telemetry_sample();
     }
 
     return 0;
@@ -1,9 +1,18 @@
 #ifndef BLE_APP_H
 #define BLE_APP_H
 
+/* LE credit based channel for commands, replies and the telemetry stream */
+#define BLE_APP_L2CAP_PSM    0x0081
+/* the longest command is the bootloader magic */
+#define BLE_APP_L2CAP_RX_MTU 23
+
 void ble_app_init(void);
 void ble_app_send(uint8_t *data, uint16_t len);
 bool ble_app_is_connected(void);
 int ble_app_process(void);
+#if defined(CONFIG_BT_DEBUG_MONITOR)
+/* keep the HCI capture in flash and print it, for the assert handler */
+void ble_app_snoop_assert(void);
+#endif
 
 #endif
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include <errno.h>
+#include <stddef.h>
+#include <math.h>
+#include <string.h>
+#include "hal_flash.h"
+#include "softcrc.h"
+#include "gain_store.h"
+
+#define GAIN_STORE_MAGIC 0x324E4147 /* "GAN2", one loop */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t crc;   /* of the rest of the record */
+    uint32_t valid; /* bit per loop */
+    autotune_gains_t gains[GAIN_STORE_LOOPS];
+} gain_store_record_t;
+
+/* an erased or foreign sector reads as an empty store */
+static void gain_store_read(gain_store_record_t *record)
+{
+    if ((flash_read(GAIN_STORE_ADDR, (uint8_t *)record, sizeof(*record)) != SUCCESS) ||
+        (record->magic != GAIN_STORE_MAGIC) ||
+        (record->crc != BFLB_Soft_CRC32(&record->valid, sizeof(*record) - offsetof(gain_store_record_t, valid)))) {
+        memset(record, 0, sizeof(*record));
+    }
+}
+
+static int gain_store_write(gain_store_record_t *record)
+{
+    record->magic = GAIN_STORE_MAGIC;
+    record->crc = BFLB_Soft_CRC32(&record->valid, sizeof(*record) - offsetof(gain_store_record_t, valid));
+
+    if ((flash_erase(GAIN_STORE_ADDR, GAIN_STORE_SIZE) != SUCCESS) ||
+        (flash_write(GAIN_STORE_ADDR, (uint8_t *)record, sizeof(*record)) != SUCCESS)) {
+        return -EIO;
+    }
+
+    return 0;
+}
+
+int gain_store_load(uint8_t loop, autotune_gains_t *gains)
+{
+    gain_store_record_t record;
+    const autotune_gains_t *g = &record.gains[loop];
+
+    if (loop >= GAIN_STORE_LOOPS) {
+        return -EINVAL;
+    }
+
+    gain_store_read(&record);
+    if (!(record.valid & (1 << loop))) {
+        return -ENOENT;
+    }
+
+    /* a loop never runs on gains it could not have been tuned to */
+    if (!isfinite(g->kp) || !isfinite(g->ki) || !isfinite(g->kd) || (g->kp < 0) || (g->ki < 0) || (g->kd < 0)) {
+        return -EINVAL;
+    }
+
+    *gains = *g;
+    return 0;
+}
+
+int gain_store_save(uint8_t loop, const autotune_gains_t *gains)
+{
+    gain_store_record_t record;
+
+    if (loop >= GAIN_STORE_LOOPS) {
+        return -EINVAL;
+    }
+
+    gain_store_read(&record);
+    record.gains[loop] = *gains;
+    record.valid |= 1 << loop;
+
+    return gain_store_write(&record);
+}
+
+int gain_store_erase(uint8_t loop)
+{
+    gain_store_record_t record;
+
+    if (loop >= GAIN_STORE_LOOPS) {
+        return -EINVAL;
+    }
+
+    gain_store_read(&record);
+    if (!(record.valid & (1 << loop))) {
+        return 0;
+    }
+
+    memset(&record.gains[loop], 0, sizeof(record.gains[loop]));
+    record.valid &= ~(1 << loop);
+
+    return gain_store_write(&record);
+}
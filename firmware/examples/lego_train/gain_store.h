@@ -0,0 +1,22 @@
+#ifndef GAIN_STORE_H
+#define GAIN_STORE_H
+
+#include <stdint.h>
+#include "autotune.h"
+
+/* first sector of the PSM partition of partition_cfg_1M_boot2_ble.toml, unused while
+ * CONFIG_BT_SETTINGS is off */
+#define GAIN_STORE_ADDR 0xF9000
+#define GAIN_STORE_SIZE 0x1000
+
+/* control loops with a slot in the store */
+#define GAIN_STORE_SPEED 0 /* speed_ctrl.c */
+#define GAIN_STORE_LOOPS 1
+
+/* 0 and the gains of a loop, -ENOENT when none were saved */
+int gain_store_load(uint8_t loop, autotune_gains_t *gains);
+/* rewrites the sector, which stalls code running from flash: keep it out of a running loop */
+int gain_store_save(uint8_t loop, const autotune_gains_t *gains);
+int gain_store_erase(uint8_t loop);
+
+#endif
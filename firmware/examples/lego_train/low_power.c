@@ -0,0 +1,131 @@
+#include <FreeRTOS.h>
+#include "task.h"
+#include "bflb_platform.h"
+#include "bl702_hbn.h"
+#include "low_power.h"
+
+/* compensation is kept this far above the measured latency */
+#define LOW_POWER_WAKE_GUARD_CYCLES 16
+#define LOW_POWER_REDUCE_MAX        300
+/* running average kept as x += (new - x) / 2^LOW_POWER_AVG_SHIFT */
+#define LOW_POWER_AVG_SHIFT         3
+
+#define CYCLES_TO_US(c) (((uint64_t)(c) * 1000000) >> 15)
+#define CYCLES_TO_MS(c) (((uint64_t)(c) * 1000) >> 15)
+
+static uint32_t reduce_cycles;
+static uint32_t latency_avg_cycles;
+static uint32_t sleep_start_rtc;
+static uint32_t stats_start_rtc;
+static uint32_t sleep_total_cycles;
+static low_power_stats_t lp_stats;
+
+static uint32_t low_power_rtc(void)
+{
+    uint32_t low, high;
+
+    HBN_Get_RTC_Timer_Val(&low, &high);
+    return low;
+}
+
+static uint32_t low_power_clamp(uint32_t val)
+{
+    if (val < LOW_POWER_REDUCE_MIN) {
+        return LOW_POWER_REDUCE_MIN;
+    }
+
+    if (val > LOW_POWER_REDUCE_MAX) {
+        return LOW_POWER_REDUCE_MAX;
+    }
+
+    return val;
+}
+
+/* reduce_cycles is the static estimate derived from the flash setup */
+void low_power_init(uint32_t reduce)
+{
+    reduce_cycles = low_power_clamp(reduce);
+    latency_avg_cycles = reduce_cycles - LOW_POWER_WAKE_GUARD_CYCLES;
+    stats_start_rtc = low_power_rtc();
+}
+
+uint32_t low_power_get_reduce_cycles(void)
+{
+    return reduce_cycles;
+}
+
+void low_power_sleep_begin(void)
+{
+    sleep_start_rtc = low_power_rtc();
+}
+
+/*
+ * Called once the idle task runs again. Whatever elapsed beyond the programmed
+ * sleep is the wake up path: PDS exit, fast boot, TCM restore and the
+ * peripheral restore in bl_pds_restore(). The compensation follows it.
+ */
+void low_power_sleep_end(uint32_t sleep_cycles, bool connected)
+{
+    uint32_t elapsed = low_power_rtc() - sleep_start_rtc;
+    uint32_t latency = (elapsed > sleep_cycles) ? (elapsed - sleep_cycles) : 0;
+    uint32_t latency_us = CYCLES_TO_US(latency);
+    uint32_t bucket = latency_us / LOW_POWER_HIST_BUCKET_US;
+
+    latency_avg_cycles += (int32_t)(latency - latency_avg_cycles) >> LOW_POWER_AVG_SHIFT;
+
+    if (latency > reduce_cycles) {
+        lp_stats.late_wakes++;
+    }
+
+    reduce_cycles = low_power_clamp(latency_avg_cycles + LOW_POWER_WAKE_GUARD_CYCLES);
+    sleep_total_cycles += sleep_cycles;
+
+    lp_stats.sleeps++;
+    if (connected) {
+        lp_stats.sleeps_connected++;
+    }
+
+    lp_stats.wake_latency_avg_us = CYCLES_TO_US(latency_avg_cycles);
+    if (latency_us > lp_stats.wake_latency_max_us) {
+        lp_stats.wake_latency_max_us = latency_us;
+    }
+
+    if (bucket >= LOW_POWER_HIST_BUCKETS) {
+        bucket = LOW_POWER_HIST_BUCKETS - 1;
+    }
+    lp_stats.wake_hist[bucket]++;
+}
+
+void low_power_sleep_skipped(void)
+{
+    lp_stats.too_short++;
+}
+
+void low_power_get_stats(low_power_stats_t *stats)
+{
+    uint32_t wall_cycles;
+
+    taskENTER_CRITICAL();
+    wall_cycles = low_power_rtc() - stats_start_rtc;
+    *stats = lp_stats;
+    stats->wall_ms = CYCLES_TO_MS(wall_cycles);
+    stats->sleep_ms = CYCLES_TO_MS(sleep_total_cycles);
+    stats->reduce_cycles = reduce_cycles;
+    taskEXIT_CRITICAL();
+
+    if (wall_cycles) {
+        stats->residency_permille = (uint64_t)sleep_total_cycles * 1000 / wall_cycles;
+    }
+
+    stats->idle_current_ua = (stats->residency_permille * LOW_POWER_PDS31_UA +
+                              (1000 - stats->residency_permille) * LOW_POWER_RUN_UA) / 1000;
+}
+
+void low_power_clear_stats(void)
+{
+    taskENTER_CRITICAL();
+    memset(&lp_stats, 0, sizeof(lp_stats));
+    sleep_total_cycles = 0;
+    stats_start_rtc = low_power_rtc();
+    taskEXIT_CRITICAL();
+}
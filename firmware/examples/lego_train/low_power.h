@@ -0,0 +1,41 @@
+#ifndef LOW_POWER_H
+#define LOW_POWER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* wake-to-run latency histogram, LOW_POWER_HIST_BUCKET_US wide, last bucket open ended */
+#define LOW_POWER_HIST_BUCKETS   8
+#define LOW_POWER_HIST_BUCKET_US 500
+
+/* datasheet ballpark figures for the idle current estimate */
+#define LOW_POWER_PDS31_UA       20
+#define LOW_POWER_RUN_UA         3000
+
+/* the shortest wake compensation, 32768 Hz cycles; a sleep that leaves no more than this is skipped */
+#define LOW_POWER_REDUCE_MIN     60
+
+typedef struct {
+    uint32_t sleeps;                /* PDS entries */
+    uint32_t sleeps_connected;      /* of those, between connection events */
+    uint32_t too_short;             /* idle periods skipped, next event under 5 ms or within the wake compensation */
+    uint32_t wall_ms;               /* since the stats were cleared, RTC based */
+    uint32_t sleep_ms;
+    uint32_t residency_permille;    /* sleep_ms / wall_ms */
+    uint32_t idle_current_ua;       /* estimate from the residency */
+    uint32_t reduce_cycles;         /* wake compensation in use, 32768 Hz cycles */
+    uint32_t wake_latency_avg_us;   /* programmed wake up to back in the idle task */
+    uint32_t wake_latency_max_us;
+    uint32_t late_wakes;            /* latency beyond the compensation */
+    uint32_t wake_hist[LOW_POWER_HIST_BUCKETS];
+} low_power_stats_t;
+
+void low_power_init(uint32_t reduce_cycles);
+uint32_t low_power_get_reduce_cycles(void);
+void low_power_sleep_begin(void);
+void low_power_sleep_end(uint32_t sleep_cycles, bool connected);
+void low_power_sleep_skipped(void);
+void low_power_get_stats(low_power_stats_t *stats);
+void low_power_clear_stats(void);
+
+#endif
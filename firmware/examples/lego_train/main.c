@@ -28,16 +28,25 @@
 #include "hal_clock.h"
 #include "hal_pm.h"
 #include "hal_pwm.h"
-#include "hal_wdt.h"
 #include "hal_uart.h"
 #include "bl702_sec_eng.h"
 #include <FreeRTOS.h>
 #include "task.h"
 #include "ble_app.h"
+#include "motor.h"
+#include "speed_ctrl.h"
+#include "power_sense.h"
+#include "sound.h"
+#include "task_profile.h"
+#include "watchdog.h"
+#include "low_power.h"
+#include "boot_profile.h"
 #include "hal_clock.h"
 #include "bl702_romdriver.h"
 #include "hal_pm.h"
 #include "hal_pm_util.h"
+#include "dlog.h"
+#include "app_log.h"
 
 extern uint32_t __hbn_load_addr;
 extern uint32_t __hbn_ram_start__;
@@ -65,8 +74,11 @@ extern uint32_t __system_ram_data_end__;
 #define DEBUG_DISABLE    1
 
 #define LED_PIN     1
-#define MOTOR1_PIN 24
-#define MOTOR2_PIN 23
+#define ENCODER_A_PIN 18
+#define ENCODER_B_PIN 19
+#define MOTOR_A_PIN 3
+#define MOTOR_B_PIN 4
+#define CURRENT_SENSE_PIN 20
 
 #define SHUTDOWN_TIME       5
 #define THREAD_CYCLE_TIME   20
@@ -91,7 +103,12 @@ static HeapRegion_t xHeapRegions[] = {
 void user_vAssertCalled(void) __attribute__((weak, alias("vAssertCalled")));
 void vAssertCalled(void)
 {
+    /* what was logged up to here, before the capture takes the uart */
+    dlog_flush();
     MSG("vAssertCalled\r\n");
+#if defined(CONFIG_BT_DEBUG_MONITOR)
+    ble_app_snoop_assert();
+#endif
 
     while (1)
         ;
@@ -105,9 +122,15 @@ void ATTR_PDS_RAM_SECTION bl702_low_power_config(void)
     // Power off DLL
     GLB_Power_Off_DLL();
 
+#if defined(CONFIG_HW_SEC_ENG_DISABLE)
     // Disable secure engine
     Sec_Eng_Trng_Disable();
     SEC_Eng_Turn_Off_Sec_Ring();
+#else
+    // BLE random numbers and the pairing keys come from the TRNG, (re)start it after a wake
+    SEC_Eng_Turn_On_Sec_Ring();
+    Sec_Eng_Trng_Enable();
+#endif
 
     // Disable Zigbee clock
     GLB_Set_MAC154_ZIGBEE_CLK(0);
@@ -132,6 +155,26 @@ void ATTR_PDS_RAM_SECTION bl702_low_power_config(void)
             continue;
         }
 
+        // motor pwm pins, pwm channels 3 and 4 like the line robot; 23-28 belong to the flash
+        if ((i == MOTOR_A_PIN) || (i == MOTOR_B_PIN)) {
+            continue;
+        }
+
+        // wheel encoder pins
+        if ((i == ENCODER_A_PIN) || (i == ENCODER_B_PIN)) {
+            continue;
+        }
+
+        // motor current sense pin
+        if (i == CURRENT_SENSE_PIN) {
+            continue;
+        }
+
+        // sound dac output
+        if (i == SOUND_DAC_PIN) {
+            continue;
+        }
+
         GLB_GPIO_Set_HZ(i);
     }
 
@@ -170,6 +213,19 @@ void ATTR_PDS_RAM_SECTION bl702_low_power_config(void)
                 continue;
             }
 
+            if (i == BL_AHB_SLAVE1_PWM) {
+                continue;
+            }
+
+            if (i == BL_AHB_SLAVE1_QDEC) {
+                continue;
+            }
+
+            // power sensing adc and its dma
+            if ((i == BL_AHB_SLAVE1_GPIP) || (i == BL_AHB_SLAVE1_DMA)) {
+                continue;
+            }
+
             GLB_AHB_Slave1_Clock_Gate(1, i);
             regValue = BL_RD_REG(GLB_BASE, GLB_CGEN_CFG1);
         }
@@ -181,11 +237,12 @@ void ATTR_PDS_RAM_SECTION bl702_low_power_config(void)
 
 void vApplicationTickHook(void)
 {
-    //MSG("vApplicationTickHook\r\n");
+    watchdog_tick();
 }
 
 void vApplicationStackOverflowHook(TaskHandle_t xTask, char *pcTaskName)
 {
+    dlog_flush();
     MSG("vApplicationStackOverflowHook\r\n");
 
     if (pcTaskName) {
@@ -198,6 +255,7 @@ void vApplicationStackOverflowHook(TaskHandle_t xTask, char *pcTaskName)
 
 void vApplicationMallocFailedHook(void)
 {
+    dlog_flush();
     MSG("vApplicationMallocFailedHook\r\n");
 
     while (1)
@@ -280,19 +338,19 @@ static void ATTR_PDS_RAM_SECTION user_pds_restore_tcm(void)
 }
 
 /**
- * @brief gate all clock but CPU and ble
+ * @brief gate all clock but CPU, ble and the motor control peripherals
+ *
+ * PWM, QDEC, GPIP (adc, dac) and DMA keep running for the speed loop, power sensing and sound
  *
  */
 static void ATTR_HBN_RAM_SECTION system_clock_gate(void)
 {
     uint32_t tmpVal;
     tmpVal = BL_RD_REG(GLB_BASE, GLB_CGEN_CFG1);
-    tmpVal &= (~(1 << BL_AHB_SLAVE1_GPIP));    //2
     tmpVal &= (~(1 << BL_AHB_SLAVE1_SEC_DBG)); //3
     tmpVal &= (~(1 << BL_AHB_SLAVE1_SEC));     //4
     tmpVal &= (~(1 << BL_AHB_SLAVE1_TZ1));     //5
     tmpVal &= (~(1 << BL_AHB_SLAVE1_TZ2));     //6
-    tmpVal &= (~(1 << BL_AHB_SLAVE1_DMA));     //12
     tmpVal &= (~(1 << BL_AHB_SLAVE1_EMAC));    //13
 #if DEBUG_DISABLE
     tmpVal &= (~(1 << BL_AHB_SLAVE1_UART0));//14
@@ -300,10 +358,8 @@ static void ATTR_HBN_RAM_SECTION system_clock_gate(void)
     tmpVal &= (~(1 << BL_AHB_SLAVE1_UART1)); //15
     tmpVal &= (~(1 << BL_AHB_SLAVE1_SPI));   //16
     tmpVal &= (~(1 << BL_AHB_SLAVE1_I2C));   //17
-    tmpVal &= (~(1 << BL_AHB_SLAVE1_PWM));
     tmpVal &= (~(1 << BL_AHB_SLAVE1_IRR));
     tmpVal &= (~(1 << BL_AHB_SLAVE1_CKS));
-    tmpVal &= (~(1 << BL_AHB_SLAVE1_QDEC));
     tmpVal &= (~(1 << BL_AHB_SLAVE1_KYS));
     tmpVal &= (~(1 << BL_AHB_SLAVE1_I2S));
     tmpVal &= (~(1 << BL_AHB_SLAVE1_USB));
@@ -315,7 +371,6 @@ static void ATTR_HBN_RAM_SECTION system_clock_gate(void)
     tmpVal = BL_RD_REG(GLB_BASE, GLB_CGEN_CFG0);
     tmpVal &= (~(1 << 1)); //SDU clock gating
     tmpVal &= (~(1 << 2)); //SEC clock gating
-    tmpVal &= (~(1 << 3)); //DMA clock gating
     tmpVal &= (~(1 << 4)); //CCI clock gating
     BL_WR_REG(GLB_BASE, GLB_CGEN_CFG0, tmpVal);
 }
@@ -430,22 +485,53 @@ void bl_pds_restore(void)
     }
 #endif
     bl702_low_power_config();
+    power_sense_restart();
     ble_controller_sleep_restore();
 }
 
+/*
+ * The flash setup does not change at run time, so the wake compensation
+ * estimate is worked out once instead of on every idle period.
+ */
+static void low_power_config_init(void)
+{
+    uint32_t reduceSleepTime;
+    SPI_Flash_Cfg_Type *flashCfg;
+    uint32_t len;
+    extern BL_Err_Type flash_get_cfg(uint8_t * *cfg_addr, uint32_t * len);
+
+    flash_get_cfg((uint8_t **)&flashCfg, &len);
+    uint8_t ioMode = flashCfg->ioMode & 0xF;
+    uint8_t contRead = flashCfg->cReadSupport;
+    uint8_t cpuClk = GLB_Get_Root_CLK_Sel();
+    if (ioMode == 4 && contRead == 1 && cpuClk == GLB_ROOT_CLK_XTAL) {
+        reduceSleepTime = 100;
+    } else if (ioMode == 1 && contRead == 0 && cpuClk == GLB_ROOT_CLK_XTAL) {
+        reduceSleepTime = 130;
+    } else {
+        reduceSleepTime = 130;
+    }
+
+    low_power_init(reduceSleepTime);
+}
+
+/*
+ * ble_controller_sleep() returns the time to the next radio event, including
+ * connection events, so a connected train sleeps between them as well. Only
+ * the motor control peripherals and a playing sound need the system awake.
+ */
 void vApplicationSleep(TickType_t xExpectedIdleTime_ms)
 {
     int32_t bleSleepDuration_32768cycles = 0;
     int32_t expectedIdleTime_32768cycles = 0;
+    int32_t sleepCycles;
     eSleepModeStatus eSleepStatus;
     bool freertos_max_idle = false;
-    struct device *wdg;
+    bool connected;
 
-    if (ble_app_is_connected()) {
-        wdg = device_find("wdg_rst");
-        if (wdg) {
-            device_control(wdg, DEVICE_CTRL_RST_WDT_COUNTER, NULL);
-        }
+    watchdog_feed();
+
+    if (speed_ctrl_is_active() || sound_is_active()) {
         return;
     }
 
@@ -467,55 +553,53 @@ void vApplicationSleep(TickType_t xExpectedIdleTime_ms)
     bleSleepDuration_32768cycles = ble_controller_sleep();
 
     if (bleSleepDuration_32768cycles < TIME_5MS_IN_32768CYCLE) {
+        low_power_sleep_skipped();
         return;
     } else {
-        MSG("Sleep_cycles=%ld\r\n", bleSleepDuration_32768cycles);
-
-        uint32_t reduceSleepTime;
-        SPI_Flash_Cfg_Type *flashCfg;
-        uint32_t len;
-        extern BL_Err_Type flash_get_cfg(uint8_t * *cfg_addr, uint32_t * len);
-        flash_get_cfg((uint8_t **)&flashCfg, &len);
-        uint8_t ioMode = flashCfg->ioMode & 0xF;
-        uint8_t contRead = flashCfg->cReadSupport;
-        uint8_t cpuClk = GLB_Get_Root_CLK_Sel();
-        if (ioMode == 4 && contRead == 1 && cpuClk == GLB_ROOT_CLK_XTAL) {
-            reduceSleepTime = 100;
-        } else if (ioMode == 1 && contRead == 0 && cpuClk == GLB_ROOT_CLK_XTAL) {
-            reduceSleepTime = 130;
-        } else {
-            reduceSleepTime = 130;
-        }
+        connected = ble_app_is_connected();
 
         if (eSleepStatus == eStandardSleep && ((!freertos_max_idle) && (expectedIdleTime_32768cycles < bleSleepDuration_32768cycles))) {
-            enter_sleep(expectedIdleTime_32768cycles - reduceSleepTime);
+            sleepCycles = expectedIdleTime_32768cycles - low_power_get_reduce_cycles();
         } else {
-            enter_sleep(bleSleepDuration_32768cycles - reduceSleepTime);
+            sleepCycles = bleSleepDuration_32768cycles - low_power_get_reduce_cycles();
         }
 
-        bl_pds_restore();
+        /* the compensation grows up to 300 cycles, more than the 5 ms above leave; a negative sleep would be taken as 36 hours */
+        if (sleepCycles <= LOW_POWER_REDUCE_MIN) {
+            low_power_sleep_skipped();
+            return;
+        }
 
-        wdg = device_find("wdg_rst");
+        low_power_sleep_begin();
+        watchdog_sleep_begin();
+        enter_sleep(sleepCycles);
+        bl_pds_restore();
+        watchdog_sleep_end();
+        low_power_sleep_end(sleepCycles, connected);
 
-        if (wdg) {
-            device_control(wdg, DEVICE_CTRL_RST_WDT_COUNTER, NULL);
-        }
+        watchdog_feed();
     }
 }
 
 static void main_task(void *pvParameters)
 {
+    boot_profile_mark(BOOT_PHASE_APP_TASKS);
+    app_log_init();
+    watchdog_report();
     ble_app_init();
     bl702_low_power_config();
 
     gpio_set_mode(LED_PIN, GPIO_OUTPUT_PP_MODE);
     gpio_write(LED_PIN, 0);
 
-    gpio_set_mode(MOTOR1_PIN, GPIO_OUTPUT_PP_MODE);
-    gpio_write(MOTOR1_PIN, 0);
+    motor_init();
+    speed_ctrl_init();
+    power_sense_init();
+    sound_init();
+    task_profile_init();
 
-    gpio_set_mode(MOTOR2_PIN, GPIO_OUTPUT_PP_MODE);
-    gpio_write(MOTOR2_PIN, 0);
+    /* got this far, boot2 may skip its loader window next time */
+    boot_profile_confirm();
 
     while(1) {
         ble_app_process();
@@ -524,12 +608,12 @@ static void main_task(void *pvParameters)
 
 int main(void)
 {
-    struct device *wdg;
     uint32_t tmpVal = 0;
 
     bflb_load_hbn_ram();
     bflb_platform_print_set(DEBUG_DISABLE);
     bflb_platform_init(0);
+    boot_profile_mark(BOOT_PHASE_APP_MAIN);
     HBN_Set_Ldo11_Rt_Vout(HBN_LDO_LEVEL_1P00V);
     HBN_Set_Ldo11_Soc_Vout(HBN_LDO_LEVEL_1P00V);
     user_pds_recovery_board();
@@ -546,16 +630,9 @@ int main(void)
     tmpVal = BL_SET_REG_BITS_VAL(tmpVal, AON_XTAL_CAPCODE_OUT_AON, 33);
     BL_WR_REG(AON_BASE, AON_XTAL_CFG, tmpVal);
 
-    wdt_register(WDT_INDEX, "wdg_rst");
-    wdg = device_find("wdg_rst");
+    watchdog_init();
 
-    if (wdg) {
-        uint32_t wdg_timeout = 0xFFFF;
-
-        device_control(wdg, DEVICE_CTRL_CLR_INT, NULL);
-        device_open(wdg, 0);
-        device_write(wdg, 0, &wdg_timeout, sizeof(wdg_timeout));
-    }
+    low_power_config_init();
 
     vPortDefineHeapRegions(xHeapRegions);
 
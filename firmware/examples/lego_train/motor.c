@@ -1,18 +1,59 @@
+#include <FreeRTOS.h>
+#include "task.h"
 #include "bflb_platform.h"
 #include "hal_gpio.h"
 #include "hal_pwm.h"
 #include "motor.h"
+#include "boot_profile.h"
 
 #define MOTOR_LB_PWM_CHAN          PWM_CH4_INDEX
 #define MOTOR_LA_PWM_CHAN          PWM_CH3_INDEX
 #define MOTOR_RA_PWM_CHAN          PWM_CH0_INDEX
 #define MOTOR_RB_PWM_CHAN          PWM_CH1_INDEX
 
+#define MOTOR_PWM_PERIOD           100
+/* the bridge inputs are active low, a channel held high does not drive */
+#define MOTOR_PWM_IDLE             MOTOR_PWM_PERIOD
+
+/* index of each bridge input inside motor_pwm */
+#define MOTOR_LA_IDX               0
+#define MOTOR_LB_IDX               1
+#define MOTOR_RA_IDX               2
+#define MOTOR_RB_IDX               3
+
+/*
+ * One H-bridge: input a drives forward, input b drives backward. The sign of
+ * the last committed speed is remembered so a reversal can pass through the
+ * idle state for MOTOR_DEAD_TIME_US first.
+ */
+typedef struct {
+    uint8_t a_idx;
+    uint8_t b_idx;
+    int8_t speed;
+} motor_bridge_t;
+
 struct device *motor_l[2];
 struct device *motor_r[2];
 
+static pwm_group_t motor_pwm;
+static motor_bridge_t motor_bridge_l = { MOTOR_LA_IDX, MOTOR_LB_IDX, 0 };
+static motor_bridge_t motor_bridge_r = { MOTOR_RA_IDX, MOTOR_RB_IDX, 0 };
+/* set by motor_stop_now(), forces every staged speed to idle until released */
+static volatile bool motor_inhibited = false;
+
+static void motor_open_channel(struct device *dev)
+{
+    PWM_DEV(dev)->period = MOTOR_PWM_PERIOD;
+    PWM_DEV(dev)->threshold_low = 0;
+    PWM_DEV(dev)->threshold_high = MOTOR_PWM_IDLE;
+    device_open(dev, DEVICE_OFLAG_STREAM_TX);
+    pwm_channel_start(dev);
+}
+
 void motor_init(void)
 {
+    struct device *channels[4];
+
     pwm_register(MOTOR_LA_PWM_CHAN, "motor_la");
     pwm_register(MOTOR_LB_PWM_CHAN, "motor_lb");
     pwm_register(MOTOR_RA_PWM_CHAN, "motor_ra");
@@ -23,121 +64,167 @@ void motor_init(void)
     motor_r[0] = device_find("motor_ra");
     motor_r[1] = device_find("motor_rb");
 
-    PWM_DEV(motor_l[0])->period = 100;
-    PWM_DEV(motor_l[0])->threshold_low = 0;
-    PWM_DEV(motor_l[0])->threshold_high = 100;
-    device_open(motor_l[0], DEVICE_OFLAG_STREAM_TX);
-    pwm_channel_start(motor_l[0]);
-
-    PWM_DEV(motor_l[1])->period = 100;
-    PWM_DEV(motor_l[1])->threshold_low = 0;                
-    PWM_DEV(motor_l[1])->threshold_high = 100;
-    device_open(motor_l[1], DEVICE_OFLAG_STREAM_TX);
-    pwm_channel_start(motor_l[1]);
-
-    PWM_DEV(motor_r[0])->period = 100;
-    PWM_DEV(motor_r[0])->threshold_low = 0;
-    PWM_DEV(motor_r[0])->threshold_high = 100;
-    device_open(motor_r[0], DEVICE_OFLAG_STREAM_TX);
-    pwm_channel_start(motor_r[0]);
-
-    PWM_DEV(motor_r[1])->period = 100;
-    PWM_DEV(motor_r[1])->threshold_low = 0;
-    PWM_DEV(motor_r[1])->threshold_high = 100;
-    device_open(motor_r[1], DEVICE_OFLAG_STREAM_TX);
-    pwm_channel_start(motor_r[1]);
+    motor_open_channel(motor_l[0]);
+    motor_open_channel(motor_l[1]);
+    motor_open_channel(motor_r[0]);
+    motor_open_channel(motor_r[1]);
+
+    channels[MOTOR_LA_IDX] = motor_l[0];
+    channels[MOTOR_LB_IDX] = motor_l[1];
+    channels[MOTOR_RA_IDX] = motor_r[0];
+    channels[MOTOR_RB_IDX] = motor_r[1];
+    pwm_group_init(&motor_pwm, channels, 4);
 }
 
-void motor_run(motor_direction_t dir, uint8_t speed)
+static void motor_bridge_stage(motor_bridge_t *bridge, int8_t speed)
+{
+    if (speed > 100) speed = 100;
+    if (speed < -100) speed = -100;
+
+    if (motor_inhibited) {
+        speed = 0;
+    }
+
+    if (speed > 0) {
+        pwm_group_stage(&motor_pwm, bridge->a_idx, 0, MOTOR_PWM_IDLE - speed);
+        pwm_group_stage(&motor_pwm, bridge->b_idx, 0, MOTOR_PWM_IDLE);
+    } else if (speed < 0) {
+        pwm_group_stage(&motor_pwm, bridge->a_idx, 0, MOTOR_PWM_IDLE);
+        pwm_group_stage(&motor_pwm, bridge->b_idx, 0, MOTOR_PWM_IDLE + speed);
+    } else {
+        pwm_group_stage(&motor_pwm, bridge->a_idx, 0, MOTOR_PWM_IDLE);
+        pwm_group_stage(&motor_pwm, bridge->b_idx, 0, MOTOR_PWM_IDLE);
+    }
+
+    bridge->speed = speed;
+}
+
+static bool motor_bridge_reverses(motor_bridge_t *bridge, int8_t speed)
+{
+    return ((bridge->speed > 0) && (speed < 0)) || ((bridge->speed < 0) && (speed > 0));
+}
+
+static void motor_wait_committed(void)
+{
+    /* at most one pwm period, 50us with the 2MHz pwm clock */
+    uint32_t timeout = 1000;
+
+    while (pwm_group_is_pending(&motor_pwm) && timeout--) {
+        bflb_platform_delay_us(1);
+    }
+
+    if (pwm_group_is_pending(&motor_pwm)) {
+        pwm_group_commit_now(&motor_pwm);
+    }
+}
+
+static void motor_set(int8_t l_speed, int8_t r_speed)
 {
-    pwm_dutycycle_config_t pwm_cfg = {0, 100};
-    uint8_t turn_speed;
+    static bool moved;
+    bool reverse_l = motor_bridge_reverses(&motor_bridge_l, l_speed);
+    bool reverse_r = motor_bridge_reverses(&motor_bridge_r, r_speed);
 
-    device_control(motor_l[0], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
-    device_control(motor_l[1], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
-    device_control(motor_r[0], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
-    device_control(motor_r[1], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
-    bflb_platform_delay_us(1);
+    if (!moved && (l_speed || r_speed)) {
+        moved = true;
+        boot_profile_mark(BOOT_PHASE_APP_FIRST_MOVE);
+    }
+
+    motor_wait_committed();
+
+    if (reverse_l || reverse_r) {
+        if (reverse_l) {
+            motor_bridge_stage(&motor_bridge_l, 0);
+        }
+        if (reverse_r) {
+            motor_bridge_stage(&motor_bridge_r, 0);
+        }
+        pwm_group_commit(&motor_pwm);
+        motor_wait_committed();
+        bflb_platform_delay_us(MOTOR_DEAD_TIME_US);
+    }
+
+    motor_bridge_stage(&motor_bridge_l, l_speed);
+    motor_bridge_stage(&motor_bridge_r, r_speed);
+    pwm_group_commit(&motor_pwm);
+}
+
+void motor_run(motor_direction_t dir, uint8_t speed)
+{
+    int8_t turn_speed;
 
     if (speed > 100) speed = 100;
 
     if (speed == 100) {
-        speed = 0;
-        turn_speed = 25;
+        turn_speed = 75;
     } else {
-        turn_speed = 100 - (speed / 4);
-        speed = 100 - speed;
+        turn_speed = speed / 4;
     }
 
     switch(dir) {
         case FORWARD:
-            pwm_cfg.threshold_high = speed;
-            device_control(motor_l[0], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
-            device_control(motor_r[0], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
+            motor_set(speed, speed);
             break;
         case BACKWARD:
-            pwm_cfg.threshold_high = speed;
-            device_control(motor_l[1], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
-            device_control(motor_r[1], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
+            motor_set(-speed, -speed);
             break;
         case FORWARD_LEFT:
-            pwm_cfg.threshold_high = turn_speed;
-            device_control(motor_l[0], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
-            pwm_cfg.threshold_high = speed;
-            device_control(motor_r[0], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
+            motor_set(turn_speed, speed);
             break;
         case FORWARD_RIGHT:
-            pwm_cfg.threshold_high = turn_speed;
-            device_control(motor_r[0], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
-            pwm_cfg.threshold_high = speed;
-            device_control(motor_l[0], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
+            motor_set(speed, turn_speed);
             break;
         case BACKWARD_LEFT:
-            pwm_cfg.threshold_high = turn_speed;
-            device_control(motor_l[1], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
-            pwm_cfg.threshold_high = speed;
-            device_control(motor_r[1], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
+            motor_set(-turn_speed, -speed);
             break;
         case BACKWARD_RIGHT:
-            pwm_cfg.threshold_high = turn_speed;
-            device_control(motor_r[1], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
-            pwm_cfg.threshold_high = speed;
-            device_control(motor_l[1], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
+            motor_set(-speed, -turn_speed);
             break;
         case CIRCLE_LEFT:
-            pwm_cfg.threshold_high = speed;
-            device_control(motor_l[1], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
-            device_control(motor_r[0], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
+            motor_set(-speed, speed);
             break;
         case CIRCLE_RIGHT:
-            pwm_cfg.threshold_high = speed;
-            device_control(motor_r[1], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
-            device_control(motor_l[0], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
+            motor_set(speed, -speed);
             break;
         case STOP:
         default:
+            motor_set(0, 0);
             break;
     }
 }
 
 void motor_run_manual(int8_t r_speed, int8_t l_speed)
 {
-    pwm_dutycycle_config_t pwm_cfg = {0, 100};
+    motor_set(l_speed, r_speed);
+}
+
+/*
+ * Emergency cutoff, callable from any task. Both bridges go idle at once
+ * without waiting for a period boundary or a dead time: going idle never
+ * shoots through. A caller preempted halfway through motor_set() will only
+ * stage idle values from here on.
+ */
+void motor_stop_now(void)
+{
+    motor_inhibited = true;
 
-    if (r_speed > 0) {
-        r_speed = 100 - r_speed;
-        l_speed = 100 - l_speed;
+    taskENTER_CRITICAL();
+    motor_bridge_stage(&motor_bridge_l, 0);
+    motor_bridge_stage(&motor_bridge_r, 0);
+    pwm_group_commit_now(&motor_pwm);
+    taskEXIT_CRITICAL();
+}
 
-        pwm_cfg.threshold_high = l_speed;
-        device_control(motor_l[0], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
-        pwm_cfg.threshold_high = r_speed;
-        device_control(motor_r[0], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
-    } else {
-        r_speed = 100 - (r_speed * -1);
-        l_speed = 100 - (l_speed * -1);
-        pwm_cfg.threshold_high = l_speed;
-        device_control(motor_l[1], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
-        pwm_cfg.threshold_high = r_speed;
-        device_control(motor_r[1], DEVICE_CTRL_PWM_DUTYCYCLE_CONFIG, &pwm_cfg);
-    }
-}
\ No newline at end of file
+void motor_release(void)
+{
+    motor_inhibited = false;
+}
+
+bool motor_is_inhibited(void)
+{
+    return motor_inhibited;
+}
+
+const pwm_group_t *motor_get_pwm_group(void)
+{
+    return &motor_pwm;
+}
@@ -1,6 +1,11 @@
 #ifndef MOTOR_H
 #define MOTOR_H
 
+#include "hal_pwm.h"
+
+/* both half bridge inputs are held idle this long when a motor reverses */
+#define MOTOR_DEAD_TIME_US  100
+
 typedef enum {
     FORWARD = 0,
     BACKWARD,
@@ -16,5 +21,9 @@ typedef enum {
 void motor_init(void);
 void motor_run(motor_direction_t dir, uint8_t speed);
 void motor_run_manual(int8_t r_speed, int8_t l_speed);
+void motor_stop_now(void);
+void motor_release(void);
+bool motor_is_inhibited(void);
+const pwm_group_t *motor_get_pwm_group(void);
 
-#endif
\ No newline at end of file
+#endif
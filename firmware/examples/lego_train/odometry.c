@@ -0,0 +1,48 @@
+#include "bflb_platform.h"
+#include "hal_qdec.h"
+#include "odometry.h"
+
+static struct device *wheel_qdec;
+static volatile odometry_t odometry;
+
+/*
+ * The QDEC accumulates wheel edges in hardware and only interrupts once per
+ * report period, so the CPU sees one interrupt per ~5 ms regardless of how
+ * fast the wheel turns.
+ */
+static void odometry_qdec_callback(struct device *dev, void *args, uint32_t size, uint32_t event)
+{
+    if (event == QDEC_REPORT_EVENT) {
+        odometry.ticks += (int16_t)device_control(dev, DEVICE_CTRL_GET_SAMPLE_VAL, NULL);
+        odometry.reports++;
+    } else if (event == QDEC_ERROR_EVENT) {
+        odometry.errors += device_control(dev, DEVICE_CTRL_GET_ERROR_CNT, NULL);
+    } else if (event == QDEC_OVERFLOW_EVENT) {
+        odometry.overflows++;
+    }
+}
+
+void odometry_init(void)
+{
+    qdec_register(QDEC0_INDEX, "wheel_qdec");
+    wheel_qdec = device_find("wheel_qdec");
+
+    if (wheel_qdec) {
+        device_open(wheel_qdec, DEVICE_OFLAG_INT_RX);
+        device_set_callback(wheel_qdec, odometry_qdec_callback);
+        device_control(wheel_qdec, DEVICE_CTRL_SET_INT, (void *)(QDEC_REPORT_EVENT | QDEC_ERROR_EVENT | QDEC_OVERFLOW_EVENT));
+        device_control(wheel_qdec, DEVICE_CTRL_RESUME, NULL);
+    }
+}
+
+int32_t odometry_get_ticks(void)
+{
+    return odometry.ticks;
+}
+
+void odometry_get(odometry_t *odo)
+{
+    CPU_Interrupt_Disable(QDEC0_IRQn);
+    *odo = odometry;
+    CPU_Interrupt_Enable(QDEC0_IRQn);
+}
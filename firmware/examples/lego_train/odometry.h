@@ -0,0 +1,20 @@
+#ifndef ODOMETRY_H
+#define ODOMETRY_H
+
+#include <stdint.h>
+
+/* QDEC0 reports every 64us * 78 samples, i.e. about every 5 ms */
+#define ODOMETRY_REPORT_PERIOD_US   (64 * 78)
+
+typedef struct {
+    int32_t ticks;      /* wheel ticks accumulated since odometry_init */
+    uint32_t reports;   /* QDEC report interrupts taken */
+    uint32_t errors;    /* QDEC invalid transition count */
+    uint32_t overflows; /* QDEC accumulator overflows */
+} odometry_t;
+
+void odometry_init(void);
+int32_t odometry_get_ticks(void);
+void odometry_get(odometry_t *odo);
+
+#endif
@@ -0,0 +1,364 @@
+#include <FreeRTOS.h>
+#include "task.h"
+#include "bflb_platform.h"
+#include "hal_adc.h"
+#include "hal_dma.h"
+#include "bl702_dma.h"
+#include "motor.h"
+#include "odometry.h"
+#include "speed_ctrl.h"
+#include "power_sense.h"
+#include "watchdog.h"
+#include "app_log.h"
+#define DLOG_MODULE APP_LOG_POWER
+#include "dlog.h"
+
+#define POWER_SENSE_VBAT_CHANNEL    ADC_CHANNEL_VABT_HALF
+#define POWER_SENSE_CURRENT_CHANNEL ADC_CHANNEL10
+
+/* 12 bit conversions against the 2V reference */
+#define POWER_SENSE_VREF_MV         2000
+#define POWER_SENSE_ADC_BITS        12
+
+/* filtered values are kept as x += (new - x) / 2^POWER_SENSE_IIR_SHIFT */
+#define POWER_SENSE_IIR_SHIFT       3
+#define POWER_SENSE_AVG_SHIFT       4
+/* a block comes every few ms even at the slowest adc clock */
+#define POWER_SENSE_WDG_MS          500
+
+static StackType_t power_sense_stack[256];
+static StaticTask_t power_sense_task_handle;
+static TaskHandle_t power_sense_task;
+static int power_sense_wdg = -1;
+
+static struct device *sense_adc;
+static struct device *sense_dma;
+
+/* two halves filled alternately by the dma, see DMA_LLI_PINGPONG_MODE */
+static uint32_t power_sense_ring[2 * POWER_SENSE_BLOCK_SAMPLES];
+static volatile uint8_t ready_half;
+static volatile uint8_t pending_blocks;
+static volatile uint64_t ready_us;
+static uint64_t last_ready_us;
+
+/* filtered values scaled by 2^POWER_SENSE_IIR_SHIFT, zero until the first block */
+static uint32_t vbat_filt;
+static uint32_t current_filt;
+static volatile bool tripped = false;
+static int32_t stall_ticks;
+static uint32_t stall_us;
+static power_sense_stats_t sense_stats;
+/* adc clock divider for the task to switch to between two blocks, -1 for none */
+static volatile int8_t clk_div_req = -1;
+
+static void power_sense_start(void);
+static void power_sense_stop(void);
+
+static void power_sense_dma_callback(struct device *dev, void *args, uint32_t size, uint32_t state)
+{
+    BaseType_t woken = pdFALSE;
+
+    if (state != DMA_INT_TCOMPLETED) {
+        return;
+    }
+
+    ready_us = bflb_platform_get_time_us();
+    ready_half = !ready_half;
+
+    if (pending_blocks++) {
+        sense_stats.overruns++;
+    }
+
+    vTaskNotifyGiveFromISR(power_sense_task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static uint32_t power_sense_raw_to_mv(uint32_t raw)
+{
+    return (raw * POWER_SENSE_VREF_MV) >> POWER_SENSE_ADC_BITS;
+}
+
+static uint32_t power_sense_filter(uint32_t *filt, uint32_t val)
+{
+    if (*filt == 0) {
+        *filt = val << POWER_SENSE_IIR_SHIFT;
+    } else {
+        *filt += (int32_t)((val << POWER_SENSE_IIR_SHIFT) - *filt) >> POWER_SENSE_IIR_SHIFT;
+    }
+
+    return *filt >> POWER_SENSE_IIR_SHIFT;
+}
+
+static void power_sense_trip(uint32_t *counter, uint64_t block_ready_us)
+{
+    uint32_t latency;
+
+    motor_stop_now();
+    speed_ctrl_set_target(0);
+    tripped = true;
+
+    /* the offending conversion may have been the first one of the block */
+    latency = (uint32_t)(bflb_platform_get_time_us() - block_ready_us) + sense_stats.block_us;
+
+    (*counter)++;
+    sense_stats.detect_latency_us = latency;
+    if (latency > sense_stats.detect_latency_max_us) {
+        sense_stats.detect_latency_max_us = latency;
+    }
+}
+
+static void power_sense_check_stall(uint32_t current_ma, uint32_t block_us)
+{
+    int32_t ticks = odometry_get_ticks();
+
+    if (!speed_ctrl_is_active() || (current_ma < POWER_SENSE_STALL_MA) || (ticks != stall_ticks)) {
+        stall_ticks = ticks;
+        stall_us = 0;
+        return;
+    }
+
+    stall_us += block_us;
+}
+
+/*
+ * Decimate one half buffer to a single value per channel, then low pass it.
+ * The overcurrent limit is checked against the raw block peak so a short
+ * spike is not averaged away.
+ */
+static void power_sense_process(const uint32_t *block, uint64_t block_ready_us)
+{
+    uint32_t sum[2] = { 0 };
+    uint32_t count[2] = { 0 };
+    uint32_t peak = 0;
+    uint32_t raw;
+    uint32_t peak_ma;
+    uint32_t vbat_mv;
+    uint32_t current_ma;
+
+    for (uint32_t i = 0; i < POWER_SENSE_BLOCK_SAMPLES; i++) {
+        raw = (block[i] & 0xffff) >> 4;
+
+        if ((block[i] >> 21) == POWER_SENSE_VBAT_CHANNEL) {
+            sum[0] += raw;
+            count[0]++;
+        } else if ((block[i] >> 21) == POWER_SENSE_CURRENT_CHANNEL) {
+            sum[1] += raw;
+            count[1]++;
+            if (raw > peak) {
+                peak = raw;
+            }
+        }
+    }
+
+    peak_ma = power_sense_raw_to_mv(peak) * POWER_SENSE_CURRENT_UA_PER_MV / 1000;
+    if (peak_ma > sense_stats.current_peak_ma) {
+        sense_stats.current_peak_ma = peak_ma;
+    }
+
+    if (!tripped && (peak_ma >= POWER_SENSE_OVERCURRENT_MA)) {
+        power_sense_trip(&sense_stats.overcurrent_trips, block_ready_us);
+    }
+
+    if (count[0]) {
+        vbat_mv = power_sense_filter(&vbat_filt, power_sense_raw_to_mv(sum[0] / count[0]) * 2);
+        sense_stats.vbat_mv = vbat_mv;
+    }
+
+    if (count[1]) {
+        current_ma = power_sense_filter(&current_filt, power_sense_raw_to_mv(sum[1] / count[1]) * POWER_SENSE_CURRENT_UA_PER_MV / 1000);
+        sense_stats.current_ma = current_ma;
+
+        power_sense_check_stall(current_ma, sense_stats.block_us);
+        if (!tripped && (stall_us >= POWER_SENSE_STALL_MS * 1000)) {
+            power_sense_trip(&sense_stats.stall_trips, block_ready_us);
+        }
+    }
+}
+
+static void power_sense_update_stats(uint64_t block_ready_us, uint32_t cpu_us)
+{
+    sense_stats.blocks++;
+
+    if (last_ready_us && (block_ready_us > last_ready_us)) {
+        sense_stats.block_us = (uint32_t)(block_ready_us - last_ready_us);
+        sense_stats.sample_rate_hz = (POWER_SENSE_BLOCK_SAMPLES * 1000000) / sense_stats.block_us;
+    }
+    last_ready_us = block_ready_us;
+
+    sense_stats.cpu_us_avg += ((int32_t)cpu_us - (int32_t)sense_stats.cpu_us_avg) >> POWER_SENSE_AVG_SHIFT;
+    if (cpu_us > sense_stats.cpu_us_max) {
+        sense_stats.cpu_us_max = cpu_us;
+    }
+
+    if (sense_stats.block_us) {
+        sense_stats.cpu_load_permille = (sense_stats.cpu_us_avg * 1000) / sense_stats.block_us;
+    }
+}
+
+/* in the task, so that the dma does not restart under a block being processed */
+static void power_sense_apply_clk_div(void)
+{
+    int8_t clk_div;
+
+    taskENTER_CRITICAL();
+    clk_div = clk_div_req;
+    clk_div_req = -1;
+    taskEXIT_CRITICAL();
+
+    power_sense_stop();
+    ADC_DEV(sense_adc)->clk_div = (uint8_t)clk_div;
+    /* a block that completed meanwhile belongs to the old rate */
+    ulTaskNotifyTake(pdTRUE, 0);
+    power_sense_clear_stats();
+    power_sense_start();
+}
+
+static void power_sense_task_entry(void *pvParameters)
+{
+    uint64_t start_us;
+    uint64_t block_ready_us;
+    const uint32_t *block;
+
+    while (1) {
+        /* the adc stops only in pds, which the watchdog leaves out */
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        watchdog_checkin(power_sense_wdg);
+
+        if (clk_div_req >= 0) {
+            power_sense_apply_clk_div();
+            continue;
+        }
+
+        start_us = bflb_platform_get_time_us();
+
+        taskENTER_CRITICAL();
+        /* the half the dma just left; it is now filling the other one */
+        block = &power_sense_ring[ready_half * POWER_SENSE_BLOCK_SAMPLES];
+        block_ready_us = ready_us;
+        pending_blocks = 0;
+        taskEXIT_CRITICAL();
+
+        power_sense_process(block, block_ready_us);
+        power_sense_update_stats(block_ready_us, (uint32_t)(bflb_platform_get_time_us() - start_us));
+    }
+}
+
+static void power_sense_start(void)
+{
+    uint8_t pos_chan[] = { POWER_SENSE_VBAT_CHANNEL, POWER_SENSE_CURRENT_CHANNEL };
+    uint8_t neg_chan[] = { ADC_CHANNEL_GND, ADC_CHANNEL_GND };
+    adc_channel_cfg_t adc_channel_cfg;
+
+    adc_channel_cfg.pos_channel = pos_chan;
+    adc_channel_cfg.neg_channel = neg_chan;
+    adc_channel_cfg.num = 2;
+
+    device_open(sense_adc, DEVICE_OFLAG_DMA_RX);
+    device_control(sense_adc, DEVICE_CTRL_ATTACH_RX_DMA, sense_dma);
+    device_control(sense_adc, DEVICE_CTRL_ADC_VBAT_ON, NULL);
+
+    if (adc_channel_config(sense_adc, &adc_channel_cfg) != SUCCESS) {
+        DLOG_W("adc channel io not configured");
+    }
+
+    /* the first completed half is index 0 */
+    ready_half = 1;
+    pending_blocks = 0;
+    last_ready_us = 0;
+
+    device_read(sense_adc, 0, power_sense_ring, sizeof(power_sense_ring));
+    adc_channel_start(sense_adc);
+}
+
+static void power_sense_stop(void)
+{
+    adc_channel_stop(sense_adc);
+    dma_channel_stop(sense_dma);
+    device_close(sense_adc);
+}
+
+void power_sense_init(void)
+{
+    adc_register(ADC0_INDEX, "power_adc");
+    sense_adc = device_find("power_adc");
+
+    dma_register(DMA0_CH4_INDEX, "power_dma");
+    sense_dma = device_find("power_dma");
+
+    if (!sense_adc || !sense_dma) {
+        return;
+    }
+
+    power_sense_wdg = watchdog_register("power_sense", POWER_SENSE_WDG_MS);
+    power_sense_task = xTaskCreateStatic(power_sense_task_entry, (char *)"power_sense", sizeof(power_sense_stack) / 4, NULL,
+                                         configMAX_PRIORITIES - 1, power_sense_stack, &power_sense_task_handle);
+
+    device_open(sense_dma, 0);
+    device_set_callback(sense_dma, power_sense_dma_callback);
+    device_control(sense_dma, DEVICE_CTRL_SET_INT, NULL);
+
+    power_sense_start();
+}
+
+/* the adc and dma lose their setup in pds, restart them after wake up */
+void power_sense_restart(void)
+{
+    if (!sense_adc || !sense_dma) {
+        return;
+    }
+
+    power_sense_stop();
+    device_close(sense_dma);
+    device_open(sense_dma, 0);
+    device_control(sense_dma, DEVICE_CTRL_SET_INT, NULL);
+    power_sense_start();
+}
+
+/* select the conversion rate, see adc_clk_div_t; the task switches before its next block and clears the statistics */
+int power_sense_set_clk_div(uint8_t clk_div)
+{
+    if (!sense_adc || !power_sense_task || (clk_div > ADC_CLOCK_DIV_32)) {
+        return -1;
+    }
+
+    clk_div_req = (int8_t)clk_div;
+    xTaskNotifyGive(power_sense_task);
+
+    return 0;
+}
+
+uint32_t power_sense_get_vbat_mv(void)
+{
+    return sense_stats.vbat_mv;
+}
+
+uint32_t power_sense_get_current_ma(void)
+{
+    return sense_stats.current_ma;
+}
+
+bool power_sense_is_tripped(void)
+{
+    return tripped;
+}
+
+void power_sense_rearm(void)
+{
+    tripped = false;
+    stall_us = 0;
+    motor_release();
+}
+
+void power_sense_get_stats(power_sense_stats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = sense_stats;
+    taskEXIT_CRITICAL();
+}
+
+void power_sense_clear_stats(void)
+{
+    taskENTER_CRITICAL();
+    memset(&sense_stats, 0, sizeof(sense_stats));
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,46 @@
+#ifndef POWER_SENSE_H
+#define POWER_SENSE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* conversions per dma half buffer, both channels interleaved */
+#define POWER_SENSE_BLOCK_SAMPLES   32
+
+/* motor current sense amplifier output on GPIO20, 1 mV per mA */
+#define POWER_SENSE_CURRENT_UA_PER_MV 1000
+
+/* instantaneous limit, checked on every block */
+#define POWER_SENSE_OVERCURRENT_MA  1500
+/* filtered current above this with a motionless wheel is a stall */
+#define POWER_SENSE_STALL_MA        800
+#define POWER_SENSE_STALL_MS        200
+
+typedef struct {
+    uint32_t blocks;                /* dma half buffers processed */
+    uint32_t overruns;              /* blocks completed before the previous one was processed */
+    uint32_t sample_rate_hz;        /* conversions per second, both channels */
+    uint32_t block_us;              /* time to fill one half buffer */
+    uint32_t cpu_us_avg;            /* processing time per block, running average */
+    uint32_t cpu_us_max;            /* processing time per block, worst case */
+    uint32_t cpu_load_permille;     /* cpu_us_avg / block_us */
+    uint32_t vbat_mv;               /* filtered */
+    uint32_t current_ma;            /* filtered */
+    uint32_t current_peak_ma;       /* highest single conversion since cleared */
+    uint32_t overcurrent_trips;
+    uint32_t stall_trips;
+    uint32_t detect_latency_us;     /* worst case for the last trip: block fill plus processing */
+    uint32_t detect_latency_max_us;
+} power_sense_stats_t;
+
+void power_sense_init(void);
+void power_sense_restart(void);
+int power_sense_set_clk_div(uint8_t clk_div);
+uint32_t power_sense_get_vbat_mv(void);
+uint32_t power_sense_get_current_ma(void);
+bool power_sense_is_tripped(void);
+void power_sense_rearm(void);
+void power_sense_get_stats(power_sense_stats_t *stats);
+void power_sense_clear_stats(void);
+
+#endif
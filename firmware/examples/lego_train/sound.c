@@ -0,0 +1,289 @@
+#include <errno.h>
+#include <FreeRTOS.h>
+#include "task.h"
+#include "bflb_platform.h"
+#include "hal_dac.h"
+#include "hal_dma.h"
+#include "bl702_dma.h"
+#include "hal_flash.h"
+#include "speed_ctrl.h"
+#include "sound_mix.h"
+#include "sound.h"
+#include "watchdog.h"
+#include "app_log.h"
+#define DLOG_MODULE APP_LOG_SOUND
+#include "dlog.h"
+
+/* running averages are kept as x += (new - x) / 2^SOUND_AVG_SHIFT */
+#define SOUND_AVG_SHIFT 4
+/* chuff_acc counts wheel ticks times output samples */
+#define SOUND_CHUFF_THRESHOLD (SOUND_CHUFF_TICKS * SOUND_RATE_HZ)
+/* a dma half is played every 16 ms while streaming */
+#define SOUND_WDG_MS 200
+
+static StackType_t sound_stack[256];
+static StaticTask_t sound_task_handle;
+static TaskHandle_t sound_task;
+static int sound_wdg = -1;
+
+static struct device *sound_dac;
+static struct device *sound_dma;
+static sound_mix_t sound_mix;
+
+/* two halves played alternately by the dma, see DMA_LLI_PINGPONG_MODE; a word per
+ * sample holds the 10 bit value for both dac channels */
+static uint32_t sound_ring[2 * SOUND_BLOCK_SAMPLES];
+static int16_t sound_block[SOUND_BLOCK_SAMPLES];
+static volatile uint8_t free_half;
+static volatile uint8_t pending_blocks;
+/* bit per clip, set by sound_play() and taken by the task */
+static volatile uint8_t play_req;
+static volatile bool streaming;
+static uint32_t chuff_acc;
+static sound_stats_t sound_stats;
+
+static const uint16_t sound_gain[] = {
+    [SOUND_HORN] = 0x6000,
+    [SOUND_CHUFF] = 0x4000,
+    [SOUND_BELL] = 0x5000,
+};
+
+static int sound_bank_read(uint32_t offset, void *buf, uint32_t len)
+{
+    if ((offset > SOUND_BANK_SIZE) || (len > SOUND_BANK_SIZE - offset)) {
+        return -1;
+    }
+
+    return (flash_read(SOUND_BANK_ADDR + offset, buf, len) == SUCCESS) ? 0 : -1;
+}
+
+static void sound_dma_callback(struct device *dev, void *args, uint32_t size, uint32_t state)
+{
+    BaseType_t woken = pdFALSE;
+
+    if (state != DMA_INT_TCOMPLETED) {
+        return;
+    }
+
+    free_half = !free_half;
+
+    if (pending_blocks++) {
+        sound_stats.underruns++;
+    }
+
+    vTaskNotifyGiveFromISR(sound_task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void sound_play_clip(uint8_t clip)
+{
+    sound_mix_play(&sound_mix, clip, (clip < sizeof(sound_gain) / sizeof(sound_gain[0])) ? sound_gain[clip] : 0x4000);
+}
+
+static void sound_render(uint32_t *half)
+{
+    int32_t target = speed_ctrl_get_target();
+    uint32_t speed = (target < 0) ? -target : target;
+    uint32_t done, n, until, v;
+    uint8_t req, i;
+
+    taskENTER_CRITICAL();
+    req = play_req;
+    play_req = 0;
+    taskEXIT_CRITICAL();
+
+    for (i = 0; i < SOUND_MIX_CLIPS_MAX; i++) {
+        if (req & (1 << i)) {
+            sound_play_clip(i);
+        }
+    }
+
+    if (!speed) {
+        /* the first chuff comes as soon as the train is told to move */
+        chuff_acc = SOUND_CHUFF_THRESHOLD;
+    }
+
+    /* split the block where a chuff starts, so the chuffs keep their spacing to the sample */
+    for (done = 0; done < SOUND_BLOCK_SAMPLES; done += n) {
+        n = SOUND_BLOCK_SAMPLES - done;
+
+        if (speed) {
+            if (chuff_acc >= SOUND_CHUFF_THRESHOLD) {
+                chuff_acc -= SOUND_CHUFF_THRESHOLD;
+                sound_play_clip(SOUND_CHUFF);
+                sound_stats.chuffs++;
+            }
+            until = (SOUND_CHUFF_THRESHOLD - chuff_acc + speed - 1) / speed;
+            if (until < n) {
+                n = until;
+            }
+            chuff_acc += speed * n;
+        }
+
+        sound_mix_render(&sound_mix, &sound_block[done], n);
+    }
+
+    for (done = 0; done < SOUND_BLOCK_SAMPLES; done++) {
+        v = (uint32_t)(sound_block[done] + 32768) >> 6;
+        half[done] = v | (v << 16);
+    }
+}
+
+static void sound_update_stats(uint32_t cpu_us)
+{
+    sound_stats.blocks++;
+    sound_stats.block_us = SOUND_BLOCK_SAMPLES * 1000000 / SOUND_RATE_HZ;
+    sound_stats.cpu_us_avg += ((int32_t)cpu_us - (int32_t)sound_stats.cpu_us_avg) >> SOUND_AVG_SHIFT;
+    if (cpu_us > sound_stats.cpu_us_max) {
+        sound_stats.cpu_us_max = cpu_us;
+    }
+    sound_stats.cpu_load_permille = (sound_stats.cpu_us_avg * 1000) / sound_stats.block_us;
+    sound_stats.clipped = sound_mix.clipped;
+    sound_stats.read_errors = sound_mix.read_errors;
+}
+
+static void sound_start(void)
+{
+    /* the dma loses its setup in pds */
+    device_close(sound_dma);
+    device_open(sound_dma, 0);
+    device_set_callback(sound_dma, sound_dma_callback);
+    device_control(sound_dma, DEVICE_CTRL_SET_INT, NULL);
+
+    device_open(sound_dac, DEVICE_OFLAG_DMA_TX);
+    device_control(sound_dac, DEVICE_CTRL_ATTACH_TX_DMA, sound_dma);
+
+    /* the dma plays half 0 first, the first one to free */
+    free_half = 1;
+    pending_blocks = 0;
+    sound_render(&sound_ring[0]);
+    sound_render(&sound_ring[SOUND_BLOCK_SAMPLES]);
+
+    streaming = true;
+    device_write(sound_dac, 0, sound_ring, sizeof(sound_ring));
+}
+
+static void sound_stop(void)
+{
+    dma_channel_stop(sound_dma);
+    device_close(sound_dac);
+    streaming = false;
+}
+
+static void sound_task_entry(void *pvParameters)
+{
+    uint64_t start_us;
+    uint32_t *half;
+    uint8_t silent;
+
+    while (1) {
+        /* idle until a clip is asked for or the train is told to move */
+        while (!play_req && !speed_ctrl_get_target()) {
+            watchdog_block(sound_wdg);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            watchdog_checkin(sound_wdg);
+        }
+
+        sound_start();
+
+        /* the last sounding half still plays while two silent ones are rendered after it */
+        for (silent = 0; silent < 3;) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            watchdog_checkin(sound_wdg);
+
+            /* a request, it is taken with the next block */
+            if (!pending_blocks) {
+                continue;
+            }
+
+            start_us = bflb_platform_get_time_us();
+
+            taskENTER_CRITICAL();
+            half = &sound_ring[free_half * SOUND_BLOCK_SAMPLES];
+            pending_blocks = 0;
+            taskEXIT_CRITICAL();
+
+            sound_render(half);
+            sound_update_stats((uint32_t)(bflb_platform_get_time_us() - start_us));
+
+            if (sound_mix_is_active(&sound_mix) || play_req || speed_ctrl_get_target()) {
+                silent = 0;
+            } else {
+                silent++;
+            }
+        }
+
+        sound_stop();
+    }
+}
+
+void sound_init(void)
+{
+    int err;
+
+    dac_register(DAC0_INDEX, "sound_dac");
+    sound_dac = device_find("sound_dac");
+
+    dma_register(DMA0_CH3_INDEX, "sound_dma");
+    sound_dma = device_find("sound_dma");
+
+    if (!sound_dac || !sound_dma) {
+        return;
+    }
+
+    /* fails unless the pin is analog, see CONFIG_GPIO17_FUNC */
+    if (device_open(sound_dac, DEVICE_OFLAG_DMA_TX) != 0) {
+        DLOG_W("dac did not open");
+        return;
+    }
+    device_close(sound_dac);
+
+    err = sound_mix_init(&sound_mix, sound_bank_read, SOUND_RATE_HZ);
+    if (err) {
+        /* an erased partition until the bank is flashed */
+        DLOG_W("no sound bank at 0x%x, err %d", SOUND_BANK_ADDR, err);
+        return;
+    }
+
+    DLOG_I("%u clips", sound_mix.clip_count);
+
+    sound_wdg = watchdog_register("sound", SOUND_WDG_MS);
+    sound_task = xTaskCreateStatic(sound_task_entry, (char *)"sound", sizeof(sound_stack) / 4, NULL,
+                                   2, sound_stack, &sound_task_handle);
+}
+
+/* queue a clip for the next block; -EINVAL without a bank or for a clip it lacks */
+int sound_play(uint8_t clip)
+{
+    if (!sound_task || (clip >= sound_mix.clip_count)) {
+        return -EINVAL;
+    }
+
+    taskENTER_CRITICAL();
+    play_req |= 1 << clip;
+    taskEXIT_CRITICAL();
+
+    xTaskNotifyGive(sound_task);
+
+    return 0;
+}
+
+/* the commanded speed changed, a stopped engine starts chuffing */
+void sound_wake(void)
+{
+    if (sound_task) {
+        xTaskNotifyGive(sound_task);
+    }
+}
+
+bool sound_is_active(void)
+{
+    return streaming || play_req;
+}
+
+void sound_get_stats(sound_stats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = sound_stats;
+    taskEXIT_CRITICAL();
+}
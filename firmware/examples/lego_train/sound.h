@@ -0,0 +1,43 @@
+#ifndef SOUND_H
+#define SOUND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* clips of the bank written by tools/sound/sound_pack.py */
+#define SOUND_HORN  0
+#define SOUND_CHUFF 1
+#define SOUND_BELL  2
+
+/* the bank sits in the first half of the media partition of partition_cfg_1M_boot2_ble.toml */
+#define SOUND_BANK_ADDR 0xFB000
+#define SOUND_BANK_SIZE 0x2000
+
+/* dac channel B on GPIO17, see DAC_CONFIG of the board */
+#define SOUND_DAC_PIN       17
+#define SOUND_RATE_HZ       16000
+/* output samples per dma half buffer, 16 ms */
+#define SOUND_BLOCK_SAMPLES 256
+
+/* wheel ticks between two chuffs at the commanded speed */
+#define SOUND_CHUFF_TICKS   40
+
+typedef struct {
+    uint32_t blocks;            /* dma half buffers rendered */
+    uint32_t underruns;         /* halves played again before they were rendered */
+    uint32_t block_us;          /* time to play one half buffer */
+    uint32_t cpu_us_avg;        /* render time per block, running average */
+    uint32_t cpu_us_max;        /* render time per block, worst case */
+    uint32_t cpu_load_permille; /* cpu_us_avg / block_us */
+    uint32_t chuffs;
+    uint32_t clipped;           /* samples that saturated in the mix */
+    uint32_t read_errors;       /* failed bank reads, the voice stops */
+} sound_stats_t;
+
+void sound_init(void);
+int sound_play(uint8_t clip);
+void sound_wake(void);
+bool sound_is_active(void);
+void sound_get_stats(sound_stats_t *stats);
+
+#endif
@@ -0,0 +1,248 @@
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include "sound_mix.h"
+
+static const int16_t adpcm_steps[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+    107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871,
+    5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+    27086, 29794, 32767
+};
+
+static const int8_t adpcm_index_adjust[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static int16_t sound_mix_saturate(int32_t v)
+{
+    if (v > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (v < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)v;
+}
+
+static int16_t sound_mix_adpcm_decode(sound_voice_t *voice, uint8_t code)
+{
+    int32_t step = adpcm_steps[voice->index];
+    int32_t diff = step >> 3;
+    int32_t index;
+
+    if (code & 4) {
+        diff += step;
+    }
+    if (code & 2) {
+        diff += step >> 1;
+    }
+    if (code & 1) {
+        diff += step >> 2;
+    }
+
+    voice->predictor = sound_mix_saturate(voice->predictor + ((code & 8) ? -diff : diff));
+
+    index = voice->index + adpcm_index_adjust[code & 7];
+    voice->index = (index < 0) ? 0 : ((index > 88) ? 88 : index);
+
+    return voice->predictor;
+}
+
+static bool sound_mix_fill(sound_mix_t *mix, sound_voice_t *voice)
+{
+    const sound_bank_clip_t *clip = &mix->clips[voice->clip];
+    uint32_t end = clip->offset + 4 + (clip->samples + 1) / 2;
+    uint32_t len;
+
+    if (clip->format == SOUND_FMT_PCM16) {
+        end = clip->offset + clip->samples * 2;
+    }
+
+    len = end - voice->offset;
+    if (len > SOUND_MIX_CHUNK) {
+        len = SOUND_MIX_CHUNK;
+    }
+
+    if (!len || mix->read(voice->offset, voice->chunk, len)) {
+        mix->read_errors += (len != 0);
+        return false;
+    }
+
+    voice->offset += len;
+    voice->chunk_pos = 0;
+    voice->chunk_len = len;
+    return true;
+}
+
+/* the next clip sample, false at the end of the clip */
+static bool sound_mix_next(sound_mix_t *mix, sound_voice_t *voice, int16_t *sample)
+{
+    uint8_t byte;
+
+    if (voice->pos >= mix->clips[voice->clip].samples) {
+        return false;
+    }
+
+    if ((voice->chunk_pos >= voice->chunk_len) && !sound_mix_fill(mix, voice)) {
+        return false;
+    }
+
+    if (mix->clips[voice->clip].format == SOUND_FMT_PCM16) {
+        /* clip data and chunks hold whole samples */
+        *sample = (int16_t)(voice->chunk[voice->chunk_pos] | (voice->chunk[voice->chunk_pos + 1] << 8));
+        voice->chunk_pos += 2;
+    } else {
+        byte = voice->chunk[voice->chunk_pos];
+        *sample = sound_mix_adpcm_decode(voice, voice->nibble ? (byte >> 4) : (byte & 0x0f));
+        voice->nibble ^= 1;
+        if (!voice->nibble) {
+            voice->chunk_pos++;
+        }
+    }
+
+    voice->pos++;
+    return true;
+}
+
+int sound_mix_init(sound_mix_t *mix, sound_read_t read, uint16_t rate)
+{
+    sound_bank_header_t header;
+    uint8_t i;
+
+    memset(mix, 0, sizeof(*mix));
+    mix->read = read;
+    mix->rate = rate;
+
+    if (read(0, &header, sizeof(header)) || (header.magic != SOUND_BANK_MAGIC) ||
+        (header.count > SOUND_MIX_CLIPS_MAX)) {
+        return -EINVAL;
+    }
+
+    if (read(sizeof(header), mix->clips, header.count * sizeof(sound_bank_clip_t))) {
+        return -EIO;
+    }
+
+    for (i = 0; i < header.count; i++) {
+        if ((mix->clips[i].rate == 0) || (mix->clips[i].rate > rate) || (mix->clips[i].format > SOUND_FMT_ADPCM)) {
+            return -EINVAL;
+        }
+    }
+
+    mix->clip_count = header.count;
+    return 0;
+}
+
+int sound_mix_play(sound_mix_t *mix, uint8_t clip, uint16_t gain)
+{
+    sound_voice_t *voice = NULL;
+    sound_voice_t *v;
+    uint8_t state[4];
+
+    if (clip >= mix->clip_count) {
+        return -EINVAL;
+    }
+
+    /* the voice of the same clip, else a free one, else the one furthest into its clip */
+    for (v = mix->voices; v < mix->voices + SOUND_MIX_VOICES; v++) {
+        if (v->active && (v->clip == clip)) {
+            voice = v;
+            break;
+        }
+        if (!voice || (voice->active && (!v->active || (v->pos > voice->pos)))) {
+            voice = v;
+        }
+    }
+
+    voice->active = false;
+    voice->clip = clip;
+    voice->gain = gain;
+    voice->step = ((uint32_t)mix->clips[clip].rate << 16) / mix->rate;
+    voice->pos = 0;
+    voice->offset = mix->clips[clip].offset;
+    voice->chunk_pos = 0;
+    voice->chunk_len = 0;
+    voice->nibble = 0;
+    voice->prev = 0;
+    voice->cur = 0;
+
+    if (mix->clips[clip].format == SOUND_FMT_ADPCM) {
+        if (mix->read(voice->offset, state, sizeof(state))) {
+            mix->read_errors++;
+            return -EIO;
+        }
+        voice->predictor = (int16_t)(state[0] | (state[1] << 8));
+        voice->index = (state[2] > 88) ? 88 : state[2];
+        voice->offset += sizeof(state);
+    }
+
+    /* the first sample is reached after one step */
+    voice->phase = 0x10000 - voice->step;
+    voice->active = true;
+
+    return voice - mix->voices;
+}
+
+void sound_mix_stop(sound_mix_t *mix, uint8_t clip)
+{
+    sound_voice_t *v;
+
+    for (v = mix->voices; v < mix->voices + SOUND_MIX_VOICES; v++) {
+        if (v->clip == clip) {
+            v->active = false;
+        }
+    }
+}
+
+bool sound_mix_is_active(const sound_mix_t *mix)
+{
+    const sound_voice_t *v;
+
+    for (v = mix->voices; v < mix->voices + SOUND_MIX_VOICES; v++) {
+        if (v->active) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void sound_mix_render(sound_mix_t *mix, int16_t *out, uint32_t count)
+{
+    int32_t acc[64];
+    sound_voice_t *v;
+    uint32_t done, n, i;
+    int32_t s;
+
+    /* a block of the output at a time, each voice adds its whole block before the next one runs */
+    for (done = 0; done < count; done += n) {
+        n = count - done;
+        if (n > sizeof(acc) / sizeof(acc[0])) {
+            n = sizeof(acc) / sizeof(acc[0]);
+        }
+        memset(acc, 0, n * sizeof(acc[0]));
+
+        for (v = mix->voices; v < mix->voices + SOUND_MIX_VOICES; v++) {
+            for (i = 0; v->active && (i < n); i++) {
+                v->phase += v->step;
+                while (v->phase >= 0x10000) {
+                    v->phase -= 0x10000;
+                    v->prev = v->cur;
+                    if (!sound_mix_next(mix, v, &v->cur)) {
+                        v->active = false;
+                        break;
+                    }
+                }
+
+                /* linear interpolation up to the output rate */
+                s = v->prev + (((v->cur - v->prev) * (int32_t)(v->phase >> 1)) >> 15);
+                acc[i] += (s * v->gain) >> 15;
+            }
+        }
+
+        for (i = 0; i < n; i++) {
+            s = sound_mix_saturate(acc[i]);
+            mix->clipped += (s != acc[i]);
+            out[done + i] = s;
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef SOUND_MIX_H
+#define SOUND_MIX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Fixed point mixer for short clips, free of hal calls so that a host build
+ * (tools/sound/sound_host.c) runs the same code. Clips come from a bank that
+ * tools/sound/sound_pack.py writes: a header, a clip table and the sample data.
+ * The mixer pulls the data through a read callback a chunk at a time, so a bank
+ * in flash is never mapped or copied whole.
+ */
+
+#define SOUND_BANK_MAGIC    0x31444E53 /* "SND1" */
+
+#define SOUND_FMT_PCM16     0 /* signed 16 bit, little endian */
+#define SOUND_FMT_ADPCM     1 /* IMA ADPCM, 4 bit, low nibble first, after a 4 byte start state */
+
+#define SOUND_MIX_CLIPS_MAX 8
+#define SOUND_MIX_VOICES    4
+/* clip bytes staged per voice, one flash read covers 128 ADPCM samples */
+#define SOUND_MIX_CHUNK     64
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t count;
+    uint16_t reserved;
+} sound_bank_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t offset;  /* from the start of the bank */
+    uint32_t samples;
+    uint16_t rate;    /* Hz, up to the output rate */
+    uint8_t format;   /* SOUND_FMT_ */
+    uint8_t reserved;
+} sound_bank_clip_t;
+
+/* copies len bytes at offset of the bank into buf, 0 on success */
+typedef int (*sound_read_t)(uint32_t offset, void *buf, uint32_t len);
+
+typedef struct {
+    bool active;
+    uint8_t clip;
+    uint16_t gain;      /* Q15 */
+    uint32_t step;      /* clip samples per output sample, Q16 */
+    uint32_t phase;     /* between prev and cur, Q16 */
+    uint32_t pos;       /* clip samples decoded */
+    uint32_t offset;    /* bank offset of the next chunk */
+    int16_t prev;
+    int16_t cur;
+    int16_t predictor;  /* ADPCM state */
+    uint8_t index;
+    uint8_t nibble;     /* ADPCM nibbles used of the current byte */
+    uint8_t chunk_pos;
+    uint8_t chunk_len;
+    uint8_t chunk[SOUND_MIX_CHUNK];
+} sound_voice_t;
+
+typedef struct {
+    sound_read_t read;
+    uint16_t rate;      /* output, Hz */
+    uint8_t clip_count;
+    sound_bank_clip_t clips[SOUND_MIX_CLIPS_MAX];
+    sound_voice_t voices[SOUND_MIX_VOICES];
+    uint32_t clipped;   /* output samples that saturated */
+    uint32_t read_errors;
+} sound_mix_t;
+
+int sound_mix_init(sound_mix_t *mix, sound_read_t read, uint16_t rate);
+/* starts a clip at gain (Q15), restarting a voice that plays it already; returns the voice */
+int sound_mix_play(sound_mix_t *mix, uint8_t clip, uint16_t gain);
+void sound_mix_stop(sound_mix_t *mix, uint8_t clip);
+bool sound_mix_is_active(const sound_mix_t *mix);
+/* mixes the next count output samples; silence when no voice plays */
+void sound_mix_render(sound_mix_t *mix, int16_t *out, uint32_t count);
+
+#endif
@@ -0,0 +1,411 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include "task.h"
+#include "bflb_platform.h"
+#include "risc-v/Core/Include/riscv_encoding.h"
+/* common/pid, not the local float pid.h; the float pid is only run by speed_ctrl_bench() */
+#include "../../common/pid/pid.h"
+#include "pid_q.h"
+#include "autotune.h"
+#include "gain_store.h"
+#include "motor.h"
+#include "odometry.h"
+#include "power_sense.h"
+#include "speed_ctrl.h"
+#include "speed_loop.h"
+#include "watchdog.h"
+#include "app_log.h"
+#define DLOG_MODULE APP_LOG_SPEED
+#include "dlog.h"
+
+/* relay autotune, see autotune.h: the pid holds the setpoint this long before the relay takes over */
+#define SPEED_CTRL_TUNE_SETTLE_MS     1000
+#define SPEED_CTRL_TUNE_MAX_OUT       80
+#define SPEED_CTRL_TUNE_MAX_SETPOINT  1500
+#define SPEED_CTRL_TUNE_MAX_RELAY     40
+/* the relay sees the ticks of this many steps, a 10 ms count is too coarse to switch on */
+#define SPEED_CTRL_TUNE_WINDOW        4
+#define SPEED_CTRL_TUNE_HYSTERESIS    (2 * 1000 / (SPEED_CTRL_TUNE_WINDOW * SPEED_CTRL_PERIOD_MS))
+#define SPEED_CTRL_TUNE_MAX_DEVIATION 600
+#define SPEED_CTRL_TUNE_TIMEOUT_MS    15000
+/* ticks that stop while the relay drives: a stall, a cutoff or a lost encoder */
+#define SPEED_CTRL_TUNE_NO_SIGNAL_MS  1000
+/* the rule tools/autotune/autotune_sim.c settles fastest with on the simulated trains */
+#define SPEED_CTRL_TUNE_RULE          AUTOTUNE_RULE_ZN_PI
+/* calls per batch of speed_ctrl_bench(), the quickest of the batches is kept */
+#define SPEED_CTRL_BENCH_CALLS   64
+#define SPEED_CTRL_BENCH_BATCHES 4
+/* fifty periods, or the flash write of tuned gains */
+#define SPEED_CTRL_WDG_MS 500
+
+static StackType_t speed_ctrl_stack[256];
+static StaticTask_t speed_ctrl_task_handle;
+static TaskHandle_t speed_ctrl_task;
+static int speed_ctrl_wdg = -1;
+
+static pid_q_alg_t speed_pid;
+static volatile int32_t target_speed = 0;
+static int8_t last_duty = 0;
+static speed_ctrl_stats_t speed_stats;
+
+enum {
+    SPEED_TUNE_IDLE,
+    SPEED_TUNE_SETTLE,
+    SPEED_TUNE_RELAY,
+};
+
+static autotune_gains_t speed_gains = { SPEED_CTRL_KP, SPEED_CTRL_KI, SPEED_CTRL_KD };
+static autotune_t speed_tune;
+static speed_ctrl_tune_t tune_info;
+static volatile uint8_t tune_phase;
+static volatile bool tune_abort_req;
+static uint8_t tune_relay;
+static uint32_t tune_steps;
+static bool tune_save;
+/* ticks of the last SPEED_CTRL_TUNE_WINDOW steps */
+static int32_t tune_window[SPEED_CTRL_TUNE_WINDOW];
+static uint8_t tune_window_pos;
+
+static void speed_ctrl_output(int8_t duty)
+{
+    /* motor.c inserts the dead time itself when the direction reverses */
+    if ((duty != 0) || (last_duty != 0)) {
+        motor_run_manual(duty, duty);
+    }
+
+    last_duty = duty;
+}
+
+static void speed_ctrl_reset(void)
+{
+    speed_loop_reset(&speed_pid, &speed_gains);
+}
+
+/* cycles per call of the float pid this loop used to run and of the fixed point one */
+static void speed_ctrl_bench(void)
+{
+    static const int16_t velocity[8] = { 0, 140, 260, 330, 310, 290, 305, 298 };
+    pid_alg_t float_pid;
+    volatile float float_out;
+    volatile q31_t q_out;
+    uint32_t float_cycles = UINT32_MAX;
+    uint32_t q_cycles = UINT32_MAX;
+    uint32_t start, cycles;
+    uint32_t i, j;
+
+    pid_init(&float_pid);
+    float_pid.kp = SPEED_CTRL_KP;
+    float_pid.ki = SPEED_CTRL_KI;
+    float_pid.kd = SPEED_CTRL_KD;
+    float_pid.max_val = SPEED_CTRL_MAX_OUT;
+    float_pid.min_val = -SPEED_CTRL_MAX_OUT;
+
+    /* an interrupt only lengthens the batch it lands in */
+    for (i = 0; i < SPEED_CTRL_BENCH_BATCHES; i++) {
+        start = read_csr(mcycle);
+        for (j = 0; j < SPEED_CTRL_BENCH_CALLS; j++) {
+            float_out = feedback_pid_cal(&float_pid, 300.0f, (float)velocity[j & 7]);
+        }
+        cycles = read_csr(mcycle) - start;
+        float_cycles = (cycles < float_cycles) ? cycles : float_cycles;
+
+        start = read_csr(mcycle);
+        for (j = 0; j < SPEED_CTRL_BENCH_CALLS; j++) {
+            q_out = feedback_pid_q_cal(&speed_pid, q31_from_int(300, SPEED_CTRL_IN_BITS),
+                                       q31_from_int(velocity[j & 7], SPEED_CTRL_IN_BITS));
+        }
+        cycles = read_csr(mcycle) - start;
+        q_cycles = (cycles < q_cycles) ? cycles : q_cycles;
+    }
+
+    (void)float_out;
+    (void)q_out;
+    speed_ctrl_reset();
+
+    DLOG_I("pid: %u cycles float, %u cycles q31", float_cycles / SPEED_CTRL_BENCH_CALLS,
+           q_cycles / SPEED_CTRL_BENCH_CALLS);
+}
+
+static void speed_ctrl_set_gains(const autotune_gains_t *gains, uint8_t source)
+{
+    taskENTER_CRITICAL();
+    speed_gains = *gains;
+    tune_info.source = source;
+    tune_info.kp = gains->kp;
+    tune_info.ki = gains->ki;
+    tune_info.kd = gains->kd;
+    taskEXIT_CRITICAL();
+}
+
+static void speed_ctrl_tune_start(int32_t target, int32_t bias)
+{
+    autotune_cfg_t cfg = {
+        .setpoint = target,
+        .bias = bias,
+        .relay = tune_relay,
+        .hysteresis = SPEED_CTRL_TUNE_HYSTERESIS,
+        .max_out = SPEED_CTRL_TUNE_MAX_OUT,
+        .max_deviation = SPEED_CTRL_TUNE_MAX_DEVIATION,
+        .timeout_steps = SPEED_CTRL_TUNE_TIMEOUT_MS / SPEED_CTRL_PERIOD_MS,
+        .no_signal_steps = SPEED_CTRL_TUNE_NO_SIGNAL_MS / SPEED_CTRL_PERIOD_MS,
+        .settle_cycles = 3,
+        .cycles = 4,
+    };
+
+    /* a reverse run is the same experiment on the negated speed */
+    if (target < 0) {
+        cfg.setpoint = -target;
+        cfg.bias = -bias;
+    }
+
+    autotune_start(&speed_tune, &cfg);
+    tune_phase = SPEED_TUNE_RELAY;
+}
+
+static void speed_ctrl_tune_finish(void)
+{
+    autotune_gains_t gains;
+    float ku, tu;
+
+    tune_info.state = speed_tune.state;
+
+    if (autotune_result(&speed_tune, &ku, &tu) == 0) {
+        autotune_gains(ku, tu, SPEED_CTRL_TUNE_RULE, &gains);
+        tune_info.ku = ku;
+        tune_info.tu_ms = (uint16_t)(tu * SPEED_CTRL_PERIOD_MS);
+        speed_ctrl_set_gains(&gains, SPEED_CTRL_GAINS_TUNED);
+        /* written once the motor is stopped, an erase stalls everything that runs from flash */
+        tune_save = true;
+    }
+
+    /* ku and the gains in 1/10000 duty per tick/s */
+    DLOG_I("autotune: state %u after %u ms, ku %d, tu %u ms, kp %d ki %d", speed_tune.state,
+           speed_tune.step * SPEED_CTRL_PERIOD_MS, (int)(tune_info.ku * 10000), tune_info.tu_ms,
+           (int)(speed_gains.kp * 10000), (int)(speed_gains.ki * 10000));
+
+    tune_phase = SPEED_TUNE_IDLE;
+    speed_ctrl_reset();
+
+    /* the train stops after the experiment, unless a speed command ended it */
+    if (!tune_abort_req) {
+        target_speed = 0;
+    }
+    tune_abort_req = false;
+}
+
+/* the velocity over the tune window, from the ticks of this step */
+static int32_t speed_ctrl_window_velocity(int32_t ticks)
+{
+    int32_t velocity = (ticks - tune_window[tune_window_pos]) *
+                       (1000 / (SPEED_CTRL_TUNE_WINDOW * SPEED_CTRL_PERIOD_MS));
+
+    tune_window[tune_window_pos] = ticks;
+    tune_window_pos = (tune_window_pos + 1) % SPEED_CTRL_TUNE_WINDOW;
+
+    return velocity;
+}
+
+static void speed_ctrl_task_entry(void *pvParameters)
+{
+    TickType_t last_wake;
+    uint64_t expected_us;
+    uint64_t wake_us;
+    int32_t ticks;
+    int32_t last_ticks;
+    int32_t velocity;
+    int32_t target;
+    int32_t window_velocity;
+    int32_t out;
+    int err;
+    uint8_t i;
+
+    while (1) {
+        /* idle until a non-zero speed is commanded */
+        while (target_speed == 0) {
+            speed_ctrl_output(0);
+            speed_ctrl_reset();
+
+            if (tune_save) {
+                tune_save = false;
+                err = gain_store_save(GAIN_STORE_SPEED, &speed_gains);
+                if (err) {
+                    DLOG_W("autotune: gains not saved (%d)", err);
+                }
+            }
+
+            watchdog_block(speed_ctrl_wdg);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            watchdog_checkin(speed_ctrl_wdg);
+        }
+
+        last_ticks = odometry_get_ticks();
+        last_wake = xTaskGetTickCount();
+        expected_us = bflb_platform_get_time_us();
+
+        for (i = 0; i < SPEED_CTRL_TUNE_WINDOW; i++) {
+            tune_window[i] = last_ticks;
+        }
+
+        while ((target = target_speed) != 0) {
+            vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(SPEED_CTRL_PERIOD_MS));
+            watchdog_checkin(speed_ctrl_wdg);
+            expected_us += SPEED_CTRL_PERIOD_MS * 1000;
+            wake_us = bflb_platform_get_time_us();
+
+            ticks = odometry_get_ticks();
+            velocity = (ticks - last_ticks) * (1000 / SPEED_CTRL_PERIOD_MS);
+            last_ticks = ticks;
+            window_velocity = speed_ctrl_window_velocity(ticks);
+
+            if (tune_abort_req && (tune_phase != SPEED_TUNE_IDLE)) {
+                autotune_abort(&speed_tune);
+                speed_ctrl_tune_finish();
+            }
+
+            /* changing direction restarts the loop from rest */
+            if ((target > 0) != (speed_pid.set_val > 0)) {
+                speed_ctrl_reset();
+            }
+
+            if (tune_phase == SPEED_TUNE_RELAY) {
+                out = autotune_step(&speed_tune, (target < 0) ? -window_velocity : window_velocity);
+                out = (target < 0) ? -out : out;
+                if (speed_tune.state != AUTOTUNE_RUNNING) {
+                    speed_ctrl_tune_finish();
+                }
+                speed_ctrl_output((int8_t)out);
+            } else {
+                out = speed_loop_pid(&speed_pid, target, velocity);
+                speed_ctrl_output((int8_t)speed_loop_sag_compensate(out, power_sense_get_vbat_mv()));
+
+                /* the relay starts from the duty that holds the setpoint */
+                if ((tune_phase == SPEED_TUNE_SETTLE) &&
+                    (++tune_steps >= SPEED_CTRL_TUNE_SETTLE_MS / SPEED_CTRL_PERIOD_MS)) {
+                    speed_ctrl_tune_start(target, out);
+                }
+            }
+
+            speed_loop_update_stats(&speed_stats, target, velocity,
+                                    (uint32_t)(bflb_platform_get_time_us() - wake_us),
+                                    (wake_us > expected_us) ? (uint32_t)(wake_us - expected_us) : 0);
+        }
+    }
+}
+
+void speed_ctrl_init(void)
+{
+    autotune_gains_t gains;
+
+    odometry_init();
+
+    if (gain_store_load(GAIN_STORE_SPEED, &gains) == 0) {
+        speed_ctrl_set_gains(&gains, SPEED_CTRL_GAINS_STORED);
+    } else {
+        speed_ctrl_set_gains(&speed_gains, SPEED_CTRL_GAINS_DEFAULT);
+    }
+
+    speed_ctrl_reset();
+    speed_ctrl_bench();
+
+    speed_ctrl_wdg = watchdog_register("speed_ctrl", SPEED_CTRL_WDG_MS);
+    speed_ctrl_task = xTaskCreateStatic(speed_ctrl_task_entry, (char *)"speed_ctrl", sizeof(speed_ctrl_stack) / 4, NULL,
+                                        configMAX_PRIORITIES - 2, speed_ctrl_stack, &speed_ctrl_task_handle);
+}
+
+static void speed_ctrl_start(int32_t ticks_per_s)
+{
+    int32_t prev = target_speed;
+
+    target_speed = ticks_per_s;
+    DLOG_D("target %d ticks/s", ticks_per_s);
+
+    if ((prev == 0) && (ticks_per_s != 0) && speed_ctrl_task) {
+        xTaskNotifyGive(speed_ctrl_task);
+    }
+}
+
+void speed_ctrl_set_target(int32_t ticks_per_s)
+{
+    /* a speed command takes the motor back from an autotune run */
+    if (tune_phase != SPEED_TUNE_IDLE) {
+        tune_abort_req = true;
+    }
+
+    speed_ctrl_start(ticks_per_s);
+}
+
+int speed_ctrl_autotune(int32_t ticks_per_s, uint8_t relay_duty)
+{
+    if ((ticks_per_s == 0) || (ticks_per_s > SPEED_CTRL_TUNE_MAX_SETPOINT) ||
+        (ticks_per_s < -SPEED_CTRL_TUNE_MAX_SETPOINT) || (relay_duty == 0) ||
+        (relay_duty > SPEED_CTRL_TUNE_MAX_RELAY)) {
+        return -EINVAL;
+    }
+
+    if (tune_phase != SPEED_TUNE_IDLE) {
+        return -EBUSY;
+    }
+
+    /* running from here, so that a speed command during the settle phase aborts it */
+    memset(&speed_tune, 0, sizeof(speed_tune));
+    speed_tune.state = AUTOTUNE_RUNNING;
+    tune_relay = relay_duty;
+    tune_steps = 0;
+    tune_abort_req = false;
+    tune_info.state = AUTOTUNE_RUNNING;
+    tune_phase = SPEED_TUNE_SETTLE;
+    speed_ctrl_start(ticks_per_s);
+
+    return 0;
+}
+
+int speed_ctrl_clear_gains(void)
+{
+    const autotune_gains_t defaults = { SPEED_CTRL_KP, SPEED_CTRL_KI, SPEED_CTRL_KD };
+
+    /* the erase would stall a running loop */
+    if ((tune_phase != SPEED_TUNE_IDLE) || (target_speed != 0)) {
+        return -EBUSY;
+    }
+
+    speed_ctrl_set_gains(&defaults, SPEED_CTRL_GAINS_DEFAULT);
+    return gain_store_erase(GAIN_STORE_SPEED);
+}
+
+void speed_ctrl_get_tune(speed_ctrl_tune_t *tune)
+{
+    taskENTER_CRITICAL();
+    *tune = tune_info;
+    taskEXIT_CRITICAL();
+}
+
+int32_t speed_ctrl_get_target(void)
+{
+    return target_speed;
+}
+
+bool speed_ctrl_is_active(void)
+{
+    return (target_speed != 0) || (last_duty != 0);
+}
+
+void speed_ctrl_get_stats(speed_ctrl_stats_t *stats)
+{
+    const pwm_group_t *pwm = motor_get_pwm_group();
+
+    taskENTER_CRITICAL();
+    *stats = speed_stats;
+    stats->pwm_commits = pwm->commits;
+    stats->pwm_reg_writes = pwm->reg_writes;
+    stats->pwm_latency_max_us = pwm->max_latency_us;
+    taskEXIT_CRITICAL();
+}
+
+void speed_ctrl_clear_stats(void)
+{
+    taskENTER_CRITICAL();
+    memset(&speed_stats, 0, sizeof(speed_stats));
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,54 @@
+#ifndef SPEED_CTRL_H
+#define SPEED_CTRL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SPEED_CTRL_PERIOD_MS 10
+
+typedef struct {
+    uint32_t loops;          /* control loop iterations since start */
+    uint32_t latency_avg_us; /* wake-up to PWM update, running average */
+    uint32_t latency_max_us; /* wake-up to PWM update, worst case */
+    uint32_t jitter_max_us;  /* late wake-up against the fixed schedule */
+    int32_t target;          /* commanded speed, ticks/s */
+    int32_t velocity;        /* measured speed, ticks/s */
+    uint32_t error_avg;      /* |target - velocity|, running average */
+    uint32_t error_max;      /* |target - velocity|, worst case */
+    uint32_t pwm_commits;    /* grouped motor pwm updates */
+    uint32_t pwm_reg_writes; /* pwm threshold registers written by those updates */
+    uint32_t pwm_latency_max_us; /* pwm commit to register write, worst case */
+} speed_ctrl_stats_t;
+
+/* speed_ctrl_tune_t.source */
+#define SPEED_CTRL_GAINS_DEFAULT 0
+#define SPEED_CTRL_GAINS_STORED  1
+#define SPEED_CTRL_GAINS_TUNED   2
+
+typedef struct {
+    uint8_t state;  /* autotune_state_t of the last run */
+    uint8_t source; /* of the gains in use, SPEED_CTRL_GAINS_ */
+    uint16_t tu_ms; /* ultimate period of the last run that finished */
+    float ku;       /* ultimate gain of that run, duty per tick/s */
+    float kp;       /* gains in use, per control step */
+    float ki;
+    float kd;
+} speed_ctrl_tune_t;
+
+void speed_ctrl_init(void);
+void speed_ctrl_set_target(int32_t ticks_per_s);
+int32_t speed_ctrl_get_target(void);
+bool speed_ctrl_is_active(void);
+/*
+ * relay autotune at a speed: the train holds it, oscillates around it with relay_duty
+ * either side, stops and runs on the new gains, which are saved. A speed command ends
+ * the run and keeps the old gains.
+ */
+int speed_ctrl_autotune(int32_t ticks_per_s, uint8_t relay_duty);
+/* back to the built in gains, only while stopped */
+int speed_ctrl_clear_gains(void);
+void speed_ctrl_get_tune(speed_ctrl_tune_t *tune);
+void speed_ctrl_get_stats(speed_ctrl_stats_t *stats);
+void speed_ctrl_clear_stats(void);
+
+#endif
@@ -0,0 +1,58 @@
+#include <stdlib.h>
+#include "speed_loop.h"
+
+void speed_loop_reset(pid_q_alg_t *pid, const autotune_gains_t *gains)
+{
+    pid_q_init(pid);
+    autotune_to_pid_q(gains, SPEED_CTRL_IN_BITS, SPEED_CTRL_OUT_BITS, pid);
+    pid->max_val = q31_from_int(SPEED_CTRL_MAX_OUT, SPEED_CTRL_OUT_BITS);
+    pid->min_val = q31_from_int(-SPEED_CTRL_MAX_OUT, SPEED_CTRL_OUT_BITS);
+}
+
+int32_t speed_loop_pid(pid_q_alg_t *pid, int32_t target, int32_t velocity)
+{
+    return q31_to_int(feedback_pid_q_cal(pid, q31_from_int(target, SPEED_CTRL_IN_BITS),
+                                         q31_from_int(velocity, SPEED_CTRL_IN_BITS)),
+                      SPEED_CTRL_OUT_BITS);
+}
+
+int32_t speed_loop_sag_compensate(int32_t out, uint32_t vbat_mv)
+{
+    if ((vbat_mv == 0) || (vbat_mv >= SPEED_CTRL_VBAT_NOMINAL_MV)) {
+        return out;
+    }
+
+    out = out * SPEED_CTRL_VBAT_NOMINAL_MV / (int32_t)vbat_mv;
+
+    if (out > SPEED_CTRL_MAX_OUT) {
+        out = SPEED_CTRL_MAX_OUT;
+    } else if (out < -SPEED_CTRL_MAX_OUT) {
+        out = -SPEED_CTRL_MAX_OUT;
+    }
+
+    return out;
+}
+
+void speed_loop_update_stats(speed_ctrl_stats_t *stats, int32_t target, int32_t velocity, uint32_t latency_us,
+                             uint32_t jitter_us)
+{
+    uint32_t error = (uint32_t)abs(target - velocity);
+
+    stats->loops++;
+    stats->target = target;
+    stats->velocity = velocity;
+
+    stats->latency_avg_us += ((int32_t)latency_us - (int32_t)stats->latency_avg_us) >> SPEED_CTRL_AVG_SHIFT;
+    if (latency_us > stats->latency_max_us) {
+        stats->latency_max_us = latency_us;
+    }
+
+    if (jitter_us > stats->jitter_max_us) {
+        stats->jitter_max_us = jitter_us;
+    }
+
+    stats->error_avg += ((int32_t)error - (int32_t)stats->error_avg) >> SPEED_CTRL_AVG_SHIFT;
+    if (error > stats->error_max) {
+        stats->error_max = error;
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef SPEED_LOOP_H
+#define SPEED_LOOP_H
+
+#include <stdint.h>
+#include "autotune.h"
+#include "pid_q.h"
+#include "speed_ctrl.h"
+
+/*
+ * The arithmetic of one step of the speed loop in speed_ctrl.c: the fixed point pid,
+ * the battery sag compensation and the stats. Free of hal calls so that
+ * tools/speed_ctrl/speed_ctrl_sim.c runs the same code on a simulated motor.
+ */
+
+/* gains without stored ones */
+#define SPEED_CTRL_KP      0.05f
+#define SPEED_CTRL_KI      0.02f
+#define SPEED_CTRL_KD      0.0f
+#define SPEED_CTRL_MAX_OUT 100
+/* ticks/s and duty enter the pid as Q31 fractions of 2^n */
+#define SPEED_CTRL_IN_BITS  12
+#define SPEED_CTRL_OUT_BITS 7
+/* supply the gains were tuned at, lower readings scale the duty up */
+#define SPEED_CTRL_VBAT_NOMINAL_MV 3300
+/* running averages are kept as x += (new - x) / 2^SPEED_CTRL_AVG_SHIFT */
+#define SPEED_CTRL_AVG_SHIFT 4
+
+void speed_loop_reset(pid_q_alg_t *pid, const autotune_gains_t *gains);
+/* duty in % for a target and a measured speed in ticks/s, before the sag compensation */
+int32_t speed_loop_pid(pid_q_alg_t *pid, int32_t target, int32_t velocity);
+/* 0 mV is no reading and leaves the duty alone */
+int32_t speed_loop_sag_compensate(int32_t out, uint32_t vbat_mv);
+void speed_loop_update_stats(speed_ctrl_stats_t *stats, int32_t target, int32_t velocity, uint32_t latency_us,
+                             uint32_t jitter_us);
+
+#endif
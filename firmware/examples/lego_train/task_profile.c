@@ -0,0 +1,175 @@
+#include <FreeRTOS.h>
+#include "task.h"
+#include "bflb_platform.h"
+#include "misc.h"
+#include "task_profile.h"
+
+#if (configGENERATE_RUN_TIME_STATS != 0)
+
+#define TASK_PROFILE_CALIBRATE_LOOPS 1000
+
+/* indexed by uxTCBNumber, which FreeRTOS hands out from 1; any overflow shares slot 0 */
+static volatile uint32_t task_switches[TASK_PROFILE_MAX_TASKS];
+static volatile uint32_t total_switches;
+
+static uint32_t prev_runtime[TASK_PROFILE_MAX_TASKS];
+static uint32_t prev_switches[TASK_PROFILE_MAX_TASKS];
+static uint32_t prev_total_switches;
+static uint32_t prev_uptime_us;
+static uint16_t snapshot_us;
+static uint16_t hook_ns;
+
+/* kept off the caller's stack, it is larger than most task stacks allow */
+static TaskStatus_t task_status[TASK_PROFILE_MAX_TASKS];
+
+#if TASK_PROFILE_UART_PERIOD_MS
+static uint8_t snapshot_buf[TASK_PROFILE_SNAPSHOT_MAX];
+static StackType_t task_profile_stack[256];
+static StaticTask_t task_profile_task_handle;
+static char hex_buf[TASK_PROFILE_SNAPSHOT_MAX * 2 + 1];
+#endif
+
+/* runs on every context switch from vTaskSwitchContext(), keep it to two increments */
+void ATTR_TCM_SECTION vApplicationTaskSwitchedIn(uint32_t ulTaskNumber)
+{
+    total_switches++;
+
+    task_switches[(ulTaskNumber < TASK_PROFILE_MAX_TASKS) ? ulTaskNumber : 0]++;
+}
+
+/* the calibration calls land in slot 0 and are removed again */
+static void task_profile_calibrate(void)
+{
+    uint64_t start_us;
+    uint32_t saved_total;
+
+    taskENTER_CRITICAL();
+    saved_total = total_switches;
+    start_us = bflb_platform_get_time_us();
+
+    for (uint32_t i = 0; i < TASK_PROFILE_CALIBRATE_LOOPS; i++) {
+        vApplicationTaskSwitchedIn(0);
+    }
+
+    hook_ns = (uint16_t)((bflb_platform_get_time_us() - start_us) * 1000 / TASK_PROFILE_CALIBRATE_LOOPS);
+    task_switches[0] -= TASK_PROFILE_CALIBRATE_LOOPS;
+    total_switches = saved_total;
+    taskEXIT_CRITICAL();
+}
+
+uint16_t task_profile_snapshot(uint8_t *buf, uint16_t size)
+{
+    task_profile_header_t *header = (task_profile_header_t *)buf;
+    task_profile_entry_t *entry = (task_profile_entry_t *)(buf + sizeof(task_profile_header_t));
+    uint32_t start_us = portGET_RUN_TIME_COUNTER_VALUE();
+    uint32_t total_runtime;
+    uint32_t switches;
+    UBaseType_t num;
+    UBaseType_t i;
+    uint8_t slot;
+
+    if (size < TASK_PROFILE_SNAPSHOT_MAX) {
+        return 0;
+    }
+
+    /* the ble and uart exports share the previous-snapshot state */
+    vTaskSuspendAll();
+
+    num = uxTaskGetSystemState(task_status, TASK_PROFILE_MAX_TASKS, &total_runtime);
+    switches = total_switches;
+
+    header->magic = TASK_PROFILE_MAGIC;
+    header->version = TASK_PROFILE_VERSION;
+    header->num_tasks = num;
+    header->reserved = 0;
+    header->uptime_us = total_runtime;
+    header->window_us = total_runtime - prev_uptime_us;
+    header->switches = switches - prev_total_switches;
+    header->snapshot_us = snapshot_us;
+    header->hook_ns = hook_ns;
+
+    prev_uptime_us = total_runtime;
+    prev_total_switches = switches;
+
+    for (i = 0; i < num; i++) {
+        slot = (task_status[i].xTaskNumber < TASK_PROFILE_MAX_TASKS) ? task_status[i].xTaskNumber : 0;
+        switches = task_switches[slot] - prev_switches[slot];
+
+        entry[i].number = task_status[i].xTaskNumber;
+        entry[i].priority = task_status[i].uxCurrentPriority;
+        entry[i].state = task_status[i].eCurrentState;
+        entry[i].reserved = 0;
+        entry[i].runtime_us = task_status[i].ulRunTimeCounter - prev_runtime[slot];
+        entry[i].stack_free = task_status[i].usStackHighWaterMark;
+        entry[i].switches = (switches > UINT16_MAX) ? UINT16_MAX : switches;
+        strncpy(entry[i].name, task_status[i].pcTaskName, TASK_PROFILE_NAME_LEN);
+
+        prev_runtime[slot] = task_status[i].ulRunTimeCounter;
+        prev_switches[slot] += switches;
+    }
+
+    xTaskResumeAll();
+
+    /* reported with the next snapshot, this one is already encoded */
+    switches = portGET_RUN_TIME_COUNTER_VALUE() - start_us;
+    snapshot_us = (switches > UINT16_MAX) ? UINT16_MAX : switches;
+
+    return sizeof(task_profile_header_t) + num * sizeof(task_profile_entry_t);
+}
+
+/* one "PROF:<hex>" line per snapshot so it can share the debug uart with MSG() logs */
+void task_profile_dump(void)
+{
+#if TASK_PROFILE_UART_PERIOD_MS
+    static const char hex[] = "0123456789abcdef";
+    uint16_t len = task_profile_snapshot(snapshot_buf, sizeof(snapshot_buf));
+
+    for (uint16_t i = 0; i < len; i++) {
+        hex_buf[i * 2] = hex[snapshot_buf[i] >> 4];
+        hex_buf[i * 2 + 1] = hex[snapshot_buf[i] & 0x0f];
+    }
+    hex_buf[len * 2] = '\0';
+
+    MSG("PROF:%s\r\n", hex_buf);
+#endif
+}
+
+#if TASK_PROFILE_UART_PERIOD_MS
+static void task_profile_task_entry(void *pvParameters)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+
+    while (1) {
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(TASK_PROFILE_UART_PERIOD_MS));
+        task_profile_dump();
+    }
+}
+#endif
+
+void task_profile_init(void)
+{
+    task_profile_calibrate();
+    prev_uptime_us = portGET_RUN_TIME_COUNTER_VALUE();
+
+#if TASK_PROFILE_UART_PERIOD_MS
+    xTaskCreateStatic(task_profile_task_entry, (char *)"profile", sizeof(task_profile_stack) / 4, NULL,
+                      1, task_profile_stack, &task_profile_task_handle);
+#endif
+}
+
+#else
+
+void task_profile_init(void)
+{
+}
+
+uint16_t task_profile_snapshot(uint8_t *buf, uint16_t size)
+{
+    return 0;
+}
+
+void task_profile_dump(void)
+{
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef TASK_PROFILE_H
+#define TASK_PROFILE_H
+
+#include <stdint.h>
+
+#define TASK_PROFILE_MAGIC      0x50 /* 'P' */
+#define TASK_PROFILE_VERSION    1
+#define TASK_PROFILE_MAX_TASKS  16
+#define TASK_PROFILE_NAME_LEN   8
+/* hex dump a snapshot to the log this often, 0 only serves BLE requests */
+#ifndef TASK_PROFILE_UART_PERIOD_MS
+#define TASK_PROFILE_UART_PERIOD_MS 0
+#endif
+
+/*
+ * Snapshot wire format, little endian: one header followed by num_tasks
+ * entries. Run time and switch counts cover the window since the previous
+ * snapshot. tools/profile/profile_decode.py renders it.
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t magic;
+    uint8_t version;
+    uint8_t num_tasks;
+    uint8_t reserved;
+    uint32_t uptime_us;   /* run time counter when taken */
+    uint32_t window_us;   /* time covered by the deltas */
+    uint32_t switches;    /* context switches in the window */
+    uint16_t snapshot_us; /* cost of taking the previous snapshot */
+    uint16_t hook_ns;     /* cost of one switch hook call */
+} task_profile_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t number;
+    uint8_t priority;
+    uint8_t state;      /* eTaskState */
+    uint8_t reserved;
+    uint32_t runtime_us; /* in the window */
+    uint16_t stack_free; /* lowest free stack so far, words */
+    uint16_t switches;   /* in the window, saturated */
+    char name[TASK_PROFILE_NAME_LEN];
+} task_profile_entry_t;
+
+#define TASK_PROFILE_SNAPSHOT_MAX (sizeof(task_profile_header_t) + TASK_PROFILE_MAX_TASKS * sizeof(task_profile_entry_t))
+
+void task_profile_init(void);
+uint16_t task_profile_snapshot(uint8_t *buf, uint16_t size);
+void task_profile_dump(void);
+
+#endif
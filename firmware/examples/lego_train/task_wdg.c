@@ -0,0 +1,99 @@
+#include <errno.h>
+#include <string.h>
+#include "task_wdg.h"
+
+void task_wdg_init(task_wdg_t *wdg)
+{
+    memset(wdg, 0, sizeof(*wdg));
+    wdg->fault = -1;
+}
+
+int task_wdg_register(task_wdg_t *wdg, const char *name, uint32_t deadline_ms)
+{
+    task_wdg_entry_t *entry;
+
+    if (wdg->count >= TASK_WDG_MAX) {
+        return -ENOMEM;
+    }
+
+    entry = &wdg->entries[wdg->count];
+    entry->name = name;
+    entry->deadline_ms = deadline_ms;
+    entry->last_ms = 0;
+    entry->blocked = true;
+    entry->worst_ms = 0;
+
+    /* a check that preempts this sees the entry only once it is complete */
+    wdg->count++;
+
+    return wdg->count - 1;
+}
+
+void task_wdg_checkin(task_wdg_t *wdg, uint8_t id, uint32_t now_ms)
+{
+    task_wdg_entry_t *entry = &wdg->entries[id];
+    uint32_t gap = now_ms - entry->last_ms;
+
+    if (!entry->blocked && (gap > entry->worst_ms)) {
+        entry->worst_ms = gap;
+    }
+
+    /* the time first: a check between the two stores still skips the entry */
+    entry->last_ms = now_ms;
+    entry->blocked = false;
+}
+
+void task_wdg_block(task_wdg_t *wdg, uint8_t id)
+{
+    wdg->entries[id].blocked = true;
+}
+
+void task_wdg_pause(task_wdg_t *wdg, uint32_t now_ms)
+{
+    wdg->pause_ms = now_ms;
+    wdg->paused = true;
+}
+
+void task_wdg_resume(task_wdg_t *wdg, uint32_t now_ms)
+{
+    uint32_t slept = now_ms - wdg->pause_ms;
+    uint8_t i;
+
+    if (!wdg->paused) {
+        return;
+    }
+
+    for (i = 0; i < wdg->count; i++) {
+        wdg->entries[i].last_ms += slept;
+    }
+
+    wdg->paused = false;
+}
+
+int task_wdg_check(task_wdg_t *wdg, uint32_t now_ms)
+{
+    const task_wdg_entry_t *entry;
+    uint32_t gap;
+    uint8_t i;
+
+    if ((wdg->fault >= 0) || wdg->paused) {
+        return wdg->fault;
+    }
+
+    for (i = 0; i < wdg->count; i++) {
+        entry = &wdg->entries[i];
+        if (entry->blocked) {
+            continue;
+        }
+
+        gap = now_ms - entry->last_ms;
+        if (gap > entry->deadline_ms) {
+            wdg->fault_ms = now_ms;
+            wdg->late_ms = gap - entry->deadline_ms;
+            wdg->fault = i;
+            break;
+        }
+    }
+
+    return wdg->fault;
+}
@@ -0,0 +1,51 @@
+#ifndef TASK_WDG_H
+#define TASK_WDG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Deadline supervision of tasks. A task checks in at least every deadline while it
+ * runs. Before a wait for an event that may never come, like a command or a sound to
+ * play, it blocks its entry: the deadline is off until the next check-in. Between
+ * task_wdg_pause() and task_wdg_resume() no deadline runs at all, for a sleep that
+ * also stops the events a task waits for; the time slept is left out of every entry.
+ * The first entry found past its deadline stays the fault, the caller stops feeding
+ * the hardware watchdog on it.
+ *
+ * Times are ms of any free running counter. Free of hal and FreeRTOS calls so that
+ * tools/task_wdg/task_wdg_sim.c runs the same code. Check-ins come from tasks, the
+ * check may come from an interrupt that preempts them.
+ */
+
+#define TASK_WDG_MAX 8
+
+typedef struct {
+    const char *name;
+    uint32_t deadline_ms;
+    volatile uint32_t last_ms; /* last check-in */
+    volatile bool blocked;
+    uint32_t worst_ms;         /* longest supervised gap between check-ins */
+} task_wdg_entry_t;
+
+typedef struct {
+    task_wdg_entry_t entries[TASK_WDG_MAX];
+    volatile uint8_t count;
+    volatile bool paused;
+    uint32_t pause_ms;
+    int8_t fault;      /* the late entry, -1 while there is none */
+    uint32_t fault_ms; /* when it was found */
+    uint32_t late_ms;  /* past its deadline then */
+} task_wdg_t;
+
+void task_wdg_init(task_wdg_t *wdg);
+/* id of a new entry, blocked until its first check-in; -ENOMEM when all are taken */
+int task_wdg_register(task_wdg_t *wdg, const char *name, uint32_t deadline_ms);
+void task_wdg_checkin(task_wdg_t *wdg, uint8_t id, uint32_t now_ms);
+void task_wdg_block(task_wdg_t *wdg, uint8_t id);
+void task_wdg_pause(task_wdg_t *wdg, uint32_t now_ms);
+void task_wdg_resume(task_wdg_t *wdg, uint32_t now_ms);
+/* -1 while every entry is on time, else the id of the first one found late, for good */
+int task_wdg_check(task_wdg_t *wdg, uint32_t now_ms);
+
+#endif
@@ -0,0 +1,187 @@
+#include <stddef.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include "task.h"
+#include "hal_wdt.h"
+#include "task_wdg.h"
+#include "watchdog.h"
+#include "app_log.h"
+#define DLOG_MODULE APP_LOG_MAIN
+#include "dlog.h"
+
+#define watchdog_record ((volatile watchdog_record_t *)WATCHDOG_RECORD_ADDR)
+
+static struct device *watchdog_dev;
+static task_wdg_t supervisor;
+static int idle_wdg = -1;
+static TickType_t last_check;
+static bool recorded;
+/* the record as this boot found it */
+static watchdog_record_t last_reset;
+
+static uint32_t watchdog_now_ms(void)
+{
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+static void watchdog_copy_name(volatile char *dst, const char *src)
+{
+    uint8_t i;
+
+    for (i = 0; (i < WATCHDOG_NAME_LEN - 1) && src && src[i]; i++) {
+        dst[i] = src[i];
+    }
+    for (; i < WATCHDOG_NAME_LEN; i++) {
+        dst[i] = '\0';
+    }
+}
+
+/* in a critical section or the tick interrupt; the first late task goes to the record */
+static void watchdog_check(uint32_t now_ms)
+{
+    const task_wdg_entry_t *entry;
+    int id;
+
+    id = task_wdg_check(&supervisor, now_ms);
+    if ((id < 0) || recorded) {
+        return;
+    }
+
+    entry = &supervisor.entries[id];
+    watchdog_record->uptime_ms = supervisor.fault_ms;
+    watchdog_record->deadline_ms = entry->deadline_ms;
+    watchdog_record->late_ms = supervisor.late_ms;
+    watchdog_copy_name(watchdog_record->task, entry->name);
+    watchdog_copy_name(watchdog_record->running, pcTaskGetName(NULL));
+    watchdog_record->flags |= WATCHDOG_FLAG_FAULT;
+    recorded = true;
+}
+
+void watchdog_init(void)
+{
+    uint32_t timeout = WATCHDOG_TIMEOUT;
+    bool wdt_reset;
+
+    task_wdg_init(&supervisor);
+    idle_wdg = task_wdg_register(&supervisor, "idle", WATCHDOG_IDLE_MS);
+
+    wdt_register(WDT_INDEX, "wdg_rst");
+    watchdog_dev = device_find("wdg_rst");
+    if (!watchdog_dev) {
+        return;
+    }
+
+    wdt_reset = (device_control(watchdog_dev, DEVICE_CTRL_GET_RST_STATUS, NULL) != 0);
+    device_control(watchdog_dev, DEVICE_CTRL_CLR_RST_STATUS, NULL);
+
+    /* without the magic it is what power on left in the ram */
+    if (watchdog_record->magic != WATCHDOG_RECORD_MAGIC) {
+        memset((void *)watchdog_record, 0, sizeof(watchdog_record_t));
+        watchdog_record->magic = WATCHDOG_RECORD_MAGIC;
+    }
+
+    if (wdt_reset) {
+        watchdog_record->resets++;
+        memcpy(&last_reset, (const void *)watchdog_record, sizeof(last_reset));
+        /* a hang with interrupts off, or in one, leaves no late task behind */
+        if (!(last_reset.flags & WATCHDOG_FLAG_FAULT)) {
+            memset((uint8_t *)&last_reset + offsetof(watchdog_record_t, uptime_ms), 0,
+                   sizeof(last_reset) - offsetof(watchdog_record_t, uptime_ms));
+        }
+        last_reset.flags |= WATCHDOG_FLAG_WDT_RESET;
+    }
+    watchdog_record->flags = 0;
+
+    device_control(watchdog_dev, DEVICE_CTRL_CLR_INT, NULL);
+    device_open(watchdog_dev, 0);
+    device_write(watchdog_dev, 0, &timeout, sizeof(timeout));
+}
+
+void watchdog_report(void)
+{
+    if (!(last_reset.flags & WATCHDOG_FLAG_WDT_RESET)) {
+        return;
+    }
+
+    if (last_reset.flags & WATCHDOG_FLAG_FAULT) {
+        DLOG_W("watchdog reset %u: %s late by %u ms at %u ms, %s running", last_reset.resets, last_reset.task,
+               last_reset.late_ms, last_reset.uptime_ms, last_reset.running);
+    } else {
+        DLOG_W("watchdog reset %u with every task on time", last_reset.resets);
+    }
+}
+
+int watchdog_register(const char *name, uint32_t deadline_ms)
+{
+    int id;
+
+    taskENTER_CRITICAL();
+    id = task_wdg_register(&supervisor, name, deadline_ms);
+    taskEXIT_CRITICAL();
+
+    if (id < 0) {
+        DLOG_W("%s not supervised (%d)", name, id);
+    }
+
+    return id;
+}
+
+void watchdog_checkin(int id)
+{
+    if (id >= 0) {
+        task_wdg_checkin(&supervisor, id, watchdog_now_ms());
+    }
+}
+
+void watchdog_block(int id)
+{
+    if (id >= 0) {
+        task_wdg_block(&supervisor, id);
+    }
+}
+
+void watchdog_feed(void)
+{
+    uint32_t now_ms = watchdog_now_ms();
+
+    if (!watchdog_dev) {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    task_wdg_checkin(&supervisor, idle_wdg, now_ms);
+    watchdog_check(now_ms);
+    taskEXIT_CRITICAL();
+
+    /* a late task is never fed again, the hardware resets within WATCHDOG_TIMEOUT */
+    if (supervisor.fault < 0) {
+        device_control(watchdog_dev, DEVICE_CTRL_RST_WDT_COUNTER, NULL);
+    }
+}
+
+void watchdog_sleep_begin(void)
+{
+    task_wdg_pause(&supervisor, watchdog_now_ms());
+}
+
+void watchdog_sleep_end(void)
+{
+    task_wdg_resume(&supervisor, watchdog_now_ms());
+}
+
+void watchdog_tick(void)
+{
+    TickType_t now = xTaskGetTickCountFromISR();
+
+    if ((now - last_check) < pdMS_TO_TICKS(WATCHDOG_CHECK_MS)) {
+        return;
+    }
+
+    last_check = now;
+    watchdog_check(now * portTICK_PERIOD_MS);
+}
+
+void watchdog_get_reset(watchdog_record_t *record)
+{
+    memcpy(record, &last_reset, sizeof(*record));
+}
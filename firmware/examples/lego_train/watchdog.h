@@ -0,0 +1,55 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <stdint.h>
+
+/*
+ * Record of the last watchdog reset, in HBN RAM between the PDS register backup at
+ * 0x40010E00 and the boot profile at 0x40010F00, so it survives the reset it explains.
+ */
+#define WATCHDOG_RECORD_ADDR  0x40010E80
+#define WATCHDOG_RECORD_MAGIC 0x47445757 /* "WWDG" */
+#define WATCHDOG_NAME_LEN     12
+
+/* 32 kHz clock, the longest the hardware waits for a feed: 2 s */
+#define WATCHDOG_TIMEOUT      0xFFFF
+/* the idle task feeds the watchdog, a task that keeps it from running is found this late */
+#define WATCHDOG_IDLE_MS      1000
+/* ticks between deadline checks */
+#define WATCHDOG_CHECK_MS     10
+
+#define WATCHDOG_FLAG_FAULT     0x01 /* a task was found late before the reset */
+#define WATCHDOG_FLAG_WDT_RESET 0x02 /* the reset came from the watchdog, set in watchdog_get_reset() */
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t resets;      /* watchdog resets since power on */
+    uint8_t flags;
+    uint8_t reserved;
+    uint32_t uptime_ms;   /* when the late task was found */
+    uint32_t deadline_ms; /* of that task */
+    uint32_t late_ms;     /* past its deadline then */
+    char task[WATCHDOG_NAME_LEN];    /* the late task */
+    char running[WATCHDOG_NAME_LEN]; /* the task the check interrupted */
+} watchdog_record_t;
+
+/* starts the hardware watchdog, call before the scheduler */
+void watchdog_init(void);
+/* logs the reset before this boot once logging is up */
+void watchdog_report(void);
+/* id of a task, supervised from its first check-in on; -ENOMEM when full */
+int watchdog_register(const char *name, uint32_t deadline_ms);
+void watchdog_checkin(int id);
+/* the deadline waits for the next check-in, call before a wait with no upper bound */
+void watchdog_block(int id);
+/* idle task: feeds the hardware while every task is on time */
+void watchdog_feed(void);
+/* around tickless PDS sleep, the time in it counts against no deadline */
+void watchdog_sleep_begin(void);
+void watchdog_sleep_end(void);
+/* tick hook */
+void watchdog_tick(void);
+/* the record of the reset before this boot, zero flags when it was not a watchdog reset */
+void watchdog_get_reset(watchdog_record_t *record);
+
+#endif
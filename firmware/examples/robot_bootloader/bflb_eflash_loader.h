@@ -40,6 +40,7 @@
 #include "bflb_eflash_loader_cmds.h"
 #include "bflb_eflash_loader_uart.h"
 #include "bflb_eflash_loader_ble.h"
+#include "bflb_eflash_loader_usb.h"
 
 /*error code definition*/
 typedef enum tag_eflash_loader_error_code_t {
@@ -131,6 +132,21 @@ typedef enum tag_eflash_loader_error_code_t {
 #define BFLB_EFLASH_LOADER_WRITEBUF_SIZE    BFLB_EFLASH_LOADER_READBUF_SIZE
 #define BFLB_EFLASH_LOADER_CMD_DATA_MAX_LEN (BFLB_EFLASH_LOADER_READBUF_SIZE - 0x04) //cmd+rsvd+len(2bytes)
 
+/*image partition is erased sector by sector just ahead of the write pointer*/
+#define BFLB_EFLASH_LOADER_SECTOR_SIZE         4096
+#define BFLB_EFLASH_LOADER_ERASE_AHEAD_SECTORS 2
+/*the erase and page bitmaps cover a FW partition up to this size*/
+#define BFLB_EFLASH_LOADER_IMG_MAP_LEN         0x100000
+/*max_len of the inactive FW slot in the partition table, see pt_table_get_iap_para(); 0 without a valid table*/
+#define BFLB_EFLASH_LOADER_IMG_MAX_LEN         bflb_eflash_loader_img_max_len()
+/*its last sector keeps the page log of a resumable transfer, which limits those images to the rest*/
+#define BFLB_EFLASH_LOADER_PROGRESS_OFFSET     (BFLB_EFLASH_LOADER_IMG_MAX_LEN ? BFLB_EFLASH_LOADER_IMG_MAX_LEN - BFLB_EFLASH_LOADER_SECTOR_SIZE : 0)
+#define BFLB_EFLASH_LOADER_PROGRESS_PAGES      (BFLB_EFLASH_LOADER_PROGRESS_OFFSET / BFLB_EFLASH_LOADER_SECTOR_SIZE)
+#define BFLB_EFLASH_LOADER_PROGRESS_MAX_PAGES  (BFLB_EFLASH_LOADER_IMG_MAP_LEN / BFLB_EFLASH_LOADER_SECTOR_SIZE - 1)
+#define BFLB_EFLASH_LOADER_PROGRESS_MAGIC      0x504F4642 /*"BFOP"*/
+/*page CRCs per progress answer, keeps it within one indication*/
+#define BFLB_EFLASH_LOADER_PROGRESS_QUERY_PAGES 40
+
 #define MAXOF(a, b)          ((a) > (b) ? (a) : (b))
 #define OFFSET(TYPE, MEMBER) ((uint32_t)(&(((TYPE *)0)->MEMBER)))
 
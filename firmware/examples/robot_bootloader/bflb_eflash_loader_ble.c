@@ -44,10 +44,12 @@
 #include <FreeRTOS.h>
 #include <task.h>
 #include <semphr.h>
+#include <errno.h>
 
 #include "bluetooth.h"
 #include "conn.h"
 #include "gatt.h"
+#include "l2cap.h"
 #include "hci_core.h"
 #include "hci_driver.h"
 #include "ble_lib_api.h"
@@ -59,6 +61,10 @@ static struct bt_gatt_exchange_params exchg_mtu;
 static SemaphoreHandle_t rx_sem;
 static SemaphoreHandle_t tx_sem;
 static bool is_indicate_enabled = false;
+static bool ble_started = false;
+static struct bt_l2cap_le_chan coc_chan;
+static QueueHandle_t coc_rx_queue;
+static bool is_coc_connected = false;
 
 void bflb_eflash_loader_ble_if_enable_int(void)
 {
@@ -114,6 +120,129 @@ static int ble_blf_recv(struct bt_conn *conn,
     return len;
 }
 
+static struct net_buf *ble_coc_alloc_buf(struct bt_l2cap_chan *chan)
+{
+    return bt_l2cap_chan_buf_alloc(K_NO_WAIT);
+}
+
+static struct net_buf *ble_coc_alloc_frag(s32_t timeout, void *user_data)
+{
+    return bt_l2cap_chan_buf_alloc(timeout);
+}
+
+static int ble_coc_recv(struct bt_l2cap_chan *chan, struct net_buf *buf)
+{
+    /* one command per SDU, held until the loader task copies it out; the peer gets
+       its credits back only then, so it cannot run ahead of the flash */
+    if (xQueueSend(coc_rx_queue, &buf, 0) != pdTRUE) {
+        return -ENOMEM;
+    }
+
+    xSemaphoreGive(rx_sem);
+
+    return -EINPROGRESS;
+}
+
+static void ble_coc_sent(struct bt_l2cap_chan *chan)
+{
+    xSemaphoreGive(tx_sem);
+}
+
+static void ble_coc_connected(struct bt_l2cap_chan *chan)
+{
+    MSG("l2cap connected, tx mtu %u mps %u, rx mtu %u credits %u\r\n",
+        coc_chan.tx.mtu, coc_chan.tx.mps, coc_chan.rx.mtu, coc_chan.rx.init_credits);
+    is_coc_connected = true;
+}
+
+static void ble_coc_disconnected(struct bt_l2cap_chan *chan)
+{
+    struct net_buf *buf;
+
+    MSG("l2cap disconnected\r\n");
+    is_coc_connected = false;
+
+    while (xQueueReceive(coc_rx_queue, &buf, 0) == pdTRUE) {
+        net_buf_unref(buf);
+    }
+}
+
+static struct bt_l2cap_chan_ops coc_ops = {
+    .alloc_buf = ble_coc_alloc_buf,
+    .recv = ble_coc_recv,
+    .sent = ble_coc_sent,
+    .connected = ble_coc_connected,
+    .disconnected = ble_coc_disconnected,
+};
+
+static int ble_coc_accept(struct bt_conn *conn, struct bt_l2cap_chan **chan)
+{
+    if (coc_chan.chan.conn) {
+        return -ENOMEM;
+    }
+
+    memset(&coc_chan, 0, sizeof(coc_chan));
+    coc_chan.chan.ops = &coc_ops;
+    coc_chan.rx.mtu = BFLB_EFLASH_LOADER_BLE_L2CAP_MTU;
+    *chan = &coc_chan.chan;
+
+    return 0;
+}
+
+static struct bt_l2cap_server coc_server = {
+    .psm = BFLB_EFLASH_LOADER_BLE_L2CAP_PSM,
+    .sec_level = BT_SECURITY_L1,
+    .accept = ble_coc_accept,
+};
+
+/* moves a received SDU to where the GATT path reassembles its frames */
+static bool ble_coc_rx_pull(void)
+{
+    struct net_buf *buf;
+
+    if (xQueueReceive(coc_rx_queue, &buf, 0) != pdTRUE) {
+        return false;
+    }
+
+    g_rx_buf_len = net_buf_linearize(&g_eflash_loader_readbuf[0][2], BFLB_EFLASH_LOADER_BLE_READBUF_SIZE - 2,
+                                     buf, 0, net_buf_frags_len(buf));
+
+    /* frees the segments and returns the credits, the next command may come in */
+    if (bt_l2cap_chan_recv_complete(&coc_chan.chan, buf) < 0) {
+        net_buf_unref(buf);
+    }
+
+    return true;
+}
+
+static int ble_coc_send(const uint8_t *data, uint32_t len)
+{
+    struct net_buf *buf;
+    int ret;
+
+    if (len > coc_chan.tx.mtu) {
+        return -EMSGSIZE;
+    }
+
+    buf = bt_l2cap_chan_buf_alloc(K_NO_WAIT);
+    if (!buf) {
+        return -ENOMEM;
+    }
+
+    if (net_buf_append_bytes(buf, len, data, K_NO_WAIT, ble_coc_alloc_frag, NULL) != len) {
+        net_buf_unref(buf);
+        return -ENOMEM;
+    }
+
+    /* segmented to the peer's MPS and queued until it grants credits */
+    ret = bt_l2cap_chan_send(&coc_chan.chan, buf);
+    if (ret == -ENOTCONN) {
+        net_buf_unref(buf);
+    }
+
+    return (ret < 0) ? ret : 0;
+}
+
 static void ble_cfg_changed(const struct bt_gatt_attr *attr, u16_t vblfue)
 {
     if(vblfue == BT_GATT_CCC_INDICATE) {
@@ -208,7 +337,7 @@ static struct bt_gatt_attr blattrs[]= {
     BT_GATT_CCC(ble_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
 
     BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(BT_UUID_128_ENCODE(0x00070002, 0x0745, 0x4650, 0x8d93, 0xdf59be2fc10a)),
-                            BT_GATT_CHRC_WRITE,
+                            BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP,
                             BT_GATT_PERM_WRITE,
                             NULL,
                             ble_blf_recv,
@@ -235,14 +364,17 @@ void bt_enable_cb(int err)
 
         bt_conn_cb_register(&conn_callbacks);
         bt_gatt_service_register(&ble_bl_server);
+        bt_l2cap_server_register(&coc_server);
         bt_le_adv_start(BT_LE_ADV_CONN_NAME, ad, ARRAY_SIZE(ad), NULL, 0);
     }
 }
 
 int32_t bflb_eflash_loader_ble_init()
 {
+    ble_started = true;
     rx_sem = xSemaphoreCreateBinary();
     tx_sem = xSemaphoreCreateBinary();
+    coc_rx_queue = xQueueCreate(2, sizeof(struct net_buf *));
 
     GLB_Set_EM_Sel(GLB_EM_8KB);
     ble_controller_init(configMAX_PRIORITIES - 1);
@@ -294,20 +426,29 @@ uint32_t *bflb_eflash_loader_ble_recv(uint32_t *recv_len, uint32_t maxlen, uint3
                 device_control(wdg, DEVICE_CTRL_RST_WDT_COUNTER, NULL);
             }
 
-            if (xSemaphoreTake(rx_sem, pdMS_TO_TICKS(20)) == pdTRUE) {
+#if BLSP_BOOT2_SUPPORT_EFLASH_LOADER_FLASH
+            /* erase the next image sector while the host is still sending */
+            bflb_eflash_loader_erase_ahead_poll();
+#endif
+
+            if (uxQueueMessagesWaiting(coc_rx_queue) || (xSemaphoreTake(rx_sem, pdMS_TO_TICKS(20)) == pdTRUE)) {
                 break;
             }
         }
 
         if (timeout) {
+            if (ble_coc_rx_pull()) {
+                /* one give per SDU, drop the one that belongs to this SDU */
+                xSemaphoreTake(rx_sem, 0);
+            }
+
             if (g_rx_buf_len) {
                 *recv_len = g_rx_buf_len;
                 g_rx_buf_len = 0;
                 rcv_buf = (uint32_t *)&g_eflash_loader_readbuf[0][2];
                 cmd = *((uint8_t *)&g_eflash_loader_readbuf[0][2]);
 
-                if ((cmd == BFLB_EFLASH_LOADER_CMD_FLASH_ERASE) ||
-                        (cmd == BFLB_EFLASH_LOADER_CMD_RESET)) {
+                if (cmd == BFLB_EFLASH_LOADER_CMD_RESET) {
                     timeout = 200;
                     
                     while (timeout) {
@@ -345,18 +486,45 @@ static void indicate_cb(struct bt_conn *conn, const struct bt_gatt_attr *attr,
     xSemaphoreGive(tx_sem);
 }
 
-int32_t bflb_eflash_loader_ble_send(uint32_t *data, uint32_t len)
+static int32_t ble_wait_tx_done(void)
 {
-    struct bt_gatt_indicate_params params;
     struct device *wdg;
     uint16_t timeout = 5000;
 
     wdg = device_find("wdg_rst");
 
+    while (timeout) {
+        timeout = timeout - 20;
+
+        if (wdg) {
+            device_control(wdg, DEVICE_CTRL_RST_WDT_COUNTER, NULL);
+        }
+
+        if (xSemaphoreTake(tx_sem, pdMS_TO_TICKS(20)) == pdTRUE) {
+            break;
+        }
+    }
+
+    return timeout ? 0 : -1;
+}
+
+int32_t bflb_eflash_loader_ble_send(uint32_t *data, uint32_t len)
+{
+    struct bt_gatt_indicate_params params;
+
     MSG("send len %u\r\n", len);
 
     xSemaphoreTake(tx_sem, 0);
 
+    /* a host that opened the channel gets its answers there */
+    if (is_coc_connected) {
+        if (!ble_coc_send((const uint8_t *)data, len)) {
+            return ble_wait_tx_done();
+        }
+
+        return -1;
+    }
+
     if ((ble_bl_conn) && (is_indicate_enabled)) {
 
         memset(&params, 0, sizeof(struct bt_gatt_indicate_params));
@@ -366,21 +534,7 @@ int32_t bflb_eflash_loader_ble_send(uint32_t *data, uint32_t len)
         params.func = indicate_cb;
 
         if (!bt_gatt_indicate(ble_bl_conn, &params)) {
-            while (timeout) {
-                timeout = timeout - 20;
-
-                if (wdg) {
-                    device_control(wdg, DEVICE_CTRL_RST_WDT_COUNTER, NULL);
-                }
-
-                if (xSemaphoreTake(tx_sem, pdMS_TO_TICKS(20)) == pdTRUE) {
-                    break;
-                }
-            }
-
-            if (timeout) {
-                return 0;
-            }
+            return ble_wait_tx_done();
         }
     }
     
@@ -404,6 +558,10 @@ int32_t bflb_eflash_loader_ble_deinit()
 
 void bflb_eflash_loader_ble_stop(void)
 {
+    if (!ble_started) {
+        return;
+    }
+
     if (ble_bl_conn) {
         bt_conn_disconnect(ble_bl_conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
     }
@@ -40,6 +40,12 @@
 
 #define BFLB_EFLASH_LOADER_IF_BLE_RX_TIMEOUT    10000 /*ms*/
 
+/* LE credit based channel: one loader command per SDU without the length prefix
+   of the GATT frames, answered by one SDU */
+#define BFLB_EFLASH_LOADER_BLE_L2CAP_PSM        0x0080
+/* a 2 KB flash write: command, checksum, length, address and data */
+#define BFLB_EFLASH_LOADER_BLE_L2CAP_MTU        (2048 + 8)
+
 int32_t bflb_eflash_loader_ble_init();
 
 int32_t bflb_eflash_loader_ble_handshake_poll(uint32_t timeout);
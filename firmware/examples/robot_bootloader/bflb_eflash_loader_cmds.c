@@ -43,6 +43,7 @@
 #include "hal_flash.h"
 #include "hal_sec_hash.h"
 #include "blsp_media_boot.h"
+#include "blsp_boot_decrypt.h"
 #include <FreeRTOS.h>
 #include "hal_wdt.h"
 
@@ -75,6 +76,47 @@ static void bflb_bootrom_cmd_ack(uint32_t result);
 
 #if BLSP_BOOT2_SUPPORT_EFLASH_LOADER_FLASH
 static uint32_t g_eflash_loader_error = 0;
+/*image sectors erased since the transfer started, see bflb_eflash_loader_erase_ahead_poll()*/
+#define ERASE_MAP_SECTORS (BFLB_EFLASH_LOADER_IMG_MAP_LEN / BFLB_EFLASH_LOADER_SECTOR_SIZE)
+static uint32_t erase_map[(ERASE_MAP_SECTORS + 31) / 32];
+static uint8_t erase_ahead_active = 0;
+static uint32_t erase_ahead_cnt = 0;
+static uint32_t erase_inline_cnt = 0;
+static uint32_t erase_max_us = 0;
+
+/*ciphertext window of an encrypted transfer, see bflb_eflash_loader_cmd_decrypt_start()*/
+static blsp_boot2_enc_img_header decrypt_header;
+static uint8_t decrypt_active = 0;
+static uint32_t decrypt_start_addr = 0;
+
+/*resumable transfer, page log in the last image sector, see bflb_eflash_loader_progress_query()*/
+typedef struct {
+    uint32_t magic;
+    uint32_t img_len;
+    uint32_t img_id;
+    uint32_t crc32;
+} eflash_loader_progress_header_t;
+
+/*appended once a page is written and read back, a blank slot is all 0xff*/
+typedef struct {
+    uint16_t page;
+    uint16_t page_inv;
+    uint32_t crc32;
+} eflash_loader_progress_entry_t;
+
+#define PROGRESS_ENTRY_MAX ((BFLB_EFLASH_LOADER_SECTOR_SIZE - sizeof(eflash_loader_progress_header_t)) / sizeof(eflash_loader_progress_entry_t))
+#define PROGRESS_PAGE_NONE 0xffff
+
+static eflash_loader_progress_header_t progress_header;
+static uint8_t progress_active = 0;
+static uint32_t progress_entries = 0;
+static uint32_t progress_map[(BFLB_EFLASH_LOADER_PROGRESS_MAX_PAGES + 31) / 32];
+static uint32_t progress_crc[BFLB_EFLASH_LOADER_PROGRESS_MAX_PAGES];
+static uint32_t progress_ack_buf[(12 + (BFLB_EFLASH_LOADER_PROGRESS_MAX_PAGES + 7) / 8 + BFLB_EFLASH_LOADER_PROGRESS_QUERY_PAGES * 4 + 3) / 4];
+/*page being filled by consecutive writes*/
+static uint16_t fill_page = PROGRESS_PAGE_NONE;
+static uint32_t fill_len = 0;
+static uint32_t fill_crc = 0;
 /* for bl702 */
 static int32_t bflb_eflash_loader_cmd_read_jedec_id(uint16_t cmd, uint8_t *data, uint16_t len);
 static int32_t bflb_eflash_loader_cmd_reset(uint16_t cmd, uint8_t *data, uint16_t len);
@@ -87,6 +129,8 @@ static int32_t bflb_eflash_loader_cmd_write_flash_check(uint16_t cmd, uint8_t *d
 static int32_t bflb_eflash_loader_cmd_set_flash_para(uint16_t cmd, uint8_t *data, uint16_t len);
 static int32_t bflb_eflash_loader_cmd_xip_read_flash_start(uint16_t cmd, uint8_t *data, uint16_t len);
 static int32_t bflb_eflash_loader_cmd_xip_read_flash_finish(uint16_t cmd, uint8_t *data, uint16_t len);
+static int32_t bflb_eflash_loader_cmd_decrypt_start(uint16_t cmd, uint8_t *data, uint16_t len);
+static void bflb_eflash_loader_progress_clear(void);
 #endif
 
 static const struct eflash_loader_cmd_cfg_t eflash_loader_cmds[] = {
@@ -113,6 +157,7 @@ static const struct eflash_loader_cmd_cfg_t eflash_loader_cmds[] = {
     { BFLB_EFLASH_LOADER_CMD_XIP_READ_START, EFLASH_LOADER_CMD_ENABLE, bflb_eflash_loader_cmd_xip_read_flash_start },
     { BFLB_EFLASH_LOADER_CMD_XIP_READ_FINISH, EFLASH_LOADER_CMD_ENABLE, bflb_eflash_loader_cmd_xip_read_flash_finish },
     { BFLB_EFLASH_LOADER_CMD_FLASH_READ_JEDECID, EFLASH_LOADER_CMD_ENABLE, bflb_eflash_loader_cmd_read_jedec_id },
+    { BFLB_EFLASH_LOADER_CMD_FLASH_DECRYPT_START, EFLASH_LOADER_CMD_ENABLE, bflb_eflash_loader_cmd_decrypt_start },
 #endif        
 };
 
@@ -491,6 +536,10 @@ static int32_t bflb_eflash_loader_cmd_reset(uint16_t cmd, uint8_t *data, uint16_
 
     pt_table_set_iap_para(&p_iap_param);
     pt_table_dump();
+
+    /*the transfer is over, the same image sent again starts from scratch*/
+    bflb_eflash_loader_progress_clear();
+
     MSG("RST\n");
 
     bflb_eflash_loader_cmd_ack(ret);
@@ -508,21 +557,461 @@ static int32_t bflb_eflash_loader_cmd_reset(uint16_t cmd, uint8_t *data, uint16_
     return ret;
 }
 
-static int32_t bflb_eflash_loader_cmd_erase_flash(uint16_t cmd, uint8_t *data, uint16_t len)
+/* the inactive FW slot as the partition table sizes it, whole sectors the bitmaps cover */
+uint32_t bflb_eflash_loader_img_max_len(void)
 {
-    int32_t ret = BFLB_EFLASH_LOADER_SUCCESS;
-    uint32_t startaddr, endaddr;
+    uint32_t len = p_iap_param.iap_max_len;
+
+    if (len > BFLB_EFLASH_LOADER_IMG_MAP_LEN) {
+        len = BFLB_EFLASH_LOADER_IMG_MAP_LEN;
+    }
+
+    len -= len % BFLB_EFLASH_LOADER_SECTOR_SIZE;
+
+    /*the page log takes the last sector, a slot without room for an image besides is unusable*/
+    return (len < 2 * BFLB_EFLASH_LOADER_SECTOR_SIZE) ? 0 : len;
+}
+
+/*
+ * Erase-ahead: the image partition is never erased in one go. Each write makes
+ * sure its own sectors are erased and the idle loop of the BLE interface
+ * erases a couple of sectors past the write pointer, one per poll, so no flash
+ * operation keeps interrupts off long enough to drop the link.
+ */
+static void bflb_eflash_loader_erase_start(void)
+{
+    bflb_eflash_loader_progress_clear();
+    memset(erase_map, 0, sizeof(erase_map));
+    erase_ahead_active = 1;
+    erase_ahead_cnt = 0;
+    erase_inline_cnt = 0;
+    erase_max_us = 0;
+    p_iap_param.iap_write_addr = p_iap_param.iap_start_addr;
+    p_iap_param.iap_img_len = 0;
+}
+
+static int32_t bflb_eflash_loader_erase_sector(uint32_t idx)
+{
+    uint32_t start_us;
+
+    if (erase_map[idx / 32] & (1U << (idx % 32))) {
+        return BFLB_EFLASH_LOADER_SUCCESS;
+    }
+
+    start_us = bflb_platform_get_time_us();
+
+    if (SUCCESS != flash_erase(p_iap_param.iap_start_addr + idx * BFLB_EFLASH_LOADER_SECTOR_SIZE, BFLB_EFLASH_LOADER_SECTOR_SIZE)) {
+        MSG("erase fail %d\n", idx);
+        return BFLB_EFLASH_LOADER_FLASH_ERASE_ERROR;
+    }
+
+    start_us = bflb_platform_get_time_us() - start_us;
+
+    if (start_us > erase_max_us) {
+        erase_max_us = start_us;
+    }
+
+    erase_map[idx / 32] |= (1U << (idx % 32));
+    return BFLB_EFLASH_LOADER_SUCCESS;
+}
+
+/* erase whatever part of [addr, addr + len) inside the image is not erased yet */
+static int32_t bflb_eflash_loader_erase_range(uint32_t addr, uint32_t len)
+{
+    int32_t ret;
+    uint32_t idx, last;
     struct device *wdg;
 
+    if ((addr < p_iap_param.iap_start_addr) || (addr + len > p_iap_param.iap_start_addr + BFLB_EFLASH_LOADER_IMG_MAX_LEN)) {
+        /*outside the image, up to the host to erase*/
+        return BFLB_EFLASH_LOADER_SUCCESS;
+    }
+
     wdg = device_find("wdg_rst");
+    idx = (addr - p_iap_param.iap_start_addr) / BFLB_EFLASH_LOADER_SECTOR_SIZE;
+    last = (addr + len - 1 - p_iap_param.iap_start_addr) / BFLB_EFLASH_LOADER_SECTOR_SIZE;
+
+    for (; idx <= last; idx++) {
+        if (!(erase_map[idx / 32] & (1U << (idx % 32)))) {
+            ret = bflb_eflash_loader_erase_sector(idx);
+
+            if (ret != BFLB_EFLASH_LOADER_SUCCESS) {
+                return ret;
+            }
+
+            erase_inline_cnt++;
+        }
+
+        if (wdg) {
+            device_control(wdg, DEVICE_CTRL_RST_WDT_COUNTER, NULL);
+        }
+    }
+
+    return BFLB_EFLASH_LOADER_SUCCESS;
+}
+
+/* called while the interface waits for the next command, erases one sector at most */
+void bflb_eflash_loader_erase_ahead_poll(void)
+{
+    uint32_t idx, last, end;
+
+    if (!erase_ahead_active || g_eflash_loader_error != BFLB_EFLASH_LOADER_SUCCESS) {
+        return;
+    }
+
+    end = BFLB_EFLASH_LOADER_IMG_MAX_LEN;
+
+    /*the erase command, when sent, tells how long the image is*/
+    if (p_iap_param.iap_img_len && p_iap_param.iap_img_len < end) {
+        end = p_iap_param.iap_img_len;
+    }
+
+    idx = (p_iap_param.iap_write_addr - p_iap_param.iap_start_addr) / BFLB_EFLASH_LOADER_SECTOR_SIZE;
+    last = (end - 1) / BFLB_EFLASH_LOADER_SECTOR_SIZE;
+
+    if (last > idx + BFLB_EFLASH_LOADER_ERASE_AHEAD_SECTORS) {
+        last = idx + BFLB_EFLASH_LOADER_ERASE_AHEAD_SECTORS;
+    }
+
+    for (; idx <= last; idx++) {
+        if (!(erase_map[idx / 32] & (1U << (idx % 32)))) {
+            if (bflb_eflash_loader_erase_sector(idx) != BFLB_EFLASH_LOADER_SUCCESS) {
+                g_eflash_loader_error = BFLB_EFLASH_LOADER_FLASH_ERASE_ERROR;
+            } else {
+                erase_ahead_cnt++;
+            }
+
+            return;
+        }
+    }
+}
+
+/*
+ * Image writes for a loader without commands, the USB drive. Offsets are
+ * relative to the image start and go through the same erase-ahead as the
+ * write command. img_len may be 0 while the image length is unknown.
+ */
+int32_t bflb_eflash_loader_image_start(uint32_t img_len)
+{
+    if (0 != pt_table_get_iap_para(&p_iap_param)) {
+        return BFLB_EFLASH_LOADER_FLASH_WRITE_ADDR_ERROR;
+    }
+
+    if (img_len > BFLB_EFLASH_LOADER_IMG_MAX_LEN) {
+        return BFLB_EFLASH_LOADER_FLASH_WRITE_PARA_ERROR;
+    }
+
+    g_eflash_loader_error = BFLB_EFLASH_LOADER_SUCCESS;
+    decrypt_active = 0;
+    bflb_eflash_loader_erase_start();
+    p_iap_param.iap_img_len = img_len;
+
+    return BFLB_EFLASH_LOADER_SUCCESS;
+}
+
+int32_t bflb_eflash_loader_image_write(uint32_t offset, uint8_t *data, uint32_t len)
+{
+    int32_t ret;
+
+    if (!erase_ahead_active || offset + len > BFLB_EFLASH_LOADER_IMG_MAX_LEN) {
+        return BFLB_EFLASH_LOADER_FLASH_WRITE_ADDR_ERROR;
+    }
+
+    ret = bflb_eflash_loader_erase_range(p_iap_param.iap_start_addr + offset, len);
+
+    if (ret == BFLB_EFLASH_LOADER_SUCCESS && SUCCESS != flash_write(p_iap_param.iap_start_addr + offset, data, len)) {
+        ret = BFLB_EFLASH_LOADER_FLASH_WRITE_ERROR;
+    }
+
+    if (ret != BFLB_EFLASH_LOADER_SUCCESS) {
+        g_eflash_loader_error = ret;
+        return ret;
+    }
+
+    p_iap_param.iap_write_addr = p_iap_param.iap_start_addr + offset + len;
+    return BFLB_EFLASH_LOADER_SUCCESS;
+}
+
+int32_t bflb_eflash_loader_image_read(uint32_t offset, uint8_t *data, uint32_t len)
+{
+    if (offset + len > BFLB_EFLASH_LOADER_IMG_MAX_LEN || SUCCESS != flash_read(p_iap_param.iap_start_addr + offset, data, len)) {
+        return BFLB_EFLASH_LOADER_FLASH_WRITE_ADDR_ERROR;
+    }
+
+    return BFLB_EFLASH_LOADER_SUCCESS;
+}
+
+/* the image is complete and checked, boot2 takes it from the inactive slot on the next reset */
+int32_t bflb_eflash_loader_image_finish(void)
+{
+    erase_ahead_active = 0;
+    MSG("erase ahead %d, inline %d, max %dus\n", erase_ahead_cnt, erase_inline_cnt, erase_max_us);
+
+    if (PT_ERROR_SUCCESS != pt_table_set_iap_para(&p_iap_param)) {
+        return BFLB_EFLASH_LOADER_FLASH_WRITE_ERROR;
+    }
+
+    pt_table_dump();
+    return BFLB_EFLASH_LOADER_SUCCESS;
+}
+
+/*
+ * Resumable transfers: a page is one sector of the image. Once a page has been
+ * written start to end and read back, its CRC is appended to a log in the last
+ * sector of the image area. The log is only ever appended to, so it costs one
+ * erase per transfer, and it survives a reset of the loader. After a reconnect
+ * the host asks which pages are logged and skips those whose CRC matches.
+ */
+static uint32_t bflb_eflash_loader_progress_addr(void)
+{
+    return p_iap_param.iap_start_addr + BFLB_EFLASH_LOADER_PROGRESS_OFFSET;
+}
+
+static uint32_t bflb_eflash_loader_progress_header_crc(void)
+{
+    return BFLB_Soft_CRC32(&progress_header, OFFSET(eflash_loader_progress_header_t, crc32));
+}
+
+/*forget the logged session, the sector is only erased when there is one*/
+static void bflb_eflash_loader_progress_clear(void)
+{
+    uint32_t magic;
+
+    progress_active = 0;
+    fill_page = PROGRESS_PAGE_NONE;
+
+    flash_read(bflb_eflash_loader_progress_addr(), (uint8_t *)&magic, sizeof(magic));
+
+    if (magic != 0xffffffff) {
+        flash_erase(bflb_eflash_loader_progress_addr(), BFLB_EFLASH_LOADER_SECTOR_SIZE);
+    }
+}
+
+static int32_t bflb_eflash_loader_progress_start(uint32_t img_len, uint32_t img_id)
+{
+    bflb_eflash_loader_progress_clear();
+
+    progress_header.magic = BFLB_EFLASH_LOADER_PROGRESS_MAGIC;
+    progress_header.img_len = img_len;
+    progress_header.img_id = img_id;
+    progress_header.crc32 = bflb_eflash_loader_progress_header_crc();
+
+    if (SUCCESS != flash_write(bflb_eflash_loader_progress_addr(), (uint8_t *)&progress_header, sizeof(progress_header))) {
+        return BFLB_EFLASH_LOADER_FLASH_WRITE_ERROR;
+    }
 
-    if (wdg) {
-        device_control(wdg, DEVICE_CTRL_SUSPEND, NULL);
+    memset(progress_map, 0, sizeof(progress_map));
+    progress_entries = 0;
+    progress_active = 1;
+    return BFLB_EFLASH_LOADER_SUCCESS;
+}
+
+/*rebuild the page map from the log, the session has to match the host's image*/
+static int32_t bflb_eflash_loader_progress_load(uint32_t img_len, uint32_t img_id)
+{
+    eflash_loader_progress_entry_t entry[8];
+    uint32_t addr = bflb_eflash_loader_progress_addr() + sizeof(eflash_loader_progress_header_t);
+    uint32_t i, n;
+
+    progress_active = 0;
+    progress_entries = 0;
+    memset(progress_map, 0, sizeof(progress_map));
+
+    flash_read(bflb_eflash_loader_progress_addr(), (uint8_t *)&progress_header, sizeof(progress_header));
+
+    if ((progress_header.magic != BFLB_EFLASH_LOADER_PROGRESS_MAGIC) || (progress_header.crc32 != bflb_eflash_loader_progress_header_crc()) ||
+        (progress_header.img_len != img_len) || (progress_header.img_id != img_id)) {
+        return BFLB_EFLASH_LOADER_FAIL;
+    }
+
+    for (n = 0; n < PROGRESS_ENTRY_MAX; n += 8) {
+        flash_read(addr + n * sizeof(entry[0]), (uint8_t *)entry, sizeof(entry));
+
+        for (i = 0; i < 8 && n + i < PROGRESS_ENTRY_MAX; i++) {
+            if (entry[i].page == 0xffff && entry[i].page_inv == 0xffff) {
+                progress_entries = n + i;
+                progress_active = 1;
+                return BFLB_EFLASH_LOADER_SUCCESS;
+            }
+
+            /*a torn append only loses its own page*/
+            if (entry[i].page_inv == (uint16_t)~entry[i].page && entry[i].page < BFLB_EFLASH_LOADER_PROGRESS_PAGES) {
+                progress_map[entry[i].page / 32] |= (1U << (entry[i].page % 32));
+                progress_crc[entry[i].page] = entry[i].crc32;
+            }
+        }
+    }
+
+    progress_entries = PROGRESS_ENTRY_MAX;
+    progress_active = 1;
+    return BFLB_EFLASH_LOADER_SUCCESS;
+}
+
+static void bflb_eflash_loader_progress_record(uint16_t page, uint32_t crc)
+{
+    eflash_loader_progress_entry_t entry;
+    uint32_t addr;
+
+    /*a full log only means this page is not resumable*/
+    if (progress_entries >= PROGRESS_ENTRY_MAX) {
+        return;
+    }
+
+    entry.page = page;
+    entry.page_inv = ~page;
+    entry.crc32 = crc;
+    addr = bflb_eflash_loader_progress_addr() + sizeof(eflash_loader_progress_header_t) + progress_entries * sizeof(entry);
+
+    if (SUCCESS == flash_write(addr, (uint8_t *)&entry, sizeof(entry))) {
+        progress_map[page / 32] |= (1U << (page % 32));
+        progress_crc[page] = crc;
+    }
+
+    progress_entries++;
+}
+
+/*called with the plaintext of every write that reached the flash*/
+static int32_t bflb_eflash_loader_progress_track(uint32_t write_addr, uint8_t *data, uint32_t len)
+{
+    uint8_t verify[256];
+    uint32_t offset, pos, n, i;
+    uint16_t page;
+
+    if (!progress_active || write_addr < p_iap_param.iap_start_addr ||
+        write_addr + len > p_iap_param.iap_start_addr + progress_header.img_len) {
+        return BFLB_EFLASH_LOADER_SUCCESS;
+    }
+
+    for (i = 0; i < len; i += n) {
+        n = (len - i > sizeof(verify)) ? sizeof(verify) : (len - i);
+        flash_read(write_addr + i, verify, n);
+
+        if (memcmp(verify, data + i, n)) {
+            MSG("verify fail %08x\n", write_addr + i);
+            fill_page = PROGRESS_PAGE_NONE;
+            return BFLB_EFLASH_LOADER_FLASH_WRITE_ERROR;
+        }
+    }
+
+    offset = write_addr - p_iap_param.iap_start_addr;
+
+    while (len) {
+        page = offset / BFLB_EFLASH_LOADER_SECTOR_SIZE;
+        pos = offset % BFLB_EFLASH_LOADER_SECTOR_SIZE;
+        n = (len > BFLB_EFLASH_LOADER_SECTOR_SIZE - pos) ? (BFLB_EFLASH_LOADER_SECTOR_SIZE - pos) : len;
+
+        if (pos == 0) {
+            fill_page = page;
+            fill_len = 0;
+            fill_crc = 0;
+        }
+
+        if (fill_page == page && fill_len == pos) {
+            fill_crc = BFLB_Soft_CRC32_Ex(fill_crc, data, n);
+            fill_len += n;
+
+            if (fill_len == BFLB_EFLASH_LOADER_SECTOR_SIZE || offset + n == progress_header.img_len) {
+                bflb_eflash_loader_progress_record(page, fill_crc);
+                fill_page = PROGRESS_PAGE_NONE;
+            }
+        } else {
+            fill_page = PROGRESS_PAGE_NONE;
+        }
+
+        offset += n;
+        data += n;
+        len -= n;
+    }
+
+    return BFLB_EFLASH_LOADER_SUCCESS;
+}
+
+/*
+ * Write check with a 12 byte payload: image length, image id (the host's CRC32
+ * of the plaintext image) and first page. The answer is the page count, first
+ * page, number of CRCs and a reserved half word, followed by the done bitmap and
+ * the CRCs of up to BFLB_EFLASH_LOADER_PROGRESS_QUERY_PAGES pages from first,
+ * 0 where a page is not done. No matching session answers zero pages.
+ */
+static int32_t bflb_eflash_loader_progress_query(uint8_t *data)
+{
+    uint8_t *ack = (uint8_t *)progress_ack_buf;
+    uint8_t *bitmap = ack + 12;
+    uint32_t img_len, img_id, first;
+    uint16_t pages = 0, count = 0, i, payload;
+    uint32_t crc;
+
+    memcpy(&img_len, data, 4);
+    memcpy(&img_id, data + 4, 4);
+    memcpy(&first, data + 8, 4);
+
+    if (img_len && img_len <= BFLB_EFLASH_LOADER_PROGRESS_OFFSET && bflb_eflash_loader_progress_load(img_len, img_id) == BFLB_EFLASH_LOADER_SUCCESS) {
+        pages = (img_len + BFLB_EFLASH_LOADER_SECTOR_SIZE - 1) / BFLB_EFLASH_LOADER_SECTOR_SIZE;
+
+        /*pick up where the session stopped, logged pages are never erased again*/
+        erase_ahead_active = 1;
+        fill_page = PROGRESS_PAGE_NONE;
+        p_iap_param.iap_img_len = img_len;
+        p_iap_param.iap_write_addr = 0;
+
+        for (i = 0; i < pages; i++) {
+            if (progress_map[i / 32] & (1U << (i % 32))) {
+                erase_map[i / 32] |= (1U << (i % 32));
+            } else if (!p_iap_param.iap_write_addr) {
+                p_iap_param.iap_write_addr = p_iap_param.iap_start_addr + i * BFLB_EFLASH_LOADER_SECTOR_SIZE;
+            }
+        }
+
+        if (!p_iap_param.iap_write_addr) {
+            p_iap_param.iap_write_addr = p_iap_param.iap_start_addr + img_len;
+        }
+    }
+
+    if (first < pages) {
+        count = (pages - first > BFLB_EFLASH_LOADER_PROGRESS_QUERY_PAGES) ? BFLB_EFLASH_LOADER_PROGRESS_QUERY_PAGES : (pages - first);
+    }
+
+    memset(bitmap, 0, (pages + 7) / 8);
+
+    for (i = 0; i < pages; i++) {
+        if (progress_map[i / 32] & (1U << (i % 32))) {
+            bitmap[i / 8] |= (1 << (i % 8));
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        crc = (progress_map[(first + i) / 32] & (1U << ((first + i) % 32))) ? progress_crc[first + i] : 0;
+        memcpy(bitmap + (pages + 7) / 8 + i * 4, &crc, 4);
     }
 
+    payload = 8 + (pages + 7) / 8 + count * 4;
+    progress_ack_buf[0] = BFLB_EFLASH_LOADER_CMD_ACK;
+    ack[2] = payload & 0xff;
+    ack[3] = (payload >> 8) & 0xff;
+    memcpy(ack + 4, &pages, 2);
+    ack[6] = first & 0xff;
+    ack[7] = (first >> 8) & 0xff;
+    memcpy(ack + 8, &count, 2);
+    ack[10] = 0;
+    ack[11] = 0;
+
+    bflb_eflash_loader_if_write(progress_ack_buf, payload + 4);
+    return BFLB_EFLASH_LOADER_SUCCESS;
+}
+
+/*
+ * Optional now: records the image length and restarts the erase tracking.
+ * The sectors themselves are erased ahead of the writes. A third word, the
+ * image id, makes the transfer resumable.
+ */
+static int32_t bflb_eflash_loader_cmd_erase_flash(uint16_t cmd, uint8_t *data, uint16_t len)
+{
+    int32_t ret = BFLB_EFLASH_LOADER_SUCCESS;
+    uint32_t startaddr, endaddr, img_id;
+
     MSG("E\n");
 
-    if (len != 8) {
+    if (len != 8 && len != 12) {
         ret = BFLB_EFLASH_LOADER_FLASH_ERASE_PARA_ERROR;
     } else {
         /*clean write error, since write usually behand erase*/
@@ -531,25 +1020,84 @@ static int32_t bflb_eflash_loader_cmd_erase_flash(uint16_t cmd, uint8_t *data, u
         memcpy(&startaddr, data, 4);
         memcpy(&endaddr, data + 4, 4);
 
+        /*a new transfer, plaintext unless the decrypt command follows*/
+        decrypt_active = 0;
+        bflb_eflash_loader_erase_start();
         p_iap_param.iap_img_len = endaddr - startaddr + 1;
 
         MSG("from%08xto%08x\n", p_iap_param.iap_start_addr, p_iap_param.iap_start_addr + p_iap_param.iap_img_len - 1);
 
-        if (SUCCESS != flash_erase(p_iap_param.iap_start_addr, p_iap_param.iap_img_len)) {
-            MSG("fail\n");
-            ret = BFLB_EFLASH_LOADER_FLASH_ERASE_ERROR;
+        if (p_iap_param.iap_img_len > BFLB_EFLASH_LOADER_IMG_MAX_LEN) {
+            ret = BFLB_EFLASH_LOADER_FLASH_ERASE_PARA_ERROR;
+        } else if (len == 12 && p_iap_param.iap_img_len <= BFLB_EFLASH_LOADER_PROGRESS_OFFSET) {
+            memcpy(&img_id, data + 8, 4);
+            ret = bflb_eflash_loader_progress_start(p_iap_param.iap_img_len, img_id);
         }
     }
 
-    if (wdg) {
-        device_control(wdg, DEVICE_CTRL_RST_WDT_COUNTER, NULL);
-        device_control(wdg, DEVICE_CTRL_RESUME, NULL);
+    bflb_eflash_loader_cmd_ack(ret);
+    return ret;
+}
+
+/*
+ * Encrypted transfer: the payload is the container header of blsp_boot_decrypt.h.
+ * The following writes inside [image start, image start + payload_len) carry
+ * AES-CTR ciphertext at the plaintext addresses and are decrypted with the
+ * efuse key before they reach the flash, so the image never travels in the clear.
+ * It lands in flash as plaintext on purpose: this is the path for single slot
+ * layouts, where boot2 has no second slot to install a container into and
+ * decrypting the running slot in place at boot is not power safe. With two slots
+ * the container is written as it is, without this command, and stays ciphertext
+ * in flash until boot2 installs it.
+ */
+static int32_t bflb_eflash_loader_cmd_decrypt_start(uint16_t cmd, uint8_t *data, uint16_t len)
+{
+    int32_t ret = BFLB_EFLASH_LOADER_SUCCESS;
+
+    MSG("D\n");
+
+    decrypt_active = 0;
+
+    if (len != sizeof(blsp_boot2_enc_img_header) || blsp_boot2_enc_img_parse(data, &decrypt_header) != BFLB_BOOT2_SUCCESS) {
+        ret = BFLB_EFLASH_LOADER_FLASH_WRITE_PARA_ERROR;
+    } else if ((decrypt_header.flags & BLSP_BOOT2_ENC_IMG_FLAG_XZ) || decrypt_header.payload_len > BFLB_EFLASH_LOADER_IMG_MAX_LEN) {
+        /*compressed containers go to an OTA slot whole and boot2 installs them*/
+        ret = BFLB_EFLASH_LOADER_FLASH_WRITE_PARA_ERROR;
+    } else {
+        decrypt_active = 1;
+        decrypt_start_addr = p_iap_param.iap_start_addr;
     }
 
     bflb_eflash_loader_cmd_ack(ret);
     return ret;
 }
 
+/*decrypt in place whatever part of a write falls in the ciphertext window*/
+static int32_t ATTR_TCM_SECTION bflb_eflash_loader_decrypt_write(uint32_t write_addr, uint8_t *data, uint32_t write_len)
+{
+    int32_t ret = BFLB_EFLASH_LOADER_SUCCESS;
+    uint32_t offset;
+
+    if (!decrypt_active || write_addr < decrypt_start_addr || write_addr >= decrypt_start_addr + decrypt_header.payload_len) {
+        return BFLB_EFLASH_LOADER_SUCCESS;
+    }
+
+    offset = write_addr - decrypt_start_addr;
+
+    if ((offset & 0x0f) || (write_len & 0x0f) || offset + write_len > decrypt_header.payload_len) {
+        return BFLB_EFLASH_LOADER_FLASH_WRITE_PARA_ERROR;
+    }
+
+    /*the BLE host shares the engine, it is taken and the key and counter set per write*/
+    if (blsp_boot2_decrypt_start(&decrypt_header, offset) != BFLB_BOOT2_SUCCESS ||
+        blsp_boot2_decrypt(data, data, write_len) != BFLB_BOOT2_SUCCESS) {
+        ret = BFLB_EFLASH_LOADER_FLASH_WRITE_ERROR;
+    }
+
+    blsp_boot2_decrypt_finish();
+    return ret;
+}
+
 static int32_t ATTR_TCM_SECTION bflb_eflash_loader_cmd_write_flash(uint16_t cmd, uint8_t *data, uint16_t len)
 {
     int32_t ret = BFLB_EFLASH_LOADER_SUCCESS;
@@ -565,15 +1113,34 @@ static int32_t ATTR_TCM_SECTION bflb_eflash_loader_cmd_write_flash(uint16_t cmd,
         write_len = len - 4;
         MSG("to%08x,%d\n", write_addr, write_len);
 
-        if (write_addr < 0xffffffff) {
+        /*a write to the image start begins a new transfer, with or without the erase command*/
+        if ((write_addr == p_iap_param.iap_start_addr) && (!erase_ahead_active || p_iap_param.iap_write_addr != write_addr)) {
+            bflb_eflash_loader_erase_start();
+        }
+
+        ret = bflb_eflash_loader_erase_range(write_addr, write_len);
+
+        if (ret == BFLB_EFLASH_LOADER_SUCCESS) {
+            ret = bflb_eflash_loader_decrypt_write(write_addr, data + 4, write_len);
+        }
+
+        if (ret != BFLB_EFLASH_LOADER_SUCCESS) {
+            g_eflash_loader_error = ret;
+        } else if (write_addr < 0xffffffff) {
             if (SUCCESS != flash_write(write_addr, data + 4, write_len)) {
                 /*error , response again with error */
                 MSG("fail\r\n");
                 ret = BFLB_EFLASH_LOADER_FLASH_WRITE_ERROR;
                 g_eflash_loader_error = ret;
+            } else if ((ret = bflb_eflash_loader_progress_track(write_addr, data + 4, write_len)) != BFLB_EFLASH_LOADER_SUCCESS) {
+                /*read back differs, the page is not logged and the host sends it again*/
             } else {
                 bflb_eflash_loader_cmd_ack(ret);
                 p_iap_param.iap_write_addr = write_addr + write_len;
+
+                if (erase_ahead_active && (write_addr + write_len - p_iap_param.iap_start_addr > p_iap_param.iap_img_len)) {
+                    p_iap_param.iap_img_len = write_addr + write_len - p_iap_param.iap_start_addr;
+                }
                 //bflb_eflash_loader_printe("Write suss\r\n");
                 return BFLB_EFLASH_LOADER_SUCCESS;
             }
@@ -693,6 +1260,10 @@ static int32_t bflb_eflash_loader_cmd_write_flash_check(uint16_t cmd, uint8_t *d
 {
     MSG("WC\n");
 
+    if (len == 12 && g_eflash_loader_error == BFLB_EFLASH_LOADER_SUCCESS) {
+        return bflb_eflash_loader_progress_query(data);
+    }
+
     bflb_eflash_loader_cmd_ack(g_eflash_loader_error);
 
     return BFLB_EFLASH_LOADER_SUCCESS;
@@ -63,6 +63,7 @@
 #define BFLB_EFLASH_LOADER_CMD_FLASH_CHIPERASE   0x003C
 #define BFLB_EFLASH_LOADER_CMD_FLASH_READSHA     0x003D
 #define BFLB_EFLASH_LOADER_CMD_FLASH_XIP_READSHA 0x003E
+#define BFLB_EFLASH_LOADER_CMD_FLASH_DECRYPT_START 0x003F
 
 #define BFLB_EFLASH_LOADER_CMD_FLASH_XIP_READ      0x0034
 #define BFLB_EFLASH_LOADER_CMD_FLASH_SBUS_XIP_READ 0x0035
@@ -103,6 +104,12 @@
 void bflb_eflash_loader_cmd_disable(uint8_t cmdid);
 void bflb_eflash_loader_cmd_enable(uint8_t cmdid);
 int32_t bflb_eflash_loader_cmd_process(uint8_t cmdid, uint8_t *data, uint16_t len);
+void bflb_eflash_loader_erase_ahead_poll(void);
+uint32_t bflb_eflash_loader_img_max_len(void);
+int32_t bflb_eflash_loader_image_start(uint32_t img_len);
+int32_t bflb_eflash_loader_image_write(uint32_t offset, uint8_t *data, uint32_t len);
+int32_t bflb_eflash_loader_image_read(uint32_t offset, uint8_t *data, uint32_t len);
+int32_t bflb_eflash_loader_image_finish(void);
 
 typedef int32_t (*pfun_cmd_process)(uint16_t cmd, uint8_t *data, uint16_t len);
 
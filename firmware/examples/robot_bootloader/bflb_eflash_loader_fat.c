@@ -0,0 +1,607 @@
+/**
+  ******************************************************************************
+  * @file    bflb_eflash_loader_fat.c
+  * @version V1.2
+  * @date
+  * @brief   This file is the peripheral case c file
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT(c) 2018 Bouffalo Lab</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+#include "string.h"
+#include "bflb_eflash_loader_fat.h"
+
+#define FAT_CLUSTER_SIZE  (BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE * BFLB_EFLASH_LOADER_FAT_CLUSTER_SECTORS)
+/*12 bit entries for the clusters and the two reserved ones*/
+#define FAT_SECTORS       ((((BFLB_EFLASH_LOADER_FAT_CLUSTERS + 2) * 3 + 1) / 2 + BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE - 1) / BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE)
+#define FAT_COPIES        2
+#define FAT_ROOT_SECTORS  (BFLB_EFLASH_LOADER_FAT_ROOT_ENTRIES * 32 / BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE)
+#define FAT_TABLE_START   1
+#define FAT_ROOT_START    (FAT_TABLE_START + FAT_COPIES * FAT_SECTORS)
+#define FAT_DATA_START    (FAT_ROOT_START + FAT_ROOT_SECTORS)
+#define FAT_TOTAL_SECTORS (FAT_DATA_START + BFLB_EFLASH_LOADER_FAT_CLUSTERS * BFLB_EFLASH_LOADER_FAT_CLUSTER_SECTORS)
+#define FAT_FIRST_CLUSTER 2
+#define FAT_LAST_CLUSTER  (FAT_FIRST_CLUSTER + BFLB_EFLASH_LOADER_FAT_CLUSTERS - 1)
+#define FAT_EOC           0xFFF
+
+#define FAT_STATUS_CLUSTER FAT_FIRST_CLUSTER
+#define FAT_LABEL          "TRAIN BOOT "
+#define FAT_STATUS_NAME    "STATUS  TXT"
+
+/*directory entry fields*/
+#define DIR_ENTRY_SIZE   32
+#define DIR_ATTR         11
+#define DIR_CLUSTER      26
+#define DIR_SIZE         28
+#define DIR_ATTR_RO      0x01
+#define DIR_ATTR_VOLUME  0x08
+#define DIR_ATTR_DIR     0x10
+#define DIR_ATTR_LFN     0x0F
+#define DIR_NAME_END     0x00
+#define DIR_NAME_DELETED 0xE5
+
+static const eflash_loader_fat_sink_t *fat_sink;
+static const char *fat_status;
+static uint8_t fat_table[FAT_SECTORS * BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE];
+static uint8_t fat_root[FAT_ROOT_SECTORS * BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE];
+
+/*clusters the stream went through so far, in file order*/
+static eflash_loader_fat_state_t stream_state;
+static uint16_t stream_clusters[BFLB_EFLASH_LOADER_FAT_FILE_CLUSTERS];
+static uint32_t stream_count;
+static uint32_t stream_offset;
+/*file size from the directory, 0 until the host writes the entry*/
+static uint32_t stream_size;
+/*sector expected next, 0 if the stream cannot go on*/
+static uint32_t stream_next;
+/*clusters the host wrote that were not streamed, until they are freed again*/
+static uint8_t fat_missed[(BFLB_EFLASH_LOADER_FAT_CLUSTERS + 7) / 8];
+
+static uint16_t fat_get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t fat_get32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void fat_put16(uint8_t *p, uint16_t val)
+{
+    p[0] = val & 0xff;
+    p[1] = val >> 8;
+}
+
+static void fat_put32(uint8_t *p, uint32_t val)
+{
+    fat_put16(p, val & 0xffff);
+    fat_put16(p + 2, val >> 16);
+}
+
+static uint16_t fat_entry_get(uint32_t cluster)
+{
+    uint16_t val = fat_get16(&fat_table[cluster + cluster / 2]);
+
+    return (cluster & 1) ? (val >> 4) : (val & 0xfff);
+}
+
+static void fat_entry_set(uint32_t cluster, uint16_t val)
+{
+    uint8_t *p = &fat_table[cluster + cluster / 2];
+
+    if (cluster & 1) {
+        p[0] = (p[0] & 0x0f) | ((val & 0x0f) << 4);
+        p[1] = val >> 4;
+    } else {
+        p[0] = val & 0xff;
+        p[1] = (p[1] & 0xf0) | ((val >> 8) & 0x0f);
+    }
+}
+
+static int fat_missed_get(uint32_t cluster)
+{
+    cluster -= FAT_FIRST_CLUSTER;
+
+    return (fat_missed[cluster / 8] >> (cluster % 8)) & 1;
+}
+
+static void fat_missed_set(uint32_t cluster, int missed)
+{
+    cluster -= FAT_FIRST_CLUSTER;
+
+    if (missed) {
+        fat_missed[cluster / 8] |= 1 << (cluster % 8);
+    } else {
+        fat_missed[cluster / 8] &= ~(1 << (cluster % 8));
+    }
+}
+
+static uint32_t fat_cluster_sector(uint32_t cluster)
+{
+    if (cluster < FAT_FIRST_CLUSTER || cluster > FAT_LAST_CLUSTER) {
+        return 0;
+    }
+
+    return FAT_DATA_START + (cluster - FAT_FIRST_CLUSTER) * BFLB_EFLASH_LOADER_FAT_CLUSTER_SECTORS;
+}
+
+static void fat_boot_sector(uint8_t *data)
+{
+    data[0] = 0xEB;
+    data[1] = 0x3C;
+    data[2] = 0x90;
+    memcpy(&data[3], "MSWIN4.1", 8);
+    fat_put16(&data[11], BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE);
+    data[13] = BFLB_EFLASH_LOADER_FAT_CLUSTER_SECTORS;
+    fat_put16(&data[14], FAT_TABLE_START);
+    data[16] = FAT_COPIES;
+    fat_put16(&data[17], BFLB_EFLASH_LOADER_FAT_ROOT_ENTRIES);
+    fat_put16(&data[19], FAT_TOTAL_SECTORS);
+    data[21] = 0xF8;
+    fat_put16(&data[22], FAT_SECTORS);
+    fat_put16(&data[24], 63);
+    fat_put16(&data[26], 255);
+    data[36] = 0x80;
+    data[38] = 0x29;
+    fat_put32(&data[39], 0x07020B00);
+    memcpy(&data[43], FAT_LABEL, 11);
+    memcpy(&data[54], "FAT12   ", 8);
+    data[510] = 0x55;
+    data[511] = 0xAA;
+}
+
+/* a firmware file in the root directory, not a hidden one like the ._ files of macOS */
+static int fat_dir_is_bin(const uint8_t *entry)
+{
+    if (entry[0] == DIR_NAME_DELETED || entry[0] == '.' || entry[0] == '_') {
+        return 0;
+    }
+
+    if (entry[DIR_ATTR] == DIR_ATTR_LFN || (entry[DIR_ATTR] & (DIR_ATTR_VOLUME | DIR_ATTR_DIR))) {
+        return 0;
+    }
+
+    return memcmp(&entry[8], "BIN", 3) == 0;
+}
+
+/* size of the firmware file starting at cluster, 0 if there is none or the host has not sized it yet */
+static uint32_t fat_dir_size(uint32_t cluster)
+{
+    const uint8_t *entry;
+
+    for (entry = fat_root; entry < fat_root + sizeof(fat_root); entry += DIR_ENTRY_SIZE) {
+        if (entry[0] == DIR_NAME_END) {
+            break;
+        }
+
+        if (fat_dir_is_bin(entry) && fat_get16(&entry[DIR_CLUSTER]) == cluster) {
+            return fat_get32(&entry[DIR_SIZE]);
+        }
+    }
+
+    return 0;
+}
+
+static uint8_t *fat_dir_status(void)
+{
+    uint8_t *entry;
+
+    for (entry = fat_root; entry < fat_root + sizeof(fat_root); entry += DIR_ENTRY_SIZE) {
+        if (memcmp(entry, FAT_STATUS_NAME, 11) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/* index of cluster in the stream, -1 if the stream has not been there */
+static int32_t fat_stream_index(uint32_t cluster)
+{
+    uint32_t i;
+
+    if (stream_state == EFLASH_LOADER_FAT_IDLE) {
+        return -1;
+    }
+
+    for (i = 0; i < stream_count; i++) {
+        if (stream_clusters[i] == cluster) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void fat_stream_fail(int32_t error)
+{
+    stream_state = EFLASH_LOADER_FAT_ERROR;
+    stream_next = 0;
+    fat_sink->abort(error);
+}
+
+static void fat_stream_finish(uint32_t size)
+{
+    int32_t ret = fat_sink->finish(size);
+
+    if (ret == BFLB_EFLASH_LOADER_FAT_WAIT) {
+        return;
+    }
+
+    stream_state = (ret == 0) ? EFLASH_LOADER_FAT_DONE : EFLASH_LOADER_FAT_ERROR;
+    stream_next = 0;
+}
+
+/*
+ * The stream goes on where the FAT says. Most hosts write the data before
+ * the FAT, then the next cluster is taken to be the following one, which is
+ * what a host allocates on a disk that is empty but for STATUS.TXT. The FAT,
+ * once written, is checked against the clusters taken, and a next cluster the
+ * host already wrote has gone by for good.
+ */
+static void fat_stream_predict(int32_t error)
+{
+    uint32_t last = stream_clusters[stream_count - 1];
+    uint32_t next = fat_entry_get(last);
+
+    if (next < FAT_FIRST_CLUSTER || next > FAT_LAST_CLUSTER) {
+        next = last + 1;
+    } else if (fat_missed_get(next)) {
+        fat_stream_fail(error);
+        return;
+    }
+
+    stream_next = fat_cluster_sector(next);
+}
+
+static void fat_stream_start(uint32_t cluster)
+{
+    stream_state = EFLASH_LOADER_FAT_STREAM;
+    stream_count = 0;
+    stream_offset = 0;
+    stream_size = fat_dir_size(cluster);
+    stream_next = fat_cluster_sector(cluster);
+}
+
+static int32_t fat_stream_append(uint32_t sector, const uint8_t *data)
+{
+    uint32_t pos = (sector - FAT_DATA_START) % BFLB_EFLASH_LOADER_FAT_CLUSTER_SECTORS;
+    uint32_t len = BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE;
+    int32_t ret;
+
+    if (pos == 0) {
+        if (stream_count == BFLB_EFLASH_LOADER_FAT_FILE_CLUSTERS) {
+            fat_stream_fail(BFLB_EFLASH_LOADER_FAT_SIZE_ERROR);
+            return 0;
+        }
+
+        stream_clusters[stream_count] = FAT_FIRST_CLUSTER + (sector - FAT_DATA_START) / BFLB_EFLASH_LOADER_FAT_CLUSTER_SECTORS;
+        fat_missed_set(stream_clusters[stream_count++], 0);
+    }
+
+    /*the last sector of a file of known size is only partly file*/
+    if (stream_size && stream_offset + len > stream_size) {
+        len = stream_size - stream_offset;
+    }
+
+    ret = fat_sink->write(stream_offset, data, len);
+
+    if (ret != 0) {
+        fat_stream_fail(ret);
+        return 0;
+    }
+
+    stream_offset += len;
+
+    if (pos + 1 < BFLB_EFLASH_LOADER_FAT_CLUSTER_SECTORS) {
+        stream_next = sector + 1;
+    } else {
+        fat_stream_predict(BFLB_EFLASH_LOADER_FAT_ORDER_ERROR);
+    }
+
+    if (stream_state == EFLASH_LOADER_FAT_STREAM && stream_size && stream_offset >= stream_size) {
+        fat_stream_finish(stream_size);
+    }
+
+    return 0;
+}
+
+/* hosts may write a sector twice, fine as long as it does not change */
+static int fat_stream_same(uint32_t offset, const uint8_t *data)
+{
+    uint8_t old[BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE];
+    uint32_t len = stream_offset - offset;
+
+    if (len > sizeof(old)) {
+        len = sizeof(old);
+    }
+
+    return fat_sink->read(offset, old, len) == 0 && memcmp(old, data, len) == 0;
+}
+
+/* nonzero if the FAT chain after the stream's last cluster reaches cluster */
+static int fat_stream_ahead(uint32_t cluster)
+{
+    uint32_t next, i;
+
+    if (!stream_count) {
+        return 0;
+    }
+
+    next = stream_clusters[stream_count - 1];
+
+    for (i = stream_count; i < BFLB_EFLASH_LOADER_FAT_FILE_CLUSTERS; i++) {
+        next = fat_entry_get(next);
+
+        if (next < FAT_FIRST_CLUSTER || next > FAT_LAST_CLUSTER) {
+            return 0;
+        }
+
+        if (next == cluster) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int32_t fat_data_write(uint32_t sector, const uint8_t *data)
+{
+    uint32_t cluster = FAT_FIRST_CLUSTER + (sector - FAT_DATA_START) / BFLB_EFLASH_LOADER_FAT_CLUSTER_SECTORS;
+    uint32_t pos = (sector - FAT_DATA_START) % BFLB_EFLASH_LOADER_FAT_CLUSTER_SECTORS;
+    uint32_t offset;
+    int32_t idx;
+
+    if (stream_state == EFLASH_LOADER_FAT_STREAM && sector == stream_next) {
+        return fat_stream_append(sector, data);
+    }
+
+    idx = fat_stream_index(cluster);
+
+    if (idx >= 0 && stream_state != EFLASH_LOADER_FAT_ERROR) {
+        offset = idx * FAT_CLUSTER_SIZE + pos * BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE;
+
+        if (offset < stream_offset) {
+            if (fat_stream_same(offset, data)) {
+                return 0;
+            }
+
+            if (stream_state == EFLASH_LOADER_FAT_STREAM) {
+                fat_stream_fail(BFLB_EFLASH_LOADER_FAT_REWRITE_ERROR);
+                return 0;
+            }
+        }
+    }
+
+    if (stream_state == EFLASH_LOADER_FAT_STREAM && (idx >= 0 || fat_stream_ahead(cluster))) {
+        /*data of this file past a gap, it cannot be streamed*/
+        fat_stream_fail(BFLB_EFLASH_LOADER_FAT_ORDER_ERROR);
+        return 0;
+    }
+
+    /*a new image, whatever happened to the one before*/
+    if (pos == 0 && (fat_sink->probe(data) || fat_dir_size(cluster))) {
+        if (stream_state == EFLASH_LOADER_FAT_STREAM) {
+            fat_stream_fail(BFLB_EFLASH_LOADER_FAT_ORDER_ERROR);
+        }
+
+        fat_stream_start(cluster);
+        return fat_stream_append(sector, data);
+    }
+
+    /*any other file, nothing of it is kept*/
+    fat_missed_set(cluster, 1);
+    return 0;
+}
+
+static void fat_table_changed(void)
+{
+    uint32_t i, next;
+
+    for (i = FAT_FIRST_CLUSTER; i <= FAT_LAST_CLUSTER; i++) {
+        if (fat_entry_get(i) == 0) {
+            fat_missed_set(i, 0);
+        }
+    }
+
+    if (stream_state != EFLASH_LOADER_FAT_STREAM || !stream_count) {
+        return;
+    }
+
+    /*a free entry is a FAT not written yet, anything else must be the chain streamed*/
+    for (i = 0; i + 1 < stream_count; i++) {
+        next = fat_entry_get(stream_clusters[i]);
+
+        if (next != 0 && next != stream_clusters[i + 1]) {
+            fat_stream_fail(BFLB_EFLASH_LOADER_FAT_FRAGMENTED_ERROR);
+            return;
+        }
+    }
+
+    /*between clusters, the next one is now known*/
+    if (stream_offset % FAT_CLUSTER_SIZE == 0) {
+        fat_stream_predict(BFLB_EFLASH_LOADER_FAT_FRAGMENTED_ERROR);
+    }
+}
+
+static void fat_dir_changed(void)
+{
+    uint32_t size;
+
+    if (stream_state != EFLASH_LOADER_FAT_STREAM || stream_size || !stream_count) {
+        return;
+    }
+
+    size = fat_dir_size(stream_clusters[0]);
+
+    if (!size) {
+        return;
+    }
+
+    if (size > BFLB_EFLASH_LOADER_FAT_FILE_CLUSTERS * FAT_CLUSTER_SIZE) {
+        fat_stream_fail(BFLB_EFLASH_LOADER_FAT_SIZE_ERROR);
+        return;
+    }
+
+    stream_size = size;
+
+    if (stream_offset >= stream_size) {
+        fat_stream_finish(stream_size);
+    }
+}
+
+void bflb_eflash_loader_fat_init(const eflash_loader_fat_sink_t *sink, const char *status)
+{
+    fat_sink = sink;
+
+    memset(fat_table, 0, sizeof(fat_table));
+    fat_entry_set(0, 0xFF8);
+    fat_entry_set(1, FAT_EOC);
+    fat_entry_set(FAT_STATUS_CLUSTER, FAT_EOC);
+
+    memset(fat_missed, 0, sizeof(fat_missed));
+    memset(fat_root, 0, sizeof(fat_root));
+    memcpy(&fat_root[0], FAT_LABEL, 11);
+    fat_root[DIR_ATTR] = DIR_ATTR_VOLUME;
+    memcpy(&fat_root[DIR_ENTRY_SIZE], FAT_STATUS_NAME, 11);
+    fat_root[DIR_ENTRY_SIZE + DIR_ATTR] = DIR_ATTR_RO;
+    fat_put16(&fat_root[DIR_ENTRY_SIZE + DIR_CLUSTER], FAT_STATUS_CLUSTER);
+
+    stream_state = EFLASH_LOADER_FAT_IDLE;
+    stream_count = 0;
+    stream_offset = 0;
+    stream_size = 0;
+    stream_next = 0;
+
+    bflb_eflash_loader_fat_set_status(status);
+}
+
+uint32_t bflb_eflash_loader_fat_sectors(void)
+{
+    return FAT_TOTAL_SECTORS;
+}
+
+/*
+ * The host only sees the status file in the open, until it is remounted
+ * it keeps what it read before.
+ */
+void bflb_eflash_loader_fat_set_status(const char *status)
+{
+    uint8_t *entry = fat_dir_status();
+    uint32_t len = strlen(status);
+
+    fat_status = status;
+
+    if (entry) {
+        fat_put32(&entry[DIR_SIZE], (len > FAT_CLUSTER_SIZE) ? FAT_CLUSTER_SIZE : len);
+    }
+}
+
+int32_t bflb_eflash_loader_fat_read(uint32_t sector, uint8_t *data)
+{
+    uint32_t cluster, offset, len;
+    int32_t idx;
+
+    memset(data, 0, BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE);
+
+    if (sector == 0) {
+        fat_boot_sector(data);
+    } else if (sector < FAT_ROOT_START) {
+        memcpy(data, &fat_table[((sector - FAT_TABLE_START) % FAT_SECTORS) * BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE], BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE);
+    } else if (sector < FAT_DATA_START) {
+        memcpy(data, &fat_root[(sector - FAT_ROOT_START) * BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE], BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE);
+    } else if (sector < FAT_TOTAL_SECTORS) {
+        cluster = FAT_FIRST_CLUSTER + (sector - FAT_DATA_START) / BFLB_EFLASH_LOADER_FAT_CLUSTER_SECTORS;
+        offset = ((sector - FAT_DATA_START) % BFLB_EFLASH_LOADER_FAT_CLUSTER_SECTORS) * BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE;
+        idx = fat_stream_index(cluster);
+
+        if (idx >= 0) {
+            /*the image as far as it got into flash*/
+            offset += idx * FAT_CLUSTER_SIZE;
+
+            if (offset < stream_offset) {
+                len = stream_offset - offset;
+                return fat_sink->read(offset, data, (len > BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE) ? BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE : len);
+            }
+        } else if (cluster == FAT_STATUS_CLUSTER) {
+            len = strlen(fat_status);
+
+            if (offset < len) {
+                len -= offset;
+                memcpy(data, fat_status + offset, (len > BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE) ? BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE : len);
+            }
+        }
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+int32_t bflb_eflash_loader_fat_write(uint32_t sector, const uint8_t *data)
+{
+    if (sector == 0) {
+        /*the layout is fixed, a format is not kept*/
+        return 0;
+    } else if (sector < FAT_ROOT_START) {
+        /*both copies land in the one table*/
+        memcpy(&fat_table[((sector - FAT_TABLE_START) % FAT_SECTORS) * BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE], data, BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE);
+        fat_table_changed();
+    } else if (sector < FAT_DATA_START) {
+        memcpy(&fat_root[(sector - FAT_ROOT_START) * BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE], data, BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE);
+        fat_dir_changed();
+    } else if (sector < FAT_TOTAL_SECTORS) {
+        return fat_data_write(sector, data);
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* the host went quiet: end a stream whose directory entry has not come */
+int32_t bflb_eflash_loader_fat_flush(void)
+{
+    if (stream_state == EFLASH_LOADER_FAT_STREAM) {
+        fat_stream_finish(stream_size);
+    }
+
+    return 0;
+}
+
+eflash_loader_fat_state_t bflb_eflash_loader_fat_state(void)
+{
+    return stream_state;
+}
+
+uint32_t bflb_eflash_loader_fat_streamed(void)
+{
+    return stream_offset;
+}
@@ -0,0 +1,95 @@
+/**
+  ******************************************************************************
+  * @file    bflb_eflash_loader_fat.h
+  * @version V1.2
+  * @date
+  * @brief   This file is the peripheral case header file
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT(c) 2018 Bouffalo Lab</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+#ifndef __BFLB_EFLASH_LOADER_FAT_H__
+#define __BFLB_EFLASH_LOADER_FAT_H__
+
+#include "stdint.h"
+
+/*
+ * Virtual FAT12 disk for drag and drop updates. Nothing of it is stored but
+ * the FAT, the root directory and the firmware stream: a file that starts
+ * with an image the sink recognizes is handed to it sector by sector while
+ * the host writes it, and the host sees STATUS.TXT with the last result.
+ *
+ * 2 MB volume, 512 byte sectors, 4 KB clusters, so a cluster is one flash
+ * sector of the image.
+ */
+#define BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE     512
+#define BFLB_EFLASH_LOADER_FAT_CLUSTER_SECTORS 8
+#define BFLB_EFLASH_LOADER_FAT_CLUSTERS        512
+#define BFLB_EFLASH_LOADER_FAT_ROOT_ENTRIES    64
+/*longest file that can be streamed, 1 MB*/
+#define BFLB_EFLASH_LOADER_FAT_FILE_CLUSTERS   256
+
+/*errors of the stream itself, next to the sink's own codes*/
+#define BFLB_EFLASH_LOADER_FAT_ORDER_ERROR      0x0501 /*the host skipped ahead inside the file*/
+#define BFLB_EFLASH_LOADER_FAT_FRAGMENTED_ERROR 0x0502 /*the FAT chain is not the clusters streamed*/
+#define BFLB_EFLASH_LOADER_FAT_SIZE_ERROR       0x0503 /*file larger than a stream can hold*/
+#define BFLB_EFLASH_LOADER_FAT_REWRITE_ERROR    0x0504 /*a streamed sector was written again with other data*/
+
+/*sink answer to finish() while the image length is still unknown*/
+#define BFLB_EFLASH_LOADER_FAT_WAIT 1
+
+typedef enum {
+    EFLASH_LOADER_FAT_IDLE,
+    EFLASH_LOADER_FAT_STREAM,
+    EFLASH_LOADER_FAT_DONE,
+    EFLASH_LOADER_FAT_ERROR,
+} eflash_loader_fat_state_t;
+
+typedef struct {
+    /* nonzero for the first sector of an image, starts a stream */
+    int32_t (*probe)(const uint8_t *data);
+    /* len bytes at offset of the file, offsets go up one sector per call */
+    int32_t (*write)(uint32_t offset, const uint8_t *data, uint32_t len);
+    /* read back what write() took */
+    int32_t (*read)(uint32_t offset, uint8_t *data, uint32_t len);
+    /* the file is complete, size 0 if the host has not told its size yet */
+    int32_t (*finish)(uint32_t size);
+    /* the stream ended with error, nothing more comes */
+    void (*abort)(int32_t error);
+} eflash_loader_fat_sink_t;
+
+void bflb_eflash_loader_fat_init(const eflash_loader_fat_sink_t *sink, const char *status);
+uint32_t bflb_eflash_loader_fat_sectors(void);
+int32_t bflb_eflash_loader_fat_read(uint32_t sector, uint8_t *data);
+int32_t bflb_eflash_loader_fat_write(uint32_t sector, const uint8_t *data);
+int32_t bflb_eflash_loader_fat_flush(void);
+void bflb_eflash_loader_fat_set_status(const char *status);
+eflash_loader_fat_state_t bflb_eflash_loader_fat_state(void);
+uint32_t bflb_eflash_loader_fat_streamed(void);
+
+#endif /* __BFLB_EFLASH_LOADER_FAT_H__ */
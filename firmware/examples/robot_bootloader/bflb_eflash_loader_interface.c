@@ -70,6 +70,11 @@ int32_t bflb_eflash_loader_if_init()
 
 int32_t bflb_eflash_loader_if_handshake_poll(uint32_t timeout)
 {
+    /*fast boot starts no interface*/
+    if (eflash_loader_if_cfg.boot_if_handshake_poll == NULL) {
+        return -1;
+    }
+
 	return eflash_loader_if_cfg.boot_if_handshake_poll(timeout);
 }
 
@@ -0,0 +1,493 @@
+/**
+  ******************************************************************************
+  * @file    bflb_eflash_loader_usb.c
+  * @version V1.2
+  * @date
+  * @brief   This file is the peripheral case c file
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT(c) 2018 Bouffalo Lab</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+#include "bflb_eflash_loader.h"
+#include "bflb_eflash_loader_fat.h"
+#include "bflb_eflash_loader_usb.h"
+#include "bflb_platform.h"
+#include "blsp_bootinfo.h"
+#include "blsp_boot_decrypt.h"
+#include "blsp_boot_decompress.h"
+#include "hal_boot2.h"
+#include "hal_usb.h"
+#include "hal_sec_hash.h"
+#include "bl702_glb.h"
+#include "usbd_core.h"
+#include "usbd_msc.h"
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+#include "stdio.h"
+#include "string.h"
+
+#define USB_LOADER_OUT_EP 0x01
+#define USB_LOADER_IN_EP  0x82
+#define USB_LOADER_TOTAL  (9 + MSC_DESCRIPTOR_LEN)
+
+#define USB_REQ_NONE  0
+#define USB_REQ_READ  1
+#define USB_REQ_WRITE 2
+
+/*images the drive takes, see upgrade_firmware.py*/
+#define USB_IMG_NONE 0
+#define USB_IMG_BOOT 1 /*boot header, the data 4K in*/
+#define USB_IMG_ENC  2 /*container of blsp_boot_decrypt.h*/
+#define USB_IMG_XZ   3 /*xz stream, its length is only known from the directory*/
+
+/*the host needs a moment without the pull-up to see the drive go*/
+#define USB_RECONNECT_MS 200
+
+extern struct device *usb_dc_init(void);
+extern struct device *dev_check_hash;
+
+static const uint8_t usb_loader_descriptor[] = {
+    USB_DEVICE_DESCRIPTOR_INIT(USB_2_0, 0x00, 0x00, 0x00, 0xFFFF, 0xFFFF, 0x0001, 0x01),
+    USB_CONFIG_DESCRIPTOR_INIT(USB_LOADER_TOTAL, 0x01, 0x01, USB_CONFIG_BUS_POWERED, 100),
+    MSC_DESCRIPTOR_INIT(0x00, USB_LOADER_OUT_EP, USB_LOADER_IN_EP, 0x00),
+
+    USB_LANGID_INIT(0x0409),
+    0x18, USB_DESCRIPTOR_TYPE_STRING,
+    'B', 0x00, 'o', 0x00, 'u', 0x00, 'f', 0x00, 'f', 0x00, 'a', 0x00, 'l', 0x00, 'o', 0x00, 'l', 0x00,
+    'a', 0x00, 'b', 0x00,
+    0x16, USB_DESCRIPTOR_TYPE_STRING,
+    'T', 0x00, 'r', 0x00, 'a', 0x00, 'i', 0x00, 'n', 0x00, ' ', 0x00, 'B', 0x00, 'o', 0x00, 'o', 0x00,
+    't', 0x00,
+    0x0A, USB_DESCRIPTOR_TYPE_STRING,
+    '0', 0x00, '7', 0x00, '0', 0x00, '2', 0x00,
+    0x00
+};
+
+static const char usb_status_ready[] =
+    "Copy a firmware .bin onto this drive to update.\r\n"
+    "Boot images, encrypted containers and xz images are taken.\r\n"
+    "This file shows the result once the drive comes back.\r\n";
+
+static struct device *usb;
+static SemaphoreHandle_t usb_req_sem;
+static char usb_status[160];
+
+/*block the usb interrupt handed over, the loader task serves it*/
+static volatile uint8_t usb_req_dir;
+static volatile uint32_t usb_req_sector;
+static uint8_t *volatile usb_req_buf;
+
+static TickType_t usb_last_active;
+static TickType_t usb_last_write;
+static uint8_t usb_reconnect;
+static uint8_t usb_reset;
+static TickType_t usb_reset_tick;
+
+static uint8_t img_type;
+/*bytes the image has, 0 while unknown*/
+static uint32_t img_expect;
+static uint32_t img_written;
+/*sha256 of the boot image data, from the header*/
+static uint8_t img_hash_on;
+static uint32_t img_hash_end;
+static uint8_t img_hash[32];
+
+void usbd_msc_get_cap(uint8_t lun, uint32_t *block_num, uint16_t *block_size)
+{
+    *block_num = bflb_eflash_loader_fat_sectors();
+    *block_size = BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE;
+}
+
+/*
+ * Flash erase and write mask interrupts, so nothing of the drive runs in the
+ * usb interrupt. The block goes to the loader task and the endpoint NAKs
+ * until usbd_msc_sector_done(), which keeps the host in step with the flash.
+ */
+static int usb_loader_request(uint8_t dir, uint32_t sector, uint8_t *buffer)
+{
+    BaseType_t woken = pdFALSE;
+
+    usb_req_sector = sector;
+    usb_req_buf = buffer;
+    usb_req_dir = dir;
+    xSemaphoreGiveFromISR(usb_req_sem, &woken);
+    portYIELD_FROM_ISR(woken);
+
+    return USBD_MSC_PENDING;
+}
+
+int usbd_msc_sector_read(uint32_t sector, uint8_t *buffer, uint32_t length)
+{
+    return usb_loader_request(USB_REQ_READ, sector, buffer);
+}
+
+int usbd_msc_sector_write(uint32_t sector, uint8_t *buffer, uint32_t length)
+{
+    return usb_loader_request(USB_REQ_WRITE, sector, buffer);
+}
+
+static const char *usb_loader_reason(int32_t error)
+{
+    switch (error) {
+        case BFLB_EFLASH_LOADER_IMG_BOOTHEADER_MAGIC_ERROR:
+            return "not a boot image";
+        case BFLB_EFLASH_LOADER_IMG_BOOTHEADER_CRC_ERROR:
+            return "header CRC mismatch";
+        case BFLB_EFLASH_LOADER_IMG_DEC_ERROR:
+            return "bad encrypted container header";
+        case BFLB_EFLASH_LOADER_IMG_HASH_ERROR:
+            return "SHA256 mismatch";
+        case BFLB_EFLASH_LOADER_IMG_HALFBAKED_ERROR:
+            return "file shorter than its image";
+        case BFLB_EFLASH_LOADER_FLASH_WRITE_PARA_ERROR:
+        case BFLB_EFLASH_LOADER_FAT_SIZE_ERROR:
+            return "image too large";
+        case BFLB_EFLASH_LOADER_FLASH_ERASE_ERROR:
+        case BFLB_EFLASH_LOADER_FLASH_WRITE_ERROR:
+            return "flash error";
+        case BFLB_EFLASH_LOADER_FLASH_WRITE_ADDR_ERROR:
+            return "no valid partition table";
+        case BFLB_EFLASH_LOADER_FAT_ORDER_ERROR:
+            return "host wrote the file out of order";
+        case BFLB_EFLASH_LOADER_FAT_FRAGMENTED_ERROR:
+            return "file is fragmented, delete the other files and copy again";
+        case BFLB_EFLASH_LOADER_FAT_REWRITE_ERROR:
+            return "file changed while it was copied";
+        default:
+            return "error";
+    }
+}
+
+static void usb_loader_fail(int32_t error)
+{
+    if (img_hash_on) {
+        img_hash_on = 0;
+        device_close(dev_check_hash);
+    }
+
+    MSG("usb update fail %04x\r\n", error);
+    snprintf(usb_status, sizeof(usb_status), "FAIL 0x%04x: %s\r\nThe current firmware is kept.\r\n", (unsigned int)error, usb_loader_reason(error));
+    bflb_eflash_loader_fat_set_status(usb_status);
+    usb_reconnect = 1;
+}
+
+static int32_t usb_img_probe(const uint8_t *data)
+{
+    if (memcmp(data, "BFNP", 4) == 0) {
+        return USB_IMG_BOOT;
+    }
+
+    if (memcmp(data, BLSP_BOOT2_ENC_IMG_MAGIC, 4) == 0) {
+        return USB_IMG_ENC;
+    }
+
+    if (blsp_boot2_verify_xz_header((uint8_t *)data)) {
+        return USB_IMG_XZ;
+    }
+
+    return USB_IMG_NONE;
+}
+
+/* the first sector tells how long the image is and how to check it */
+static int32_t usb_img_start(const uint8_t *data)
+{
+    struct bootheader_t *header = (struct bootheader_t *)data;
+    blsp_boot2_enc_img_header enc;
+
+    img_type = usb_img_probe(data);
+    img_expect = 0;
+    img_written = 0;
+    img_hash_on = 0;
+
+    if (img_type == USB_IMG_BOOT) {
+        if (!(header->bootcfg.bval.crc_ignore == 1 && header->crc32 == BOOTROM_DEADBEEF_VAL) &&
+            header->crc32 != BFLB_Soft_CRC32((uint8_t *)header, sizeof(struct bootheader_t) - sizeof(header->crc32))) {
+            return BFLB_EFLASH_LOADER_IMG_BOOTHEADER_CRC_ERROR;
+        }
+
+        img_expect = BFLB_FW_IMG_OFFSET_AFTER_HEADER + header->img_segment_info.img_len;
+
+        /*an encrypted image is hashed in the clear, boot2 checks that one*/
+        if (!header->bootcfg.bval.hash_ignore && !header->bootcfg.bval.encrypt_type) {
+            memcpy(img_hash, header->hash, sizeof(img_hash));
+            img_hash_end = img_expect;
+
+            device_unregister("dev_check_hash");
+            sec_hash_sha256_register(SEC_HASH0_INDEX, "dev_check_hash");
+            dev_check_hash = device_find("dev_check_hash");
+
+            if (dev_check_hash && device_open(dev_check_hash, 0) == 0) {
+                img_hash_on = 1;
+            }
+        }
+    } else if (img_type == USB_IMG_ENC) {
+        if (blsp_boot2_enc_img_parse(data, &enc) != BFLB_BOOT2_SUCCESS) {
+            return BFLB_EFLASH_LOADER_IMG_DEC_ERROR;
+        }
+
+        img_expect = sizeof(enc) + enc.payload_len;
+    } else if (img_type != USB_IMG_XZ) {
+        return BFLB_EFLASH_LOADER_IMG_BOOTHEADER_MAGIC_ERROR;
+    }
+
+    if (img_expect > BFLB_EFLASH_LOADER_IMG_MAX_LEN) {
+        return BFLB_EFLASH_LOADER_FLASH_WRITE_PARA_ERROR;
+    }
+
+    MSG("usb update type %d, %d bytes\r\n", img_type, img_expect);
+    return bflb_eflash_loader_image_start(img_expect);
+}
+
+static int32_t usb_img_write(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+    uint32_t start = BFLB_FW_IMG_OFFSET_AFTER_HEADER;
+    uint32_t hash_len = len;
+    int32_t ret;
+
+    if (offset == 0) {
+        ret = usb_img_start(data);
+
+        if (ret != BFLB_EFLASH_LOADER_SUCCESS) {
+            return ret;
+        }
+    }
+
+    if (offset + len > BFLB_EFLASH_LOADER_IMG_MAX_LEN) {
+        return BFLB_EFLASH_LOADER_FLASH_WRITE_PARA_ERROR;
+    }
+
+    ret = bflb_eflash_loader_image_write(offset, (uint8_t *)data, len);
+
+    if (ret != BFLB_EFLASH_LOADER_SUCCESS) {
+        return ret;
+    }
+
+    img_written = offset + len;
+
+    /*hash the image data as it passes, the part of it in this block*/
+    if (img_hash_on && offset + len > start && offset < img_hash_end) {
+        if (offset < start) {
+            data += start - offset;
+            hash_len -= start - offset;
+            offset = start;
+        }
+
+        if (offset + hash_len > img_hash_end) {
+            hash_len = img_hash_end - offset;
+        }
+
+        device_write(dev_check_hash, 0, data, hash_len);
+    }
+
+    return BFLB_EFLASH_LOADER_SUCCESS;
+}
+
+static int32_t usb_img_read(uint32_t offset, uint8_t *data, uint32_t len)
+{
+    return bflb_eflash_loader_image_read(offset, data, len);
+}
+
+static int32_t usb_img_finish(uint32_t size)
+{
+    uint8_t digest[32];
+    uint32_t needed = img_expect ? img_expect : size;
+    int32_t ret = BFLB_EFLASH_LOADER_SUCCESS;
+
+    if (!needed) {
+        return BFLB_EFLASH_LOADER_FAT_WAIT;
+    }
+
+    if (img_written < needed) {
+        ret = BFLB_EFLASH_LOADER_IMG_HALFBAKED_ERROR;
+    }
+
+    if (img_hash_on) {
+        img_hash_on = 0;
+        device_read(dev_check_hash, 0, digest, 0);
+        device_close(dev_check_hash);
+
+        if (ret == BFLB_EFLASH_LOADER_SUCCESS && memcmp(digest, img_hash, sizeof(digest))) {
+            ret = BFLB_EFLASH_LOADER_IMG_HASH_ERROR;
+        }
+    }
+
+    if (ret == BFLB_EFLASH_LOADER_SUCCESS) {
+        ret = bflb_eflash_loader_image_finish();
+    }
+
+    if (ret != BFLB_EFLASH_LOADER_SUCCESS) {
+        usb_loader_fail(ret);
+        return ret;
+    }
+
+    MSG("usb update ok %d\r\n", needed);
+    snprintf(usb_status, sizeof(usb_status), "OK: %u bytes, %s.\r\nRestarting into the new firmware.\r\n",
+             (unsigned int)needed, (img_type == USB_IMG_BOOT) ? (img_hash_end ? "header CRC and SHA256 checked" : "header CRC checked") :
+                                   (img_type == USB_IMG_ENC) ? "container CRC checked, boot2 checks the rest" : "boot2 checks it on install");
+    bflb_eflash_loader_fat_set_status(usb_status);
+    usb_reconnect = 1;
+    usb_reset = 1;
+
+    return BFLB_EFLASH_LOADER_SUCCESS;
+}
+
+static const eflash_loader_fat_sink_t usb_img_sink = {
+    .probe = usb_img_probe,
+    .write = usb_img_write,
+    .read = usb_img_read,
+    .finish = usb_img_finish,
+    .abort = usb_loader_fail,
+};
+
+int32_t bflb_eflash_loader_usb_init(void)
+{
+    usb_req_sem = xSemaphoreCreateBinary();
+
+    if (!usb_req_sem) {
+        return -1;
+    }
+
+    bflb_eflash_loader_fat_init(&usb_img_sink, usb_status_ready);
+
+    usbd_desc_register(usb_loader_descriptor);
+    usbd_msc_class_init(USB_LOADER_OUT_EP, USB_LOADER_IN_EP);
+
+    usb = usb_dc_init();
+
+    if (!usb) {
+        return -1;
+    }
+
+    usb_last_active = xTaskGetTickCount();
+    return 0;
+}
+
+/* the host reads the drive again, and with it the new STATUS.TXT */
+static void usb_loader_reconnect(void)
+{
+    device_control(usb, DEVICE_CTRL_USB_DC_ENUM_OFF, NULL);
+    vTaskDelay(pdMS_TO_TICKS(USB_RECONNECT_MS));
+    device_control(usb, DEVICE_CTRL_USB_DC_ENUM_ON, NULL);
+
+    usb_reconnect = 0;
+    usb_last_active = xTaskGetTickCount();
+    usb_reset_tick = usb_last_active;
+}
+
+static void usb_loader_idle(void)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    if (bflb_eflash_loader_fat_state() == EFLASH_LOADER_FAT_STREAM) {
+        if (now - usb_last_write >= pdMS_TO_TICKS(BFLB_EFLASH_LOADER_USB_FLUSH_TIMEOUT)) {
+            bflb_eflash_loader_fat_flush();
+        } else {
+            /* erase the next image sector while the host is between writes */
+            bflb_eflash_loader_erase_ahead_poll();
+        }
+
+        return;
+    }
+
+    /*the host may still write the FAT and directory after the last data*/
+    if (usb_reconnect && now - usb_last_write >= pdMS_TO_TICKS(BFLB_EFLASH_LOADER_USB_FLUSH_TIMEOUT)) {
+        usb_loader_reconnect();
+        return;
+    }
+
+    if (usb_reset && !usb_reconnect && now - usb_reset_tick >= pdMS_TO_TICKS(BFLB_EFLASH_LOADER_USB_RESET_DELAY)) {
+        MSG("RST\r\n");
+        device_control(usb, DEVICE_CTRL_USB_DC_ENUM_OFF, NULL);
+
+        /* add for bl702, will impact on boot pin read */
+        hal_boot2_set_psmode_status(0x594c440B);
+        __disable_irq();
+        GLB_SW_POR_Reset();
+    }
+}
+
+/*
+ * Serve the drive for timeout ms. Returns nonzero while a host is using it,
+ * the boot window stays open until the host has been idle for
+ * BFLB_EFLASH_LOADER_USB_IDLE_TIMEOUT or an update has gone through.
+ */
+int32_t bflb_eflash_loader_usb_poll(uint32_t timeout)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t elapsed = 0;
+    uint8_t dir;
+    int32_t ret;
+
+    if (!usb) {
+        vTaskDelay(pdMS_TO_TICKS(timeout));
+        return 0;
+    }
+
+    while (elapsed < pdMS_TO_TICKS(timeout)) {
+        if (xSemaphoreTake(usb_req_sem, pdMS_TO_TICKS(timeout) - elapsed) != pdTRUE) {
+            break;
+        }
+
+        dir = usb_req_dir;
+        usb_req_dir = USB_REQ_NONE;
+        usb_last_active = xTaskGetTickCount();
+
+        if (dir == USB_REQ_READ) {
+            ret = bflb_eflash_loader_fat_read(usb_req_sector, usb_req_buf);
+        } else if (dir == USB_REQ_WRITE) {
+            ret = bflb_eflash_loader_fat_write(usb_req_sector, usb_req_buf);
+            usb_last_write = usb_last_active;
+        } else {
+            continue;
+        }
+
+        taskENTER_CRITICAL();
+        usbd_msc_sector_done(ret);
+        taskEXIT_CRITICAL();
+
+        elapsed = xTaskGetTickCount() - start;
+    }
+
+    usb_loader_idle();
+
+    if (usb_reset) {
+        return 1;
+    }
+
+    return usb_device_is_configured() && (xTaskGetTickCount() - usb_last_active < pdMS_TO_TICKS(BFLB_EFLASH_LOADER_USB_IDLE_TIMEOUT));
+}
+
+void bflb_eflash_loader_usb_deinit(void)
+{
+    if (usb) {
+        device_control(usb, DEVICE_CTRL_USB_DC_ENUM_OFF, NULL);
+        device_close(usb);
+        usb = NULL;
+    }
+}
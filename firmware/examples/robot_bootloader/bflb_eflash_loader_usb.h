@@ -0,0 +1,54 @@
+/**
+  ******************************************************************************
+  * @file    bflb_eflash_loader_usb.h
+  * @version V1.2
+  * @date
+  * @brief   This file is the peripheral case header file
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT(c) 2018 Bouffalo Lab</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+#ifndef __BFLB_EFLASH_LOADER_USB_H__
+#define __BFLB_EFLASH_LOADER_USB_H__
+
+#include "stdint.h"
+
+/*a host that read or wrote nothing for this long is done with the drive*/
+#define BFLB_EFLASH_LOADER_USB_IDLE_TIMEOUT  30000 /*ms*/
+/*quiet time after which a stream without directory entry is taken as complete*/
+#define BFLB_EFLASH_LOADER_USB_FLUSH_TIMEOUT 1000  /*ms*/
+/*time the host gets to read STATUS.TXT before the reset into a new image*/
+#define BFLB_EFLASH_LOADER_USB_RESET_DELAY   5000  /*ms*/
+
+int32_t bflb_eflash_loader_usb_init(void);
+
+int32_t bflb_eflash_loader_usb_poll(uint32_t timeout);
+
+void bflb_eflash_loader_usb_deinit(void);
+
+#endif
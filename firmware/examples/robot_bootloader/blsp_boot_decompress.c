@@ -42,6 +42,8 @@
 #include "softcrc.h"
 #include "partition.h"
 #include "hal_flash.h"
+#include "blsp_port.h"
+#include "blsp_boot_decrypt.h"
 #include <FreeRTOS.h>
 
 
@@ -66,11 +68,13 @@ static int32_t blsp_boot2_fw_decompress(uint32_t src_address, uint32_t dest_addr
     struct xz_buf b;
     struct xz_dec *s;
     enum xz_ret ret;
+    flash_write_buf_t wbuf;
 
     *p_dest_size = 0;
+    flash_write_buf_init(&wbuf, g_boot2_flash_window, sizeof(g_boot2_flash_window));
 
     if (dest_max_size > 0) {
-        flash_erase(dest_address, dest_max_size);
+        flash_erase_skip_blank(dest_address, dest_max_size);
     }
 
     xz_crc32_init();
@@ -120,7 +124,7 @@ static int32_t blsp_boot2_fw_decompress(uint32_t src_address, uint32_t dest_addr
             MSG("XZ outputing\r\n");
 
             if (dest_max_size > 0) {
-                flash_write(dest_address, b.out, BFLB_BOOT2_XZ_WRITE_BUF_SIZE);
+                flash_write_buffered(&wbuf, dest_address, b.out, BFLB_BOOT2_XZ_WRITE_BUF_SIZE);
             }
 
             dest_address += BFLB_BOOT2_XZ_WRITE_BUF_SIZE;
@@ -139,7 +143,7 @@ static int32_t blsp_boot2_fw_decompress(uint32_t src_address, uint32_t dest_addr
         //}
         if (b.out_pos > 0) {
             if (dest_max_size > 0) {
-                flash_write(dest_address, b.out, b.out_pos);
+                flash_write_buffered(&wbuf, dest_address, b.out, b.out_pos);
             }
 
             dest_address += b.out_pos;
@@ -148,6 +152,7 @@ static int32_t blsp_boot2_fw_decompress(uint32_t src_address, uint32_t dest_addr
 
         switch (ret) {
             case XZ_STREAM_END:
+                flash_write_flush(&wbuf);
                 xz_dec_end(s);
                 vPortFree((void*)b.in);
                 vPortFree((void*)b.out);
@@ -181,6 +186,7 @@ static int32_t blsp_boot2_fw_decompress(uint32_t src_address, uint32_t dest_addr
     }
 
 error:
+    flash_write_flush(&wbuf);
     vPortFree((void*)b.in);
     vPortFree((void*)b.out);
     xz_dec_end(s);
@@ -271,6 +277,263 @@ int32_t blsp_boot2_update_fw(pt_table_id_type active_id, pt_table_stuff_config *
     return BFLB_BOOT2_SUCCESS;
 }
 
+#if BLSP_BOOT2_SUPPORT_ENC_IMG
+/*
+ * Encrypted image install: every chunk read from the OTA slot is decrypted by
+ * the secure engine, then either XZ decoded or written as is. Nothing larger
+ * than one read buffer and the XZ dictionary is held in RAM.
+ */
+typedef struct {
+    uint32_t read_us;
+    uint32_t aes_us;
+    uint32_t xz_us;
+    uint32_t write_us;
+} blsp_boot2_install_time;
+
+static int32_t blsp_boot2_install_write(flash_write_buf_t *wbuf, uint32_t *dest_address, uint8_t *data, uint32_t len,
+                                        uint32_t dest_max_size, uint32_t *p_dest_size, blsp_boot2_install_time *time)
+{
+    uint32_t start_us;
+
+    if (*p_dest_size + len > dest_max_size && dest_max_size > 0) {
+        MSG_ERR("Image exceeds dest region\r\n");
+        return BFLB_BOOT2_FAIL;
+    }
+
+    if (dest_max_size > 0) {
+        start_us = bflb_platform_get_time_us();
+
+        /* XZ hands out 256 byte chunks, the flash layer combines them into page programs */
+        if (SUCCESS != flash_write_buffered(wbuf, *dest_address, data, len)) {
+            return BFLB_BOOT2_FLASH_WRITE_ERROR;
+        }
+
+        time->write_us += bflb_platform_get_time_us() - start_us;
+    }
+
+    *dest_address += len;
+    *p_dest_size += len;
+    return BFLB_BOOT2_SUCCESS;
+}
+
+/****************************************************************************/ /**
+ * @brief  Decrypt, and decompress if flagged, an encrypted image container
+ *
+ * @param  src_address: Container payload address on flash
+ * @param  header: Parsed container header
+ * @param  dest_address: Destination address on flash
+ * @param  dest_max_size: Destination flash region size for erase, 0 for a dry run
+ * @param  p_dest_size: Pointer for output destination firmware size
+ * @param  p_crc: Pointer for output CRC32 of the decrypted payload
+ *
+ * @return Install result status
+ *
+*******************************************************************************/
+static int32_t blsp_boot2_enc_fw_install(uint32_t src_address, const blsp_boot2_enc_img_header *header,
+                                         uint32_t dest_address, uint32_t dest_max_size,
+                                         uint32_t *p_dest_size, uint32_t *p_crc)
+{
+    blsp_boot2_install_time time = { 0 };
+    uint32_t total_us = bflb_platform_get_time_us();
+    flash_write_buf_t wbuf;
+    flash_stats_t stats;
+    uint32_t start_us;
+    uint32_t deal_len = 0;
+    uint32_t cur_len;
+    struct xz_buf b;
+    struct xz_dec *s = NULL;
+    uint8_t *in = NULL;
+    uint8_t *out = NULL;
+    enum xz_ret xz_ret = XZ_OK;
+    int32_t ret = BFLB_BOOT2_SUCCESS;
+
+    *p_dest_size = 0;
+    *p_crc = 0;
+    xz_crc32_init();
+    flash_clear_stats();
+    flash_write_buf_init(&wbuf, g_boot2_flash_window, sizeof(g_boot2_flash_window));
+
+    if (dest_max_size > 0) {
+        if (SUCCESS != flash_erase_skip_blank(dest_address, dest_max_size)) {
+            return BFLB_BOOT2_FLASH_ERASE_ERROR;
+        }
+    }
+
+    in = pvPortMalloc(BFLB_BOOT2_XZ_READ_BUF_SIZE);
+
+    if (header->flags & BLSP_BOOT2_ENC_IMG_FLAG_XZ) {
+        s = xz_dec_init(XZ_PREALLOC, 1 << 15);
+        out = pvPortMalloc(BFLB_BOOT2_XZ_WRITE_BUF_SIZE);
+    }
+
+    if (in == NULL || ((header->flags & BLSP_BOOT2_ENC_IMG_FLAG_XZ) && (s == NULL || out == NULL))) {
+        MSG_ERR("Memory allocation failed\n");
+        ret = BFLB_BOOT2_MEM_ERROR;
+        goto exit;
+    }
+
+    b.out = out;
+    b.out_pos = 0;
+    b.out_size = BFLB_BOOT2_XZ_WRITE_BUF_SIZE;
+
+    if (BFLB_BOOT2_SUCCESS != blsp_boot2_decrypt_start(header, 0)) {
+        ret = BFLB_BOOT2_IMG_DEC_ERROR;
+        goto exit;
+    }
+
+    while (deal_len < header->payload_len && ret == BFLB_BOOT2_SUCCESS) {
+        cur_len = header->payload_len - deal_len;
+
+        if (cur_len > BFLB_BOOT2_XZ_READ_BUF_SIZE) {
+            cur_len = BFLB_BOOT2_XZ_READ_BUF_SIZE;
+        }
+
+        start_us = bflb_platform_get_time_us();
+
+        if (BFLB_BOOT2_SUCCESS != blsp_mediaboot_read(src_address + deal_len, in, cur_len)) {
+            MSG_ERR("Read enc FW fail\r\n");
+            ret = BFLB_BOOT2_FLASH_READ_ERROR;
+            break;
+        }
+
+        time.read_us += bflb_platform_get_time_us() - start_us;
+        start_us = bflb_platform_get_time_us();
+
+        if (BFLB_BOOT2_SUCCESS != blsp_boot2_decrypt(in, in, cur_len)) {
+            ret = BFLB_BOOT2_IMG_DEC_ERROR;
+            break;
+        }
+
+        time.aes_us += bflb_platform_get_time_us() - start_us;
+        *p_crc = xz_crc32(in, cur_len, *p_crc);
+        deal_len += cur_len;
+
+        if (s == NULL) {
+            ret = blsp_boot2_install_write(&wbuf, &dest_address, in, cur_len, dest_max_size, p_dest_size, &time);
+            continue;
+        }
+
+        b.in = in;
+        b.in_pos = 0;
+        b.in_size = cur_len;
+
+        /* drain everything this chunk produces before reading the next one */
+        while (ret == BFLB_BOOT2_SUCCESS && xz_ret == XZ_OK && (b.in_pos < b.in_size || b.out_pos == b.out_size)) {
+            start_us = bflb_platform_get_time_us();
+            xz_ret = xz_dec_run(s, &b);
+            time.xz_us += bflb_platform_get_time_us() - start_us;
+
+            if (b.out_pos == b.out_size || (xz_ret == XZ_STREAM_END && b.out_pos > 0)) {
+                ret = blsp_boot2_install_write(&wbuf, &dest_address, out, b.out_pos, dest_max_size, p_dest_size, &time);
+                b.out_pos = 0;
+            }
+        }
+
+        if (xz_ret != XZ_OK && xz_ret != XZ_STREAM_END) {
+            MSG_ERR("XZ error %d\r\n", xz_ret);
+            ret = BFLB_BOOT2_FAIL;
+        }
+    }
+
+    if (ret == BFLB_BOOT2_SUCCESS && s != NULL && xz_ret != XZ_STREAM_END) {
+        MSG_ERR("XZ stream truncated\r\n");
+        ret = BFLB_BOOT2_FAIL;
+    }
+
+    start_us = bflb_platform_get_time_us();
+
+    if (SUCCESS != flash_write_flush(&wbuf) && ret == BFLB_BOOT2_SUCCESS) {
+        ret = BFLB_BOOT2_FLASH_WRITE_ERROR;
+    }
+
+    time.write_us += bflb_platform_get_time_us() - start_us;
+    flash_get_stats(&stats);
+
+    total_us = bflb_platform_get_time_us() - total_us;
+    MSG("enc install %d -> %d bytes, %dus: read %d, aes %d, xz %d, write %d, %dKB/s\r\n",
+        header->payload_len, *p_dest_size, total_us, time.read_us, time.aes_us, time.xz_us, time.write_us,
+        total_us ? (uint32_t)((uint64_t)*p_dest_size * 1000000 / 1024 / total_us) : 0);
+    MSG("flash: %d writes, %d programs, %d page programs, write %dKB/s, %d sectors erased, %d already blank\r\n",
+        stats.write_calls, stats.program_calls, stats.page_programs,
+        time.write_us ? (uint32_t)((uint64_t)stats.write_bytes * 1000000 / 1024 / time.write_us) : 0,
+        stats.erase_sectors, stats.erase_skipped);
+
+exit:
+    blsp_boot2_decrypt_finish();
+
+    if (s != NULL) {
+        xz_dec_end(s);
+    }
+
+    if (in != NULL) {
+        vPortFree(in);
+    }
+
+    if (out != NULL) {
+        vPortFree(out);
+    }
+
+    return ret;
+}
+
+/****************************************************************************/ /**
+ * @brief  Install an encrypted image container from the active slot to the other one
+ *
+ * @param  active_id: Active partition table ID
+ * @param  pt_stuff: Pointer of partition table stuff
+ * @param  pt_entry: Pointer of active entry
+ * @param  header: Container header read from the active slot
+ *
+ * @return Install result status
+ *
+*******************************************************************************/
+int32_t blsp_boot2_update_enc_fw(pt_table_id_type active_id, pt_table_stuff_config *pt_stuff, pt_table_entry_config *pt_entry,
+                                 const blsp_boot2_enc_img_header *header)
+{
+    uint8_t active_index = pt_entry->active_index & 0x01;
+    uint32_t src_address = pt_entry->start_address[active_index] + sizeof(blsp_boot2_enc_img_header);
+    uint32_t dest_address = pt_entry->start_address[!active_index];
+    uint32_t new_fw_len;
+    uint32_t crc;
+    int32_t ret;
+
+    MSG("enc image at %08x, dest address %08x\r\n", pt_entry->start_address[active_index], dest_address);
+
+    /* decrypting in place would destroy the only copy on a power cut */
+    if (dest_address == pt_entry->start_address[active_index]) {
+        MSG_ERR("No second slot to install to\r\n");
+        return BFLB_BOOT2_FAIL;
+    }
+
+    /* dry run first, the running image is only erased once the payload is known good */
+    ret = blsp_boot2_enc_fw_install(src_address, header, dest_address, 0, &new_fw_len, &crc);
+
+    if (ret != BFLB_BOOT2_SUCCESS || crc != header->plain_crc32 || new_fw_len > pt_entry->max_len[!active_index]) {
+        MSG_ERR("Enc image check fail, crc %08x\r\n", crc);
+        return BFLB_BOOT2_IMG_DEC_ERROR;
+    }
+
+    ret = blsp_boot2_enc_fw_install(src_address, header, dest_address, pt_entry->max_len[!active_index], &new_fw_len, &crc);
+
+    if (ret != BFLB_BOOT2_SUCCESS || crc != header->plain_crc32) {
+        MSG_ERR("Enc image install fail\r\n");
+        return BFLB_BOOT2_FAIL;
+    }
+
+    pt_entry->active_index = !active_index;
+    pt_entry->len = new_fw_len;
+    pt_entry->age++;
+    ret = pt_table_update_entry((pt_table_id_type)(!active_id), pt_stuff, pt_entry);
+
+    if (ret != PT_ERROR_SUCCESS) {
+        MSG_ERR("Enc install Update Partition table entry fail\r\n");
+        return BFLB_BOOT2_FAIL;
+    }
+
+    return BFLB_BOOT2_SUCCESS;
+}
+#endif
+
 /****************************************************************************/ /**
  * @brief  Check if buffer is XZ header
  *
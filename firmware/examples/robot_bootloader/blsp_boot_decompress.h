@@ -38,9 +38,12 @@
 
 #include "stdint.h"
 #include "partition.h"
+#include "blsp_boot_decrypt.h"
 
 int32_t blsp_boot2_update_fw(pt_table_id_type activeID, pt_table_stuff_config *ptStuff, pt_table_entry_config *ptEntry);
 int blsp_boot2_verify_xz_header(uint8_t *buffer);
+int32_t blsp_boot2_update_enc_fw(pt_table_id_type active_id, pt_table_stuff_config *pt_stuff, pt_table_entry_config *pt_entry,
+                                 const blsp_boot2_enc_img_header *header);
 
 
 #endif /* __BLSP_BOOT_DECOMPRESS_H__ */
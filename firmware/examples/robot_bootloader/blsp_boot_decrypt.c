@@ -0,0 +1,180 @@
+/**
+  ******************************************************************************
+  * @file    blsp_boot_decrypt.c
+  * @version V1.2
+  * @date
+  * @brief   This file is the peripheral case c file
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT(c) 2018 Bouffalo Lab</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+#include "string.h"
+#include "bflb_platform.h"
+#include "blsp_bootinfo.h"
+#include "blsp_boot_decrypt.h"
+#include "softcrc.h"
+#include "hal_sec_aes.h"
+
+/* the engine reads and writes memory directly, go through aligned buffers */
+#define BLSP_BOOT2_DECRYPT_BUF_SIZE 256
+
+static sec_aes_handle_t decrypt_aes;
+/* the engine is ours from start to finish, the BLE host and mbedTLS use it too */
+static uint8_t decrypt_locked;
+static uint8_t decrypt_in[BLSP_BOOT2_DECRYPT_BUF_SIZE] __attribute__((aligned(4)));
+static uint8_t decrypt_out[BLSP_BOOT2_DECRYPT_BUF_SIZE] __attribute__((aligned(4)));
+
+/****************************************************************************/ /**
+ * @brief  Check an encrypted image container header
+ *
+ * @param  data: Container start, at least sizeof(blsp_boot2_enc_img_header) bytes
+ * @param  header: Filled with the header when it is valid
+ *
+ * @return BFLB_BOOT2_SUCCESS or BFLB_BOOT2_IMG_DEC_ERROR
+ *
+*******************************************************************************/
+int32_t blsp_boot2_enc_img_parse(const uint8_t *data, blsp_boot2_enc_img_header *header)
+{
+    memcpy(header, data, sizeof(*header));
+
+    if (memcmp(header->magic, BLSP_BOOT2_ENC_IMG_MAGIC, sizeof(header->magic))) {
+        return BFLB_BOOT2_IMG_DEC_ERROR;
+    }
+
+    if (header->crc32 != BFLB_Soft_CRC32(header, sizeof(*header) - sizeof(header->crc32))) {
+        MSG_ERR("Enc img header crc error\r\n");
+        return BFLB_BOOT2_IMG_DEC_ERROR;
+    }
+
+    if (header->version != BLSP_BOOT2_ENC_IMG_VERSION || (header->payload_len & 0x0f)) {
+        MSG_ERR("Enc img version %d, len %d not supported\r\n", header->version, header->payload_len);
+        return BFLB_BOOT2_IMG_DEC_ERROR;
+    }
+
+    return BFLB_BOOT2_SUCCESS;
+}
+
+/****************************************************************************/ /**
+ * @brief  Take the engine and load the efuse key and the IV for a payload offset,
+ *         blsp_boot2_decrypt_finish gives the engine back
+ *
+ * @param  header: Parsed container header
+ * @param  offset: Payload offset to start at, 16 byte aligned
+ *
+ * @return BFLB_BOOT2_SUCCESS or BFLB_BOOT2_IMG_DEC_ERROR
+ *
+*******************************************************************************/
+int32_t blsp_boot2_decrypt_start(const blsp_boot2_enc_img_header *header, uint32_t offset)
+{
+    uint8_t iv[16];
+    uint8_t key_sel = header->key_sel;
+    uint32_t counter;
+
+    if (offset & 0x0f) {
+        return BFLB_BOOT2_IMG_DEC_ERROR;
+    }
+
+    /* big endian block counter in the last word */
+    memcpy(iv, header->iv, sizeof(iv));
+    counter = ((uint32_t)iv[12] << 24) | ((uint32_t)iv[13] << 16) | ((uint32_t)iv[14] << 8) | iv[15];
+    counter += offset / 16;
+    iv[12] = counter >> 24;
+    iv[13] = counter >> 16;
+    iv[14] = counter >> 8;
+    iv[15] = counter;
+
+    if (!decrypt_locked) {
+        sec_eng_lock();
+        decrypt_locked = 1;
+    }
+
+    /* CTR runs the engine forward either way; key length 0 selects the efuse key */
+    sec_aes_init(&decrypt_aes, SEC_AES_CTR, SEC_AES_KEY_128);
+    sec_aes_setkey(&decrypt_aes, &key_sel, 0, iv, SEC_AES_DIR_ENCRYPT);
+
+    return BFLB_BOOT2_SUCCESS;
+}
+
+/****************************************************************************/ /**
+ * @brief  Decrypt the next part of the payload, continuing the counter
+ *
+ * @param  in: Ciphertext
+ * @param  out: Plaintext, may be the same buffer as in
+ * @param  len: Length, multiple of 16
+ *
+ * @return BFLB_BOOT2_SUCCESS or BFLB_BOOT2_IMG_DEC_ERROR
+ *
+*******************************************************************************/
+int32_t ATTR_TCM_SECTION blsp_boot2_decrypt(const uint8_t *in, uint8_t *out, uint32_t len)
+{
+    uint32_t cur_len;
+
+    if (len & 0x0f) {
+        return BFLB_BOOT2_IMG_DEC_ERROR;
+    }
+
+    while (len > 0) {
+        cur_len = len > BLSP_BOOT2_DECRYPT_BUF_SIZE ? BLSP_BOOT2_DECRYPT_BUF_SIZE : len;
+
+        memcpy(decrypt_in, in, cur_len);
+
+        if (sec_aes_decrypt(&decrypt_aes, decrypt_in, cur_len, 0, decrypt_out)) {
+            return BFLB_BOOT2_IMG_DEC_ERROR;
+        }
+
+        memcpy(out, decrypt_out, cur_len);
+        in += cur_len;
+        out += cur_len;
+        len -= cur_len;
+    }
+
+    return BFLB_BOOT2_SUCCESS;
+}
+
+/****************************************************************************/ /**
+ * @brief  Release the engine and clear the buffers, also after a failed start
+ *
+ * @param  None
+ *
+ * @return None
+ *
+*******************************************************************************/
+void blsp_boot2_decrypt_finish(void)
+{
+    if (!decrypt_locked) {
+        return;
+    }
+
+    sec_aes_deinit(&decrypt_aes);
+    memset(decrypt_in, 0, sizeof(decrypt_in));
+    memset(decrypt_out, 0, sizeof(decrypt_out));
+
+    decrypt_locked = 0;
+    sec_eng_unlock();
+}
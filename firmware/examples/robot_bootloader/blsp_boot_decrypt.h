@@ -0,0 +1,70 @@
+/**
+  ******************************************************************************
+  * @file    blsp_boot_decrypt.h
+  * @version V1.2
+  * @date
+  * @brief   This file is the peripheral case header file
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; COPYRIGHT(c) 2018 Bouffalo Lab</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+#ifndef __BLSP_BOOT_DECRYPT_H__
+#define __BLSP_BOOT_DECRYPT_H__
+
+#include "stdint.h"
+
+#define BLSP_BOOT2_ENC_IMG_MAGIC   "BFEI"
+#define BLSP_BOOT2_ENC_IMG_VERSION 1
+/* payload is an XZ stream once decrypted */
+#define BLSP_BOOT2_ENC_IMG_FLAG_XZ 0x01
+
+/*
+ * Encrypted image container, little endian, followed by payload_len bytes of
+ * AES-128-CTR ciphertext. The key is the efuse AES key selected by key_sel,
+ * it never leaves the chip. The low 32 bits of the IV are zero and carry the
+ * block counter, so any 16 byte aligned offset can be decrypted on its own.
+ * tools/boot_script/upgrade_firmware.py --encrypt builds it.
+ */
+typedef struct {
+    uint8_t magic[4];
+    uint8_t version;
+    uint8_t flags;
+    uint8_t key_sel;
+    uint8_t rsvd;
+    uint32_t payload_len; /* multiple of 16 */
+    uint32_t plain_crc32; /* CRC32 of the decrypted payload */
+    uint8_t iv[16];
+    uint32_t crc32;       /* of the fields above */
+} blsp_boot2_enc_img_header;
+
+int32_t blsp_boot2_enc_img_parse(const uint8_t *data, blsp_boot2_enc_img_header *header);
+int32_t blsp_boot2_decrypt_start(const blsp_boot2_enc_img_header *header, uint32_t offset);
+int32_t blsp_boot2_decrypt(const uint8_t *in, uint8_t *out, uint32_t len);
+void blsp_boot2_decrypt_finish(void);
+
+#endif /* __BLSP_BOOT_DECRYPT_H__ */
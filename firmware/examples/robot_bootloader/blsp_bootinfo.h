@@ -50,6 +50,8 @@
 #define BFLB_BOOT2_DEADBEEF_VAL      0xdeadbeef
 
 #define BFLB_BOOT2_READBUF_SIZE         256//4 * 1024
+/* boot2 copies and decompresses in 256 byte chunks, program them four pages at a time */
+#define BFLB_BOOT2_FLASH_WINDOW_SIZE    1024
 #define BFLB_FW_IMG_OFFSET_AFTER_HEADER 4 * 1024
 
 
@@ -263,6 +265,7 @@ extern boot2_efuse_hw_config g_efuse_cfg;
 extern uint8_t g_ps_mode;
 extern uint8_t g_cpu_count;
 extern uint8_t *g_boot2_read_buf;
+extern uint8_t g_boot2_flash_window[BFLB_BOOT2_FLASH_WINDOW_SIZE];
 
 
 
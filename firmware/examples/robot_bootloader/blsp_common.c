@@ -49,6 +49,7 @@
 #include <FreeRTOS.h>
 #include <task.h>
 #include "bflb_eflash_loader_ble.h"
+#include "boot_profile.h"
 
 // uint8_t g_malloc_buf[BFLB_BOOT2_XZ_MALLOC_BUF_SIZE] __attribute__((section(".noinit_data")));
 
@@ -93,9 +94,17 @@ int32_t blsp_mediaboot_pre_jump(void)
     /* Stop BLE */
     bflb_eflash_loader_ble_stop();
 
+#ifdef BSP_USING_USB
+    /* the app enumerates on its own */
+    bflb_eflash_loader_usb_deinit();
+#endif
+
     /* Stop interrupts to avoid scheduler running */
     portDISABLE_INTERRUPTS();
 
+    /* before the mtimer clock changes */
+    boot_profile_handoff();
+
     /* reinit mtimer clock */
     system_mtimer_clock_reinit();
 
@@ -45,6 +45,7 @@
 #include "softcrc.h"
 #include "bflb_eflash_loader_interface.h"
 #include "hal_uart.h"
+#include "boot_profile.h"
 
 extern int main(void);
 extern struct device *dev_check_hash;
@@ -412,7 +413,7 @@ int32_t blsp_mediaboot_main(uint32_t cpu_boot_header_addr[BFLB_BOOT2_CPU_MAX], u
     MSG("flash_offset[1] %08x,cache_dis[1] %02x\r\n", g_boot_img_cfg[1].img_start.flash_offset, g_boot_img_cfg[1].cache_way_disable);
     MSG("CPU Count %d,halt_cpu1 %d\r\n", g_cpu_count, g_boot_img_cfg[0].halt_cpu1);
     blsp_boot2_show_timer();
-
+    boot_profile_mark(BOOT_PHASE_IMG_CHECKED);
 
     if (0 == bflb_eflash_loader_if_handshake_poll(0)) {
         bflb_eflash_loader_main();
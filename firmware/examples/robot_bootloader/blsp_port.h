@@ -47,9 +47,17 @@
 #define BLSP_BOOT2_XIP_BASE                     BL_FLASH_XIP_BASE
 //#define BLSP_BOOT2_ROLLBACK
 #define BLSP_BOOT2_SUPPORT_DECOMPRESS           HAL_BOOT2_SUPPORT_DECOMPRESS
+/* install BFEI encrypted containers from the OTA slot, see blsp_boot_decrypt.h */
+#define BLSP_BOOT2_SUPPORT_ENC_IMG              1
 #define BLSP_BOOT2_SUPPORT_USB_IAP              0//HAL_BOOT2_SUPPORT_USB_IAP
 #define BLSP_BOOT2_SUPPORT_EFLASH_LOADER_RAM    HAL_BOOT2_SUPPORT_EFLASH_LOADER_RAM     
 #define BLSP_BOOT2_SUPPORT_EFLASH_LOADER_FLASH  HAL_BOOT2_SUPPORT_EFLASH_LOADER_FLASH   
+/* boot straight into the app, the loaders only start when asked for, see blsp_boot2_loader_window() */
+#define BLSP_BOOT2_FAST_BOOT                    1
+/* open the loader window after this many boots the app did not confirm */
+#define BLSP_BOOT2_MAX_UNCONFIRMED_BOOTS        3
+/* held low at reset opens the loader window */
+//#define BLSP_BOOT2_LOADER_GPIO                GPIO_PIN_0
 
 #define BOOT2_MODE_RELEASE              0x01
 #define BOOT2_MODE_DEBUG                0x02
@@ -53,6 +53,8 @@
 #include "bl702_glb.h"
 #include "task.h"
 #include "hal_wdt.h"
+#include "hal_gpio.h"
+#include "boot_profile.h"
 
 #define UART_DEBUG          1
 // #define APP_FLASH_ADDR      0x30000
@@ -67,6 +69,8 @@ static HeapRegion_t xHeapRegions[] = {
 static StackType_t main_task_stack[2048];
 static StaticTask_t main_task_h;
 uint8_t *g_boot2_read_buf;
+/* write combine window of the image installs, which run one at a time */
+uint8_t g_boot2_flash_window[BFLB_BOOT2_FLASH_WINDOW_SIZE] __attribute__((aligned(4)));
 boot2_image_config g_boot_img_cfg[2];
 boot2_efuse_hw_config g_efuse_cfg;
 uint8_t g_ps_mode = BFLB_PSM_ACTIVE;
@@ -231,6 +235,44 @@ static int blsp_boot2_check_xz_fw(pt_table_id_type activeID, pt_table_stuff_conf
 }
 #endif
 
+#if BLSP_BOOT2_SUPPORT_ENC_IMG
+/****************************************************************************/ /**
+ * @brief  Boot2 check encrypted FW container and install it
+ *
+ * @param  activeID: Active partition table ID
+ * @param  ptStuff: Pointer of partition table stuff
+ * @param  ptEntry: Pointer of active entry
+ *
+ * @return 1 for find encrypted FW and install success, 0 for other cases
+ *
+*******************************************************************************/
+static int blsp_boot2_check_enc_fw(pt_table_id_type activeID, pt_table_stuff_config *ptStuff, pt_table_entry_config *ptEntry)
+{
+    blsp_boot2_enc_img_header header;
+
+    if (BFLB_BOOT2_SUCCESS != blsp_mediaboot_read(ptEntry->start_address[ptEntry->active_index & 0x01], g_boot2_read_buf, sizeof(header))) {
+        MSG("Read fw fail\r\n");
+        return 0;
+    }
+
+    if (BFLB_BOOT2_SUCCESS != blsp_boot2_enc_img_parse(g_boot2_read_buf, &header)) {
+        return 0;
+    }
+
+    MSG("Enc image\r\n");
+
+    if (BFLB_BOOT2_SUCCESS == blsp_boot2_update_enc_fw(activeID, ptStuff, ptEntry, &header)) {
+        return 1;
+    }
+
+    MSG("Img install fail\r\n");
+    /* Set flag to make it not boot */
+    ptEntry->active_index = 0;
+    ptEntry->start_address[0] = 0;
+    return 0;
+}
+#endif
+
 /****************************************************************************/ /**
  * @brief  Boot2 copy firmware from OTA region to normal region
  *
@@ -250,10 +292,15 @@ static int blsp_boot2_do_fw_copy(pt_table_id_type active_id, pt_table_stuff_conf
     uint32_t total_len = pt_entry->len;
     uint32_t deal_len = 0;
     uint32_t cur_len = 0;
+    uint32_t start_us = bflb_platform_get_time_us();
+    flash_write_buf_t wbuf;
+    flash_stats_t stats;
 
     MSG("OTA copy src address %08x, dest address %08x, total len %d\r\n", src_address, dest_address, total_len);
+    flash_clear_stats();
+    flash_write_buf_init(&wbuf, g_boot2_flash_window, sizeof(g_boot2_flash_window));
 
-    if (SUCCESS != flash_erase(dest_address, dest_max_size)) {
+    if (SUCCESS != flash_erase_skip_blank(dest_address, dest_max_size)) {
         MSG("Erase flash fail");
         return BFLB_BOOT2_FLASH_ERASE_ERROR;
     }
@@ -270,7 +317,7 @@ static int blsp_boot2_do_fw_copy(pt_table_id_type active_id, pt_table_stuff_conf
             return BFLB_BOOT2_FLASH_READ_ERROR;
         }
 
-        if (SUCCESS != flash_write(dest_address, g_boot2_read_buf, cur_len)) {
+        if (SUCCESS != flash_write_buffered(&wbuf, dest_address, g_boot2_read_buf, cur_len)) {
             MSG("Write flash fail");
             return BFLB_BOOT2_FLASH_WRITE_ERROR;
         }
@@ -280,6 +327,18 @@ static int blsp_boot2_do_fw_copy(pt_table_id_type active_id, pt_table_stuff_conf
         deal_len += cur_len;
     }
 
+    if (SUCCESS != flash_write_flush(&wbuf)) {
+        MSG("Write flash fail");
+        return BFLB_BOOT2_FLASH_WRITE_ERROR;
+    }
+
+    /* plaintext baseline for the encrypted install figures */
+    start_us = bflb_platform_get_time_us() - start_us;
+    flash_get_stats(&stats);
+    MSG("OTA copy %dus, %dKB/s, %d programs, %d page programs, %d sectors erased, %d already blank\r\n",
+        start_us, start_us ? (uint32_t)((uint64_t)total_len * 1000000 / 1024 / start_us) : 0,
+        stats.program_calls, stats.page_programs, stats.erase_sectors, stats.erase_skipped);
+
     return BFLB_BOOT2_SUCCESS;
 }
 
@@ -318,6 +377,11 @@ static int blsp_boot2_deal_one_fw(pt_table_id_type active_id, pt_table_stuff_con
         if (blsp_boot2_check_xz_fw(active_id, pt_stuff, pt_entry) == 1) {
             return 0;
         }
+#endif
+#if BLSP_BOOT2_SUPPORT_ENC_IMG
+        if (blsp_boot2_check_enc_fw(active_id, pt_stuff, pt_entry) == 1) {
+            return 0;
+        }
 #endif
         /* Check if this partition need copy */
         if (pt_entry->active_index >= 2) {
@@ -404,6 +468,53 @@ static void blsp_boot2_get_mfg_startreq(pt_table_id_type active_id, pt_table_stu
     }
 }
 
+/****************************************************************************/ /**
+ * @brief  Boot2 decide whether the loaders get a handshake window
+ *
+ * @param  None
+ *
+ * @return Window length in 20 ms polls, 0 to boot straight into the app
+ *
+*******************************************************************************/
+static uint32_t blsp_boot2_loader_window(void)
+{
+    uint8_t flags = 0;
+    uint32_t timeout_ms = 0;
+
+    /* the app resets into the loader for an update */
+    if (BL_RD_REG(HBN_BASE, HBN_RSV3) == 0xAABBCCDD) {
+        BL_WR_REG(HBN_BASE, HBN_RSV3, 0x00);
+        flags |= BOOT_PROFILE_FLAG_REQ_APP;
+        timeout_ms = 10000;
+    }
+
+#ifdef BLSP_BOOT2_LOADER_GPIO
+    gpio_set_mode(BLSP_BOOT2_LOADER_GPIO, GPIO_INPUT_PU_MODE);
+    bflb_platform_delay_us(10);
+
+    if (gpio_read(BLSP_BOOT2_LOADER_GPIO) == 0) {
+        flags |= BOOT_PROFILE_FLAG_REQ_GPIO;
+        timeout_ms = 10000;
+    }
+#endif
+
+    /* an app that never gets far enough to confirm can still be updated */
+    if (boot_profile_get_unconfirmed() >= BLSP_BOOT2_MAX_UNCONFIRMED_BOOTS) {
+        flags |= BOOT_PROFILE_FLAG_REQ_UNCONF;
+    }
+
+    if (timeout_ms == 0 && (flags || !BLSP_BOOT2_FAST_BOOT)) {
+        timeout_ms = 1000;
+    }
+
+    if (timeout_ms == 0) {
+        flags |= BOOT_PROFILE_FLAG_FAST_BOOT;
+    }
+
+    boot_profile_set_flags(flags);
+    return timeout_ms / 20;
+}
+
 #ifdef UART_DEBUG
 void uart_debug_printf(char *fmt, ...)
 {
@@ -441,14 +552,22 @@ static void main_task(void *pvParameters)
     uint32_t crc;
     uint8_t *flash_cfg = NULL;
     uint32_t flash_cfg_len = 0;
-    uint32_t boot_timeout = 1000 / 20;
+    uint32_t boot_timeout = blsp_boot2_loader_window();
+    uint8_t loaders_up = (boot_timeout != 0);
     struct device *wdg;
 
-    bflb_eflash_loader_if_set(BFLB_EFLASH_LOADER_IF_BLE);
-    bflb_eflash_loader_if_init();
+    /* bringing up the BLE stack alone costs more than the rest of boot2 */
+    if (loaders_up) {
+        bflb_eflash_loader_if_set(BFLB_EFLASH_LOADER_IF_BLE);
+        bflb_eflash_loader_if_init();
 
-    bflb_eflash_loader_if_set(BFLB_EFLASH_LOADER_IF_UART);
-    bflb_eflash_loader_if_init();
+        bflb_eflash_loader_if_set(BFLB_EFLASH_LOADER_IF_UART);
+        bflb_eflash_loader_if_init();
+#ifdef BSP_USING_USB
+        bflb_eflash_loader_usb_init();
+#endif
+        boot_profile_mark(BOOT_PHASE_LOADER_INIT);
+    }
 
     wdt_register(WDT_INDEX, "wdg_rst");
     wdg = device_find("wdg_rst");
@@ -467,6 +586,7 @@ static void main_task(void *pvParameters)
 
     hal_boot2_custom();
     flash_init();
+    boot_profile_mark(BOOT_PHASE_FLASH_INIT);
 
     bflb_platform_deinit_time();
 
@@ -509,19 +629,28 @@ static void main_task(void *pvParameters)
     pt_table_set_flash_operation(flash_erase, flash_write, flash_read);
 
     pt_table_dump();
+    boot_profile_mark(BOOT_PHASE_PT_READY);
 
-    if (BL_RD_REG(HBN_BASE, HBN_RSV3) == 0xAABBCCDD) {
-        BL_WR_REG(HBN_BASE, HBN_RSV3, 0x00);
-        boot_timeout = 10000 / 20;
-    }
+    if (boot_timeout) {
+        while (boot_timeout) {
+            if (0 == bflb_eflash_loader_if_handshake_poll(0)) {
+                boot_profile_set_flags(BOOT_PROFILE_FLAG_LOADER_RAN);
+                bflb_eflash_loader_main();
+            }
 
-    while (boot_timeout) {
-        if (0 == bflb_eflash_loader_if_handshake_poll(0)) {
-            bflb_eflash_loader_main();
+#ifdef BSP_USING_USB
+            /* a host with the drive open holds the window */
+            if (bflb_eflash_loader_usb_poll(20)) {
+                boot_profile_set_flags(BOOT_PROFILE_FLAG_LOADER_RAN);
+                continue;
+            }
+#else
+            vTaskDelay(pdMS_TO_TICKS(20));
+#endif
+            boot_timeout--;
         }
 
-        vTaskDelay(pdMS_TO_TICKS(20));
-        boot_timeout--;
+        boot_profile_mark(BOOT_PHASE_HANDSHAKE_END);
     }
 
     while (1) {
@@ -645,6 +774,16 @@ static void main_task(void *pvParameters)
     }
 
     /* We should never get here unless boot fail */
+    if (!loaders_up) {
+        bflb_eflash_loader_if_set(BFLB_EFLASH_LOADER_IF_BLE);
+        bflb_eflash_loader_if_init();
+        bflb_eflash_loader_if_set(BFLB_EFLASH_LOADER_IF_UART);
+        bflb_eflash_loader_if_init();
+#ifdef BSP_USING_USB
+        bflb_eflash_loader_usb_init();
+#endif
+    }
+
     bflb_eflash_loader_if_set(BFLB_EFLASH_LOADER_IF_UART);
     while (1) {
         if (0 == bflb_eflash_loader_if_handshake_poll(0)) {
@@ -652,7 +791,11 @@ static void main_task(void *pvParameters)
         }
 
         // MSG("BLSP boot2 fail\r\n");
+#ifdef BSP_USING_USB
+        bflb_eflash_loader_usb_poll(20);
+#else
         vTaskDelay(pdMS_TO_TICKS(20));
+#endif
     }
 }
 
@@ -688,6 +831,7 @@ int main(void)
 
     system_mtimer_clock_init();
     peripheral_clock_init();
+    boot_profile_start();
 
 #ifdef APP_FLASH_ADDR
     if (BL_RD_REG(HBN_BASE, HBN_RSV3) == 0xA5A55A5A) {
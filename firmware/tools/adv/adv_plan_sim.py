@@ -0,0 +1,219 @@
+#!/usr/bin/env python3
+
+# Host model of the advertising plan in components/ble/ble_stack/host/multi_adv.c.
+#
+# It builds the plan the way multi_adv_new_schedule() does: intervals on a 10 ms
+# slot grid, stretched towards interval_max while the estimated current is over
+# the budget, then offsets that spread the sets over their common period. The plan
+# is then run slot by slot like multi_adv_schedule_timeslot(). A set due in a slot
+# another set already has slips into the next one. The report lists the slips,
+# the intervals the sets really get and the average current of each configuration.
+#
+#   adv_plan_sim.py                          the lego_train sets and the cli example
+#   adv_plan_sim.py --budget 100 --set phone:1000-1200:11:17:conn --set beacon:100-150:15
+
+import argparse
+import math
+
+TIME_PRIOD_MS = 10
+SLOT_PER_PERIOD = TIME_PRIOD_MS * 8 // 5
+MAX_MIN_MULTI = 30000 // TIME_PRIOD_MS
+HIGH_DUTY_CYCLE_INTERVAL = 20 * 8 // 5
+
+MULTI_ADV_TX_UA = 9000
+MULTI_ADV_RX_UA = 8000
+MULTI_ADV_CPU_UA = 4000
+MULTI_ADV_RAMP_US = 150
+MULTI_ADV_RX_WINDOW_US = 230
+MULTI_ADV_SWITCH_US = 1000
+MULTI_ADV_STOP_US = 300
+
+CONFIGS = {
+    # examples/lego_train/ble_app.c before a phone connects, 150 uA budget
+    "train": (150, ["phone:1000-1200:11:17:conn", "beacon:100-150:15"]),
+    # connected: the beacon alone, the controller keeps its interval
+    "train-connected": (150, ["beacon:100-150:15"]),
+    # ble_start_multi_adv of the cli, no budget
+    "cli": (0, ["conn:100:26:0:conn", "nonconn:200:26"]),
+    # three sets with intervals that share no common period below the cap
+    "crowded": (0, ["a:100:20", "b:130:20", "c:170:20:0:conn"]),
+}
+
+
+class AdvSet:
+    def __init__(self, spec):
+        fields = spec.split(":")
+        self.name = fields[0]
+        lo, _, hi = fields[1].partition("-")
+        # bt_le_adv_param takes 0.625 ms units
+        self.interval_min = int(float(lo) * 8 / 5)
+        self.interval_max = int(float(hi or lo) * 8 / 5)
+        self.ad_len = int(fields[2]) if len(fields) > 2 else 31
+        self.sd_len = int(fields[3]) if len(fields) > 3 and fields[3] else 0
+        self.connectable = len(fields) > 4 and fields[4] == "conn"
+        self.charge = event_charge(self)
+        self.interval = 0
+        self.offset = 0
+
+
+def event_charge(s):
+    """multi_adv_event_charge(), uA * ms of one event on three channels."""
+    tx_us = (1 + 4 + 2 + 6 + s.ad_len + 3) * 8 + MULTI_ADV_RAMP_US
+    rx_us = MULTI_ADV_RX_WINDOW_US if s.connectable or s.sd_len else 0
+    return (3 * (tx_us * MULTI_ADV_TX_UA + rx_us * MULTI_ADV_RX_UA) +
+            (MULTI_ADV_SWITCH_US + MULTI_ADV_STOP_US) * MULTI_ADV_CPU_UA) // 1000
+
+
+def change_to_tick(min_interval, max_interval):
+    if max_interval // SLOT_PER_PERIOD != min_interval // SLOT_PER_PERIOD:
+        tick = min_interval // SLOT_PER_PERIOD
+        if min_interval % SLOT_PER_PERIOD:
+            tick += 1
+    else:
+        tick = min_interval // SLOT_PER_PERIOD
+    return max(tick, 1)
+
+
+def plan_current(intervals, charges):
+    return sum(c // (i * TIME_PRIOD_MS) for i, c in zip(intervals, charges))
+
+
+def fit_budget(budget, intervals, max_intervals, charges):
+    while budget and plan_current(intervals, charges) > budget:
+        stretchable = [i for i in range(len(intervals)) if intervals[i] < max_intervals[i]]
+        if not stretchable:
+            return False
+        # the first of equal costs wins, like the strict compare in C
+        worst = max(stretchable, key=lambda i: (charges[i] // intervals[i], -i))
+        intervals[worst] = min(intervals[worst] + max(intervals[worst] // 8, 1), max_intervals[worst])
+    return True
+
+
+def calculate_offset(interval, offset, num, duration):
+    if num == 0:
+        return 0
+    offset_range = min(interval[num], duration)
+    best, best_max = 0, None
+    for i in range(offset_range):
+        worst = 0
+        for j in range(duration):
+            n = sum(1 for k in range(num) if j % interval[k] == offset[k]) + (1 if j % interval[num] == i else 0)
+            worst = max(worst, n)
+        if best_max is None or worst < best_max:
+            best, best_max = i, worst
+    return best
+
+
+def schedule_table(intervals):
+    min_multi = intervals[0]
+    for i in intervals[1:]:
+        m = min_multi * i // math.gcd(min_multi, i)
+        if m > MAX_MIN_MULTI:
+            break
+        min_multi = m
+    offsets = []
+    for i in range(len(intervals)):
+        offsets.append(calculate_offset(intervals, offsets + [0], i, min_multi))
+    return offsets, min_multi
+
+
+def build_plan(sets, budget):
+    """multi_adv_new_schedule(), returns the sets shortest interval first."""
+    if any(s.interval_min < HIGH_DUTY_CYCLE_INTERVAL for s in sets):
+        raise SystemExit("a high duty cycle set takes the controller for itself, nothing to plan")
+
+    intervals = [change_to_tick(s.interval_min, s.interval_max) for s in sets]
+    max_intervals = [max(s.interval_max // SLOT_PER_PERIOD, i) for s, i in zip(sets, intervals)]
+    charges = [s.charge for s in sets]
+    fits = True
+    if len(sets) > 1:
+        fits = fit_budget(budget, intervals, max_intervals, charges)
+
+    # multi_adv_reorder() is a stable sort for distinct intervals
+    order = sorted(range(len(sets)), key=lambda i: intervals[i])
+    plan = [sets[i] for i in order]
+    for s, i in zip(plan, sorted(intervals)):
+        s.interval = i
+    offsets, period = schedule_table([s.interval for s in plan])
+    for s, o in zip(plan, offsets):
+        s.offset = o
+    return plan, period, fits, plan_current(intervals, charges)
+
+
+def run(plan, seconds):
+    """multi_adv_schedule_timeslot() for every slot of the run."""
+    slots = int(seconds * 1000 / TIME_PRIOD_MS)
+    events = {s.name: [] for s in plan}
+    pending = set()
+    slips = collisions = on_air = stops = 0
+
+    for slot in range(slots):
+        due = [i for i, s in enumerate(plan) if slot % s.interval == s.offset]
+        if len(due) > 1:
+            collisions += 1
+        pending.update(due)
+        if not pending:
+            continue
+
+        first = min(pending)
+        pending.discard(first)
+        slips += len(pending)
+        events[plan[first].name].append(slot)
+        on_air += 1
+
+        # a stop at the end of the slot unless the next one starts another set
+        if not pending and not any((slot + 1) % s.interval == s.offset for s in plan):
+            stops += 1
+
+    return events, slips, collisions, on_air, stops, slots
+
+
+def report(name, sets, budget, seconds):
+    print("== %s: %s, budget %s" % (name, ", ".join(s.name for s in sets), "%d uA" % budget if budget else "none"))
+    plan, period, fits, planned_ua = build_plan(sets, budget)
+
+    if len(plan) == 1:
+        s = plan[0]
+        # a lone set runs on the controller's own interval, no switches and no stops
+        ms = s.interval_min * 5 // 8
+        print("   %-8s alone at %d ms, planned %d uA, about %d uA without the switches" %
+              (s.name, ms, planned_ua, (s.charge - (MULTI_ADV_SWITCH_US + MULTI_ADV_STOP_US) * MULTI_ADV_CPU_UA // 1000) // ms))
+        return
+
+    for s in plan:
+        print("   %-8s interval %4d ms (asked %d-%d ms), offset %3d ms, %5d uA*ms per event" %
+              (s.name, s.interval * TIME_PRIOD_MS, s.interval_min * 5 // 8, s.interval_max * 5 // 8,
+               s.offset * TIME_PRIOD_MS, s.charge))
+    print("   common period %d ms%s, planned %d uA%s" %
+          (period * TIME_PRIOD_MS, "" if period < MAX_MIN_MULTI else " (capped)", planned_ua,
+           "" if fits else ", over budget at interval_max"))
+
+    events, slips, collisions, on_air, stops, slots = run(plan, seconds)
+    charge = 0
+    for s in plan:
+        ev = events[s.name]
+        gaps = [(b - a) * TIME_PRIOD_MS for a, b in zip(ev, ev[1:])]
+        mean = sum(gaps) / len(gaps) if gaps else 0
+        charge += len(ev) * s.charge
+        print("   %-8s %6d events, mean interval %7.1f ms, max gap %4d ms" %
+              (s.name, len(ev), mean, max(gaps) if gaps else 0))
+    # the charge counts a stop after every event, back to back events skip it
+    charge -= (on_air - stops) * MULTI_ADV_STOP_US * MULTI_ADV_CPU_UA // 1000
+    print("   %d slots with more than one set due, %d slips, radio busy in %.1f%% of the slots, %d stops" %
+          (collisions, slips, 100.0 * on_air / slots, stops))
+    print("   average %.1f uA over %d s" % (charge / (seconds * 1000), seconds))
+
+
+parser = argparse.ArgumentParser(description='Model of the multi_adv.c advertising plan')
+parser.add_argument('--set', help='name:interval_ms[-max_ms]:ad_len[:sd_len][:conn], repeat for each set', action='append')
+parser.add_argument('--budget', help='advertising current budget in uA, 0 for none', type=int, default=0)
+parser.add_argument('--config', help='run one of the built-in configurations', choices=sorted(CONFIGS), default=None)
+parser.add_argument('--seconds', help='simulated time', type=int, default=600)
+args = parser.parse_args()
+
+if args.set:
+    report("custom", [AdvSet(s) for s in args.set], args.budget, args.seconds)
+else:
+    for name in [args.config] if args.config else CONFIGS:
+        budget, specs = CONFIGS[name]
+        report(name, [AdvSet(s) for s in specs], budget, args.seconds)
@@ -0,0 +1,292 @@
+/*
+ * Host build of the relay autotune of lego_train (examples/lego_train/autotune.c) on
+ * simulated trains.
+ *
+ * Each model is a motor with a first order speed response, a dead band, a transport
+ * delay and the 10 ms tick count of the QDEC as the only measurement. The run does what
+ * speed_ctrl.c does: the default pid brings the train to the setpoint, the relay takes
+ * over from its output, and the Ziegler-Nichols PI gains from Ku and Tu go back into the
+ * fixed point pid. Speed steps then compare those gains with the defaults. A model
+ * fails when the relay does not finish, or the tuned loop overshoots or does not settle.
+ * Two more runs check that a lost encoder and a runaway end the experiment.
+ *
+ *   gcc -O2 -I common/pid -I examples/lego_train tools/autotune/autotune_sim.c \
+ *       examples/lego_train/autotune.c common/pid/pid_q.c -lm -o autotune_sim
+ *   ./autotune_sim
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "autotune.h"
+#include "pid_q.h"
+
+/* speed_ctrl.c of the train, which pulls in the hal */
+#define SPEED_CTRL_PERIOD_MS         10
+#define SPEED_CTRL_KP                0.05
+#define SPEED_CTRL_KI                0.02
+#define SPEED_CTRL_MAX_OUT           100
+#define SPEED_CTRL_IN_BITS           12
+#define SPEED_CTRL_OUT_BITS          7
+#define SPEED_CTRL_TUNE_SETTLE_MS    1000
+#define SPEED_CTRL_TUNE_MAX_OUT      80
+#define SPEED_CTRL_TUNE_WINDOW       4
+#define SPEED_CTRL_TUNE_HYSTERESIS   (2 * 1000 / (SPEED_CTRL_TUNE_WINDOW * SPEED_CTRL_PERIOD_MS))
+#define SPEED_CTRL_TUNE_MAX_DEVIATION 600
+#define SPEED_CTRL_TUNE_TIMEOUT_MS   15000
+#define SPEED_CTRL_TUNE_NO_SIGNAL_MS 1000
+
+/* one tick in a control step */
+#define SPEED_QUANTUM (1000 / SPEED_CTRL_PERIOD_MS)
+
+#define TUNE_SETPOINT 300
+#define TUNE_RELAY    30
+#define SUBSTEPS      10
+#define DELAY_MAX     8
+
+typedef struct {
+    const char *name;
+    double gain;     /* ticks/s per % of duty past the dead band */
+    double tau_s;
+    double deadband; /* % of duty */
+    int delay;       /* control steps */
+} model_t;
+
+typedef struct {
+    const model_t *model;
+    double velocity;
+    double position; /* ticks */
+    int32_t ticks[SPEED_CTRL_TUNE_WINDOW + 1];
+    int32_t duty[DELAY_MAX + 1];
+    int broken;      /* encoder unplugged */
+} plant_t;
+
+static const model_t models[] = {
+    { "light train", 10.0, 0.15, 8.0, 0 },
+    { "three cars", 9.0, 0.45, 12.0, 1 },
+    { "worn gearbox", 7.0, 0.25, 18.0, 2 },
+    { "fast motor", 16.0, 0.10, 6.0, 1 },
+    { "low battery", 6.0, 0.30, 10.0, 3 },
+};
+
+static int failed;
+
+static void plant_init(plant_t *p, const model_t *model)
+{
+    memset(p, 0, sizeof(*p));
+    p->model = model;
+}
+
+/* one control step: apply a duty, return the velocity speed_ctrl.c measures */
+static int32_t plant_step(plant_t *p, int32_t duty)
+{
+    const model_t *m = p->model;
+    double drive, dt = SPEED_CTRL_PERIOD_MS / 1000.0 / SUBSTEPS;
+    int32_t ticks, velocity;
+    int i;
+
+    memmove(&p->duty[1], &p->duty[0], DELAY_MAX * sizeof(p->duty[0]));
+    p->duty[0] = duty;
+    duty = p->duty[m->delay];
+
+    drive = (abs(duty) > m->deadband) ? (duty - copysign(m->deadband, duty)) : 0;
+    for (i = 0; i < SUBSTEPS; i++) {
+        p->velocity += (m->gain * drive - p->velocity) * dt / m->tau_s;
+        p->position += p->velocity * dt;
+    }
+
+    ticks = p->broken ? 0 : (int32_t)floor(p->position);
+    velocity = (ticks - p->ticks[0]) * (1000 / SPEED_CTRL_PERIOD_MS);
+    memmove(&p->ticks[1], &p->ticks[0], SPEED_CTRL_TUNE_WINDOW * sizeof(p->ticks[0]));
+    p->ticks[0] = ticks;
+
+    return velocity;
+}
+
+/* the velocity the relay sees, over a few steps for a finer count */
+static int32_t plant_window_velocity(const plant_t *p)
+{
+    return (p->ticks[0] - p->ticks[SPEED_CTRL_TUNE_WINDOW]) * (1000 / (SPEED_CTRL_TUNE_WINDOW * SPEED_CTRL_PERIOD_MS));
+}
+
+static void pid_default(pid_q_alg_t *pid)
+{
+    const autotune_gains_t gains = { SPEED_CTRL_KP, SPEED_CTRL_KI, 0 };
+
+    pid_q_init(pid);
+    autotune_to_pid_q(&gains, SPEED_CTRL_IN_BITS, SPEED_CTRL_OUT_BITS, pid);
+    pid->max_val = q31_from_int(SPEED_CTRL_MAX_OUT, SPEED_CTRL_OUT_BITS);
+    pid->min_val = q31_from_int(-SPEED_CTRL_MAX_OUT, SPEED_CTRL_OUT_BITS);
+}
+
+static int32_t pid_duty(pid_q_alg_t *pid, int32_t target, int32_t velocity)
+{
+    return q31_to_int(feedback_pid_q_cal(pid, q31_from_int(target, SPEED_CTRL_IN_BITS),
+                                         q31_from_int(velocity, SPEED_CTRL_IN_BITS)),
+                      SPEED_CTRL_OUT_BITS);
+}
+
+static void tune_cfg(autotune_cfg_t *cfg, int32_t setpoint, int32_t bias)
+{
+    cfg->setpoint = setpoint;
+    cfg->bias = bias;
+    cfg->relay = TUNE_RELAY;
+    cfg->hysteresis = SPEED_CTRL_TUNE_HYSTERESIS;
+    cfg->max_out = SPEED_CTRL_TUNE_MAX_OUT;
+    cfg->max_deviation = SPEED_CTRL_TUNE_MAX_DEVIATION;
+    cfg->timeout_steps = SPEED_CTRL_TUNE_TIMEOUT_MS / SPEED_CTRL_PERIOD_MS;
+    cfg->no_signal_steps = SPEED_CTRL_TUNE_NO_SIGNAL_MS / SPEED_CTRL_PERIOD_MS;
+    cfg->settle_cycles = 3;
+    cfg->cycles = 4;
+}
+
+/* the settle phase and the relay, as speed_ctrl.c runs them; returns the final state */
+static autotune_state_t tune(plant_t *p, autotune_t *at)
+{
+    autotune_cfg_t cfg;
+    pid_q_alg_t pid;
+    int32_t velocity = 0, duty = 0;
+    int i;
+
+    pid_default(&pid);
+    for (i = 0; i < SPEED_CTRL_TUNE_SETTLE_MS / SPEED_CTRL_PERIOD_MS; i++) {
+        duty = pid_duty(&pid, TUNE_SETPOINT, velocity);
+        velocity = plant_step(p, duty);
+    }
+
+    tune_cfg(&cfg, TUNE_SETPOINT, duty);
+    autotune_start(at, &cfg);
+    while (at->state == AUTOTUNE_RUNNING) {
+        plant_step(p, autotune_step(at, plant_window_velocity(p)));
+    }
+
+    return at->state;
+}
+
+typedef struct {
+    double overshoot;  /* % of the step */
+    double settle_ms;  /* worst of the steps */
+    double error;      /* mean |error| over the last half second of each step, ticks/s */
+} response_t;
+
+/* speed steps from rest, each held for 2 s */
+static void step_response(const model_t *m, pid_q_alg_t *pid, response_t *r)
+{
+    static const int32_t targets[] = { 300, 600, 150, 450 };
+    const int hold = 4000 / SPEED_CTRL_PERIOD_MS;
+    plant_t p;
+    int32_t velocity = 0, from = 0, band;
+    double peak, error_sum = 0;
+    int t, i, last_out;
+
+    memset(r, 0, sizeof(*r));
+    plant_init(&p, m);
+
+    for (t = 0; t < (int)(sizeof(targets) / sizeof(targets[0])); t++) {
+        band = abs(targets[t] - from) / 10;
+        band = (band < SPEED_QUANTUM) ? SPEED_QUANTUM : band;
+        peak = 0;
+        last_out = 0;
+
+        for (i = 0; i < hold; i++) {
+            velocity = plant_step(&p, pid_duty(pid, targets[t], velocity));
+
+            /* overshoot on the true speed, the ticks are too coarse for it */
+            if (targets[t] > from) {
+                peak = fmax(peak, p.velocity - targets[t]);
+            } else {
+                peak = fmax(peak, targets[t] - p.velocity);
+            }
+            if (fabs(p.velocity - targets[t]) > band) {
+                last_out = i + 1;
+            }
+            if (i >= hold - 500 / SPEED_CTRL_PERIOD_MS) {
+                error_sum += fabs(p.velocity - targets[t]);
+            }
+        }
+
+        r->overshoot = fmax(r->overshoot, 100.0 * peak / abs(targets[t] - from));
+        r->settle_ms = fmax(r->settle_ms, last_out * SPEED_CTRL_PERIOD_MS);
+        from = targets[t];
+    }
+
+    r->error = error_sum / (sizeof(targets) / sizeof(targets[0])) / (500 / SPEED_CTRL_PERIOD_MS);
+}
+
+static void run_model(const model_t *m)
+{
+    static const char *const rules[] = { "zn pid", "zn pi", "tl pi" };
+    autotune_gains_t gains;
+    autotune_t at;
+    pid_q_alg_t pid;
+    response_t tuned, def;
+    plant_t p;
+    float ku, tu;
+    int rule;
+
+    plant_init(&p, m);
+    if ((tune(&p, &at) != AUTOTUNE_DONE) || autotune_result(&at, &ku, &tu)) {
+        printf("%-13s relay ended in state %d after %u steps  FAIL\n", m->name, at.state, at.step);
+        failed = 1;
+        return;
+    }
+
+    printf("%-13s Ku %.4f duty per tick/s, Tu %.0f ms, %u cycles in %.1f s, bias %d\n", m->name, ku,
+           tu * SPEED_CTRL_PERIOD_MS, at.cycle, at.step * SPEED_CTRL_PERIOD_MS / 1000.0, at.bias);
+
+    pid_default(&pid);
+    step_response(m, &pid, &def);
+    printf("    %-8s kp %.4f ki %.4f kd %.4f: overshoot %5.1f %%, settled in %4.0f ms, error %5.1f ticks/s\n",
+           "default", SPEED_CTRL_KP, SPEED_CTRL_KI, 0.0, def.overshoot, def.settle_ms, def.error);
+
+    for (rule = AUTOTUNE_RULE_ZN_PID; rule <= AUTOTUNE_RULE_TL_PI; rule++) {
+        autotune_gains(ku, tu, rule, &gains);
+        pid_default(&pid);
+        autotune_to_pid_q(&gains, SPEED_CTRL_IN_BITS, SPEED_CTRL_OUT_BITS, &pid);
+        step_response(m, &pid, &tuned);
+
+        printf("    %-8s kp %.4f ki %.4f kd %.4f: overshoot %5.1f %%, settled in %4.0f ms, error %5.1f ticks/s",
+               rules[rule], gains.kp, gains.ki, gains.kd, tuned.overshoot, tuned.settle_ms, tuned.error);
+
+        /* the train runs the ziegler-nichols pi gains, the others are for comparison */
+        if ((rule == AUTOTUNE_RULE_ZN_PI) && ((tuned.overshoot > 25.0) || (tuned.settle_ms > 1500))) {
+            printf("  FAIL");
+            failed = 1;
+        }
+        printf("\n");
+    }
+}
+
+static void run_faults(void)
+{
+    autotune_t at;
+    plant_t p;
+
+    plant_init(&p, &models[0]);
+    p.broken = 1;
+    tune(&p, &at);
+    printf("%-13s state %d after %u ms%s\n", "no encoder", at.state, at.step * SPEED_CTRL_PERIOD_MS,
+           (at.state != AUTOTUNE_NO_SIGNAL) ? "  FAIL" : "");
+    failed |= (at.state != AUTOTUNE_NO_SIGNAL);
+
+    /* a relay far too strong for the band drives the train out of it */
+    static const model_t runaway = { "runaway", 200.0, 0.15, 0.0, 2 };
+    plant_init(&p, &runaway);
+    tune(&p, &at);
+    printf("%-13s state %d after %u ms%s\n", runaway.name, at.state, at.step * SPEED_CTRL_PERIOD_MS,
+           (at.state != AUTOTUNE_OUT_OF_RANGE) ? "  FAIL" : "");
+    failed |= (at.state != AUTOTUNE_OUT_OF_RANGE);
+}
+
+int main(void)
+{
+    unsigned i;
+
+    for (i = 0; i < sizeof(models) / sizeof(models[0]); i++) {
+        run_model(&models[i]);
+    }
+    run_faults();
+
+    return failed;
+}
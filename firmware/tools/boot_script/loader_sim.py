@@ -0,0 +1,574 @@
+#!/usr/bin/env python3
+
+# Simulated robot_bootloader endpoint for benchmarking ota_client.py without a radio.
+#
+# It implements the flash command set of examples/robot_bootloader/bflb_eflash_loader_cmds.c,
+# erase-ahead, encrypted and resumable transfers included, behind the reassembly rules of
+# bflb_eflash_loader_ble.c. The socket carries the ATT writes and indications of
+# the real link (see ota_client.py for the framing) and each of them is delayed by
+# a simple connection event model, so transfer speed compares with the radio.
+# A client that opens the loader's LE credit based channel gets the credit
+# accounting of the BLE stack's l2cap.c instead, see run_l2cap().
+# Flash and the page log survive a simulated reboot, the rest of the state does not.
+
+import argparse
+import asyncio
+import binascii
+import hashlib
+import random
+import struct
+import subprocess
+import time
+
+from ota_client import (SIM_FRAME_FORMAT, SIM_WRITE_REQ, SIM_WRITE_RSP, SIM_WRITE_CMD, SIM_INDICATE,
+                        SIM_HELLO, SIM_L2CAP_CONNECT, SIM_L2CAP_PDU, SIM_L2CAP_CREDITS, SIM_DEFAULT_PORT,
+                        FLASH_START_ADDRESS, L2CAP_PSM, L2CAP_MAX_MPS, L2CAP_CONN_SUCCESS)
+
+CMD_RESET = 0x21
+CMD_FLASH_ERASE = 0x30
+CMD_FLASH_WRITE = 0x31
+CMD_FLASH_READ = 0x32
+CMD_FLASH_WRITE_CHECK = 0x3A
+CMD_FLASH_SET_PARA = 0x3B
+CMD_FLASH_READSHA = 0x3D
+CMD_FLASH_XIP_READSHA = 0x3E
+CMD_FLASH_DECRYPT_START = 0x3F
+CMD_FLASH_READ_JEDECID = 0x36
+CMD_XIP_READ_START = 0x60
+CMD_XIP_READ_FINISH = 0x61
+
+ERR_FLASH_ERASE_PARA = 0x0002
+ERR_FLASH_WRITE_PARA = 0x0004
+ERR_FLASH_WRITE_ADDR = 0x0005
+ERR_FLASH_WRITE = 0x0006
+ERR_CMD_CRC = 0x0103
+
+ATT_ERR_INVALID_ATTRIBUTE_LEN = 0x0D
+ATT_ERR_VALUE_NOT_ALLOWED = 0x13
+
+BLE_READBUF_SIZE = 4096 + 1024
+# BFLB_EFLASH_LOADER_BLE_L2CAP_MTU
+L2CAP_MTU = 2048 + 8
+L2CAP_ERR_PSM_NOT_SUPP = 0x0002
+SECTOR_SIZE = 4096
+ERASE_AHEAD_SECTORS = 2
+# size1 of the FW entry in partition_cfg_1M_boot2_ble.toml, the loader takes it from the partition table
+IMG_MAX_LEN = 0xca000
+PROGRESS_OFFSET = IMG_MAX_LEN - SECTOR_SIZE
+PROGRESS_QUERY_PAGES = 40
+JEDEC_ID = b'\xef\x40\x15\x00'
+
+ENC_IMG_MAGIC = b'BFEI'
+ENC_IMG_VERSION = 1
+ENC_IMG_FLAG_XZ = 0x01
+ENC_IMG_HEADER_SIZE = 36
+
+
+class Loader:
+    """Loader state, kept across connections like on the device."""
+
+    def __init__(self, args):
+        self.args = args
+        self.flash = bytearray(b'\xff' * IMG_MAX_LEN)
+        # the page log at PROGRESS_OFFSET: image length, id and the CRC of each logged page
+        self.log = None
+        self.reboot()
+
+    def reboot(self):
+        self.erased = set()
+        self.fill = None
+        self.erase_ahead_active = False
+        self.img_len = 0
+        self.write_addr = FLASH_START_ADDRESS
+        self.error = 0
+        self.decrypt = None
+        self.erase_ahead_cnt = 0
+        self.erase_inline_cnt = 0
+        self.written = 0
+        self.start = None
+        self.flash_lock = asyncio.Lock()
+        self.poll_task = None
+
+    def ack(self, result=0):
+        if result == 0:
+            return b'OK'
+        return b'FL' + struct.pack("<H", result)
+
+    async def erase_sector(self, idx):
+        if idx not in self.erased:
+            await asyncio.sleep(self.args.erase_ms / 1000)
+            self.flash[idx * SECTOR_SIZE:(idx + 1) * SECTOR_SIZE] = b'\xff' * SECTOR_SIZE
+            self.erased.add(idx)
+
+    def erase_start(self):
+        self.log = None
+        self.erased = set()
+        self.erase_ahead_active = True
+        self.erase_ahead_cnt = 0
+        self.erase_inline_cnt = 0
+        self.write_addr = FLASH_START_ADDRESS
+        self.img_len = 0
+        self.written = 0
+        self.start = time.time()
+
+    def erase_ahead_kick(self):
+        if self.poll_task is None or self.poll_task.done():
+            self.poll_task = asyncio.ensure_future(self.erase_ahead_poll())
+
+    async def erase_ahead_poll(self):
+        # the BLE interface erases one sector per receive poll while the host sends
+        while self.erase_ahead_active and self.error == 0:
+            end = min(self.img_len, IMG_MAX_LEN) if self.img_len else IMG_MAX_LEN
+            idx = (self.write_addr - FLASH_START_ADDRESS) // SECTOR_SIZE
+            last = min((end - 1) // SECTOR_SIZE, idx + ERASE_AHEAD_SECTORS)
+            pending = [i for i in range(idx, last + 1) if i not in self.erased]
+            if not pending:
+                return
+            async with self.flash_lock:
+                await self.erase_sector(pending[0])
+                self.erase_ahead_cnt += 1
+
+    def decrypt_write(self, addr, data):
+        hdr = self.decrypt
+        if hdr is None or addr < FLASH_START_ADDRESS or addr >= FLASH_START_ADDRESS + hdr["payload_len"]:
+            return 0, data
+
+        offset = addr - FLASH_START_ADDRESS
+        if (offset & 0x0f) or (len(data) & 0x0f) or offset + len(data) > hdr["payload_len"]:
+            return ERR_FLASH_WRITE_PARA, data
+
+        # the low word of the IV counts blocks, the loader never crosses its wrap
+        iv = hdr["iv"][:12] + ((int.from_bytes(hdr["iv"][12:], "big") + offset // 16) & 0xffffffff).to_bytes(4, "big")
+        plain = subprocess.run(["openssl", "enc", "-d", "-aes-128-ctr", "-nosalt", "-K", self.args.key, "-iv", iv.hex()],
+                               input=data, stdout=subprocess.PIPE, check=True).stdout
+        return 0, plain
+
+    async def cmd_erase(self, data):
+        if len(data) not in (8, 12):
+            return self.ack(ERR_FLASH_ERASE_PARA)
+
+        self.error = 0
+        startaddr, endaddr = struct.unpack_from("<II", data)
+        self.decrypt = None
+        self.erase_start()
+        self.img_len = endaddr - startaddr + 1
+        if self.img_len > IMG_MAX_LEN:
+            return self.ack(ERR_FLASH_ERASE_PARA)
+        if len(data) == 12 and self.img_len <= PROGRESS_OFFSET:
+            self.log = {"img_len": self.img_len, "img_id": struct.unpack_from("<I", data, 8)[0], "pages": {}}
+        return self.ack()
+
+    def progress_track(self, offset, data):
+        # the device reads each write back; CRCs chain over in-order writes of a sector
+        if self.log is None or offset + len(data) > self.log["img_len"]:
+            return
+        while data:
+            page, pos = divmod(offset, SECTOR_SIZE)
+            n = min(len(data), SECTOR_SIZE - pos)
+            if pos == 0:
+                self.fill = (page, 0, 0)
+            if self.fill is not None and self.fill[:2] == (page, pos):
+                crc = binascii.crc32(data[:n], self.fill[2])
+                self.fill = (page, pos + n, crc)
+                if pos + n == SECTOR_SIZE or offset + n == self.log["img_len"]:
+                    self.log["pages"][page] = crc
+                    self.fill = None
+            else:
+                self.fill = None
+            offset += n
+            data = data[n:]
+
+    async def cmd_write_check(self, data):
+        if len(data) != 12 or self.error:
+            return self.ack(self.error)
+
+        img_len, img_id, first = struct.unpack("<III", data)
+        log = self.log
+        pages = 0
+        if log is not None and img_len and img_len == log["img_len"] and img_id == log["img_id"]:
+            pages = (img_len + SECTOR_SIZE - 1) // SECTOR_SIZE
+            # pick up where the session stopped, logged pages are never erased again
+            self.erase_ahead_active = True
+            self.fill = None
+            self.img_len = img_len
+            self.erased |= set(log["pages"])
+            todo = [i for i in range(pages) if i not in log["pages"]]
+            self.write_addr = FLASH_START_ADDRESS + (todo[0] * SECTOR_SIZE if todo else img_len)
+            if self.start is None:
+                self.start = time.time()
+
+        count = min(max(pages - first, 0), PROGRESS_QUERY_PAGES)
+        bitmap = bytearray((pages + 7) // 8)
+        for i in range(pages):
+            if i in log["pages"]:
+                bitmap[i // 8] |= 1 << (i % 8)
+        crcs = b''.join(struct.pack("<I", log["pages"].get(first + i, 0)) for i in range(count))
+        payload = struct.pack("<HHHH", pages, first, count, 0) + bytes(bitmap) + crcs
+        return b'OK' + struct.pack("<H", len(payload)) + payload
+
+    async def cmd_decrypt_start(self, data):
+        self.decrypt = None
+
+        if len(data) != ENC_IMG_HEADER_SIZE or data[:4] != ENC_IMG_MAGIC or \
+           binascii.crc32(data[:32]) != struct.unpack_from("<I", data, 32)[0]:
+            return self.ack(ERR_FLASH_WRITE_PARA)
+
+        version, flags, key_sel, _, payload_len, payload_crc, iv = struct.unpack_from("<BBBBII16s", data, 4)
+        if version != ENC_IMG_VERSION or (flags & ENC_IMG_FLAG_XZ) or payload_len > IMG_MAX_LEN or self.args.key is None:
+            return self.ack(ERR_FLASH_WRITE_PARA)
+
+        self.decrypt = {"payload_len": payload_len, "iv": iv}
+        return self.ack()
+
+    async def cmd_write(self, data):
+        if len(data) <= 4:
+            return self.ack(ERR_FLASH_WRITE_PARA)
+
+        addr = struct.unpack_from("<I", data)[0]
+        data = data[4:]
+        offset = addr - FLASH_START_ADDRESS
+
+        if offset < 0 or offset + len(data) > IMG_MAX_LEN:
+            return self.ack(ERR_FLASH_WRITE_ADDR)
+
+        if addr == FLASH_START_ADDRESS and (not self.erase_ahead_active or self.write_addr != addr):
+            self.erase_start()
+
+        async with self.flash_lock:
+            for idx in range(offset // SECTOR_SIZE, (offset + len(data) - 1) // SECTOR_SIZE + 1):
+                if idx not in self.erased:
+                    await self.erase_sector(idx)
+                    self.erase_inline_cnt += 1
+
+            ret, data = self.decrypt_write(addr, data)
+            if ret:
+                self.error = ret
+                return self.ack(ret)
+
+            await asyncio.sleep(len(data) / 256 * self.args.prog_ms / 1000)
+            # NOR flash only clears bits, a page written twice with the same data is unchanged
+            for i, b in enumerate(data):
+                self.flash[offset + i] &= b
+
+            if self.flash[offset:offset + len(data)] != data:
+                # not logged, the host sends it again
+                self.fill = None
+                return self.ack(ERR_FLASH_WRITE)
+            self.progress_track(offset, data)
+
+        self.write_addr = addr + len(data)
+        self.written += len(data)
+        if self.erase_ahead_active and offset + len(data) > self.img_len:
+            self.img_len = offset + len(data)
+        return self.ack()
+
+    async def cmd_xip_readsha(self, data):
+        if len(data) != 8:
+            return self.ack(ERR_FLASH_WRITE_PARA)
+        digest = hashlib.sha256(self.flash[:self.img_len]).digest()
+        return b'OK' + struct.pack("<H", len(digest)) + digest
+
+    async def cmd_reset(self, data):
+        self.log = None
+        elapsed = time.time() - self.start if self.start else 0
+        print("reset: %d bytes written in %.1f s (%.1f KB/s), erase ahead %d, inline %d, sha256 %s" %
+              (self.written, elapsed, self.written / 1024 / max(elapsed, 1e-3), self.erase_ahead_cnt,
+               self.erase_inline_cnt, hashlib.sha256(self.flash[:self.img_len]).hexdigest()))
+        return self.ack()
+
+    async def process(self, frame):
+        cmd, checksum, cmd_len = struct.unpack_from("<BBH", frame)
+
+        if checksum != 0 and (sum(frame[2:cmd_len + 4]) & 0xff) != checksum:
+            return self.ack(ERR_CMD_CRC)
+
+        data = frame[4:4 + cmd_len]
+        handlers = {
+            CMD_RESET: self.cmd_reset,
+            CMD_FLASH_ERASE: self.cmd_erase,
+            CMD_FLASH_WRITE: self.cmd_write,
+            CMD_FLASH_WRITE_CHECK: self.cmd_write_check,
+            CMD_FLASH_SET_PARA: lambda d: asyncio.sleep(0, self.ack()),
+            CMD_FLASH_XIP_READSHA: self.cmd_xip_readsha,
+            CMD_FLASH_DECRYPT_START: self.cmd_decrypt_start,
+            CMD_FLASH_READ_JEDECID: lambda d: asyncio.sleep(0, b'OK' + struct.pack("<H", 4) + JEDEC_ID),
+            CMD_XIP_READ_START: lambda d: asyncio.sleep(0, self.ack()),
+            CMD_XIP_READ_FINISH: lambda d: asyncio.sleep(0, self.ack()),
+        }
+
+        # FLASH_READ and READSHA are stubs that answer nothing, as are unknown commands
+        if cmd not in handlers:
+            return None
+        return await handlers[cmd](data)
+
+
+async def reader_frames(reader):
+    while True:
+        ftype, length = struct.unpack(SIM_FRAME_FORMAT, await reader.readexactly(struct.calcsize(SIM_FRAME_FORMAT)))
+        yield ftype, await reader.readexactly(length)
+
+
+class Connection:
+    def __init__(self, loader, args, reader, writer):
+        self.loader = loader
+        self.args = args
+        self.reader = reader
+        self.writer = writer
+        self.rx = bytearray()
+        self.writes = 0
+
+    def event(self, count=1):
+        return asyncio.sleep(count * self.args.interval / 1000)
+
+    def send(self, ftype, payload):
+        self.writer.write(struct.pack(SIM_FRAME_FORMAT, ftype, len(payload)) + payload)
+
+    async def indicate(self, payload):
+        # goes out in the next connection event, the host confirms it in the one after
+        await self.event()
+        self.send(SIM_INDICATE, payload)
+        await self.writer.drain()
+        return True
+
+    def recv(self, chunk):
+        """ble_blf_recv(), returns the ATT error and whether a whole frame is in."""
+        if len(chunk) + len(self.rx) >= BLE_READBUF_SIZE:
+            return ATT_ERR_INVALID_ATTRIBUTE_LEN, False
+
+        self.rx += chunk
+        if len(self.rx) < 2:
+            self.rx = bytearray()
+            return ATT_ERR_VALUE_NOT_ALLOWED, False
+
+        return 0, len(self.rx) - 2 >= struct.unpack_from("<H", self.rx)[0]
+
+    async def run(self):
+        mtu = self.args.mtu
+        # scan, connect and service discovery before the host can write
+        await asyncio.sleep(self.args.connect_ms / 1000)
+        self.send(SIM_HELLO, struct.pack("<HB", mtu, 0 if self.args.no_write_without_response else 1))
+
+        while True:
+            ftype, length = struct.unpack(SIM_FRAME_FORMAT, await self.reader.readexactly(struct.calcsize(SIM_FRAME_FORMAT)))
+            chunk = await self.reader.readexactly(length)
+
+            if ftype == SIM_L2CAP_CONNECT:
+                await self.run_l2cap(reader_frames(self.reader), chunk)
+                return
+
+            if length > mtu - 3 or ftype not in (SIM_WRITE_REQ, SIM_WRITE_CMD) or \
+               (ftype == SIM_WRITE_CMD and self.args.no_write_without_response):
+                print("dropping the link: ATT write of %d bytes, type 0x%02X" % (length, ftype))
+                return
+
+            if ftype == SIM_WRITE_REQ:
+                # request in one connection event, response in the next
+                await self.event(2)
+            else:
+                await self.event(1 / self.args.packets_per_event)
+
+            err, complete = self.recv(chunk)
+            if ftype == SIM_WRITE_REQ:
+                self.send(SIM_WRITE_RSP, bytes([err]))
+            if not complete:
+                continue
+
+            pkg_length = struct.unpack_from("<H", self.rx)[0]
+            frame = bytes(self.rx[2:])
+            self.rx = bytearray()
+
+            if len(frame) != pkg_length:
+                await self.indicate(b'NOK\x00')
+                continue
+
+            if not await self.command(frame, self.indicate):
+                return
+
+    async def command(self, frame, answer):
+        """Runs one command, False once the link is gone."""
+        if frame[0] == CMD_FLASH_WRITE and (self.args.drop_every or self.args.drop_rate):
+            self.writes += 1
+            if (self.args.drop_every and self.writes % self.args.drop_every == 0) or \
+               random.random() < self.args.drop_rate:
+                # processed but never acknowledged, the client has to resend it
+                await self.loader.process(frame)
+                print("dropping the link after write %d%s" % (self.writes, ", rebooting" if self.args.reboot_on_drop else ""))
+                if self.args.reboot_on_drop:
+                    self.loader.reboot()
+                return False
+
+        rsp = await self.loader.process(frame)
+        if rsp is not None and not await answer(rsp):
+            return False
+
+        if frame[0] == CMD_RESET:
+            self.loader.reboot()
+            return False
+
+        self.loader.erase_ahead_kick()
+        return True
+
+    async def run_l2cap(self, frames, req):
+        """bflb_eflash_loader_ble.c behind l2cap.c: one command per SDU, credits back once it is copied out."""
+        psm, mtu, mps, credits = struct.unpack("<HHHH", req)
+        if psm != L2CAP_PSM:
+            self.send(SIM_L2CAP_CONNECT, struct.pack("<HHHH", L2CAP_ERR_PSM_NOT_SUPP, 0, 0, 0))
+            return
+
+        self.tx_mtu, self.tx_mps, self.tx_credits = mtu, mps, credits
+        self.tx_credits_event = asyncio.Event()
+        rx_mps = min(L2CAP_MTU + 2, L2CAP_MAX_MPS)
+        # auto tuned from the mtu like l2cap_chan_rx_init(), unless overridden
+        init_credits = self.args.credits or (L2CAP_MTU + L2CAP_MAX_MPS - 1) // L2CAP_MAX_MPS
+        rx_credits = init_credits
+        self.send(SIM_L2CAP_CONNECT, struct.pack("<HHHH", L2CAP_CONN_SUCCESS, L2CAP_MTU, rx_mps, init_credits))
+        print("l2cap: mtu %d mps %d credits %d, host mtu %d mps %d credits %d" %
+              (L2CAP_MTU, rx_mps, init_credits, mtu, mps, credits))
+
+        pdus = asyncio.Queue()
+
+        async def rx():
+            # credits arrive while the loader waits to send, PDUs queue up in the controller
+            try:
+                async for ftype, payload in frames:
+                    if ftype == SIM_L2CAP_CREDITS:
+                        self.tx_credits += struct.unpack("<H", payload)[0]
+                        self.tx_credits_event.set()
+                    elif ftype == SIM_L2CAP_PDU:
+                        pdus.put_nowait(payload)
+                    else:
+                        print("dropping the link: frame type 0x%02X on the l2cap link" % ftype)
+                        break
+            except (asyncio.IncompleteReadError, ConnectionError):
+                pass
+            pdus.put_nowait(None)
+
+        def give(n):
+            nonlocal rx_credits
+            n = min(n, init_credits)
+            rx_credits += n
+            self.send(SIM_L2CAP_CREDITS, struct.pack("<H", n))
+
+        rx_task = asyncio.ensure_future(rx())
+        sdu = None
+        try:
+            while True:
+                pdu = await pdus.get()
+                if pdu is None:
+                    return
+
+                await self.event(1 / self.args.packets_per_event)
+
+                if rx_credits == 0 or len(pdu) > rx_mps:
+                    print("dropping the link: %d byte PDU with %d credits" % (len(pdu), rx_credits))
+                    return
+                rx_credits -= 1
+
+                if sdu is None:
+                    sdu_len = struct.unpack_from("<H", pdu)[0]
+                    if sdu_len > L2CAP_MTU:
+                        print("dropping the link: %d byte SDU" % sdu_len)
+                        return
+                    sdu = bytearray()
+                    seg = 0
+                    pdu = pdu[2:]
+
+                sdu += pdu
+                seg += 1
+                if len(sdu) > sdu_len:
+                    print("dropping the link: SDU length mismatch")
+                    return
+                if len(sdu) < sdu_len:
+                    # l2cap_chan_update_credits(), a sender with a small mps ran dry mid SDU
+                    if rx_credits == 0 and seg == init_credits:
+                        give((sdu_len - len(sdu) + rx_mps - 1) // rx_mps)
+                    continue
+
+                frame = bytes(sdu)
+                sdu = None
+                # ble_coc_rx_pull() copies the SDU out and returns its credits before running it
+                give(seg)
+
+                if len(frame) < 4 or len(frame) - 4 != struct.unpack_from("<H", frame, 2)[0]:
+                    if not await self.l2cap_send(b'NOK\x00'):
+                        return
+                    continue
+
+                if not await self.command(frame, self.l2cap_send):
+                    return
+        finally:
+            rx_task.cancel()
+
+    async def l2cap_send(self, payload):
+        """ble_coc_send(), False when the host withholds credits past the loader's 5 s timeout."""
+        if len(payload) > self.tx_mtu:
+            print("dropping the link: %d byte answer over the host mtu" % len(payload))
+            return False
+
+        await self.event()
+        sdu = struct.pack("<H", len(payload)) + payload
+        for i in range(0, len(sdu), self.tx_mps):
+            if i:
+                await self.event(1 / self.args.packets_per_event)
+            while self.tx_credits == 0:
+                self.tx_credits_event.clear()
+                try:
+                    await asyncio.wait_for(self.tx_credits_event.wait(), 5)
+                except asyncio.TimeoutError:
+                    print("dropping the link: no credits from the host")
+                    return False
+            self.tx_credits -= 1
+            self.send(SIM_L2CAP_PDU, sdu[i:i + self.tx_mps])
+        await self.writer.drain()
+        return True
+
+    async def serve(self):
+        peer = self.writer.get_extra_info("peername")
+        print("connected", peer)
+        try:
+            await self.run()
+        except (asyncio.IncompleteReadError, ConnectionError):
+            pass
+        self.writer.close()
+        print("disconnected", peer)
+
+
+async def main(args):
+    loader = Loader(args)
+
+    async def on_connect(reader, writer):
+        await Connection(loader, args, reader, writer).serve()
+
+    server = await asyncio.start_server(on_connect, args.host, args.port)
+    print("Simulated loader on %s:%d, %.1f ms interval, mtu %d, %s" %
+          (args.host, args.port, args.interval, args.mtu,
+           "write with response only" if args.no_write_without_response
+           else "%d writes without response per event" % args.packets_per_event))
+    async with server:
+        await server.serve_forever()
+
+
+parser = argparse.ArgumentParser(description='Simulated robot_bootloader endpoint')
+parser.add_argument('--host', help='address to listen on', default='127.0.0.1')
+parser.add_argument('--port', help='port to listen on', type=int, default=SIM_DEFAULT_PORT)
+parser.add_argument('--interval', help='connection interval in ms, 0 runs as fast as possible', type=float, default=30)
+parser.add_argument('--packets-per-event', help='writes without response per connection event', type=int, default=4)
+parser.add_argument('--mtu', help='ATT MTU', type=int, default=247)
+parser.add_argument('--no-write-without-response', help='only accept writes with response', action="store_true")
+parser.add_argument('--erase-ms', help='sector erase time', type=float, default=45)
+parser.add_argument('--prog-ms', help='page program time per 256 bytes', type=float, default=0.7)
+parser.add_argument('--drop-every', help='drop the link before acknowledging every Nth write', type=int, default=0)
+parser.add_argument('--drop-rate', help='probability of a drop before acknowledging a write', type=float, default=0)
+parser.add_argument('--seed', help='random seed for --drop-rate', type=int, default=None)
+parser.add_argument('--reboot-on-drop', help='lose the RAM state on a drop, as on a watchdog reset', action="store_true")
+parser.add_argument('--connect-ms', help='reconnect time before the first write', type=float, default=1500)
+parser.add_argument('--credits', help='initial l2cap credits of the loader, 0 tunes them to one full SDU; '
+                    'under half an SDU a 2 KB write stalls like it does in l2cap.c', type=int, default=0)
+parser.add_argument('--key', help='AES-128 efuse key in hex for encrypted transfers', default=None)
+args = parser.parse_args()
+random.seed(args.seed)
+
+try:
+    asyncio.run(main(args))
+except KeyboardInterrupt:
+    pass
@@ -0,0 +1,482 @@
+#!/usr/bin/env python3
+
+# Event-driven OTA client for the robot_bootloader flash loader.
+#
+# Every loader command is one length prefixed frame written to the loader's
+# write characteristic and answered by one indication. The loader has a single
+# receive buffer, so only one command is in flight, but the chunks of a command
+# go out back to back as write-without-response when the characteristic allows
+# it. After a link drop the transfer resumes from the last page the loader
+# logged as written and read back; the log survives a reset of the loader.
+#
+# The same client drives loader_sim.py over a socket, see SocketTransport.
+# L2capSocketTransport sends each command as one SDU on the loader's credit
+# based channel instead; bleak has no LE CoC, so that path exists only
+# against the simulator until the host side has a stack that does.
+
+import asyncio
+import binascii
+import hashlib
+import struct
+import time
+
+CMD_RESET = 0x21
+CMD_FLASH_ERASE = 0x30
+CMD_FLASH_WRITE = 0x31
+CMD_FLASH_WRITE_CHECK = 0x3A
+CMD_FLASH_XIP_READSHA = 0x3E
+CMD_FLASH_DECRYPT_START = 0x3F
+
+ACK = b'OK'
+
+FLASH_START_ADDRESS = 0x2F000
+# one sector per write, fits the loader's 5 KB BLE receive buffer
+PAGE_SIZE = 4096
+# the loader logs finished sectors of a resumable transfer, see bflb_eflash_loader_progress_query()
+SECTOR_SIZE = 4096
+PROGRESS_HEADER_SIZE = 8
+PROGRESS_QUERY_PAGES = 40
+MAGIC_CODE = b"BL702BOOT"
+
+BLE_READ_CHARACTERISTIC_UUID = "00070001-0745-4650-8d93-df59be2fc10a"
+BLE_WRITE_CHARACTERISTIC_UUID = "00070002-0745-4650-8d93-df59be2fc10a"
+# the loader asks for 251 byte LL packets, so one ATT write per packet
+BLE_MAX_CHUNK = 244
+
+# socket framing shared with loader_sim.py: type(1) length(2) payload
+SIM_FRAME_FORMAT = "<BH"
+SIM_WRITE_REQ = 0x01    # write with response, answered by SIM_WRITE_RSP
+SIM_WRITE_RSP = 0x02    # payload is the ATT error, 0 on success
+SIM_WRITE_CMD = 0x03    # write without response
+SIM_INDICATE = 0x04
+SIM_HELLO = 0x05        # sent on connect: mtu(2) write_without_response(1)
+SIM_L2CAP_CONNECT = 0x06    # psm(2) mtu(2) mps(2) credits(2), answered with result(2) mtu(2) mps(2) credits(2)
+SIM_L2CAP_PDU = 0x07        # one K-frame, the first of an SDU starts with the SDU length(2)
+SIM_L2CAP_CREDITS = 0x08    # credits(2) the sender of the frame gives back
+SIM_DEFAULT_PORT = 7702
+
+# BFLB_EFLASH_LOADER_BLE_L2CAP_PSM, one command per SDU up to a 2 KB write
+L2CAP_PSM = 0x0080
+L2CAP_PAGE_SIZE = 2048
+L2CAP_MAX_MPS = 247
+L2CAP_CONN_SUCCESS = 0x0000
+
+
+class LinkLost(Exception):
+    pass
+
+
+class LoaderError(Exception):
+    pass
+
+
+def make_command(cmd, data):
+    checksum = (sum(data) + (len(data) & 0xFF) + (len(data) >> 8)) & 0xFF
+    return bytes([cmd, checksum]) + struct.pack("<H", len(data)) + data
+
+
+class Transport:
+    chunk_size = 20
+    write_without_response = False
+
+    def reset(self):
+        self.indications = asyncio.Queue()
+        self.lost = asyncio.Event()
+
+    async def wait_for(self, aw, timeout):
+        """Wait for aw, raising LinkLost as soon as the link goes down."""
+        task = asyncio.ensure_future(aw)
+        lost = asyncio.ensure_future(self.lost.wait())
+        done, pending = await asyncio.wait({task, lost}, timeout=timeout, return_when=asyncio.FIRST_COMPLETED)
+        for p in pending:
+            p.cancel()
+        if task in done:
+            return task.result()
+        if lost in done:
+            raise LinkLost("link lost")
+        raise asyncio.TimeoutError()
+
+    def flush(self):
+        while not self.indications.empty():
+            self.indications.get_nowait()
+
+    async def send(self, frame, response):
+        # the BLE interface reassembles writes up to this length
+        frame = struct.pack("<H", len(frame)) + frame
+        for i in range(0, len(frame), self.chunk_size):
+            await self.write(frame[i:i + self.chunk_size], response)
+
+    def describe(self, with_response):
+        if with_response or not self.write_without_response:
+            return "write with response"
+        return "pipelined write without response"
+
+
+class BleTransport(Transport):
+    def __init__(self, address):
+        self.address = address
+        self.client = None
+        self.write_char = None
+
+    async def connect(self, timeout=10):
+        from bleak import BleakClient, BleakScanner
+
+        self.reset()
+        lost = self.lost
+
+        # returns as soon as the loader advertises, no fixed delay after a reboot
+        device = await BleakScanner.find_device_by_address(self.address, timeout=timeout)
+        if device is None:
+            raise LinkLost("%s is not advertising" % self.address)
+
+        self.client = BleakClient(device, disconnected_callback=lambda c: lost.set())
+        await self.client.connect()
+
+        self.write_char = self.client.services.get_characteristic(BLE_WRITE_CHARACTERISTIC_UUID)
+        read_char = self.client.services.get_characteristic(BLE_READ_CHARACTERISTIC_UUID)
+        if self.write_char is None or read_char is None:
+            raise LoaderError("device does not expose the loader characteristics")
+
+        self.write_without_response = "write-without-response" in self.write_char.properties
+        self.chunk_size = min(getattr(self.client, "mtu_size", 23) - 3, BLE_MAX_CHUNK)
+
+        indications = self.indications
+        # completes once the CCC write is acknowledged, the loader can answer from then on
+        await self.client.start_notify(read_char, lambda sender, data: indications.put_nowait(bytes(data)))
+
+    async def write(self, chunk, response):
+        try:
+            await self.client.write_gatt_char(self.write_char, chunk, response)
+        except Exception as e:
+            raise LinkLost(str(e))
+
+    async def disconnect(self):
+        if self.client is not None:
+            try:
+                await self.client.disconnect()
+            except Exception:
+                pass
+            self.client = None
+
+
+class SocketTransport(Transport):
+    def __init__(self, host, port):
+        self.host = host
+        self.port = port
+        self.writer = None
+        self.rx_task = None
+
+    async def read_frame(self, reader):
+        ftype, length = struct.unpack(SIM_FRAME_FORMAT, await reader.readexactly(struct.calcsize(SIM_FRAME_FORMAT)))
+        return ftype, await reader.readexactly(length)
+
+    def handle(self, ftype, payload):
+        if ftype == SIM_INDICATE:
+            self.indications.put_nowait(payload)
+        elif ftype == SIM_WRITE_RSP:
+            self.responses.put_nowait(payload[0])
+
+    async def rx(self, reader):
+        try:
+            while True:
+                self.handle(*await self.read_frame(reader))
+        except (asyncio.IncompleteReadError, ConnectionError):
+            pass
+        self.lost.set()
+
+    def send_frame(self, ftype, payload):
+        self.writer.write(struct.pack(SIM_FRAME_FORMAT, ftype, len(payload)) + payload)
+
+    async def connect(self, timeout=10):
+        self.reset()
+        self.responses = asyncio.Queue()
+
+        try:
+            reader, self.writer = await asyncio.wait_for(asyncio.open_connection(self.host, self.port), timeout)
+            ftype, payload = await asyncio.wait_for(self.read_frame(reader), timeout)
+        except (OSError, asyncio.IncompleteReadError) as e:
+            raise LinkLost(str(e))
+
+        if ftype != SIM_HELLO:
+            raise LoaderError("unexpected frame 0x%02X from the simulator" % ftype)
+
+        mtu, wwr = struct.unpack("<HB", payload)
+        self.chunk_size = min(mtu - 3, BLE_MAX_CHUNK)
+        self.write_without_response = bool(wwr)
+        self.rx_task = asyncio.ensure_future(self.rx(reader))
+
+    async def write(self, chunk, response):
+        if self.lost.is_set():
+            raise LinkLost("link lost")
+
+        self.send_frame(SIM_WRITE_REQ if response else SIM_WRITE_CMD, chunk)
+        try:
+            await self.writer.drain()
+        except ConnectionError as e:
+            raise LinkLost(str(e))
+
+        if response:
+            err = await self.wait_for(self.responses.get(), 5)
+            if err:
+                raise LoaderError("write rejected with ATT error 0x%02X" % err)
+
+    async def disconnect(self):
+        if self.writer is not None:
+            self.writer.close()
+            self.writer = None
+        if self.rx_task is not None:
+            await asyncio.gather(self.rx_task, return_exceptions=True)
+            self.rx_task = None
+
+
+class L2capSocketTransport(SocketTransport):
+    """Commands as SDUs on the loader's LE credit based channel, against loader_sim.py."""
+
+    def __init__(self, host, port, credits=4, mps=L2CAP_MAX_MPS):
+        super().__init__(host, port)
+        # what the loader may send us before we hand out more
+        self.rx_init_credits = credits
+        self.rx_mps = mps
+        self.rx_mtu = 512
+        # times a command waited for the loader to return credits
+        self.stalls = 0
+
+    def give_credits(self, credits):
+        self.rx_credits += credits
+        self.send_frame(SIM_L2CAP_CREDITS, struct.pack("<H", credits))
+
+    def handle(self, ftype, payload):
+        if ftype == SIM_L2CAP_CONNECT:
+            self.connected.set_result(struct.unpack("<HHHH", payload))
+        elif ftype == SIM_L2CAP_CREDITS:
+            self.tx_credits += struct.unpack("<H", payload)[0]
+            self.credits_event.set()
+        elif ftype == SIM_L2CAP_PDU:
+            if self.rx_credits == 0:
+                raise ConnectionError("PDU without credits")
+            self.rx_credits -= 1
+            if self.sdu is None:
+                self.sdu_len = struct.unpack_from("<H", payload)[0]
+                self.sdu = bytearray()
+                self.seg = 0
+                payload = payload[2:]
+            self.sdu += payload
+            self.seg += 1
+            if len(self.sdu) < self.sdu_len:
+                if self.rx_credits == 0:
+                    self.give_credits((self.sdu_len - len(self.sdu) + self.rx_mps - 1) // self.rx_mps)
+                return
+            self.indications.put_nowait(bytes(self.sdu))
+            self.sdu = None
+            self.give_credits(min(self.seg, self.rx_init_credits))
+
+    async def connect(self, timeout=10):
+        await super().connect(timeout)
+        self.connected = asyncio.get_event_loop().create_future()
+        self.credits_event = asyncio.Event()
+        self.rx_credits = self.rx_init_credits
+        self.sdu = None
+
+        self.send_frame(SIM_L2CAP_CONNECT, struct.pack("<HHHH", L2CAP_PSM, self.rx_mtu, self.rx_mps, self.rx_init_credits))
+        result, self.tx_mtu, self.tx_mps, self.tx_credits = await self.wait_for(self.connected, timeout)
+        if result != L2CAP_CONN_SUCCESS:
+            raise LoaderError("l2cap connection refused with 0x%04X" % result)
+
+    async def send(self, frame, response):
+        if len(frame) > self.tx_mtu:
+            raise LoaderError("%d byte command exceeds the loader's %d byte mtu" % (len(frame), self.tx_mtu))
+
+        sdu = struct.pack("<H", len(frame)) + frame
+        for i in range(0, len(sdu), self.tx_mps):
+            if self.tx_credits == 0:
+                self.stalls += 1
+                while self.tx_credits == 0:
+                    self.credits_event.clear()
+                    await self.wait_for(self.credits_event.wait(), 5)
+            self.tx_credits -= 1
+            self.send_frame(SIM_L2CAP_PDU, sdu[i:i + self.tx_mps])
+
+        try:
+            await self.writer.drain()
+        except ConnectionError as e:
+            raise LinkLost(str(e))
+
+    def describe(self, with_response):
+        return "l2cap mps %d, %d credit stalls" % (self.tx_mps, self.stalls)
+
+
+class OtaClient:
+    def __init__(self, transport, image, enc_header=None, plain=None, verify=False, page_size=PAGE_SIZE,
+                 with_response=False, resume=True, retries=10):
+        self.transport = transport
+        self.image = image
+        self.enc_header = enc_header
+        # what ends up in flash, the loader logs and checks pages by their plaintext
+        self.plain = plain if plain is not None else image
+        self.verify = verify
+        self.page_size = page_size
+        self.with_response = with_response
+        self.resume = resume
+        # cleared once the loader turns out not to keep a page log
+        self.resumable = resume
+        self.retries = retries
+        self.image_id = binascii.crc32(self.plain)
+        self.page_crcs = [binascii.crc32(self.plain[i:i + SECTOR_SIZE]) for i in range(0, len(self.plain), SECTOR_SIZE)]
+        # sectors acknowledged in this run or found in the loader's log
+        self.done = set()
+        self.started = False
+        self.sent = 0
+        self.skipped = 0
+        self.link_drops = 0
+
+    async def command(self, cmd, data, timeout=5):
+        t = self.transport
+        frame = make_command(cmd, data)
+        response = self.with_response or not t.write_without_response
+
+        # an indication left over from before a drop would answer the wrong command
+        t.flush()
+        await t.send(frame, response)
+
+        rsp = await t.wait_for(t.indications.get(), timeout)
+        if rsp[:2] != ACK:
+            code = struct.unpack_from("<H", rsp, 2)[0] if len(rsp) >= 4 else 0xFFFF
+            raise LoaderError("command 0x%02X failed with 0x%04X" % (cmd, code))
+        return rsp[2:]
+
+    async def query_progress(self):
+        """Sectors the loader logged with our CRC, None when it keeps no log for this image."""
+        pages = len(self.page_crcs)
+        verified = set()
+        first = 0
+
+        while first < pages:
+            rsp = await self.command(CMD_FLASH_WRITE_CHECK, struct.pack("<III", len(self.plain), self.image_id, first))
+            # a loader without the page log answers a plain OK
+            if len(rsp) < 2 + PROGRESS_HEADER_SIZE:
+                self.resumable = False
+                return None
+
+            logged, first, count, _ = struct.unpack_from("<HHHH", rsp, 2)
+            if logged != pages or count == 0:
+                return None
+
+            bitmap = rsp[2 + PROGRESS_HEADER_SIZE:2 + PROGRESS_HEADER_SIZE + (pages + 7) // 8]
+            crcs = struct.unpack_from("<%dI" % count, rsp, 2 + PROGRESS_HEADER_SIZE + len(bitmap))
+            for i, crc in enumerate(crcs):
+                if bitmap[(first + i) // 8] & (1 << ((first + i) % 8)) and crc == self.page_crcs[first + i]:
+                    verified.add(first + i)
+
+            # only windows with logged pages need their CRCs
+            first = first + count
+            while first < pages and not any(bitmap[p // 8] & (1 << (p % 8))
+                                            for p in range(first, min(first + PROGRESS_QUERY_PAGES, pages))):
+                first = first + PROGRESS_QUERY_PAGES
+
+        return verified
+
+    async def start_session(self, resumable):
+        # announces the image size, the loader erases ahead of the writes; the id makes it log pages
+        end = FLASH_START_ADDRESS + len(self.image) - 1
+        if resumable:
+            await self.command(CMD_FLASH_ERASE, struct.pack("<III", FLASH_START_ADDRESS, end, self.image_id), 10)
+        else:
+            await self.command(CMD_FLASH_ERASE, struct.pack("<II", FLASH_START_ADDRESS, end), 10)
+        self.done = set()
+        self.started = True
+
+    async def transfer(self):
+        if not self.resume:
+            # the old behaviour, for comparison: every connection starts over
+            self.started = False
+
+        verified = await self.query_progress() if self.resumable else None
+
+        if verified is not None:
+            # the log, not what this run saw acknowledged, says which sectors are good
+            self.skipped += sum(min(SECTOR_SIZE, len(self.image) - p * SECTOR_SIZE) for p in verified - self.done)
+            self.done = verified
+            self.started = True
+        elif self.resumable or not self.started:
+            # no session for this image on the loader; a loader without the log keeps
+            # its erase state in RAM, so the sectors acknowledged so far still count
+            await self.start_session(self.resumable)
+
+        if self.enc_header is not None:
+            # ciphertext goes to the plaintext addresses, the loader decrypts each page;
+            # sent on every connection since a reset loader forgets it
+            await self.command(CMD_FLASH_DECRYPT_START, self.enc_header)
+
+        for sector in range(len(self.page_crcs)):
+            if sector in self.done:
+                continue
+
+            end = min((sector + 1) * SECTOR_SIZE, len(self.image))
+            for offset in range(sector * SECTOR_SIZE, end, self.page_size):
+                page = self.image[offset:min(offset + self.page_size, end)]
+                await self.command(CMD_FLASH_WRITE, struct.pack("<I", FLASH_START_ADDRESS + offset) + page)
+                self.sent += len(page)
+
+            self.done.add(sector)
+            acked = sum(min(SECTOR_SIZE, len(self.image) - p * SECTOR_SIZE) for p in self.done)
+            print("\r%d/%d bytes, %.1f KB/s" % (acked, len(self.image),
+                  self.sent / 1024 / max(time.time() - self.start, 1e-3)), end="", flush=True)
+        print("")
+
+        await self.command(CMD_FLASH_WRITE_CHECK, b'')
+
+        if self.verify:
+            rsp = await self.command(CMD_FLASH_XIP_READSHA, bytes(8), 30)
+            if rsp[2:34] != hashlib.sha256(self.plain).digest():
+                raise LoaderError("flash sha256 %s does not match the image" % rsp[2:34].hex())
+            print("Flash sha256 verified")
+
+        # the loader acks and resets straight away, the indication may not make it
+        try:
+            await self.command(CMD_RESET, b'\x00', 2)
+        except (LinkLost, asyncio.TimeoutError):
+            pass
+
+    async def run(self):
+        self.start = time.time()
+
+        while True:
+            try:
+                await self.transport.connect()
+                await self.transfer()
+                break
+            except (LinkLost, asyncio.TimeoutError) as e:
+                self.link_drops += 1
+                if self.link_drops > self.retries:
+                    raise LinkLost("gave up after %d link drops" % self.link_drops)
+                print("\nLink lost with %d of %d sectors done (%s), %s" % (len(self.done), len(self.page_crcs),
+                      e if str(e) else "timeout", "resuming" if self.resume else "starting over"))
+            finally:
+                await self.transport.disconnect()
+
+        elapsed = time.time() - self.start
+        print("OTA done: %d bytes in %.1f s, %.1f KB/s, %d bytes sent, %d recovered from the page log, %d link drops, %s" %
+              (len(self.image), elapsed, len(self.image) / 1024 / elapsed, self.sent, self.skipped, self.link_drops,
+               self.transport.describe(self.with_response)))
+        return elapsed
+
+
+async def find_device(name, timeout=10):
+    from bleak import BleakScanner
+
+    while True:
+        device = await BleakScanner.find_device_by_filter(lambda d, adv: d.name is not None and name in d.name,
+                                                          timeout=timeout)
+        if device is not None:
+            print("Found device with information {}".format(device))
+            return device
+
+
+async def enter_bootloader(address, timeout=10):
+    from bleak import BleakClient
+
+    lost = asyncio.Event()
+    async with BleakClient(address, disconnected_callback=lambda c: lost.set()) as client:
+        await client.write_gatt_char(BLE_WRITE_CHARACTERISTIC_UUID, MAGIC_CODE, True)
+        # the app reboots into the loader, the link drop is the signal to move on
+        await asyncio.wait_for(lost.wait(), timeout)
@@ -10,6 +10,7 @@ import time
 import binascii
 import struct
 import random
+import math
 import os
 import subprocess
 import pathlib
@@ -17,9 +18,8 @@ import configparser
 import hashlib
 import asyncio
 import signal
-from bleak import BleakScanner
-from bleak import BleakClient
-from queue import Queue
+import lzma
+import ota_client
 
 BFLB_EFLASH_LOADER_CMD_RESET=b'\x21'
 BFLB_EFLASH_LOADER_CMD_FLASH_ERASE=b'\x30'
@@ -31,6 +31,7 @@ BFLB_EFLASH_LOADER_CMD_FLASH_SET_PARA=b'\x3B'
 BFLB_EFLASH_LOADER_CMD_FLASH_CHIPERASE=b'\x3C'
 BFLB_EFLASH_LOADER_CMD_FLASH_READSHA=b'\x3D'
 BFLB_EFLASH_LOADER_CMD_FLASH_XIP_READSHA=b'\x3E'
+BFLB_EFLASH_LOADER_CMD_FLASH_DECRYPT_START=b'\x3F'
 
 FLASH_START_ADDRESS=0x2F000
 FLASH_TOTAL_SIZE=0xca000
@@ -41,8 +42,10 @@ FLASH_OFFSET=0x2000
 BOOT_ENTRY=0x0000
 MAGIC_CODE="BL702BOOT"
 
-BLE_READ_CHARACTERISTIC_UUID = "00070001-0745-4650-8d93-df59be2fc10a"
-BLE_WRITE_CHARACTERISTIC_UUID = "00070002-0745-4650-8d93-df59be2fc10a "
+# encrypted image container, see examples/robot_bootloader/blsp_boot_decrypt.h
+ENC_IMG_MAGIC=b'BFEI'
+ENC_IMG_VERSION=1
+ENC_IMG_FLAG_XZ=0x01
 
 def print_data(data):
     print(data)
@@ -282,190 +285,119 @@ def add_boot_header(data, config):
 
     return header + data
 
-async def ble_process(fw_data, addr):
-    write_handle = None
-    read_handle = None
-    rx_queue = Queue(maxsize = 1)
-
-    def notification_handler(sender, data):
-        rx_queue.put(data)
-
-    async def clean_queue():
-        if not rx_queue.empty():
-            rx_queue.get()
-        
-    async def get_response_ble(device):
-        timeout = 5
-        while rx_queue.empty():
-            timeout = timeout - 1
-            if timeout == 0:
-                break
-            await asyncio.sleep(1)
-        
-        if timeout == 0:
-            print("Did not receive response from BLE device")
-            return -1
-        else:
-            response = rx_queue.get()
-        
-        if len(response) != 2:
-            print("Error: didn't receive enough bytes in the response")
-            return -1
-
-        print("Received a response: ", response)
-
-        if response[0] != 0x4F:
-            print("Error: response NACK or unknown response")
-            return -1
-        return 0
-
-    async def write_data(device, buf):
-        send_data = len(buf).to_bytes(2, "little") + buf
-
-        while len(send_data) > 0:
-            if not rx_queue.empty():
-                return -1
-            start = time.time()
-            await device.write_gatt_char(write_handle, send_data[0 : 240], True)
-
-            send_data = send_data[240: ]
-        return 0
-
-    async def program_one_page_ble(device, addr, data):
-        data = addr.to_bytes(4, "little") + data
-
-        command = create_payload(BFLB_EFLASH_LOADER_CMD_FLASH_WRITE, data)
-
-        retry = 3
-        while retry > 0:
-            await clean_queue()
-            # write the bytes in three shots with a time delay betwoen, otherwise there is a strange bug where bytes get dropped
-            ret = await write_data(device, command)
-
-            if ret == 0:
-                ret = (await get_response_ble(device))
-                if ret == 0:
-                    break
-                else:
-                    retry = retry - 1
-            else:
-                print("Write data failed, Retry")
-                retry = retry - 1
-        if retry == 0:
-            ret = -1
-        return ret
-
-    async def erase_flash_ble(device, size):
-        print("Erase flash")
-
-        size = size + FLASH_START_ADDRESS
-
-        data = FLASH_START_ADDRESS.to_bytes(4, "little") + size.to_bytes(4, "little")
-
-        command = create_payload(BFLB_EFLASH_LOADER_CMD_FLASH_ERASE, data)
-
-    #    print_data(command)
-        await clean_queue()
-        # write the bytes in three shots with a time delay betwoen, otherwise there is a strange bug where bytes get dropped
-        await write_data(device, command)
+def build_container(data, key_hex, key_sel, use_xz):
+    # AES-128-CTR with the efuse key; the low word of the IV is the block counter
+    # the loader and boot2 derive from the offset, openssl increments it the same way
+    key = bytes.fromhex(key_hex)
+    if len(key) != 16:
+        print("Error: the AES key must be 16 bytes of hex")
+        exit(1)
 
-    async def system_reset_command_ble(device):
-        print("Resettting the newly programmed device...")
+    flags = 0
+    if use_xz:
+        filters = [{"id": lzma.FILTER_LZMA2, "preset": 9, "dict_size": 32768}]
+        data = lzma.compress(data, format=lzma.FORMAT_XZ, check=lzma.CHECK_CRC32, filters=filters)
+        flags = flags | ENC_IMG_FLAG_XZ
+    while len(data) % 0x10 != 0:
+        data = data + b'\x00'
+
+    iv = os.urandom(12) + bytes(4)
+    start = time.time()
+    ciphertext = subprocess.run(["openssl", "enc", "-aes-128-ctr", "-nosalt", "-K", key.hex(), "-iv", iv.hex()],
+                                input=data, stdout=subprocess.PIPE, check=True).stdout
+    print("Encrypted %d bytes in %.3f s" % (len(data), time.time() - start))
+
+    header = ENC_IMG_MAGIC + struct.pack("<BBBBII16s", ENC_IMG_VERSION, flags, key_sel, 0,
+                                         len(data), binascii.crc32(data), iv)
+    header = header + binascii.crc32(header).to_bytes(4, "little")
+    return header, ciphertext
 
-        data = int(0).to_bytes(1, "little")
+async def ble_process(fw_data, addr, enc_header=None, plain=None, **options):
+    if addr is None:
+        addr = (await ota_client.find_device("robot_bl702")).address
 
-        command = create_payload(BFLB_EFLASH_LOADER_CMD_RESET, data)
+    for retry in range(0, 10):
+        try:
+            print('\r\n\r\nConnect robot application and request to jump into bootloader\r\n\r\n')
+            await ota_client.enter_bootloader(addr)
+            break
+        except Exception as e:
+            print("Cannot connect device with error as {}".format(e))
+    else:
+        print("Failed to reach the robot application")
+        return
 
-        await write_data(device, command)
+    print('\r\n\r\nConnect robot bootloader and program device\r\n\r\n')
+    client = ota_client.OtaClient(ota_client.BleTransport(addr), fw_data, enc_header, plain, **options)
+    await client.run()
 
-    dev_addr = None
-    if addr is None:
-        device = None
-        while device is None:
-            devices = await BleakScanner.discover(timeout=3)
-            for d in devices:
-                if d.name is not None and "robot_bl702" in d.name:
-                    print("Found device with information {}".format(d))
-                    device = d
-                    break
-        if device:
-            dev_addr = device.address
+async def sim_process(fw_data, endpoint, enc_header=None, plain=None, l2cap=None, **options):
+    host, _, port = endpoint.rpartition(":")
+    if l2cap is not None:
+        transport = ota_client.L2capSocketTransport(host or "127.0.0.1", int(port or ota_client.SIM_DEFAULT_PORT), **l2cap)
     else:
-        dev_addr = addr
-    if dev_addr:
-        is_success = False
-        for retry in range (0, 10):
-            try: 
-                print('\r\n\r\nConnect robot application and request to jump into bootloader\r\n\r\n')
-
-                async with BleakClient(dev_addr) as client:
-                    for service in client.services:
-                        for char in service.characteristics:
-                            if char.uuid in BLE_WRITE_CHARACTERISTIC_UUID:
-                                write_handle = char
-                    if write_handle is not None:
-                        data = MAGIC_CODE.encode()
-                        await client.write_gatt_char(write_handle, data, True)
-                        is_success = True
-            except Exception as e:
-                print("Cannot connect device with error as {}".format(e))
-            if is_success:
-                break
+        transport = ota_client.SocketTransport(host or "127.0.0.1", int(port or ota_client.SIM_DEFAULT_PORT))
+    client = ota_client.OtaClient(transport, fw_data, enc_header, plain, **options)
+    await client.run()
+
+def simulate_ota(size, config, runs, interval_ms, latency, supervision_ms):
+    # Timing model of one BLE transfer, bulk erase against erase-ahead, event by event.
+    # An erase keeps interrupts off, so the device serves no connection event until it
+    # ends: every event in between is missed, the ATT write in flight waits and the
+    # transfer time grows by the stall. The link drops when the time from the last event
+    # the device served to the next one it serves passes the supervision timeout. While
+    # the loader waits for the next command it may already skip up to `latency` events,
+    # which the erase-ahead of the idle poll adds to its stall.
+    reconnect_ms = 3000
+    sector_ms = config.getint('BOOTHEADER_CFG', 'sector_erase_time')
+    blk64k_ms = config.getint('BOOTHEADER_CFG', 'blk64k_erase_time')
+    page_size = 2048
+    pages = (size + page_size - 1) // page_size
+    # write with response, one 240 byte chunk per two connection events, then the indication
+    page_events = (page_size + 10 + 239) // 240 * 2 + 1
+
+    def erase_time(max_ms):
+        return random.uniform(0.25, 1.0) * max_ms
+
+    def stall(now_ms, erase_ms, skipped):
+        # the next served event after an erase that starts at now_ms, the link gap and the missed events
+        last_ms = now_ms - skipped * interval_ms
+        next_ms = now_ms + math.ceil(erase_ms / interval_ms) * interval_ms
+        return next_ms, next_ms - last_ms, round(erase_ms / interval_ms)
+
+    for mode in ["bulk erase", "erase-ahead"]:
+        total_ms = 0
+        drops = 0
+        missed = 0
+        worst_gap_ms = 0
+        for run in range(0, runs):
+            now_ms = 0
+            if mode == "bulk erase":
+                # one command right after the erase request, the block erases follow each other
+                blocks = size // 0x10000
+                sectors = (size % 0x10000 + FLASH_PAGE_SIZE - 1) // FLASH_PAGE_SIZE
+                erase_ms = sum(erase_time(blk64k_ms) for i in range(blocks)) + sum(erase_time(sector_ms) for i in range(sectors))
+                now_ms, gap_ms, lost = stall(now_ms, erase_ms, 0)
+                if gap_ms > supervision_ms:
+                    drops = drops + 1
+                    now_ms = now_ms + reconnect_ms
+                missed = missed + lost
+                worst_gap_ms = max(worst_gap_ms, gap_ms)
+                now_ms = now_ms + pages * page_events * interval_ms
             else:
-                print("Failed to connect device, retry new transaction...")
-                print("")
-        if is_success:
-            is_success = False
-            for retry in range (0, 10):
-                try:
-                    print('\r\n\r\nConnect robot bootloader and request flash erasing\r\n\r\n')
-
-                    async with BleakClient(dev_addr) as client:
-                        for service in client.services:
-                            for char in service.characteristics:
-                                if char.uuid in BLE_WRITE_CHARACTERISTIC_UUID:
-                                    write_handle = char
-                                if char.uuid in BLE_READ_CHARACTERISTIC_UUID:
-                                    read_handle = char
-                        if write_handle is not None and read_handle is not None:
-                            await client.start_notify(read_handle, notification_handler)
-                            await asyncio.sleep(0.5)
-                            await erase_flash_ble(client, len(fw_data))
-                            await asyncio.sleep(1)
-  
-                    await asyncio.sleep(2)
-                    print('\r\n\r\nErased flash, reconnect to program device\r\n\r\n')
-                    program_data = fw_data
-
-                    async with BleakClient(dev_addr) as client:
-                        if write_handle is not None and read_handle is not None:
-                            await client.start_notify(read_handle, notification_handler)
-                            await asyncio.sleep(0.5)
-                            
-                            FLASH_PAGE_SIZE = 2048
-                            start_addr = FLASH_START_ADDRESS
-                            while len(program_data) > 0:
-                                print("Size left:", len(program_data))
-                                # if len(data) < FLASH_PAGE_SIZE:
-                                #     data = data + bytearray([0]) * (FLASH_PAGE_SIZE - len(data))
-                                #     print("Size left after append:", len(data))
-                                # assert len(data) >= FLASH_PAGE_SIZE
-                                ret = (await program_one_page_ble(client, start_addr, program_data[0 : FLASH_PAGE_SIZE]))
-                                if ret != 0:
-                                    break
-                                program_data = program_data[FLASH_PAGE_SIZE:]
-                                start_addr = start_addr + FLASH_PAGE_SIZE
-                            if ret == 0:
-                                await system_reset_command_ble(client)
-                                await asyncio.sleep(0.5)
-                                is_success = True
-                except Exception as e:
-                    print("Cannot connect device with error as {}".format(e))
-                if is_success:
-                    break
-                else:
-                    print("Upload failed, retry new transaction...")
-                    print("")
+                # the poll erases one sector per two pages, after the indication of the page before
+                for i in range(0, pages):
+                    if i % 2 == 0:
+                        now_ms, gap_ms, lost = stall(now_ms, erase_time(sector_ms), random.randint(0, latency))
+                        if gap_ms > supervision_ms:
+                            drops = drops + 1
+                            now_ms = now_ms + reconnect_ms
+                        missed = missed + lost
+                        worst_gap_ms = max(worst_gap_ms, gap_ms)
+                    now_ms = now_ms + page_events * interval_ms
+            total_ms = total_ms + now_ms
+        print("%-12s %d bytes: average OTA %.1f s, %.0f missed events per run, worst link gap %.0f ms of %d ms, link drop rate %.0f %% over %d runs" %
+              (mode, size, total_ms / runs / 1000, missed / runs, worst_gap_ms, supervision_ms, drops * 100 / runs, runs))
 
 # Define the arguments for this program. This program takes in an optional -p option to specify the serial port device
 # and it also takes a mandatory firmware file name
@@ -475,6 +407,22 @@ parser.add_argument('-P', '--PORT', help='show all ports on the system and let t
 parser.add_argument('-i', '--ini', help='Bootheader configuration file', default=None)
 parser.add_argument('-b', '--bluetooth', help='Update over bluetooth', action="store_true", default=False)
 parser.add_argument('-a', '--addr', help='Bluetooth address of device', default=None)
+parser.add_argument('-s', '--simulate', help='model this many bluetooth transfers instead of flashing', type=int, default=0)
+parser.add_argument('--interval', help='connection interval in ms for --simulate', type=float, default=30)
+parser.add_argument('--latency', help='peripheral latency in events for --simulate', type=int, default=0)
+parser.add_argument('--supervision', help='supervision timeout in ms for --simulate, the loader asks for 4000', type=int, default=4000)
+parser.add_argument('--encrypt', help='AES-128 key in hex, send the image encrypted, the loader decrypts it into flash with the matching efuse key', default=None)
+parser.add_argument('--key-sel', help='efuse key slot the device decrypts with', type=int, default=0)
+parser.add_argument('--xz', help='compress before encrypting, only with --container', action="store_true", default=False)
+parser.add_argument('--container', help='write the encrypted container to this file for boot2 to install instead of flashing', default=None)
+parser.add_argument('--sim', help='program a loader_sim.py endpoint at [host:]port instead of a device', default=None)
+parser.add_argument('--page-size', help='bytes per flash write command over bluetooth', type=int, default=None)
+parser.add_argument('--l2cap', help='send the commands over the loader\'s l2cap channel, only with --sim', action="store_true", default=False)
+parser.add_argument('--credits', help='l2cap credits the loader gets for its answers', type=int, default=4)
+parser.add_argument('--mps', help='l2cap mps for the answers of the loader', type=int, default=ota_client.L2CAP_MAX_MPS)
+parser.add_argument('--with-response', help='never pipeline writes without response, for comparison', action="store_true", default=False)
+parser.add_argument('--verify', help='compare the flash sha256 before resetting the device', action="store_true", default=False)
+parser.add_argument('--no-resume', help='start over after a link drop instead of resuming from the loader\'s page log', action="store_true", default=False)
 parser.add_argument('firmware_filename', help='new firmware file to send to the device')
 args = parser.parse_args()
 
@@ -509,7 +457,28 @@ if len(data) > FLASH_TOTAL_SIZE:
     print("Error: the firmware is too big to fit in the flash")
     exit(1)
 
-if args.bluetooth == False:
+enc_header = None
+if args.encrypt:
+    if args.xz and args.container is None:
+        print("Error: --xz images are installed by boot2 from a --container file, the loader cannot stream them")
+        exit(1)
+    if args.bluetooth == False and args.container is None and args.simulate == 0 and args.sim is None:
+        print("Error: encrypted transfers are only supported over bluetooth")
+        exit(1)
+    enc_header, data_enc = build_container(data, args.encrypt, args.key_sel, args.xz)
+    if args.xz:
+        print("Compressed %d bytes to %d" % (len(data), len(data_enc)))
+
+if args.container:
+    if enc_header is None:
+        print("Error: --container needs --encrypt")
+        exit(1)
+    with open(args.container, "wb") as fh:
+        fh.write(enc_header + data_enc)
+    print("Wrote %d byte container to %s" % (len(enc_header) + len(data_enc), args.container))
+elif args.simulate > 0:
+    simulate_ota(len(data), config, args.simulate, args.interval, args.latency, args.supervision)
+elif args.bluetooth == False and args.sim is None:
     ser = serial.Serial(port=serial_port, baudrate=921600, timeout=1)
     handshake(ser)
     time.sleep(0.6)
@@ -535,4 +504,22 @@ if args.bluetooth == False:
 
     ser.close()
 else:
-    asyncio.run(ble_process(data, args.addr))
\ No newline at end of file
+    if args.l2cap and args.sim is None:
+        print("Error: --l2cap needs --sim, bleak has no l2cap channels")
+        exit(1)
+    if args.page_size is None:
+        args.page_size = ota_client.L2CAP_PAGE_SIZE if args.l2cap else ota_client.PAGE_SIZE
+    if ota_client.SECTOR_SIZE % args.page_size:
+        print("--page-size has to divide the %d byte flash sector" % ota_client.SECTOR_SIZE)
+        exit(1)
+    # the loader writes plaintext either way, digest and page log are over the image as built
+    options = dict(verify=args.verify, page_size=args.page_size, with_response=args.with_response, resume=not args.no_resume)
+    if enc_header is not None:
+        plain, data = data, data_enc
+    else:
+        plain = data
+    if args.sim:
+        l2cap = dict(credits=args.credits, mps=args.mps) if args.l2cap else None
+        asyncio.run(sim_process(data, args.sim, enc_header, plain, l2cap, **options))
+    else:
+        asyncio.run(ble_process(data, args.addr, enc_header, plain, **options))
@@ -0,0 +1,467 @@
+/*
+ * Host build of the HCI capture ring (components/ble/ble_stack/host/monitor.c), for
+ * the btsnoop file it writes and the cost of a capture.
+ *
+ * The clock is a counter the checks advance, or the host clock for the bench. Flash
+ * is a RAM region behind the hal_flash calls the dump uses, erased to 0xff.
+ *
+ * Checks:
+ *  - a connection frozen by its Disconnection Complete: the dump parses as a btsnoop
+ *    file of the Linux monitor datalink, with the index, every packet with its
+ *    opcode, length and time, and the closing note; nothing after the freeze is kept;
+ *  - a ring that wrapped keeps the newest CONFIG_BT_MONITOR_SLOTS packets in order;
+ *  - the ACL header filter and the events only filter;
+ *  - BT_ASSERT freezes the ring, and works as the body of an if with an else;
+ *  - the flash dump is the same file behind its header, and a region too small for
+ *    it is left without one.
+ * Then 2M captures of a 31 byte ACL packet against formatting it the way the
+ * monitor did before, through bt_hex() and the BT_WARN format.
+ *
+ *   gcc -O2 -std=gnu99 -include stdint.h -DBL702 -DARCH_RISCV -D__riscv_xlen=32 -DBFLB_BLE -DBL_MCU_SDK -DCONFIG_BT_ASSERT \
+ *       -DCONFIG_BT_DEBUG_MONITOR -I components/ble/ble_stack/host -I components/ble/ble_stack/common \
+ *       -I components/ble/ble_stack/common/include -I components/ble/ble_stack/common/include/zephyr \
+ *       -I components/ble/ble_stack/include/bluetooth -I components/ble/ble_stack/include/drivers/bluetooth \
+ *       -I components/ble/ble_stack/port/include -I components/freertos/include -I components/freertos/portable/gcc/risc-v/bl702 \
+ *       -I drivers/bl702_driver/hal_drv/inc -I drivers/bl702_driver/std_drv/inc -I drivers/bl702_driver/regs \
+ *       -I drivers/bl702_driver/startup -I bsp/bsp_common/platform -I common/misc \
+ *       tools/btsnoop/monitor_bench.c -o monitor_bench
+ *   ./monitor_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "monitor.c"
+
+#define FLASH_BASE 0xFB000
+#define FLASH_SIZE 16384
+#define DUMP_MAX   (16 + 24 + sizeof(struct bt_monitor_new_index) + CONFIG_BT_MONITOR_SLOTS * (24 + CONFIG_BT_MONITOR_SNAPLEN) + 24 + 112)
+
+#define BENCH_PACKETS 2000000
+
+static int clock_real;
+static u64_t clock_us;
+static u8_t flash[FLASH_SIZE];
+static u32_t asserts;
+
+/* LE-U ACL header and an ATT notification of 23 bytes */
+static const u8_t pkt_acl[4 + 27] = { 0x40, 0x20, 27, 0x00, 23, 0x00, 0x04, 0x00, 0x1b, 0x10, 0x00 };
+static const u8_t pkt_cmd[] = { 0x06, 0x20, 0x0f, 0xa0, 0x00, 0xa0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0x00 };
+static const u8_t pkt_evt[] = { 0x0e, 0x04, 0x01, 0x06, 0x20, 0x00 };
+/* handle 0x0040, remote user terminated */
+static const u8_t pkt_disconn[] = { BT_HCI_EVT_DISCONN_COMPLETE, 0x04, 0x00, 0x40, 0x00, 0x13 };
+
+static struct {
+    u8_t data[DUMP_MAX];
+    u32_t len;
+} dump;
+
+/* what the checks sent, in order */
+static struct {
+    u8_t opcode;
+    u16_t len;
+    u32_t ts_us;
+    const u8_t *data;
+} sent[CONFIG_BT_MONITOR_SLOTS * 2];
+static u32_t sent_count;
+
+uint64_t bflb_platform_get_time_us(void)
+{
+    struct timespec t;
+
+    if (!clock_real) {
+        return clock_us;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000ULL + t.tv_nsec / 1000;
+}
+
+void flash_write_buf_init(flash_write_buf_t *wbuf, uint8_t *buf, uint32_t size)
+{
+    wbuf->buf = buf;
+    wbuf->size = size;
+}
+
+BL_Err_Type flash_erase(uint32_t addr, uint32_t len)
+{
+    memset(&flash[addr - FLASH_BASE], 0xff, len);
+    return SUCCESS;
+}
+
+BL_Err_Type flash_write(uint32_t addr, uint8_t *data, uint32_t len)
+{
+    memcpy(&flash[addr - FLASH_BASE], data, len);
+    return SUCCESS;
+}
+
+BL_Err_Type flash_write_buffered(flash_write_buf_t *wbuf, uint32_t addr, uint8_t *data, uint32_t len)
+{
+    return flash_write(addr, data, len);
+}
+
+BL_Err_Type flash_write_flush(flash_write_buf_t *wbuf)
+{
+    return SUCCESS;
+}
+
+void user_vAssertCalled(void)
+{
+    asserts++;
+}
+
+static int dump_out(void *ctx, const void *data, size_t len)
+{
+    if (dump.len + len > sizeof(dump.data)) {
+        return -ENOSPC;
+    }
+
+    memcpy(&dump.data[dump.len], data, len);
+    dump.len += len;
+    return 0;
+}
+
+static void send(u8_t opcode, const u8_t *data, u16_t len)
+{
+    sent[sent_count % ARRAY_SIZE(sent)].opcode = opcode;
+    sent[sent_count % ARRAY_SIZE(sent)].len = len;
+    sent[sent_count % ARRAY_SIZE(sent)].ts_us = clock_us;
+    sent[sent_count % ARRAY_SIZE(sent)].data = data;
+    sent_count++;
+    bt_monitor_send(opcode, data, len);
+}
+
+static void start(u8_t filter, u8_t triggers)
+{
+    bt_addr_t addr = { { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06 } };
+
+    clock_real = 0;
+    clock_us = 1000000;
+    sent_count = 0;
+    bt_monitor_new_index(BT_MONITOR_TYPE_PRIMARY, 0, &addr, "bt0");
+    bt_monitor_set_filter(filter);
+    bt_monitor_set_freeze(triggers);
+    bt_monitor_resume();
+}
+
+/*
+ * Parse the dump: file header, index, then the packets sent from first on, each
+ * cut the way the filter cuts it, and the note, which must contain note_has.
+ */
+static int check_dump(u32_t first, const char *note_has)
+{
+    const u8_t *p = dump.data, *end = dump.data + dump.len;
+    u32_t orig, incl = 0, flags, keep, i;
+    u64_t ts, ts_first = 0;
+    int records = 0, noted = 0;
+
+    if (dump.len < 16 || memcmp(p, "btsnoop\0", 8) != 0 || sys_get_be32(p + 8) != 1 || sys_get_be32(p + 12) != 2001) {
+        printf("  not a btsnoop file of datalink 2001\n");
+        return 1;
+    }
+    p += 16;
+
+    for (i = first; p + 24 <= end; records++) {
+        orig = sys_get_be32(p);
+        incl = sys_get_be32(p + 4);
+        flags = sys_get_be32(p + 8);
+        ts = ((u64_t)sys_get_be32(p + 16) << 32) | sys_get_be32(p + 20);
+        p += 24;
+
+        if (p + incl > end || incl > orig) {
+            printf("  record %d: %u of %u bytes, past the end\n", records, incl, orig);
+            return 1;
+        }
+
+        if (records == 0) {
+            if (flags != BT_MONITOR_NEW_INDEX || incl != sizeof(struct bt_monitor_new_index) || strcmp((const char *)p + 8, "bt0") != 0) {
+                printf("  first record is not the index\n");
+                return 1;
+            }
+            ts_first = ts;
+        } else if (flags == BT_MONITOR_SYSTEM_NOTE) {
+            if (p + incl != end || p[incl - 1] != 0 || !strstr((const char *)p, note_has)) {
+                printf("  note \"%.*s\", expected \"%s\"\n", (int)incl, p, note_has);
+                return 1;
+            }
+            noted = 1;
+            break;
+        } else {
+            if (i >= sent_count) {
+                printf("  record %d: more packets than sent\n", records);
+                return 1;
+            }
+
+            keep = MIN(orig, CONFIG_BT_MONITOR_SNAPLEN);
+            if ((flags == BT_MONITOR_ACL_TX_PKT || flags == BT_MONITOR_ACL_RX_PKT) && (monitor_filter & BT_MONITOR_FILTER_ACL_HDR)) {
+                keep = MIN(keep, BT_MONITOR_ACL_HDR_LEN);
+            }
+
+            if (flags != sent[i % ARRAY_SIZE(sent)].opcode || orig != sent[i % ARRAY_SIZE(sent)].len ||
+                incl != keep || memcmp(p, sent[i % ARRAY_SIZE(sent)].data, incl) != 0) {
+                printf("  record %d: opcode %u, %u of %u bytes, expected packet %u\n", records, flags, incl, orig, i);
+                return 1;
+            }
+
+            /*the index takes the time of the oldest packet, the rest keep their distance to it*/
+            if (ts - ts_first != sent[i % ARRAY_SIZE(sent)].ts_us - sent[first % ARRAY_SIZE(sent)].ts_us) {
+                printf("  record %d: time off by %lld us\n", records,
+                       (long long)(ts - ts_first) - (sent[i % ARRAY_SIZE(sent)].ts_us - sent[first % ARRAY_SIZE(sent)].ts_us));
+                return 1;
+            }
+            i++;
+        }
+
+        p += incl;
+    }
+
+    if (!noted || i != sent_count) {
+        printf("  %u of %u packets, then %d bytes left\n", i - first, sent_count - first, (int)(end - p));
+        return 1;
+    }
+
+    return 0;
+}
+
+static int take_dump(void)
+{
+    dump.len = 0;
+    return bt_monitor_dump(dump_out, NULL);
+}
+
+static int run_disconnect(void)
+{
+    int i;
+
+    start(BT_MONITOR_FILTER_ALL, BT_MONITOR_FREEZE_DISCONNECT | BT_MONITOR_FREEZE_ASSERT);
+
+    for (i = 0; i < 40; i++) {
+        clock_us += 7500;
+        send((i & 1) ? BT_MONITOR_ACL_TX_PKT : BT_MONITOR_ACL_RX_PKT, pkt_acl, sizeof(pkt_acl));
+
+        if (i % 10 == 0) {
+            send(BT_MONITOR_COMMAND_PKT, pkt_cmd, sizeof(pkt_cmd));
+            clock_us += 30;
+            send(BT_MONITOR_EVENT_PKT, pkt_evt, sizeof(pkt_evt));
+        }
+    }
+
+    clock_us += 20000;
+    send(BT_MONITOR_EVENT_PKT, pkt_disconn, sizeof(pkt_disconn));
+
+    if (bt_monitor_frozen() != BT_MONITOR_FREEZE_DISCONNECT) {
+        printf("  not frozen by the disconnect\n");
+        return 1;
+    }
+
+    /*after the freeze, not kept*/
+    bt_monitor_send(BT_MONITOR_EVENT_PKT, pkt_evt, sizeof(pkt_evt));
+    clock_us += 5000000;
+
+    if (take_dump()) {
+        printf("  dump failed\n");
+        return 1;
+    }
+
+    return check_dump(0, "frozen on disconnect, disconnect reason 0x13, 49 packets, 0 overwritten");
+}
+
+static int run_wrapped(void)
+{
+    u32_t i;
+
+    start(BT_MONITOR_FILTER_ALL, BT_MONITOR_FREEZE_DISCONNECT);
+
+    for (i = 0; i < CONFIG_BT_MONITOR_SLOTS + 50; i++) {
+        clock_us += 1000 + i;
+        send(BT_MONITOR_ACL_RX_PKT, (i & 1) ? pkt_acl : pkt_cmd, (i & 1) ? sizeof(pkt_acl) : sizeof(pkt_cmd));
+    }
+
+    if (take_dump()) {
+        printf("  dump failed\n");
+        return 1;
+    }
+
+    return check_dump(50, "frozen manually, disconnect reason 0x00");
+}
+
+static int run_filters(void)
+{
+    struct bt_monitor_stats stats;
+
+    start(BT_MONITOR_FILTER_ALL | BT_MONITOR_FILTER_ACL_HDR, 0);
+    send(BT_MONITOR_ACL_TX_PKT, pkt_acl, sizeof(pkt_acl));
+    clock_us += 10;
+    send(BT_MONITOR_COMMAND_PKT, pkt_cmd, sizeof(pkt_cmd));
+    clock_us += 10;
+    send(BT_MONITOR_EVENT_PKT, pkt_disconn, sizeof(pkt_disconn));
+
+    if (bt_monitor_frozen()) {
+        printf("  froze without the trigger\n");
+        return 1;
+    }
+
+    /*the command and the event are shorter than the ACL cut*/
+    if (take_dump() || check_dump(0, "1 truncated")) {
+        return 1;
+    }
+
+    start(BT_MONITOR_FILTER_EVT, 0);
+    bt_monitor_send(BT_MONITOR_ACL_TX_PKT, pkt_acl, sizeof(pkt_acl));
+    bt_monitor_send(BT_MONITOR_COMMAND_PKT, pkt_cmd, sizeof(pkt_cmd));
+    send(BT_MONITOR_EVENT_PKT, pkt_evt, sizeof(pkt_evt));
+    bt_monitor_get_stats(&stats);
+
+    if (stats.captured != 1 || stats.filtered != 2) {
+        printf("  events only: %u captured, %u filtered\n", stats.captured, stats.filtered);
+        return 1;
+    }
+
+    return take_dump() || check_dump(0, "1 packets");
+}
+
+static int run_assert(void)
+{
+    int cond = 0;
+
+    start(BT_MONITOR_FILTER_ALL, BT_MONITOR_FREEZE_ASSERT);
+    asserts = 0;
+    send(BT_MONITOR_EVENT_PKT, pkt_evt, sizeof(pkt_evt));
+
+    if (cond)
+        BT_ASSERT(cond);
+    else
+        BT_ASSERT(cond == 1);
+
+    /*neither kept*/
+    bt_monitor_send(BT_MONITOR_EVENT_PKT, pkt_disconn, sizeof(pkt_disconn));
+    bt_monitor_send(BT_MONITOR_EVENT_PKT, pkt_evt, sizeof(pkt_evt));
+
+    if (asserts != 1 || bt_monitor_frozen() != BT_MONITOR_FREEZE_ASSERT) {
+        printf("  %u asserts, frozen %u\n", asserts, bt_monitor_frozen());
+        return 1;
+    }
+
+    return take_dump() || check_dump(0, "frozen on assert");
+}
+
+static int run_flash(void)
+{
+    struct bt_monitor_flash_hdr hdr;
+    u32_t i;
+    int err;
+
+    start(BT_MONITOR_FILTER_ALL, 0);
+
+    for (i = 0; i < CONFIG_BT_MONITOR_SLOTS; i++) {
+        clock_us += 7500;
+        send(BT_MONITOR_ACL_RX_PKT, pkt_acl, sizeof(pkt_acl));
+    }
+
+    if (take_dump()) {
+        printf("  dump failed\n");
+        return 1;
+    }
+
+    memset(flash, 0, sizeof(flash));
+    err = bt_monitor_dump_flash(FLASH_BASE, sizeof(flash));
+    memcpy(&hdr, flash, sizeof(hdr));
+
+    if (err || hdr.magic != BT_MONITOR_FLASH_MAGIC || hdr.len != dump.len || memcmp(&flash[sizeof(hdr)], dump.data, dump.len) != 0) {
+        printf("  flash dump %d, %u bytes, expected %u\n", err, hdr.len, dump.len);
+        return 1;
+    }
+
+    memset(flash, 0, sizeof(flash));
+    err = bt_monitor_dump_flash(FLASH_BASE, dump.len);
+    memcpy(&hdr, flash, sizeof(hdr));
+
+    if (err != -ENOSPC || hdr.magic == BT_MONITOR_FLASH_MAGIC) {
+        printf("  a region too small: %d, magic 0x%08x\n", err, hdr.magic);
+        return 1;
+    }
+
+    return 0;
+}
+
+static double now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static void bench(const char *what, u8_t filter)
+{
+    double t;
+    int i;
+
+    start(filter, 0);
+    clock_real = 1;
+
+    t = now_ns();
+    for (i = 0; i < BENCH_PACKETS; i++) {
+        bt_monitor_send(BT_MONITOR_ACL_RX_PKT, pkt_acl, sizeof(pkt_acl));
+    }
+    t = now_ns() - t;
+
+    printf("  %-28s %6.1f ns\n", what, t / BENCH_PACKETS);
+}
+
+/* what bt_monitor_send() did before: BT_WARN("[Hci]:pkt_type:[0x%x],pkt_data:[%s]\r\n", opcode, bt_hex(buf, len)) */
+static void bench_hex(void)
+{
+    static const char hex[] = "0123456789abcdef";
+    char str[sizeof(pkt_acl) * 2 + 1], line[128];
+    volatile int chars = 0;
+    double t;
+    u32_t i, j;
+
+    t = now_ns();
+    for (i = 0; i < BENCH_PACKETS / 10; i++) {
+        for (j = 0; j < sizeof(pkt_acl); j++) {
+            str[j * 2] = hex[pkt_acl[j] >> 4];
+            str[j * 2 + 1] = hex[pkt_acl[j] & 0xf];
+        }
+        str[j * 2] = 0;
+        chars = snprintf(line, sizeof(line), "[Hci]:pkt_type:[0x%x],pkt_data:[%s]\r\n", BT_MONITOR_ACL_RX_PKT, str);
+    }
+    t = now_ns() - t;
+
+    printf("  %-28s %6.1f ns, then %d characters on the uart\n", "hex format, before", t / (BENCH_PACKETS / 10), chars);
+}
+
+static const struct {
+    const char *name;
+    int (*run)(void);
+} runs[] = {
+    { "frozen on disconnect", run_disconnect },
+    { "wrapped ring", run_wrapped },
+    { "filters", run_filters },
+    { "BT_ASSERT", run_assert },
+    { "flash dump", run_flash },
+};
+
+int main(void)
+{
+    int failed = 0;
+    unsigned i;
+
+    for (i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        printf("%s\n", runs[i].name);
+        if (runs[i].run() != 0) {
+            printf("  FAILED\n");
+            failed++;
+        }
+    }
+
+    printf("capture of a %u byte ACL packet, host cpu\n", (unsigned)sizeof(pkt_acl));
+    bench("all", BT_MONITOR_FILTER_ALL);
+    bench("ACL headers", BT_MONITOR_FILTER_ALL | BT_MONITOR_FILTER_ACL_HDR);
+    bench("events only, ACL filtered", BT_MONITOR_FILTER_EVT);
+    bench_hex();
+
+    printf("%u runs, %d failed\n", (unsigned)(sizeof(runs) / sizeof(runs[0])), failed);
+    return failed ? 1 : 0;
+}
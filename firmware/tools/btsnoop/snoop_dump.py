@@ -0,0 +1,249 @@
+#!/usr/bin/env python3
+
+# Turn HCI captures of the ble stack's capture ring (components/ble/ble_stack/host/monitor.c)
+# into .btsnoop files that Wireshark opens.
+#
+# The firmware writes a btsnoop file with the Linux monitor datalink (2001). It reaches the
+# host as "SNOOP:<hex>" lines in the debug uart log, as raw bytes from a USB CDC port, or
+# from a flash region read back with the flasher. Every capture ends with a system note
+# that says why the ring froze.
+#
+#   snoop_dump.py -l uart.log -o train.btsnoop
+#   snoop_dump.py -p /dev/ttyUSB0 -o train.btsnoop
+#   snoop_dump.py -p /dev/ttyACM0 --raw -o train.btsnoop
+#   snoop_dump.py -f flash_fd000.bin -o train.btsnoop
+
+import sys
+import argparse
+import struct
+import binascii
+
+BTSNOOP_MAGIC = b"btsnoop\0"
+BTSNOOP_HEADER_FORMAT = ">8sII"
+BTSNOOP_RECORD_FORMAT = ">IIIIQ"
+BTSNOOP_HEADER_SIZE = struct.calcsize(BTSNOOP_HEADER_FORMAT)
+BTSNOOP_RECORD_SIZE = struct.calcsize(BTSNOOP_RECORD_FORMAT)
+BTSNOOP_DATALINK_MONITOR = 2001
+BTSNOOP_EPOCH_2000 = 0x00E03AB44A676000
+
+FLASH_HEADER_FORMAT = "<II"
+FLASH_HEADER_SIZE = struct.calcsize(FLASH_HEADER_FORMAT)
+BT_MONITOR_FLASH_MAGIC = 0x504E5342
+
+MONITOR_NEW_INDEX = 0
+MONITOR_COMMAND_PKT = 2
+MONITOR_EVENT_PKT = 3
+MONITOR_ACL_TX_PKT = 4
+MONITOR_ACL_RX_PKT = 5
+MONITOR_SYSTEM_NOTE = 12
+
+EVENTS = {
+    0x05: "disconnect complete",
+    0x08: "encryption change",
+    0x0e: "command complete",
+    0x0f: "command status",
+    0x13: "number of completed packets",
+    0x1a: "data buffer overflow",
+    0x30: "encryption key refresh",
+    0x3e: "le meta",
+    0xff: "vendor",
+}
+
+LE_META = {
+    0x01: "connection complete",
+    0x02: "advertising report",
+    0x03: "connection update complete",
+    0x04: "remote features",
+    0x05: "ltk request",
+    0x06: "remote conn param request",
+    0x07: "data length change",
+    0x0a: "enhanced connection complete",
+    0x0c: "phy update complete",
+}
+
+L2CAP_CIDS = {0x0004: "att", 0x0005: "le signalling", 0x0006: "smp"}
+
+
+def parse(data):
+    """Split a btsnoop stream into (ts_us, opcode, orig_len, payload), stops at a cut off record."""
+    magic, version, datalink = struct.unpack_from(BTSNOOP_HEADER_FORMAT, data, 0)
+    if magic != BTSNOOP_MAGIC:
+        raise ValueError("no btsnoop header")
+    if datalink != BTSNOOP_DATALINK_MONITOR:
+        raise ValueError("datalink %d, expected %d" % (datalink, BTSNOOP_DATALINK_MONITOR))
+
+    records = []
+    offset = BTSNOOP_HEADER_SIZE
+    while offset + BTSNOOP_RECORD_SIZE <= len(data):
+        orig_len, incl_len, flags, _, ts = struct.unpack_from(BTSNOOP_RECORD_FORMAT, data, offset)
+        offset += BTSNOOP_RECORD_SIZE
+        if offset + incl_len > len(data):
+            break
+        records.append((ts, flags & 0xffff, orig_len, data[offset:offset + incl_len]))
+        offset += incl_len
+    return records, offset
+
+
+def complete(data):
+    """True once the closing system note is in."""
+    try:
+        records, _ = parse(data)
+    except (ValueError, struct.error):
+        return False
+    return bool(records) and records[-1][1] == MONITOR_SYSTEM_NOTE
+
+
+def summary(opcode, orig_len, payload):
+    if opcode == MONITOR_NEW_INDEX and len(payload) >= 16:
+        return "index %s %s" % (payload[8:16].split(b"\0")[0].decode(errors="replace"),
+                                ":".join("%02x" % b for b in reversed(payload[2:8])))
+    if opcode == MONITOR_SYSTEM_NOTE:
+        return "note: " + payload.split(b"\0")[0].decode(errors="replace")
+    if opcode == MONITOR_COMMAND_PKT and len(payload) >= 3:
+        op = payload[0] | payload[1] << 8
+        return "cmd  ogf 0x%02x ocf 0x%03x, %d bytes" % (op >> 10, op & 0x3ff, payload[2])
+    if opcode == MONITOR_EVENT_PKT and len(payload) >= 2:
+        text = "evt  %s" % EVENTS.get(payload[0], "0x%02x" % payload[0])
+        if payload[0] == 0x3e and len(payload) >= 3:
+            text += " %s" % LE_META.get(payload[2], "0x%02x" % payload[2])
+        elif payload[0] in (0x0e, 0x0f) and len(payload) >= 6:
+            op_at = 3 if payload[0] == 0x0e else 4
+            op = payload[op_at] | payload[op_at + 1] << 8
+            text += " 0x%04x" % op
+        elif payload[0] == 0x05 and len(payload) >= 6:
+            text += " handle 0x%03x reason 0x%02x" % ((payload[3] | payload[4] << 8) & 0xfff, payload[5])
+        return text
+    if opcode in (MONITOR_ACL_TX_PKT, MONITOR_ACL_RX_PKT) and len(payload) >= 4:
+        handle = (payload[0] | payload[1] << 8) & 0xfff
+        text = "acl  %s handle 0x%03x %d bytes" % ("tx" if opcode == MONITOR_ACL_TX_PKT else "rx",
+                                                  handle, orig_len - 4)
+        if len(payload) >= 8:
+            cid = payload[6] | payload[7] << 8
+            text += ", %s" % L2CAP_CIDS.get(cid, "cid 0x%04x" % cid)
+            if len(payload) >= 9:
+                text += " 0x%02x" % payload[8]
+        return text
+    return "opcode %d, %d bytes" % (opcode, orig_len)
+
+
+def render(data):
+    records, _ = parse(data)
+    packets = [r for r in records if r[1] not in (MONITOR_NEW_INDEX, MONITOR_SYSTEM_NOTE)]
+    if packets:
+        start = packets[0][0]
+        span = packets[-1][0] - start
+        print("%d packets over %.3f s, captured at %.3f s uptime" %
+              (len(packets), span / 1e6, (start - BTSNOOP_EPOCH_2000) / 1e6))
+    else:
+        start = records[0][0] if records else BTSNOOP_EPOCH_2000
+    last = start
+    for ts, opcode, orig_len, payload in records:
+        cut = " (%d kept)" % len(payload) if len(payload) < orig_len and opcode != MONITOR_SYSTEM_NOTE else ""
+        print("%10.3f ms %+9.3f  %s%s" % ((ts - start) / 1e3, (ts - last) / 1e3, summary(opcode, orig_len, payload), cut))
+        last = ts
+    print("")
+
+
+def save(data, filename):
+    _, end = parse(data)
+    with open(filename, "wb") as fh:
+        fh.write(data[:end])
+    print("wrote %s" % filename)
+
+
+def output_name(base, index, count):
+    if count == 1:
+        return base
+    stem, dot, ext = base.rpartition(".")
+    return "%s-%d.%s" % (stem, index, ext) if dot else "%s-%d" % (base, index)
+
+
+def from_lines(lines):
+    """Captures out of SNOOP: lines, a new one starts with every btsnoop header."""
+    captures = []
+    for line in lines:
+        idx = line.find("SNOOP:")
+        if idx < 0:
+            continue
+        try:
+            chunk = binascii.unhexlify(line[idx + 6:].strip())
+        except binascii.Error:
+            continue
+        if chunk.startswith(BTSNOOP_MAGIC) or not captures:
+            captures.append(bytearray())
+        captures[-1].extend(chunk)
+    return captures
+
+
+def read_log(filename):
+    with open(filename, "r", errors="replace") as fh:
+        return from_lines(fh)
+
+
+def read_serial(port, baudrate, raw):
+    import serial
+
+    data = bytearray()
+    with serial.Serial(port=port, baudrate=baudrate, timeout=1) as ser:
+        print("waiting for a capture on %s" % port)
+        while not complete(data):
+            if raw:
+                data.extend(ser.read(4096))
+                start = data.find(BTSNOOP_MAGIC)
+                if start > 0:
+                    del data[:start]
+            else:
+                line = ser.readline().decode(errors="replace")
+                captures = from_lines([line])
+                if captures and captures[0].startswith(BTSNOOP_MAGIC):
+                    data = captures[0]
+                elif captures and data:
+                    data.extend(captures[0])
+    return [data]
+
+
+def read_flash(filename):
+    with open(filename, "rb") as fh:
+        image = fh.read()
+    magic, length = struct.unpack_from(FLASH_HEADER_FORMAT, image, 0)
+    if magic != BT_MONITOR_FLASH_MAGIC:
+        raise SystemExit("no capture in %s, the region is blank or was cut short" % filename)
+    return [image[FLASH_HEADER_SIZE:FLASH_HEADER_SIZE + length]]
+
+
+parser = argparse.ArgumentParser(description='Convert ble stack HCI captures to btsnoop files')
+parser.add_argument('-l', '--log', help='saved debug uart log containing SNOOP: lines', default=None)
+parser.add_argument('-p', '--port', help='serial port to wait on for one capture', default=None)
+parser.add_argument('-r', '--baudrate', help='serial baud rate', type=int, default=921600)
+parser.add_argument('--raw', help='the port carries the raw btsnoop bytes (USB CDC)', action='store_true')
+parser.add_argument('-f', '--flash', help='image of the flash region written by bt_monitor_dump_flash()', default=None)
+parser.add_argument('-i', '--input', help='btsnoop file to list', default=None)
+parser.add_argument('-o', '--output', help='btsnoop file to write, numbered when there are several', default=None)
+parser.add_argument('-q', '--quiet', help='do not list the packets', action='store_true')
+args = parser.parse_args()
+
+if args.log:
+    captures = read_log(args.log)
+elif args.port:
+    captures = read_serial(args.port, args.baudrate, args.raw)
+elif args.flash:
+    captures = read_flash(args.flash)
+elif args.input:
+    with open(args.input, "rb") as fh:
+        captures = [fh.read()]
+else:
+    parser.print_usage()
+    sys.exit(1)
+
+if not captures:
+    print("no capture found")
+    sys.exit(1)
+
+for i, data in enumerate(captures):
+    try:
+        if not args.quiet:
+            render(bytes(data))
+        if args.output:
+            save(bytes(data), output_name(args.output, i + 1, len(captures)))
+    except (ValueError, struct.error) as e:
+        print("skipped capture %d: %s" % (i + 1, e))
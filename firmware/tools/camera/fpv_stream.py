@@ -0,0 +1,244 @@
+#!/usr/bin/env python3
+
+# Receive the low resolution BLE video stream of examples/camera_train.
+#
+# Frames are put back together from their chunks and optionally saved as jpeg
+# files. The device clock is matched to the host clock by a few time sync
+# round trips before and after the run, so the capture time stamped on every
+# frame gives the end-to-end latency up to the last chunk arriving here. Build
+# the firmware with VIDEO_TEST_SOURCE to measure the links without a sensor.
+
+import os
+import sys
+import time
+import argparse
+import asyncio
+import struct
+
+BLE_NOTIFY_CHARACTERISTIC_UUID = "00080001-0745-4650-8d93-df59be2fc10a"
+BLE_WRITE_CHARACTERISTIC_UUID = "00080002-0745-4650-8d93-df59be2fc10a"
+
+BLE_CMD_STREAM_START = b'\x01'
+BLE_CMD_STREAM_STOP = b'\x02'
+BLE_CMD_GET_STATS = b'\x03'
+BLE_CMD_TIME_SYNC = 0x04
+
+BLE_MSG_CHUNK = 0x01
+BLE_MSG_CHUNK_LAST = 0x03
+BLE_MSG_FRAME = 0x10
+BLE_MSG_TIME = 0x20
+BLE_MSG_STATS = 0x21
+
+FRAME_FORMAT = "<BHHIIBB"
+TIME_FORMAT = "<BII"
+CHUNK_HEADER_FORMAT = "<BBH"
+PIPE_STATS_FORMAT = "<6I"
+RATE_STATS_FORMAT = "<BB2x7I"
+
+PIPE_STATS = ["captured", "encoded", "skipped", "overflows", "wrapped", "bytes_avg"]
+RATE_STATS = ["quality", "fps", "throughput", "frame_bytes", "budget", "sent", "paced", "steps_down", "steps_up"]
+
+TIME_SYNC_ROUNDS = 8
+
+
+def now_us():
+    return time.monotonic_ns() // 1000
+
+
+class Clock:
+    """Device to host time mapping from the best of a few round trips."""
+
+    def __init__(self):
+        self.samples = []
+
+    def add(self, sent, received, device):
+        rtt = received - sent
+        self.samples.append((rtt, sent + rtt // 2, device))
+
+    def best(self, samples):
+        rtt, host, device = min(samples)
+        return host, device
+
+    def fit(self, count):
+        """Offset from the first sync round, drift from the first to the last."""
+        self.host0, self.dev0 = self.best(self.samples[:count])
+        self.drift = 0.0
+        if len(self.samples) > count:
+            host1, dev1 = self.best(self.samples[count:])
+            span = (dev1 - self.dev0) & 0xFFFFFFFF
+            if span:
+                self.drift = ((host1 - self.host0) - span) / span
+
+    def to_host(self, device_us):
+        delta = (device_us - self.dev0) & 0xFFFFFFFF
+        if delta >= 0x80000000:
+            delta -= 0x100000000
+        return self.host0 + delta * (1 + self.drift)
+
+
+class Receiver:
+    def __init__(self, out_dir):
+        self.out_dir = out_dir
+        self.frame = None
+        self.chunks = {}
+        self.complete = []
+        self.broken = 0
+        self.bytes = 0
+        self.sync = {}
+        self.stats = None
+        self.sync_done = asyncio.Event()
+        self.stats_done = asyncio.Event()
+
+    def handle(self, sender, data):
+        received = now_us()
+        self.bytes += len(data)
+        kind = data[0]
+
+        if kind == BLE_MSG_FRAME:
+            if self.frame is not None:
+                self.broken += 1
+            _, seq, chunks, length, capture_us, quality, fps = struct.unpack_from(FRAME_FORMAT, data)
+            self.frame = {"seq": seq, "chunks": chunks, "len": length, "capture_us": capture_us,
+                          "quality": quality, "fps": fps, "start": received}
+            self.chunks = {}
+        elif kind in (BLE_MSG_CHUNK, BLE_MSG_CHUNK_LAST):
+            _, seq, index = struct.unpack_from(CHUNK_HEADER_FORMAT, data)
+            if self.frame is None or seq != (self.frame["seq"] & 0xFF):
+                return
+            self.chunks[index] = bytes(data[4:])
+            if kind == BLE_MSG_CHUNK_LAST:
+                self.finish(received)
+        elif kind == BLE_MSG_TIME:
+            _, token, device_us = struct.unpack_from(TIME_FORMAT, data)
+            if token in self.sync:
+                self.sync[token] = (self.sync[token], received, device_us)
+                self.sync_done.set()
+        elif kind == BLE_MSG_STATS:
+            pipe = struct.unpack_from(PIPE_STATS_FORMAT, data, 1)
+            rate = struct.unpack_from(RATE_STATS_FORMAT, data, 1 + struct.calcsize(PIPE_STATS_FORMAT))
+            self.stats = dict(zip(PIPE_STATS, pipe)), dict(zip(RATE_STATS, rate))
+            self.stats_done.set()
+
+    def finish(self, received):
+        frame = self.frame
+        self.frame = None
+
+        if len(self.chunks) != frame["chunks"]:
+            self.broken += 1
+            return
+
+        jpeg = b"".join(self.chunks[i] for i in range(frame["chunks"]))[:frame["len"]]
+        if len(jpeg) != frame["len"] or not jpeg.startswith(b"\xff\xd8"):
+            self.broken += 1
+            return
+
+        frame["end"] = received
+        self.complete.append(frame)
+
+        if self.out_dir:
+            with open(os.path.join(self.out_dir, "frame_%05d.jpg" % frame["seq"]), "wb") as f:
+                f.write(jpeg)
+
+
+async def time_sync(client, write_handle, receiver, clock, token_base):
+    for i in range(TIME_SYNC_ROUNDS):
+        token = token_base + i
+        receiver.sync_done.clear()
+        receiver.sync[token] = now_us()
+        await client.write_gatt_char(write_handle, struct.pack("<BI", BLE_CMD_TIME_SYNC, token), True)
+        try:
+            await asyncio.wait_for(receiver.sync_done.wait(), 2)
+        except asyncio.TimeoutError:
+            continue
+        if isinstance(receiver.sync[token], tuple):
+            clock.add(*receiver.sync[token])
+
+
+def report(receiver, clock, seconds):
+    frames = receiver.complete
+
+    print("%d frames in %.1f s, %.1f fps, %d lost or broken, %.1f kB/s on the link" %
+          (len(frames), seconds, len(frames) / seconds, receiver.broken, receiver.bytes / seconds / 1000))
+
+    if frames and clock.samples:
+        latency = sorted((f["end"] - clock.to_host(f["capture_us"])) / 1000 for f in frames)
+        transfer = sorted((f["end"] - f["start"]) / 1000 for f in frames)
+        print("latency ms: min %.1f, median %.1f, p95 %.1f, max %.1f" %
+              (latency[0], latency[len(latency) // 2], latency[int(len(latency) * 0.95)], latency[-1]))
+        print("transfer ms: median %.1f, max %.1f (frame record to last chunk)" %
+              (transfer[len(transfer) // 2], transfer[-1]))
+        print("frame size: median %d bytes, quality %d-%d, fps %d-%d" %
+              (sorted(f["len"] for f in frames)[len(frames) // 2],
+               min(f["quality"] for f in frames), max(f["quality"] for f in frames),
+               min(f["fps"] for f in frames), max(f["fps"] for f in frames)))
+        rtt = min(s[0] for s in clock.samples) / 1000
+        print("clock: best sync round trip %.1f ms, drift %.1f ppm" % (rtt, clock.drift * 1e6))
+
+    if receiver.stats:
+        pipe, rate = receiver.stats
+        print("device pipe: " + ", ".join("%s %d" % kv for kv in pipe.items()))
+        print("device rate: " + ", ".join("%s %d" % kv for kv in rate.items()))
+
+
+async def stream(addr, seconds, out_dir):
+    from bleak import BleakClient
+
+    receiver = Receiver(out_dir)
+    clock = Clock()
+
+    async with BleakClient(addr) as client:
+        write_handle = None
+        notify_handle = None
+        for service in client.services:
+            for char in service.characteristics:
+                if char.uuid == BLE_WRITE_CHARACTERISTIC_UUID:
+                    write_handle = char
+                if char.uuid == BLE_NOTIFY_CHARACTERISTIC_UUID:
+                    notify_handle = char
+
+        if write_handle is None or notify_handle is None:
+            print("Device does not expose the camera_train characteristics")
+            return
+
+        await client.start_notify(notify_handle, receiver.handle)
+
+        await time_sync(client, write_handle, receiver, clock, 0)
+        first = len(clock.samples)
+        if not first:
+            print("No time sync reply, latency is not measured")
+
+        await client.write_gatt_char(write_handle, BLE_CMD_STREAM_START, True)
+        start = now_us()
+        await asyncio.sleep(seconds)
+        await client.write_gatt_char(write_handle, BLE_CMD_STREAM_STOP, True)
+        elapsed = (now_us() - start) / 1e6
+
+        # let the last frame drain before the closing sync
+        await asyncio.sleep(0.5)
+        await time_sync(client, write_handle, receiver, clock, TIME_SYNC_ROUNDS)
+        if first:
+            clock.fit(first)
+
+        receiver.stats_done.clear()
+        await client.write_gatt_char(write_handle, BLE_CMD_GET_STATS, True)
+        try:
+            await asyncio.wait_for(receiver.stats_done.wait(), 2)
+        except asyncio.TimeoutError:
+            pass
+
+    report(receiver, clock, elapsed)
+
+
+parser = argparse.ArgumentParser(description='Receive and measure the camera_train BLE video stream')
+parser.add_argument('-a', '--addr', help='Bluetooth address of device', required=True)
+parser.add_argument('-d', '--duration', help='seconds to stream', type=float, default=10.0)
+parser.add_argument('-o', '--out', help='directory to save the received jpeg frames in', default=None)
+args = parser.parse_args()
+
+if args.out:
+    os.makedirs(args.out, exist_ok=True)
+
+try:
+    asyncio.run(stream(args.addr, args.duration, args.out))
+except KeyboardInterrupt:
+    sys.exit(1)
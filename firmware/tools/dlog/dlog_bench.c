@@ -0,0 +1,349 @@
+/*
+ * Host build of the deferred log ring (common/dlog/dlog.c), for what it renders
+ * and the cost of a call next to MSG().
+ *
+ * The clock is a counter the checks advance, or the host clock for the bench.
+ * Records keep the format and %s arguments as 32 bit addresses like on the chip, so
+ * the build is -no-pie to keep them below 4 GB.
+ *
+ * Checks:
+ *  - text lines: timestamp, level, module, arguments, %s of a literal, the level
+ *    filter per module, and one notify per empty ring;
+ *  - a full ring drops, counts the drops per module and reports them after the
+ *    records it kept;
+ *  - binary lines carry the header, timestamp, format address and arguments;
+ *  - three writer threads against a reader thread: every line rendered whole and
+ *    each writer's lines in order.
+ * Then dlog_bench_ns(), the two argument call the firmware times, against the same
+ * line through MSG(), which is vsnprintf into a 128 byte buffer and the uart write.
+ *
+ *   gcc -O2 -no-pie -pthread -I common/dlog -I drivers/bl702_driver/hal_drv/inc \
+ *       tools/dlog/dlog_bench.c common/dlog/dlog.c -o dlog_bench
+ *   ./dlog_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "hal_mtimer.h"
+
+#define DLOG_MODULE 1
+#include "dlog.h"
+
+#define BENCH_CALLS    2000000
+#define THREAD_WRITERS 3
+#define THREAD_LINES   200000
+
+const char *const dlog_modules[DLOG_MODULE_MAX] = { "app", "ble", "motor" };
+
+static int clock_real;
+static uint64_t clock_us;
+static uint32_t notifies;
+
+static struct {
+    char text[THREAD_WRITERS * THREAD_LINES * 48];
+    size_t len;
+} out;
+
+uint64_t mtimer_get_time_us(void)
+{
+    struct timespec t;
+
+    if (!clock_real) {
+        return clock_us;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000ULL + t.tv_nsec / 1000;
+}
+
+static void out_text(const char *text, uint32_t len)
+{
+    if (out.len + len <= sizeof(out.text)) {
+        memcpy(&out.text[out.len], text, len);
+        out.len += len;
+    }
+}
+
+static void notify(void)
+{
+    notifies++;
+}
+
+static void start(void)
+{
+    dlog_flush();
+    out.len = 0;
+    notifies = 0;
+    clock_real = 0;
+    clock_us = 1000250;
+}
+
+static int expect_text(const char *expected)
+{
+    if (out.len != strlen(expected) || memcmp(out.text, expected, out.len) != 0) {
+        printf("  got:\n%.*s  expected:\n%s", (int)out.len, out.text, expected);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int run_text(void)
+{
+    start();
+    DLOG_I("connected, interval %u x 1.25 ms, latency %u", 24, 0);
+    clock_us += 1500;
+    DLOG_W("no arguments");
+    DLOG_E("%s failed: %d", "bt_enable", -5);
+    DLOG_D("below the level");
+    dlog_set_level(DLOG_MODULE, DLOG_LEVEL_DBG);
+    DLOG_D("debug %x", 0xbeef);
+    dlog_set_level(DLOG_MODULE, DLOG_LEVEL_INF);
+
+    if (notifies != 1) {
+        printf("  %u notifies for one empty ring\n", notifies);
+        return 1;
+    }
+
+    dlog_flush();
+    return expect_text("1.000250 I/ble: connected, interval 24 x 1.25 ms, latency 0\r\n"
+                       "1.001750 W/ble: no arguments\r\n"
+                       "1.001750 E/ble: bt_enable failed: -5\r\n"
+                       "1.001750 D/ble: debug beef\r\n");
+}
+
+static int run_full(void)
+{
+    const uint32_t fit = DLOG_RING_WORDS / 4;
+    dlog_stats_t before, after;
+    char line[32];
+    uint32_t i;
+
+    start();
+    dlog_get_stats(&before);
+
+    /*one argument, 4 words a record*/
+    for (i = 0; i < fit + 10; i++) {
+        DLOG_I("fill %u", i);
+    }
+
+    dlog_get_stats(&after);
+    dlog_flush();
+
+    if (after.written - before.written != fit || after.dropped - before.dropped != 10 ||
+        after.module_dropped[DLOG_MODULE] - before.module_dropped[DLOG_MODULE] != 10 || after.high_water != DLOG_RING_WORDS) {
+        printf("  %u written, %u dropped, high water %u\n", after.written - before.written, after.dropped - before.dropped,
+               after.high_water);
+        return 1;
+    }
+
+    /*the last record kept, then the report*/
+    snprintf(line, sizeof(line), "fill %u\r\n", fit - 1);
+    if (out.len < 40 || !strstr(out.text + out.len - 40, line) || memcmp(out.text + out.len - 18, "dlog: 10 dropped\r\n", 18) != 0) {
+        printf("  ends with \"%.*s\"\n", 40, out.text + out.len - 40);
+        return 1;
+    }
+
+    /*reported once*/
+    out.len = 0;
+    DLOG_I("after");
+    dlog_flush();
+    return expect_text("1.000250 I/ble: after\r\n");
+}
+
+static uint32_t hex_word(const char *p)
+{
+    uint32_t val = 0;
+    int b;
+
+    for (b = 0; b < 4; b++) {
+        val |= (uint32_t)strtoul((char[]){ p[b * 2], p[b * 2 + 1], 0 }, NULL, 16) << (b * 8);
+    }
+
+    return val;
+}
+
+static int run_binary(void)
+{
+    static const char fmt[] = "x=%d y=%u";
+    uint32_t words[5];
+    int i;
+
+    start();
+    dlog_set_binary(true);
+    DLOG_W(fmt, -3, 7);
+    dlog_flush();
+    dlog_set_binary(false);
+
+    if (out.len != 5 + 5 * 8 + 2 || memcmp(out.text, "DLOG:", 5) != 0 || memcmp(out.text + out.len - 2, "\r\n", 2) != 0) {
+        printf("  \"%.*s\"\n", (int)out.len, out.text);
+        return 1;
+    }
+
+    for (i = 0; i < 5; i++) {
+        words[i] = hex_word(out.text + 5 + i * 8);
+    }
+
+    /*marker, 2 arguments, module 1, warning*/
+    if (words[0] != 0xD0000212 || words[1] != (uint32_t)clock_us || words[2] != (uint32_t)(uintptr_t)fmt ||
+        words[3] != (uint32_t)-3 || words[4] != 7) {
+        printf("  words %08x %08x %08x %08x %08x\n", words[0], words[1], words[2], words[3], words[4]);
+        return 1;
+    }
+
+    return 0;
+}
+
+static volatile int readers_stop;
+
+static void *writer(void *arg)
+{
+    uint32_t id = (uint32_t)(uintptr_t)arg;
+    uint32_t i;
+
+    for (i = 0; i < THREAD_LINES; i++) {
+        DLOG_I("writer %u line %u", id, i);
+        /*about the pace the reader renders at, so most records are kept*/
+        sched_yield();
+    }
+
+    return NULL;
+}
+
+static void *reader(void *arg)
+{
+    while (!readers_stop) {
+        if (!dlog_process(64)) {
+            sched_yield();
+        }
+    }
+
+    dlog_flush();
+    return NULL;
+}
+
+static int run_threads(void)
+{
+    pthread_t writers[THREAD_WRITERS], rd;
+    int last[THREAD_WRITERS];
+    const char *p, *nl, *end;
+    char text[DLOG_LINE_MAX];
+    uint32_t id, line, lines = 0, drops = 0, dropped, bad = 0;
+    uintptr_t i;
+
+    start();
+    readers_stop = 0;
+
+    pthread_create(&rd, NULL, reader, NULL);
+    for (i = 0; i < THREAD_WRITERS; i++) {
+        last[i] = -1;
+        pthread_create(&writers[i], NULL, writer, (void *)i);
+    }
+    for (i = 0; i < THREAD_WRITERS; i++) {
+        pthread_join(writers[i], NULL);
+    }
+    readers_stop = 1;
+    pthread_join(rd, NULL);
+
+    for (p = out.text, end = out.text + out.len; p < end; p = nl + 1) {
+        nl = memchr(p, '\n', end - p);
+        if (!nl || nl - p >= (int)sizeof(text)) {
+            bad++;
+            break;
+        }
+        memcpy(text, p, nl - p);
+        text[nl - p] = 0;
+
+        if (sscanf(text, "1.000250 I/ble: writer %u line %u\r", &id, &line) == 2 && id < THREAD_WRITERS && (int)line > last[id]) {
+            last[id] = line;
+            lines++;
+        } else if (sscanf(text, "dlog: %u dropped\r", &dropped) == 1) {
+            drops += dropped;
+        } else {
+            if (bad++ < 3) {
+                printf("  \"%s\"\n", text);
+            }
+        }
+    }
+
+    printf("  %u lines, %u dropped of %u\n", lines, drops, THREAD_WRITERS * THREAD_LINES);
+
+    /*the drop counter is not atomic across host threads, on the chip one core takes it*/
+    if (bad || lines == 0 || lines > THREAD_WRITERS * THREAD_LINES) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/* what MSG() does: bflb_platform_printf() formats into 128 bytes and writes them to the polled uart */
+static volatile size_t uart_chars;
+
+static void msg_printf(const char *fmt, ...)
+{
+    char print_buf[128];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(print_buf, sizeof(print_buf) - 1, fmt, ap);
+    va_end(ap);
+    uart_chars += strlen(print_buf);
+}
+
+static void bench(void)
+{
+    struct timespec t0, t1;
+    double ns;
+    int i;
+
+    start();
+    clock_real = 1;
+    printf("two argument record, host cpu\n");
+    printf("  %-24s %5u ns\n", "dlog_bench_ns()", dlog_bench_ns());
+
+    uart_chars = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < BENCH_CALLS; i++) {
+        msg_printf("connected, interval %u x 1.25 ms, latency %u\r\n", i, 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / BENCH_CALLS;
+
+    printf("  %-24s %5.0f ns, then %u characters on the uart\n", "MSG() format", ns, (unsigned)(uart_chars / BENCH_CALLS));
+}
+
+static const struct {
+    const char *name;
+    int (*run)(void);
+} runs[] = {
+    { "text", run_text },
+    { "full ring", run_full },
+    { "binary", run_binary },
+    { "threads", run_threads },
+};
+
+int main(void)
+{
+    int failed = 0;
+    unsigned i;
+
+    dlog_init(out_text, notify);
+
+    for (i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        printf("%s\n", runs[i].name);
+        if (runs[i].run() != 0) {
+            printf("  FAILED\n");
+            failed++;
+        }
+    }
+
+    bench();
+
+    printf("%u runs, %d failed\n", (unsigned)(sizeof(runs) / sizeof(runs[0])), failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,220 @@
+#!/usr/bin/env python3
+
+# Turn the binary records of common/dlog into text with the strings of the firmware ELF.
+#
+# In binary mode (dlog_set_binary()) the firmware prints every record as a
+# "DLOG:<hex>" line: header, timestamp, format string address and one word per
+# argument, little endian. The format strings and %s arguments stay in flash, this
+# tool reads them and the module names (dlog_modules[]) from the ELF of the build.
+#
+#   dlog_decode.py -e build/out/examples/lego_train/lego_train_bl702.elf -l uart.log
+#   dlog_decode.py -e lego_train_bl702.elf -p /dev/ttyUSB0
+
+import sys
+import re
+import argparse
+import struct
+import binascii
+
+DLOG_HDR_MARK = 0xD0000000
+DLOG_HDR_MARK_MASK = 0xF0000000
+DLOG_HDR_WORDS = 3
+DLOG_MODULE_MAX = 16
+LEVELS = "DIWE"
+
+SHT_SYMTAB = 2
+SHT_NOBITS = 8
+SHF_ALLOC = 0x2
+
+# flags, width, precision, length, conversion of a C printf specifier
+SPEC = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|j|z|t)?([diouxXcspn%])")
+
+
+class Elf:
+    """The loaded sections and the symbols of a little endian ELF, 32 or 64 bit."""
+
+    def __init__(self, filename):
+        with open(filename, "rb") as fh:
+            self.image = fh.read()
+        if self.image[:4] != b"\x7fELF":
+            raise SystemExit("%s is not an ELF file" % filename)
+        self.wide = self.image[4] == 2
+        self.ptr = 8 if self.wide else 4
+
+        if self.wide:
+            shoff, = struct.unpack_from("<Q", self.image, 0x28)
+            shentsize, shnum, shstrndx = struct.unpack_from("<HHH", self.image, 0x3a)
+        else:
+            shoff, = struct.unpack_from("<I", self.image, 0x20)
+            shentsize, shnum, shstrndx = struct.unpack_from("<HHH", self.image, 0x2e)
+
+        self.sections = []
+        for i in range(shnum):
+            off = shoff + i * shentsize
+            if self.wide:
+                name, stype, flags, addr, offset, size, link = struct.unpack_from("<IIQQQQI", self.image, off)
+            else:
+                name, stype, flags, addr, offset, size, link = struct.unpack_from("<IIIIIII", self.image, off)
+            self.sections.append((name, stype, flags, addr, offset, size, link))
+
+        self.symbols = {}
+        for _, stype, _, _, offset, size, link in self.sections:
+            if stype == SHT_SYMTAB:
+                self.read_symbols(offset, size, self.sections[link][4])
+
+    def read_symbols(self, offset, size, strtab):
+        entsize = 24 if self.wide else 16
+        for off in range(offset, offset + size, entsize):
+            if self.wide:
+                name, _, _, _, value, _ = struct.unpack_from("<IBBHQQ", self.image, off)
+            else:
+                name, value, _, _, _, _ = struct.unpack_from("<IIIBBH", self.image, off)
+            if name:
+                end = self.image.index(b"\0", strtab + name)
+                self.symbols[self.image[strtab + name:end].decode(errors="replace")] = value
+
+    def read(self, addr, length):
+        """Bytes the image holds at a run time address, None outside the loaded sections."""
+        for _, stype, flags, start, offset, size, _ in self.sections:
+            if flags & SHF_ALLOC and stype != SHT_NOBITS and start <= addr < start + size:
+                length = min(length, start + size - addr)
+                return self.image[offset + addr - start:offset + addr - start + length]
+        return None
+
+    def string(self, addr):
+        data = self.read(addr, 256) if addr else None
+        if data is None:
+            return None
+        return data.split(b"\0")[0].decode(errors="replace")
+
+    def pointer(self, addr):
+        data = self.read(addr, self.ptr)
+        if data is None or len(data) < self.ptr:
+            return 0
+        return struct.unpack("<Q" if self.wide else "<I", data)[0]
+
+
+def module_names(elf):
+    base = elf.symbols.get("dlog_modules")
+    if base is None:
+        return ["%d" % i for i in range(DLOG_MODULE_MAX)]
+    names = []
+    for i in range(DLOG_MODULE_MAX):
+        names.append(elf.string(elf.pointer(base + i * elf.ptr)) or "%d" % i)
+    return names
+
+
+def signed(word):
+    return word - (1 << 32) if word & 0x80000000 else word
+
+
+def format_c(elf, fmt, args):
+    """printf with 32 bit words for the arguments, like dlog_render_text() does on the target."""
+    args = list(args)
+
+    def take():
+        return args.pop(0) if args else 0
+
+    def convert(m):
+        flags, width, prec, length, conv = m.groups()
+        if conv == "%":
+            return "%"
+        if width == "*":
+            width = str(signed(take()))
+        if prec == "*":
+            prec = str(signed(take()))
+        spec = "%" + flags + (width or "") + ("." + prec if prec is not None else "")
+        word = take()
+        if length == "ll":
+            # the caller passed a 64 bit value, only its low word was kept
+            return spec.replace("#", "") + "s" % "<64 bit>"
+        if conv in "di":
+            return (spec + "d") % signed(word)
+        if conv == "u":
+            return (spec + "d") % word
+        if conv in "oxX":
+            return (spec + conv) % word
+        if conv == "c":
+            return (spec + "c") % chr(word & 0xff)
+        if conv == "p":
+            return (spec + "s") % ("0x%08x" % word)
+        if conv == "s":
+            text = elf.string(word)
+            return (spec + "s") % (text if text is not None else "<0x%08x>" % word)
+        return m.group(0)
+
+    return SPEC.sub(convert, fmt)
+
+
+def decode(elf, modules, words):
+    hdr = words[0]
+    if hdr & DLOG_HDR_MARK_MASK != DLOG_HDR_MARK:
+        return "bad record %08x" % hdr
+    nargs = (hdr >> 8) & 0x0f
+    module = modules[(hdr >> 4) & 0x0f]
+    level = LEVELS[hdr & 0x03]
+    ts = words[1]
+    args = words[DLOG_HDR_WORDS:DLOG_HDR_WORDS + nargs]
+
+    if words[2] == 0:
+        # a record without a format counts the records the ring had no room for
+        return "%lu.%06lu %c/dlog: %d dropped" % (ts // 1000000, ts % 1000000, level, args[0] if args else 0)
+    fmt = elf.string(words[2])
+    if fmt is None:
+        text = "<format 0x%08x> %s" % (words[2], " ".join("%08x" % a for a in args))
+    else:
+        text = format_c(elf, fmt, args)
+    return "%lu.%06lu %c/%s: %s" % (ts // 1000000, ts % 1000000, level, module, text)
+
+
+def render_line(elf, modules, line):
+    """Decoded text of a DLOG: line, other lines are passed through."""
+    idx = line.find("DLOG:")
+    if idx < 0:
+        return line.rstrip("\r\n")
+    try:
+        data = binascii.unhexlify(line[idx + 5:].strip())
+    except binascii.Error:
+        return line.rstrip("\r\n")
+    words = struct.unpack("<%dI" % (len(data) // 4), data[:len(data) // 4 * 4])
+    if len(words) < DLOG_HDR_WORDS:
+        return line.rstrip("\r\n")
+    return line[:idx] + decode(elf, modules, words)
+
+
+def read_log(elf, modules, filename):
+    with open(filename, "r", errors="replace") as fh:
+        for line in fh:
+            print(render_line(elf, modules, line))
+
+
+def read_serial(elf, modules, port, baudrate):
+    import serial
+
+    with serial.Serial(port=port, baudrate=baudrate, timeout=1) as ser:
+        while True:
+            line = ser.readline().decode(errors="replace")
+            if line:
+                print(render_line(elf, modules, line))
+
+
+parser = argparse.ArgumentParser(description='Decode binary dlog records')
+parser.add_argument('-e', '--elf', help='ELF of the running firmware', required=True)
+parser.add_argument('-l', '--log', help='saved debug uart log containing DLOG: lines', default=None)
+parser.add_argument('-p', '--port', help='serial port device to follow', default=None)
+parser.add_argument('-r', '--baudrate', help='serial baud rate', type=int, default=921600)
+args = parser.parse_args()
+
+elf = Elf(args.elf)
+modules = module_names(elf)
+
+if args.log:
+    read_log(elf, modules, args.log)
+elif args.port:
+    try:
+        read_serial(elf, modules, args.port, args.baudrate)
+    except KeyboardInterrupt:
+        pass
+else:
+    parser.print_usage()
+    sys.exit(1)
@@ -0,0 +1,573 @@
+/*
+ * Host tests of the drag and drop FAT12 disk of the bootloader
+ * (examples/robot_bootloader/bflb_eflash_loader_fat.c) under the write orders
+ * hosts use.
+ *
+ * The host side keeps its own copy of the FAT and the root directory, read from
+ * the disk like a mount does. It writes a file as data sectors, FAT (both copies)
+ * and directory entry, in the order each run gives. The sink keeps what it is
+ * given like the image slot does. It checks that every write goes on where the
+ * last one ended, and it only finishes once the size is known.
+ *
+ * Runs:
+ *  - data, FAT and directory entry in every order the stream has to follow: FAT
+ *    before data, data before the directory entry, the host going quiet before the
+ *    entry, and a FAT written between clusters;
+ *  - a FAT written first that steps around another file's cluster;
+ *  - rewritten entries: an entry created empty and sized later, the directory
+ *    sector written again, a macOS ._ file next to the image, an image deleted and
+ *    replaced by another at the same clusters;
+ *  - what must fail: data that steps around a cluster before the FAT says so, a FAT
+ *    chain rewritten to other clusters, a sector written again with other data, the
+ *    host skipping ahead inside the file, and a file larger than a stream.
+ * A finished image is also read back through the disk.
+ *
+ *   gcc -O2 -I examples/robot_bootloader tools/fat/eflash_loader_fat_test.c -o eflash_loader_fat_test
+ *   ./eflash_loader_fat_test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bflb_eflash_loader_fat.c"
+
+#define SECTOR     BFLB_EFLASH_LOADER_FAT_SECTOR_SIZE
+#define FILE_MAX   (BFLB_EFLASH_LOADER_FAT_FILE_CLUSTERS * FAT_CLUSTER_SIZE)
+#define IMG_MAGIC  "BFNP"
+#define IMG_SIZE   (3 * FAT_CLUSTER_SIZE + 700)
+#define SLOT_IMAGE 2
+#define SLOT_OTHER 3
+
+typedef struct {
+    char name[12];
+    uint32_t size;
+    uint16_t chain[BFLB_EFLASH_LOADER_FAT_FILE_CLUSTERS];
+    uint32_t clusters;
+    uint8_t data[FILE_MAX];
+} host_file_t;
+
+/* the image slot */
+static struct {
+    uint8_t image[FILE_MAX];
+    uint32_t written;
+    uint32_t bad_offsets; /* writes that did not go on where the last one ended */
+    uint32_t finishes;    /* finish() calls that ended the image */
+    uint32_t finished;    /* size of the last image ended */
+    uint32_t waits;       /* finish() calls while the size was unknown */
+    int32_t aborted;
+} sink;
+
+static struct {
+    uint8_t fat[FAT_SECTORS * SECTOR];
+    uint8_t root[FAT_ROOT_SECTORS * SECTOR];
+} host;
+
+static host_file_t img_a, img_b, other;
+
+static int32_t sink_probe(const uint8_t *data)
+{
+    return memcmp(data, IMG_MAGIC, 4) == 0;
+}
+
+static int32_t sink_write(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+    /*a new image starts over*/
+    if (offset == 0) {
+        sink.written = 0;
+    }
+
+    if (offset != sink.written || offset + len > sizeof(sink.image)) {
+        sink.bad_offsets++;
+        return -1;
+    }
+
+    memcpy(&sink.image[offset], data, len);
+    sink.written += len;
+    return 0;
+}
+
+static int32_t sink_read(uint32_t offset, uint8_t *data, uint32_t len)
+{
+    if (offset + len > sink.written) {
+        return -1;
+    }
+
+    memcpy(data, &sink.image[offset], len);
+    return 0;
+}
+
+static int32_t sink_finish(uint32_t size)
+{
+    if (size == 0) {
+        sink.waits++;
+        return BFLB_EFLASH_LOADER_FAT_WAIT;
+    }
+
+    if (size > sink.written) {
+        return -1;
+    }
+
+    sink.finishes++;
+    sink.finished = size;
+    return 0;
+}
+
+static void sink_abort(int32_t error)
+{
+    sink.aborted = error;
+}
+
+static const eflash_loader_fat_sink_t test_sink = {
+    .probe = sink_probe,
+    .write = sink_write,
+    .read = sink_read,
+    .finish = sink_finish,
+    .abort = sink_abort,
+};
+
+static void host_fat_set(uint32_t cluster, uint16_t val)
+{
+    uint8_t *p = &host.fat[cluster + cluster / 2];
+
+    if (cluster & 1) {
+        p[0] = (p[0] & 0x0f) | ((val & 0x0f) << 4);
+        p[1] = val >> 4;
+    } else {
+        p[0] = val & 0xff;
+        p[1] = (p[1] & 0xf0) | ((val >> 8) & 0x0f);
+    }
+}
+
+/* a fresh disk, mounted */
+static void host_mount(void)
+{
+    uint32_t i;
+
+    memset(&sink, 0, sizeof(sink));
+    bflb_eflash_loader_fat_init(&test_sink, "READY\r\n");
+
+    for (i = 0; i < FAT_SECTORS; i++) {
+        bflb_eflash_loader_fat_read(FAT_TABLE_START + i, &host.fat[i * SECTOR]);
+    }
+
+    for (i = 0; i < FAT_ROOT_SECTORS; i++) {
+        bflb_eflash_loader_fat_read(FAT_ROOT_START + i, &host.root[i * SECTOR]);
+    }
+}
+
+/* both copies, like every host does */
+static void host_write_fat(void)
+{
+    uint32_t copy, i;
+
+    for (copy = 0; copy < FAT_COPIES; copy++) {
+        for (i = 0; i < FAT_SECTORS; i++) {
+            bflb_eflash_loader_fat_write(FAT_TABLE_START + copy * FAT_SECTORS + i, &host.fat[i * SECTOR]);
+        }
+    }
+}
+
+static void host_dir(uint32_t slot, const char *name, uint16_t cluster, uint32_t size)
+{
+    uint8_t *entry = &host.root[slot * DIR_ENTRY_SIZE];
+    uint32_t sector = slot * DIR_ENTRY_SIZE / SECTOR;
+
+    memset(entry, 0, DIR_ENTRY_SIZE);
+    memcpy(entry, name, 11);
+    entry[DIR_ATTR] = 0x20;
+    fat_put16(&entry[DIR_CLUSTER], cluster);
+    fat_put32(&entry[DIR_SIZE], size);
+    bflb_eflash_loader_fat_write(FAT_ROOT_START + sector, &host.root[sector * SECTOR]);
+}
+
+static void file_make(host_file_t *f, const char *name, uint32_t size, uint32_t first, int image)
+{
+    uint32_t i;
+
+    memcpy(f->name, name, 11);
+    f->size = size;
+    f->clusters = (size + FAT_CLUSTER_SIZE - 1) / FAT_CLUSTER_SIZE;
+
+    for (i = 0; i < f->clusters; i++) {
+        f->chain[i] = first + i;
+    }
+
+    for (i = 0; i < size; i++) {
+        f->data[i] = rand();
+    }
+
+    /*only the first sector of an image may look like one*/
+    for (i = 0; i < size; i += SECTOR) {
+        f->data[i] = image && i == 0 ? IMG_MAGIC[0] : 0;
+    }
+
+    if (image) {
+        memcpy(f->data, IMG_MAGIC, 4);
+    }
+}
+
+static void file_fat(const host_file_t *f)
+{
+    uint32_t i;
+
+    for (i = 0; i < f->clusters; i++) {
+        host_fat_set(f->chain[i], (i + 1 < f->clusters) ? f->chain[i + 1] : FAT_EOC);
+    }
+
+    host_write_fat();
+}
+
+static void file_dir(uint32_t slot, const host_file_t *f)
+{
+    host_dir(slot, f->name, f->chain[0], f->size);
+}
+
+/* file sectors from to to, the last one padded */
+static void file_data(const host_file_t *f, uint32_t from, uint32_t to)
+{
+    uint8_t buf[SECTOR];
+    uint32_t i, len;
+
+    for (i = from; i < to; i++) {
+        len = f->size - i * SECTOR;
+        memset(buf, 0, sizeof(buf));
+        memcpy(buf, &f->data[i * SECTOR], (len > SECTOR) ? SECTOR : len);
+        bflb_eflash_loader_fat_write(fat_cluster_sector(f->chain[i / BFLB_EFLASH_LOADER_FAT_CLUSTER_SECTORS]) + i % BFLB_EFLASH_LOADER_FAT_CLUSTER_SECTORS, buf);
+    }
+}
+
+static uint32_t file_sectors(const host_file_t *f)
+{
+    return (f->size + SECTOR - 1) / SECTOR;
+}
+
+static void file_delete(uint32_t slot, const host_file_t *f)
+{
+    uint32_t sector = slot * DIR_ENTRY_SIZE / SECTOR;
+    uint32_t i;
+
+    host.root[slot * DIR_ENTRY_SIZE] = DIR_NAME_DELETED;
+    bflb_eflash_loader_fat_write(FAT_ROOT_START + sector, &host.root[sector * SECTOR]);
+
+    for (i = 0; i < f->clusters; i++) {
+        host_fat_set(f->chain[i], 0);
+    }
+
+    host_write_fat();
+}
+
+static int expect(eflash_loader_fat_state_t state, int32_t error, const host_file_t *f)
+{
+    uint8_t buf[SECTOR];
+    uint32_t i, len;
+    int bad = 0;
+
+    if (bflb_eflash_loader_fat_state() != state) {
+        printf("  state %d, expected %d\n", bflb_eflash_loader_fat_state(), state);
+        bad = 1;
+    }
+
+    if (sink.aborted != error) {
+        printf("  aborted with 0x%04x, expected 0x%04x\n", (unsigned)sink.aborted, (unsigned)error);
+        bad = 1;
+    }
+
+    if (sink.bad_offsets) {
+        printf("  %u writes out of order\n", sink.bad_offsets);
+        bad = 1;
+    }
+
+    if (state != EFLASH_LOADER_FAT_DONE) {
+        return bad;
+    }
+
+    if (sink.finished != f->size || memcmp(sink.image, f->data, f->size) != 0) {
+        printf("  image of %u bytes, expected %u\n", sink.finished, f->size);
+        return 1;
+    }
+
+    /*what the host reads back is the image*/
+    for (i = 0; i < file_sectors(f); i++) {
+        len = f->size - i * SECTOR;
+        len = (len > SECTOR) ? SECTOR : len;
+        bflb_eflash_loader_fat_read(fat_cluster_sector(f->chain[i / BFLB_EFLASH_LOADER_FAT_CLUSTER_SECTORS]) + i % BFLB_EFLASH_LOADER_FAT_CLUSTER_SECTORS, buf);
+
+        if (memcmp(buf, &f->data[i * SECTOR], len) != 0) {
+            printf("  sector %u of the image reads back wrong\n", i);
+            return 1;
+        }
+    }
+
+    return bad;
+}
+
+/* Windows */
+static int run_data_fat_dir(void)
+{
+    host_mount();
+    file_make(&img_a, "TRAIN   BIN", IMG_SIZE, 3, 1);
+    file_data(&img_a, 0, file_sectors(&img_a));
+    file_fat(&img_a);
+    file_dir(SLOT_IMAGE, &img_a);
+    return expect(EFLASH_LOADER_FAT_DONE, 0, &img_a);
+}
+
+static int run_fat_data_dir(void)
+{
+    host_mount();
+    file_make(&img_a, "TRAIN   BIN", IMG_SIZE, 3, 1);
+    file_fat(&img_a);
+    file_data(&img_a, 0, file_sectors(&img_a));
+    file_dir(SLOT_IMAGE, &img_a);
+    return expect(EFLASH_LOADER_FAT_DONE, 0, &img_a);
+}
+
+/* the size is known from the first sector on, the last one ends the image */
+static int run_fat_dir_data(void)
+{
+    host_mount();
+    file_make(&img_a, "TRAIN   BIN", IMG_SIZE, 3, 1);
+    file_fat(&img_a);
+    file_dir(SLOT_IMAGE, &img_a);
+    file_data(&img_a, 0, file_sectors(&img_a) - 1);
+
+    if (bflb_eflash_loader_fat_state() != EFLASH_LOADER_FAT_STREAM) {
+        printf("  ended before the last sector\n");
+        return 1;
+    }
+
+    file_data(&img_a, file_sectors(&img_a) - 1, file_sectors(&img_a));
+    return expect(EFLASH_LOADER_FAT_DONE, 0, &img_a);
+}
+
+/* the FAT goes first and steps around the cluster of a file written before */
+static int run_fat_around_other(void)
+{
+    host_mount();
+    file_make(&other, "README  TXT", 1000, 4, 0);
+    file_data(&other, 0, file_sectors(&other));
+    file_fat(&other);
+    file_dir(SLOT_OTHER, &other);
+
+    file_make(&img_a, "TRAIN   BIN", IMG_SIZE, 3, 1);
+    img_a.chain[1] = 5;
+    img_a.chain[2] = 6;
+    img_a.chain[3] = 7;
+    file_fat(&img_a);
+    file_data(&img_a, 0, file_sectors(&img_a));
+    file_dir(SLOT_IMAGE, &img_a);
+    return expect(EFLASH_LOADER_FAT_DONE, 0, &img_a);
+}
+
+/* the data of a file that is not one run of clusters cannot come before its FAT */
+static int run_data_around_other(void)
+{
+    host_mount();
+    file_make(&other, "README  TXT", 1000, 4, 0);
+    file_data(&other, 0, file_sectors(&other));
+    file_fat(&other);
+    file_dir(SLOT_OTHER, &other);
+
+    file_make(&img_a, "TRAIN   BIN", IMG_SIZE, 3, 1);
+    img_a.chain[1] = 5;
+    img_a.chain[2] = 6;
+    img_a.chain[3] = 7;
+    file_data(&img_a, 0, file_sectors(&img_a));
+    file_fat(&img_a);
+    file_dir(SLOT_IMAGE, &img_a);
+    return expect(EFLASH_LOADER_FAT_ERROR, BFLB_EFLASH_LOADER_FAT_FRAGMENTED_ERROR, NULL);
+}
+
+/* the FAT is updated while the file is written */
+static int run_fat_between_clusters(void)
+{
+    host_mount();
+    file_make(&img_a, "TRAIN   BIN", IMG_SIZE, 3, 1);
+    file_data(&img_a, 0, 2 * BFLB_EFLASH_LOADER_FAT_CLUSTER_SECTORS);
+    file_fat(&img_a);
+    file_data(&img_a, 2 * BFLB_EFLASH_LOADER_FAT_CLUSTER_SECTORS, file_sectors(&img_a));
+    file_dir(SLOT_IMAGE, &img_a);
+    return expect(EFLASH_LOADER_FAT_DONE, 0, &img_a);
+}
+
+static int run_fat_rechained(void)
+{
+    host_mount();
+    file_make(&img_a, "TRAIN   BIN", IMG_SIZE, 3, 1);
+    file_data(&img_a, 0, 2 * BFLB_EFLASH_LOADER_FAT_CLUSTER_SECTORS);
+    img_a.chain[1] = 9;
+    file_fat(&img_a);
+    return expect(EFLASH_LOADER_FAT_ERROR, BFLB_EFLASH_LOADER_FAT_FRAGMENTED_ERROR, NULL);
+}
+
+/* the entry ends the image, the FAT after it changes nothing */
+static int run_data_dir_fat(void)
+{
+    host_mount();
+    file_make(&img_a, "TRAIN   BIN", IMG_SIZE, 3, 1);
+    file_data(&img_a, 0, file_sectors(&img_a));
+
+    if (bflb_eflash_loader_fat_state() != EFLASH_LOADER_FAT_STREAM) {
+        printf("  ended before the size was known\n");
+        return 1;
+    }
+
+    file_dir(SLOT_IMAGE, &img_a);
+
+    if (bflb_eflash_loader_fat_state() != EFLASH_LOADER_FAT_DONE) {
+        printf("  the entry did not end the image\n");
+        return 1;
+    }
+
+    file_fat(&img_a);
+    return expect(EFLASH_LOADER_FAT_DONE, 0, &img_a);
+}
+
+/* the host goes quiet before it writes the entry */
+static int run_data_quiet_dir(void)
+{
+    host_mount();
+    file_make(&img_a, "TRAIN   BIN", IMG_SIZE, 3, 1);
+    file_data(&img_a, 0, file_sectors(&img_a));
+    bflb_eflash_loader_fat_flush();
+
+    if (bflb_eflash_loader_fat_state() != EFLASH_LOADER_FAT_STREAM || sink.waits != 1) {
+        printf("  state %d after the flush, %u waits\n", bflb_eflash_loader_fat_state(), sink.waits);
+        return 1;
+    }
+
+    file_fat(&img_a);
+    file_dir(SLOT_IMAGE, &img_a);
+    return expect(EFLASH_LOADER_FAT_DONE, 0, &img_a);
+}
+
+/* created empty, sized after the data, then written again along with a macOS ._ file */
+static int run_entry_rewritten(void)
+{
+    host_mount();
+    file_make(&img_a, "TRAIN   BIN", IMG_SIZE, 3, 1);
+    host_dir(SLOT_IMAGE, img_a.name, 0, 0);
+    file_data(&img_a, 0, file_sectors(&img_a));
+    file_fat(&img_a);
+    file_dir(SLOT_IMAGE, &img_a);
+    file_dir(SLOT_IMAGE, &img_a);
+
+    file_make(&other, "_TRAIN~1BIN", 4096, 3 + img_a.clusters, 0);
+    host_dir(SLOT_OTHER, other.name, 0, 0);
+    file_data(&other, 0, file_sectors(&other));
+    file_fat(&other);
+    file_dir(SLOT_OTHER, &other);
+
+    if (sink.finishes != 1) {
+        printf("  %u finishes\n", sink.finishes);
+        return 1;
+    }
+
+    return expect(EFLASH_LOADER_FAT_DONE, 0, &img_a);
+}
+
+/* the second image takes the clusters and the entry of the first */
+static int run_image_replaced(void)
+{
+    host_mount();
+    file_make(&img_a, "TRAIN   BIN", IMG_SIZE, 3, 1);
+    file_data(&img_a, 0, file_sectors(&img_a));
+    file_fat(&img_a);
+    file_dir(SLOT_IMAGE, &img_a);
+
+    if (expect(EFLASH_LOADER_FAT_DONE, 0, &img_a)) {
+        return 1;
+    }
+
+    file_delete(SLOT_IMAGE, &img_a);
+    file_make(&img_b, "TRAIN   BIN", 2 * FAT_CLUSTER_SIZE, 3, 1);
+    file_data(&img_b, 0, file_sectors(&img_b));
+    file_fat(&img_b);
+    file_dir(SLOT_IMAGE, &img_b);
+
+    if (sink.finishes != 2) {
+        printf("  %u finishes\n", sink.finishes);
+        return 1;
+    }
+
+    return expect(EFLASH_LOADER_FAT_DONE, 0, &img_b);
+}
+
+static int run_sector_again(void)
+{
+    host_mount();
+    file_make(&img_a, "TRAIN   BIN", IMG_SIZE, 3, 1);
+    file_data(&img_a, 0, 3);
+    file_data(&img_a, 1, file_sectors(&img_a));
+    file_fat(&img_a);
+    file_dir(SLOT_IMAGE, &img_a);
+    return expect(EFLASH_LOADER_FAT_DONE, 0, &img_a);
+}
+
+static int run_sector_changed(void)
+{
+    host_mount();
+    file_make(&img_a, "TRAIN   BIN", IMG_SIZE, 3, 1);
+    file_data(&img_a, 0, 3);
+    img_a.data[SECTOR + 7] ^= 0xff;
+    file_data(&img_a, 1, 2);
+    return expect(EFLASH_LOADER_FAT_ERROR, BFLB_EFLASH_LOADER_FAT_REWRITE_ERROR, NULL);
+}
+
+static int run_skip_ahead(void)
+{
+    host_mount();
+    file_make(&img_a, "TRAIN   BIN", IMG_SIZE, 3, 1);
+    file_data(&img_a, 0, 1);
+    file_data(&img_a, 2, 3);
+    return expect(EFLASH_LOADER_FAT_ERROR, BFLB_EFLASH_LOADER_FAT_ORDER_ERROR, NULL);
+}
+
+static int run_too_large(void)
+{
+    host_mount();
+    file_make(&img_a, "TRAIN   BIN", FAT_CLUSTER_SIZE, 3, 1);
+    file_data(&img_a, 0, file_sectors(&img_a));
+    host_dir(SLOT_IMAGE, img_a.name, 3, FILE_MAX + 1);
+    return expect(EFLASH_LOADER_FAT_ERROR, BFLB_EFLASH_LOADER_FAT_SIZE_ERROR, NULL);
+}
+
+static const struct {
+    const char *name;
+    int (*run)(void);
+} runs[] = {
+    { "data, FAT, entry", run_data_fat_dir },
+    { "FAT, data, entry", run_fat_data_dir },
+    { "FAT, entry, data", run_fat_dir_data },
+    { "FAT first around another file", run_fat_around_other },
+    { "data first around another file", run_data_around_other },
+    { "FAT between clusters", run_fat_between_clusters },
+    { "FAT rechained", run_fat_rechained },
+    { "data, entry, FAT", run_data_dir_fat },
+    { "data, quiet, FAT, entry", run_data_quiet_dir },
+    { "entry rewritten", run_entry_rewritten },
+    { "image replaced", run_image_replaced },
+    { "sector written again", run_sector_again },
+    { "sector changed", run_sector_changed },
+    { "skip ahead", run_skip_ahead },
+    { "too large", run_too_large },
+};
+
+int main(void)
+{
+    int failed = 0;
+    unsigned i;
+
+    srand(1);
+
+    for (i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        printf("%s\n", runs[i].name);
+        if (runs[i].run() != 0) {
+            printf("  FAILED\n");
+            failed++;
+        }
+    }
+
+    printf("%u runs, %d failed\n", (unsigned)(sizeof(runs) / sizeof(runs[0])), failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,509 @@
+/*
+ * Host build of the flash HAL (drivers/bl702_driver/hal_drv/src/hal_flash.c) on a NOR
+ * model, for the write combine windows and the blank skipping erase.
+ *
+ * The model is a 2 MB part on which a program only clears bits. It splits programs
+ * into page commands like SFlash_Program() and erases like SFlash_Erase(): 64K and
+ * 32K blocks where aligned, sectors elsewhere. Time is charged per driver call, page
+ * command, programmed and read byte and erase. The figures are typical datasheet
+ * values of a 25Q series part and the XIP save/restore around a call, not
+ * measurements on the board.
+ *
+ * Checks, each one a run:
+ *  - random buffered writes, direct writes, erases, blank skipping erases and reads
+ *    against a shadow image;
+ *  - two writers with their own windows, interleaved;
+ *  - a program that lands while a blank check runs, which must not leave the sector
+ *    marked blank;
+ *  - no driver call and no erased map change with interrupts on, and no nested
+ *    cpu_global_irq_disable(), which does not nest on the chip.
+ * Then a 200 KB install in 256 byte chunks without a window and with 256 and 1024
+ * byte windows, and the erase of a 512 KB slot with and without blank skipping.
+ *
+ * hal_flash.c is included, so a run can forget the erased map like a reboot does.
+ *
+ *   gcc -O2 -I tools/flash/include -I drivers/bl702_driver/hal_drv/inc -I drivers/bl702_driver/hal_drv/src \
+ *       tools/flash/hal_flash_sim.c -o hal_flash_sim
+ *   ./hal_flash_sim
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal_flash.c"
+
+#define NOR_SIZE      (2 * 1024 * 1024)
+#define NOR_PAGE      256
+#define NOR_BLK32     (32 * 1024)
+#define NOR_BLK64     (64 * 1024)
+
+/* us */
+#define T_CALL        25.0     /* XIP state save and restore around a driver call */
+#define T_PAGE        30.0     /* page program command */
+#define T_PAGE_BYTE   1.5
+#define T_READ_BYTE   0.0625   /* quad read at 32 MHz */
+#define T_SECTOR      45000.0
+#define T_BLK32       120000.0
+#define T_BLK64       150000.0
+
+static uint8_t nor[NOR_SIZE];
+static uint8_t shadow[NOR_SIZE];
+static double nor_us;
+
+static struct {
+    uint32_t irq_on_calls;   /* driver calls or map changes with interrupts on */
+    uint32_t irq_nested;
+    uint32_t dirty_bytes;    /* programs that needed an erase first */
+    uint32_t reads;
+    uint32_t erases[3];      /* sector, 32K, 64K */
+} model;
+
+static int irq_off;
+
+/* a task switch when interrupts come back on, after the given number of reads */
+static void (*preempt_hook)(void);
+static uint32_t preempt_after_reads;
+
+void cpu_global_irq_disable(void)
+{
+    if (irq_off) {
+        model.irq_nested++;
+    }
+    irq_off = 1;
+}
+
+void cpu_global_irq_enable(void)
+{
+    void (*hook)(void) = preempt_hook;
+
+    irq_off = 0;
+
+    if (hook && model.reads >= preempt_after_reads) {
+        preempt_hook = NULL;
+        hook();
+    }
+}
+
+static void driver_call(void)
+{
+    if (!irq_off) {
+        model.irq_on_calls++;
+    }
+    nor_us += T_CALL;
+}
+
+static int nor_range(uint32_t addr, uint32_t len)
+{
+    if (addr >= NOR_SIZE || len > NOR_SIZE - addr) {
+        printf("  access out of the part: 0x%08x + %u\n", addr, len);
+        exit(2);
+    }
+    return 1;
+}
+
+BL_Err_Type XIP_SFlash_Read_Need_Lock(SPI_Flash_Cfg_Type *pFlashCfg, SF_Ctrl_IO_Type ioMode, uint32_t addr,
+                                      uint8_t *data, uint32_t len)
+{
+    driver_call();
+    nor_range(addr, len);
+    memcpy(data, nor + addr, len);
+    nor_us += len * T_READ_BYTE;
+    model.reads++;
+    return SUCCESS;
+}
+
+BL_Err_Type XIP_SFlash_Write_Need_Lock(SPI_Flash_Cfg_Type *pFlashCfg, SF_Ctrl_IO_Type ioMode, uint32_t addr,
+                                       uint8_t *data, uint32_t len)
+{
+    uint32_t i, n;
+
+    driver_call();
+    nor_range(addr, len);
+
+    while (len > 0) {
+        n = pFlashCfg->pageSize - addr % pFlashCfg->pageSize;
+        n = n < len ? n : len;
+        nor_us += T_PAGE + n * T_PAGE_BYTE;
+
+        for (i = 0; i < n; i++) {
+            if ((nor[addr + i] & data[i]) != data[i]) {
+                model.dirty_bytes++;
+            }
+            nor[addr + i] &= data[i];
+        }
+
+        addr += n;
+        data += n;
+        len -= n;
+    }
+
+    return SUCCESS;
+}
+
+BL_Err_Type XIP_SFlash_Erase_Need_Lock(SPI_Flash_Cfg_Type *pFlashCfg, SF_Ctrl_IO_Type ioMode, uint32_t startaddr,
+                                       uint32_t endaddr)
+{
+    uint32_t sector = pFlashCfg->sectorSize * 1024;
+    uint32_t len, erase_len;
+
+    driver_call();
+
+    /* SFlash_Erase() */
+    while (startaddr <= endaddr) {
+        len = endaddr - startaddr + 1;
+
+        if ((startaddr & (NOR_BLK64 - 1)) == 0 && len > NOR_BLK64 - sector) {
+            erase_len = NOR_BLK64;
+            nor_us += T_BLK64;
+            model.erases[2]++;
+        } else if ((startaddr & (NOR_BLK32 - 1)) == 0 && len > NOR_BLK32 - sector) {
+            erase_len = NOR_BLK32;
+            nor_us += T_BLK32;
+            model.erases[1]++;
+        } else {
+            startaddr &= ~(sector - 1);
+            erase_len = sector;
+            nor_us += T_SECTOR;
+            model.erases[0]++;
+        }
+
+        nor_range(startaddr, erase_len);
+        memset(nor + startaddr, 0xff, erase_len);
+        startaddr += erase_len;
+    }
+
+    return SUCCESS;
+}
+
+/* the rest of the driver hal_flash.c links against, unused here */
+void L1C_Cache_Enable_Set(uint8_t wayDisable) {}
+void L1C_Cache_Flush_Ext(void) {}
+void L1C_Set_Wrap(BL_Fun_Type wrapDis) {}
+void SF_Ctrl_Set_Owner(SF_Ctrl_Owner_Type owner) {}
+void SF_Ctrl_Set_Flash_Image_Offset(uint32_t addrOffset) {}
+BL_Err_Type SF_Cfg_Get_Flash_Cfg_Need_Lock_Ext(uint32_t flashID, SPI_Flash_Cfg_Type *pFlashCfg) { return ERROR; }
+BL_Err_Type SFlash_Qspi_Enable(SPI_Flash_Cfg_Type *flashCfg) { return SUCCESS; }
+void SFlash_SetBurstWrap(SPI_Flash_Cfg_Type *flashCfg) {}
+void SFlash_GetJedecId(SPI_Flash_Cfg_Type *flashCfg, uint8_t *data) { memset(data, 0, 4); }
+BL_Err_Type SFlash_Reset_Continue_Read(SPI_Flash_Cfg_Type *flashCfg) { return SUCCESS; }
+BL_Err_Type SFlash_Read(SPI_Flash_Cfg_Type *flashCfg, SF_Ctrl_IO_Type ioMode, uint8_t contRead, uint32_t addr,
+                        uint8_t *data, uint32_t len) { return ERROR; }
+BL_Err_Type SFlash_Cache_Read_Enable(SPI_Flash_Cfg_Type *flashCfg, SF_Ctrl_IO_Type ioMode, uint8_t contRead,
+                                     uint8_t wayDisable) { return SUCCESS; }
+void XIP_SFlash_Opt_Enter(void) {}
+void XIP_SFlash_Opt_Exit(void) {}
+BL_Err_Type XIP_SFlash_State_Save(SPI_Flash_Cfg_Type *pFlashCfg, uint32_t *offset) { return SUCCESS; }
+BL_Err_Type XIP_SFlash_State_Restore(SPI_Flash_Cfg_Type *pFlashCfg, SF_Ctrl_IO_Type ioMode, uint32_t offset) { return SUCCESS; }
+BL_Err_Type XIP_SFlash_GetJedecId_Need_Lock(SPI_Flash_Cfg_Type *pFlashCfg, SF_Ctrl_IO_Type ioMode, uint8_t *data) { return ERROR; }
+BL_Err_Type XIP_SFlash_Read_Via_Cache_Need_Lock(uint32_t addr, uint8_t *data, uint32_t len) { return ERROR; }
+BL_Err_Type XIP_SFlash_Clear_Status_Register_Need_Lock(SPI_Flash_Cfg_Type *pFlashCfg) { return ERROR; }
+BL_Err_Type XIP_SFlash_KH25V40_Write_Protect_Need_Lock(SPI_Flash_Cfg_Type *pFlashCfg,
+                                                      SFlash_Protect_Kh25v40_Type protect) { return ERROR; }
+
+/* the erased map is RAM, a reboot forgets it */
+static void sim_reboot(void)
+{
+    memset(g_flash_erased_map, 0, sizeof(g_flash_erased_map));
+    g_flash_program_seq = 0;
+    memset(&g_flash_cfg, 0, sizeof(g_flash_cfg));
+    g_flash_cfg.ioMode = SF_CTRL_QIO_MODE;
+    g_flash_cfg.pageSize = NOR_PAGE;
+    g_flash_cfg.sectorSize = FLASH_SECTOR_SIZE / 1024;
+    g_flash_cfg.blk32EraseCmd = 0x52;
+    g_flash_cfg.blk64EraseCmd = 0xd8;
+}
+
+static void fill_random(uint8_t *buf, uint32_t len)
+{
+    while (len--) {
+        *buf++ = rand();
+    }
+}
+
+static int check_region(const char *what, uint32_t addr, uint32_t len)
+{
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        if (nor[addr + i] != shadow[addr + i]) {
+            printf("  %s: 0x%08x is %02x, wrote %02x\n", what, addr + i, nor[addr + i], shadow[addr + i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void shadow_program(uint32_t addr, const uint8_t *data, uint32_t len)
+{
+    while (len--) {
+        shadow[addr++] &= *data++;
+    }
+}
+
+static void shadow_erase(uint32_t addr, uint32_t len)
+{
+    uint32_t first = addr / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE;
+    uint32_t end = (addr + len - 1) / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE + FLASH_SECTOR_SIZE;
+
+    memset(shadow + first, 0xff, end - first);
+}
+
+#define FUZZ_SIZE (256 * 1024)
+#define FUZZ_OPS  20000
+
+/* buffered streams that jump now and then, direct writes, both erases and reads against the shadow */
+static int run_random(void)
+{
+    static uint8_t window[1024] __attribute__((aligned(4)));
+    static uint8_t data[3000];
+    flash_write_buf_t wbuf;
+    uint32_t cursor = 0, addr, len, op;
+    int i;
+
+    /* an old image, partly blank, the map knows nothing */
+    fill_random(nor, FUZZ_SIZE);
+    memset(nor + FUZZ_SIZE / 2, 0xff, FUZZ_SIZE / 4);
+    memcpy(shadow, nor, FUZZ_SIZE);
+    flash_write_buf_init(&wbuf, window, sizeof(window));
+
+    for (i = 0; i < FUZZ_OPS; i++) {
+        op = rand() % 100;
+
+        if (op < 60) {
+            if (rand() % 8 == 0) {
+                cursor = rand() % FUZZ_SIZE;
+            }
+            len = 1 + rand() % (rand() % 4 ? 300 : sizeof(data));
+            if (len > FUZZ_SIZE - cursor) {
+                cursor = 0;
+            }
+            fill_random(data, len);
+            /* mostly set bits, so programs keep clearing something */
+            data[0] &= 0x7f;
+            if (flash_write_buffered(&wbuf, cursor, data, len) != SUCCESS) {
+                return -1;
+            }
+            shadow_program(cursor, data, len);
+            cursor += len;
+        } else if (op < 70) {
+            addr = rand() % FUZZ_SIZE;
+            len = 1 + rand() % 600;
+            len = len < FUZZ_SIZE - addr ? len : FUZZ_SIZE - addr;
+            fill_random(data, len);
+            flash_write(addr, data, len);
+            shadow_program(addr, data, len);
+        } else if (op < 85) {
+            addr = rand() % FUZZ_SIZE;
+            len = 1 + rand() % (op < 78 ? 8192 : 96 * 1024);
+            len = len < FUZZ_SIZE - addr ? len : FUZZ_SIZE - addr;
+            /* the caller flushes before erasing what it wrote */
+            flash_write_flush(&wbuf);
+            if ((op & 1 ? flash_erase_skip_blank(addr, len) : flash_erase(addr, len)) != SUCCESS) {
+                return -1;
+            }
+            shadow_erase(addr, len);
+        } else {
+            addr = rand() % FUZZ_SIZE;
+            len = 1 + rand() % sizeof(data);
+            len = len < FUZZ_SIZE - addr ? len : FUZZ_SIZE - addr;
+            flash_write_flush(&wbuf);
+            flash_read(addr, data, len);
+            if (memcmp(data, shadow + addr, len) != 0) {
+                printf("  read 0x%08x + %u differs\n", addr, len);
+                return -1;
+            }
+        }
+    }
+
+    flash_write_flush(&wbuf);
+    printf("  %d operations, %u reads, %u sectors erased, %u skipped as blank\n", FUZZ_OPS, model.reads,
+           g_flash_stats.erase_sectors, g_flash_stats.erase_skipped);
+    return check_region("random", 0, FUZZ_SIZE);
+}
+
+/* two writers with their own windows interleaved, each still combined into whole pages */
+static int run_two_writers(void)
+{
+    static uint8_t window_a[1024] __attribute__((aligned(4)));
+    static uint8_t window_b[256] __attribute__((aligned(4)));
+    static uint8_t data[300];
+    flash_write_buf_t a, b;
+    uint32_t addr_a = 320 * 1024, addr_b = 400 * 1024 + 100, len;
+    uint32_t end_a = addr_a + 64 * 1024;
+    uint32_t programs;
+
+    flash_erase(addr_a, 160 * 1024);
+    shadow_erase(addr_a, 160 * 1024);
+    flash_write_buf_init(&a, window_a, sizeof(window_a));
+    flash_write_buf_init(&b, window_b, sizeof(window_b));
+    flash_clear_stats();
+
+    while (addr_a < end_a) {
+        len = 1 + rand() % sizeof(data);
+        len = len < end_a - addr_a ? len : end_a - addr_a;
+        fill_random(data, len);
+        flash_write_buffered(&a, addr_a, data, len);
+        shadow_program(addr_a, data, len);
+        addr_a += len;
+
+        fill_random(data, 200);
+        flash_write_buffered(&b, addr_b, data, 200);
+        shadow_program(addr_b, data, 200);
+        addr_b += 200;
+    }
+
+    flash_write_flush(&a);
+    flash_write_flush(&b);
+
+    /* a: 64 windows; b: one program per 256 byte window it fills, plus the partial ends */
+    programs = 64 + (addr_b - (400 * 1024 + 100) + 255) / 256 + 1;
+    printf("  %u writes, %u programs, %u page programs\n", g_flash_stats.write_calls, g_flash_stats.program_calls,
+           g_flash_stats.page_programs);
+    if (g_flash_stats.program_calls > programs) {
+        printf("  expected at most %u programs\n", programs);
+        return -1;
+    }
+
+    return check_region("two writers", 320 * 1024, 160 * 1024);
+}
+
+#define RACE_ADDR (480 * 1024)
+
+static void race_program(void)
+{
+    uint8_t x = 0x5a;
+
+    /* another task writes the part of the sector the check has already read */
+    flash_write(RACE_ADDR + 100, &x, 1);
+    shadow_program(RACE_ADDR + 100, &x, 1);
+}
+
+/* a program in the middle of a blank check must not leave the sector marked blank */
+static int run_race(void)
+{
+    sim_reboot();
+    memset(nor + RACE_ADDR, 0xff, FLASH_SECTOR_SIZE);
+    memset(shadow + RACE_ADDR, 0xff, FLASH_SECTOR_SIZE);
+
+    preempt_after_reads = model.reads + 4;
+    preempt_hook = race_program;
+
+    /* races with the write either way, the sector read blank when it was checked */
+    flash_erase_skip_blank(RACE_ADDR, FLASH_SECTOR_SIZE);
+
+    if (preempt_hook != NULL) {
+        printf("  the blank check never let the other task run\n");
+        return -1;
+    }
+
+    /* this one has to look again and erase */
+    flash_erase_skip_blank(RACE_ADDR, FLASH_SECTOR_SIZE);
+    shadow_erase(RACE_ADDR, FLASH_SECTOR_SIZE);
+
+    return check_region("race", RACE_ADDR, FLASH_SECTOR_SIZE);
+}
+
+#define INSTALL_ADDR (1024 * 1024)
+#define INSTALL_SIZE (200 * 1024)
+#define INSTALL_CHUNK 256
+
+/* boot2 writing an image in 256 byte chunks, erase not counted */
+static void bench_install(uint32_t window_size, uint32_t offset)
+{
+    static uint8_t window[1024] __attribute__((aligned(4)));
+    static uint8_t image[INSTALL_SIZE];
+    flash_write_buf_t wbuf;
+    uint32_t done;
+
+    flash_erase(INSTALL_ADDR, 256 * 1024);
+    fill_random(image, sizeof(image));
+    flash_write_buf_init(&wbuf, window_size ? window : NULL, window_size);
+    flash_clear_stats();
+    nor_us = 0;
+
+    for (done = 0; done < INSTALL_SIZE; done += INSTALL_CHUNK) {
+        flash_write_buffered(&wbuf, INSTALL_ADDR + offset + done, image + done, INSTALL_CHUNK);
+    }
+    flash_write_flush(&wbuf);
+
+    printf("  window %4u, dest %s: %4u programs, %4u page programs, %6.1f ms, %.2f MB/s%s\n", window_size,
+           offset ? "+100   " : "aligned", g_flash_stats.program_calls, g_flash_stats.page_programs, nor_us / 1000,
+           INSTALL_SIZE / nor_us, memcmp(nor + INSTALL_ADDR + offset, image, INSTALL_SIZE) ? ", CONTENT WRONG" : "");
+}
+
+#define SLOT_ADDR (1024 * 1024)
+#define SLOT_SIZE (512 * 1024)
+
+/* the OTA slot after a reboot, the first used_kb of it holding an old image */
+static void bench_erase(uint32_t used_kb, int skip_blank)
+{
+    uint32_t i;
+
+    memset(nor + SLOT_ADDR, 0xff, SLOT_SIZE);
+    fill_random(nor + SLOT_ADDR, used_kb * 1024);
+    sim_reboot();
+    flash_clear_stats();
+    memset(model.erases, 0, sizeof(model.erases));
+    nor_us = 0;
+
+    (skip_blank ? flash_erase_skip_blank : flash_erase)(SLOT_ADDR, SLOT_SIZE);
+
+    for (i = 0; i < SLOT_SIZE && nor[SLOT_ADDR + i] == 0xff; i++) {
+    }
+
+    printf("  %3u KB used, %-16s: %3u sectors, %2u skipped, erases %u/%u/%u (4K/32K/64K), %6.1f ms%s\n", used_kb,
+           skip_blank ? "skip blank" : "flash_erase", g_flash_stats.erase_sectors, g_flash_stats.erase_skipped,
+           model.erases[0], model.erases[1], model.erases[2], nor_us / 1000, i < SLOT_SIZE ? ", NOT BLANK" : "");
+}
+
+static const struct {
+    const char *name;
+    int (*run)(void);
+} runs[] = {
+    { "random", run_random },
+    { "two writers", run_two_writers },
+    { "blank check race", run_race },
+};
+
+int main(void)
+{
+    int failed = 0;
+    unsigned i;
+
+    srand(1);
+    memset(nor, 0xff, sizeof(nor));
+    memset(shadow, 0xff, sizeof(shadow));
+    sim_reboot();
+
+    for (i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        printf("%s\n", runs[i].name);
+        if (runs[i].run() != 0) {
+            printf("  FAILED\n");
+            failed++;
+        }
+    }
+
+    printf("interrupts: %u driver calls with interrupts on, %u nested disables\n", model.irq_on_calls,
+           model.irq_nested);
+    if (model.irq_on_calls || model.irq_nested || irq_off) {
+        printf("  FAILED\n");
+        failed++;
+    }
+
+    printf("install, %u KB in %u byte chunks\n", INSTALL_SIZE / 1024, INSTALL_CHUNK);
+    bench_install(0, 0);
+    bench_install(0, 100);
+    bench_install(256, 0);
+    bench_install(256, 100);
+    bench_install(1024, 0);
+    bench_install(1024, 100);
+
+    printf("erase of a %u KB slot\n", SLOT_SIZE / 1024);
+    bench_erase(256, 0);
+    bench_erase(256, 1);
+    bench_erase(500, 0);
+    bench_erase(500, 1);
+
+    printf("%u runs, %d failed\n", (unsigned)(sizeof(runs) / sizeof(runs[0])) + 1, failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,27 @@
+/*
+ * Host stand-in for drivers/bl702_driver/std_drv/inc/bl702_common.h, the types
+ * hal_common.h and hal_flash.c use, see tools/flash/hal_flash_sim.c.
+ */
+#ifndef __BL702_COMMON_H__
+#define __BL702_COMMON_H__
+
+#include <stdint.h>
+#include <string.h>
+
+typedef enum {
+    SUCCESS = 0,
+    ERROR = 1,
+    TIMEOUT = 2,
+} BL_Err_Type;
+
+typedef enum {
+    DISABLE = 0,
+    ENABLE = 1,
+} BL_Fun_Type;
+
+#define ATTR_TCM_SECTION
+
+#define arch_memcpy memcpy
+#define arch_memset memset
+
+#endif
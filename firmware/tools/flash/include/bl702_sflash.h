@@ -0,0 +1,74 @@
+/*
+ * Host stand-in for the flash driver headers hal_flash.c includes
+ * (bl702_sflash.h, bl702_xip_sflash.h, bl702_sf_cfg.h and their _ext, bl702_glb.h):
+ * the config fields and functions hal_flash.c uses, copied from there.
+ * tools/flash/hal_flash_sim.c implements them on a NOR model.
+ */
+#ifndef __BL702_SFLASH_H__
+#define __BL702_SFLASH_H__
+
+#include "bl702_common.h"
+
+#define BFLB_SPIFLASH_CMD_INVALID 0xff
+
+typedef enum {
+    SF_CTRL_NIO_MODE, /*!< Normal IO mode define */
+    SF_CTRL_DO_MODE,  /*!< Dual Output mode define */
+    SF_CTRL_QO_MODE,  /*!< Quad Output mode define */
+    SF_CTRL_DIO_MODE, /*!< Dual IO mode define */
+    SF_CTRL_QIO_MODE, /*!< Quad IO mode define */
+} SF_Ctrl_IO_Type;
+
+typedef enum {
+    SF_CTRL_OWNER_SAHB, /*!< System AHB bus control serial flash controller */
+    SF_CTRL_OWNER_IAHB, /*!< I-Code AHB bus control serial flash controller */
+} SF_Ctrl_Owner_Type;
+
+typedef enum {
+    SFLASH_KH25V40_PROTECT_NONE, /*!< SFlash no protect */
+} SFlash_Protect_Kh25v40_Type;
+
+typedef struct
+{
+    uint8_t ioMode;        /*!< Serail flash interface mode,bit0-3:IF mode,bit4:unwrap */
+    uint8_t cReadSupport;  /*!< Support continuous read mode,bit0:continuous read mode support,bit1:read mode cfg */
+    uint8_t clkDelay;      /*!< SPI clock delay,bit0-3:delay,bit4-6:pad delay */
+    uint8_t clkInvert;     /*!< SPI clock phase invert,bit0:clck invert,bit1:rx invert,bit2-4:pad delay,bit5-7:pad delay */
+    uint8_t mid;           /*!< Manufacturer ID */
+    uint16_t pageSize;     /*!< Page size */
+    uint8_t sectorSize;    /*!< Sector size in KB */
+    uint8_t blk32EraseCmd; /*!< Block 32K erase command */
+    uint8_t blk64EraseCmd; /*!< Block 64K erase command */
+} SPI_Flash_Cfg_Type;
+
+void L1C_Cache_Enable_Set(uint8_t wayDisable);
+void L1C_Cache_Flush_Ext(void);
+void L1C_Set_Wrap(BL_Fun_Type wrapDis);
+void SF_Ctrl_Set_Owner(SF_Ctrl_Owner_Type owner);
+void SF_Ctrl_Set_Flash_Image_Offset(uint32_t addrOffset);
+BL_Err_Type SF_Cfg_Get_Flash_Cfg_Need_Lock_Ext(uint32_t flashID, SPI_Flash_Cfg_Type *pFlashCfg);
+BL_Err_Type SFlash_Qspi_Enable(SPI_Flash_Cfg_Type *flashCfg);
+void SFlash_SetBurstWrap(SPI_Flash_Cfg_Type *flashCfg);
+void SFlash_GetJedecId(SPI_Flash_Cfg_Type *flashCfg, uint8_t *data);
+BL_Err_Type SFlash_Reset_Continue_Read(SPI_Flash_Cfg_Type *flashCfg);
+BL_Err_Type SFlash_Read(SPI_Flash_Cfg_Type *flashCfg, SF_Ctrl_IO_Type ioMode, uint8_t contRead, uint32_t addr,
+                        uint8_t *data, uint32_t len);
+BL_Err_Type SFlash_Cache_Read_Enable(SPI_Flash_Cfg_Type *flashCfg, SF_Ctrl_IO_Type ioMode, uint8_t contRead,
+                                     uint8_t wayDisable);
+void XIP_SFlash_Opt_Enter(void);
+void XIP_SFlash_Opt_Exit(void);
+BL_Err_Type XIP_SFlash_State_Save(SPI_Flash_Cfg_Type *pFlashCfg, uint32_t *offset);
+BL_Err_Type XIP_SFlash_State_Restore(SPI_Flash_Cfg_Type *pFlashCfg, SF_Ctrl_IO_Type ioMode, uint32_t offset);
+BL_Err_Type XIP_SFlash_GetJedecId_Need_Lock(SPI_Flash_Cfg_Type *pFlashCfg, SF_Ctrl_IO_Type ioMode, uint8_t *data);
+BL_Err_Type XIP_SFlash_Read_Via_Cache_Need_Lock(uint32_t addr, uint8_t *data, uint32_t len);
+BL_Err_Type XIP_SFlash_Read_Need_Lock(SPI_Flash_Cfg_Type *pFlashCfg, SF_Ctrl_IO_Type ioMode, uint32_t addr,
+                                      uint8_t *data, uint32_t len);
+BL_Err_Type XIP_SFlash_Write_Need_Lock(SPI_Flash_Cfg_Type *pFlashCfg, SF_Ctrl_IO_Type ioMode, uint32_t addr,
+                                       uint8_t *data, uint32_t len);
+BL_Err_Type XIP_SFlash_Erase_Need_Lock(SPI_Flash_Cfg_Type *pFlashCfg, SF_Ctrl_IO_Type ioMode, uint32_t startaddr,
+                                       uint32_t endaddr);
+BL_Err_Type XIP_SFlash_Clear_Status_Register_Need_Lock(SPI_Flash_Cfg_Type *pFlashCfg);
+BL_Err_Type XIP_SFlash_KH25V40_Write_Protect_Need_Lock(SPI_Flash_Cfg_Type *pFlashCfg,
+                                                      SFlash_Protect_Kh25v40_Type protect);
+
+#endif
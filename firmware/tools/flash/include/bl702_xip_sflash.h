@@ -0,0 +1,2 @@
+/* host stand-in, see bl702_sflash.h */
+#include "bl702_sflash.h"
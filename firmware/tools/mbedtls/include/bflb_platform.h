@@ -0,0 +1,27 @@
+/*
+ * Host stand-in for bsp/bsp_common/platform/bflb_platform.h and the parts of
+ * common/misc/misc.h the mbedTLS port uses, see tools/mbedtls/mbedtls_kat.c.
+ */
+#ifndef __BFLB_PLATFORM_H__
+#define __BFLB_PLATFORM_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+typedef enum {
+    SUCCESS = 0,
+    ERROR = 1,
+    TIMEOUT = 2,
+} BL_Err_Type;
+
+#define MSG printf
+
+#define CHECK_PARAM(expr) assert(expr)
+
+#define arch_memcpy memcpy
+#define arch_memset memset
+#define arch_memcmp memcmp
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * Host stand-in for drivers/bl702_driver/std_drv/inc/bl702_sec_eng.h: the
+ * types and the AES/SHA prototypes the mbedTLS port uses, copied from there.
+ * tools/mbedtls/sec_eng_model.c implements them.
+ */
+#ifndef __BL702_SEC_ENG_H__
+#define __BL702_SEC_ENG_H__
+
+#include "bflb_platform.h"
+
+typedef enum {
+    SEC_ENG_AES_ID0, /*!< AES0 port define */
+} SEC_ENG_AES_ID_Type;
+
+typedef enum {
+    SEC_ENG_SHA_ID0, /*!< SHA0 port define */
+} SEC_ENG_SHA_ID_Type;
+
+typedef enum {
+    SEC_ENG_SHA256,    /*!< SHA type:SHA256 */
+    SEC_ENG_SHA224,    /*!< SHA type:SHA224 */
+    SEC_ENG_SHA1,      /*!< SHA type:SHA1 */
+    SEC_ENG_SHA1_RSVD, /*!< SHA type:SHA1 */
+} SEC_ENG_SHA_Type;
+
+typedef enum {
+    SEC_ENG_AES_ECB, /*!< AES mode type:ECB */
+    SEC_ENG_AES_CTR, /*!< AES mode type:CTR */
+    SEC_ENG_AES_CBC, /*!< AES mode type:CBC */
+} SEC_ENG_AES_Type;
+
+typedef enum {
+    SEC_ENG_AES_KEY_128BITS,        /*!< AES KEY type:128 bits */
+    SEC_ENG_AES_KEY_256BITS,        /*!< AES KEY type:256 bits */
+    SEC_ENG_AES_KEY_192BITS,        /*!< AES KEY type:192 bits */
+    SEC_ENG_AES_DOUBLE_KEY_128BITS, /*!< AES double KEY type:128 bits */
+} SEC_ENG_AES_Key_Type;
+
+typedef enum {
+    SEC_ENG_AES_KEY_SW, /*!< AES KEY from software */
+    SEC_ENG_AES_KEY_HW, /*!< AES KEY from hardware */
+} SEC_ENG_AES_Key_Src_Type;
+
+typedef enum {
+    SEC_ENG_AES_ENCRYPTION, /*!< AES encryption */
+    SEC_ENG_AES_DECRYPTION, /*!< AES decryption */
+} SEC_ENG_AES_EnDec_Type;
+
+typedef struct
+{
+    uint32_t total[2];    /*!< Number of bytes processed */
+    uint32_t *shaBuf;     /*!< Data not processed but in this temp buffer */
+    uint32_t *shaPadding; /*!< Padding data */
+    uint32_t linkAddr;    /*!< Link configure address */
+} SEC_Eng_SHA256_Link_Ctx;
+
+typedef struct
+{
+    uint8_t aesFeed;       /*!< AES has feed data */
+    SEC_ENG_AES_Type mode; /*!< AES mode */
+} SEC_Eng_AES_Ctx;
+
+typedef struct
+{
+    uint32_t            : 2;  /*!< [1:0]reserved */
+    uint32_t shaMode    : 3;  /*!< [4:2]Sha-256/sha-224/sha-1/sha-1 */
+    uint32_t            : 1;  /*!< [5]reserved */
+    uint32_t shaHashSel : 1;  /*!< [6]New hash or accumulate last hash */
+    uint32_t            : 2;  /*!< [8:7]reserved */
+    uint32_t shaIntClr  : 1;  /*!< [9]Clear interrupt */
+    uint32_t shaIntSet  : 1;  /*!< [10]Set interrupt */
+    uint32_t            : 5;  /*!< [15:11]reserved */
+    uint32_t shaMsgLen  : 16; /*!< [31:16]Number of 512-bit block */
+    uint32_t shaSrcAddr;      /*!< Message source address */
+    uint32_t result[8];       /*!< Result of SHA */
+} __attribute__((aligned(4))) SEC_Eng_SHA_Link_Config_Type;
+
+void Sec_Eng_SHA_Enable_Link(SEC_ENG_SHA_ID_Type shaNo);
+void Sec_Eng_SHA_Disable_Link(SEC_ENG_SHA_ID_Type shaNo);
+void Sec_Eng_SHA256_Link_Init(SEC_Eng_SHA256_Link_Ctx *shaCtx, SEC_ENG_SHA_ID_Type shaNo, uint32_t linkAddr,
+                              uint32_t shaTmpBuf[16], uint32_t padding[16]);
+BL_Err_Type Sec_Eng_SHA256_Link_Update(SEC_Eng_SHA256_Link_Ctx *shaCtx, SEC_ENG_SHA_ID_Type shaNo,
+                                       const uint8_t *input, uint32_t len);
+BL_Err_Type Sec_Eng_SHA256_Link_Finish(SEC_Eng_SHA256_Link_Ctx *shaCtx, SEC_ENG_SHA_ID_Type shaNo,
+                                       uint8_t *hash);
+BL_Err_Type Sec_Eng_AES_Init(SEC_Eng_AES_Ctx *aesCtx, SEC_ENG_AES_ID_Type aesNo, SEC_ENG_AES_Type aesType,
+                             SEC_ENG_AES_Key_Type keyType, SEC_ENG_AES_EnDec_Type enDecType);
+void Sec_Eng_AES_Enable_BE(SEC_ENG_AES_ID_Type aesNo);
+void Sec_Eng_AES_Set_Key_IV_BE(SEC_ENG_AES_ID_Type aesNo, SEC_ENG_AES_Key_Src_Type keySrc, const uint8_t *key,
+                               const uint8_t *iv);
+BL_Err_Type Sec_Eng_AES_Crypt(SEC_Eng_AES_Ctx *aesCtx, SEC_ENG_AES_ID_Type aesNo, const uint8_t *in, uint32_t len,
+                              uint8_t *out);
+BL_Err_Type Sec_Eng_AES_Finish(SEC_ENG_AES_ID_Type aesNo);
+
+#endif
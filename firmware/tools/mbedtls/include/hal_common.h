@@ -0,0 +1,13 @@
+/*
+ * Host stand-in for drivers/bl702_driver/hal_drv/inc/hal_common.h, only the
+ * engine lock; the engine model checks it is held.
+ */
+#ifndef __HAL_COMMON_H__
+#define __HAL_COMMON_H__
+
+#include "bflb_platform.h"
+
+void sec_eng_lock(void);
+void sec_eng_unlock(void);
+
+#endif
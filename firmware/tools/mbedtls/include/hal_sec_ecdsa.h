@@ -0,0 +1,55 @@
+/*
+ * Host stand-in for drivers/bl702_driver/hal_drv/inc/hal_sec_ecdsa.h, the
+ * declarations are the same; tools/mbedtls/sec_eng_model.c implements the
+ * ones the mbedTLS port calls.
+ */
+#ifndef __HAL_SEC_ECDSA_H__
+#define __HAL_SEC_ECDSA_H__
+
+#include "hal_common.h"
+
+typedef enum {
+    ECP_SECP256R1 = 0,
+    ECP_SECP256K1 = 1,
+    ECP_TYPE_MAX = 2,
+} sec_ecp_type;
+
+typedef struct
+{
+    sec_ecp_type ecpId;
+    uint32_t *privateKey;
+    uint32_t *publicKeyx;
+    uint32_t *publicKeyy;
+} sec_ecdsa_handle_t;
+
+typedef struct
+{
+    sec_ecp_type ecpId;
+    /* a stepped scalar multiplication */
+    const uint8_t *scalar;
+    uint32_t bit;
+    uint32_t bits;
+} sec_ecdh_handle_t;
+
+int sec_ecdsa_init(sec_ecdsa_handle_t *handle, sec_ecp_type id);
+int sec_ecdsa_deinit(sec_ecdsa_handle_t *handle);
+int sec_ecdsa_sign(sec_ecdsa_handle_t *handle, const uint32_t *random_k, const uint32_t *hash, uint32_t hashLenInWord, uint32_t *r, uint32_t *s);
+int sec_ecdsa_verify(sec_ecdsa_handle_t *handle, const uint32_t *hash, uint32_t hashLen, const uint32_t *r, const uint32_t *s);
+int sec_ecdsa_get_private_key(sec_ecdsa_handle_t *handle, uint32_t *private_key);
+int sec_ecdsa_get_public_key(sec_ecdsa_handle_t *handle, const uint32_t *private_key, const uint32_t *pRx, const uint32_t *pRy);
+
+int sec_ecdh_init(sec_ecdh_handle_t *handle, sec_ecp_type id);
+int sec_ecdh_deinit(sec_ecdh_handle_t *handle);
+int sec_ecdh_get_encrypt_key(sec_ecdh_handle_t *handle, const uint32_t *pkX, const uint32_t *pkY, const uint32_t *private_key, const uint32_t *pRx, const uint32_t *pRy);
+int sec_ecdh_get_public_key(sec_ecdh_handle_t *handle, const uint32_t *private_key, const uint32_t *pRx, const uint32_t *pRy);
+/* the same multiplication a few scalar bits per step, the PKA holds the point in between;
+ * step returns the bits left, 0 when finish can read the result, or -1 */
+int sec_ecdh_scalar_point_start(sec_ecdh_handle_t *handle, const uint32_t *pkX, const uint32_t *pkY, const uint32_t *private_key);
+int sec_ecdh_scalar_point_step(sec_ecdh_handle_t *handle, uint32_t bits);
+int sec_ecdh_scalar_point_finish(sec_ecdh_handle_t *handle, uint32_t *pRx, uint32_t *pRy);
+int sec_ecc_get_random_value(uint32_t *randomData, uint32_t *maxRef, uint32_t size);
+int sec_eng_trng_enable(void);
+void sec_eng_trng_disable(void);
+int sec_eng_trng_read(uint8_t data[32]);
+
+#endif
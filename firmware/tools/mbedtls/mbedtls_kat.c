@@ -0,0 +1,419 @@
+/*
+ * Host known answer tests of the mbedTLS port (components/mbedtls/bflb_port) on a
+ * model of the security engine (sec_eng_model.c).
+ *
+ * The port sources and the mbedtls library build as they do for the chip, with
+ * stand-ins for the few BL702 headers they include (include/). The vectors are the
+ * published ones: FIPS 180-2 SHA-256/224, NIST SP 800-38A AES, SP 800-38C CCM and
+ * RFC 5903 P-256 ECDH. The data goes in the ways that take the other paths of the
+ * port: unaligned and odd sized input through the bounce buffers, CTR across the low
+ * word wrap of the engine's counter, CCM with short tags, secp256k1 which the model's
+ * PKA refuses, and ECDSA rejections confirmed in software. Every engine call must be
+ * made with sec_eng_lock() held, from word aligned addresses.
+ *
+ * The SHA engine gets 32 bit addresses, hence -no-pie and static SHA contexts and
+ * input; mbedtls_sha256_ret() with its context on the stack does not run here.
+ *
+ *   gcc -O2 -no-pie -I tools/mbedtls/include -I tools/mbedtls -I components/mbedtls/bflb_port/inc \
+ *       -I components/mbedtls/include -I components/mbedtls/library \
+ *       -I components/ble/ble_stack/common/tinycrypt/include/tinycrypt \
+ *       '-DMBEDTLS_CONFIG_FILE="mbedtls_bflb_config.h"' \
+ *       tools/mbedtls/mbedtls_kat.c tools/mbedtls/sec_eng_model.c \
+ *       components/mbedtls/bflb_port/src/bflb_{aes,ccm,sha256,ecp}.c \
+ *       components/mbedtls/library/{aes,sha256,bignum,ecp,ecp_curves,ecdh,ecdsa,asn1parse,asn1write,platform_util}.c \
+ *       components/ble/ble_stack/common/tinycrypt/source/{aes_encrypt,aes_decrypt,utils,ecc,ecc_dsa,ecc_platform_specific}.c \
+ *       -o mbedtls_kat
+ *   ./mbedtls_kat
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mbedtls/aes.h"
+#include "mbedtls/ccm.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/ecdh.h"
+#include "mbedtls/ecdsa.h"
+#include "sec_eng_model.h"
+
+static int failed;
+
+static void check(const char *name, int ok)
+{
+    printf("%-40s %s\n", name, ok ? "ok" : "FAIL");
+    failed += !ok;
+}
+
+static void hex(uint8_t *out, const char *s)
+{
+    while (s[0] && s[1]) {
+        sscanf(s, "%2hhx", out++);
+        s += 2;
+    }
+}
+
+/*
+ * SHA-256/224, FIPS 180-2 appendix B and the SHA-224 "abc" example
+ */
+static const char sha_448[] = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+
+static const struct {
+    const char *name;
+    const char *msg;
+    int is224;
+    const char *digest;
+} sha_kat[] = {
+    { "SHA-256 \"\"", "", 0, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+    { "SHA-256 \"abc\"", "abc", 0, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+    { "SHA-256 448 bits", sha_448, 0, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+    { "SHA-224 \"abc\"", "abc", 1, "23097d223405d8228642a477bda255b32aadbce4bda0b3f7e36c9da7" },
+};
+
+static const char sha_million_a[] = "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0";
+
+/* pieces of the million, each from a different alignment */
+static const uint32_t sha_pieces[] = { 1, 3, 63, 64, 65, 127, 1000, 1024, 1025, 4000 };
+
+static mbedtls_sha256_context sha_ctx, sha_clone;
+static uint8_t sha_msg[4096 + 4] __attribute__((aligned(4)));
+
+static void kat_sha256(void)
+{
+    uint8_t out[32], out2[32], expect[32];
+    char name[48];
+    uint32_t done, len, rest, piece, i;
+    unsigned k;
+
+    for (k = 0; k < sizeof(sha_kat) / sizeof(sha_kat[0]); k++) {
+        /* aligned copy, then the same from an odd address */
+        for (i = 0; i < 2; i++) {
+            memcpy(sha_msg + i, sha_kat[k].msg, strlen(sha_kat[k].msg));
+            mbedtls_sha256_init(&sha_ctx);
+            mbedtls_sha256_starts_ret(&sha_ctx, sha_kat[k].is224);
+            mbedtls_sha256_update_ret(&sha_ctx, sha_msg + i, strlen(sha_kat[k].msg));
+            mbedtls_sha256_finish_ret(&sha_ctx, out);
+            mbedtls_sha256_free(&sha_ctx);
+
+            hex(expect, sha_kat[k].digest);
+            snprintf(name, sizeof(name), "%s%s", sha_kat[k].name, i ? ", unaligned" : "");
+            check(name, !memcmp(out, expect, sha_kat[k].is224 ? 28 : 32));
+        }
+    }
+
+    /* a million 'a', cloned half way */
+    memset(sha_msg, 'a', sizeof(sha_msg));
+    mbedtls_sha256_init(&sha_ctx);
+    mbedtls_sha256_starts_ret(&sha_ctx, 0);
+
+    for (done = 0, i = 0; done < 1000000; done += len, i++) {
+        len = sha_pieces[i % (sizeof(sha_pieces) / sizeof(sha_pieces[0]))];
+        len = (len > 1000000 - done) ? 1000000 - done : len;
+        mbedtls_sha256_update_ret(&sha_ctx, sha_msg + (i & 3), len);
+
+        if (done < 500000 && done + len >= 500000) {
+            mbedtls_sha256_clone(&sha_clone, &sha_ctx);
+            for (rest = 1000000 - done - len; rest > 0; rest -= piece) {
+                piece = (rest > 4096) ? 4096 : rest;
+                mbedtls_sha256_update_ret(&sha_clone, sha_msg, piece);
+            }
+        }
+    }
+
+    mbedtls_sha256_finish_ret(&sha_ctx, out);
+    mbedtls_sha256_finish_ret(&sha_clone, out2);
+    hex(expect, sha_million_a);
+    check("SHA-256 a million 'a' in odd pieces", !memcmp(out, expect, 32));
+    check("SHA-256 a million 'a' cloned", !memcmp(out2, expect, 32));
+}
+
+/*
+ * AES-128, SP 800-38A F.1.1, F.2.1 and F.5.1
+ */
+static const char aes_key[] = "2b7e151628aed2a6abf7158809cf4f3c";
+static const char aes_pt[] = "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+                             "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710";
+static const char aes_ecb[] = "3ad77bb40d7a3660a89ecaf32466ef97f5d3d58503b9699de785895a96fdbaaf"
+                              "43b1cd7f598ece23881b00e3ed0306887b0c785e27e8ad3f8223207104725dd4";
+static const char aes_cbc_iv[] = "000102030405060708090a0b0c0d0e0f";
+static const char aes_cbc[] = "7649abac8119b246cee98e9b12e9197d5086cb9b507219ee95db113a917678b2"
+                              "73bed6b8e3c1743b7116e69e222295163ff1caa1681fac09120eca307586e1a7";
+static const char aes_ctr_iv[] = "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+static const char aes_ctr[] = "874d6191b620e3261bef6864990db6ce9806f66b7970fdff8617187bb9fffdff"
+                              "5ae4df3edbd5d35e5b4f09020db03eab1e031dda2fbe03d1792170a0f3009cee";
+
+/* 128 bit big endian counter, the reference for the engine's 32 bit one */
+static void ctr_ref(mbedtls_aes_context *aes, const uint8_t iv[16], const uint8_t *in, uint8_t *out, size_t len)
+{
+    uint8_t ctr[16], ks[16];
+    size_t i;
+    int j;
+
+    memcpy(ctr, iv, 16);
+
+    for (i = 0; i < len; i++) {
+        if ((i & 15) == 0) {
+            mbedtls_aes_crypt_ecb(aes, MBEDTLS_AES_ENCRYPT, ctr, ks);
+            for (j = 15; j >= 0 && ++ctr[j] == 0; j--) {
+            }
+        }
+        out[i] = in[i] ^ ks[i & 15];
+    }
+}
+
+static void kat_aes(void)
+{
+    static uint8_t big_in[4096 + 1], big_out[4096 + 1], big_ref[4096];
+    mbedtls_aes_context aes;
+    uint8_t key[16], pt[64], ct[64], iv[16], iv0[16], stream[16], buf[64 + 1];
+    size_t off, done, len;
+    unsigned i;
+
+    hex(key, aes_key);
+    hex(pt, aes_pt);
+    mbedtls_aes_init(&aes);
+    mbedtls_aes_setkey_enc(&aes, key, 128);
+
+    hex(ct, aes_ecb);
+    for (i = 0; i < 4; i++) {
+        mbedtls_aes_crypt_ecb(&aes, MBEDTLS_AES_ENCRYPT, pt + 16 * i, buf + 1 + 16 * i);
+    }
+    check("AES-128-ECB encrypt", !memcmp(buf + 1, ct, 64));
+    for (i = 0; i < 4; i++) {
+        mbedtls_aes_crypt_ecb(&aes, MBEDTLS_AES_DECRYPT, ct + 16 * i, buf + 16 * i);
+    }
+    check("AES-128-ECB decrypt", !memcmp(buf, pt, 64));
+
+    hex(ct, aes_cbc);
+    hex(iv, aes_cbc_iv);
+    mbedtls_aes_crypt_cbc(&aes, MBEDTLS_AES_ENCRYPT, 32, iv, pt, buf + 1);
+    mbedtls_aes_crypt_cbc(&aes, MBEDTLS_AES_ENCRYPT, 32, iv, pt + 32, buf + 33);
+    check("AES-128-CBC encrypt, chained, unaligned", !memcmp(buf + 1, ct, 64));
+    hex(iv, aes_cbc_iv);
+    memcpy(buf, ct, 64);
+    mbedtls_aes_crypt_cbc(&aes, MBEDTLS_AES_DECRYPT, 64, iv, buf, buf);
+    check("AES-128-CBC decrypt in place", !memcmp(buf, pt, 64));
+
+    hex(ct, aes_ctr);
+    hex(iv, aes_ctr_iv);
+    off = 0;
+    for (done = 0, i = 0; done < 64; done += len, i++) {
+        len = (i % 3 == 0) ? 5 : (i % 3 == 1) ? 16 : 23;
+        len = (len > 64 - done) ? 64 - done : len;
+        mbedtls_aes_crypt_ctr(&aes, len, &off, iv, stream, pt + done, buf + 1 + done);
+    }
+    check("AES-128-CTR in odd pieces", !memcmp(buf + 1, ct, 64));
+
+    /* more than a chunk, from odd addresses, across the wrap of the low counter word */
+    for (i = 0; i < sizeof(big_in); i++) {
+        big_in[i] = (uint8_t)(i * 7);
+    }
+    memset(iv0, 0, 16);
+    iv0[11] = 0x12;
+    iv0[12] = iv0[13] = iv0[14] = 0xff;
+    iv0[15] = 0xf0;
+    memcpy(iv, iv0, 16);
+    off = 0;
+    mbedtls_aes_crypt_ctr(&aes, 4096, &off, iv, stream, big_in + 1, big_out + 1);
+    ctr_ref(&aes, iv0, big_in + 1, big_ref, 4096);
+    check("AES-128-CTR 4 KB across the counter wrap", !memcmp(big_out + 1, big_ref, 4096));
+
+    mbedtls_aes_free(&aes);
+}
+
+/*
+ * AES-CCM, SP 800-38C C.1 to C.3
+ */
+static const struct {
+    const char *nonce, *adata, *pt, *ct;
+    size_t tag_len;
+} ccm_kat[] = {
+    { "10111213141516", "0001020304050607", "20212223", "7162015b4dac255d", 4 },
+    { "1011121314151617", "000102030405060708090a0b0c0d0e0f", "202122232425262728292a2b2c2d2e2f",
+      "d2a1f0e051ea5f62081a7792073d593d1fc64fbfaccd", 6 },
+    { "101112131415161718191a1b", "000102030405060708090a0b0c0d0e0f10111213",
+      "202122232425262728292a2b2c2d2e2f3031323334353637",
+      "e3b201a9f5b71a7a9b1ceaeccd97e70b6176aad9a4428aa5484392fbc1b09951", 8 },
+};
+
+static void kat_ccm(void)
+{
+    mbedtls_ccm_context ccm;
+    uint8_t key[16], nonce[13], adata[20], pt[24], ct[32], out[24], tag[8];
+    size_t n_len, a_len, p_len;
+    char name[48];
+    unsigned k;
+
+    hex(key, "404142434445464748494a4b4c4d4e4f");
+    mbedtls_ccm_init(&ccm);
+    mbedtls_ccm_setkey(&ccm, MBEDTLS_CIPHER_ID_AES, key, 128);
+
+    for (k = 0; k < sizeof(ccm_kat) / sizeof(ccm_kat[0]); k++) {
+        n_len = strlen(ccm_kat[k].nonce) / 2;
+        a_len = strlen(ccm_kat[k].adata) / 2;
+        p_len = strlen(ccm_kat[k].pt) / 2;
+        hex(nonce, ccm_kat[k].nonce);
+        hex(adata, ccm_kat[k].adata);
+        hex(pt, ccm_kat[k].pt);
+        hex(ct, ccm_kat[k].ct);
+
+        mbedtls_ccm_encrypt_and_tag(&ccm, p_len, nonce, n_len, adata, a_len, pt, out, tag, ccm_kat[k].tag_len);
+        snprintf(name, sizeof(name), "AES-CCM C.%u encrypt", k + 1);
+        check(name, !memcmp(out, ct, p_len) && !memcmp(tag, ct + p_len, ccm_kat[k].tag_len));
+
+        snprintf(name, sizeof(name), "AES-CCM C.%u decrypt", k + 1);
+        check(name, !mbedtls_ccm_auth_decrypt(&ccm, p_len, nonce, n_len, adata, a_len, ct, out,
+                                              ct + p_len, ccm_kat[k].tag_len) &&
+                        !memcmp(out, pt, p_len));
+
+        ct[p_len] ^= 1;
+        snprintf(name, sizeof(name), "AES-CCM C.%u bad tag rejected", k + 1);
+        check(name, mbedtls_ccm_auth_decrypt(&ccm, p_len, nonce, n_len, adata, a_len, ct, out,
+                                             ct + p_len, ccm_kat[k].tag_len) != 0);
+    }
+
+    mbedtls_ccm_free(&ccm);
+}
+
+/*
+ * ECDH P-256, RFC 5903 8.1; secp256k1 and ECDSA against mbedtls' own code
+ */
+static const char ecdh_i[] = "C88F01F510D9AC3F70A292DAA2316DE544E9AAB8AFE84049C62A9C57862D1433";
+static const char ecdh_gix[] = "DAD0B65394221CF9B051E1FECA5787D098DFE637FC90B9EF945D0C3772581180";
+static const char ecdh_giy[] = "5271A0461CDB8252D61F1C456FA3E59AB1F45B33ACCF5F58389E0577B8990BB3";
+static const char ecdh_grx[] = "D12DFB5289C8D4F81208B70270398C342296970A0BCCB74C736FC7554494BF63";
+static const char ecdh_gry[] = "56FBF3CA366CC23E8157854C13C58D6AAC23F046ADA30F8353E74F33039872AB";
+static const char ecdh_girx[] = "D6840F6B42F6EDAFD13116E0E12565202FEF8E9ECE7DCE03812464D04B9442DE";
+
+/* hands out the bytes it is given, then counts */
+static int fixed_rng(void *p_rng, unsigned char *output, size_t len)
+{
+    const uint8_t *fixed = p_rng;
+    static uint8_t n;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        output[i] = fixed ? fixed[i % 32] : (uint8_t)(++n * 151 + 17);
+    }
+
+    return 0;
+}
+
+static int mpi_is(const mbedtls_mpi *x, const char *s)
+{
+    mbedtls_mpi y;
+    int eq;
+
+    mbedtls_mpi_init(&y);
+    mbedtls_mpi_read_string(&y, 16, s);
+    eq = !mbedtls_mpi_cmp_mpi(x, &y);
+    mbedtls_mpi_free(&y);
+
+    return eq;
+}
+
+static void kat_ecdh(void)
+{
+    mbedtls_ecp_group grp;
+    mbedtls_ecp_point Q, R, P;
+    mbedtls_mpi d, e, z, z2;
+    uint8_t i_bytes[32];
+    uint32_t refused;
+
+    mbedtls_ecp_group_init(&grp);
+    mbedtls_ecp_point_init(&Q);
+    mbedtls_ecp_point_init(&R);
+    mbedtls_ecp_point_init(&P);
+    mbedtls_mpi_init(&d);
+    mbedtls_mpi_init(&e);
+    mbedtls_mpi_init(&z);
+    mbedtls_mpi_init(&z2);
+
+    mbedtls_ecp_group_load(&grp, MBEDTLS_ECP_DP_SECP256R1);
+    hex(i_bytes, ecdh_i);
+    mbedtls_ecdh_gen_public(&grp, &d, &Q, fixed_rng, i_bytes);
+    check("ECDH P-256 public key", mpi_is(&d, ecdh_i) && mpi_is(&Q.X, ecdh_gix) && mpi_is(&Q.Y, ecdh_giy));
+
+    mbedtls_mpi_read_string(&R.X, 16, ecdh_grx);
+    mbedtls_mpi_read_string(&R.Y, 16, ecdh_gry);
+    mbedtls_mpi_lset(&R.Z, 1);
+    mbedtls_ecdh_compute_shared(&grp, &z, &R, &d, fixed_rng, NULL);
+    check("ECDH P-256 shared secret", mpi_is(&z, ecdh_girx));
+
+    /* an off curve peer key is refused before it reaches the PKA */
+    mbedtls_mpi_add_int(&R.Y, &R.Y, 1);
+    check("ECDH P-256 invalid peer key", mbedtls_ecdh_compute_shared(&grp, &z, &R, &d, fixed_rng, NULL) != 0);
+
+    /* the PKA of the model refuses secp256k1, mbedtls does it */
+    refused = sec_eng_model.pka_refused;
+    mbedtls_ecp_group_free(&grp);
+    mbedtls_ecp_group_init(&grp);
+    mbedtls_ecp_group_load(&grp, MBEDTLS_ECP_DP_SECP256K1);
+    mbedtls_ecdh_gen_public(&grp, &d, &Q, fixed_rng, NULL);
+    mbedtls_ecdh_gen_public(&grp, &e, &P, fixed_rng, NULL);
+    mbedtls_ecdh_compute_shared(&grp, &z, &P, &d, fixed_rng, NULL);
+    mbedtls_ecdh_compute_shared(&grp, &z2, &Q, &e, fixed_rng, NULL);
+    check("ECDH secp256k1 through the fallback",
+          !mbedtls_mpi_cmp_mpi(&z, &z2) && !mbedtls_ecp_check_pubkey(&grp, &Q) && sec_eng_model.pka_refused > refused);
+
+    mbedtls_ecp_group_free(&grp);
+    mbedtls_ecp_point_free(&Q);
+    mbedtls_ecp_point_free(&R);
+    mbedtls_ecp_point_free(&P);
+    mbedtls_mpi_free(&d);
+    mbedtls_mpi_free(&e);
+    mbedtls_mpi_free(&z);
+    mbedtls_mpi_free(&z2);
+}
+
+static void kat_ecdsa(mbedtls_ecp_group_id id, const char *name)
+{
+    mbedtls_ecp_group grp;
+    mbedtls_ecp_point Q;
+    mbedtls_mpi d, r, s;
+    uint8_t hash[32];
+    char line[64];
+
+    mbedtls_ecp_group_init(&grp);
+    mbedtls_ecp_point_init(&Q);
+    mbedtls_mpi_init(&d);
+    mbedtls_mpi_init(&r);
+    mbedtls_mpi_init(&s);
+
+    mbedtls_ecp_group_load(&grp, id);
+    mbedtls_ecp_gen_keypair(&grp, &d, &Q, fixed_rng, NULL);
+    hex(hash, sha_kat[1].digest);
+    mbedtls_ecdsa_sign(&grp, &r, &s, &d, hash, sizeof(hash), fixed_rng, NULL);
+
+    snprintf(line, sizeof(line), "ECDSA %s verify", name);
+    check(line, !mbedtls_ecdsa_verify(&grp, hash, sizeof(hash), &Q, &r, &s));
+
+    hash[31] ^= 1;
+    snprintf(line, sizeof(line), "ECDSA %s bad signature rejected", name);
+    check(line, mbedtls_ecdsa_verify(&grp, hash, sizeof(hash), &Q, &r, &s) == MBEDTLS_ERR_ECP_VERIFY_FAILED);
+
+    mbedtls_ecp_group_free(&grp);
+    mbedtls_ecp_point_free(&Q);
+    mbedtls_mpi_free(&d);
+    mbedtls_mpi_free(&r);
+    mbedtls_mpi_free(&s);
+}
+
+int main(void)
+{
+    kat_sha256();
+    kat_aes();
+    kat_ccm();
+    kat_ecdh();
+    kat_ecdsa(MBEDTLS_ECP_DP_SECP256R1, "P-256");
+    kat_ecdsa(MBEDTLS_ECP_DP_SECP256K1, "secp256k1");
+
+    check("engine only used under sec_eng_lock()", sec_eng_model.unlocked == 0 && sec_eng_model_balanced());
+    check("engine only fed word aligned buffers", sec_eng_model.unaligned == 0);
+
+    printf("engine: %u AES runs, %u SHA blocks, %u PKA operations, %u refused, lock depth %u\n",
+           sec_eng_model.aes_runs, sec_eng_model.sha_blocks, sec_eng_model.pka_ops, sec_eng_model.pka_refused,
+           sec_eng_model.max_depth);
+    printf("%d failed\n", failed);
+
+    return failed ? 1 : 0;
+}
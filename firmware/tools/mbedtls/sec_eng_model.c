@@ -0,0 +1,498 @@
+/*
+ * Host model of the security engine as the mbedTLS port (components/mbedtls/bflb_port)
+ * drives it, for mbedtls_kat.c.
+ *
+ * AES runs ECB, CBC and CTR on tinycrypt's AES-128 the way the engine does with the
+ * big endian key and IV: the CTR counter is the low word of the IV and wraps without
+ * carry. SHA-256/224 in link mode keeps the driver code of bl702_sec_eng.c and replaces
+ * the register trigger with a software compression that reads and writes the link
+ * config, so the hash state lives in the caller's context like on the chip. The PKA
+ * knows P-256 through tinycrypt's uECC and refuses secp256k1, which sends the port down
+ * its mbedtls fallback.
+ *
+ * Every engine call checks that sec_eng_lock() is held and that the addresses the
+ * engine would fetch from are word aligned. The link config holds 32 bit addresses like
+ * on the chip, so the contexts and buffers the SHA engine reads must be static and the
+ * program built with -no-pie.
+ */
+
+#include <stdlib.h>
+#include "bl702_sec_eng.h"
+#include "hal_sec_ecdsa.h"
+#include "sec_eng_model.h"
+#include "aes.h"
+#include "ecc.h"
+#include "ecc_dsa.h"
+
+sec_eng_model_stats_t sec_eng_model;
+
+static uint32_t lock_depth;
+
+void sec_eng_lock(void)
+{
+    lock_depth++;
+    sec_eng_model.max_depth = (lock_depth > sec_eng_model.max_depth) ? lock_depth : sec_eng_model.max_depth;
+}
+
+void sec_eng_unlock(void)
+{
+    if (lock_depth == 0) {
+        printf("sec_eng_unlock() without sec_eng_lock()\n");
+        abort();
+    }
+
+    lock_depth--;
+}
+
+int sec_eng_model_balanced(void)
+{
+    return lock_depth == 0;
+}
+
+static void engine_access(const void *p)
+{
+    if (lock_depth == 0) {
+        sec_eng_model.unlocked++;
+    }
+
+    if (p && ((uintptr_t)p & 3)) {
+        sec_eng_model.unaligned++;
+    }
+}
+
+/* the link config and the SHA source are 32 bit bus addresses */
+static uint32_t bus_addr(const void *p)
+{
+    if ((uintptr_t)p > UINT32_MAX) {
+        printf("%p is not a 32 bit address, build with -no-pie and keep SHA buffers static\n", p);
+        abort();
+    }
+
+    return (uint32_t)(uintptr_t)p;
+}
+
+static void *bus_ptr(uint32_t addr)
+{
+    return (void *)(uintptr_t)addr;
+}
+
+/*
+ * AES
+ */
+static struct {
+    SEC_ENG_AES_Type mode;
+    SEC_ENG_AES_Key_Type key_type;
+    SEC_ENG_AES_EnDec_Type dir;
+    uint8_t key[32];
+    uint8_t iv[16];
+} aes;
+
+void Sec_Eng_AES_Enable_BE(SEC_ENG_AES_ID_Type aesNo)
+{
+    engine_access(NULL);
+}
+
+BL_Err_Type Sec_Eng_AES_Init(SEC_Eng_AES_Ctx *aesCtx, SEC_ENG_AES_ID_Type aesNo, SEC_ENG_AES_Type aesType,
+                             SEC_ENG_AES_Key_Type keyType, SEC_ENG_AES_EnDec_Type enDecType)
+{
+    engine_access(NULL);
+    aes.mode = aesType;
+    aes.key_type = keyType;
+    aes.dir = enDecType;
+    memset(aesCtx, 0, sizeof(SEC_Eng_AES_Ctx));
+    aesCtx->mode = aesType;
+
+    return SUCCESS;
+}
+
+void Sec_Eng_AES_Set_Key_IV_BE(SEC_ENG_AES_ID_Type aesNo, SEC_ENG_AES_Key_Src_Type keySrc, const uint8_t *key,
+                               const uint8_t *iv)
+{
+    engine_access(NULL);
+    memcpy(aes.key, key, 16);
+    memcpy(aes.iv, iv, 16);
+}
+
+static void aes_ctr_inc(uint8_t iv[16])
+{
+    int i;
+
+    for (i = 15; i >= 12; i--) {
+        if (++iv[i] != 0) {
+            break;
+        }
+    }
+}
+
+BL_Err_Type Sec_Eng_AES_Crypt(SEC_Eng_AES_Ctx *aesCtx, SEC_ENG_AES_ID_Type aesNo, const uint8_t *in, uint32_t len,
+                              uint8_t *out)
+{
+    struct tc_aes_key_sched_struct sched;
+    uint8_t block[16], prev[16];
+    uint32_t i, j;
+
+    engine_access(in);
+    engine_access(out);
+
+    /* tinycrypt does AES-128 only */
+    if ((len % 16) || aes.key_type != SEC_ENG_AES_KEY_128BITS) {
+        return ERROR;
+    }
+
+    if (aes.mode != SEC_ENG_AES_CTR && aes.dir == SEC_ENG_AES_DECRYPTION) {
+        tc_aes128_set_decrypt_key(&sched, aes.key);
+    } else {
+        tc_aes128_set_encrypt_key(&sched, aes.key);
+    }
+
+    for (i = 0; i < len; i += 16) {
+        memcpy(block, in + i, 16);
+
+        switch (aes.mode) {
+            case SEC_ENG_AES_ECB:
+                if (aes.dir == SEC_ENG_AES_DECRYPTION) {
+                    tc_aes_decrypt(out + i, block, &sched);
+                } else {
+                    tc_aes_encrypt(out + i, block, &sched);
+                }
+                break;
+
+            case SEC_ENG_AES_CBC:
+                if (aes.dir == SEC_ENG_AES_DECRYPTION) {
+                    memcpy(prev, block, 16);
+                    tc_aes_decrypt(out + i, block, &sched);
+                    for (j = 0; j < 16; j++) {
+                        out[i + j] ^= aes.iv[j];
+                    }
+                    memcpy(aes.iv, prev, 16);
+                } else {
+                    for (j = 0; j < 16; j++) {
+                        block[j] ^= aes.iv[j];
+                    }
+                    tc_aes_encrypt(out + i, block, &sched);
+                    memcpy(aes.iv, out + i, 16);
+                }
+                break;
+
+            case SEC_ENG_AES_CTR:
+                tc_aes_encrypt(prev, aes.iv, &sched);
+                for (j = 0; j < 16; j++) {
+                    out[i + j] = block[j] ^ prev[j];
+                }
+                aes_ctr_inc(aes.iv);
+                break;
+        }
+    }
+
+    aesCtx->aesFeed = 1;
+    sec_eng_model.aes_runs++;
+
+    return SUCCESS;
+}
+
+BL_Err_Type Sec_Eng_AES_Finish(SEC_ENG_AES_ID_Type aesNo)
+{
+    engine_access(NULL);
+    memset(&aes, 0, sizeof(aes));
+
+    return SUCCESS;
+}
+
+/*
+ * SHA-256/224 in link mode
+ */
+static const uint32_t sha_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t sha256_h0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const uint32_t sha224_h0[8] = {
+    0xc1059ed8, 0x367cd507, 0x3070dd17, 0xf70e5939, 0xffc00b31, 0x68581511, 0x64f98fa7, 0xbefa4fa4
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static uint32_t get_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void sha256_block(uint32_t h[8], const uint8_t *p)
+{
+    uint32_t w[64], a, b, c, d, e, f, g, k, t1, t2;
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        w[i] = get_be32(p + 4 * i);
+    }
+    for (; i < 64; i++) {
+        w[i] = (ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10)) + w[i - 7] +
+               (ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 16];
+    }
+
+    a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+
+    for (i = 0; i < 64; i++) {
+        t1 = k + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + sha_k[i] + w[i];
+        t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        k = g, g = f, f = e, e = d + t1, d = c, c = b, b = a, a = t1 + t2;
+    }
+
+    h[0] += a, h[1] += b, h[2] += c, h[3] += d, h[4] += e, h[5] += f, h[6] += g, h[7] += k;
+}
+
+/* SEC_ENG_SE_SHA_0_TRIG_1T: runs the link config at addr */
+static void sha_trigger(uint32_t addr)
+{
+    SEC_Eng_SHA_Link_Config_Type *cfg = bus_ptr(addr);
+    const uint8_t *src = bus_ptr(cfg->shaSrcAddr);
+    uint32_t h[8];
+    uint32_t i;
+
+    engine_access(cfg);
+    engine_access(src);
+
+    if (cfg->shaHashSel) {
+        for (i = 0; i < 8; i++) {
+            h[i] = get_be32((uint8_t *)&cfg->result[i]);
+        }
+    } else {
+        memcpy(h, (cfg->shaMode == SEC_ENG_SHA224) ? sha224_h0 : sha256_h0, sizeof(h));
+    }
+
+    for (i = 0; i < cfg->shaMsgLen; i++) {
+        sha256_block(h, src + 64 * i);
+        sec_eng_model.sha_blocks++;
+    }
+
+    for (i = 0; i < 8; i++) {
+        put_be32((uint8_t *)&cfg->result[i], h[i]);
+    }
+}
+
+void Sec_Eng_SHA_Enable_Link(SEC_ENG_SHA_ID_Type shaNo)
+{
+    engine_access(NULL);
+}
+
+void Sec_Eng_SHA_Disable_Link(SEC_ENG_SHA_ID_Type shaNo)
+{
+    engine_access(NULL);
+}
+
+/* from here on the driver, bl702_sec_eng.c, with the registers taken out */
+void Sec_Eng_SHA256_Link_Init(SEC_Eng_SHA256_Link_Ctx *shaCtx, SEC_ENG_SHA_ID_Type shaNo, uint32_t linkAddr,
+                              uint32_t shaTmpBuf[16], uint32_t padding[16])
+{
+    memset(shaCtx, 0, sizeof(SEC_Eng_SHA256_Link_Ctx));
+
+    shaCtx->shaBuf = shaTmpBuf;
+    shaCtx->shaPadding = padding;
+    memset(shaCtx->shaPadding, 0, 64);
+    memset(shaCtx->shaPadding, 0x80, 1);
+    shaCtx->linkAddr = linkAddr;
+}
+
+BL_Err_Type Sec_Eng_SHA256_Link_Update(SEC_Eng_SHA256_Link_Ctx *shaCtx, SEC_ENG_SHA_ID_Type shaNo,
+                                       const uint8_t *input, uint32_t len)
+{
+    uint32_t fill;
+    uint32_t left;
+
+    engine_access(NULL);
+
+    if (len == 0) {
+        return SUCCESS;
+    }
+
+    left = shaCtx->total[0] & 0x3F;
+    fill = 64 - left;
+
+    shaCtx->total[0] += (uint32_t)len;
+    shaCtx->total[0] &= 0xFFFFFFFF;
+
+    if (shaCtx->total[0] < (uint32_t)len) {
+        shaCtx->total[1]++;
+    }
+
+    if (left && len >= fill) {
+        memcpy((void *)((uint8_t *)shaCtx->shaBuf + left), input, fill);
+        *(uint32_t *)bus_ptr(shaCtx->linkAddr + 4) = bus_addr(shaCtx->shaBuf);
+        *((uint16_t *)bus_ptr(shaCtx->linkAddr) + 1) = 1;
+        sha_trigger(shaCtx->linkAddr);
+        *((uint32_t *)bus_ptr(shaCtx->linkAddr)) |= 0x40;
+        input += fill;
+        len -= fill;
+        left = 0;
+    }
+
+    fill = len / 64;
+    len = len % 64;
+
+    if (fill > 0) {
+        *(uint32_t *)bus_ptr(shaCtx->linkAddr + 4) = bus_addr(input);
+        *((uint16_t *)bus_ptr(shaCtx->linkAddr) + 1) = fill;
+        sha_trigger(shaCtx->linkAddr);
+        input += (fill * 64);
+        *((uint32_t *)bus_ptr(shaCtx->linkAddr)) |= 0x40;
+    }
+
+    if (len > 0) {
+        memcpy((void *)((uint8_t *)shaCtx->shaBuf + left), input, len);
+    }
+
+    return SUCCESS;
+}
+
+BL_Err_Type Sec_Eng_SHA256_Link_Finish(SEC_Eng_SHA256_Link_Ctx *shaCtx, SEC_ENG_SHA_ID_Type shaNo,
+                                       uint8_t *hash)
+{
+    uint32_t last, padn;
+    uint32_t high, low;
+    uint8_t msgLen[8];
+    uint32_t shaMode = (*(uint32_t *)bus_ptr(shaCtx->linkAddr)) >> 2 & 0x7;
+
+    engine_access(NULL);
+
+    high = (shaCtx->total[0] >> 29) | (shaCtx->total[1] << 3);
+    low = (shaCtx->total[0] << 3);
+
+    put_be32(msgLen, high);
+    put_be32(msgLen + 4, low);
+
+    last = shaCtx->total[0] & 0x3F;
+    padn = (last < 56) ? (56 - last) : (120 - last);
+
+    Sec_Eng_SHA256_Link_Update(shaCtx, shaNo, (uint8_t *)shaCtx->shaPadding, padn);
+    Sec_Eng_SHA256_Link_Update(shaCtx, shaNo, msgLen, 8);
+
+    memcpy(hash, (uint8_t *)bus_ptr(shaCtx->linkAddr + 8), (shaMode == 1) ? 28 : 32);
+
+    *((uint32_t *)bus_ptr(shaCtx->linkAddr)) &= ~0x40;
+
+    return SUCCESS;
+}
+
+/*
+ * PKA, operands are big endian words
+ */
+static int pka_curve_ok(sec_ecp_type id)
+{
+    engine_access(NULL);
+
+    if (id != ECP_SECP256R1) {
+        sec_eng_model.pka_refused++;
+        return 0;
+    }
+
+    sec_eng_model.pka_ops++;
+    return 1;
+}
+
+int sec_ecdh_init(sec_ecdh_handle_t *handle, sec_ecp_type id)
+{
+    engine_access(NULL);
+    memset(handle, 0, sizeof(*handle));
+    handle->ecpId = id;
+
+    return 0;
+}
+
+int sec_ecdh_deinit(sec_ecdh_handle_t *handle)
+{
+    engine_access(NULL);
+
+    return 0;
+}
+
+int sec_ecdh_get_public_key(sec_ecdh_handle_t *handle, const uint32_t *private_key, const uint32_t *pRx,
+                            const uint32_t *pRy)
+{
+    uint8_t pk[64];
+
+    if (!pka_curve_ok(handle->ecpId) || !uECC_compute_public_key((const uint8_t *)private_key, pk, uECC_secp256r1())) {
+        return -1;
+    }
+
+    memcpy((void *)pRx, pk, 32);
+    memcpy((void *)pRy, pk + 32, 32);
+
+    return 0;
+}
+
+/* uECC_shared_secret() without dropping Y */
+int sec_ecdh_get_encrypt_key(sec_ecdh_handle_t *handle, const uint32_t *pkX, const uint32_t *pkY,
+                             const uint32_t *private_key, const uint32_t *pRx, const uint32_t *pRy)
+{
+    uECC_Curve curve = uECC_secp256r1();
+    uECC_word_t point[NUM_ECC_WORDS * 2], k[NUM_ECC_WORDS], tmp[NUM_ECC_WORDS];
+    uECC_word_t *p2[2] = { k, tmp };
+    uECC_word_t carry;
+
+    if (!pka_curve_ok(handle->ecpId)) {
+        return -1;
+    }
+
+    uECC_vli_bytesToNative(k, (const uint8_t *)private_key, 32);
+    uECC_vli_bytesToNative(point, (const uint8_t *)pkX, 32);
+    uECC_vli_bytesToNative(point + NUM_ECC_WORDS, (const uint8_t *)pkY, 32);
+
+    carry = regularize_k(k, k, tmp, curve);
+    EccPoint_mult(point, point, p2[!carry], 0, curve->num_n_bits + 1, curve);
+
+    uECC_vli_nativeToBytes((uint8_t *)pRx, 32, point);
+    uECC_vli_nativeToBytes((uint8_t *)pRy, 32, point + NUM_ECC_WORDS);
+
+    return 0;
+}
+
+int sec_ecdsa_init(sec_ecdsa_handle_t *handle, sec_ecp_type id)
+{
+    engine_access(NULL);
+    memset(handle, 0, sizeof(*handle));
+    handle->ecpId = id;
+
+    return 0;
+}
+
+int sec_ecdsa_deinit(sec_ecdsa_handle_t *handle)
+{
+    engine_access(NULL);
+
+    return 0;
+}
+
+int sec_ecdsa_verify(sec_ecdsa_handle_t *handle, const uint32_t *hash, uint32_t hashLen, const uint32_t *r,
+                     const uint32_t *s)
+{
+    uint8_t pk[64], sig[64];
+
+    if (!pka_curve_ok(handle->ecpId)) {
+        return -1;
+    }
+
+    memcpy(pk, handle->publicKeyx, 32);
+    memcpy(pk + 32, handle->publicKeyy, 32);
+    memcpy(sig, r, 32);
+    memcpy(sig + 32, s, 32);
+
+    return uECC_verify(pk, (const uint8_t *)hash, hashLen * 4, sig, uECC_secp256r1()) ? 0 : -1;
+}
@@ -0,0 +1,22 @@
+#ifndef __SEC_ENG_MODEL_H__
+#define __SEC_ENG_MODEL_H__
+
+#include <stdint.h>
+
+/* what the port did to the engine, see sec_eng_model.c */
+typedef struct {
+    uint32_t unlocked;    /* engine calls without sec_eng_lock() held */
+    uint32_t unaligned;   /* addresses the engine would fetch from or store to that are not word aligned */
+    uint32_t max_depth;   /* deepest sec_eng_lock() nesting */
+    uint32_t aes_runs;
+    uint32_t sha_blocks;
+    uint32_t pka_ops;     /* point multiplications and verifies the model did */
+    uint32_t pka_refused; /* operations on curves the model refuses, the port falls back to mbedtls */
+} sec_eng_model_stats_t;
+
+extern sec_eng_model_stats_t sec_eng_model;
+
+/* the lock is released as often as it was taken */
+int sec_eng_model_balanced(void);
+
+#endif
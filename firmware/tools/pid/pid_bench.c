@@ -0,0 +1,346 @@
+/*
+ * Host check of the fixed point control code (common/pid/pid_q.c) against the float
+ * code of common/pid/pid.c, and a rough timing of both.
+ *
+ * Each controller runs the same input sequence as its float reference and the worst
+ * difference of the outputs is reported in the units of the loop; the run fails when
+ * one is past its limit. The speed loop of lego_train drives a first order model of the
+ * motor, a line follower with the gains of robot.c replays noisy sensor steps. Filters and slew
+ * limiters are checked against plain float versions. The timing says little about the
+ * train, speed_ctrl.c logs the cycle counts of both at boot.
+ *
+ *   gcc -O2 -I common/pid tools/pid/pid_bench.c common/pid/pid.c common/pid/pid_q.c -lm -o pid_bench
+ *   ./pid_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "pid.h"
+#include "pid_q.h"
+
+#define STEPS       20000
+#define BENCH_CALLS 1000000
+
+/* speed_ctrl.c */
+#define SPEED_IN_BITS    12
+#define SPEED_OUT_BITS   7
+#define SPEED_GAIN_SHIFT 1
+#define SPEED_GAIN(k)    PID_Q_GAIN((k) * (1 << (SPEED_IN_BITS - SPEED_OUT_BITS)), SPEED_GAIN_SHIFT)
+
+/* the float gains of robot.c after pid_tune() with its 100 ms sample time; robot.c itself is not built */
+#define ROBOT_IN_BITS    12
+#define ROBOT_OUT_BITS   7
+#define ROBOT_GAIN_SHIFT 2
+#define ROBOT_GAIN(k)    PID_Q_GAIN((k) * (1 << (ROBOT_IN_BITS - ROBOT_OUT_BITS)), ROBOT_GAIN_SHIFT)
+
+static int failed;
+
+static void check(const char *name, double worst, double limit, const char *unit)
+{
+    printf("%-26s worst %-9.3g limit %-9.3g %s%s\n", name, worst, limit, unit, (worst > limit) ? "  FAIL" : "");
+    failed |= (worst > limit);
+}
+
+static double worse(double worst, double a, double b)
+{
+    return (fabs(a - b) > worst) ? fabs(a - b) : worst;
+}
+
+static double q31_to_double(q31_t q)
+{
+    return q / 2147483648.0;
+}
+
+static double noise(void)
+{
+    return rand() / (double)RAND_MAX * 2.0 - 1.0;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+/* the train at 10 ms steps: 10 ticks/s per percent of duty, 150 ms to settle */
+static double motor_model(double velocity, double duty)
+{
+    return velocity + (duty * 10.0 - velocity) * 10.0 / 150.0;
+}
+
+static int32_t speed_target(int step)
+{
+    static const int32_t targets[] = { 300, 600, 150, -400, 900, -900, 50 };
+
+    return targets[(step / 500) % (sizeof(targets) / sizeof(targets[0]))];
+}
+
+/* speed_ctrl_reset() in float and in fixed point */
+static void speed_pid_init(pid_alg_t *f, pid_q_alg_t *q)
+{
+    pid_init(f);
+    f->kp = 0.05f;
+    f->ki = 0.02f;
+    f->max_val = 100;
+    f->min_val = -100;
+
+    pid_q_init(q);
+    q->shift = SPEED_GAIN_SHIFT;
+    q->kp = SPEED_GAIN(0.05);
+    q->ki = SPEED_GAIN(0.02);
+    q->max_val = q31_from_int(100, SPEED_OUT_BITS);
+    q->min_val = q31_from_int(-100, SPEED_OUT_BITS);
+}
+
+static void check_speed_loop(void)
+{
+    pid_alg_t f;
+    pid_q_alg_t q;
+    double velocity = 0, q_velocity = 0, worst = 0, worst_closed = 0;
+    int32_t target, measured;
+    float out;
+    q31_t q_out;
+    int i;
+
+    speed_pid_init(&f, &q);
+
+    /* both controllers see the velocity of the float loop */
+    for (i = 0; i < STEPS; i++) {
+        target = speed_target(i);
+        measured = (int32_t)lrint(velocity + noise() * 20.0);
+
+        out = feedback_pid_cal(&f, (float)target, (float)measured);
+        q_out = feedback_pid_q_cal(&q, q31_from_int(target, SPEED_IN_BITS), q31_from_int(measured, SPEED_IN_BITS));
+
+        worst = worse(worst, out, q31_to_double(q_out) * (1 << SPEED_OUT_BITS));
+        velocity = motor_model(velocity, out);
+    }
+    check("speed loop, same input", worst, 0.001, "% duty");
+
+    /* and each one closing its own loop */
+    speed_pid_init(&f, &q);
+    velocity = 0;
+
+    for (i = 0; i < STEPS; i++) {
+        target = speed_target(i);
+
+        out = feedback_pid_cal(&f, (float)target, (float)lrint(velocity));
+        q_out = feedback_pid_q_cal(&q, q31_from_int(target, SPEED_IN_BITS),
+                                   q31_from_int((int32_t)lrint(q_velocity), SPEED_IN_BITS));
+
+        velocity = motor_model(velocity, out);
+        q_velocity = motor_model(q_velocity, q31_to_double(q_out) * (1 << SPEED_OUT_BITS));
+        worst_closed = worse(worst_closed, velocity, q_velocity);
+    }
+    check("speed loop, closed", worst_closed, 2.0, "ticks/s");
+}
+
+static void check_robot_loop(void)
+{
+    pid_alg_t f;
+    pid_q_alg_t q;
+    double worst = 0;
+    int32_t input = 0;
+    float out;
+    q31_t q_out;
+    int i;
+
+    pid_init(&f);
+    f.kp = 0.1f;
+    f.ki = 0.00001f;
+    f.kd = 0.05f;
+    f.max_val = 100;
+    f.min_val = -100;
+
+    pid_q_init(&q);
+    q.shift = ROBOT_GAIN_SHIFT;
+    q.kp = ROBOT_GAIN(0.1);
+    q.ki = ROBOT_GAIN(0.00001);
+    q.kd = ROBOT_GAIN(0.05);
+    q.max_val = q31_from_int(100, ROBOT_OUT_BITS);
+    q.min_val = q31_from_int(-100, ROBOT_OUT_BITS);
+
+    /* the sensor difference jumps between the line and the edges, with noise */
+    for (i = 0; i < STEPS; i++) {
+        int32_t sample;
+
+        if ((i % 50) == 0) {
+            input = (rand() % 3 - 1) * (20 + rand() % 800);
+        }
+        sample = input + (int32_t)(noise() * 5);
+
+        out = feedback_pid_cal(&f, (float)sample, 0.0f);
+        q_out = feedback_pid_q_cal(&q, q31_from_int(sample, ROBOT_IN_BITS), 0);
+        worst = worse(worst, out, q31_to_double(q_out) * (1 << ROBOT_OUT_BITS));
+    }
+    check("robot loop", worst, 0.001, "% duty");
+}
+
+/* standard and increment pid on fractions, their error is taken against their own output */
+static void check_open_forms(void)
+{
+    pid_alg_t f;
+    pid_q_alg_t q;
+    double worst_std = 0, worst_inc = 0;
+    double set;
+    int i;
+
+    pid_init(&f);
+    f.kp = 0.4f;
+    f.ki = 0.05f;
+    f.kd = 0.1f;
+    pid_q_init(&q);
+    q.shift = 0;
+    q.kp = Q31(0.4);
+    q.ki = Q31(0.05);
+    q.kd = Q31(0.1);
+
+    for (i = 0; i < STEPS; i++) {
+        set = 0.5 * sin(i * 0.01) + 0.05 * noise();
+        worst_std = worse(worst_std, standard_pid_cal(&f, (float)set), q31_to_double(standard_pid_q_cal(&q, Q31(set))));
+    }
+
+    pid_init(&f);
+    f.kp = 0.3f;
+    f.ki = 0.1f;
+    f.kd = 0.02f;
+    pid_q_init(&q);
+    q.shift = 0;
+    q.kp = Q31(0.3);
+    q.ki = Q31(0.1);
+    q.kd = Q31(0.02);
+
+    for (i = 0; i < STEPS; i++) {
+        set = 0.5 * sin(i * 0.01) + 0.05 * noise();
+        worst_inc = worse(worst_inc, increment_pid_cal(&f, (float)set), q31_to_double(increment_pid_q_cal(&q, Q31(set))));
+    }
+
+    /* float keeps 24 bits, so the limit is the float rounding and not the Q31 one */
+    check("standard pid", worst_std, 1e-5, "of full scale");
+    check("increment pid", worst_inc, 1e-5, "of full scale");
+}
+
+/* feedback pid with the derivative low pass, against a float version of the same */
+static void check_derivative_filter(void)
+{
+    const double alpha = LPF_Q_ALPHA(5.0, 100.0);
+    const double kp = 0.8, ki = 0.02, kd = 0.6;
+    pid_q_alg_t q;
+    double sum = 0, last = 0, d_term = 0, error, d, out, worst = 0;
+    double set, feedback;
+    int i;
+
+    pid_q_init(&q);
+    q.shift = 1;
+    q.kp = PID_Q_GAIN(kp, 1);
+    q.ki = PID_Q_GAIN(ki, 1);
+    q.kd = PID_Q_GAIN(kd, 1);
+    q.d_alpha = Q31(alpha);
+    q.max_val = Q31(0.9);
+    q.min_val = Q31(-0.9);
+
+    for (i = 0; i < STEPS; i++) {
+        set = ((i / 400) & 1) ? 0.4 : -0.3;
+        feedback = 0.2 * sin(i * 0.03) + 0.02 * noise();
+
+        error = set - feedback;
+        sum += ki * error;
+        sum = (sum > 0.9) ? 0.9 : ((sum < -0.9) ? -0.9 : sum);
+        d = kd * (error - last);
+        d_term += alpha * (d - d_term);
+        last = error;
+        out = kp * error + sum + d_term;
+        out = (out > 0.9) ? 0.9 : ((out < -0.9) ? -0.9 : out);
+
+        worst = worse(worst, out, q31_to_double(feedback_pid_q_cal(&q, Q31(set), Q31(feedback))));
+    }
+    check("feedback pid, filtered d", worst, 1e-6, "of full scale");
+}
+
+static void check_filters(void)
+{
+    const double alpha = LPF_Q_ALPHA(2.0, 100.0);
+    lpf_q31_t lpf31;
+    lpf_q15_t lpf15;
+    slew_q31_t slew31;
+    slew_q15_t slew15;
+    double y = 0, s31 = 0, s15 = 0, in;
+    double worst31 = 0, worst15 = 0, worst_s31 = 0, worst_s15 = 0;
+    int i;
+
+    lpf_q31_init(&lpf31, Q31(alpha), 0);
+    lpf_q15_init(&lpf15, Q15(alpha), 0);
+    slew_q31_init(&slew31, Q31(0.002), 0);
+    slew_q15_init(&slew15, Q15(0.002), 0);
+
+    for (i = 0; i < STEPS; i++) {
+        in = (((i / 700) & 1) ? 0.7 : -0.6) + 0.1 * noise();
+
+        y += alpha * (in - y);
+        worst31 = worse(worst31, y, q31_to_double(lpf_q31(&lpf31, Q31(in))));
+        worst15 = worse(worst15, y, lpf_q15(&lpf15, Q15(in)) / 32768.0);
+
+        s31 += fmax(fmin(in - s31, 0.002), -0.002);
+        worst_s31 = worse(worst_s31, s31, q31_to_double(slew_q31(&slew31, Q31(in))));
+        s15 += fmax(fmin(in - s15, Q15(0.002) / 32768.0), -Q15(0.002) / 32768.0);
+        worst_s15 = worse(worst_s15, s15, slew_q15(&slew15, Q15(in)) / 32768.0);
+    }
+
+    /* Q15 input alone is off by half a step, the low pass adds the rounding of alpha */
+    check("low pass q31", worst31, 1e-7, "of full scale");
+    check("low pass q15", worst15, 3.0 / 32768, "of full scale");
+    check("slew q31", worst_s31, 1e-6, "of full scale");
+    check("slew q15", worst_s15, 1.0 / 32768, "of full scale");
+}
+
+static void bench(void)
+{
+    static int32_t samples[1024];
+    pid_alg_t f;
+    pid_q_alg_t q;
+    volatile float f_sink = 0;
+    volatile q31_t q_sink = 0;
+    uint64_t start, f_ns, q_ns;
+    int i;
+
+    for (i = 0; i < 1024; i++) {
+        samples[i] = rand() % 1200 - 600;
+    }
+
+    speed_pid_init(&f, &q);
+
+    start = now_ns();
+    for (i = 0; i < BENCH_CALLS; i++) {
+        f_sink = feedback_pid_cal(&f, 300.0f, (float)samples[i & 1023]);
+    }
+    f_ns = now_ns() - start;
+
+    start = now_ns();
+    for (i = 0; i < BENCH_CALLS; i++) {
+        q_sink = feedback_pid_q_cal(&q, q31_from_int(300, SPEED_IN_BITS), q31_from_int(samples[i & 1023], SPEED_IN_BITS));
+    }
+    q_ns = now_ns() - start;
+
+    (void)f_sink;
+    (void)q_sink;
+    printf("host: feedback_pid_cal %.1f ns, feedback_pid_q_cal %.1f ns per call\n", (double)f_ns / BENCH_CALLS,
+           (double)q_ns / BENCH_CALLS);
+}
+
+int main(void)
+{
+    srand(1);
+
+    check_speed_loop();
+    check_robot_loop();
+    check_open_forms();
+    check_derivative_filter();
+    check_filters();
+    bench();
+
+    return failed;
+}
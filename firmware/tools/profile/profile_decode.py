@@ -0,0 +1,243 @@
+#!/usr/bin/env python3
+
+# Render task profile snapshots produced by examples/lego_train/task_profile.c.
+#
+# Snapshots come either from "PROF:<hex>" lines in the debug uart log (a saved
+# log file or a live serial port) or straight from the train over BLE. With
+# --boot the boot phase record from common/boot_profile is read over BLE instead.
+
+import sys
+import argparse
+import asyncio
+import struct
+import binascii
+
+PROFILE_MAGIC = 0x50
+PROFILE_VERSION = 1
+HEADER_FORMAT = "<BBBBIIIHH"
+ENTRY_FORMAT = "<BBBBIHH8s"
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+ENTRY_SIZE = struct.calcsize(ENTRY_FORMAT)
+
+BLE_CMD_GET_TASK_PROFILE = b'\x05'
+BLE_CMD_GET_BOOT_PROFILE = b'\x07'
+BLE_READ_CHARACTERISTIC_UUID = "00070001-0745-4650-8d93-df59be2fc10a"
+BLE_WRITE_CHARACTERISTIC_UUID = "00070002-0745-4650-8d93-df59be2fc10a"
+
+TASK_STATES = ["run", "ready", "blocked", "suspend", "deleted", "invalid"]
+
+BOOT_MAGIC = 0x50544F42
+BOOT_VERSION = 1
+BOOT_HEADER_FORMAT = "<IBBBBI"
+BOOT_MARK_FORMAT = "<IB3x"
+BOOT_HEADER_SIZE = struct.calcsize(BOOT_HEADER_FORMAT)
+BOOT_MARK_SIZE = struct.calcsize(BOOT_MARK_FORMAT)
+
+BOOT_PHASES = {
+    0x01: "boot2 start",
+    0x02: "loader init",
+    0x03: "flash init",
+    0x04: "pt ready",
+    0x05: "handshake end",
+    0x06: "image checked",
+    0x07: "jump",
+    0x10: "app main",
+    0x11: "app tasks",
+    0x12: "app ready",
+    0x13: "advertising",
+    0x14: "connected",
+    0x15: "first move",
+}
+
+BOOT_FLAGS = ["fast", "app request", "gpio request", "unconfirmed", "loader ran"]
+
+
+def expected_length(data):
+    if len(data) < HEADER_SIZE:
+        return None
+    return HEADER_SIZE + data[2] * ENTRY_SIZE
+
+
+def decode(data):
+    magic, version, num_tasks, _, uptime_us, window_us, switches, snapshot_us, hook_ns = \
+        struct.unpack_from(HEADER_FORMAT, data, 0)
+
+    if magic != PROFILE_MAGIC or version != PROFILE_VERSION:
+        raise ValueError("not a version %d task profile snapshot" % PROFILE_VERSION)
+
+    if len(data) < HEADER_SIZE + num_tasks * ENTRY_SIZE:
+        raise ValueError("snapshot truncated, %d bytes" % len(data))
+
+    tasks = []
+    for i in range(num_tasks):
+        number, priority, state, _, runtime_us, stack_free, task_switches, name = \
+            struct.unpack_from(ENTRY_FORMAT, data, HEADER_SIZE + i * ENTRY_SIZE)
+        tasks.append({
+            "number": number,
+            "name": name.split(b'\0')[0].decode(errors="replace"),
+            "priority": priority,
+            "state": TASK_STATES[min(state, len(TASK_STATES) - 1)],
+            "runtime_us": runtime_us,
+            "stack_free": stack_free,
+            "switches": task_switches,
+        })
+
+    return {
+        "uptime_us": uptime_us,
+        "window_us": window_us,
+        "switches": switches,
+        "snapshot_us": snapshot_us,
+        "hook_ns": hook_ns,
+        "tasks": tasks,
+    }
+
+
+def render(snapshot):
+    window = max(snapshot["window_us"], 1)
+    # switch hook calls plus the previous snapshot, against the window
+    overhead_us = snapshot["switches"] * snapshot["hook_ns"] / 1000 + snapshot["snapshot_us"]
+
+    print("uptime %.3f s, window %.1f ms, %d switches (%.0f/s)" %
+          (snapshot["uptime_us"] / 1e6, window / 1e3, snapshot["switches"], snapshot["switches"] * 1e6 / window))
+    print("profiling overhead: hook %d ns/switch, snapshot %d us, %.3f %% cpu" %
+          (snapshot["hook_ns"], snapshot["snapshot_us"], overhead_us * 100 / window))
+    print("%3s %-8s %4s %-8s %8s %6s %9s %8s" % ("#", "name", "prio", "state", "cpu %", "us", "stack", "switches"))
+
+    for task in sorted(snapshot["tasks"], key=lambda t: t["runtime_us"], reverse=True):
+        print("%3d %-8s %4d %-8s %8.2f %6d %9d %8d" %
+              (task["number"], task["name"], task["priority"], task["state"],
+               task["runtime_us"] * 100 / window, task["runtime_us"], task["stack_free"] * 4, task["switches"]))
+    print("")
+
+
+def boot_expected_length(data):
+    if len(data) < BOOT_HEADER_SIZE:
+        return None
+    return BOOT_HEADER_SIZE + data[5] * BOOT_MARK_SIZE
+
+
+def decode_boot(data):
+    magic, version, num_marks, flags, unconfirmed, boot_count = \
+        struct.unpack_from(BOOT_HEADER_FORMAT, data, 0)
+
+    if magic != BOOT_MAGIC or version != BOOT_VERSION:
+        raise ValueError("not a version %d boot profile" % BOOT_VERSION)
+
+    if len(data) < BOOT_HEADER_SIZE + num_marks * BOOT_MARK_SIZE:
+        raise ValueError("boot profile truncated, %d bytes" % len(data))
+
+    marks = [struct.unpack_from(BOOT_MARK_FORMAT, data, BOOT_HEADER_SIZE + i * BOOT_MARK_SIZE)
+             for i in range(num_marks)]
+
+    return {
+        "flags": flags,
+        "unconfirmed": unconfirmed,
+        "boot_count": boot_count,
+        "marks": marks,
+    }
+
+
+def render_boot(profile):
+    flags = [name for i, name in enumerate(BOOT_FLAGS) if profile["flags"] & (1 << i)]
+
+    print("boot %d, %s, %d unconfirmed" %
+          (profile["boot_count"], ", ".join(flags) or "loader window", profile["unconfirmed"]))
+    print("%-14s %10s %10s" % ("phase", "ms", "delta ms"))
+
+    last_us = 0
+    for time_us, phase in profile["marks"]:
+        print("%-14s %10.1f %10.1f" %
+              (BOOT_PHASES.get(phase, "0x%02x" % phase), time_us / 1e3, (time_us - last_us) / 1e3))
+        last_us = time_us
+    print("")
+
+
+def render_line(line):
+    idx = line.find("PROF:")
+    if idx < 0:
+        return
+    try:
+        render(decode(binascii.unhexlify(line[idx + 5:].strip())))
+    except (ValueError, binascii.Error) as e:
+        print("skipped snapshot: {}".format(e))
+
+
+def read_log(filename):
+    with open(filename, "r", errors="replace") as fh:
+        for line in fh:
+            render_line(line)
+
+
+def read_serial(port, baudrate):
+    import serial
+
+    with serial.Serial(port=port, baudrate=baudrate, timeout=1) as ser:
+        while True:
+            line = ser.readline().decode(errors="replace")
+            if line:
+                render_line(line)
+
+
+async def read_ble(addr, count, interval, boot):
+    from bleak import BleakClient
+
+    rx = bytearray()
+    done = asyncio.Event()
+
+    def notification_handler(sender, data):
+        rx.extend(data)
+        length = boot_expected_length(rx) if boot else expected_length(rx)
+        if length is not None and len(rx) >= length:
+            done.set()
+
+    async with BleakClient(addr) as client:
+        write_handle = None
+        read_handle = None
+        for service in client.services:
+            for char in service.characteristics:
+                if char.uuid == BLE_WRITE_CHARACTERISTIC_UUID:
+                    write_handle = char
+                if char.uuid == BLE_READ_CHARACTERISTIC_UUID:
+                    read_handle = char
+
+        if write_handle is None or read_handle is None:
+            print("Device does not expose the lego_train characteristics")
+            return
+
+        await client.start_notify(read_handle, notification_handler)
+
+        for i in range(count):
+            rx.clear()
+            done.clear()
+            await client.write_gatt_char(write_handle,
+                                         BLE_CMD_GET_BOOT_PROFILE if boot else BLE_CMD_GET_TASK_PROFILE, True)
+            try:
+                await asyncio.wait_for(done.wait(), 5)
+                if boot:
+                    render_boot(decode_boot(bytes(rx)))
+                else:
+                    render(decode(bytes(rx)))
+            except asyncio.TimeoutError:
+                print("Did not receive a complete snapshot, got %d bytes" % len(rx))
+            await asyncio.sleep(interval)
+
+
+parser = argparse.ArgumentParser(description='Decode task profile snapshots')
+parser.add_argument('-l', '--log', help='saved debug uart log containing PROF: lines', default=None)
+parser.add_argument('-p', '--port', help='serial port device to follow', default=None)
+parser.add_argument('-r', '--baudrate', help='serial baud rate', type=int, default=921600)
+parser.add_argument('-a', '--addr', help='Bluetooth address of device', default=None)
+parser.add_argument('-n', '--count', help='snapshots to request over bluetooth', type=int, default=1)
+parser.add_argument('-t', '--interval', help='seconds between bluetooth requests', type=float, default=1.0)
+parser.add_argument('-b', '--boot', help='read the boot phase profile over bluetooth', action='store_true')
+args = parser.parse_args()
+
+if args.log:
+    read_log(args.log)
+elif args.port:
+    read_serial(args.port, args.baudrate)
+elif args.addr:
+    asyncio.run(read_ble(args.addr, args.count, args.interval, args.boot))
+else:
+    parser.print_usage()
+    sys.exit(1)
@@ -0,0 +1,230 @@
+/*
+ * Host build of the lego_train sound mixer (examples/lego_train/sound_mix.c).
+ *
+ * Plays a bank from sound_pack.py the way sound.c does on the train: 256 sample
+ * blocks at 16 kHz, a chuff every SOUND_CHUFF_TICKS wheel ticks at the commanded
+ * speed, the horn and the bell on request. The run ramps the speed up and down,
+ * writes the output to a WAV file and reports the mixing time per block, then times
+ * blocks with every clip playing at once.
+ *
+ *   gcc -O2 -I examples/lego_train tools/sound/sound_host.c examples/lego_train/sound_mix.c -o sound_host
+ *   ./sound_host sound_bank.bin train.wav
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "sound_mix.h"
+
+/* sound.h of the train, which pulls in the hal */
+#define SOUND_HORN          0
+#define SOUND_CHUFF         1
+#define SOUND_BELL          2
+#define SOUND_RATE_HZ       16000
+#define SOUND_BLOCK_SAMPLES 256
+#define SOUND_CHUFF_TICKS   40
+#define SOUND_CHUFF_THRESHOLD (SOUND_CHUFF_TICKS * SOUND_RATE_HZ)
+
+#define RUN_SECONDS 12
+#define BENCH_BLOCKS 4000
+
+static uint8_t *bank;
+static long bank_size;
+static sound_mix_t mix;
+static uint32_t chuff_acc = SOUND_CHUFF_THRESHOLD;
+static uint32_t chuffs;
+
+static int bank_read(uint32_t offset, void *buf, uint32_t len)
+{
+    if ((offset > bank_size) || (len > bank_size - offset)) {
+        return -1;
+    }
+    memcpy(buf, bank + offset, len);
+    return 0;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+/* the commanded speed over the run: up to 600 ticks/s, a stop, then backwards */
+static int32_t run_speed(uint32_t ms)
+{
+    if (ms < 1000) {
+        return 0;
+    }
+    if (ms < 4000) {
+        return (ms - 1000) / 5;
+    }
+    if (ms < 7000) {
+        return 600;
+    }
+    if (ms < 9000) {
+        return 600 - (ms - 7000) * 3 / 10;
+    }
+    if (ms < 10000) {
+        return 0;
+    }
+    return -300;
+}
+
+static int clip_playing(uint8_t clip)
+{
+    int v;
+
+    for (v = 0; v < SOUND_MIX_VOICES; v++) {
+        if (mix.voices[v].active && (mix.voices[v].clip == clip)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* sound_render() without the dac words */
+static void render(int16_t *block, int32_t target)
+{
+    uint32_t speed = (target < 0) ? -target : target;
+    uint32_t done, n, until;
+
+    if (!speed) {
+        chuff_acc = SOUND_CHUFF_THRESHOLD;
+    }
+
+    for (done = 0; done < SOUND_BLOCK_SAMPLES; done += n) {
+        n = SOUND_BLOCK_SAMPLES - done;
+
+        if (speed) {
+            if (chuff_acc >= SOUND_CHUFF_THRESHOLD) {
+                chuff_acc -= SOUND_CHUFF_THRESHOLD;
+                sound_mix_play(&mix, SOUND_CHUFF, 0x4000);
+                chuffs++;
+            }
+            until = (SOUND_CHUFF_THRESHOLD - chuff_acc + speed - 1) / speed;
+            if (until < n) {
+                n = until;
+            }
+            chuff_acc += speed * n;
+        }
+
+        sound_mix_render(&mix, &block[done], n);
+    }
+}
+
+static void write_wav_header(FILE *fh, uint32_t samples)
+{
+    uint32_t data = samples * 2;
+    uint8_t hdr[44];
+
+    memcpy(hdr, "RIFF", 4);
+    *(uint32_t *)&hdr[4] = 36 + data;
+    memcpy(&hdr[8], "WAVEfmt ", 8);
+    *(uint32_t *)&hdr[16] = 16;
+    *(uint16_t *)&hdr[20] = 1;
+    *(uint16_t *)&hdr[22] = 1;
+    *(uint32_t *)&hdr[24] = SOUND_RATE_HZ;
+    *(uint32_t *)&hdr[28] = SOUND_RATE_HZ * 2;
+    *(uint16_t *)&hdr[32] = 2;
+    *(uint16_t *)&hdr[34] = 16;
+    memcpy(&hdr[36], "data", 4);
+    *(uint32_t *)&hdr[40] = data;
+    fwrite(hdr, 1, sizeof(hdr), fh);
+}
+
+int main(int argc, char **argv)
+{
+    const uint32_t blocks = RUN_SECONDS * SOUND_RATE_HZ / SOUND_BLOCK_SAMPLES;
+    const double block_ns = SOUND_BLOCK_SAMPLES * 1e9 / SOUND_RATE_HZ;
+    int16_t block[SOUND_BLOCK_SAMPLES];
+    uint64_t start, ns, total = 0, worst = 0;
+    uint32_t i, ms;
+    FILE *fh;
+    int err;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s bank.bin out.wav\n", argv[0]);
+        return 1;
+    }
+
+    fh = fopen(argv[1], "rb");
+    if (!fh) {
+        perror(argv[1]);
+        return 1;
+    }
+    fseek(fh, 0, SEEK_END);
+    bank_size = ftell(fh);
+    rewind(fh);
+    bank = malloc(bank_size);
+    if (fread(bank, 1, bank_size, fh) != (size_t)bank_size) {
+        perror(argv[1]);
+        return 1;
+    }
+    fclose(fh);
+
+    err = sound_mix_init(&mix, bank_read, SOUND_RATE_HZ);
+    if (err) {
+        fprintf(stderr, "%s: not a sound bank (%d)\n", argv[1], err);
+        return 1;
+    }
+
+    fh = fopen(argv[2], "wb");
+    if (!fh) {
+        perror(argv[2]);
+        return 1;
+    }
+    write_wav_header(fh, blocks * SOUND_BLOCK_SAMPLES);
+
+    for (i = 0; i < blocks; i++) {
+        ms = i * SOUND_BLOCK_SAMPLES * 1000 / SOUND_RATE_HZ;
+
+        if ((ms / 16 == 2000 / 16) || (ms / 16 == 8000 / 16)) {
+            sound_mix_play(&mix, SOUND_HORN, 0x6000);
+        }
+        if ((ms / 16 == 500 / 16) || (ms / 16 == 9500 / 16)) {
+            sound_mix_play(&mix, SOUND_BELL, 0x5000);
+        }
+
+        start = now_ns();
+        render(block, run_speed(ms));
+        ns = now_ns() - start;
+
+        total += ns;
+        worst = (ns > worst) ? ns : worst;
+        fwrite(block, sizeof(block[0]), SOUND_BLOCK_SAMPLES, fh);
+    }
+    fclose(fh);
+
+    printf("%s: %u clips, %u blocks of %u samples, %u chuffs, %u clipped samples\n", argv[2], mix.clip_count, blocks,
+           SOUND_BLOCK_SAMPLES, chuffs, mix.clipped);
+    printf("run:   %.2f us per block on average, %.2f us worst, %.3f%% of the %.0f us block\n", total / 1e3 / blocks,
+           worst / 1e3, 100.0 * total / blocks / block_ns, block_ns / 1e3);
+
+    /* every clip at once, restarted as soon as it ends */
+    total = 0;
+    worst = 0;
+    for (i = 0; i < BENCH_BLOCKS; i++) {
+        for (uint8_t c = 0; c < mix.clip_count && c < SOUND_MIX_VOICES; c++) {
+            if (!clip_playing(c)) {
+                sound_mix_play(&mix, c, 0x3000);
+            }
+        }
+
+        start = now_ns();
+        sound_mix_render(&mix, block, SOUND_BLOCK_SAMPLES);
+        ns = now_ns() - start;
+
+        total += ns;
+        worst = (ns > worst) ? ns : worst;
+    }
+
+    printf("busy:  %.2f us per block with %u voices, %.2f us worst, %.1f ns per output sample\n",
+           total / 1e3 / BENCH_BLOCKS, mix.clip_count < SOUND_MIX_VOICES ? mix.clip_count : SOUND_MIX_VOICES,
+           worst / 1e3, (double)total / BENCH_BLOCKS / SOUND_BLOCK_SAMPLES);
+
+    return 0;
+}
@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+
+# Build the clip bank that examples/lego_train/sound.c plays from the media partition.
+#
+# The bank holds a header, a clip table and the samples, see sound_mix.h. The clips are
+# the horn, the chuff and the bell, in that order, as the train's SOUND_ ids expect. Each
+# one comes from a mono 16 bit WAV file, or from a small synthesizer when no file is
+# given. Clips are IMA ADPCM unless --pcm is set. The result must fit SOUND_BANK_SIZE.
+# Flash it at 0xFB000. --preview writes each clip as the mixer decodes it.
+#
+#   sound_pack.py -o sound_bank.bin
+#   sound_pack.py --horn horn.wav --bell bell.wav -o sound_bank.bin --preview out/
+
+import os
+import sys
+import math
+import wave
+import random
+import struct
+import argparse
+
+SOUND_BANK_MAGIC = 0x31444E53
+SOUND_BANK_SIZE = 0x2000
+SOUND_RATE_HZ = 16000
+HEADER_FORMAT = "<IHH"
+CLIP_FORMAT = "<IIHBB"
+SOUND_FMT_PCM16 = 0
+SOUND_FMT_ADPCM = 1
+
+CLIPS = ["horn", "chuff", "bell"]
+SYNTH_RATE = 8000
+
+ADPCM_STEPS = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+    107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871,
+    5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+    27086, 29794, 32767
+]
+ADPCM_INDEX_ADJUST = [-1, -1, -1, -1, 2, 4, 6, 8]
+
+
+def clamp16(v):
+    return max(-32768, min(32767, int(v)))
+
+
+def adpcm_decode(code, predictor, index):
+    """sound_mix_adpcm_decode(), the encoder runs it to stay in step with the train."""
+    step = ADPCM_STEPS[index]
+    diff = step >> 3
+    if code & 4:
+        diff += step
+    if code & 2:
+        diff += step >> 1
+    if code & 1:
+        diff += step >> 2
+    predictor = clamp16(predictor - diff if code & 8 else predictor + diff)
+    index = max(0, min(88, index + ADPCM_INDEX_ADJUST[code & 7]))
+    return predictor, index
+
+
+def adpcm_encode(samples):
+    predictor, index = samples[0] if samples else 0, 0
+    data = bytearray(struct.pack("<hBB", predictor, index, 0))
+    decoded = []
+    byte = None
+    for s in samples:
+        step = ADPCM_STEPS[index]
+        diff = s - predictor
+        code = 0
+        if diff < 0:
+            code = 8
+            diff = -diff
+        if diff >= step:
+            code |= 4
+            diff -= step
+        if diff >= step >> 1:
+            code |= 2
+            diff -= step >> 1
+        if diff >= step >> 2:
+            code |= 1
+        predictor, index = adpcm_decode(code, predictor, index)
+        decoded.append(predictor)
+        if byte is None:
+            byte = code
+        else:
+            data.append(byte | code << 4)
+            byte = None
+    if byte is not None:
+        data.append(byte)
+    return bytes(data), decoded
+
+
+def envelope(i, n, attack, release):
+    return min(1.0, i / max(attack, 1), (n - i) / max(release, 1))
+
+
+def synth_horn(rate):
+    """A three note steam whistle with some breath in it."""
+    n = int(0.9 * rate)
+    rnd = random.Random(1)
+    out, noise = [], 0.0
+    for i in range(n):
+        t = i / rate
+        noise += (rnd.uniform(-1, 1) - noise) * 0.3
+        v = sum(math.sin(2 * math.pi * f * t) + 0.3 * math.sin(4 * math.pi * f * t) for f in (466.2, 554.4, 698.5))
+        out.append(clamp16(9000 * envelope(i, n, 0.04 * rate, 0.12 * rate) * (v / 3.9 + 0.15 * noise)))
+    return out
+
+
+def synth_chuff(rate):
+    """A burst of low passed noise that dies away."""
+    n = int(0.12 * rate)
+    rnd = random.Random(2)
+    out, lp = [], 0.0
+    for i in range(n):
+        lp += (rnd.uniform(-1, 1) - lp) * 0.35
+        out.append(clamp16(26000 * lp * min(1.0, i / (0.005 * rate)) * math.exp(-i / (0.03 * rate))))
+    return out
+
+
+def synth_bell(rate):
+    """One strike with inharmonic partials."""
+    n = int(0.8 * rate)
+    partials = ((1.0, 1.0, 0.35), (2.76, 0.5, 0.2), (5.40, 0.25, 0.1))
+    out = []
+    for i in range(n):
+        t = i / rate
+        v = sum(a * math.exp(-t / d) * math.sin(2 * math.pi * 880 * r * t) for r, a, d in partials)
+        out.append(clamp16(14000 * v * min(1.0, i / (0.002 * rate))))
+    return out
+
+
+SYNTH = {"horn": synth_horn, "chuff": synth_chuff, "bell": synth_bell}
+
+
+def read_wav(filename):
+    with wave.open(filename, "rb") as w:
+        if w.getsampwidth() != 2:
+            raise SystemExit("%s: only 16 bit samples" % filename)
+        rate, channels = w.getframerate(), w.getnchannels()
+        frames = w.readframes(w.getnframes())
+    if rate > SOUND_RATE_HZ:
+        raise SystemExit("%s: %d Hz is above the %d Hz of the dac" % (filename, rate, SOUND_RATE_HZ))
+    samples = struct.unpack("<%dh" % (len(frames) // 2), frames)
+    return list(samples[::channels]), rate
+
+
+def write_wav(filename, samples, rate):
+    with wave.open(filename, "wb") as w:
+        w.setnchannels(1)
+        w.setsampwidth(2)
+        w.setframerate(rate)
+        w.writeframes(struct.pack("<%dh" % len(samples), *samples))
+
+
+parser = argparse.ArgumentParser(description='Build the lego_train sound bank')
+for name in CLIPS:
+    parser.add_argument('--' + name, help='mono 16 bit WAV for the %s, synthesized when left out' % name, default=None)
+parser.add_argument('--pcm', help='store 16 bit PCM instead of ADPCM', action='store_true')
+parser.add_argument('--preview', help='directory for WAV files of the clips as the train decodes them', default=None)
+parser.add_argument('-o', '--output', help='bank image to write', required=True)
+args = parser.parse_args()
+
+table = bytearray()
+data = bytearray()
+offset = struct.calcsize(HEADER_FORMAT) + len(CLIPS) * struct.calcsize(CLIP_FORMAT)
+
+for name in CLIPS:
+    filename = getattr(args, name)
+    samples, rate = read_wav(filename) if filename else (SYNTH[name](SYNTH_RATE), SYNTH_RATE)
+
+    if args.pcm:
+        clip, fmt, decoded = struct.pack("<%dh" % len(samples), *samples), SOUND_FMT_PCM16, samples
+    else:
+        (clip, decoded), fmt = adpcm_encode(samples), SOUND_FMT_ADPCM
+
+    table += struct.pack(CLIP_FORMAT, offset + len(data), len(samples), rate, fmt, 0)
+    data += clip
+    print("%-6s %5d samples at %5d Hz, %.2f s, %5d bytes %s" %
+          (name, len(samples), rate, len(samples) / rate, len(clip), "pcm" if args.pcm else "adpcm"))
+
+    if args.preview:
+        os.makedirs(args.preview, exist_ok=True)
+        write_wav(os.path.join(args.preview, name + ".wav"), decoded, rate)
+
+bank = struct.pack(HEADER_FORMAT, SOUND_BANK_MAGIC, len(CLIPS), 0) + table + data
+print("bank %d of %d bytes" % (len(bank), SOUND_BANK_SIZE))
+if len(bank) > SOUND_BANK_SIZE:
+    print("too big for the partition")
+    sys.exit(1)
+
+with open(args.output, "wb") as fh:
+    fh.write(bank)
+print("wrote %s" % args.output)
@@ -0,0 +1,195 @@
+/*
+ * Host build of the lego_train speed loop (examples/lego_train/speed_ctrl.c) on a
+ * simulated motor plant.
+ *
+ * The motor has a first order speed response and a dead band; the duty it sees scales
+ * with the battery and a hill takes part of it. The wheel ticks reach the loop the way
+ * odometry.c hands them over: the QDEC adds them up and reports every 5 ms, so the loop
+ * only sees the ticks of the last report. The loop wakes every 10 ms with some jitter,
+ * runs speed_loop.c, the fixed point pid with the default gains and the sag compensation
+ * of the firmware, and updates the duty. A course of speed changes, hills and a sagging battery is driven once in
+ * closed loop and once with the fixed duty that holds each speed on the flat at full
+ * battery. Each segment of the course passes when the closed loop holds the speed over
+ * its last second within SIM_MAX_ERROR; the open loop shows what it holds instead.
+ * Loop latency and tracking error are kept by speed_loop_update_stats().
+ *
+ *   gcc -O2 -I common/pid -I examples/lego_train tools/speed_ctrl/speed_ctrl_sim.c \
+ *       examples/lego_train/speed_loop.c examples/lego_train/autotune.c common/pid/pid_q.c \
+ *       -lm -o speed_ctrl_sim
+ *   ./speed_ctrl_sim
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "odometry.h"
+#include "speed_loop.h"
+
+/* the plant runs in steps of this many us */
+#define SIM_STEP_US       100
+/* wake up of the loop after the tick, 0 to this many us */
+#define SIM_JITTER_US     300
+/* wake up to the new duty */
+#define SIM_LATENCY_US    40
+#define SIM_SEGMENT_MS    3000
+/* of the target, over the last second of a segment */
+#define SIM_MAX_ERROR     5.0
+
+typedef struct {
+    int32_t target;  /* ticks/s */
+    double hill;     /* % of duty the slope takes */
+    uint32_t vbat_mv;
+} segment_t;
+
+typedef struct {
+    double gain;     /* ticks/s per % of duty past the dead band */
+    double tau_s;
+    double deadband; /* % of duty */
+} motor_t;
+
+static const motor_t motor = { 9.0, 0.3, 12.0 };
+
+static const segment_t course[] = {
+    { 300, 0.0, 3300 },
+    { 300, 8.0, 3300 },   /* up a hill */
+    { 300, -6.0, 3300 },  /* and down again */
+    { 600, 0.0, 3300 },
+    { 600, 8.0, 3300 },
+    { 600, 0.0, 2800 },   /* the battery sags */
+    { 300, 0.0, 2600 },
+    { -300, 0.0, 3300 },  /* reverse */
+    { -300, 8.0, 3300 },
+};
+
+#define COURSE_LEN (sizeof(course) / sizeof(course[0]))
+
+static int failed;
+
+static uint32_t rand_us(uint32_t max)
+{
+    return (uint32_t)rand() % (max + 1);
+}
+
+/* the duty that holds the speed on the flat at full battery */
+static int32_t open_loop_duty(int32_t target)
+{
+    double duty = abs(target) / motor.gain + motor.deadband;
+
+    return (int32_t)copysign(floor(duty + 0.5), target);
+}
+
+/*
+ * the course in closed or open loop; the mean true speed over the last second of each segment,
+ * and the age of the newest tick report when the loop read it
+ */
+static void drive(int closed, double held[COURSE_LEN], speed_ctrl_stats_t *s, uint32_t *report_age_max_us)
+{
+    const autotune_gains_t gains = { SPEED_CTRL_KP, SPEED_CTRL_KI, SPEED_CTRL_KD };
+    const uint32_t period_us = SPEED_CTRL_PERIOD_MS * 1000;
+    const uint32_t end_us = COURSE_LEN * SIM_SEGMENT_MS * 1000;
+    const double dt = SIM_STEP_US / 1e6;
+    pid_q_alg_t pid;
+    double velocity = 0, position = 0, drive, sum = 0;
+    int32_t qdec_last = 0, ticks = 0, last_ticks = 0, target = 0, out, duty = 0, pending = 0;
+    uint32_t t, report_us = 0, wake_us = period_us + rand_us(SIM_JITTER_US), apply_us = UINT32_MAX;
+    unsigned seg, samples = 0;
+
+    memset(s, 0, sizeof(*s));
+    *report_age_max_us = 0;
+    speed_loop_reset(&pid, &gains);
+
+    for (t = 0; t < end_us; t += SIM_STEP_US) {
+        const segment_t *sg = &course[t / (SIM_SEGMENT_MS * 1000)];
+        seg = t / (SIM_SEGMENT_MS * 1000);
+
+        /* the motor */
+        drive = duty * (double)sg->vbat_mv / SPEED_CTRL_VBAT_NOMINAL_MV;
+        drive = (fabs(drive) > motor.deadband) ? (drive - copysign(motor.deadband, drive)) : 0;
+        /* uphill against the direction of travel */
+        if (drive != 0) {
+            drive -= (drive > 0) ? sg->hill : -sg->hill;
+        }
+        velocity += (motor.gain * drive - velocity) * dt / motor.tau_s;
+        position += velocity * dt;
+
+        /* odometry_qdec_callback() */
+        if (t - report_us >= ODOMETRY_REPORT_PERIOD_US) {
+            report_us += ODOMETRY_REPORT_PERIOD_US;
+            ticks += (int32_t)floor(position) - qdec_last;
+            qdec_last = (int32_t)floor(position);
+        }
+
+        if (t >= apply_us) {
+            duty = pending;
+            apply_us = UINT32_MAX;
+        }
+
+        /* speed_ctrl_task_entry() */
+        if (t >= wake_us) {
+            int32_t measured = (ticks - last_ticks) * (1000 / SPEED_CTRL_PERIOD_MS);
+
+            last_ticks = ticks;
+
+            /* changing direction restarts the loop from rest */
+            if ((sg->target > 0) != (target > 0)) {
+                speed_loop_reset(&pid, &gains);
+            }
+            target = sg->target;
+
+            if (closed) {
+                out = speed_loop_pid(&pid, target, measured);
+                pending = speed_loop_sag_compensate(out, sg->vbat_mv);
+            } else {
+                pending = open_loop_duty(target);
+            }
+            apply_us = t + SIM_LATENCY_US;
+
+            *report_age_max_us = (t - report_us > *report_age_max_us) ? t - report_us : *report_age_max_us;
+            speed_loop_update_stats(s, target, measured, SIM_LATENCY_US, t % period_us);
+            wake_us = (t / period_us + 1) * period_us + rand_us(SIM_JITTER_US);
+        }
+
+        /* the last second of the segment */
+        if ((t % (SIM_SEGMENT_MS * 1000)) >= (SIM_SEGMENT_MS - 1000) * 1000) {
+            sum += velocity;
+            samples++;
+        }
+        if ((t + SIM_STEP_US) % (SIM_SEGMENT_MS * 1000) == 0) {
+            held[seg] = sum / samples;
+            sum = 0;
+            samples = 0;
+        }
+    }
+}
+
+int main(void)
+{
+    double closed[COURSE_LEN], open[COURSE_LEN];
+    double closed_err, open_err;
+    speed_ctrl_stats_t cs, os;
+    uint32_t report_age_max_us, open_report_age_max_us;
+    unsigned i;
+
+    srand(1);
+    drive(1, closed, &cs, &report_age_max_us);
+    drive(0, open, &os, &open_report_age_max_us);
+
+    printf("target  hill  vbat   closed loop         open loop\n");
+    for (i = 0; i < COURSE_LEN; i++) {
+        closed_err = 100.0 * (closed[i] - course[i].target) / abs(course[i].target);
+        open_err = 100.0 * (open[i] - course[i].target) / abs(course[i].target);
+
+        printf("%6d %4.0f%% %5u  %6.0f (%+5.1f %%)   %6.0f (%+5.1f %%)%s\n", course[i].target, course[i].hill,
+               course[i].vbat_mv, closed[i], closed_err, open[i], open_err,
+               (fabs(closed_err) > SIM_MAX_ERROR) ? "  FAIL" : "");
+        failed |= (fabs(closed_err) > SIM_MAX_ERROR);
+    }
+
+    printf("%u loops, latency avg %u us max %u us, jitter max %u us, report age max %u us\n", cs.loops,
+           cs.latency_avg_us, cs.latency_max_us, cs.jitter_max_us, report_age_max_us);
+    printf("tracking error on the measured ticks: avg %u max %u ticks/s closed, avg %u max %u ticks/s open\n",
+           cs.error_avg, cs.error_max, os.error_avg, os.error_max);
+
+    return failed;
+}
@@ -0,0 +1,284 @@
+/*
+ * Host build of the lego_train task supervisor (examples/lego_train/task_wdg.c) with
+ * injected faults.
+ *
+ * A millisecond scheduler runs the tasks of the train as watchdog.c sees them: power
+ * sensing every 2 ms, the speed loop every 10 ms and the sound every 16 ms while the
+ * train moves, BLE commands and log output now and then, and the idle task feeding a
+ * 2 s hardware watchdog whenever nothing keeps it from running. The deadline check
+ * runs every 10 ms like the tick hook. Tickless PDS sleep stops the ticks, the tasks
+ * and the hardware counter. Each run injects one fault and states which task the reset
+ * record must name, or that there must be no reset: hung tasks, tasks that slow down,
+ * tasks that stall and recover, a task that keeps the idle task from running, and a
+ * sleep the supervisor is not told about.
+ *
+ *   gcc -O2 -I examples/lego_train tools/task_wdg/task_wdg_sim.c examples/lego_train/task_wdg.c -o task_wdg_sim
+ *   ./task_wdg_sim
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "task_wdg.h"
+
+/* watchdog.h of the train, which pulls in FreeRTOS */
+#define WATCHDOG_IDLE_MS  1000
+#define WATCHDOG_CHECK_MS 10
+/* 0xFFFF at 32 kHz */
+#define HW_TIMEOUT_MS     2000
+
+#define RUN_MS            40000
+/* the train moves in between, with the speed loop and the sound running */
+#define MOVE_START_MS     2000
+#define MOVE_END_MS       20000
+/* tickless PDS sleep while stopped */
+#define SLEEP_START_MS    25000
+#define SLEEP_MS          5000
+
+enum {
+    TASK_MAIN,
+    TASK_SPEED,
+    TASK_POWER,
+    TASK_SOUND,
+    TASK_LOG,
+    TASK_COUNT
+};
+
+enum {
+    RUNS_ALWAYS,   /* checks in every period */
+    RUNS_MOVING,   /* checks in every period while the train moves, else waits */
+    RUNS_EVENTS,   /* waits for an event every period, busy for a few ms on each */
+};
+
+typedef struct {
+    const char *name;
+    uint32_t deadline_ms;
+    uint8_t runs;
+    uint32_t period_ms;
+    uint32_t busy_ms;
+    /* state of a run */
+    int id;
+    bool waiting;
+    uint32_t next_ms;
+} sim_task_t;
+
+enum {
+    FAULT_NONE,
+    FAULT_HANG,     /* stops where it is, for good */
+    FAULT_SLOW,     /* the period grows 5 ms every 100 ms, up to a cap */
+    FAULT_STALL,    /* no check-ins for a while, then back to normal */
+    FAULT_QUIET,    /* no events for a while, the task waits meanwhile */
+    FAULT_HOG,      /* spins for a while, the idle task and the log do not run */
+    FAULT_UNPAUSED, /* the sleep is not told to the supervisor */
+};
+
+typedef struct {
+    const char *name;
+    uint8_t fault;
+    uint8_t task;
+    uint32_t at_ms;
+    uint32_t len_ms;  /* or the cap of the period */
+    const char *expect; /* the late task of the record, NULL for no reset */
+} scenario_t;
+
+/* the deadlines of the train */
+static sim_task_t tasks[TASK_COUNT] = {
+    [TASK_MAIN] = { "main", 3000, RUNS_EVENTS, 700, 5 },
+    [TASK_SPEED] = { "speed_ctrl", 500, RUNS_MOVING, 10 },
+    [TASK_POWER] = { "power_sense", 500, RUNS_ALWAYS, 2 },
+    [TASK_SOUND] = { "sound", 200, RUNS_MOVING, 16 },
+    [TASK_LOG] = { "log", 2000, RUNS_EVENTS, 300, 2 },
+};
+
+static const scenario_t scenarios[] = {
+    { "healthy", FAULT_NONE, 0, 0, 0, NULL },
+    { "hung speed loop", FAULT_HANG, TASK_SPEED, 8000, 0, "speed_ctrl" },
+    { "hung command", FAULT_HANG, TASK_MAIN, 4902, 0, "main" },
+    { "hung adc", FAULT_HANG, TASK_POWER, 30500, 0, "power_sense" },
+    { "slowing speed loop", FAULT_SLOW, TASK_SPEED, 6000, 1000, "speed_ctrl" },
+    { "slow adc", FAULT_SLOW, TASK_POWER, 6000, 400, NULL },
+    { "sound stall 150 ms", FAULT_STALL, TASK_SOUND, 9000, 150, NULL },
+    { "sound stall 400 ms", FAULT_STALL, TASK_SOUND, 9000, 400, "sound" },
+    { "no command 30 s", FAULT_QUIET, TASK_MAIN, 3000, 30000, NULL },
+    { "busy command 600 ms", FAULT_HOG, TASK_MAIN, 7000, 600, NULL },
+    { "spinning command", FAULT_HOG, TASK_MAIN, 7000, 5000, "idle" },
+    { "sleep not paused", FAULT_UNPAUSED, 0, 0, 0, "power_sense" },
+};
+
+static bool sim_window(uint32_t t, uint32_t start, uint32_t len)
+{
+    return (t >= start) && (t - start < len);
+}
+
+/* whether the task has work at t */
+static bool sim_active(const scenario_t *sc, uint8_t i, uint32_t t)
+{
+    const sim_task_t *task = &tasks[i];
+
+    if ((sc->fault == FAULT_QUIET) && (sc->task == i) && sim_window(t, sc->at_ms, sc->len_ms)) {
+        return false;
+    }
+
+    switch (task->runs) {
+        case RUNS_MOVING:
+            return sim_window(t, MOVE_START_MS, MOVE_END_MS - MOVE_START_MS);
+        case RUNS_EVENTS:
+            return (t % task->period_ms) < task->busy_ms;
+        default:
+            return true;
+    }
+}
+
+static uint32_t sim_period(const scenario_t *sc, uint8_t i, uint32_t t)
+{
+    uint32_t period = (tasks[i].runs == RUNS_EVENTS) ? 1 : tasks[i].period_ms;
+
+    if ((sc->fault == FAULT_SLOW) && (sc->task == i) && (t >= sc->at_ms)) {
+        period += (t - sc->at_ms) / 100 * 5;
+        period = (period > sc->len_ms) ? sc->len_ms : period;
+    }
+
+    return period;
+}
+
+static void sim_task_step(task_wdg_t *wdg, const scenario_t *sc, uint8_t i, uint32_t t, bool hog)
+{
+    sim_task_t *task = &tasks[i];
+
+    if ((sc->task == i) && (((sc->fault == FAULT_HANG) && (t >= sc->at_ms)) ||
+                            ((sc->fault == FAULT_STALL) && sim_window(t, sc->at_ms, sc->len_ms)) ||
+                            ((sc->fault == FAULT_HOG) && hog))) {
+        return;
+    }
+
+    /* below the spinning task */
+    if (hog && (i == TASK_LOG)) {
+        return;
+    }
+
+    if (!sim_active(sc, i, t)) {
+        if (!task->waiting) {
+            task_wdg_block(wdg, task->id);
+            task->waiting = true;
+        }
+        return;
+    }
+
+    if (task->waiting || (t >= task->next_ms)) {
+        task_wdg_checkin(wdg, task->id, t);
+        task->waiting = false;
+        task->next_ms = t + sim_period(sc, i, t);
+    }
+}
+
+static int sim_run(const scenario_t *sc)
+{
+    task_wdg_t wdg;
+    const task_wdg_entry_t *entry;
+    bool recorded = false;
+    char running[16] = "";
+    uint32_t hw_ms = 0;
+    uint32_t t;
+    int idle, id;
+    uint8_t i;
+    bool hog;
+
+    task_wdg_init(&wdg);
+    idle = task_wdg_register(&wdg, "idle", WATCHDOG_IDLE_MS);
+    for (i = 0; i < TASK_COUNT; i++) {
+        tasks[i].id = task_wdg_register(&wdg, tasks[i].name, tasks[i].deadline_ms);
+        tasks[i].waiting = true;
+        tasks[i].next_ms = 0;
+    }
+
+    for (t = 0; t < RUN_MS; t++) {
+        /* no ticks, no tasks and no hardware counter in pds; power sensing stops with the adc */
+        if (sim_window(t, SLEEP_START_MS, SLEEP_MS)) {
+            if ((t == SLEEP_START_MS) && (sc->fault != FAULT_UNPAUSED)) {
+                task_wdg_pause(&wdg, t);
+            }
+            continue;
+        }
+        if (t == SLEEP_START_MS + SLEEP_MS) {
+            task_wdg_resume(&wdg, t);
+            /* the adc restarts after wake up and fills a block first */
+            tasks[TASK_POWER].next_ms = t + tasks[TASK_POWER].period_ms;
+        }
+
+        hog = (sc->fault == FAULT_HOG) && sim_window(t, sc->at_ms, sc->len_ms);
+
+        for (i = 0; i < TASK_COUNT; i++) {
+            sim_task_step(&wdg, sc, i, t, hog);
+        }
+
+        /* watchdog_feed() */
+        if (!hog) {
+            task_wdg_checkin(&wdg, idle, t);
+            id = task_wdg_check(&wdg, t);
+            if (id < 0) {
+                hw_ms = 0;
+            } else if (!recorded) {
+                strcpy(running, "IDLE");
+                recorded = true;
+            }
+        }
+
+        /* watchdog_tick() */
+        if (t % WATCHDOG_CHECK_MS == 0) {
+            id = task_wdg_check(&wdg, t);
+            if ((id >= 0) && !recorded) {
+                strcpy(running, hog ? tasks[sc->task].name : "IDLE");
+                recorded = true;
+            }
+        }
+
+        if (++hw_ms >= HW_TIMEOUT_MS) {
+            break;
+        }
+    }
+
+    printf("%-20s ", sc->name);
+
+    if (t >= RUN_MS) {
+        printf("no reset, worst gaps:");
+        for (i = 0; i < TASK_COUNT; i++) {
+            printf(" %s %u", tasks[i].name, wdg.entries[tasks[i].id].worst_ms);
+        }
+        printf(" ms\n");
+        return sc->expect ? -1 : 0;
+    }
+
+    if (!recorded) {
+        printf("reset at %u ms without a record\n", t);
+        return -1;
+    }
+
+    entry = &wdg.entries[wdg.fault];
+    printf("reset at %u ms: %s late by %u ms (deadline %u ms) at %u ms, %s running, worst gap %u ms\n", t,
+           entry->name, wdg.late_ms, entry->deadline_ms, wdg.fault_ms, running, entry->worst_ms);
+
+    /* found on the first check after the deadline, or on wake up after a sleep nothing checks in;
+     * reset by the hardware after that */
+    if (!sc->expect || strcmp(sc->expect, entry->name) ||
+        ((wdg.late_ms > WATCHDOG_CHECK_MS) && (sc->fault != FAULT_UNPAUSED)) || (t - wdg.fault_ms > HW_TIMEOUT_MS)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    int failed = 0;
+    uint8_t i;
+
+    for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        if (sim_run(&scenarios[i])) {
+            printf("  FAILED, expected %s\n", scenarios[i].expect ? scenarios[i].expect : "no reset");
+            failed++;
+        }
+    }
+
+    printf("%u runs, %d failed\n", (unsigned)(sizeof(scenarios) / sizeof(scenarios[0])), failed);
+    return failed ? 1 : 0;
+}
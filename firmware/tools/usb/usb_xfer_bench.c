@@ -0,0 +1,478 @@
+/*
+ * Host build of the bulk/interrupt transfer engine of the USB driver
+ * (drivers/bl702_driver/hal_drv/src/hal_usb.c) against a loopback stand-in of the
+ * endpoint registers, for the packet sequence and the cost of moving data through
+ * the fifos.
+ *
+ * USB_BASE points at a block of host memory, so the fifo data registers are plain
+ * volatile bytes: a store replaces the last one, a load returns what the host put
+ * there. The USB_* register functions are the host side. An armed IN endpoint is
+ * drained at once and raises its CMD interrupt. An armed OUT endpoint receives the
+ * next packet of what the host has to send and raises DONE, with a zero length
+ * packet after a full last one. The byte the host puts
+ * in the rx register changes with every packet, and the last byte of each IN packet
+ * is checked, so misplaced bytes and wrong word order show up.
+ *
+ * Checks: IN transfers of 0 to 4097 bytes with a zero length packet after a full
+ * last packet; OUT transfers that end on a short packet and on a full buffer; both at
+ * every buffer alignment; and the zero length packet of the ring buffer path. Then
+ * 64 MB each way, as 4 KB engine transfers and through a 4 KB ring buffer the way
+ * the CDC class drives it, median of 5 runs. The figures are host CPU time for the
+ * driver side of the copy, not bus throughput.
+ *
+ *   gcc -O2 -no-pie -I drivers/bl702_driver/hal_drv/inc -I drivers/bl702_driver/hal_drv/src -I drivers/bl702_driver/std_drv/inc \
+ *       -I drivers/bl702_driver/regs -I drivers/bl702_driver/startup -I drivers/bl702_driver/risc-v/Core/Include -I bsp/board/bl702 \
+ *       -I common/device -I common/list -I common/ring_buffer -I common/misc -I common/soft_crc \
+ *       -include stdint.h -DBL702 -DARCH_RISCV -Dbl702_lego_train \
+ *       tools/usb/usb_xfer_bench.c common/ring_buffer/ring_buffer.c common/misc/misc.c -o usb_xfer_bench
+ *   ./usb_xfer_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hal_usb.h"
+#include "bl702_usb.h"
+#include "ring_buffer.h"
+
+/* register block of the stand-in, at a 32 bit address like on the chip (-no-pie) */
+static uint8_t usb_regs[0x400] __attribute__((aligned(4)));
+
+#undef USB_BASE
+#define USB_BASE ((uint32_t)(uintptr_t)usb_regs)
+
+#include "hal_usb.c"
+
+#define EP_IN       1
+#define EP_OUT      2
+#define EP_MPS      64
+#define BENCH_TOTAL (64 * 1024 * 1024)
+#define BENCH_UNIT  4096
+#define BENCH_RUNS  5
+
+static struct {
+    uint8_t rdy[8];            /* armed, the host has not taken or sent the packet yet */
+    uint32_t int_sts;
+    uint16_t rx_cnt[8];
+
+    /* IN: where the data comes from and how much of it the driver has consumed */
+    const uint8_t *in_src;
+    uint32_t (*in_consumed)(void);
+    uint32_t in_taken;
+    uint32_t in_packets;
+    uint32_t in_zlps;
+    uint32_t in_short;         /* packets shorter than EP_MPS that were not the last one */
+    uint32_t in_last_len;
+
+    /* OUT: what the host still has to send, and whether a zero length packet ends it */
+    uint32_t out_left;
+    uint8_t out_zlp;
+    uint32_t out_packets;
+    uint8_t out_fill;
+
+    uint32_t errors;
+    uint8_t check;             /* verify every packet, off while benchmarking */
+} host;
+
+static void host_error(const char *what, uint32_t a, uint32_t b)
+{
+    if (host.errors++ < 5) {
+        printf("  %s: %u %u\n", what, a, b);
+    }
+}
+
+BL_Err_Type USB_Set_EPx_Rdy(USB_EP_ID epId)
+{
+    volatile uint8_t *tx = (volatile uint8_t *)(uintptr_t)USB_DC_EP_TX_FIFO(epId);
+    volatile uint8_t *rx = (volatile uint8_t *)(uintptr_t)USB_DC_EP_RX_FIFO(epId);
+    uint32_t consumed, len;
+
+    host.rdy[epId] = 1;
+
+    if (epId == EP_IN) {
+        consumed = host.in_consumed();
+        len = consumed - host.in_taken;
+
+        if (host.check) {
+            if (len > EP_MPS) {
+                host_error("IN packet too long", host.in_packets, len);
+            }
+            if (host.in_last_len < EP_MPS && host.in_packets && host.in_last_len) {
+                host.in_short++;
+            }
+            if (len && *tx != host.in_src[consumed - 1]) {
+                host_error("IN packet ends in the wrong byte", host.in_packets, consumed);
+            }
+        }
+
+        if (!len) {
+            host.in_zlps++;
+        }
+
+        host.in_last_len = len;
+        host.in_taken = consumed;
+        host.in_packets++;
+        host.rdy[epId] = 0;
+        host.int_sts |= 1U << (USB_INT_EP0_OUT_CMD + 2 * epId);
+    } else if (epId == EP_OUT && (host.out_left || host.out_zlp)) {
+        len = host.out_left < EP_MPS ? host.out_left : EP_MPS;
+        host.out_left -= len;
+        host.out_zlp &= (len != 0);
+        host.out_fill = 0x11 + host.out_packets * 37;
+        *rx = host.out_fill;
+        host.rx_cnt[epId] = len;
+        host.out_packets++;
+        host.rdy[epId] = 0;
+        host.int_sts |= 1U << (USB_INT_EP0_OUT_CMD + 2 * epId + 1);
+    }
+
+    return SUCCESS;
+}
+
+BL_Sts_Type USB_Is_EPx_RDY_Free(USB_EP_ID epId)
+{
+    return host.rdy[epId] ? RESET : SET;
+}
+
+BL_Sts_Type USB_Get_IntStatus(USB_INT_Type intType)
+{
+    return (host.int_sts & (1U << intType)) ? SET : RESET;
+}
+
+BL_Err_Type USB_Clr_IntStatus(USB_INT_Type intType)
+{
+    host.int_sts &= ~(1U << intType);
+    return SUCCESS;
+}
+
+uint16_t USB_Get_EPx_RX_FIFO_CNT(USB_EP_ID epId)
+{
+    return host.rx_cnt[epId];
+}
+
+uint16_t USB_Get_EPx_TX_FIFO_CNT(USB_EP_ID epId)
+{
+    return host.rdy[epId] ? 0 : EP_MPS;
+}
+
+/* the rest of the chip hal_usb.c links against, unused here */
+BL_Err_Type GLB_AHB_Slave1_Reset(BL_AHB_Slave1_Type slave1) { return SUCCESS; }
+void Interrupt_Handler_Register(IRQn_Type irq, pFunc interruptFun) {}
+void clic_enable_interrupt(uint32_t source) {}
+void clic_disable_interrupt(uint32_t source) {}
+void cpu_global_irq_enable(void) {}
+void cpu_global_irq_disable(void) {}
+void mtimer_delay_ms(uint32_t time) {}
+int device_control(struct device *dev, int cmd, void *args) { return 0; }
+BL_Err_Type USB_Enable(void) { return SUCCESS; }
+BL_Err_Type USB_Disable(void) { return SUCCESS; }
+BL_Err_Type USB_Set_Config(BL_Fun_Type enable, USB_Config_Type *usbCfg) { return SUCCESS; }
+BL_Err_Type USB_Set_Device_Addr(uint8_t addr) { return SUCCESS; }
+BL_Err_Type USB_Set_EPx_Config(USB_EP_ID epId, EP_Config_Type *epCfg) { return SUCCESS; }
+BL_Err_Type USB_Set_EPx_Xfer_Size(USB_EP_ID epId, uint8_t size) { return SUCCESS; }
+BL_Err_Type USB_Set_EPx_Status(USB_EP_ID epId, USB_EP_STATUS_Type epStatus) { return SUCCESS; }
+USB_EP_STATUS_Type USB_Get_EPx_Status(USB_EP_ID epId) { return USB_EP_STATUS_ACK; }
+BL_Err_Type USB_Set_EPx_TX_DMA_Interface_Config(USB_EP_ID epId, BL_Fun_Type newState) { return SUCCESS; }
+BL_Err_Type USB_Set_EPx_RX_DMA_Interface_Config(USB_EP_ID epId, BL_Fun_Type newState) { return SUCCESS; }
+BL_Err_Type USB_IntEn(USB_INT_Type intType, uint8_t enable) { return SUCCESS; }
+BL_Err_Type USB_IntMask(USB_INT_Type intType, BL_Mask_Type intMask) { return SUCCESS; }
+
+static void host_reset(void)
+{
+    memset(&host, 0, sizeof(host));
+    host.check = 1;
+    usb_fs_device.in_ep[EP_IN].xfer.busy = 0;
+    usb_fs_device.in_ep[EP_IN].xfer.zlp = 0;
+    usb_fs_device.out_ep[EP_OUT].xfer.busy = 0;
+    usb_fs_device.out_ep[EP_OUT].xfer.nak = 0;
+}
+
+static uint32_t xfer_done_actual;
+static int xfer_done_calls;
+
+static void xfer_done(struct device *dev, uint8_t ep, uint32_t actual)
+{
+    xfer_done_actual = actual;
+    xfer_done_calls++;
+}
+
+static uint32_t engine_in_consumed(void)
+{
+    return usb_fs_device.in_ep[EP_IN].xfer.actual;
+}
+
+/* one IN transfer through the engine, the isr runs until it is done */
+static int engine_in(uint8_t *buf, uint32_t len)
+{
+    xfer_done_calls = 0;
+    host.in_src = buf;
+    host.in_consumed = engine_in_consumed;
+    host.in_taken = 0;
+
+    if (usb_dc_ep_xfer_start(&usb_fs_device.parent, USB_SET_EP_IN(EP_IN), buf, len, xfer_done) != 0) {
+        return -1;
+    }
+    while (!xfer_done_calls) {
+        usb_dc_isr(&usb_fs_device);
+    }
+    /* the zero length packet goes out after done */
+    while (host.int_sts) {
+        usb_dc_isr(&usb_fs_device);
+    }
+    return 0;
+}
+
+static void host_send(uint32_t len)
+{
+    host.out_left = len;
+    host.out_zlp = !(len % EP_MPS);
+}
+
+static int engine_out(uint8_t *buf, uint32_t len, uint32_t host_len)
+{
+    xfer_done_calls = 0;
+    host_send(host_len);
+
+    if (usb_dc_ep_xfer_start(&usb_fs_device.parent, USB_SET_EP_OUT(EP_OUT), buf, len, xfer_done) != 0) {
+        return -1;
+    }
+    while (!xfer_done_calls) {
+        usb_dc_isr(&usb_fs_device);
+    }
+    return 0;
+}
+
+static int check_in(void)
+{
+    static const uint32_t lens[] = { 0, 1, 3, 63, 64, 65, 100, 128, 4095, 4096, 4097 };
+    static uint8_t buf[4097 + 4] __attribute__((aligned(4)));
+    uint32_t i, align, len, packets;
+    int failed = 0;
+
+    for (i = 0; i < sizeof(buf); i++) {
+        buf[i] = rand();
+    }
+
+    for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+        for (align = 0; align < 4; align++) {
+            len = lens[i];
+            host_reset();
+            engine_in(buf + align, len);
+            packets = (len + EP_MPS - 1) / EP_MPS + !(len % EP_MPS);
+
+            if (host.errors || xfer_done_calls != 1 || xfer_done_actual != len || host.in_taken != len ||
+                host.in_packets != packets || host.in_zlps != !(len % EP_MPS) || host.in_short) {
+                printf("  IN %u bytes at +%u: %u packets, %u zlp, done %d times with %u\n", len, align,
+                       host.in_packets, host.in_zlps, xfer_done_calls, xfer_done_actual);
+                failed++;
+            }
+        }
+    }
+
+    return failed;
+}
+
+static int check_out(void)
+{
+    static const uint32_t cases[][2] = {
+        /* buffer, host sends */
+        { 4096, 100 }, { 4096, 64 }, { 4096, 0 }, { 128, 128 }, { 128, 300 }, { 4096, 4096 }, { 4096, 4095 },
+    };
+    static uint8_t buf[4096 + 4] __attribute__((aligned(4)));
+    uint32_t i, j, align, expect;
+    int failed = 0;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        for (align = 0; align < 4; align++) {
+            host_reset();
+            memset(buf, 0, sizeof(buf));
+            expect = cases[i][1] < cases[i][0] ? cases[i][1] : cases[i][0];
+            engine_out(buf + align, cases[i][0], cases[i][1]);
+
+            for (j = 0; j < expect; j++) {
+                if (buf[align + j] != (uint8_t)(0x11 + (j / EP_MPS) * 37)) {
+                    break;
+                }
+            }
+
+            if (xfer_done_calls != 1 || xfer_done_actual != expect || j != expect || buf[align + expect] != 0) {
+                printf("  OUT %u into %u at +%u: done %d times with %u, bytes right up to %u\n", cases[i][1],
+                       cases[i][0], align, xfer_done_calls, xfer_done_actual, j);
+                failed++;
+            }
+        }
+    }
+
+    return failed;
+}
+
+static Ring_Buffer_Type rb;
+static uint8_t rb_mem[BENCH_UNIT];
+static uint32_t rb_written;
+
+static uint32_t rb_in_consumed(void)
+{
+    return rb_written - Ring_Buffer_Get_Length(&rb);
+}
+
+static void rb_lock(void) {}
+
+/* the CDC class: the next packet leaves the ring buffer once the last one is gone */
+static void class_callback(struct device *dev, void *args, uint32_t size, uint32_t event)
+{
+    if (event == USB_DC_EVENT_EP_IN_NOTIFY) {
+        usb_dc_send_from_ringbuffer(dev, &rb, USB_SET_EP_IN(EP_IN));
+    } else if (event == USB_DC_EVENT_EP_OUT_NOTIFY) {
+        usb_dc_receive_to_ringbuffer(dev, &rb, USB_SET_EP_OUT(EP_OUT));
+    }
+}
+
+/* writes that end on a full packet get a zero length packet, the others do not */
+static int check_ringbuffer_zlp(void)
+{
+    static uint8_t data[128];
+    static const uint32_t lens[] = { 128, 100, 64, 1 };
+    uint32_t i;
+    int failed = 0;
+
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = i * 7;
+    }
+
+    for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+        host_reset();
+        Ring_Buffer_Reset(&rb);
+        rb_written = Ring_Buffer_Write(&rb, data, lens[i]);
+        host.in_src = data;
+        host.in_consumed = rb_in_consumed;
+
+        usb_dc_send_from_ringbuffer(&usb_fs_device.parent, &rb, USB_SET_EP_IN(EP_IN));
+        while (host.int_sts) {
+            usb_dc_isr(&usb_fs_device);
+        }
+
+        if (host.errors || host.in_taken != lens[i] || host.in_zlps != !(lens[i] % EP_MPS)) {
+            printf("  ring buffer %u bytes: %u sent, %u zlp\n", lens[i], host.in_taken, host.in_zlps);
+            failed++;
+        }
+    }
+
+    return failed;
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static uint8_t bench_buf[BENCH_UNIT] __attribute__((aligned(4)));
+
+static void bench_engine_in(void)
+{
+    uint32_t done;
+
+    for (done = 0; done < BENCH_TOTAL; done += BENCH_UNIT) {
+        engine_in(bench_buf, BENCH_UNIT);
+    }
+}
+
+static void bench_engine_out(void)
+{
+    uint32_t done;
+
+    for (done = 0; done < BENCH_TOTAL; done += BENCH_UNIT) {
+        engine_out(bench_buf, BENCH_UNIT, BENCH_UNIT);
+    }
+}
+
+static void bench_rb_in(void)
+{
+    uint32_t done = 0;
+
+    Ring_Buffer_Reset(&rb);
+    rb_written = 0;
+    host.in_src = bench_buf;
+    host.in_consumed = rb_in_consumed;
+
+    while (host.in_taken < BENCH_TOTAL) {
+        if (done < BENCH_TOTAL && Ring_Buffer_Get_Length(&rb) == 0) {
+            rb_written += Ring_Buffer_Write(&rb, bench_buf, BENCH_UNIT);
+            done += BENCH_UNIT;
+            usb_dc_send_from_ringbuffer(&usb_fs_device.parent, &rb, USB_SET_EP_IN(EP_IN));
+        }
+        usb_dc_isr(&usb_fs_device);
+    }
+}
+
+static void bench_rb_out(void)
+{
+    uint32_t done = 0;
+
+    Ring_Buffer_Reset(&rb);
+    host_send(BENCH_TOTAL);
+    USB_Set_EPx_Rdy(EP_OUT);
+
+    while (done < BENCH_TOTAL) {
+        usb_dc_isr(&usb_fs_device);
+        done += Ring_Buffer_Read(&rb, bench_buf, BENCH_UNIT);
+    }
+}
+
+static void bench(const char *name, void (*run)(void))
+{
+    double mbps[BENCH_RUNS], start;
+    int i;
+
+    for (i = 0; i < BENCH_RUNS; i++) {
+        host_reset();
+        host.check = 0;
+        start = now_s();
+        run();
+        mbps[i] = BENCH_TOTAL / (now_s() - start) / 1e6;
+    }
+
+    qsort(mbps, BENCH_RUNS, sizeof(mbps[0]), cmp_double);
+    printf("  %-22s %7.0f MB/s\n", name, mbps[BENCH_RUNS / 2]);
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    srand(1);
+    usb_fs_device.parent.callback = class_callback;
+    usb_fs_device.in_ep[EP_IN].ep_ena = 1;
+    usb_fs_device.in_ep[EP_IN].ep_cfg.ep_mps = EP_MPS;
+    usb_fs_device.in_ep[EP_IN].ep_cfg.ep_type = USBD_EP_TYPE_BULK;
+    usb_fs_device.out_ep[EP_OUT].ep_ena = 1;
+    usb_fs_device.out_ep[EP_OUT].ep_cfg.ep_mps = EP_MPS;
+    usb_fs_device.out_ep[EP_OUT].ep_cfg.ep_type = USBD_EP_TYPE_BULK;
+    Ring_Buffer_Init(&rb, rb_mem, sizeof(rb_mem), rb_lock, rb_lock);
+
+    printf("engine IN\n");
+    failed += check_in();
+    printf("engine OUT\n");
+    failed += check_out();
+    printf("ring buffer zero length packets\n");
+    failed += check_ringbuffer_zlp();
+
+    printf("%u MB each way, %u byte units, host cpu\n", BENCH_TOTAL >> 20, BENCH_UNIT);
+    bench("IN  ring buffer", bench_rb_in);
+    bench("IN  engine", bench_engine_in);
+    bench("OUT ring buffer", bench_rb_out);
+    bench("OUT engine", bench_engine_out);
+
+    printf("%d failed\n", failed);
+    return failed ? 1 : 0;
+}
@@ -120,7 +120,9 @@ class FirmwareUpdateHandler @Inject constructor(
                             if (eraseFlash(size)) {
                                 var retry = 4
 
-                                while (retry > 0) {
+                                // The bootloader erases ahead of the writes and acks the erase
+                                // command straight away. Only reconnect if the link went anyway.
+                                while (retry > 0 && !gattInteractor.IsConnected()) {
                                     if (!gattInteractor.waitNewConnection()) {
                                         if (verifyInBootloaderMode()) {
                                             break
@@ -275,6 +277,9 @@ class FirmwareUpdateHandler @Inject constructor(
         val bytetosend = datapkg.getNextChunk()
         var is_write_success = false
         bytetosend?.let { is_write_success = writeRawData(it) }
+        if (is_write_success) {
+            awaitResponse()
+        }
         Logger.log("Flash erased")
 
         return is_write_success